@@ -325,6 +325,18 @@ bool node_name_eq(const struct ufdt_node *node, const char *name, int len);
  */
 int merge_ufdt_into(struct ufdt_node *tree_a, struct ufdt_node *tree_b);
 
+/*
+ * Same as merge_ufdt_into(), but also runs closure.func(node, closure.env)
+ * for every node of tree_a right before it gets properties from tree_b, and
+ * for every node and property moved from tree_b into tree_a.
+ * Lets a caller keep its own index of tree_a up to date while merging.
+ *
+ * @return: 0 if merge success
+ *          < 0 otherwise
+ */
+int merge_ufdt_into_notify(struct ufdt_node *tree_a, struct ufdt_node *tree_b,
+                           struct ufdt_node_closure closure);
+
 /*
  * BEGIN of ufdt output functions
  */
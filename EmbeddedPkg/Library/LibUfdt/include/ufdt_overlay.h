@@ -26,4 +26,13 @@ struct fdt_header *ufdt_apply_overlay(struct fdt_header *main_fdt_header,
 struct fdt_header *ufdt_apply_multi_overlay(struct fdt_header *main_fdt_header,
                                     size_t main_fdt_size,
                                     struct fdt_entry_node *overlay_dt_list);
+
+/* Returns about how much memory ufdt_apply_multi_overlay() takes from
+ * dto_malloc() for main_fdt_header and the overlays in overlay_dt_list,
+ * or 0 if one of them is not a valid FDT.
+ * It is meant to size a buffer dto_malloc() hands out memory from, which
+ * should still be able to grow past it.
+ */
+size_t ufdt_multi_overlay_mem_size(struct fdt_header *main_fdt_header,
+                                   struct fdt_entry_node *overlay_dt_list);
 #endif /* UFDT_OVERLAY_H */
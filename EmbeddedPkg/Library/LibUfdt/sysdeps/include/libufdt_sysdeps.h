@@ -62,7 +62,7 @@ void *dto_memchr(const void *s, int c, size_t n);
 
 void *dto_memset(void *s, int c, size_t n);
 
-void* pre_overlay_malloc();
+void *pre_overlay_malloc(size_t size);
 
 void post_overlay_free();
 
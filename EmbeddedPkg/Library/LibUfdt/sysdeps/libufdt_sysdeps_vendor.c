@@ -1,6 +1,6 @@
 #include "libufdt_sysdeps.h"
 #define EFI_DTBO_ERROR -1
-#define PRE_ALLOC_BUFFER_SZ (5 * 1024 * 1024)
+#define PRE_ALLOC_BUFFER_MIN_SZ (64 * 1024)
 
 #if INCLUDE_PLATFORM_HDRS
 #include <debug.h>
@@ -186,33 +186,73 @@ void dto_qsort(void *base, size_t nmemb, size_t size,
  * bootloader source with the names conforming to POSIX.
  */
 
-static void* buffer;
+/* dto_malloc() hands out memory from a buffer allocated up front, sized by
+ * the caller from its input (see ufdt_multi_overlay_mem_size()). Nothing is
+ * given back before post_overlay_free(). If the buffer runs out, another one
+ * is chained to it rather than failing the overlay.
+ */
+struct pre_alloc_buffer {
+	struct pre_alloc_buffer *next;
+	size_t size;
+	size_t used;
+};
+
+static struct pre_alloc_buffer *buffer;
+static size_t buffer_size;
 
-void* pre_overlay_malloc()
+static struct pre_alloc_buffer *pre_alloc_buffer_add(size_t size)
 {
-	buffer = AllocatePool(PRE_ALLOC_BUFFER_SZ);
-	if (!buffer) {
+	struct pre_alloc_buffer *new_buffer;
+
+	if (size > MAX_UINTN - sizeof(*new_buffer)) {
 		return NULL;
 	}
-	return buffer;
+	new_buffer = AllocatePool(sizeof(*new_buffer) + size);
+	if (!new_buffer) {
+		return NULL;
+	}
+	new_buffer->next = buffer;
+	new_buffer->size = size;
+	new_buffer->used = 0;
+	buffer = new_buffer;
+	return new_buffer;
+}
+
+void *pre_overlay_malloc(size_t size)
+{
+	post_overlay_free();
+
+	buffer_size = MAX(size, PRE_ALLOC_BUFFER_MIN_SZ);
+	return pre_alloc_buffer_add(buffer_size);
 }
 
 void post_overlay_free()
 {
-	if (buffer)
+	struct pre_alloc_buffer *next;
+
+	while (buffer) {
+		next = buffer->next;
 		FreePool(buffer);
+		buffer = next;
+	}
 }
 
 void *dto_malloc(size_t size) {
-	static int ssize = 0;
-        void *retbuf;
+	void *retbuf;
+
+	if (!buffer || size > MAX_UINTN - 7) {
+		return NULL;
+	}
+	/* Keep the returned pointers aligned for the ufdt structures */
+	size = ALIGN_VALUE(size, 8);
 
-	if (((MAX_UINT64 - ssize) < size) || ((ssize + size) > PRE_ALLOC_BUFFER_SZ)) {
+	if (buffer->size - buffer->used < size &&
+	    !pre_alloc_buffer_add(MAX(size, buffer_size / 4))) {
 		return NULL;
 	}
 
-	retbuf = buffer + ssize;
-	ssize += size;
+	retbuf = (UINT8 *)(buffer + 1) + buffer->used;
+	buffer->used += size;
 	return retbuf;
 }
 
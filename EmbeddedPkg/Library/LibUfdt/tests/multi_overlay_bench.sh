@@ -0,0 +1,73 @@
+#!/bin/bash
+
+# Applies the overlay of each test case in ./testdata to its base N times
+# (default 32) in one ufdt_apply_multi_overlay call, and checks the result
+# is the same blob as applying them one at a time with ufdt_apply_overlay.
+# The time ufdt_apply_multi_overlay takes is printed. Needs dtc and the
+# tools of "mmma system/libufdt"; QcomModulePkg/Tests/ufdt_overlay_test.sh
+# checks the same on the build machine with generated overlays.
+
+SCRIPT_DIR="$(dirname "$(readlink -f "$0")")"
+source ${SCRIPT_DIR}/common.sh
+
+on_exit() {
+  rm -rf "$TEMP_DIR"
+}
+
+# Constants
+IN_DATA_DIR="${SCRIPT_DIR}/testdata"
+
+# Usage: run_bench <test case> <count>
+run_bench() {
+  local testcase="$1"
+  local count="$2"
+  local base_dtb="$TEMP_DIR/${testcase}-base.dtb"
+  local overlay_dtb="$TEMP_DIR/${testcase}-overlay.dtb"
+  local multi_dtb="$TEMP_DIR/${testcase}-multi.dtb"
+  local chain_dtb="$TEMP_DIR/${testcase}-chain.dtb"
+  local overlays=()
+  local i
+
+  dtc -@ -qq -O dtb -o "$base_dtb" "$IN_DATA_DIR/${testcase}-base.dts"
+  dtc -@ -qq -O dtb -o "$overlay_dtb" "$IN_DATA_DIR/${testcase}-overlay.dts"
+
+  for ((i = 0; i < count; i++)); do
+    overlays+=("$overlay_dtb")
+  done
+
+  alert "${testcase}: ${count} overlays"
+  ufdt_apply_multi_overlay "$base_dtb" "$multi_dtb" "${overlays[@]}"
+
+  cp "$base_dtb" "$chain_dtb"
+  for ((i = 0; i < count; i++)); do
+    ufdt_apply_overlay "$chain_dtb" "$overlay_dtb" "$chain_dtb.new" > /dev/null
+    mv "$chain_dtb.new" "$chain_dtb"
+  done
+
+  cmp "$multi_dtb" "$chain_dtb" ||
+    die "Test case: ${testcase} multi overlay result differs!!"
+}
+
+main() {
+  local count="${1:-32}"
+
+  alert "========== Running Multi Overlay Benchmark of libufdt =========="
+
+  if ! command_exists dtc ||
+     ! command_exists ufdt_apply_overlay ||
+     ! command_exists ufdt_apply_multi_overlay; then
+    die "Run mmma $(dirname ${SCRIPT_DIR}) yet?"
+  fi
+
+  TEMP_DIR=`mktemp -d`
+  # The script will exit directly if any command fails.
+  set -e
+  trap on_exit EXIT
+
+  for base_dts in "$IN_DATA_DIR"/*-base.dts; do
+    local testcase=`basename "$base_dts" -base.dts`
+    run_bench "$testcase" "$count"
+  done
+}
+
+main "$@"
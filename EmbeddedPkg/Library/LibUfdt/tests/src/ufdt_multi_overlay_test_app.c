@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "ufdt_overlay.h"
+#include "libufdt_sysdeps.h"
+
+#include "util.h"
+
+
+int apply_multi_overlay_files(const char *out_filename,
+                              const char *base_filename,
+                              const char *const *overlay_filenames,
+                              int overlay_count) {
+  int ret = 1;
+  int i;
+  char *base_buf = NULL;
+  struct fdt_entry_node *overlay_list = NULL;
+  struct fdt_header *new_blob = NULL;
+
+  size_t blob_len;
+  base_buf = load_file(base_filename, &blob_len);
+  if (!base_buf) {
+    fprintf(stderr, "Can not load base file: %s\n", base_filename);
+    goto end;
+  }
+
+  overlay_list = calloc(overlay_count, sizeof(struct fdt_entry_node));
+  if (!overlay_list) {
+    fprintf(stderr, "Can not allocate the overlay list\n");
+    goto end;
+  }
+
+  for (i = 0; i < overlay_count; i++) {
+    size_t overlay_len;
+    char *overlay_buf = load_file(overlay_filenames[i], &overlay_len);
+    if (!overlay_buf) {
+      fprintf(stderr, "Can not load overlay file: %s\n", overlay_filenames[i]);
+      goto end;
+    }
+    overlay_list[i].address = (uintptr_t)overlay_buf;
+    overlay_list[i].size = overlay_len;
+    overlay_list[i].next = (i + 1 < overlay_count) ? &overlay_list[i + 1] : NULL;
+  }
+
+  struct fdt_header *blob = ufdt_install_blob(base_buf, blob_len);
+  if (!blob) {
+    fprintf(stderr, "ufdt_install_blob() returns null\n");
+    goto end;
+  }
+
+  size_t mem_size = ufdt_multi_overlay_mem_size(blob, overlay_list);
+
+  clock_t start = clock();
+  new_blob = ufdt_apply_multi_overlay(blob, blob_len, overlay_list);
+  clock_t end = clock();
+
+  if (write_fdt_to_file(out_filename, new_blob) != 0) {
+    fprintf(stderr, "Write file error: %s\n", out_filename);
+    goto end;
+  }
+
+  // Outputs the used time.
+  double cpu_time_used = ((double)(end - start)) / CLOCKS_PER_SEC;
+  printf("ufdt_apply_multi_overlay: %d overlays took %.9f secs, "
+         "estimated memory %zu bytes\n",
+         overlay_count, cpu_time_used, mem_size);
+  ret = 0;
+
+end:
+  // Do not dto_free(blob) - it's the same as base_buf.
+
+  if (new_blob) dto_free(new_blob);
+  if (overlay_list) {
+    for (i = 0; i < overlay_count; i++) {
+      if (overlay_list[i].address) dto_free((void *)overlay_list[i].address);
+    }
+    free(overlay_list);
+  }
+  if (base_buf) dto_free(base_buf);
+
+  return ret;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 4) {
+    fprintf(stderr,
+            "Usage: %s <base_file> <out_file> <overlay_file> [overlay_file...]\n",
+            argv[0]);
+    return 1;
+  }
+
+  const char *base_file = argv[1];
+  const char *out_file = argv[2];
+  int ret = apply_multi_overlay_files(out_file, base_file,
+                                      (const char *const *)&argv[3], argc - 3);
+
+  return ret;
+}
@@ -142,9 +142,22 @@ struct ufdt_node *ufdt_get_node_by_phandle(struct ufdt *tree,
   return res;
 }
 
-int merge_children(struct ufdt_node *node_a, struct ufdt_node *node_b) {
+static int merge_ufdt_into_closure(struct ufdt_node *node_a,
+                                   struct ufdt_node *node_b,
+                                   struct ufdt_node_closure *closure);
+
+static int merge_children_closure(struct ufdt_node *node_a,
+                                  struct ufdt_node *node_b,
+                                  struct ufdt_node_closure *closure) {
   int err = 0;
   struct ufdt_node *it;
+  if (closure != NULL) {
+    struct ufdt_node **it_prop;
+    for_each_prop(it_prop, node_b) {
+      closure->func(node_a, closure->env);
+      break;
+    }
+  }
   for (it = ((struct fdt_node_ufdt_node *)node_b)->child; it;) {
     struct ufdt_node *cur_node = it;
     it = it->sibling;
@@ -157,8 +170,11 @@ int merge_children(struct ufdt_node *node_a, struct ufdt_node *node_b) {
     }
     if (target_node == NULL) {
       err = ufdt_node_add_child(node_a, cur_node);
+      if (err == 0 && closure != NULL && tag_of(cur_node) == FDT_BEGIN_NODE) {
+        ufdt_node_map(cur_node, *closure);
+      }
     } else {
-      err = merge_ufdt_into(target_node, cur_node);
+      err = merge_ufdt_into_closure(target_node, cur_node, closure);
     }
     if (err < 0) return -1;
   }
@@ -174,19 +190,34 @@ int merge_children(struct ufdt_node *node_a, struct ufdt_node *node_b) {
   return 0;
 }
 
-int merge_ufdt_into(struct ufdt_node *node_a, struct ufdt_node *node_b) {
+int merge_children(struct ufdt_node *node_a, struct ufdt_node *node_b) {
+  return merge_children_closure(node_a, node_b, NULL);
+}
+
+static int merge_ufdt_into_closure(struct ufdt_node *node_a,
+                                   struct ufdt_node *node_b,
+                                   struct ufdt_node_closure *closure) {
   if (tag_of(node_a) == FDT_PROP) {
     node_a->fdt_tag_ptr = node_b->fdt_tag_ptr;
     return 0;
   }
 
   int err = 0;
-  err = merge_children(node_a, node_b);
+  err = merge_children_closure(node_a, node_b, closure);
   if (err < 0) return -1;
 
   return 0;
 }
 
+int merge_ufdt_into(struct ufdt_node *node_a, struct ufdt_node *node_b) {
+  return merge_ufdt_into_closure(node_a, node_b, NULL);
+}
+
+int merge_ufdt_into_notify(struct ufdt_node *node_a, struct ufdt_node *node_b,
+                           struct ufdt_node_closure closure) {
+  return merge_ufdt_into_closure(node_a, node_b, &closure);
+}
+
 void ufdt_map(struct ufdt *tree, struct ufdt_node_closure closure) {
   ufdt_node_map(tree->root, closure);
 }
@@ -30,6 +30,7 @@
 #include "ufdt_overlay.h"
 
 #include "libufdt.h"
+#include "ufdt_util.h"
 
 
 /*
@@ -64,17 +65,6 @@ static void fdt_increase_u32(void *pos, uint32_t offset) {
   dto_memcpy(pos, &val, sizeof(val));
 }
 
-/*
- * Gets the max phandle of a given ufdt.
- */
-static uint32_t ufdt_get_max_phandle(struct ufdt *tree) {
-  struct static_phandle_table sorted_table = tree->phandle_table;
-  if (sorted_table.len > 0)
-    return sorted_table.data[sorted_table.len - 1].phandle;
-  else
-    return 0;
-}
-
 /*
  * Tries to increase the phandle value of a node
  * if the phandle exists.
@@ -109,6 +99,275 @@ static void ufdt_try_increase_phandle(struct ufdt *tree, uint32_t offset) {
 
 /* END of operations about phandles in ufdt. */
 
+/* BEGIN of lookup caches of the main ufdt. */
+
+/*
+ * Applying an overlay only grows the main tree: nodes are added and
+ * properties are replaced, but no node is ever removed or moved. So a node
+ * found by its path stays valid until the tree is written out, and the
+ * phandle of a node changes only when properties are merged into it.
+ *
+ * struct ufdt_overlay_cache keeps what is looked up in the main tree across
+ * all the fragments and overlays applied to it:
+ * - a phandle -> node hash. Instead of rebuilding and sorting the phandle
+ *   table of the whole tree for every overlay, only the nodes the merges
+ *   touched are re-indexed once the overlay is applied. Like the rebuilt
+ *   table, the hash is what the tree was before the overlay while it is
+ *   being applied.
+ * - the properties of /__symbols__ by name,
+ * - the last nodes found by absolute path.
+ */
+
+#define UFDT_PATH_CACHE_SZ 256
+
+struct ufdt_phandle_slot {
+  uint32_t phandle;
+  struct ufdt_node *node;
+};
+
+struct ufdt_path_slot {
+  const char *path;
+  int len;
+  struct ufdt_node *node;
+};
+
+struct ufdt_overlay_cache {
+  struct ufdt *tree;
+  uint32_t max_phandle;
+  int phandle_size;
+  int phandle_used;
+  struct ufdt_phandle_slot *phandles;
+  /* Nodes touched by the current overlay, with their phandle back then */
+  int changed_size;
+  int changed_len;
+  struct ufdt_phandle_slot *changed;
+  int err;
+  struct ufdt_node *symbols_node;
+  struct ufdt_node_dict symbols;
+  struct ufdt_path_slot *paths;
+};
+
+/*
+ * Returns the slot of phandle, or the empty slot where it goes.
+ * phandles are mostly consecutive, so they are their own hash.
+ * A slot whose node is NULL is a removed phandle.
+ */
+static struct ufdt_phandle_slot *ufdt_phandle_slot_find(
+    struct ufdt_phandle_slot *slots, int size, uint32_t phandle) {
+  int idx = phandle & (size - 1);
+  while (slots[idx].phandle != 0 && slots[idx].phandle != phandle) {
+    idx = (idx + 1) & (size - 1);
+  }
+  return &slots[idx];
+}
+
+static int ufdt_overlay_cache_resize(struct ufdt_overlay_cache *cache,
+                                     int new_size) {
+  struct ufdt_phandle_slot *new_slots =
+      dto_malloc(new_size * sizeof(struct ufdt_phandle_slot));
+  if (new_slots == NULL) return -1;
+  dto_memset(new_slots, 0, new_size * sizeof(struct ufdt_phandle_slot));
+
+  cache->phandle_used = 0;
+  for (int i = 0; i < cache->phandle_size; i++) {
+    struct ufdt_phandle_slot *slot = &cache->phandles[i];
+    if (slot->node == NULL) continue;
+    *ufdt_phandle_slot_find(new_slots, new_size, slot->phandle) = *slot;
+    cache->phandle_used++;
+  }
+
+  dto_free(cache->phandles);
+  cache->phandles = new_slots;
+  cache->phandle_size = new_size;
+  return 0;
+}
+
+static int ufdt_overlay_cache_add_phandle(struct ufdt_overlay_cache *cache,
+                                          uint32_t phandle,
+                                          struct ufdt_node *node) {
+  /* Keep the table at most half full. */
+  if ((cache->phandle_used + 1) * 2 > cache->phandle_size &&
+      ufdt_overlay_cache_resize(cache, cache->phandle_size * 2) < 0) {
+    return -1;
+  }
+
+  struct ufdt_phandle_slot *slot = ufdt_phandle_slot_find(
+      cache->phandles, cache->phandle_size, phandle);
+  if (slot->phandle == 0) cache->phandle_used++;
+  slot->phandle = phandle;
+  slot->node = node;
+
+  if (phandle > cache->max_phandle) cache->max_phandle = phandle;
+  return 0;
+}
+
+/*
+ * Closure for merge_ufdt_into_notify(): notes a node of the main tree that
+ * is about to get properties, or was just added, with its phandle now.
+ */
+static void ufdt_overlay_cache_note_node(struct ufdt_node *node, void *env) {
+  struct ufdt_overlay_cache *cache = env;
+  if (tag_of(node) != FDT_BEGIN_NODE) return;
+
+  if (cache->changed_len == cache->changed_size) {
+    int new_size = cache->changed_size ? cache->changed_size * 2 : 64;
+    struct ufdt_phandle_slot *new_changed =
+        dto_malloc(new_size * sizeof(struct ufdt_phandle_slot));
+    if (new_changed == NULL) {
+      cache->err = -1;
+      return;
+    }
+    if (cache->changed_len > 0) {
+      dto_memcpy(new_changed, cache->changed,
+                 cache->changed_len * sizeof(struct ufdt_phandle_slot));
+    }
+    dto_free(cache->changed);
+    cache->changed = new_changed;
+    cache->changed_size = new_size;
+  }
+
+  cache->changed[cache->changed_len].phandle = ufdt_node_get_phandle(node);
+  cache->changed[cache->changed_len].node = node;
+  cache->changed_len++;
+}
+
+/*
+ * Re-indexes the nodes noted while applying an overlay: drops the phandles
+ * they had, then adds the ones they have now.
+ */
+static int ufdt_overlay_cache_update(struct ufdt_overlay_cache *cache) {
+  bool max_removed = false;
+  int i;
+
+  if (cache->err < 0) return -1;
+
+  for (i = 0; i < cache->changed_len; i++) {
+    struct ufdt_phandle_slot *old = &cache->changed[i];
+    if (old->phandle == 0) continue;
+
+    struct ufdt_phandle_slot *slot = ufdt_phandle_slot_find(
+        cache->phandles, cache->phandle_size, old->phandle);
+    if (slot->phandle == old->phandle && slot->node == old->node) {
+      slot->node = NULL;
+      if (old->phandle == cache->max_phandle) max_removed = true;
+    }
+  }
+
+  if (max_removed) {
+    cache->max_phandle = 0;
+    for (i = 0; i < cache->phandle_size; i++) {
+      struct ufdt_phandle_slot *slot = &cache->phandles[i];
+      if (slot->node != NULL && slot->phandle > cache->max_phandle)
+        cache->max_phandle = slot->phandle;
+    }
+  }
+
+  for (i = 0; i < cache->changed_len; i++) {
+    struct ufdt_node *node = cache->changed[i].node;
+    uint32_t phandle = ufdt_node_get_phandle(node);
+    if (phandle == 0) continue;
+
+    if (ufdt_overlay_cache_add_phandle(cache, phandle, node) < 0) return -1;
+  }
+
+  cache->changed_len = 0;
+  return 0;
+}
+
+static int ufdt_overlay_cache_init(struct ufdt_overlay_cache *cache,
+                                   struct ufdt *tree) {
+  struct static_phandle_table table = tree->phandle_table;
+  int size = 16;
+  while (size < table.len * 2) size <<= 1;
+
+  dto_memset(cache, 0, sizeof(*cache));
+  cache->tree = tree;
+  cache->phandles = dto_malloc(size * sizeof(struct ufdt_phandle_slot));
+  cache->paths = dto_malloc(UFDT_PATH_CACHE_SZ * sizeof(struct ufdt_path_slot));
+  if (cache->phandles == NULL || cache->paths == NULL) return -1;
+  dto_memset(cache->phandles, 0, size * sizeof(struct ufdt_phandle_slot));
+  dto_memset(cache->paths, 0,
+             UFDT_PATH_CACHE_SZ * sizeof(struct ufdt_path_slot));
+  cache->phandle_size = size;
+
+  for (int i = 0; i < table.len; i++) {
+    if (ufdt_overlay_cache_add_phandle(cache, table.data[i].phandle,
+                                       table.data[i].node) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+static void ufdt_overlay_cache_destruct(struct ufdt_overlay_cache *cache) {
+  if (cache->symbols_node != NULL) ufdt_node_dict_destruct(&cache->symbols);
+  dto_free(cache->phandles);
+  dto_free(cache->changed);
+  dto_free(cache->paths);
+}
+
+static struct ufdt_node *ufdt_overlay_get_node_by_phandle(
+    struct ufdt_overlay_cache *cache, uint32_t phandle) {
+  if (phandle == 0) return NULL;
+
+  return ufdt_phandle_slot_find(cache->phandles, cache->phandle_size,
+                                phandle)->node;
+}
+
+/*
+ * Same as ufdt_get_node_by_path() on the main tree, remembering the nodes
+ * found by absolute path. Misses are not cached since a later fragment may
+ * add the node, and aliases are not cached since an overlay may change them.
+ */
+static struct ufdt_node *ufdt_overlay_get_node_by_path(
+    struct ufdt_overlay_cache *cache, const char *path) {
+  if (*path != '/') return ufdt_get_node_by_path(cache->tree, path);
+
+  int len = dto_strlen(path);
+  struct ufdt_path_slot *slot =
+      &cache->paths[(unsigned int)get_hash_len(path, len) &
+                    (UFDT_PATH_CACHE_SZ - 1)];
+  if (slot->node != NULL && slot->len == len &&
+      dto_strncmp(slot->path, path, len) == 0) {
+    return slot->node;
+  }
+
+  struct ufdt_node *node = ufdt_get_node_by_path_len(cache->tree, path, len);
+  if (node != NULL) {
+    slot->path = path;
+    slot->len = len;
+    slot->node = node;
+  }
+  return node;
+}
+
+/*
+ * Returns the path of symbol in /__symbols__ of the main tree. A symbol
+ * added by an overlay is not in the dict yet and is looked up directly.
+ */
+static const char *ufdt_overlay_get_symbol(struct ufdt_overlay_cache *cache,
+                                           struct ufdt_node *symbols_node,
+                                           const char *symbol) {
+  if (cache->symbols_node != symbols_node) {
+    struct ufdt_node **it;
+    if (cache->symbols_node != NULL) ufdt_node_dict_destruct(&cache->symbols);
+    cache->symbols = ufdt_node_dict_construct();
+    cache->symbols_node = symbols_node;
+    for_each_prop(it, symbols_node) {
+      /* Like the linear lookup, the first of duplicate names wins. */
+      if (ufdt_node_dict_find_node(&cache->symbols, name_of(*it)) == NULL)
+        ufdt_node_dict_add(&cache->symbols, *it);
+    }
+  }
+
+  struct ufdt_node *prop = ufdt_node_dict_find_node(&cache->symbols, symbol);
+  if (prop == NULL) {
+    prop = ufdt_node_get_property_by_name(symbols_node, symbol);
+  }
+  return ufdt_node_get_fdt_prop_data(prop, NULL);
+}
+
+/* END of lookup caches of the main ufdt. */
+
 /*
  * In the overlay_tree, there are some references (phandle)
  * pointing to somewhere in the main_tree.
@@ -128,66 +387,60 @@ static void ufdt_try_increase_phandle(struct ufdt *tree, uint32_t offset) {
  * where 8 is sizeof(uint32) + sizeof(unit32).
  */
 static void *ufdt_get_fixup_location(struct ufdt *tree, const char *fixup) {
-  char *path, *prop_ptr, *offset_ptr, *end_ptr;
-  int prop_offset, prop_len;
+  const char *prop_ptr, *offset_ptr;
+  char *end_ptr;
+  int path_len, prop_name_len, prop_offset, prop_len;
   const char *prop_data;
 
   /*
-   * TODO(akaineko): Keep track of substring lengths so we don't have to
-   * dto_malloc a copy and split it up.
+   * Split the fixup in place by the lengths of its parts instead of
+   * splitting a dto_strdup() copy, which is never freed back to the
+   * pre-allocated buffer.
    */
-  path = dto_strdup(fixup);
-  prop_ptr = dto_strchr(path, ':');
+  prop_ptr = dto_strchr(fixup, ':');
   if (prop_ptr == NULL) {
-    dto_error("Missing property part in '%s'\n", path);
-    goto fail;
+    dto_error("Missing property part in '%s'\n", fixup);
+    return NULL;
   }
-
-  *prop_ptr = '\0';
+  path_len = prop_ptr - fixup;
   prop_ptr++;
 
   offset_ptr = dto_strchr(prop_ptr, ':');
   if (offset_ptr == NULL) {
-    dto_error("Missing offset part in '%s'\n", path);
-    goto fail;
+    dto_error("Missing offset part in '%s'\n", fixup);
+    return NULL;
   }
-
-  *offset_ptr = '\0';
+  prop_name_len = offset_ptr - prop_ptr;
   offset_ptr++;
 
   prop_offset = dto_strtoul(offset_ptr, &end_ptr, 10 /* base */);
   if (*end_ptr != '\0') {
     dto_error("'%s' is not valid number\n", offset_ptr);
-    goto fail;
+    return NULL;
   }
 
   struct ufdt_node *target_node;
-  target_node = ufdt_get_node_by_path(tree, path);
+  target_node = ufdt_get_node_by_path_len(tree, fixup, path_len);
   if (target_node == NULL) {
-    dto_error("Path '%s' not found\n", path);
-    goto fail;
+    dto_error("Path not found in '%s'\n", fixup);
+    return NULL;
   }
 
-  prop_data =
-      ufdt_node_get_fdt_prop_data_by_name(target_node, prop_ptr, &prop_len);
+  prop_data = ufdt_node_get_fdt_prop_data_by_name_len(
+      target_node, prop_ptr, prop_name_len, &prop_len);
   if (prop_data == NULL) {
-    dto_error("Property '%s' not found in  '%s' node\n", prop_ptr, path);
-    goto fail;
+    dto_error("Property not found in '%s'\n", fixup);
+    return NULL;
   }
   /*
    * Note that prop_offset is the offset inside the property data.
    */
   if (prop_len < prop_offset + (int)sizeof(uint32_t)) {
-    dto_error("%s: property length is too small for fixup\n", path);
-    goto fail;
+    dto_error("%s: property length is too small for fixup\n", fixup);
+    return NULL;
   }
 
-  dto_free(path);
   return (char *)prop_data + prop_offset;
-
-fail:
-  dto_free(path);
-  return NULL;
 }
 
 /*
@@ -223,12 +476,12 @@ static int ufdt_do_one_fixup(struct ufdt *tree, const char *fixups,
  * Handle __fixups__ node in overlay tree.
  */
 
-static int ufdt_overlay_do_fixups(struct ufdt *main_tree,
+static int ufdt_overlay_do_fixups(struct ufdt_overlay_cache *cache,
                                   struct ufdt *overlay_tree) {
   int len = 0;
   struct ufdt_node *main_symbols_node, *overlay_fixups_node;
 
-  main_symbols_node = ufdt_get_node_by_path(main_tree, "/__symbols__");
+  main_symbols_node = ufdt_overlay_get_node_by_path(cache, "/__symbols__");
   overlay_fixups_node = ufdt_get_node_by_path(overlay_tree, "/__fixups__");
 
   if (!main_symbols_node) {
@@ -252,8 +505,8 @@ static int ufdt_overlay_do_fixups(struct ufdt *main_tree,
      */
 
     struct ufdt_node *fixups = *it;
-    char *symbol_path = ufdt_node_get_fdt_prop_data_by_name(
-        main_symbols_node, name_of(fixups), &len);
+    const char *symbol_path =
+        ufdt_overlay_get_symbol(cache, main_symbols_node, name_of(fixups));
 
     if (!symbol_path) {
       dto_error("Couldn't find '%s' symbol in main dtb\n", name_of(fixups));
@@ -261,7 +514,7 @@ static int ufdt_overlay_do_fixups(struct ufdt *main_tree,
     }
 
     struct ufdt_node *symbol_node;
-    symbol_node = ufdt_get_node_by_path(main_tree, symbol_path);
+    symbol_node = ufdt_overlay_get_node_by_path(cache, symbol_path);
 
     if (!symbol_node) {
       dto_error("Couldn't find '%s' path in main dtb\n", symbol_path);
@@ -300,9 +553,16 @@ static int ufdt_overlay_do_fixups(struct ufdt *main_tree,
 /*
  * Overlay the overlay_node over target_node.
  */
-static int ufdt_overlay_node(struct ufdt_node *target_node,
+static int ufdt_overlay_node(struct ufdt_overlay_cache *cache,
+                             struct ufdt_node *target_node,
                              struct ufdt_node *overlay_node) {
-  return merge_ufdt_into(target_node, overlay_node);
+  struct ufdt_node_closure closure;
+  closure.func = ufdt_overlay_cache_note_node;
+  closure.env = cache;
+
+  int err = merge_ufdt_into_notify(target_node, overlay_node, closure);
+  if (err < 0 || cache->err < 0) return -1;
+  return 0;
 }
 
 /*
@@ -321,7 +581,7 @@ enum overlay_result {
 /*
  * Apply one overlay fragment (subtree).
  */
-static enum overlay_result ufdt_apply_fragment(struct ufdt *tree,
+static enum overlay_result ufdt_apply_fragment(struct ufdt_overlay_cache *cache,
                                                struct ufdt_node *frag_node) {
   uint32_t target;
   const char *target_path;
@@ -333,7 +593,7 @@ static enum overlay_result ufdt_apply_fragment(struct ufdt *tree,
   if (val) {
     dto_memcpy(&target, val, sizeof(target));
     target = fdt32_to_cpu(target);
-    target_node = ufdt_get_node_by_phandle(tree, target);
+    target_node = ufdt_overlay_get_node_by_phandle(cache, target);
     if (target_node == NULL) {
       dto_error("failed to find target %04x\n", target);
       return OVERLAY_RESULT_TARGET_INVALID;
@@ -347,7 +607,7 @@ static enum overlay_result ufdt_apply_fragment(struct ufdt *tree,
       return OVERLAY_RESULT_MISSING_TARGET;
     }
 
-    target_node = ufdt_get_node_by_path(tree, target_path);
+    target_node = ufdt_overlay_get_node_by_path(cache, target_path);
     if (target_node == NULL) {
       dto_error("failed to find target-path %s\n", target_path);
       return OVERLAY_RESULT_TARGET_PATH_INVALID;
@@ -360,7 +620,7 @@ static enum overlay_result ufdt_apply_fragment(struct ufdt *tree,
     return OVERLAY_RESULT_MISSING_OVERLAY;
   }
 
-  int err = ufdt_overlay_node(target_node, overlay_node);
+  int err = ufdt_overlay_node(cache, target_node, overlay_node);
 
   if (err < 0) {
     dto_error("failed to overlay node %s to target %s\n", name_of(overlay_node),
@@ -374,7 +634,7 @@ static enum overlay_result ufdt_apply_fragment(struct ufdt *tree,
 /*
  * Applies all fragments to the main_tree.
  */
-static int ufdt_overlay_apply_fragments(struct ufdt *main_tree,
+static int ufdt_overlay_apply_fragments(struct ufdt_overlay_cache *cache,
                                         struct ufdt *overlay_tree) {
   enum overlay_result err;
   struct ufdt_node **it;
@@ -383,7 +643,7 @@ static int ufdt_overlay_apply_fragments(struct ufdt *main_tree,
    * In such case, ufdt_apply_fragment would fail with return value = -1.
    */
   for_each_node(it, overlay_tree->root) {
-    err = ufdt_apply_fragment(main_tree, *it);
+    err = ufdt_apply_fragment(cache, *it);
     if (err == OVERLAY_RESULT_MERGE_FAIL) {
       return -1;
     }
@@ -482,10 +742,10 @@ static int ufdt_local_fixup_node(struct ufdt_node *target_node,
   return 0;
 }
 
-static int ufdt_overlay_root_node(struct ufdt *tree,
+static int ufdt_overlay_root_node(struct ufdt_overlay_cache *cache,
                                      struct ufdt *overlay_tree)
 {
-     struct ufdt_node *target_node = ufdt_get_node_by_path(tree, "/");
+     struct ufdt_node *target_node = cache->tree->root;
      struct ufdt_node *overlay_node = ufdt_get_node_by_path(overlay_tree, "/");
      struct ufdt_node **it_prop;
      struct ufdt_node *target_prop;
@@ -493,6 +753,7 @@ static int ufdt_overlay_root_node(struct ufdt *tree,
      if(!target_node)
           return 0;
 
+     ufdt_overlay_cache_note_node(target_node, cache);
      for_each_prop(it_prop, overlay_node) {
           target_prop =
                ufdt_node_get_property_by_name(target_node, name_of(*it_prop));
@@ -539,11 +800,11 @@ static int ufdt_overlay_do_local_fixups(struct ufdt *tree,
   return 0;
 }
 
-static int ufdt_overlay_local_ref_update(struct ufdt *main_tree,
+static int ufdt_overlay_local_ref_update(struct ufdt_overlay_cache *cache,
                                          struct ufdt *overlay_tree) {
   uint32_t phandle_offset = 0;
 
-  phandle_offset = ufdt_get_max_phandle(main_tree);
+  phandle_offset = cache->max_phandle;
   if (phandle_offset > 0) {
     ufdt_try_increase_phandle(overlay_tree, phandle_offset);
   }
@@ -558,7 +819,8 @@ static int ufdt_overlay_local_ref_update(struct ufdt *main_tree,
 
 /* END of updating local references (phandle values) in the overlay ufdt. */
 
-static int ufdt_overlay_apply(struct ufdt *main_tree, struct ufdt *overlay_tree,
+static int ufdt_overlay_apply(struct ufdt_overlay_cache *cache,
+                              struct ufdt *overlay_tree,
                               size_t overlay_length) {
   if (overlay_length < sizeof(struct fdt_header)) {
     dto_error("Overlay_length %zu smaller than header size %zu\n",
@@ -566,23 +828,28 @@ static int ufdt_overlay_apply(struct ufdt *main_tree, struct ufdt *overlay_tree,
     return -1;
   }
 
-  if(ufdt_overlay_root_node(main_tree, overlay_tree))
+  if(ufdt_overlay_root_node(cache, overlay_tree))
        return -1;
 
-  if (ufdt_overlay_local_ref_update(main_tree, overlay_tree) < 0) {
+  if (ufdt_overlay_local_ref_update(cache, overlay_tree) < 0) {
     dto_error("failed to perform local fixups in overlay\n");
     return -1;
   }
 
-  if (ufdt_overlay_do_fixups(main_tree, overlay_tree) < 0) {
+  if (ufdt_overlay_do_fixups(cache, overlay_tree) < 0) {
     dto_error("failed to perform fixups in overlay\n");
     return -1;
   }
-  if (ufdt_overlay_apply_fragments(main_tree, overlay_tree) < 0) {
+  if (ufdt_overlay_apply_fragments(cache, overlay_tree) < 0) {
     dto_error("failed to apply fragments\n");
     return -1;
   }
 
+  if (ufdt_overlay_cache_update(cache) < 0) {
+    dto_error("failed to update the phandle index\n");
+    return -1;
+  }
+
   return 0;
 }
 
@@ -647,12 +914,19 @@ struct fdt_header *ufdt_apply_overlay(struct fdt_header *main_fdt_header,
   }
 
   struct ufdt *main_tree, *overlay_tree;
+  struct ufdt_overlay_cache cache;
 
   main_tree = fdt_to_ufdt(main_fdt_header, main_fdt_size);
 
   overlay_tree = fdt_to_ufdt(overlay_fdtp, overlay_size);
 
-  int err = ufdt_overlay_apply(main_tree, overlay_tree, overlay_size);
+  int err = ufdt_overlay_cache_init(&cache, main_tree);
+  if (err < 0) {
+    dto_error("failed to allocate memory for ufdt lookup caches\n");
+    goto fail;
+  }
+
+  err = ufdt_overlay_apply(&cache, overlay_tree, overlay_size);
   if (err < 0) {
     goto fail;
   }
@@ -663,22 +937,56 @@ struct fdt_header *ufdt_apply_overlay(struct fdt_header *main_fdt_header,
     goto fail;
   }
 
+  ufdt_overlay_cache_destruct(&cache);
   ufdt_destruct(main_tree);
   ufdt_destruct(overlay_tree);
   return out_fdt_header;
 
 fail:
+  ufdt_overlay_cache_destruct(&cache);
   ufdt_destruct(main_tree);
   ufdt_destruct(overlay_tree);
   dto_free(out_fdt_header);
   return NULL;
 }
 
+/*
+ * Besides the output, which takes the size of all the input FDTs, each tree
+ * takes about twice the size of its structure block as ufdt nodes, phandle
+ * tables and lookup caches.
+ */
+#define UFDT_MEM_STRUCT_FACTOR 3
+#define UFDT_MEM_SLACK (64 * 1024)
+
+size_t ufdt_multi_overlay_mem_size(struct fdt_header *main_fdt_header,
+                                   struct fdt_entry_node *overlay_dt_list) {
+  size_t mem_size = UFDT_MEM_SLACK;
+
+  if (main_fdt_header == NULL || fdt_check_header(main_fdt_header) < 0) {
+    return 0;
+  }
+  mem_size += fdt_totalsize(main_fdt_header) +
+              UFDT_MEM_STRUCT_FACTOR * fdt_size_dt_struct(main_fdt_header);
+
+  while (overlay_dt_list != NULL) {
+    void *overlay_fdtp = (void *)overlay_dt_list->address;
+    if (overlay_fdtp == NULL || fdt_check_header(overlay_fdtp) < 0) {
+      return 0;
+    }
+    mem_size += fdt_totalsize(overlay_fdtp) +
+                UFDT_MEM_STRUCT_FACTOR * fdt_size_dt_struct(overlay_fdtp);
+    overlay_dt_list = overlay_dt_list->next;
+  }
+
+  return mem_size;
+}
+
 struct fdt_header *ufdt_apply_multi_overlay(struct fdt_header *main_fdt_header,
                                     size_t main_fdt_size,
                                     struct fdt_entry_node *overlay_dt_list) {
   size_t out_fdt_size = 0;
   struct ufdt *main_tree, *overlay_tree;
+  struct ufdt_overlay_cache cache;
   struct fdt_header *out_fdt_header;
   struct fdt_entry_node *temp = NULL;
   int err, i=0;
@@ -717,32 +1025,25 @@ struct fdt_header *ufdt_apply_multi_overlay(struct fdt_header *main_fdt_header,
     return NULL;
   }
 
-  main_tree = fdt_to_ufdt((void *)main_fdt_header, main_fdt_size);
-
-  /* Apply overlay with first dts from the list, and iterate the loop from
-     index 1 to avoid unnecessary rebuilding of phandle table
+  /*
+   * The main tree is built once and written out once. Its phandle index
+   * and path lookups are kept up to date across the overlays by the cache
+   * instead of being rebuilt for each one.
    */
-
-  /* Recover list from saved copy */
-  overlay_dt_list = temp;
-  i=1;
-  overlay_tree = fdt_to_ufdt((void *)overlay_dt_list->address,
-                             overlay_dt_list->size);
-  err = ufdt_overlay_apply(main_tree, overlay_tree, overlay_dt_list->size);
-  ufdt_destruct(overlay_tree);
+  main_tree = fdt_to_ufdt((void *)main_fdt_header, main_fdt_size);
+  err = ufdt_overlay_cache_init(&cache, main_tree);
   if (err < 0) {
-    dto_error("Failed to apply devie tree\n");
+    dto_error("failed to allocate memory for ufdt lookup caches\n");
     goto fail;
   }
 
-  overlay_dt_list = overlay_dt_list->next;
+  /* Recover list from saved copy */
+  overlay_dt_list = temp;
+  i = 0;
   while (overlay_dt_list != NULL) {
     overlay_tree = fdt_to_ufdt((void *)overlay_dt_list->address,
                                overlay_dt_list->size);
-    /* Rebuild the phandle_table for the combined tree.*/
-    main_tree->phandle_table = build_phandle_table(main_tree);
-
-    err = ufdt_overlay_apply(main_tree, overlay_tree, overlay_dt_list->size);
+    err = ufdt_overlay_apply(&cache, overlay_tree, overlay_dt_list->size);
     ufdt_destruct(overlay_tree);
     if (err < 0) {
       dto_error("Failed to apply devie tree, index: %d\n", i);
@@ -758,10 +1059,12 @@ struct fdt_header *ufdt_apply_multi_overlay(struct fdt_header *main_fdt_header,
     goto fail;
   }
 
+  ufdt_overlay_cache_destruct(&cache);
   ufdt_destruct(main_tree);
   return out_fdt_header;
 
 fail:
+  ufdt_overlay_cache_destruct(&cache);
   ufdt_destruct(main_tree);
   dto_free(out_fdt_header);
   return NULL;
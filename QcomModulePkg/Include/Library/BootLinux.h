@@ -64,6 +64,7 @@
 
 #include "Board.h"
 #include "BootImage.h"
+#include "BootTrace.h"
 #include "Decompress.h"
 #include "DeviceInfo.h"
 #include "LinuxLoaderLib.h"
@@ -185,7 +186,13 @@ typedef struct BootLinuxParamlist {
   CHAR8 *CmdLine;
   BOOLEAN BootingWith32BitKernel;
   BOOLEAN BootingWithPatchedKernel;
-  BOOLEAN BootingWithGzipPkgKernel;
+  BOOLEAN BootingWithCompressedKernel;
+  CONST KERNEL_DECOMPRESSOR *KernelDecompressor;
+
+  /* Bytes copied and decompressed into the kernel, ramdisk and dtb load
+   * regions, reported in the boot log with the peak footprint */
+  UINT64 CopyBytes;
+  UINT64 DecompressBytes;
 } BootParamlist;
 
 EFI_STATUS
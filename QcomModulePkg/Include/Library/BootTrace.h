@@ -0,0 +1,114 @@
+/* Copyright (c) 2021, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BOOT_TRACE_H__
+#define __BOOT_TRACE_H__
+
+#include <Uefi.h>
+
+/* Spans recorded by the boot trace. BootTraceNames in BootTrace.c must be
+ * kept in the same order.
+ */
+typedef enum {
+  BT_LOAD_PARTITION = 0,
+  BT_AVB_READ,
+  BT_AVB_VERIFY,
+  BT_KERNEL_DECOMPRESS,
+  BT_APPLY_OVERLAY,
+  BT_UPDATE_DEVICE_TREE,
+  BT_PARTIAL_GOODS,
+  BT_ID_MAX,
+} BOOT_TRACE_ID;
+
+#define BOOT_TRACE_MAX_EVENTS 128
+
+/* Cells of an event in the "qcom,boot-trace" property: id, start (us),
+ * duration (us) and bytes, the bytes saturate at MAX_UINT32.
+ */
+#define BOOT_TRACE_DT_CELLS 4
+
+/* Room BootTraceExport needs in the device tree, the event cells plus the
+ * names and property headers.
+ */
+#define BOOT_TRACE_DT_SIZE                                                     \
+  (BOOT_TRACE_MAX_EVENTS * BOOT_TRACE_DT_CELLS * sizeof (UINT32) + 256)
+
+/* Event of the ring, times are in microseconds since the timer started */
+typedef struct {
+  UINT32 Seq;
+  UINT32 Id;
+  UINT64 StartUs;
+  UINT64 DurationUs;
+  UINT64 Bytes;
+} BOOT_TRACE_EVENT;
+
+/* BOOT_TRACE_BEGIN (Span) starts a span in the current scope, which
+ * BOOT_TRACE_END (Span, Id, Bytes) records as event Id.
+ */
+#define BOOT_TRACE_BEGIN(Span) UINT64 Span##TraceStart = BootTraceNowUs ()
+#define BOOT_TRACE_END(Span, Id, Bytes)                                        \
+  BootTraceRecord ((Id), Span##TraceStart, (Bytes))
+
+UINT64
+BootTraceNowUs (VOID);
+
+VOID
+BootTraceRecord (BOOT_TRACE_ID Id, UINT64 StartUs, UINT64 Bytes);
+
+CONST CHAR8 *
+BootTraceName (UINT32 Id);
+
+/* Copies the recorded events, oldest first, to Events and returns how many
+ * were copied. Slots still being written are skipped.
+ */
+UINT32
+BootTraceSnapshot (BOOT_TRACE_EVENT *Events, UINT32 MaxEvents);
+
+/* Adds the recorded events to the node at NodeOffset of Fdt */
+EFI_STATUS
+BootTraceExport (VOID *Fdt, INT32 NodeOffset);
+
+/* Saves the recorded events to the memory kept over warm resets, when the
+ * platform has set BootTracePersistBase.
+ */
+VOID
+BootTraceSave (VOID);
+
+/* Whether the platform keeps the trace over warm resets, BootTracePersistBase
+ * and BootTracePersistSize are 0 unless its DSC sets them.
+ */
+BOOLEAN
+BootTraceKeepsPrevious (VOID);
+
+/* Copies the events saved by the previous boot to Events and returns how
+ * many were copied, 0 when none were saved.
+ */
+UINT32
+BootTracePrevious (BOOT_TRACE_EVENT *Events, UINT32 MaxEvents);
+
+#endif
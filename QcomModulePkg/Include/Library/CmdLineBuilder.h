@@ -0,0 +1,88 @@
+/* Copyright (c) 2021, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __CMDLINE_BUILDER_H__
+#define __CMDLINE_BUILDER_H__
+
+#include <Uefi.h>
+
+/* Offset of a key in the builder buffer, and the last token using it */
+typedef struct {
+  UINT32 Offset;
+  UINT32 Len;
+  UINT32 Hash;
+  UINT32 Last;
+} CMDLINE_KEY;
+
+/* A command line is built in two passes over the same appends. The first
+ * pass, with no buffer, only counts the bytes and the keys, then
+ * CmdLineBuilderAllocate () takes one allocation for both and the second
+ * pass writes them at the length cursor. The keys are found through an
+ * open addressed hash table of key indexes plus one, 0 is a free slot.
+ */
+typedef struct {
+  CHAR8 *Buf;
+  UINTN Size;
+  UINTN Len;
+  CMDLINE_KEY *Keys;
+  UINTN NumKeys;
+  UINTN MaxKeys;
+  UINT32 *Table;
+  UINTN TableMask;
+  BOOLEAN Overflow;
+} CMDLINE_BUILDER;
+
+VOID
+CmdLineBuilderInit (CMDLINE_BUILDER *Builder);
+
+VOID
+CmdLineBuilderAppendN (CMDLINE_BUILDER *Builder,
+                       CONST CHAR8 *Str,
+                       UINTN Len);
+
+VOID
+CmdLineBuilderAppend (CMDLINE_BUILDER *Builder, CONST CHAR8 *Str);
+
+VOID
+CmdLineBuilderMergeN (CMDLINE_BUILDER *Builder,
+                      CONST CHAR8 *Str,
+                      UINTN Len);
+
+VOID
+CmdLineBuilderMerge (CMDLINE_BUILDER *Builder, CONST CHAR8 *Str);
+
+EFI_STATUS
+CmdLineBuilderAllocate (CMDLINE_BUILDER *Builder);
+
+EFI_STATUS
+CmdLineBuilderFinish (CMDLINE_BUILDER *Builder, CHAR8 **CmdLine);
+
+VOID
+CmdLineBuilderFree (CMDLINE_BUILDER *Builder);
+
+#endif
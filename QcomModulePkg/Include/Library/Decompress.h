@@ -32,6 +32,9 @@
 int
 is_gzip_package (unsigned char *, unsigned int);
 
+int
+is_lz4_package (unsigned char *, unsigned int);
+
 int
 decompress (unsigned char *,
             unsigned int,
@@ -39,4 +42,32 @@ decompress (unsigned char *,
             unsigned int,
             unsigned int *,
             unsigned int *);
+
+int
+lz4_decompress (unsigned char *,
+                unsigned int,
+                unsigned char *,
+                unsigned int,
+                unsigned int *,
+                unsigned int *);
+
+/* A kernel compression format, chosen by the magic at the start of the
+ * kernel. Decompress has the arguments and return value of decompress().
+ */
+typedef struct {
+  const char *Name;
+  int (*IsPackage) (unsigned char *, unsigned int);
+  int (*Decompress) (unsigned char *,
+                     unsigned int,
+                     unsigned char *,
+                     unsigned int,
+                     unsigned int *,
+                     unsigned int *);
+} KERNEL_DECOMPRESSOR;
+
+/* Returns the decompressor for the kernel in buf, NULL if it is not
+ * compressed in a known format.
+ */
+const KERNEL_DECOMPRESSOR *
+get_kernel_decompressor (unsigned char *, unsigned int);
 #endif /* __PLATFORM_MSM_SHARED_DECOMPRESS_H */
@@ -38,30 +38,28 @@ typedef struct _FDT_FIRST_LEVEL_NODE {
 
 INT32 FdtPathOffset (CONST VOID *Fdt, CONST CHAR8 *Path);
 INT32 FdtGetPropLen (VOID *Fdt, INT32 Offset, CONST CHAR8 *Name);
-VOID FdtUpdateNodeOffsetInList (INT32 NodeOffset, INT32 DiffLen);
 INT32 FdtSetProp (VOID *Fdt, INT32 Offset, CONST CHAR8 *Name,
                     CONST VOID *Val, INT32 Len);
+INT32 FdtAppendProp (VOID *Fdt, INT32 Offset, CONST CHAR8 *Name,
+                     CONST VOID *Val, INT32 Len);
+INT32 FdtAppendPropString (VOID *Fdt, INT32 Offset, CONST CHAR8 *Name,
+                           CONST CHAR8 *Str);
+INT32 FdtSetPropU32 (VOID *Fdt, INT32 Offset, CONST CHAR8 *Name, UINT32 Val);
+INT32 FdtSetPropU64 (VOID *Fdt, INT32 Offset, CONST CHAR8 *Name, UINT64 Val);
+INT32 FdtAppendPropU32 (VOID *Fdt, INT32 Offset, CONST CHAR8 *Name,
+                        UINT32 Val);
+INT32 FdtAppendPropU64 (VOID *Fdt, INT32 Offset, CONST CHAR8 *Name,
+                        UINT64 Val);
+
+/* Property edits between FdtEditBegin () and FdtEditCommit () are queued
+ * and applied to the blob in one rewrite, node offsets do not move until
+ * the commit. Begin/commit pairs on the same blob nest.
+ */
+INT32 FdtEditBegin (VOID *Fdt);
+INT32 FdtEditCommit (VOID *Fdt);
+VOID FdtEditCancel (VOID);
 
 #define FDT_ALIGN(x, a) (((x) + (a)-1) & ~((a)-1))
 #define FDT_TAGALIGN(x) (FDT_ALIGN((x), FDT_TAGSIZE))
 
-#define FdtPropUpdateFunc(Fdt, Offset, Name, Val, FdtUpdateFunc, RetValue) \
-  do {                                                                     \
-    if (FixedPcdGetBool (EnableNewNodeSearchFuc)) {                        \
-      INT32 OldLen = FdtGetPropLen (Fdt, Offset, Name);                    \
-      RetValue = FdtUpdateFunc (Fdt, Offset, Name, Val);                   \
-      if (RetValue == 0) {                                                 \
-        INT32 NewLen = FdtGetPropLen (Fdt, Offset, Name);                  \
-        if (OldLen == 0 &&                                                 \
-            NewLen) {                                                      \
-            NewLen = sizeof (struct fdt_property) + FDT_TAGALIGN (NewLen); \
-        }                                                                  \
-        /* Update the node's offset in the list */                         \
-        FdtUpdateNodeOffsetInList (                                        \
-           Offset, FDT_TAGALIGN (NewLen) - FDT_TAGALIGN (OldLen));         \
-     }                                                                     \
-    } else {                                                               \
-      RetValue = FdtUpdateFunc (Fdt, Offset, Name, Val);                   \
-    }                                                                      \
-  } while (0)
 #endif
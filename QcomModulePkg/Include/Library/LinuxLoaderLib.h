@@ -51,6 +51,7 @@
 #include <Library/UefiRuntimeServicesTableLib.h>
 #include <PiDxe.h>
 #include <Protocol/BlockIo.h>
+#include <Protocol/BlockIo2.h>
 #include <Protocol/DevicePath.h>
 #include <Protocol/EFIEraseBlock.h>
 #include <Protocol/EFIMdtp.h>
@@ -289,6 +289,23 @@ struct DtboTableEntry {
   UINT32 Custom[DTBO_CUSTOM_MAX]; // optional, must zero if unused
 };
 
+/* Match index of a dtbo entry, written to its Custom fields by
+ * Tools/dtbo_index.py. It summarizes the root properties that decide
+ * whether the overlay can be selected, so GetBoardDtb parses only the
+ * entries that can match this board:
+ * Custom[0]: DTBO_INDEX_MAGIC
+ * Custom[1]: bit (SoC id % 32) set for each qcom,msm-id entry, all bits
+ *            set if there is no valid qcom,msm-id
+ * Custom[2]: variant and subtype of the first qcom,board-id entry and
+ *            DTBO_INDEX_BOARD_VALID if the property is valid
+ * Custom[3]: zero
+ */
+#define DTBO_INDEX_MAGIC 0x51444931 /* "QDI1" */
+#define DTBO_INDEX_SOC_ALL 0xFFFFFFFF
+#define DTBO_INDEX_BOARD_VALID BIT31
+#define DTBO_INDEX_VARIANT(Board) ((Board) & VARIANT_MASK)
+#define DTBO_INDEX_SUBTYPE(Board) (((Board) >> 8) & PLATFORM_SUBTYPE_MASK)
+
 VOID *
 DeviceTreeAppended (void *kernel,
                     UINT32 kernel_size,
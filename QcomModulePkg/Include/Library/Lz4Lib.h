@@ -0,0 +1,125 @@
+/* Copyright (c) 2021, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __LZ4_LIB_H__
+#define __LZ4_LIB_H__
+
+#include <Uefi.h>
+
+#define LZ4_FRAME_MAGIC 0x184D2204
+#define LZ4_LEGACY_MAGIC 0x184C2102
+#define LZ4_LEGACY_BLOCK_SIZE (8 * 1024 * 1024)
+
+/* Streaming XXH32 state, used for the frame checksums */
+typedef struct {
+  UINT32 V[4];
+  UINT8 Mem[16];
+  UINT32 MemSize;
+  UINT64 TotalLen;
+  UINT32 Seed;
+} LZ4_XXH32_STATE;
+
+typedef enum {
+  Lz4StageMagic,
+  Lz4StageHeader,
+  Lz4StageBlock,
+  Lz4StageChecksum,
+  Lz4StageDone,
+} LZ4_FRAME_STAGE;
+
+/* Decoder of an LZ4 frame, or a legacy frame as produced by "lz4 -l" for
+ * the kernel, whose input and output each stay contiguous in memory.
+ */
+typedef struct {
+  LZ4_FRAME_STAGE Stage;
+  BOOLEAN Legacy;
+  BOOLEAN BlockChecksum;
+  BOOLEAN ContentChecksum;
+  /* Content size from the frame header, 0 when it is not given */
+  UINT64 ContentSize;
+  UINT32 MaxBlockSize;
+  LZ4_XXH32_STATE Xxh;
+} LZ4_FRAME_DECODER;
+
+/* Returns TRUE if Buffer starts with an LZ4 frame or legacy frame */
+BOOLEAN
+IsLz4Frame (IN CONST VOID *Buffer, IN UINTN Size);
+
+VOID
+Lz4FrameInit (OUT LZ4_FRAME_DECODER *Decoder);
+
+/* Decode the next unit, header, block or checksum, of the frame in
+ * In[*InPos, InSize) to Out[*OutPos, OutSize). Back-references of a block
+ * may reach back to Out[0]. InEnd tells that InSize is the end of the
+ * input. Both positions are advanced past what was decoded.
+ *
+ * Returns EFI_SUCCESS when a unit was decoded, EFI_END_OF_FILE when the
+ * frame is complete, EFI_NOT_READY when the next unit is not complete in
+ * In, EFI_BUFFER_TOO_SMALL when it does not fit in Out and
+ * EFI_VOLUME_CORRUPTED or EFI_CRC_ERROR for bad data.
+ */
+EFI_STATUS
+Lz4FrameDecode (IN OUT LZ4_FRAME_DECODER *Decoder,
+                IN CONST UINT8 *In,
+                IN UINTN InSize,
+                IN OUT UINTN *InPos,
+                IN BOOLEAN InEnd,
+                OUT UINT8 *Out,
+                IN UINTN OutSize,
+                IN OUT UINTN *OutPos);
+
+/* Decode a whole frame. Returns the decoded size in *OutUsed */
+EFI_STATUS
+Lz4Decompress (IN CONST VOID *In,
+               IN UINTN InSize,
+               OUT VOID *Out,
+               IN UINTN OutSize,
+               OUT UINTN *OutUsed);
+
+/* Decode a raw LZ4 block of SrcSize bytes to Dst[*DstPos, DstSize),
+ * matches may reach back to Dst[0].
+ */
+EFI_STATUS
+Lz4DecompressBlock (IN CONST UINT8 *Src,
+                    IN UINTN SrcSize,
+                    IN OUT UINT8 *Dst,
+                    IN UINTN DstSize,
+                    IN OUT UINTN *DstPos);
+
+VOID
+Lz4Xxh32Init (OUT LZ4_XXH32_STATE *State, IN UINT32 Seed);
+
+VOID
+Lz4Xxh32Update (IN OUT LZ4_XXH32_STATE *State,
+                IN CONST UINT8 *Data,
+                IN UINTN Size);
+
+UINT32
+Lz4Xxh32Final (IN LZ4_XXH32_STATE *State);
+
+#endif
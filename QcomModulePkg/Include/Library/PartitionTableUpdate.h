@@ -233,6 +233,11 @@ BOOLEAN
 PartitionHasMultiSlot (CONST CHAR16 *Pname);
 EFI_STATUS EnumeratePartitions (VOID);
 VOID UpdatePartitionEntries (VOID);
+VOID InvalidatePartitionIndex (VOID);
+EFI_STATUS
+GetPartitionHandles (CONST CHAR16 *Pname,
+                     HandleInfo *HandleInfoList,
+                     UINT32 *MaxHandles);
 EFI_STATUS NandABUpdatePartition (UINT32 UpdateType);
 VOID UpdatePartitionAttributes (UINT32 UpdateType);
 VOID FindPtnActiveSlot (VOID);
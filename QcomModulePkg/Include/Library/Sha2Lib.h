@@ -0,0 +1,61 @@
+/* Copyright (c) 2021, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __SHA2_LIB_H__
+#define __SHA2_LIB_H__
+
+#include <Uefi.h>
+
+#define SHA256_CE_BLOCK_SIZE 64
+#define SHA512_CE_BLOCK_SIZE 128
+
+/* Whether the SHA-256 instructions of the ARMv8 Cryptographic Extension
+ * are present and passed their known answer test. The result is computed
+ * on the first call.
+ */
+BOOLEAN
+Sha256CeSupported (VOID);
+
+/* Whether the ARMv8.2 SHA-512 instructions are present and passed their
+ * known answer test.
+ */
+BOOLEAN
+Sha512CeSupported (VOID);
+
+/* Runs the compression function on Blocks whole blocks of Data, updating
+ * the eight hash words of State. Only call when Sha256CeSupported ()
+ * returned TRUE.
+ */
+VOID
+Sha256CeBlocks (UINT32 *State, CONST UINT8 *Data, UINTN Blocks);
+
+/* Same as Sha256CeBlocks for SHA-512, see Sha512CeSupported () */
+VOID
+Sha512CeBlocks (UINT64 *State, CONST UINT8 *Data, UINTN Blocks);
+
+#endif
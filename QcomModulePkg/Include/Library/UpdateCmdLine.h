@@ -54,7 +54,6 @@ typedef struct UpdateCmdLineParamList {
   BOOLEAN MultiSlotBoot;
   BOOLEAN AlarmBoot;
   BOOLEAN MdtpActive;
-  UINT32 CmdLineLen;
   UINT32 HaveCmdLine;
   UINT32 PauseAtBootUp;
   CHAR8 *StrSerialNum;
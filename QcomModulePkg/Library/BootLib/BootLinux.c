@@ -30,6 +30,7 @@
  *
  */
 
+#include <Library/CmdLineBuilder.h>
 #include <Library/DeviceInfo.h>
 #include <Library/DrawUI.h>
 #include <Library/PartitionTableUpdate.h>
@@ -205,9 +206,11 @@ UpdateKernelModeAndPkg (BootParamlist *BootParamlistPtr)
   Kptr = (Kernel64Hdr *) (BootParamlistPtr->ImageBuffer +
                             BootParamlistPtr->PageSize);
 
-  if (is_gzip_package ((BootParamlistPtr->ImageBuffer +
-                 BootParamlistPtr->PageSize), BootParamlistPtr->KernelSize)) {
-      BootParamlistPtr->BootingWithGzipPkgKernel = TRUE;
+  BootParamlistPtr->KernelDecompressor = get_kernel_decompressor (
+                 (BootParamlistPtr->ImageBuffer + BootParamlistPtr->PageSize),
+                 BootParamlistPtr->KernelSize);
+  if (BootParamlistPtr->KernelDecompressor) {
+      BootParamlistPtr->BootingWithCompressedKernel = TRUE;
   }
   else {
     if (!AsciiStrnCmp ((CHAR8 *) Kptr, PATCHED_KERNEL_MAGIC,
@@ -309,6 +312,25 @@ CheckMDTPStatus (CHAR16 *PartitionName, BootInfo *Info)
   return Status;
 }
 
+/* Copies Length bytes into one of the load regions and accounts them to
+ * the per boot copy statistics. Nothing is moved if the data already sits
+ * at its destination.
+ */
+STATIC VOID
+LoadRegionCopy (BootParamlist *BootParamlistPtr,
+                VOID *Destination,
+                CONST VOID *Source,
+                UINTN Length)
+{
+  if (Destination == Source ||
+      Length == 0) {
+    return;
+  }
+
+  gBS->CopyMem (Destination, (VOID *)Source, Length);
+  BootParamlistPtr->CopyBytes += Length;
+}
+
 STATIC EFI_STATUS
 ApplyOverlay (BootParamlist *BootParamlistPtr,
               VOID *AppendedDtHdr,
@@ -316,7 +338,9 @@ ApplyOverlay (BootParamlist *BootParamlistPtr,
 {
   VOID *FinalDtbHdr = AppendedDtHdr;
   VOID *TmpDtbHdr = NULL;
+  UINTN PreAllocSize;
   UINT64 ApplyDTStartTime = GetTimerCountms ();
+  BOOT_TRACE_BEGIN (Overlay);
 
   if (BootParamlistPtr == NULL ||
       AppendedDtHdr == NULL) {
@@ -328,24 +352,33 @@ ApplyOverlay (BootParamlist *BootParamlistPtr,
     goto out;
   }
 
-  if (!pre_overlay_malloc ()) {
-    DEBUG ((EFI_D_ERROR,
-           "ApplyOverlay: Unable to Allocate Pre Buffer for Overlay\n"));
-    return EFI_OUT_OF_RESOURCES;
-  }
-
   TmpDtbHdr = ufdt_install_blob (AppendedDtHdr, fdt_totalsize (AppendedDtHdr));
   if (!TmpDtbHdr) {
     DEBUG ((EFI_D_ERROR, "ApplyOverlay: Install blob failed\n"));
     return EFI_NOT_FOUND;
   }
 
+  /* Size the overlay buffer from the DTB and the overlays to apply */
+  PreAllocSize = ufdt_multi_overlay_mem_size (TmpDtbHdr, DtsList);
+  if (!PreAllocSize) {
+    DEBUG ((EFI_D_ERROR, "ApplyOverlay: Invalid overlay DT\n"));
+    return EFI_NOT_FOUND;
+  }
+  DEBUG ((EFI_D_VERBOSE, "ApplyOverlay: Pre Buffer size %lu\n", PreAllocSize));
+
+  if (!pre_overlay_malloc (PreAllocSize)) {
+    DEBUG ((EFI_D_ERROR,
+           "ApplyOverlay: Unable to Allocate Pre Buffer for Overlay\n"));
+    return EFI_OUT_OF_RESOURCES;
+  }
+
   FinalDtbHdr = ufdt_apply_multi_overlay (TmpDtbHdr,
                                     fdt_totalsize (TmpDtbHdr),
                                     DtsList);
   DeleteDtList (&DtsList);
   if (!FinalDtbHdr) {
     DEBUG ((EFI_D_ERROR, "ApplyOverlay: ufdt apply overlay failed\n"));
+    post_overlay_free ();
     return EFI_NOT_FOUND;
   }
 
@@ -355,15 +388,18 @@ out:
             fdt_totalsize (FinalDtbHdr)) {
     DEBUG ((EFI_D_ERROR,
            "ApplyOverlay: After overlay DTB size exceeded than supported\n"));
+    post_overlay_free ();
     return EFI_UNSUPPORTED;
   }
   /* If DeviceTreeLoadAddr == AppendedDtHdr
      CopyMem will not copy Source Buffer to Destination Buffer
      and return Destination BUffer.
   */
-  gBS->CopyMem ((VOID *)BootParamlistPtr->DeviceTreeLoadAddr,
-                FinalDtbHdr,
-                fdt_totalsize (FinalDtbHdr));
+  LoadRegionCopy (BootParamlistPtr,
+                  (VOID *)BootParamlistPtr->DeviceTreeLoadAddr,
+                  FinalDtbHdr,
+                  fdt_totalsize (FinalDtbHdr));
+  BOOT_TRACE_END (Overlay, BT_APPLY_OVERLAY, fdt_totalsize (FinalDtbHdr));
   post_overlay_free ();
   DEBUG ((EFI_D_INFO, "Apply Overlay total time: %lu ms \n",
         GetTimerCountms () - ApplyDTStartTime));
@@ -496,8 +532,9 @@ DTBImgCheckAndAppendDT (BootInfo *Info, BootParamlist *BootParamlistPtr)
           return EFI_BAD_BUFFER_SIZE;
         }
 
-        gBS->CopyMem ((VOID *)BootParamlistPtr->DeviceTreeLoadAddr,
-                      SingleDtHdr, fdt_totalsize (SingleDtHdr));
+        LoadRegionCopy (BootParamlistPtr,
+                        (VOID *)BootParamlistPtr->DeviceTreeLoadAddr,
+                        SingleDtHdr, fdt_totalsize (SingleDtHdr));
       } else {
         DEBUG ((EFI_D_ERROR, "Error: Device Tree blob not found\n"));
         return EFI_NOT_FOUND;
@@ -602,7 +639,7 @@ GZipPkgCheck (BootParamlist *BootParamlistPtr)
     return EFI_INVALID_PARAMETER;
   }
 
-  if (BootParamlistPtr->BootingWithGzipPkgKernel) {
+  if (BootParamlistPtr->BootingWithCompressedKernel) {
     OutAvaiLen = BootParamlistPtr->DeviceTreeLoadAddr -
                  BootParamlistPtr->KernelLoadAddr;
 
@@ -614,14 +651,16 @@ GZipPkgCheck (BootParamlist *BootParamlistPtr)
     }
 
     DecompressStartTime = GetTimerCountms ();
-    if (decompress (
+    BOOT_TRACE_BEGIN (Decompress);
+    if (BootParamlistPtr->KernelDecompressor->Decompress (
         (UINT8 *)(BootParamlistPtr->ImageBuffer +
         BootParamlistPtr->PageSize),               // Read blob using BlockIo
         BootParamlistPtr->KernelSize,              // Blob size
         (UINT8 *)BootParamlistPtr->KernelLoadAddr, // Load address, allocated
         (UINT32)OutAvaiLen,                        // Allocated Size
         &BootParamlistPtr->DtbOffset, &OutLen)) {
-          DEBUG ((EFI_D_ERROR, "Decompressing kernel image failed!!!\n"));
+          DEBUG ((EFI_D_ERROR, "Decompressing %a kernel image failed!!!\n",
+                  BootParamlistPtr->KernelDecompressor->Name));
           return RETURN_OUT_OF_RESOURCES;
     }
 
@@ -630,8 +669,11 @@ GZipPkgCheck (BootParamlist *BootParamlistPtr)
               "Decompress kernel size is smaller than image header size\n"));
       return RETURN_OUT_OF_RESOURCES;
     }
+    BOOT_TRACE_END (Decompress, BT_KERNEL_DECOMPRESS, OutLen);
     Kptr = (Kernel64Hdr *) BootParamlistPtr->KernelLoadAddr;
-    DEBUG ((EFI_D_INFO, "Decompressing kernel image total time: %lu ms\n",
+    BootParamlistPtr->DecompressBytes += OutLen;
+    DEBUG ((EFI_D_INFO, "Decompressing %a kernel image total time: %lu ms\n",
+                         BootParamlistPtr->KernelDecompressor->Name,
                          GetTimerCountms () - DecompressStartTime));
   } else {
     Kptr = (struct kernel64_hdr *)(BootParamlistPtr->ImageBuffer
@@ -663,8 +705,9 @@ GZipPkgCheck (BootParamlist *BootParamlistPtr)
            ((VOID *)Kptr + DTB_OFFSET_LOCATION_IN_ARCH32_KERNEL_HDR),
            sizeof (BootParamlistPtr->DtbOffset));
     }
-    gBS->CopyMem ((VOID *)BootParamlistPtr->KernelLoadAddr, (VOID *)Kptr,
-                 BootParamlistPtr->KernelSize);
+    LoadRegionCopy (BootParamlistPtr,
+                    (VOID *)BootParamlistPtr->KernelLoadAddr, Kptr,
+                    BootParamlistPtr->KernelSize);
   }
 
   if (Kptr->magic_64 != KERNEL64_HDR_MAGIC) {
@@ -689,6 +732,7 @@ LoadAddrAndDTUpdate (BootInfo *Info, BootParamlist *BootParamlistPtr)
   UINT64 RamdiskLoadAddr;
   UINT64 RamdiskEndAddr = 0;
   UINT32 TotalRamdiskSize;
+  UINT32 KernelCopyOffset = 0;
 
   if (BootParamlistPtr == NULL) {
     DEBUG ((EFI_D_ERROR, "Invalid input parameters\n"));
@@ -728,18 +772,20 @@ LoadAddrAndDTUpdate (BootInfo *Info, BootParamlist *BootParamlistPtr)
    * This concatination would result in an overlay for .gzip and .cpio formats.
    */
   if (Info->HeaderVersion >= BOOT_HEADER_VERSION_THREE) {
-    gBS->CopyMem ((VOID *)RamdiskLoadAddr,
-                  BootParamlistPtr->VendorImageBuffer +
-                  BootParamlistPtr->PageSize,
-                  BootParamlistPtr->VendorRamdiskSize);
+    LoadRegionCopy (BootParamlistPtr,
+                    (VOID *)RamdiskLoadAddr,
+                    BootParamlistPtr->VendorImageBuffer +
+                    BootParamlistPtr->PageSize,
+                    BootParamlistPtr->VendorRamdiskSize);
 
     RamdiskLoadAddr += BootParamlistPtr->VendorRamdiskSize;
   }
 
-  gBS->CopyMem ((CHAR8 *)RamdiskLoadAddr,
-                BootParamlistPtr->ImageBuffer +
-                BootParamlistPtr->RamdiskOffset,
-                BootParamlistPtr->RamdiskSize);
+  LoadRegionCopy (BootParamlistPtr,
+                  (CHAR8 *)RamdiskLoadAddr,
+                  BootParamlistPtr->ImageBuffer +
+                  BootParamlistPtr->RamdiskOffset,
+                  BootParamlistPtr->RamdiskSize);
 
   if (BootParamlistPtr->BootingWith32BitKernel) {
     if (CHECK_ADD64 (BootParamlistPtr->KernelLoadAddr,
@@ -753,40 +799,98 @@ LoadAddrAndDTUpdate (BootInfo *Info, BootParamlist *BootParamlistPtr)
       DEBUG ((EFI_D_ERROR, "Kernel size is over the limit\n"));
       return EFI_INVALID_PARAMETER;
     }
-    gBS->CopyMem ((CHAR8 *)BootParamlistPtr->KernelLoadAddr,
-                  BootParamlistPtr->ImageBuffer +
-                  BootParamlistPtr->PageSize,
-                  BootParamlistPtr->KernelSizeActual);
+    /* GZipPkgCheck already placed the first KernelSize bytes of a plain
+     * 32-bit kernel from the same source, only the page padding is left.
+     */
+    if (!BootParamlistPtr->BootingWithCompressedKernel &&
+        !BootParamlistPtr->BootingWithPatchedKernel) {
+      KernelCopyOffset = BootParamlistPtr->KernelSize;
+    }
+    LoadRegionCopy (BootParamlistPtr,
+                    (CHAR8 *)BootParamlistPtr->KernelLoadAddr +
+                    KernelCopyOffset,
+                    BootParamlistPtr->ImageBuffer +
+                    BootParamlistPtr->PageSize + KernelCopyOffset,
+                    BootParamlistPtr->KernelSizeActual - KernelCopyOffset);
   }
 
   return EFI_SUCCESS;
 }
 
+/* The verified images stay allocated until FreeVerifiedBootResource, so
+ * the footprint of the load peaks right after everything has been placed:
+ * the images plus the kernel, ramdisk and dtb in their load regions. The
+ * sections are still copied out of the contiguous images libavb loaded
+ * and hashed, the copied and decompressed bytes are that traffic.
+ */
+STATIC VOID
+ReportLoadStats (BootInfo *Info, BootParamlist *BootParamlistPtr)
+{
+  UINT64 ImageBytes = 0;
+  UINT64 PlacedBytes;
+  UINTN Index;
+
+  for (Index = 0; Index < Info->NumLoadedImages; Index++) {
+    ImageBytes += Info->Images[Index].ImageSize;
+  }
+
+  PlacedBytes = BootParamlistPtr->BootingWithCompressedKernel
+                    ? BootParamlistPtr->DecompressBytes
+                    : BootParamlistPtr->KernelSizeActual;
+  PlacedBytes += BootParamlistPtr->RamdiskSize +
+                 BootParamlistPtr->VendorRamdiskSize;
+  PlacedBytes += fdt_totalsize ((VOID *)BootParamlistPtr->DeviceTreeLoadAddr);
+
+  DEBUG ((EFI_D_INFO, "Boot image load: images %lu KB, copied %lu KB, "
+          "decompressed %lu KB, peak %lu KB\n",
+          ImageBytes / 1024,
+          BootParamlistPtr->CopyBytes / 1024,
+          BootParamlistPtr->DecompressBytes / 1024,
+          (ImageBytes + PlacedBytes) / 1024));
+}
+
+STATIC VOID
+CatCmdLineArgs (CMDLINE_BUILDER *Builder,
+                boot_img_hdr_v3 *BootImgHdrV3,
+                vendor_boot_img_hdr_v3 *VendorBootImgHdrV3)
+{
+  /* Place the vendor_boot image cmdline first and merge the one from boot
+   * image over it, so that its androidboot.* values take precedence, where
+   * init used to see the vendor_boot ones first. Both header fields are
+   * read up to their size, they need not be terminated.
+   */
+  CmdLineBuilderAppendN (Builder, (CONST CHAR8 *)VendorBootImgHdrV3->cmdline,
+                         AsciiStrnLenS ((CONST CHAR8 *)
+                                        VendorBootImgHdrV3->cmdline,
+                                        VENDOR_BOOT_ARGS_SIZE));
+  CmdLineBuilderAppend (Builder, " ");
+  CmdLineBuilderMergeN (Builder, (CONST CHAR8 *)BootImgHdrV3->cmdline,
+                        AsciiStrnLenS ((CONST CHAR8 *)BootImgHdrV3->cmdline,
+                                       BOOT_ARGS_SIZE + BOOT_EXTRA_ARGS_SIZE));
+}
+
 STATIC EFI_STATUS
 CatCmdLine (BootParamlist *BootParamlistPtr,
             boot_img_hdr_v3 *BootImgHdrV3,
             vendor_boot_img_hdr_v3 *VendorBootImgHdrV3)
 {
-  UINTN MaxCmdLineLen = BOOT_ARGS_SIZE +
-                        BOOT_EXTRA_ARGS_SIZE + VENDOR_BOOT_ARGS_SIZE;
+  CMDLINE_BUILDER Builder;
+  EFI_STATUS Status;
 
-  BootParamlistPtr->CmdLine = AllocateZeroPool (MaxCmdLineLen);
-  if (!BootParamlistPtr->CmdLine) {
-    DEBUG ((EFI_D_ERROR,
-            "CatCmdLine: Failed to allocate memory for cmdline\n"));
-    return EFI_OUT_OF_RESOURCES;
+  CmdLineBuilderInit (&Builder);
+  CatCmdLineArgs (&Builder, BootImgHdrV3, VendorBootImgHdrV3);
+  Status = CmdLineBuilderAllocate (&Builder);
+  if (Status == EFI_SUCCESS) {
+    CatCmdLineArgs (&Builder, BootImgHdrV3, VendorBootImgHdrV3);
+    Status = CmdLineBuilderFinish (&Builder, &BootParamlistPtr->CmdLine);
   }
+  CmdLineBuilderFree (&Builder);
 
-  /* Place the vendor_boot image cmdline first so that the cmdline
-   * from boot image takes precedence in case of duplicates.
-   */
-  AsciiStrCpyS (BootParamlistPtr->CmdLine, MaxCmdLineLen,
-               (CONST CHAR8 *)VendorBootImgHdrV3->cmdline);
-  AsciiStrCatS (BootParamlistPtr->CmdLine, MaxCmdLineLen, " ");
-  AsciiStrCatS (BootParamlistPtr->CmdLine, MaxCmdLineLen,
-               (CONST CHAR8 *)BootImgHdrV3->cmdline);
-
-  return EFI_SUCCESS;
+  if (Status != EFI_SUCCESS) {
+    DEBUG ((EFI_D_ERROR,
+            "CatCmdLine: Failed to build cmdline: %r\n", Status));
+  }
+  return Status;
 }
 
 STATIC EFI_STATUS
@@ -1006,6 +1110,8 @@ BootLinux (BootInfo *Info)
        return Status;
   }
 
+  ReportLoadStats (Info, &BootParamlistPtr);
+
   FreeVerifiedBootResource (Info);
 
   /* Free the boot logo blt buffer before starting kernel */
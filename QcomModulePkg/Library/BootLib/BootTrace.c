@@ -0,0 +1,260 @@
+/* Copyright (c) 2021, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <Library/BaseMemoryLib.h>
+#include <Library/BootTrace.h>
+#include <Library/CacheMaintenanceLib.h>
+#include <Library/DebugLib.h>
+#include <Library/FdtRw.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/TimerLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <libfdt.h>
+
+#define BOOT_TRACE_SAVED_MAGIC 0x43525442 /* "BTRC" */
+
+/* Header of the copy at BootTracePersistBase, the events follow it */
+typedef struct {
+  UINT32 Magic;
+  UINT32 Count;
+  UINT32 Crc32;
+  UINT32 Reserved;
+} BOOT_TRACE_SAVED;
+
+STATIC CONST CHAR8 *BootTraceNames[BT_ID_MAX] = {
+  [BT_LOAD_PARTITION] = "load-partition",
+  [BT_AVB_READ] = "avb-read",
+  [BT_AVB_VERIFY] = "avb-verify",
+  [BT_KERNEL_DECOMPRESS] = "kernel-decompress",
+  [BT_APPLY_OVERLAY] = "apply-overlay",
+  [BT_UPDATE_DEVICE_TREE] = "update-device-tree",
+  [BT_PARTIAL_GOODS] = "partial-goods",
+};
+
+/* Spans may end on the AVB worker threads, so a slot is claimed with an
+ * atomic ticket and published by writing its sequence number last. A
+ * reader only takes a slot whose sequence number matches its ticket before
+ * and after copying it.
+ */
+STATIC BOOT_TRACE_EVENT BootTraceRing[BOOT_TRACE_MAX_EVENTS];
+STATIC UINT32 BootTraceNext;
+
+UINT64
+BootTraceNowUs (VOID)
+{
+  return GetTimeInNanoSecond (GetPerformanceCounter ()) / 1000;
+}
+
+CONST CHAR8 *
+BootTraceName (UINT32 Id)
+{
+  if (Id >= BT_ID_MAX) {
+    return "unknown";
+  }
+  return BootTraceNames[Id];
+}
+
+VOID
+BootTraceRecord (BOOT_TRACE_ID Id, UINT64 StartUs, UINT64 Bytes)
+{
+  UINT64 EndUs = BootTraceNowUs ();
+  UINT32 Ticket;
+  BOOT_TRACE_EVENT *Event;
+
+  Ticket = __atomic_fetch_add (&BootTraceNext, 1, __ATOMIC_RELAXED);
+  Event = &BootTraceRing[Ticket % BOOT_TRACE_MAX_EVENTS];
+
+  __atomic_store_n (&Event->Seq, 0, __ATOMIC_RELAXED);
+  __atomic_thread_fence (__ATOMIC_RELEASE);
+  Event->Id = Id;
+  Event->StartUs = StartUs;
+  Event->DurationUs = EndUs > StartUs ? EndUs - StartUs : 0;
+  Event->Bytes = Bytes;
+  __atomic_store_n (&Event->Seq, Ticket + 1, __ATOMIC_RELEASE);
+}
+
+UINT32
+BootTraceSnapshot (BOOT_TRACE_EVENT *Events, UINT32 MaxEvents)
+{
+  UINT32 Next = __atomic_load_n (&BootTraceNext, __ATOMIC_ACQUIRE);
+  UINT32 Ticket;
+  UINT32 Count = 0;
+  BOOT_TRACE_EVENT *Event;
+
+  Ticket = Next > BOOT_TRACE_MAX_EVENTS ? Next - BOOT_TRACE_MAX_EVENTS : 0;
+  for (; Ticket != Next && Count < MaxEvents; Ticket++) {
+    Event = &BootTraceRing[Ticket % BOOT_TRACE_MAX_EVENTS];
+    if (__atomic_load_n (&Event->Seq, __ATOMIC_ACQUIRE) != Ticket + 1) {
+      continue;
+    }
+    CopyMem (&Events[Count], Event, sizeof (*Event));
+    __atomic_thread_fence (__ATOMIC_ACQUIRE);
+    if (__atomic_load_n (&Event->Seq, __ATOMIC_RELAXED) != Ticket + 1) {
+      continue;
+    }
+    Count++;
+  }
+
+  return Count;
+}
+
+EFI_STATUS
+BootTraceExport (VOID *Fdt, INT32 NodeOffset)
+{
+  BOOT_TRACE_EVENT *Events;
+  UINT32 *Cells;
+  UINT32 Count;
+  UINT32 Index;
+  INT32 Ret;
+
+  Events = AllocateZeroPool (BOOT_TRACE_MAX_EVENTS * sizeof (*Events) +
+                             BOOT_TRACE_MAX_EVENTS * BOOT_TRACE_DT_CELLS *
+                             sizeof (*Cells));
+  if (Events == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  Cells = (UINT32 *)&Events[BOOT_TRACE_MAX_EVENTS];
+
+  Count = BootTraceSnapshot (Events, BOOT_TRACE_MAX_EVENTS);
+  for (Index = 0; Index < Count; Index++) {
+    Cells[Index * BOOT_TRACE_DT_CELLS] = cpu_to_fdt32 (Events[Index].Id);
+    Cells[Index * BOOT_TRACE_DT_CELLS + 1] =
+        cpu_to_fdt32 ((UINT32)Events[Index].StartUs);
+    Cells[Index * BOOT_TRACE_DT_CELLS + 2] =
+        cpu_to_fdt32 ((UINT32)Events[Index].DurationUs);
+    Cells[Index * BOOT_TRACE_DT_CELLS + 3] =
+        cpu_to_fdt32 ((UINT32)MIN (Events[Index].Bytes, MAX_UINT32));
+  }
+
+  Ret = FdtSetProp (Fdt, NodeOffset, "qcom,boot-trace", Cells,
+                   Count * BOOT_TRACE_DT_CELLS * sizeof (*Cells));
+  FreePool (Events);
+  if (Ret) {
+    DEBUG ((EFI_D_ERROR, "ERROR: Cannot add boot trace - 0x%x\n", Ret));
+    return EFI_BUFFER_TOO_SMALL;
+  }
+
+  /* The event ids index this string list, FdtAppendPropString () would
+   * join the names with spaces.
+   */
+  Ret = FdtSetProp (Fdt, NodeOffset, "qcom,boot-trace-names", "", 0);
+  for (Index = 0; Index < BT_ID_MAX && !Ret; Index++) {
+    Ret = FdtAppendProp (Fdt, NodeOffset, "qcom,boot-trace-names",
+                         BootTraceNames[Index],
+                         AsciiStrLen (BootTraceNames[Index]) + 1);
+  }
+  if (Ret) {
+    DEBUG ((EFI_D_ERROR, "ERROR: Cannot add boot trace names - 0x%x\n", Ret));
+    return EFI_BUFFER_TOO_SMALL;
+  }
+
+  DEBUG ((EFI_D_VERBOSE, "Boot trace: %u events added\n", Count));
+  return EFI_SUCCESS;
+}
+
+/* The saved copy and the number of events it has room for, NULL when the
+ * platform keeps none.
+ */
+STATIC BOOT_TRACE_SAVED *
+BootTraceSavedArea (UINT32 *MaxEvents)
+{
+  UINT64 Base = FixedPcdGet64 (BootTracePersistBase);
+  UINT32 Size = FixedPcdGet32 (BootTracePersistSize);
+
+  if (!Base ||
+      Size < sizeof (BOOT_TRACE_SAVED) + sizeof (BOOT_TRACE_EVENT)) {
+    return NULL;
+  }
+
+  *MaxEvents = MIN ((Size - sizeof (BOOT_TRACE_SAVED)) /
+                    sizeof (BOOT_TRACE_EVENT), BOOT_TRACE_MAX_EVENTS);
+  return (BOOT_TRACE_SAVED *)(UINTN)Base;
+}
+
+VOID
+BootTraceSave (VOID)
+{
+  BOOT_TRACE_SAVED *Saved;
+  BOOT_TRACE_EVENT *Events;
+  UINT32 MaxEvents;
+  UINTN Size;
+
+  Saved = BootTraceSavedArea (&MaxEvents);
+  if (Saved == NULL) {
+    return;
+  }
+  Events = (BOOT_TRACE_EVENT *)(Saved + 1);
+
+  /* The magic is written last, a copy cut short by a reset is not used */
+  Saved->Magic = 0;
+  Saved->Count = BootTraceSnapshot (Events, MaxEvents);
+  Size = Saved->Count * sizeof (*Events);
+  Saved->Crc32 = 0;
+  if (Size) {
+    gBS->CalculateCrc32 (Events, Size, &Saved->Crc32);
+  }
+  Saved->Reserved = 0;
+  Saved->Magic = BOOT_TRACE_SAVED_MAGIC;
+  WriteBackDataCacheRange (Saved, sizeof (*Saved) + Size);
+}
+
+BOOLEAN
+BootTraceKeepsPrevious (VOID)
+{
+  UINT32 SavedMax;
+
+  return BootTraceSavedArea (&SavedMax) != NULL;
+}
+
+UINT32
+BootTracePrevious (BOOT_TRACE_EVENT *Events, UINT32 MaxEvents)
+{
+  BOOT_TRACE_SAVED *Saved;
+  UINT32 SavedMax;
+  UINT32 Crc32 = 0;
+  UINTN Size;
+
+  Saved = BootTraceSavedArea (&SavedMax);
+  if (Saved == NULL ||
+      Saved->Magic != BOOT_TRACE_SAVED_MAGIC ||
+      Saved->Count > SavedMax) {
+    return 0;
+  }
+
+  Size = Saved->Count * sizeof (*Events);
+  if (Size &&
+      (gBS->CalculateCrc32 (Saved + 1, Size, &Crc32) != EFI_SUCCESS ||
+       Crc32 != Saved->Crc32)) {
+    DEBUG ((EFI_D_ERROR, "Boot trace: saved copy is corrupted\n"));
+    return 0;
+  }
+
+  Size = MIN (Saved->Count, MaxEvents) * sizeof (*Events);
+  CopyMem (Events, Saved + 1, Size);
+  return Size / sizeof (*Events);
+}
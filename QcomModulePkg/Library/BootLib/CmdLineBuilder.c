@@ -0,0 +1,412 @@
+/* Copyright (c) 2021, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/CmdLineBuilder.h>
+#include <Library/DebugLib.h>
+#include <Library/MemoryAllocationLib.h>
+
+/* Length of the token at Str, a double quoted part may hold spaces */
+STATIC UINTN
+CmdLineTokenLen (CONST CHAR8 *Str, UINTN Len)
+{
+  BOOLEAN Quoted = FALSE;
+  UINTN Index;
+
+  for (Index = 0; Index < Len; Index++) {
+    if (Str[Index] == '"') {
+      Quoted = !Quoted;
+    } else if (Str[Index] == ' ' &&
+               !Quoted) {
+      break;
+    }
+  }
+  return Index;
+}
+
+/* Only these keys are overridden, kernel parameters such as console= may
+ * be given more than once and are all kept.
+ */
+#define CMDLINE_OVERRIDE_PREFIX "androidboot."
+
+/* Length of the key of a key=value token that is overridden, 0 for other
+ * tokens
+ */
+STATIC UINTN
+CmdLineKeyLen (CONST CHAR8 *Token, UINTN Len)
+{
+  UINTN PrefixLen = sizeof (CMDLINE_OVERRIDE_PREFIX) - 1;
+  UINTN Index;
+
+  if (Len <= PrefixLen ||
+      CompareMem (Token, CMDLINE_OVERRIDE_PREFIX, PrefixLen)) {
+    return 0;
+  }
+
+  for (Index = PrefixLen; Index < Len && Token[Index] != '"'; Index++) {
+    if (Token[Index] == '=') {
+      return Index > PrefixLen ? Index : 0;
+    }
+  }
+  return 0;
+}
+
+STATIC UINT32
+CmdLineKeyHash (CONST CHAR8 *Key, UINTN Len)
+{
+  UINT32 Hash = 2166136261U;
+
+  while (Len--) {
+    Hash = (Hash ^ (UINT8)*Key++) * 16777619U;
+  }
+  return Hash;
+}
+
+/* Slot of Key in the hash table: the one holding it, or the free slot it
+ * goes to. Only keys whose last token is at MinLast or later are matched,
+ * the text of the others may have been moved already.
+ */
+STATIC UINT32 *
+CmdLineKeySlot (CMDLINE_BUILDER *Builder,
+                CONST CHAR8 *Key,
+                UINTN Len,
+                UINT32 Hash,
+                UINTN MinLast)
+{
+  CMDLINE_KEY *Entry;
+  UINTN Index;
+
+  for (Index = Hash & Builder->TableMask; Builder->Table[Index];
+       Index = (Index + 1) & Builder->TableMask) {
+    Entry = &Builder->Keys[Builder->Table[Index] - 1];
+    if (Entry->Hash == Hash &&
+        Entry->Len == Len &&
+        Entry->Last >= MinLast &&
+        !CompareMem (Builder->Buf + Entry->Offset, Key, Len)) {
+      break;
+    }
+  }
+  return &Builder->Table[Index];
+}
+
+STATIC CMDLINE_KEY *
+CmdLineFindKey (CMDLINE_BUILDER *Builder,
+                CONST CHAR8 *Key,
+                UINTN Len,
+                UINTN MinLast)
+{
+  UINT32 *Slot;
+
+  Slot = CmdLineKeySlot (Builder, Key, Len, CmdLineKeyHash (Key, Len),
+                         MinLast);
+  return *Slot ? &Builder->Keys[*Slot - 1] : NULL;
+}
+
+STATIC VOID
+CmdLineBuilderAddKey (CMDLINE_BUILDER *Builder,
+                      UINTN Offset,
+                      CONST CHAR8 *Key,
+                      UINTN Len)
+{
+  CMDLINE_KEY *Entry;
+  UINT32 *Slot;
+  UINT32 Hash;
+
+  if (!Builder->Buf) {
+    Builder->NumKeys++;
+    return;
+  }
+
+  Hash = CmdLineKeyHash (Key, Len);
+  Slot = CmdLineKeySlot (Builder, Key, Len, Hash, 0);
+  if (*Slot) {
+    return;
+  }
+  if (Builder->NumKeys >= Builder->MaxKeys) {
+    Builder->Overflow = TRUE;
+    return;
+  }
+
+  Entry = &Builder->Keys[Builder->NumKeys++];
+  Entry->Offset = Offset;
+  Entry->Len = Len;
+  Entry->Hash = Hash;
+  Entry->Last = 0;
+  *Slot = Builder->NumKeys;
+}
+
+/**
+  Start the sizing pass of a command line
+  @param[out] Builder   The builder to set up.
+ **/
+VOID
+CmdLineBuilderInit (CMDLINE_BUILDER *Builder)
+{
+  SetMem (Builder, sizeof (*Builder), 0);
+}
+
+/**
+  Append Len bytes of Str at the length cursor, in the sizing pass only
+  the cursor is moved.
+ **/
+VOID
+CmdLineBuilderAppendN (CMDLINE_BUILDER *Builder,
+                       CONST CHAR8 *Str,
+                       UINTN Len)
+{
+  if (Builder->Buf) {
+    if (Builder->Overflow ||
+        Builder->Len + Len >= Builder->Size) {
+      Builder->Overflow = TRUE;
+      return;
+    }
+    CopyMem (Builder->Buf + Builder->Len, Str, Len);
+  }
+  Builder->Len += Len;
+}
+
+VOID
+CmdLineBuilderAppend (CMDLINE_BUILDER *Builder, CONST CHAR8 *Str)
+{
+  CmdLineBuilderAppendN (Builder, Str, AsciiStrLen (Str));
+}
+
+/**
+  Append Len bytes of Str, its androidboot.* tokens override the ones with
+  the same key
+  @param[in] Builder    The command line builder.
+  @param[in] Str        Command line arguments, a key may be completed by
+                        the value appended after it.
+  @param[in] Len        Length of Str.
+
+  Of all the tokens of the command line using a key set here, only the
+  last one is kept by CmdLineBuilderFinish (). Other tokens are appended
+  as they are. Tokens after "--" are arguments of init and are left alone.
+ **/
+VOID
+CmdLineBuilderMergeN (CMDLINE_BUILDER *Builder,
+                      CONST CHAR8 *Str,
+                      UINTN Len)
+{
+  UINTN Start = Builder->Len;
+  UINTN TokenLen;
+  UINTN KeyLen;
+  UINTN Index;
+
+  CmdLineBuilderAppendN (Builder, Str, Len);
+  if (Builder->Overflow) {
+    return;
+  }
+
+  for (Index = 0; Index < Len; Index += TokenLen) {
+    if (Str[Index] == ' ') {
+      TokenLen = 1;
+      continue;
+    }
+    TokenLen = CmdLineTokenLen (Str + Index, Len - Index);
+    KeyLen = CmdLineKeyLen (Str + Index, TokenLen);
+    if (KeyLen) {
+      CmdLineBuilderAddKey (Builder, Start + Index, Str + Index, KeyLen);
+    }
+  }
+}
+
+VOID
+CmdLineBuilderMerge (CMDLINE_BUILDER *Builder, CONST CHAR8 *Str)
+{
+  CmdLineBuilderMergeN (Builder, Str, AsciiStrLen (Str));
+}
+
+/**
+  End the sizing pass and allocate the command line and its keys
+  @param[in] Builder    The command line builder, after the sizing pass.
+
+  The same appends are to be made again to write the command line.
+
+  @retval EFI_SUCCESS            The buffer is allocated.
+  @retval EFI_OUT_OF_RESOURCES   Allocation failed.
+ **/
+EFI_STATUS
+CmdLineBuilderAllocate (CMDLINE_BUILDER *Builder)
+{
+  UINTN TextSize;
+  UINTN TableSize = 1;
+
+  if (Builder->Buf) {
+    return EFI_ALREADY_STARTED;
+  }
+
+  /* 1 extra byte for NULL */
+  TextSize = ALIGN_VALUE (Builder->Len + 1, sizeof (UINT64));
+  /* At most half full, so that a probe ends soon on a free slot */
+  while (TableSize < 2 * Builder->NumKeys) {
+    TableSize <<= 1;
+  }
+  Builder->Buf = AllocateZeroPool (TextSize +
+                                   Builder->NumKeys * sizeof (CMDLINE_KEY) +
+                                   TableSize * sizeof (UINT32));
+  if (!Builder->Buf) {
+    DEBUG ((EFI_D_ERROR, "CMDLINE: Failed to allocate %lu bytes\n",
+            (UINT64)TextSize));
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Builder->Size = Builder->Len + 1;
+  Builder->Keys = (CMDLINE_KEY *)(Builder->Buf + TextSize);
+  Builder->Table = (UINT32 *)(Builder->Keys + Builder->NumKeys);
+  Builder->TableMask = TableSize - 1;
+  Builder->MaxKeys = Builder->NumKeys;
+  Builder->Len = 0;
+  Builder->NumKeys = 0;
+  Builder->Overflow = FALSE;
+  return EFI_SUCCESS;
+}
+
+/* Keep the last token of every merged key. The tokens are scanned once to
+ * find the last one of each key, then once more to move the kept ones
+ * down over the dropped ones, with one hash lookup per token each time.
+ */
+STATIC VOID
+CmdLineBuilderOverride (CMDLINE_BUILDER *Builder)
+{
+  CHAR8 *Buf = Builder->Buf;
+  CMDLINE_KEY *Entry;
+  UINTN TokenLen;
+  UINTN KeyLen;
+  UINTN Index;
+  UINTN Write;
+  UINTN Pos;
+  UINTN End;
+  BOOLEAN Drop;
+  BOOLEAN SkipSpace = FALSE;
+
+  for (Pos = 0; Pos < Builder->Len; Pos += TokenLen) {
+    if (Buf[Pos] == ' ') {
+      TokenLen = 1;
+      continue;
+    }
+    TokenLen = CmdLineTokenLen (Buf + Pos, Builder->Len - Pos);
+    if (TokenLen == 2 &&
+        Buf[Pos] == '-' &&
+        Buf[Pos + 1] == '-') {
+      break;
+    }
+    KeyLen = CmdLineKeyLen (Buf + Pos, TokenLen);
+    if (!KeyLen) {
+      continue;
+    }
+    Entry = CmdLineFindKey (Builder, Buf + Pos, KeyLen, 0);
+    if (Entry) {
+      Entry->Last = Pos;
+    }
+  }
+  End = Pos;
+
+  /* The key of an entry is read at its last token, which is not moved
+   * before the scan has passed it.
+   */
+  for (Index = 0; Index < Builder->NumKeys; Index++) {
+    Builder->Keys[Index].Offset = Builder->Keys[Index].Last;
+  }
+
+  for (Pos = 0, Write = 0; Pos < End; Pos += TokenLen) {
+    if (Buf[Pos] == ' ') {
+      TokenLen = 1;
+      if (!SkipSpace) {
+        Buf[Write++] = ' ';
+      }
+      SkipSpace = FALSE;
+      continue;
+    }
+    TokenLen = CmdLineTokenLen (Buf + Pos, End - Pos);
+    KeyLen = CmdLineKeyLen (Buf + Pos, TokenLen);
+    /* A later token of the key is kept */
+    Drop = KeyLen &&
+           CmdLineFindKey (Builder, Buf + Pos, KeyLen, Pos + 1) != NULL;
+    if (Drop) {
+      /* Drop the space in front of the token with it, or the one after it
+       * for the first token.
+       */
+      if (Write &&
+          Buf[Write - 1] == ' ') {
+        Write--;
+      } else {
+        SkipSpace = TRUE;
+      }
+      continue;
+    }
+    SkipSpace = FALSE;
+    CopyMem (Buf + Write, Buf + Pos, TokenLen);
+    Write += TokenLen;
+  }
+
+  CopyMem (Buf + Write, Buf + End, Builder->Len - End);
+  Builder->Len = Write + Builder->Len - End;
+}
+
+/**
+  Complete the command line written in the second pass
+  @param[in] Builder    The command line builder.
+  @param[out] CmdLine   The command line, to be freed with FreePool ().
+
+  @retval EFI_SUCCESS            The command line is complete.
+  @retval EFI_BUFFER_TOO_SMALL   The second pass did not make the same
+                                 appends as the sizing pass.
+  @retval EFI_NOT_READY          No buffer was allocated.
+ **/
+EFI_STATUS
+CmdLineBuilderFinish (CMDLINE_BUILDER *Builder, CHAR8 **CmdLine)
+{
+  if (!Builder->Buf) {
+    return EFI_NOT_READY;
+  }
+  if (Builder->Overflow) {
+    DEBUG ((EFI_D_ERROR, "CMDLINE: Longer than the %lu bytes sized\n",
+            (UINT64)Builder->Size));
+    return EFI_BUFFER_TOO_SMALL;
+  }
+
+  if (Builder->NumKeys) {
+    CmdLineBuilderOverride (Builder);
+  }
+  Builder->Buf[Builder->Len] = '\0';
+
+  *CmdLine = Builder->Buf;
+  Builder->Buf = NULL;
+  return EFI_SUCCESS;
+}
+
+VOID
+CmdLineBuilderFree (CMDLINE_BUILDER *Builder)
+{
+  if (Builder->Buf) {
+    FreePool (Builder->Buf);
+  }
+  CmdLineBuilderInit (Builder);
+}
@@ -45,15 +45,39 @@
 #include "zlib/inflate.h"
 #include "zlib/inffast.h"
 
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
 #include <Library/DebugLib.h>
+#include <Library/Lz4Lib.h>
 #include <Library/MemoryAllocationLib.h>
 
 #define GZIP_HEADER_LEN 10
 #define GZIP_FILENAME_LIMIT 256
+#define GZIP_TRAILER_LEN 8
+
+/* DTB_MAGIC of LocateDeviceTree.h, which can not be used with zlib here */
+#define LZ4_APPENDED_DTB_MAGIC 0xedfe0dd0
+
+/* inflate allocates its state and, if it does not finish in one call, a
+ * window of 1 << MAX_WBITS bytes. Both are carved from one static arena
+ * instead of going through the pool for every kernel.
+ */
+#define ZLIB_ARENA_ALIGN(x) (((x) + 7) & ~((UINTN)7))
+#define ZLIB_ARENA_SIZE                                                        \
+  (ZLIB_ARENA_ALIGN (sizeof (struct inflate_state)) + (1U << MAX_WBITS))
+
+STATIC UINT8 ZlibArena[ZLIB_ARENA_SIZE] __attribute__ ((aligned (8)));
+STATIC UINTN ZlibArenaUsed;
 
 static void
 zlib_free (voidpf qpaque, void *addr)
 {
+  if ((UINT8 *)addr >= ZlibArena &&
+      (UINT8 *)addr < ZlibArena + ZLIB_ARENA_SIZE) {
+    /* Arena memory is released as a whole by decompress */
+    return;
+  }
+
   FreePool (addr);
   addr = NULL;
 }
@@ -62,7 +86,17 @@ zlib_free (voidpf qpaque, void *addr)
 static void *
 zlib_alloc (voidpf qpaque, uInt items, uInt size)
 {
-  return AllocateZeroPool (items * size);
+  UINTN Len = ZLIB_ARENA_ALIGN ((UINTN)items * size);
+  VOID *Ptr;
+
+  if (Len > ZLIB_ARENA_SIZE - ZlibArenaUsed) {
+    return AllocateZeroPool (items * size);
+  }
+
+  Ptr = ZlibArena + ZlibArenaUsed;
+  ZlibArenaUsed += Len;
+  ZeroMem (Ptr, Len);
+  return Ptr;
 }
 
 /* decompress gzip file "in_buf", return 0 if decompressed successful,
@@ -73,6 +107,10 @@ zlib_alloc (voidpf qpaque, uInt items, uInt size)
  * out_buf_len - the available length of out_buf
  * pos - position of the end of gzip file
  * out_len - the length of decompressed data
+ *
+ * The whole kernel is in memory, so it is inflated in one call with
+ * Z_FINISH: inflate then writes straight to out_buf and never copies the
+ * output into its window.
  */
 int
 decompress (unsigned char *in_buf,
@@ -82,83 +120,79 @@ decompress (unsigned char *in_buf,
             unsigned int *pos,
             unsigned int *out_len)
 {
-  struct z_stream_s *stream;
-  int rc = -1;
-  int i;
+  struct z_stream_s stream;
+  unsigned int hdr_len = GZIP_HEADER_LEN;
+  int rc;
 
   if (in_len <= GZIP_HEADER_LEN) {
     DEBUG ((EFI_D_ERROR, "the input data is not a gzip package.\n"));
-    return rc;
+    return -1;
   }
 
   if (out_buf_len <= in_len) {
     DEBUG ((EFI_D_ERROR,
             "the available length: %u of out_buf is not enough, need %u.\n",
             out_buf_len, in_len));
-    return rc;
-  }
-
-  stream = AllocateZeroPool (sizeof (*stream));
-  if (stream == NULL) {
-    DEBUG ((EFI_D_ERROR, "allocating z_stream failed.\n"));
-    return rc;
+    return -1;
   }
 
-  stream->zalloc = zlib_alloc;
-  stream->zfree = zlib_free;
-  stream->next_out = out_buf;
-  stream->avail_out = out_buf_len;
-
-  /* skip over gzip header */
-  stream->next_in = in_buf + GZIP_HEADER_LEN;
-  stream->avail_in = in_len - GZIP_HEADER_LEN;
   /* skip over ascii filename */
   if (in_buf[3] & 0x8) {
-    for (i = 0; i < GZIP_FILENAME_LIMIT && *stream->next_in++; i++) {
-      if (stream->avail_in == 0) {
+    while (in_buf[hdr_len] != '\0') {
+      hdr_len++;
+      if (hdr_len - GZIP_HEADER_LEN >= GZIP_FILENAME_LIMIT ||
+          hdr_len >= in_len) {
         DEBUG ((EFI_D_ERROR, "header error\n"));
-        goto gunzip_end;
+        return -1;
       }
-      --stream->avail_in;
     }
+    hdr_len++;
   }
 
-  rc = inflateInit2 (stream, -MAX_WBITS);
+  SetMem (&stream, sizeof (stream), 0);
+  stream.zalloc = zlib_alloc;
+  stream.zfree = zlib_free;
+  stream.next_in = in_buf + hdr_len;
+  stream.avail_in = in_len - hdr_len;
+  stream.next_out = out_buf;
+  stream.avail_out = out_buf_len;
+  ZlibArenaUsed = 0;
+
+  rc = inflateInit2 (&stream, -MAX_WBITS);
   if (rc != Z_OK) {
     DEBUG ((EFI_D_ERROR, "inflateInit2 failed!\n"));
-    goto gunzip_end;
+    return -1;
   }
 
   /* If inflate() returns
-   * Z_OK and with zero avail_out: O/P buffer is full
    * Z_STREAM_END: we uncompressed it all
+   * Z_BUF_ERROR with zero avail_out: O/P buffer is full
+   * Z_BUF_ERROR with zero avail_in: the input is truncated
    */
-  rc = inflate (stream, Z_NO_FLUSH);
-  if (stream->avail_out == 0 && rc == Z_OK) {
-    rc = -1;
-    DEBUG ((EFI_D_ERROR, "Error in decompression: Output buffer full\n"));
-    goto gunzip_end;
-  } else if (rc == Z_STREAM_END) {
+  rc = inflate (&stream, Z_FINISH);
+  if (rc == Z_STREAM_END) {
+    if (pos)
+      /* alculation the length of the compressed package */
+      *pos = hdr_len + stream.total_in + GZIP_TRAILER_LEN;
+
+    if (out_len)
+      *out_len = stream.total_out;
     rc = 0;
   } else {
-    DEBUG (
-        (EFI_D_ERROR,
-         "Error in decompression: Something went wrong while decompression\n"));
+    if (rc == Z_BUF_ERROR && stream.avail_out == 0) {
+      DEBUG ((EFI_D_ERROR, "Error in decompression: Output buffer full\n"));
+    } else if (rc == Z_BUF_ERROR && stream.avail_in == 0) {
+      DEBUG ((EFI_D_ERROR,
+              "Error in decompression: gzip data is truncated\n"));
+    } else {
+      DEBUG ((EFI_D_ERROR, "Error in decompression: Something went wrong "
+                           "while decompression\n"));
+    }
     rc = -1;
-    goto gunzip_end;
   }
 
-  inflateEnd (stream);
-  if (pos)
-    /* alculation the length of the compressed package */
-    *pos = stream->next_in - in_buf + 8;
-
-  if (out_len)
-    *out_len = stream->total_out;
-
-gunzip_end:
-  FreePool (stream);
-  stream = NULL;
+  inflateEnd (&stream);
+  ZlibArenaUsed = 0;
   return rc; /* returns 0 if decompressed successful */
 }
 
@@ -174,3 +208,112 @@ is_gzip_package (unsigned char *buf, unsigned int len)
 
   return true;
 }
+
+/* check if the input "buf" file was an LZ4 frame or legacy frame.
+ * Return true if the input "buf" is an LZ4 package.
+ */
+int
+is_lz4_package (unsigned char *buf, unsigned int len)
+{
+  if (!buf) {
+    return false;
+  }
+
+  return IsLz4Frame (buf, len);
+}
+
+/* An LZ4 legacy frame has no end mark. The kernel build appends the 4 byte
+ * decoded size to "lz4 -l" output, and a dtb may follow either of them.
+ */
+STATIC BOOLEAN
+Lz4LegacyFrameEnd (unsigned char *in_buf,
+                   unsigned int in_len,
+                   UINTN *in_pos,
+                   UINTN out_pos)
+{
+  UINTN Pos = *in_pos;
+
+  if (in_len - Pos >= sizeof (UINT32) &&
+      ReadUnaligned32 ((UINT32 *)(in_buf + Pos)) == out_pos) {
+    Pos += sizeof (UINT32);
+  }
+
+  if (in_len - Pos >= sizeof (UINT32) &&
+      ReadUnaligned32 ((UINT32 *)(in_buf + Pos)) == LZ4_APPENDED_DTB_MAGIC) {
+    *in_pos = Pos;
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+/* decompress LZ4 file "in_buf", return 0 if decompressed successful,
+ * return -1 if decompressed failed. The arguments are those of
+ * decompress(), pos is the end of the LZ4 frame.
+ */
+int
+lz4_decompress (unsigned char *in_buf,
+                unsigned int in_len,
+                unsigned char *out_buf,
+                unsigned int out_buf_len,
+                unsigned int *pos,
+                unsigned int *out_len)
+{
+  LZ4_FRAME_DECODER Decoder;
+  EFI_STATUS Status = EFI_SUCCESS;
+  UINTN InPos = 0;
+  UINTN OutPos = 0;
+
+  if (out_buf_len <= in_len) {
+    DEBUG ((EFI_D_ERROR,
+            "the available length: %u of out_buf is not enough, need %u.\n",
+            out_buf_len, in_len));
+    return -1;
+  }
+
+  Lz4FrameInit (&Decoder);
+  do {
+    if (Decoder.Legacy &&
+        Decoder.Stage == Lz4StageBlock &&
+        Lz4LegacyFrameEnd (in_buf, in_len, &InPos, OutPos)) {
+      break;
+    }
+    Status = Lz4FrameDecode (&Decoder, in_buf, in_len, &InPos, TRUE,
+                             out_buf, out_buf_len, &OutPos);
+  } while (Status == EFI_SUCCESS);
+
+  if (EFI_ERROR (Status) &&
+      Status != EFI_END_OF_FILE) {
+    DEBUG ((EFI_D_ERROR, "Error in LZ4 decompression: %r\n", Status));
+    return -1;
+  }
+
+  if (pos)
+    *pos = InPos;
+
+  if (out_len)
+    *out_len = OutPos;
+
+  return 0;
+}
+
+STATIC CONST KERNEL_DECOMPRESSOR KernelDecompressors[] = {
+  {"gzip", is_gzip_package, decompress},
+  {"lz4", is_lz4_package, lz4_decompress},
+};
+
+const KERNEL_DECOMPRESSOR *
+get_kernel_decompressor (unsigned char *buf, unsigned int len)
+{
+  UINTN Index;
+
+  for (Index = 0;
+       Index < sizeof (KernelDecompressors) / sizeof (KernelDecompressors[0]);
+       Index++) {
+    if (KernelDecompressors[Index].IsPackage (buf, len)) {
+      return &KernelDecompressors[Index];
+    }
+  }
+
+  return NULL;
+}
@@ -67,6 +67,9 @@ STATIC VOID FdtDeleteNodeList (VOID)
 
   while (Current != NULL) {
     Next = Current->Next;
+    if (Current->NodeName) {
+      FreePool ((VOID *)Current->NodeName);
+    }
     FreePool (Current);
     Current = Next;
   }
@@ -151,7 +154,7 @@ STATIC BOOLEAN FdtFindNodeFromList (CONST CHAR8 *Name,
   return FALSE;
 }
 
-VOID FdtUpdateNodeOffsetInList (INT32 NodeOffset, INT32 DiffLen)
+STATIC VOID FdtUpdateNodeOffsetInList (INT32 NodeOffset, INT32 DiffLen)
 {
   FDT_FIRST_LEVEL_NODE *Node = NULL;
 
@@ -194,7 +197,7 @@ STATIC BOOLEAN FdtNodeNameEq (CONST VOID *Fdt, INT32 Offset,
 
   if (Ptr[Len] == '\0') {
     return TRUE;
-  } else if (!ScanMem8 (Source, '@', Len) &&
+  } else if (!ScanMem8 (Source, Len, '@') &&
             (Ptr[Len] == '@')) {
     return TRUE;
   }
@@ -369,6 +372,571 @@ INT32 FdtGetPropLen (VOID *Fdt, INT32 Offset, CONST CHAR8 *Name)
   return Len;
 }
 
+/* Property edits queued on a blob between FdtEditBegin () and
+ * FdtEditCommit (). The blob is left as it is until the commit, so the node
+ * and property offsets in the records and the ones the callers hold stay
+ * valid, and the commit moves every byte of the blob at most once.
+ */
+typedef enum {
+  FDT_EDIT_SET,
+  FDT_EDIT_APPEND,
+  FDT_EDIT_APPEND_STR,
+} FDT_EDIT_MODE;
+
+typedef struct {
+  INT32 NodeOffset;
+  /* Offset of the property replaced, or where a new one is inserted */
+  INT32 Offset;
+  /* Length of the property replaced, -1 for a new property */
+  INT32 OldLen;
+  UINT32 NameOff;
+  /* Order the edit was queued in, and the previous edit of the same node */
+  UINT32 Seq;
+  INT32 PrevInNode;
+  UINT8 *Data;
+  UINT32 Len;
+  UINT32 Size;
+} FDT_EDIT;
+
+typedef struct {
+  INT32 NodeOffset;
+  /* Index of the last edit queued on the node plus one, 0 if unused */
+  UINT32 Last;
+} FDT_EDIT_NODE;
+
+typedef struct {
+  VOID *Fdt;
+  /* FdtEditBegin () calls on Fdt not yet matched by an FdtEditCommit () */
+  UINT32 Depth;
+  FDT_EDIT *Edits;
+  UINT32 Count;
+  UINT32 Max;
+  FDT_EDIT_NODE *Nodes;
+  UINT32 NodeMask;
+  /* Names added to the end of the strings block */
+  CHAR8 *Strings;
+  UINT32 StringsLen;
+  UINT32 StringsSize;
+  /* End of the strings block once the queued edits are applied */
+  UINT32 DataSize;
+} FDT_EDIT_BATCH;
+
+#define FDT_EDIT_MIN_COUNT 64
+#define FDT_EDIT_MIN_DATA 16
+
+STATIC FDT_EDIT_BATCH Batch;
+
+/* Growth of the blob from setting a property of OldLen bytes, or a new one
+ * if OldLen is -1, to Len bytes.
+ */
+STATIC INT32 FdtEditDelta (INT32 OldLen, UINT32 Len)
+{
+  if (OldLen < 0) {
+    return sizeof (struct fdt_property) + FDT_TAGALIGN (Len);
+  }
+  return FDT_TAGALIGN (Len) - FDT_TAGALIGN (OldLen);
+}
+
+/* End of the part of the original blob the edit replaces */
+STATIC INT32 FdtEditOldEnd (CONST FDT_EDIT *Edit)
+{
+  if (Edit->OldLen < 0) {
+    return Edit->Offset;
+  }
+  return Edit->Offset + sizeof (struct fdt_property) +
+         FDT_TAGALIGN (Edit->OldLen);
+}
+
+STATIC FDT_EDIT_NODE *FdtEditNodeSlot (INT32 NodeOffset)
+{
+  UINT32 Index = ((UINT32)NodeOffset * 2654435761U) & Batch.NodeMask;
+
+  while (Batch.Nodes[Index].Last &&
+         Batch.Nodes[Index].NodeOffset != NodeOffset) {
+    Index = (Index + 1) & Batch.NodeMask;
+  }
+  return &Batch.Nodes[Index];
+}
+
+STATIC CONST CHAR8 *FdtEditString (UINT32 NameOff)
+{
+  UINT32 StringsSize = fdt_size_dt_strings (Batch.Fdt);
+
+  if (NameOff < StringsSize) {
+    return fdt_string (Batch.Fdt, NameOff);
+  }
+  return Batch.Strings + (NameOff - StringsSize);
+}
+
+STATIC FDT_EDIT *FdtEditFind (INT32 NodeOffset, CONST CHAR8 *Name)
+{
+  FDT_EDIT_NODE *Node;
+  INT32 Index;
+
+  if (!Batch.Count) {
+    return NULL;
+  }
+
+  Node = FdtEditNodeSlot (NodeOffset);
+  Index = (INT32)Node->Last - 1;
+  while (Index >= 0) {
+    if (!AsciiStrCmp (FdtEditString (Batch.Edits[Index].NameOff), Name)) {
+      return &Batch.Edits[Index];
+    }
+    Index = Batch.Edits[Index].PrevInNode;
+  }
+  return NULL;
+}
+
+/* Offset of Name in the strings block as fdt_setprop () would find or add
+ * it, the names added by earlier edits included. -1 if it is not there.
+ */
+STATIC INT32 FdtEditFindString (CONST CHAR8 *Name, UINT32 Len)
+{
+  CONST CHAR8 *Table = fdt_string (Batch.Fdt, 0);
+  UINT32 Size = fdt_size_dt_strings (Batch.Fdt);
+  UINT32 Index;
+
+  for (Index = 0; Index + Len <= Size; Index++) {
+    if (!CompareMem (Table + Index, Name, Len)) {
+      return Index;
+    }
+  }
+  for (Index = 0; Index + Len <= Batch.StringsLen; Index++) {
+    if (!CompareMem (Batch.Strings + Index, Name, Len)) {
+      return Size + Index;
+    }
+  }
+  return -1;
+}
+
+STATIC BOOLEAN FdtEditGrow (VOID **Buffer, UINT32 *Size, UINT32 Need,
+                            UINT32 Min, UINT32 ElemSize)
+{
+  UINT32 NewSize = *Size ? *Size : Min;
+  VOID *New;
+
+  if (Need <= *Size) {
+    return TRUE;
+  }
+  while (NewSize < Need) {
+    NewSize *= 2;
+  }
+  New = AllocatePool (NewSize * ElemSize);
+  if (!New) {
+    return FALSE;
+  }
+  if (*Buffer) {
+    CopyMem (New, *Buffer, *Size * ElemSize);
+    FreePool (*Buffer);
+  }
+  *Buffer = New;
+  *Size = NewSize;
+  return TRUE;
+}
+
+/* Keep the node table at most half full, it is rebuilt from the edits
+ * whenever the edit array grows.
+ */
+STATIC BOOLEAN FdtEditReserve (VOID)
+{
+  UINT32 Max = Batch.Max;
+  UINT32 Index;
+  FDT_EDIT_NODE *Nodes;
+  FDT_EDIT_NODE *Node;
+
+  if (Batch.Count < Batch.Max) {
+    return TRUE;
+  }
+  if (!FdtEditGrow ((VOID **)&Batch.Edits, &Max, Batch.Count + 1,
+                    FDT_EDIT_MIN_COUNT, sizeof (FDT_EDIT))) {
+    return FALSE;
+  }
+  Nodes = AllocateZeroPool (Max * 2 * sizeof (FDT_EDIT_NODE));
+  if (!Nodes) {
+    return FALSE;
+  }
+  if (Batch.Nodes) {
+    FreePool (Batch.Nodes);
+  }
+  Batch.Max = Max;
+  Batch.Nodes = Nodes;
+  Batch.NodeMask = Max * 2 - 1;
+  for (Index = 0; Index < Batch.Count; Index++) {
+    Node = FdtEditNodeSlot (Batch.Edits[Index].NodeOffset);
+    Node->NodeOffset = Batch.Edits[Index].NodeOffset;
+    Node->Last = Index + 1;
+  }
+  return TRUE;
+}
+
+STATIC VOID FdtEditFree (VOID)
+{
+  UINT32 Index;
+
+  for (Index = 0; Index < Batch.Count; Index++) {
+    if (Batch.Edits[Index].Data) {
+      FreePool (Batch.Edits[Index].Data);
+    }
+  }
+  if (Batch.Edits) {
+    FreePool (Batch.Edits);
+  }
+  if (Batch.Nodes) {
+    FreePool (Batch.Nodes);
+  }
+  if (Batch.Strings) {
+    FreePool (Batch.Strings);
+  }
+  SetMem (&Batch, sizeof (Batch), 0);
+}
+
+/* Queue an edit, failing with the same error and leaving the strings block
+ * in the same state as the fdt_setprop (), fdt_appendprop () or
+ * fdt_appendprop_str () call it stands for.
+ */
+STATIC INT32 FdtEditQueue (INT32 NodeOffset, CONST CHAR8 *Name,
+                           CONST VOID *Val, INT32 Len, FDT_EDIT_MODE Mode)
+{
+  VOID *Fdt = Batch.Fdt;
+  FDT_EDIT *Edit;
+  FDT_EDIT_NODE *Node;
+  CONST struct fdt_property *Prop = NULL;
+  INT32 OldLen;
+  INT32 NextOffset;
+  INT32 NameOff;
+  UINT32 NameLen;
+  UINT32 CurLen;
+  UINT32 NewLen;
+  INT32 Growth;
+  BOOLEAN Queued;
+
+  Edit = FdtEditFind (NodeOffset, Name);
+  if (!Edit) {
+    Prop = fdt_get_property (Fdt, NodeOffset, Name, &OldLen);
+    if (!Prop &&
+        OldLen != -FDT_ERR_NOTFOUND) {
+      return OldLen;
+    }
+    if (!FdtEditReserve ()) {
+      return -FDT_ERR_NOSPACE;
+    }
+
+    Edit = &Batch.Edits[Batch.Count];
+    SetMem (Edit, sizeof (*Edit), 0);
+    Edit->NodeOffset = NodeOffset;
+    Edit->Seq = Batch.Count;
+
+    if (Prop) {
+      Edit->Offset = (CONST UINT8 *)Prop - (CONST UINT8 *)Fdt -
+                     fdt_off_dt_struct (Fdt);
+      Edit->OldLen = OldLen;
+      Edit->NameOff = fdt32_to_cpu (Prop->nameoff);
+      /* Start from the current value, Data is filled in below */
+      Edit->Len = OldLen;
+    } else {
+      /* New properties go in front of the others, as fdt_setprop () puts
+       * them right after the node name.
+       */
+      if (fdt_next_tag (Fdt, NodeOffset, &NextOffset) != FDT_BEGIN_NODE) {
+        return -FDT_ERR_BADOFFSET;
+      }
+      Edit->Offset = NextOffset;
+      Edit->OldLen = -1;
+
+      NameLen = AsciiStrLen (Name) + 1;
+      NameOff = FdtEditFindString (Name, NameLen);
+      if (NameOff < 0) {
+        if (Batch.DataSize + NameLen > fdt_totalsize (Fdt) ||
+            !FdtEditGrow ((VOID **)&Batch.Strings, &Batch.StringsSize,
+                          Batch.StringsLen + NameLen, FDT_EDIT_MIN_DATA,
+                          1)) {
+          return -FDT_ERR_NOSPACE;
+        }
+        NameOff = fdt_size_dt_strings (Fdt) + Batch.StringsLen;
+        CopyMem (Batch.Strings + Batch.StringsLen, Name, NameLen);
+        Batch.StringsLen += NameLen;
+        Batch.DataSize += NameLen;
+      }
+      Edit->NameOff = NameOff;
+    }
+  }
+
+  Queued = (Edit->Seq < Batch.Count);
+  CurLen = (Mode == FDT_EDIT_SET) ? 0 : Edit->Len;
+  NewLen = CurLen + Len;
+  Growth = FdtEditDelta (Edit->OldLen, NewLen) -
+           (Queued ? FdtEditDelta (Edit->OldLen, Edit->Len) : 0);
+  if ((INT64)Batch.DataSize + Growth > fdt_totalsize (Fdt) ||
+      !FdtEditGrow ((VOID **)&Edit->Data, &Edit->Size, NewLen,
+                    FDT_EDIT_MIN_DATA, 1)) {
+    return -FDT_ERR_NOSPACE;
+  }
+
+  if (!Queued &&
+      CurLen) {
+    CopyMem (Edit->Data, Prop->data, CurLen);
+  }
+  if (Mode == FDT_EDIT_APPEND_STR &&
+      CurLen) {
+    /* Add space to separate the appended strings */
+    Edit->Data[CurLen - 1] = 0x20;
+  }
+  CopyMem (Edit->Data + CurLen, Val, Len);
+  Edit->Len = NewLen;
+  Batch.DataSize += Growth;
+
+  if (!Queued) {
+    Node = FdtEditNodeSlot (NodeOffset);
+    Edit->PrevInNode = (INT32)Node->Last - 1;
+    Node->NodeOffset = NodeOffset;
+    Node->Last = ++Batch.Count;
+  }
+  return 0;
+}
+
+/* Edits in blob order, new properties of a node in the reverse of the order
+ * they were added in, the way repeated fdt_setprop () calls leave them.
+ */
+STATIC BOOLEAN FdtEditBefore (CONST FDT_EDIT *A, CONST FDT_EDIT *B)
+{
+  if (A->Offset != B->Offset) {
+    return A->Offset < B->Offset;
+  }
+  if ((A->OldLen < 0) != (B->OldLen < 0)) {
+    return A->OldLen < 0;
+  }
+  return A->Seq > B->Seq;
+}
+
+STATIC VOID FdtEditSort (VOID)
+{
+  FDT_EDIT Edit;
+  UINT32 Index;
+  UINT32 Pos;
+
+  for (Index = 1; Index < Batch.Count; Index++) {
+    Edit = Batch.Edits[Index];
+    for (Pos = Index;
+         Pos > 0 && FdtEditBefore (&Edit, &Batch.Edits[Pos - 1]);
+         Pos--) {
+      Batch.Edits[Pos] = Batch.Edits[Pos - 1];
+    }
+    Batch.Edits[Pos] = Edit;
+  }
+}
+
+/* Move the first level nodes in the list by the edits before them, both
+ * are sorted so this is a single walk.
+ */
+STATIC VOID FdtEditMoveNodeList (INT32 StructDelta)
+{
+  FDT_FIRST_LEVEL_NODE *Node;
+  FDT_EDIT *Edit = Batch.Edits + Batch.Count;
+
+  for (Node = NodeList; Node; Node = Node->Next) {
+    while (Edit > Batch.Edits &&
+           Edit[-1].Offset > Node->NodeOffset) {
+      Edit--;
+      StructDelta -= FdtEditDelta (Edit->OldLen, Edit->Len);
+    }
+    Node->NodeOffset += StructDelta;
+  }
+}
+
+/**
+  Start queueing property edits of a device tree blob
+  @param[in] Fdt        A pointer to the device tree blob.
+
+  Until FdtEditCommit () or FdtEditCancel (), FdtSetProp () and the
+  FdtAppendProp* () functions on Fdt only record the edit and the blob is
+  not changed, so node offsets taken from it stay valid. Reading a property
+  back returns the value it had before the batch.
+
+  A batch already open on Fdt is kept and the edits are applied by the
+  FdtEditCommit () matching the outermost FdtEditBegin ().
+
+  @retval 0             The batch is open.
+  @retval other         libfdt error of the blob header.
+ **/
+INT32 FdtEditBegin (VOID *Fdt)
+{
+  INT32 Ret;
+
+  if (Batch.Fdt &&
+      Fdt == Batch.Fdt) {
+    Batch.Depth++;
+    return 0;
+  }
+
+  if ((Ret = fdt_check_header (Fdt)) != 0) {
+    return Ret;
+  }
+  if (fdt_version (Fdt) < 17) {
+    return -FDT_ERR_BADVERSION;
+  }
+  if (fdt_off_dt_strings (Fdt) <
+      fdt_off_dt_struct (Fdt) + fdt_size_dt_struct (Fdt)) {
+    return -FDT_ERR_BADLAYOUT;
+  }
+
+  FdtEditCancel ();
+  /* The node list may hold offsets of an earlier blob */
+  FdtDeleteNodeList ();
+  Batch.Fdt = Fdt;
+  Batch.Depth = 1;
+  Batch.DataSize = fdt_off_dt_strings (Fdt) + fdt_size_dt_strings (Fdt);
+  return 0;
+}
+
+/**
+  Apply the queued edits to the blob and close the batch
+  @param[in] Fdt        A pointer to the device tree blob.
+
+  The structure block is rewritten in place in one pass: the parts between
+  the edits that move down are moved first, in blob order, then the ones
+  that move up in reverse order, so that none is overwritten before it has
+  moved. The queued properties are then written into the gaps left for
+  them. The result is the blob the same calls would have made without a
+  batch, except that the padding of the written properties is zeroed.
+
+  @retval 0             The edits are applied, left to an outer commit, or
+                        no batch is open.
+  @retval other         Fdt is not the blob of the open batch.
+ **/
+INT32 FdtEditCommit (VOID *Fdt)
+{
+  UINT8 *Struct;
+  FDT_EDIT *Edit;
+  struct fdt_property *Prop;
+  UINT32 Index;
+  INT32 Start;
+  INT32 End;
+  INT32 Shift;
+  INT32 StructDelta;
+
+  if (!Batch.Fdt) {
+    return 0;
+  }
+  if (Fdt != Batch.Fdt) {
+    return -FDT_ERR_BADSTATE;
+  }
+  if (Batch.Depth > 1) {
+    Batch.Depth--;
+    return 0;
+  }
+
+  FdtEditSort ();
+  Struct = (UINT8 *)Fdt + fdt_off_dt_struct (Fdt);
+  End = fdt_off_dt_strings (Fdt) + fdt_size_dt_strings (Fdt) -
+        fdt_off_dt_struct (Fdt);
+  StructDelta = Batch.DataSize - Batch.StringsLen -
+                (fdt_off_dt_strings (Fdt) + fdt_size_dt_strings (Fdt));
+
+  /* Parts moving down, the last one runs to the end of the strings block */
+  for (Index = 0, Start = 0, Shift = 0; Index <= Batch.Count; Index++) {
+    Edit = (Index < Batch.Count) ? &Batch.Edits[Index] : NULL;
+    if (Shift < 0) {
+      CopyMem (Struct + Start + Shift, Struct + Start,
+               (Edit ? Edit->Offset : End) - Start);
+    }
+    if (Edit) {
+      Start = FdtEditOldEnd (Edit);
+      Shift += FdtEditDelta (Edit->OldLen, Edit->Len);
+    }
+  }
+
+  /* Parts moving up */
+  for (Index = Batch.Count + 1, Shift = StructDelta; Index-- > 0;) {
+    Edit = (Index > 0) ? &Batch.Edits[Index - 1] : NULL;
+    Start = Edit ? FdtEditOldEnd (Edit) : 0;
+    if (Shift > 0) {
+      CopyMem (Struct + Start + Shift, Struct + Start,
+               ((Index < Batch.Count) ? Batch.Edits[Index].Offset : End) -
+                Start);
+    }
+    if (Edit) {
+      Shift -= FdtEditDelta (Edit->OldLen, Edit->Len);
+    }
+  }
+
+  /* The edited and new properties */
+  for (Index = 0, Shift = 0; Index < Batch.Count; Index++) {
+    Edit = &Batch.Edits[Index];
+    Prop = (struct fdt_property *)(Struct + Edit->Offset + Shift);
+    Prop->tag = cpu_to_fdt32 (FDT_PROP);
+    Prop->len = cpu_to_fdt32 (Edit->Len);
+    Prop->nameoff = cpu_to_fdt32 (Edit->NameOff);
+    CopyMem (Prop->data, Edit->Data, Edit->Len);
+    SetMem (Prop->data + Edit->Len, FDT_TAGALIGN (Edit->Len) - Edit->Len, 0);
+    Shift += FdtEditDelta (Edit->OldLen, Edit->Len);
+  }
+
+  CopyMem (Struct + End + StructDelta, Batch.Strings, Batch.StringsLen);
+  fdt_set_size_dt_struct (Fdt, fdt_size_dt_struct (Fdt) + StructDelta);
+  fdt_set_off_dt_strings (Fdt, fdt_off_dt_strings (Fdt) + StructDelta);
+  fdt_set_size_dt_strings (Fdt, fdt_size_dt_strings (Fdt) + Batch.StringsLen);
+
+  FdtEditMoveNodeList (StructDelta);
+  FdtEditFree ();
+  return 0;
+}
+
+/**
+  Drop the queued edits and close the batch, the blob is left unchanged.
+  The edits of all the nested FdtEditBegin () calls are dropped.
+ **/
+VOID FdtEditCancel (VOID)
+{
+  FdtEditFree ();
+}
+
+/* Bytes the property takes in the structure block, 0 if the node does not
+ * have it. An empty property still takes its header.
+ */
+STATIC INT32 FdtPropSize (VOID *Fdt, INT32 Offset, CONST CHAR8 *Name)
+{
+  INT32 Len = 0;
+
+  if (!fdt_get_property_w (Fdt, Offset, Name, &Len) ||
+      Len < 0) {
+    return 0;
+  }
+  return sizeof (struct fdt_property) + FDT_TAGALIGN (Len);
+}
+
+STATIC INT32 FdtUpdateProp (VOID *Fdt, INT32 Offset, CONST CHAR8 *Name,
+                            CONST VOID *Val, INT32 Len, FDT_EDIT_MODE Mode)
+{
+  INT32 OldSize = 0;
+  INT32 Ret;
+
+  if (Batch.Fdt &&
+      Fdt == Batch.Fdt) {
+    return FdtEditQueue (Offset, Name, Val, Len, Mode);
+  }
+
+  if (FixedPcdGetBool (EnableNewNodeSearchFuc)) {
+    OldSize = FdtPropSize (Fdt, Offset, Name);
+  }
+
+  if (Mode == FDT_EDIT_APPEND_STR) {
+    Ret = fdt_appendprop_str (Fdt, Offset, Name, Val, Len);
+  } else if (Mode == FDT_EDIT_APPEND) {
+    Ret = fdt_appendprop (Fdt, Offset, Name, Val, Len);
+  } else {
+    Ret = fdt_setprop (Fdt, Offset, Name, Val, Len);
+  }
+
+  if (FixedPcdGetBool (EnableNewNodeSearchFuc) &&
+      Ret == 0) {
+    /* Update the node's offset in the list */
+    FdtUpdateNodeOffsetInList (
+       Offset, FdtPropSize (Fdt, Offset, Name) - OldSize);
+  }
+  return Ret;
+}
+
 /**
  * FdtSetProp - create or change a property
  * @Fdt: pointer to the device tree blob
@@ -382,7 +950,8 @@ INT32 FdtGetPropLen (VOID *Fdt, INT32 Offset, CONST CHAR8 *Name)
  * does not already exist.
  *
  * This function may insert or delete data from the blob, and will
- * therefore change the offsets of some existing nodes.
+ * therefore change the offsets of some existing nodes. Inside a batch
+ * opened with FdtEditBegin () on the blob, the edit is only queued.
  *
  * returns:
  *  0, on success
@@ -400,29 +969,54 @@ INT32 FdtGetPropLen (VOID *Fdt, INT32 Offset, CONST CHAR8 *Name)
 INT32 FdtSetProp (VOID *Fdt, INT32 Offset, CONST CHAR8 *Name,
                     CONST VOID *Val, INT32 Len)
 {
-  INT32 OldLen, NewLen;
-  INT32 Ret = 0;
+  return FdtUpdateProp (Fdt, Offset, Name, Val, Len, FDT_EDIT_SET);
+}
 
-  if (FixedPcdGetBool (EnableNewNodeSearchFuc)) {
-    OldLen = FdtGetPropLen (Fdt, Offset, Name);
-    Ret = fdt_setprop (Fdt, Offset, Name, Val, Len);
-    if (Ret == 0) {
-      NewLen = FdtGetPropLen (Fdt, Offset, Name);
-    } else {
-      return Ret;
-    }
+/* Same as fdt_appendprop (), with the node list and batch handling of
+ * FdtSetProp ().
+ */
+INT32 FdtAppendProp (VOID *Fdt, INT32 Offset, CONST CHAR8 *Name,
+                     CONST VOID *Val, INT32 Len)
+{
+  return FdtUpdateProp (Fdt, Offset, Name, Val, Len, FDT_EDIT_APPEND);
+}
 
-    /* New prop */
-    if (OldLen == 0 &&
-      NewLen) {
-      NewLen = sizeof (struct fdt_property) + FDT_TAGALIGN (NewLen);
-    }
+/* Same as fdt_appendprop_string (), the string is appended to the one
+ * already in the property separated by a space.
+ */
+INT32 FdtAppendPropString (VOID *Fdt, INT32 Offset, CONST CHAR8 *Name,
+                           CONST CHAR8 *Str)
+{
+  return FdtUpdateProp (Fdt, Offset, Name, Str, AsciiStrLen (Str) + 1,
+                        FDT_EDIT_APPEND_STR);
+}
 
-    /* Update the node's offset in the list */
-    FdtUpdateNodeOffsetInList (
-       Offset, FDT_TAGALIGN (NewLen) - FDT_TAGALIGN (OldLen));
-  } else {
-    Ret = fdt_setprop (Fdt, Offset, Name, Val, Len);
-  }
-  return Ret;
+INT32 FdtSetPropU32 (VOID *Fdt, INT32 Offset, CONST CHAR8 *Name, UINT32 Val)
+{
+  fdt32_t Tmp = cpu_to_fdt32 (Val);
+
+  return FdtSetProp (Fdt, Offset, Name, &Tmp, sizeof (Tmp));
+}
+
+INT32 FdtSetPropU64 (VOID *Fdt, INT32 Offset, CONST CHAR8 *Name, UINT64 Val)
+{
+  fdt64_t Tmp = cpu_to_fdt64 (Val);
+
+  return FdtSetProp (Fdt, Offset, Name, &Tmp, sizeof (Tmp));
+}
+
+INT32 FdtAppendPropU32 (VOID *Fdt, INT32 Offset, CONST CHAR8 *Name,
+                        UINT32 Val)
+{
+  fdt32_t Tmp = cpu_to_fdt32 (Val);
+
+  return FdtAppendProp (Fdt, Offset, Name, &Tmp, sizeof (Tmp));
+}
+
+INT32 FdtAppendPropU64 (VOID *Fdt, INT32 Offset, CONST CHAR8 *Name,
+                        UINT64 Val)
+{
+  fdt64_t Tmp = cpu_to_fdt64 (Val);
+
+  return FdtAppendProp (Fdt, Offset, Name, &Tmp, sizeof (Tmp));
 }
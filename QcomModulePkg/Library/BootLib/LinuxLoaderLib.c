@@ -375,26 +375,15 @@ LoadImageFromPartition (VOID *ImageBuffer, UINT32 *ImageSize, CHAR16 *Pname)
 {
   EFI_STATUS Status;
   EFI_BLOCK_IO_PROTOCOL *BlkIo;
-  PartiSelectFilter HandleFilter;
   HandleInfo HandleInfoList[1];
   STATIC UINT32 MaxHandles;
-  STATIC UINT32 BlkIOAttrib = 0;
-
-  BlkIOAttrib = BLK_IO_SEL_PARTITIONED_MBR;
-  BlkIOAttrib |= BLK_IO_SEL_PARTITIONED_GPT;
-  BlkIOAttrib |= BLK_IO_SEL_MEDIA_TYPE_NON_REMOVABLE;
-  BlkIOAttrib |= BLK_IO_SEL_MATCH_PARTITION_LABEL;
-
-  HandleFilter.RootDeviceType = NULL;
-  HandleFilter.PartitionLabel = Pname;
-  HandleFilter.VolumeName = NULL;
+  BOOT_TRACE_BEGIN (Load);
 
   DEBUG ((DEBUG_INFO, "Loading Image Start : %u ms\n", GetTimerCountms ()));
 
   MaxHandles = sizeof (HandleInfoList) / sizeof (*HandleInfoList);
 
-  Status =
-      GetBlkIOHandles (BlkIOAttrib, &HandleFilter, HandleInfoList, &MaxHandles);
+  Status = GetPartitionHandles (Pname, HandleInfoList, &MaxHandles);
 
   if (Status == EFI_SUCCESS) {
     if (MaxHandles == 0)
@@ -408,7 +397,7 @@ LoadImageFromPartition (VOID *ImageBuffer, UINT32 *ImageSize, CHAR16 *Pname)
     }
   } else {
     DEBUG ((EFI_D_ERROR,
-            "%s: GetBlkIOHandles failed: %r\n", __func__, Status));
+            "%s: GetPartitionHandles failed: %r\n", __func__, Status));
     return Status;
   }
 
@@ -419,6 +408,7 @@ LoadImageFromPartition (VOID *ImageBuffer, UINT32 *ImageSize, CHAR16 *Pname)
       ROUND_TO_PAGE (*ImageSize, BlkIo->Media->BlockSize - 1), ImageBuffer);
 
   if (Status == EFI_SUCCESS) {
+    BOOT_TRACE_END (Load, BT_LOAD_PARTITION, *ImageSize);
     DEBUG ((DEBUG_INFO, "Loading Image Done : %lu ms\n", GetTimerCountms ()));
     DEBUG ((DEBUG_INFO, "Total Image Read size : %d Bytes\n", *ImageSize));
   }
@@ -591,6 +581,169 @@ GetNandMiscPartiGuid (EFI_GUID *Ptype)
   return Status;
 }
 
+/* Number of BlockIo2 writes WriteBlocksAsync keeps outstanding */
+#define MAX_ASYNC_WRITES 4
+
+/* Write Size bytes, a multiple of the block size, through BlockIo2 with up
+ * to MAX_ASYNC_WRITES writes of WriteUnitSize in flight. Completion is
+ * waited for on the token events, which lets the USB timer run while the
+ * device is busy. The writes may complete in any order.
+ *
+ * *Written is what was written when the function returns, which is always
+ * after every write it queued has completed. EFI_UNSUPPORTED means the
+ * caller has to write the rest synchronously: there is no BlockIo2, the
+ * TPL is too high to wait on events, or the device did not take a write.
+ */
+STATIC EFI_STATUS
+WriteBlocksAsync (IN EFI_BLOCK_IO_PROTOCOL *BlockIo,
+                  IN EFI_HANDLE *Handle,
+                  IN UINT64 Offset,
+                  IN UINT64 Size,
+                  IN UINT64 WriteUnitSize,
+                  IN UINT8 *Image,
+                  OUT UINT64 *Written)
+{
+  EFI_STATUS Status;
+  EFI_STATUS WriteStatus = EFI_SUCCESS;
+  EFI_BLOCK_IO2_PROTOCOL *BlockIo2 = NULL;
+  EFI_BLOCK_IO2_TOKEN Tokens[MAX_ASYNC_WRITES];
+  EFI_EVENT Waits[MAX_ASYNC_WRITES];
+  UINT32 WaitSlots[MAX_ASYNC_WRITES];
+  BOOLEAN Busy[MAX_ASYNC_WRITES];
+  BOOLEAN Poll = FALSE;
+  UINT64 Issued = 0;
+  UINT64 WriteSize;
+  UINT32 InFlight = 0;
+  UINT32 NumWaits;
+  UINT32 Index;
+  UINTN EventIndex;
+  EFI_TPL OldTpl;
+
+  *Written = 0;
+  if (Handle == NULL) {
+    return EFI_UNSUPPORTED;
+  }
+
+  Status = gBS->HandleProtocol (Handle, &gEfiBlockIo2ProtocolGuid,
+                                (VOID **)&BlockIo2);
+  if (Status != EFI_SUCCESS ||
+      BlockIo2 == NULL) {
+    return EFI_UNSUPPORTED;
+  }
+
+  /* WaitForEvent is only allowed at TPL_APPLICATION */
+  OldTpl = gBS->RaiseTPL (TPL_HIGH_LEVEL);
+  gBS->RestoreTPL (OldTpl);
+  if (OldTpl != TPL_APPLICATION) {
+    return EFI_UNSUPPORTED;
+  }
+
+  gBS->SetMem ((VOID *)Tokens, sizeof (Tokens), 0);
+  gBS->SetMem ((VOID *)Busy, sizeof (Busy), 0);
+  for (Index = 0; Index < MAX_ASYNC_WRITES; Index++) {
+    Status = gBS->CreateEvent (0, TPL_NOTIFY, NULL, NULL,
+                               &Tokens[Index].Event);
+    if (Status != EFI_SUCCESS) {
+      DEBUG ((EFI_D_VERBOSE, "Failed to create BlockIo2 event: %r\n",
+              Status));
+      WriteStatus = EFI_UNSUPPORTED;
+      goto out;
+    }
+  }
+
+  while ((Issued < Size && WriteStatus == EFI_SUCCESS) ||
+         InFlight) {
+    if (Issued < Size &&
+        WriteStatus == EFI_SUCCESS &&
+        InFlight < MAX_ASYNC_WRITES) {
+      Index = 0;
+      while (Busy[Index]) {
+        Index++;
+      }
+      WriteSize = MIN (Size - Issued, WriteUnitSize);
+      Status = BlockIo2->WriteBlocksEx (BlockIo2,
+                                        BlockIo->Media->MediaId,
+                                        Offset +
+                                        Issued / BlockIo->Media->BlockSize,
+                                        &Tokens[Index],
+                                        WriteSize,
+                                        Image + Issued);
+      if (Status != EFI_SUCCESS) {
+        /* Nothing of this write happened, the rest can be written
+         * synchronously once the others are done.
+         */
+        DEBUG ((EFI_D_VERBOSE, "WriteBlocksEx failed: %r\n", Status));
+        WriteStatus = EFI_UNSUPPORTED;
+        continue;
+      }
+
+      Busy[Index] = TRUE;
+      Issued += WriteSize;
+      InFlight++;
+      continue;
+    }
+
+    /* Wait for whichever write completes first */
+    NumWaits = 0;
+    for (Index = 0; Index < MAX_ASYNC_WRITES; Index++) {
+      if (Busy[Index]) {
+        Waits[NumWaits] = Tokens[Index].Event;
+        WaitSlots[NumWaits++] = Index;
+      }
+    }
+
+    if (!Poll) {
+      Status = gBS->WaitForEvent (NumWaits, Waits, &EventIndex);
+      if (Status != EFI_SUCCESS) {
+        /* The writes in flight still own their buffers and events: poll
+         * them to completion, and write the rest synchronously.
+         */
+        DEBUG ((EFI_D_ERROR, "WaitForEvent failed: %r, polling\n", Status));
+        Poll = TRUE;
+        if (WriteStatus == EFI_SUCCESS) {
+          WriteStatus = EFI_UNSUPPORTED;
+        }
+        continue;
+      }
+    } else {
+      EventIndex = 0;
+      while (gBS->CheckEvent (Waits[EventIndex]) != EFI_SUCCESS) {
+        EventIndex = (EventIndex + 1) % NumWaits;
+      }
+    }
+
+    /* A failed write is returned even when the rest was going to be
+     * written synchronously
+     */
+    Index = WaitSlots[EventIndex];
+    if (Tokens[Index].TransactionStatus != EFI_SUCCESS &&
+        (WriteStatus == EFI_SUCCESS ||
+         WriteStatus == EFI_UNSUPPORTED)) {
+      DEBUG ((EFI_D_ERROR, "Async write failed :%r\n",
+              Tokens[Index].TransactionStatus));
+      WriteStatus = Tokens[Index].TransactionStatus;
+    }
+    Busy[Index] = FALSE;
+    InFlight--;
+  }
+
+  /* Without a failed write, all that was queued is on the device */
+  if (WriteStatus == EFI_SUCCESS ||
+      WriteStatus == EFI_UNSUPPORTED) {
+    *Written = Issued;
+  }
+
+out:
+  for (Index = 0; Index < MAX_ASYNC_WRITES; Index++) {
+    if (Tokens[Index].Event != NULL) {
+      gBS->CloseEvent (Tokens[Index].Event);
+      Tokens[Index].Event = NULL;
+    }
+  }
+
+  return WriteStatus;
+}
+
 EFI_STATUS
 WriteBlockToPartition (EFI_BLOCK_IO_PROTOCOL *BlockIo,
                    IN EFI_HANDLE *Handle,
@@ -605,6 +758,7 @@ WriteBlockToPartition (EFI_BLOCK_IO_PROTOCOL *BlockIo,
   UINT64 WriteUnitSize = MAX_WRITE_SIZE;
   INT64 LeftSize = 0;
   UINT32 WriteSize = 0;
+  UINT64 Written = 0;
 
   if ((BlockIo == NULL) ||
     (Image == NULL)) {
@@ -654,6 +808,21 @@ WriteBlockToPartition (EFI_BLOCK_IO_PROTOCOL *BlockIo,
     }
 
     LeftSize = DivMsgBufSize;
+
+    /* Flash threads already run beside USB, the async path is for the
+     * single threaded USB timer mode.
+     */
+    if (!IsUseMThreadParallel ()) {
+      Status = WriteBlocksAsync (BlockIo, Handle, Offset, DivMsgBufSize,
+                                 WriteUnitSize, Image, &Written);
+      if (Status != EFI_SUCCESS &&
+          Status != EFI_UNSUPPORTED) {
+        return Status;
+      }
+      Offset += Written / BlockIo->Media->BlockSize;
+      LeftSize -= Written;
+    }
+
     while (LeftSize > 0) {
       WriteSize = LeftSize > WriteUnitSize? WriteUnitSize : LeftSize;
       Status = BlockIo->WriteBlocks (BlockIo,
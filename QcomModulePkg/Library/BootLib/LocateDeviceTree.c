@@ -1120,6 +1120,105 @@ err:
   return Status;
 }
 
+/* Summarizes the root properties of Dtb the way the dtbo match index
+ * stores them, see DTBO_INDEX_MAGIC.
+ */
+STATIC BOOLEAN
+DtboIndexCompute (VOID *Dtb, UINT32 *SocMask, UINT32 *Board)
+{
+  CONST CHAR8 *Prop;
+  INT32 Len;
+  INT32 RootOffset;
+  UINT32 PlatformId;
+  UINT32 Variant;
+  UINT32 Subtype;
+
+  RootOffset = fdt_path_offset (Dtb, "/");
+  if (RootOffset < 0) {
+    return FALSE;
+  }
+
+  *SocMask = DTBO_INDEX_SOC_ALL;
+  Prop = (CONST CHAR8 *)fdt_getprop (Dtb, RootOffset, "qcom,msm-id", &Len);
+  if (Prop && (Len > 0) && (!(Len % PLAT_ID_SIZE))) {
+    *SocMask = 0;
+    for (; Len > 0; Len -= PLAT_ID_SIZE, Prop += PLAT_ID_SIZE) {
+      PlatformId = fdt32_to_cpu (((struct plat_id *)Prop)->platform_id);
+      *SocMask |= 1U << ((PlatformId & SOC_MASK) % 32);
+    }
+  }
+
+  *Board = 0;
+  Prop = (CONST CHAR8 *)fdt_getprop (Dtb, RootOffset, "qcom,board-id", &Len);
+  if (Prop && (Len > 0) && (!(Len % BOARD_ID_SIZE))) {
+    Variant = fdt32_to_cpu (((struct board_id *)Prop)->variant_id);
+    Subtype = fdt32_to_cpu (((struct board_id *)Prop)->platform_subtype);
+    if (Subtype == 0) {
+      Subtype = Variant >> PLATFORM_SUBTYPE_SHIFT_ID;
+    }
+    *Board = DTBO_INDEX_BOARD_VALID | (Variant & VARIANT_MASK) |
+             ((Subtype & PLATFORM_SUBTYPE_MASK) << 8);
+  }
+
+  return TRUE;
+}
+
+/* Returns FALSE if the match index of Entry shows that ReadDtbFindMatch
+ * cannot select it for this board: the SoC matches none of its msm-ids,
+ * or it has no board-id whose variant is this board's and whose subtype
+ * is this board's or the default. Entries without an index may match.
+ */
+STATIC BOOLEAN
+DtboIndexMayMatch (struct DtboTableEntry *Entry)
+{
+  UINT32 SocMask;
+  UINT32 Board;
+
+  if (fdt32_to_cpu (Entry->Custom[0]) != DTBO_INDEX_MAGIC ||
+      Entry->Custom[3] != 0) {
+    return TRUE;
+  }
+
+  SocMask = fdt32_to_cpu (Entry->Custom[1]);
+  Board = fdt32_to_cpu (Entry->Custom[2]);
+
+  if (!(SocMask & (1U << ((BoardPlatformRawChipId () & SOC_MASK) % 32)))) {
+    return FALSE;
+  }
+  if (!(Board & DTBO_INDEX_BOARD_VALID) ||
+      DTBO_INDEX_VARIANT (Board) != BoardPlatformType ()) {
+    return FALSE;
+  }
+  if (DTBO_INDEX_SUBTYPE (Board) != 0 &&
+      DTBO_INDEX_SUBTYPE (Board) != BoardPlatformSubType ()) {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Checks that the index of an entry that is going to be parsed describes
+ * its Dtb, an image whose index does not is scanned without it.
+ */
+STATIC BOOLEAN
+DtboIndexAgrees (struct DtboTableEntry *Entry, VOID *Dtb)
+{
+  UINT32 SocMask;
+  UINT32 Board;
+
+  if (fdt32_to_cpu (Entry->Custom[0]) != DTBO_INDEX_MAGIC ||
+      Entry->Custom[3] != 0) {
+    return TRUE;
+  }
+
+  if (!DtboIndexCompute (Dtb, &SocMask, &Board)) {
+    return FALSE;
+  }
+
+  return SocMask == fdt32_to_cpu (Entry->Custom[1]) &&
+         Board == fdt32_to_cpu (Entry->Custom[2]);
+}
+
 VOID *
 GetBoardDtb (BootInfo *Info, VOID *DtboImgBuffer)
 {
@@ -1132,6 +1231,8 @@ GetBoardDtb (BootInfo *Info, VOID *DtboImgBuffer)
   DtInfo CurDtbInfo = {0};
   DtInfo BestDtbInfo = {0};
   BOOLEAN FindBestDtb = FALSE;
+  BOOLEAN UseIndex = TRUE;
+  UINT32 Parsed = 0;
 
   if (!DtboImgBuffer) {
     DEBUG ((EFI_D_ERROR, "Dtbo Img buffer is NULL\n"));
@@ -1152,6 +1253,7 @@ GetBoardDtb (BootInfo *Info, VOID *DtboImgBuffer)
   }
 
   DtboTableEntriesCount = fdt32_to_cpu (DtboTableHdr->DtEntryCount);
+rescan:
   for (DtboCount = 0; DtboCount < DtboTableEntriesCount; DtboCount++) {
     if (CHECK_ADD64 ((UINT64)DtboImgBuffer,
                      fdt32_to_cpu (DtboTableEntry->DtOffset))) {
@@ -1164,6 +1266,26 @@ GetBoardDtb (BootInfo *Info, VOID *DtboImgBuffer)
       break;
     }
 
+    if (UseIndex) {
+      if (!DtboIndexMayMatch (DtboTableEntry)) {
+        DtboTableEntry++;
+        continue;
+      }
+      if (!DtboIndexAgrees (DtboTableEntry, BoardDtb)) {
+        DEBUG ((EFI_D_ERROR, "Dtbo match index of entry %u is stale, "
+                             "parsing all entries\n", DtboCount));
+        UseIndex = FALSE;
+        Parsed = 0;
+        DtboIdx = INVALID_PTN;
+        gBS->SetMem (&CurDtbInfo, sizeof (CurDtbInfo), 0);
+        gBS->SetMem (&BestDtbInfo, sizeof (BestDtbInfo), 0);
+        DtboTableEntry = (struct DtboTableEntry *)(DtboImgBuffer +
+                                                   FirstDtboTableEntryOffset);
+        goto rescan;
+      }
+    }
+    Parsed++;
+
     CurDtbInfo.Dtb = BoardDtb;
     FindBestDtb = ReadDtbFindMatch (&CurDtbInfo, &BestDtbInfo, VARIANT_MATCH);
     DEBUG ((EFI_D_VERBOSE, "Dtbo count = %u LocalBoardDtMatch = %x"
@@ -1177,6 +1299,9 @@ GetBoardDtb (BootInfo *Info, VOID *DtboImgBuffer)
     DtboTableEntry++;
   }
 
+  DEBUG ((EFI_D_VERBOSE, "Parsed %u of %u dtbo entries\n", Parsed,
+          DtboTableEntriesCount));
+
   if (!BestDtbInfo.Dtb) {
     DEBUG ((EFI_D_ERROR, "Unable to find the Board Dtb\n"));
     return NULL;
@@ -27,6 +27,7 @@
  */
 
 #include "libfdt.h"
+#include <Library/BootTrace.h>
 #include <Library/DebugLib.h>
 #include <Library/LinuxLoaderLib.h>
 #include <Library/PartialGoods.h>
@@ -319,42 +320,370 @@ static struct PartialGoods PartialGoodsMmType[] = {
      {"qcom,mss", "status", "ok", "no"}},
 };
 
+/* Partial goods rules compiled into a path trie
+ *
+ * Each active table entry is a rule on the path ParentNode/SubNodeName.
+ * The rules are sorted by path and the components shared by them are
+ * merged into a trie, the children of a trie node take consecutive slots
+ * in path order so that they are looked up with a binary search. The blob
+ * is then walked once, matching each node against the children of the
+ * trie nodes matched by its parent, and the properties of all the matched
+ * nodes are set in one batch of edits.
+ */
+#define PARTIAL_GOODS_MAX_DEPTH 8
+
+typedef struct PartialGoodsTrie {
+  CONST CHAR8 *Name;
+  UINT32 NameLen;
+  UINT32 Depth;
+  struct PartialGoodsTrie *Parent;
+  struct PartialGoodsTrie *Child;
+  UINT32 NumChild;
+  /* First node of the blob on the path, -1 if none was found */
+  INT32 Offset;
+} PARTIAL_GOODS_TRIE;
+
+typedef struct {
+  struct PartialGoods *Entry;
+  CONST CHAR8 *Comp[PARTIAL_GOODS_MAX_DEPTH];
+  UINT32 CompLen[PARTIAL_GOODS_MAX_DEPTH];
+  UINT32 NumComp;
+  PARTIAL_GOODS_TRIE *Leaf;
+} PARTIAL_GOODS_RULE;
+
+typedef struct {
+  /* Rules in table order, and sorted by path */
+  PARTIAL_GOODS_RULE *Rules;
+  PARTIAL_GOODS_RULE **Sorted;
+  UINT32 NumRules;
+  UINT32 MaxRules;
+  /* Trie nodes, the root first */
+  PARTIAL_GOODS_TRIE *Nodes;
+  UINT32 NumNodes;
+  UINT32 MaxDepth;
+} PARTIAL_GOODS_RULE_SET;
+
+STATIC INTN
+PartialGoodsNameCmp (CONST CHAR8 *Name1,
+                     UINT32 Len1,
+                     CONST CHAR8 *Name2,
+                     UINT32 Len2)
+{
+  INTN Ret;
+
+  Ret = CompareMem (Name1, Name2, MIN (Len1, Len2));
+  if (Ret) {
+    return Ret;
+  }
+  return (INTN)Len1 - (INTN)Len2;
+}
+
+/* Paths compare component by component, a path sorts in front of the
+ * longer ones it is a prefix of.
+ */
+STATIC INTN
+PartialGoodsRuleCmp (CONST PARTIAL_GOODS_RULE *Rule1,
+                     CONST PARTIAL_GOODS_RULE *Rule2)
+{
+  UINT32 Index;
+  INTN Ret;
+
+  for (Index = 0; Index < Rule1->NumComp && Index < Rule2->NumComp;
+       Index++) {
+    Ret = PartialGoodsNameCmp (Rule1->Comp[Index], Rule1->CompLen[Index],
+                               Rule2->Comp[Index], Rule2->CompLen[Index]);
+    if (Ret) {
+      return Ret;
+    }
+  }
+  return (INTN)Rule1->NumComp - (INTN)Rule2->NumComp;
+}
+
+STATIC BOOLEAN
+PartialGoodsAddComp (PARTIAL_GOODS_RULE *Rule, CONST CHAR8 *Name, UINT32 Len)
+{
+  if (Rule->NumComp >= PARTIAL_GOODS_MAX_DEPTH) {
+    return FALSE;
+  }
+  Rule->Comp[Rule->NumComp] = Name;
+  Rule->CompLen[Rule->NumComp] = Len;
+  Rule->NumComp++;
+  return TRUE;
+}
+
 STATIC VOID
-FindNodeAndUpdateProperty (VOID *fdt,
-                           UINT32 TableSz,
-                           struct PartialGoods *Table,
-                           UINT32 Value)
+PartialGoodsAddRules (PARTIAL_GOODS_RULE_SET *Set,
+                      UINT32 TableSz,
+                      struct PartialGoods *Table,
+                      UINT32 Value)
 {
-  struct SubNodeListNew *SNode = NULL;
-  INT32 SubNodeOffset = 0;
-  INT32 ParentOffset = 0;
-  INT32 Ret = 0;
+  PARTIAL_GOODS_RULE *Rule;
+  CONST CHAR8 *Path;
+  UINT32 Len;
   UINT32 i;
 
   for (i = 0; i < TableSz; i++, Table++) {
     if (!(Value & Table->Val))
       continue;
 
-    /* Find the parent node */
-    ParentOffset = FdtPathOffset (fdt, Table->ParentNode);
-    if (ParentOffset < 0) {
+    if (Set->NumRules >= Set->MaxRules) {
+      return;
+    }
+    Rule = &Set->Rules[Set->NumRules];
+    SetMem (Rule, sizeof (*Rule), 0);
+    Rule->Entry = Table;
+
+    Path = Table->ParentNode;
+    if (*Path != '/') {
+      DEBUG ((EFI_D_ERROR, "Failed to Get parent node: %a\terror: %d\n",
+              Table->ParentNode, -FDT_ERR_BADPATH));
+      continue;
+    }
+    while (*Path) {
+      while (*Path == '/') {
+        Path++;
+      }
+      for (Len = 0; Path[Len] && Path[Len] != '/'; Len++);
+      if (Len &&
+          !PartialGoodsAddComp (Rule, Path, Len)) {
+        break;
+      }
+      Path += Len;
+    }
+
+    if (*Path ||
+        !PartialGoodsAddComp (Rule, Rule->Entry->SubNode.SubNodeName,
+                              AsciiStrLen (Rule->Entry->SubNode.SubNodeName))) {
+      DEBUG ((EFI_D_ERROR, "Partial goods path too deep: %a/%a\n",
+              Table->ParentNode, Table->SubNode.SubNodeName));
+      continue;
+    }
+
+    Set->MaxDepth = MAX (Set->MaxDepth, Rule->NumComp);
+    Set->NumNodes += Rule->NumComp;
+    Set->NumRules++;
+  }
+}
+
+/* Rules Sorted[First..Last) share the path of Node, the ones ending at
+ * Node come first.
+ */
+STATIC VOID
+PartialGoodsBuildTrie (PARTIAL_GOODS_RULE_SET *Set,
+                       PARTIAL_GOODS_TRIE *Node,
+                       UINT32 First,
+                       UINT32 Last)
+{
+  PARTIAL_GOODS_TRIE *Child;
+  PARTIAL_GOODS_RULE *Rule;
+  UINT32 Depth = Node->Depth;
+  UINT32 Index;
+  UINT32 Next;
+
+  for (; First < Last && Set->Sorted[First]->NumComp == Depth; First++) {
+    Set->Sorted[First]->Leaf = Node;
+  }
+
+  Node->Child = &Set->Nodes[Set->NumNodes];
+  for (Index = First; Index < Last; Index = Next) {
+    Rule = Set->Sorted[Index];
+    for (Next = Index + 1;
+         Next < Last &&
+         !PartialGoodsNameCmp (Rule->Comp[Depth], Rule->CompLen[Depth],
+                               Set->Sorted[Next]->Comp[Depth],
+                               Set->Sorted[Next]->CompLen[Depth]);
+         Next++);
+
+    Child = &Set->Nodes[Set->NumNodes++];
+    Child->Name = Rule->Comp[Depth];
+    Child->NameLen = Rule->CompLen[Depth];
+    Child->Depth = Depth + 1;
+    Child->Parent = Node;
+    Child->Offset = -1;
+    Node->NumChild++;
+  }
+
+  for (Index = First, Child = Node->Child; Index < Last; Index = Next,
+       Child++) {
+    for (Next = Index + 1;
+         Next < Last &&
+         !PartialGoodsNameCmp (Child->Name, Child->NameLen,
+                               Set->Sorted[Next]->Comp[Depth],
+                               Set->Sorted[Next]->CompLen[Depth]);
+         Next++);
+    PartialGoodsBuildTrie (Set, Child, Index, Next);
+  }
+}
+
+STATIC EFI_STATUS
+PartialGoodsCompile (PARTIAL_GOODS_RULE_SET *Set)
+{
+  PARTIAL_GOODS_RULE *Rule;
+  UINT32 Index;
+  UINT32 Pos;
+
+  Set->Sorted = AllocateZeroPool (Set->NumRules * sizeof (*Set->Sorted));
+  /* The root and at most one node per path component */
+  Set->Nodes = AllocateZeroPool ((Set->NumNodes + 1) * sizeof (*Set->Nodes));
+  if (!Set->Sorted ||
+      !Set->Nodes) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  /* Insertion sort, stable so that equal paths keep the table order */
+  for (Index = 0; Index < Set->NumRules; Index++) {
+    Rule = &Set->Rules[Index];
+    for (Pos = Index;
+         Pos > 0 && PartialGoodsRuleCmp (Set->Sorted[Pos - 1], Rule) > 0;
+         Pos--) {
+      Set->Sorted[Pos] = Set->Sorted[Pos - 1];
+    }
+    Set->Sorted[Pos] = Rule;
+  }
+
+  Set->NumNodes = 1;
+  Set->Nodes[0].Name = "";
+  Set->Nodes[0].Offset = 0;
+  PartialGoodsBuildTrie (Set, &Set->Nodes[0], 0, Set->NumRules);
+  return EFI_SUCCESS;
+}
+
+/* A node name matches a path component the way fdt_subnode_offset ()
+ * matches it: in full, or without the unit address when the component has
+ * none. Children of a trie node are sorted, look up the exact name.
+ */
+STATIC PARTIAL_GOODS_TRIE *
+PartialGoodsFindChild (PARTIAL_GOODS_TRIE *Node,
+                       CONST CHAR8 *Name,
+                       UINT32 Len)
+{
+  UINT32 Low = 0;
+  UINT32 High = Node->NumChild;
+  UINT32 Mid;
+  INTN Ret;
+
+  while (Low < High) {
+    Mid = Low + (High - Low) / 2;
+    Ret = PartialGoodsNameCmp (Node->Child[Mid].Name,
+                               Node->Child[Mid].NameLen, Name, Len);
+    if (!Ret) {
+      return &Node->Child[Mid];
+    }
+    if (Ret < 0) {
+      Low = Mid + 1;
+    } else {
+      High = Mid;
+    }
+  }
+  return NULL;
+}
+
+/* Walk the blob once and record the first node found for each trie node.
+ * Stack holds the trie nodes matched by the current node and its parents,
+ * the ones of depth Depth start at Stack[Start[Depth]].
+ */
+STATIC BOOLEAN
+PartialGoodsMatch (VOID *Fdt, PARTIAL_GOODS_RULE_SET *Set)
+{
+  PARTIAL_GOODS_TRIE **Stack;
+  PARTIAL_GOODS_TRIE *Parent;
+  PARTIAL_GOODS_TRIE *Child;
+  UINT32 Start[PARTIAL_GOODS_MAX_DEPTH + 2];
+  UINT32 Unmatched = Set->NumNodes - 1;
+  UINT32 Top;
+  UINT32 Index;
+  UINT32 NameLen;
+  UINT32 UnitLen;
+  CONST CHAR8 *Name;
+  INT32 Offset = 0;
+  INT32 Depth = 0;
+  INT32 Len;
+
+  Stack = AllocateZeroPool (Set->NumNodes * sizeof (*Stack));
+  if (!Stack) {
+    return FALSE;
+  }
+  Stack[0] = &Set->Nodes[0];
+  Start[0] = 0;
+  Start[1] = 1;
+
+  while (Unmatched) {
+    Offset = fdt_next_node (Fdt, Offset, &Depth);
+    if (Offset < 0 ||
+        Depth <= 0) {
+      break;
+    }
+    if (Depth > Set->MaxDepth) {
+      continue;
+    }
+
+    Top = Start[Depth];
+    Name = fdt_get_name (Fdt, Offset, &Len);
+    if (!Name) {
+      Offset = Len;
+      break;
+    }
+    NameLen = Len;
+    for (UnitLen = 0; UnitLen < NameLen && Name[UnitLen] != '@'; UnitLen++);
+
+    for (Index = Start[Depth - 1]; Index < Start[Depth]; Index++) {
+      Parent = Stack[Index];
+      Child = PartialGoodsFindChild (Parent, Name, NameLen);
+      if (Child &&
+          Child->Offset < 0) {
+        Child->Offset = Offset;
+        Stack[Top++] = Child;
+        Unmatched--;
+      }
+      if (UnitLen == NameLen) {
+        continue;
+      }
+      Child = PartialGoodsFindChild (Parent, Name, UnitLen);
+      if (Child &&
+          Child->Offset < 0) {
+        Child->Offset = Offset;
+        Stack[Top++] = Child;
+        Unmatched--;
+      }
+    }
+    Start[Depth + 1] = Top;
+  }
+
+  if (Offset < 0 &&
+      Offset != -FDT_ERR_NOTFOUND) {
+    DEBUG ((EFI_D_ERROR, "Partial goods: device tree walk failed: %d\n",
+            Offset));
+  }
+  FreePool (Stack);
+  return TRUE;
+}
+
+STATIC VOID
+PartialGoodsApply (VOID *fdt, PARTIAL_GOODS_RULE_SET *Set)
+{
+  PARTIAL_GOODS_RULE *Rule;
+  struct SubNodeListNew *SNode = NULL;
+  INT32 Ret = 0;
+  UINT32 i;
+
+  for (i = 0; i < Set->NumRules; i++) {
+    Rule = &Set->Rules[i];
+    SNode = &(Rule->Entry->SubNode);
+
+    if (Rule->Leaf->Parent->Offset < 0) {
       DEBUG ((EFI_D_ERROR, "Failed to Get parent node: %a\terror: %d\n",
-              Table->ParentNode, ParentOffset));
+              Rule->Entry->ParentNode, -FDT_ERR_NOTFOUND));
       continue;
     }
 
-    /* Find the subnode */
-    SNode = &(Table->SubNode);
-    SubNodeOffset = fdt_subnode_offset (fdt, ParentOffset,
-                                      SNode->SubNodeName);
-    if (SubNodeOffset < 0) {
+    if (Rule->Leaf->Offset < 0) {
       DEBUG ((EFI_D_INFO, "Subnode: %a is not present, ignore\n",
               SNode->SubNodeName));
       continue;
     }
 
-     /* Add/Replace the property with Replace string value */
-    Ret = FdtSetProp (fdt, SubNodeOffset, SNode->PropertyName,
+    /* Add/Replace the property with Replace string value */
+    Ret = FdtSetProp (fdt, Rule->Leaf->Offset, SNode->PropertyName,
                       (CONST VOID *)SNode->ReplaceStr,
                       AsciiStrLen (SNode->ReplaceStr) + 1);
     if (!Ret) {
@@ -367,6 +696,40 @@ FindNodeAndUpdateProperty (VOID *fdt,
   }
 }
 
+/* Failures are logged and the nodes left as they are, partial goods are
+ * not fatal to the boot.
+ */
+STATIC VOID
+FindNodesAndUpdateProperties (VOID *fdt, PARTIAL_GOODS_RULE_SET *Set)
+{
+  INT32 Ret;
+
+  if (!Set->NumRules) {
+    return;
+  }
+
+  if (PartialGoodsCompile (Set) != EFI_SUCCESS) {
+    DEBUG ((EFI_D_ERROR, "Partial goods: out of memory for the rules\n"));
+    return;
+  }
+
+  /* The offsets found by the walk stay valid while the edits are queued */
+  Ret = FdtEditBegin (fdt);
+  if (Ret) {
+    DEBUG ((EFI_D_ERROR, "Partial goods: bad device tree: %d\n", Ret));
+    return;
+  }
+  if (PartialGoodsMatch (fdt, Set)) {
+    PartialGoodsApply (fdt, Set);
+  } else {
+    DEBUG ((EFI_D_ERROR, "Partial goods: out of memory for the walk\n"));
+  }
+  Ret = FdtEditCommit (fdt);
+  if (Ret) {
+    DEBUG ((EFI_D_ERROR, "Partial goods: failed to apply edits: %d\n", Ret));
+  }
+}
+
 STATIC EFI_STATUS
 ReadCpuPartialGoods (EFI_CHIPINFO_PROTOCOL *pChipInfoProtocol, UINT32 *Value)
 {
@@ -432,8 +795,11 @@ UpdatePartialGoodsNode (VOID *fdt)
   UINT32 PartialGoodsMMValue = 0;
   UINT32 PartialGoodsCpuValue[MAX_CPU_CLUSTER];
   EFI_CHIPINFO_PROTOCOL *pChipInfoProtocol;
+  PARTIAL_GOODS_RULE_SET Set;
   EFI_STATUS Status = EFI_SUCCESS;
 
+  BOOT_TRACE_BEGIN (PartialGoods);
+
   Status = gBS->LocateProtocol (&gEfiChipInfoProtocolGuid, NULL,
                                 (VOID **)&pChipInfoProtocol);
   if (EFI_ERROR (Status))
@@ -442,7 +808,16 @@ UpdatePartialGoodsNode (VOID *fdt)
   if (pChipInfoProtocol->Revision < EFI_CHIPINFO_PROTOCOL_REVISION)
     return Status;
 
-  /* Read and update Multimedia Partial Goods Nodes */
+  SetMem (&Set, sizeof (Set), 0);
+  Set.MaxRules = ARRAY_SIZE (PartialGoodsMmType) +
+                 MAX_CPU_CLUSTER * NUM_OF_CPUS;
+  Set.Rules = AllocateZeroPool (Set.MaxRules * sizeof (*Set.Rules));
+  if (!Set.Rules) {
+    DEBUG ((EFI_D_ERROR, "Partial goods: out of memory for the rules\n"));
+    return EFI_SUCCESS;
+  }
+
+  /* Read Multimedia Partial Goods Nodes */
   Status = ReadMMPartialGoods (pChipInfoProtocol, &PartialGoodsMMValue);
   if (Status != EFI_SUCCESS) {
     DEBUG ((EFI_D_INFO, "No mm partial goods found.\n"));
@@ -452,11 +827,11 @@ UpdatePartialGoodsNode (VOID *fdt)
     DEBUG ((EFI_D_INFO, "PartialGoods for Multimedia: 0x%x\n",
             PartialGoodsMMValue));
 
-    FindNodeAndUpdateProperty (fdt, ARRAY_SIZE (PartialGoodsMmType),
-                               &PartialGoodsMmType[0], PartialGoodsMMValue);
+    PartialGoodsAddRules (&Set, ARRAY_SIZE (PartialGoodsMmType),
+                          &PartialGoodsMmType[0], PartialGoodsMMValue);
   }
 
-  /* Read and update CPU Partial Goods nodes */
+  /* Read CPU Partial Goods nodes */
   Status = ReadCpuPartialGoods (pChipInfoProtocol, PartialGoodsCpuValue);
   if (Status != EFI_SUCCESS) {
     DEBUG ((EFI_D_INFO, "No partial goods for cpu ss found.\n"));
@@ -466,11 +841,20 @@ UpdatePartialGoodsNode (VOID *fdt)
     if (PartialGoodsCpuValue[i]) {
       DEBUG ((EFI_D_INFO, "PartialGoods for Cluster[%d]: 0x%x\n", i,
               PartialGoodsCpuValue[i]));
-      FindNodeAndUpdateProperty (fdt, NUM_OF_CPUS,
-                                 &PartialGoodsCpuType[i][0],
-                                 PartialGoodsCpuValue[i]);
+      PartialGoodsAddRules (&Set, NUM_OF_CPUS, &PartialGoodsCpuType[i][0],
+                            PartialGoodsCpuValue[i]);
     }
   }
 
+  /* Update all the nodes in one walk of the device tree */
+  FindNodesAndUpdateProperties (fdt, &Set);
+
+  FreePool (Set.Rules);
+  if (Set.Sorted)
+    FreePool (Set.Sorted);
+  if (Set.Nodes)
+    FreePool (Set.Nodes);
+
+  BOOT_TRACE_END (PartialGoods, BT_PARTIAL_GOODS, 0);
   return EFI_SUCCESS;
 }
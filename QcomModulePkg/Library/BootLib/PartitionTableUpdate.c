@@ -47,6 +47,24 @@ STATIC BOOLEAN FirstBoot;
 STATIC struct PartitionEntry PtnEntriesBak[MAX_NUM_PARTITIONS];
 
 STATIC struct BootPartsLinkedList *HeadNode;
+
+/* Partition name -> Ptable handle index, see GetPartitionHandles () */
+#define PTN_INDEX_SIZE (MAX_NUM_PARTITIONS * 2)
+#define PTN_INDEX_AMBIGUOUS ((UINT16)-1)
+
+typedef struct {
+  EFI_PARTITION_ENTRY *Record;
+  HandleInfo *Handle;
+} PartitionHandleEntry;
+
+STATIC BOOLEAN PtnIndexValid;
+STATIC UINT32 PtnIndexCount;
+STATIC PartitionHandleEntry PtnIndexEntries[MAX_NUM_PARTITIONS];
+/* Open addressed slots holding 1 + the entry of a name, 0 when free */
+STATIC UINT16 PtnIndexSlots[PTN_INDEX_SIZE];
+
+STATIC VOID
+PartitionIndexAdd (EFI_PARTITION_ENTRY *PartEntry, HandleInfo *Handle);
 STATIC EFI_STATUS
 GetActiveSlot (Slot *ActiveSlot);
 
@@ -129,8 +147,11 @@ VOID UpdatePartitionEntries (VOID)
 
       gBS->CopyMem ((&PtnEntries[Index]), PartEntry, sizeof (PartEntry[0]));
       PtnEntries[Index].lun = i;
+      PartitionIndexAdd (PartEntry, &Ptable[i].HandleInfoList[j]);
     }
   }
+  PtnIndexValid = TRUE;
+
   if (NAND == CheckRootDeviceType ()) {
     NandABUpdatePartition (PTN_ENTRIES_FROM_MISC);
   }
@@ -138,6 +159,107 @@ VOID UpdatePartitionEntries (VOID)
   gBS->CopyMem (PtnEntriesBak, PtnEntries, sizeof (PtnEntries));
 }
 
+STATIC UINT32
+PartitionIndexHash (CONST CHAR16 *Pname)
+{
+  UINT32 Hash = 2166136261U;
+
+  while (*Pname) {
+    Hash = (Hash ^ *Pname++) * 16777619U;
+  }
+  return Hash;
+}
+
+/* Slot of Pname in PtnIndexSlots, or the free slot where it belongs */
+STATIC UINT32
+PartitionIndexSlot (CONST CHAR16 *Pname)
+{
+  UINT32 Slot = PartitionIndexHash (Pname) % PTN_INDEX_SIZE;
+  UINT16 Entry;
+
+  while ((Entry = PtnIndexSlots[Slot]) != 0) {
+    if (!StrnCmp (PtnIndexEntries[Entry - 1].Record->PartitionName, Pname,
+                  ARRAY_SIZE (PtnIndexEntries[0].Record->PartitionName))) {
+      break;
+    }
+    Slot = (Slot + 1) % PTN_INDEX_SIZE;
+  }
+  return Slot;
+}
+
+VOID
+InvalidatePartitionIndex (VOID)
+{
+  PtnIndexValid = FALSE;
+  PtnIndexCount = 0;
+  gBS->SetMem ((VOID *)PtnIndexSlots, sizeof (PtnIndexSlots), 0);
+}
+
+STATIC VOID
+PartitionIndexAdd (EFI_PARTITION_ENTRY *PartEntry, HandleInfo *Handle)
+{
+  UINT32 Slot;
+
+  if (!PartEntry->PartitionName[0] ||
+      PtnIndexCount >= ARRAY_SIZE (PtnIndexEntries)) {
+    return;
+  }
+
+  PtnIndexEntries[PtnIndexCount].Record = PartEntry;
+  PtnIndexEntries[PtnIndexCount].Handle = Handle;
+
+  Slot = PartitionIndexSlot (PartEntry->PartitionName);
+  if (PtnIndexSlots[Slot]) {
+    /* The same name on several LUNs, leave it to GetBlkIOHandles () */
+    PtnIndexEntries[PtnIndexSlots[Slot] - 1].Handle = NULL;
+    return;
+  }
+  PtnIndexSlots[Slot] = ++PtnIndexCount;
+}
+
+/* Equivalent of GetBlkIOHandles () for the non-removable partition labelled
+ * Pname. Answered from the index of the enumerated partitions when it has a
+ * single partition of that name, from GetBlkIOHandles () otherwise.
+ */
+EFI_STATUS
+GetPartitionHandles (CONST CHAR16 *Pname,
+                     HandleInfo *HandleInfoList,
+                     UINT32 *MaxHandles)
+{
+  PartiSelectFilter HandleFilter;
+  UINT32 BlkIOAttrib;
+  UINT16 Entry;
+
+  if (Pname == NULL || HandleInfoList == NULL ||
+      MaxHandles == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if (PtnIndexValid &&
+      *MaxHandles > 0) {
+    Entry = PtnIndexSlots[PartitionIndexSlot (Pname)];
+    if (Entry != 0 &&
+        PtnIndexEntries[Entry - 1].Handle != NULL) {
+      gBS->CopyMem (HandleInfoList, PtnIndexEntries[Entry - 1].Handle,
+                    sizeof (HandleInfoList[0]));
+      *MaxHandles = 1;
+      return EFI_SUCCESS;
+    }
+  }
+
+  BlkIOAttrib = BLK_IO_SEL_PARTITIONED_MBR;
+  BlkIOAttrib |= BLK_IO_SEL_PARTITIONED_GPT;
+  BlkIOAttrib |= BLK_IO_SEL_MEDIA_TYPE_NON_REMOVABLE;
+  BlkIOAttrib |= BLK_IO_SEL_MATCH_PARTITION_LABEL;
+
+  HandleFilter.RootDeviceType = NULL;
+  HandleFilter.PartitionLabel = (CHAR16 *)Pname;
+  HandleFilter.VolumeName = NULL;
+
+  return GetBlkIOHandles (BlkIOAttrib, &HandleFilter, HandleInfoList,
+                          MaxHandles);
+}
+
 INT32
 GetPartitionIndex (CHAR16 *Pname)
 {
@@ -631,6 +753,8 @@ EnumeratePartitions (VOID)
       gEfiUfsLU4Guid, gEfiUfsLU5Guid, gEfiUfsLU6Guid, gEfiUfsLU7Guid,
   };
 
+  /* The handles of the index are about to be replaced */
+  InvalidatePartitionIndex ();
   gBS->SetMem ((VOID *)Ptable, (sizeof (struct StoragePartInfo) * MAX_LUNS), 0);
 
   /* By default look for emmc partitions if not found look for UFS */
@@ -32,6 +32,7 @@
  **/
 
 #include <Library/BootLinux.h>
+#include <Library/CmdLineBuilder.h>
 #include <Library/PartitionTableUpdate.h>
 #include <Library/PrintLib.h>
 #include <LinuxLoaderLib.h>
@@ -386,100 +387,72 @@ GetSystemPath (CHAR8 **SysPath, BootInfo *Info)
   return AsciiStrLen (*SysPath);
 }
 
+/* Called twice with the same Param, to size the command line and then to
+ * write it, so nothing here may change what the second call appends.
+ *
+ * The androidboot.* values merged here replace the ones of the image
+ * cmdline. This reverses the old precedence: the pieces used to be only
+ * concatenated, and Android init keeps the first value of a ro.boot
+ * property, so the image's value won. A platform whose image cmdline
+ * overrides a bootloader androidboot.* value must drop that value from
+ * the image.
+ */
 STATIC
-EFI_STATUS
+VOID
 UpdateCmdLineParams (UpdateCmdLineParamList *Param,
-                     CHAR8 **FinalCmdLine)
+                     CMDLINE_BUILDER *Builder)
 {
-  CONST CHAR8 *Src;
-  CHAR8 *Dst;
-  UINT32 MaxCmdLineLen = Param->CmdLineLen;
-
-  Dst = AllocateZeroPool (MaxCmdLineLen);
-  if (!Dst) {
-    DEBUG ((EFI_D_ERROR, "CMDLINE: Failed to allocate destination buffer\n"));
-    return EFI_OUT_OF_RESOURCES;
-  }
-
-  /* Save start ptr for debug print */
-  *FinalCmdLine = Dst;
-
   if (Param->HaveCmdLine) {
-    Src = Param->CmdLine;
-    AsciiStrCpyS (Dst, MaxCmdLineLen, Src);
+    CmdLineBuilderAppend (Builder, Param->CmdLine);
   }
 
   if (Param->VBCmdLine != NULL) {
-    Src = Param->VBCmdLine;
-    AsciiStrCatS (Dst, MaxCmdLineLen, Src);
+    CmdLineBuilderMerge (Builder, Param->VBCmdLine);
   }
 
   if (Param->BootDevBuf) {
-    Src = Param->BootDeviceCmdLine;
-    AsciiStrCatS (Dst, MaxCmdLineLen, Src);
-
-    Src = Param->BootDevBuf;
-    AsciiStrCatS (Dst, MaxCmdLineLen, Src);
+    CmdLineBuilderMerge (Builder, Param->BootDeviceCmdLine);
+    CmdLineBuilderAppend (Builder, Param->BootDevBuf);
 
-    Src = Param->AndroidBootFstabSuffix;
-    AsciiStrCatS (Dst, MaxCmdLineLen, Src);
-
-    Src = Param->FstabSuffix;
-    AsciiStrCatS (Dst, MaxCmdLineLen, Src);
+    CmdLineBuilderMerge (Builder, Param->AndroidBootFstabSuffix);
+    CmdLineBuilderAppend (Builder, Param->FstabSuffix);
 
     /* Dynamic partition append boot_devices for super partition */
     if (IsDynamicPartitionSupport ()) {
-      Src = DynamicBootDeviceCmdLine;
-      AsciiStrCatS (Dst, MaxCmdLineLen, Src);
-
-      Src = Param->BootDevBuf;
-      AsciiStrCatS (Dst, MaxCmdLineLen, Src);
+      CmdLineBuilderMerge (Builder, DynamicBootDeviceCmdLine);
+      CmdLineBuilderAppend (Builder, Param->BootDevBuf);
     }
-
-    FreePool (Param->BootDevBuf);
-    Param->BootDevBuf = NULL;
   }
 
-  Src = Param->UsbSerialCmdLine;
-  AsciiStrCatS (Dst, MaxCmdLineLen, Src);
-  Src = Param->StrSerialNum;
-  AsciiStrCatS (Dst, MaxCmdLineLen, Src);
+  CmdLineBuilderMerge (Builder, Param->UsbSerialCmdLine);
+  CmdLineBuilderAppend (Builder, Param->StrSerialNum);
 
   if (Param->FfbmStr &&
       (Param->FfbmStr[0] != '\0')) {
-    Src = Param->AndroidBootMode;
-    AsciiStrCatS (Dst, MaxCmdLineLen, Src);
+    CmdLineBuilderMerge (Builder, Param->AndroidBootMode);
+    CmdLineBuilderAppend (Builder, Param->FfbmStr);
 
-    Src = Param->FfbmStr;
-    AsciiStrCatS (Dst, MaxCmdLineLen, Src);
-
-    Src = Param->LogLevel;
-    AsciiStrCatS (Dst, MaxCmdLineLen, Src);
+    /* reduce kernel console messages to speed-up boot */
+    CmdLineBuilderAppend (Builder, Param->LogLevel);
   } else if (Param->PauseAtBootUp) {
-    Src = Param->BatteryChgPause;
-    AsciiStrCatS (Dst, MaxCmdLineLen, Src);
+    CmdLineBuilderMerge (Builder, Param->BatteryChgPause);
   } else if (Param->AlarmBoot) {
-    Src = Param->AlarmBootCmdLine;
-    AsciiStrCatS (Dst, MaxCmdLineLen, Src);
+    CmdLineBuilderMerge (Builder, Param->AlarmBootCmdLine);
   }
 
-  Src = BOOT_BASE_BAND;
-  AsciiStrCatS (Dst, MaxCmdLineLen, Src);
+  CmdLineBuilderMerge (Builder, BOOT_BASE_BAND);
 
   gBS->SetMem (Param->ChipBaseBand, CHIP_BASE_BAND_LEN, 0);
   AsciiStrnCpyS (Param->ChipBaseBand, CHIP_BASE_BAND_LEN,
                  BoardPlatformChipBaseBand (),
                  (CHIP_BASE_BAND_LEN - 1));
   ToLower (Param->ChipBaseBand);
-  Src = Param->ChipBaseBand;
-  AsciiStrCatS (Dst, MaxCmdLineLen, Src);
+  CmdLineBuilderAppend (Builder, Param->ChipBaseBand);
 
-  Src = Param->DisplayCmdLine;
-  AsciiStrCatS (Dst, MaxCmdLineLen, Src);
+  CmdLineBuilderMerge (Builder, Param->DisplayCmdLine);
 
   if (Param->MdtpActive) {
-    Src = Param->MdtpActiveFlag;
-    AsciiStrCatS (Dst, MaxCmdLineLen, Src);
+    CmdLineBuilderAppend (Builder, Param->MdtpActiveFlag);
   }
 
   if (Param->MultiSlotBoot &&
@@ -491,13 +464,10 @@ UpdateCmdLineParams (UpdateCmdLineParamList *Param,
       INT32 StrLen = 0;
       StrLen = AsciiStrLen (SystemdSlotEnv);
       SystemdSlotEnv[StrLen - 2] = Param->SlotSuffixAscii[1];
-      Src = Param->SystemdSlotEnv;
-      AsciiStrCatS (Dst, MaxCmdLineLen, Src);
+      CmdLineBuilderAppend (Builder, Param->SystemdSlotEnv);
     } else {
-      Src = Param->AndroidSlotSuffix;
-      AsciiStrCatS (Dst, MaxCmdLineLen, Src);
-      Src = Param->SlotSuffixAscii;
-      AsciiStrCatS (Dst, MaxCmdLineLen, Src);
+      CmdLineBuilderMerge (Builder, Param->AndroidSlotSuffix);
+      CmdLineBuilderAppend (Builder, Param->SlotSuffixAscii);
     }
   }
 
@@ -509,27 +479,22 @@ UpdateCmdLineParams (UpdateCmdLineParamList *Param,
        /* Skip Initramfs*/
        if (!IsDynamicPartitionSupport () &&
            !Param->Recovery) {
-         Src = Param->SkipRamFs;
-         AsciiStrCatS (Dst, MaxCmdLineLen, Src);
+         CmdLineBuilderAppend (Builder, Param->SkipRamFs);
        }
 
      /* Add root command line */
-     Src = Param->RootCmdLine;
-     AsciiStrCatS (Dst, MaxCmdLineLen, Src);
+     CmdLineBuilderAppend (Builder, Param->RootCmdLine);
 
      /* Add init value*/
-     Src = Param->InitCmdline;
-     AsciiStrCatS (Dst, MaxCmdLineLen, Src);
+     CmdLineBuilderAppend (Builder, Param->InitCmdline);
    }
 
   if (Param->DtboIdxStr != NULL) {
-    Src = Param->DtboIdxStr;
-    AsciiStrCatS (Dst, MaxCmdLineLen, Src);
+    CmdLineBuilderMerge (Builder, Param->DtboIdxStr);
   }
 
   if (Param->DtbIdxStr != NULL) {
-    Src = Param->DtbIdxStr;
-    AsciiStrCatS (Dst, MaxCmdLineLen, Src);
+    CmdLineBuilderMerge (Builder, Param->DtbIdxStr);
   }
 
   if ((IsBuildUseRecoveryAsBoot () &&
@@ -538,18 +503,12 @@ UpdateCmdLineParams (UpdateCmdLineParamList *Param,
       (!Param->MultiSlotBoot &&
        !IsBuildUseRecoveryAsBoot ()&&
        (Param->HeaderVersion >= BOOT_HEADER_VERSION_THREE))) {
-    Src = AndroidBootForceNormalBoot;
-    AsciiStrCatS (Dst, MaxCmdLineLen, Src);
+    CmdLineBuilderMerge (Builder, AndroidBootForceNormalBoot);
   }
 
   if (Param->LEVerityCmdLine != NULL) {
-    Src = Param->LEVerityCmdLine;
-    AsciiStrCatS (Dst, MaxCmdLineLen, Src);
-    FreePool (Param->LEVerityCmdLine);
-    Param->LEVerityCmdLine = NULL;
+    CmdLineBuilderAppend (Builder, Param->LEVerityCmdLine);
   }
-
-  return EFI_SUCCESS;
 }
 
 /*Update command line: appends boot information to the original commandline
@@ -564,7 +523,6 @@ UpdateCmdLine (CONST CHAR8 *CmdLine,
                UINT32 HeaderVersion)
 {
   EFI_STATUS Status;
-  UINT32 CmdLineLen = 0;
   UINT32 HaveCmdLine = 0;
   UINT32 PauseAtBootUp = 0;
   CHAR8 SlotSuffixAscii[MAX_SLOT_SUFFIX_SZ];
@@ -582,6 +540,7 @@ UpdateCmdLine (CONST CHAR8 *CmdLine,
   CHAR8 *LEVerityCmdLine = NULL;
   UINT32 LEVerityCmdLineLen = 0;
   CHAR8 RootDevStr[BOOT_DEV_NAME_SIZE_MAX];
+  CMDLINE_BUILDER Builder;
 
   Status = BoardSerialNum (StrSerialNum, sizeof (StrSerialNum));
   if (Status != EFI_SUCCESS) {
@@ -590,7 +549,6 @@ UpdateCmdLine (CONST CHAR8 *CmdLine,
   }
 
   if (CmdLine && CmdLine[0]) {
-    CmdLineLen = AsciiStrLen (CmdLine);
     HaveCmdLine = 1;
   }
 
@@ -608,7 +566,6 @@ UpdateCmdLine (CONST CHAR8 *CmdLine,
   if (VBCmdLine != NULL) {
     DEBUG ((EFI_D_VERBOSE, "UpdateCmdLine VBCmdLine present len %d\n",
             AsciiStrLen (VBCmdLine)));
-    CmdLineLen += AsciiStrLen (VBCmdLine);
   }
 
   if (HaveCmdLine) {
@@ -618,7 +575,6 @@ UpdateCmdLine (CONST CHAR8 *CmdLine,
       if (Status != EFI_SUCCESS) {
         DEBUG ((EFI_D_ERROR, "Failed to get LEVerityCmdLine: %r\n", Status));
       }
-      CmdLineLen += LEVerityCmdLineLen;
     }
   }
 
@@ -633,35 +589,19 @@ UpdateCmdLine (CONST CHAR8 *CmdLine,
     DEBUG ((EFI_D_ERROR, "Failed to get Boot Device: %r\n", Status));
     FreePool (BootDevBuf);
     BootDevBuf = NULL;
-  } else {
-    CmdLineLen += AsciiStrLen (BootDeviceCmdLine);
-    CmdLineLen += AsciiStrLen (BootDevBuf);
-    if (IsDynamicPartitionSupport ()) {
-      CmdLineLen += AsciiStrLen (DynamicBootDeviceCmdLine);
-      CmdLineLen += AsciiStrLen (BootDevBuf);
-    }
   }
 
-  CmdLineLen += AsciiStrLen (UsbSerialCmdLine);
-  CmdLineLen += AsciiStrLen (StrSerialNum);
-
   /* Ignore the EFI_STATUS return value as the default Battery Status = 0 and is
    * not fatal */
   TargetPauseForBatteryCharge (&BatteryStatus);
 
-  if (FfbmStr && FfbmStr[0] != '\0') {
-    CmdLineLen += AsciiStrLen (AndroidBootMode);
-    CmdLineLen += AsciiStrLen (FfbmStr);
-    /* reduce kernel console messages to speed-up boot */
-    CmdLineLen += AsciiStrLen (LogLevel);
-  } else if (BatteryStatus &&
-             IsChargingScreenEnable () &&
-             !Recovery) {
+  if ((!FfbmStr ||
+       FfbmStr[0] == '\0') &&
+      BatteryStatus &&
+      IsChargingScreenEnable () &&
+      !Recovery) {
     DEBUG ((EFI_D_INFO, "Device will boot into off mode charging mode\n"));
     PauseAtBootUp = 1;
-    CmdLineLen += AsciiStrLen (BatteryChgPause);
-  } else if (AlarmBoot) {
-    CmdLineLen += AsciiStrLen (AlarmBootCmdLine);
   }
 
   if (NULL == BoardPlatformChipBaseBand ()) {
@@ -671,81 +611,36 @@ UpdateCmdLine (CONST CHAR8 *CmdLine,
     return EFI_NOT_FOUND;
   }
 
-  CmdLineLen += AsciiStrLen (BOOT_BASE_BAND);
-  CmdLineLen += AsciiStrLen (BoardPlatformChipBaseBand ());
-
-  if (MdtpActive)
-    CmdLineLen += AsciiStrLen (MdtpActiveFlag);
-
   MultiSlotBoot = PartitionHasMultiSlot ((CONST CHAR16 *)L"boot");
-  if (MultiSlotBoot &&
-     !IsBootDevImage ()) {
-    if (IsSystemdBootslotEnabled ()) {
-      CmdLineLen += AsciiStrLen (SystemdSlotEnv);
-    } else {
-    /* Add additional length for slot suffix */
-      CmdLineLen += AsciiStrLen (AndroidSlotSuffix) + MAX_SLOT_SUFFIX_SZ;
-    }
-  }
-
-  if ((IsBuildAsSystemRootImage () &&
-      !MultiSlotBoot) ||
-      (MultiSlotBoot &&
-      !IsBootDevImage ())) {
-    CmdLineLen += AsciiStrLen (RootCmdLine);
-    CmdLineLen += AsciiStrLen (InitCmdline);
-
-       if (!IsDynamicPartitionSupport () &&
-           !Recovery)
-         CmdLineLen += AsciiStrLen (SkipRamFs);
-  }
 
   GetDisplayCmdline ();
-  CmdLineLen += AsciiStrLen (DisplayCmdLine);
 
   if (!IsLEVariant ()) {
     DtboIdx = GetDtboIdx ();
     if (DtboIdx != INVALID_PTN) {
       AsciiSPrint (DtboIdxStr, sizeof (DtboIdxStr),
                    "%a%d", AndroidBootDtboIdx, DtboIdx);
-      CmdLineLen += AsciiStrLen (DtboIdxStr);
     }
 
     DtbIdx = GetDtbIdx ();
     if (DtbIdx != INVALID_PTN) {
       AsciiSPrint (DtbIdxStr, sizeof (DtbIdxStr),
                    "%a%d", AndroidBootDtbIdx, DtbIdx);
-      CmdLineLen += AsciiStrLen (DtbIdxStr);
     }
   }
 
-  if ((IsBuildUseRecoveryAsBoot () &&
-      IsDynamicPartitionSupport () &&
-      !Recovery) ||
-      (!MultiSlotBoot &&
-       !IsBuildUseRecoveryAsBoot () &&
-       (HeaderVersion >= BOOT_HEADER_VERSION_THREE))) {
-    CmdLineLen += AsciiStrLen (AndroidBootForceNormalBoot);
-  }
-
-  CmdLineLen += AsciiStrLen (AndroidBootFstabSuffix);
   GetRootDeviceType (RootDevStr, BOOT_DEV_NAME_SIZE_MAX);
   if (!AsciiStriCmp (FstabSuffixEmmc, RootDevStr)) {
     Param.FstabSuffix = FstabSuffixEmmc;
   } else {
     Param.FstabSuffix = FstabSuffixDefault;
   }
-  CmdLineLen += AsciiStrLen (Param.FstabSuffix);
   Param.AndroidBootFstabSuffix = AndroidBootFstabSuffix;
 
-  /* 1 extra byte for NULL */
-  CmdLineLen += 1;
-
   Param.Recovery = Recovery;
   Param.MultiSlotBoot = MultiSlotBoot;
   Param.AlarmBoot = AlarmBoot;
   Param.MdtpActive = MdtpActive;
-  Param.CmdLineLen = CmdLineLen;
   Param.HaveCmdLine = HaveCmdLine;
   Param.PauseAtBootUp = PauseAtBootUp;
   Param.StrSerialNum = StrSerialNum;
@@ -773,8 +668,25 @@ UpdateCmdLine (CONST CHAR8 *CmdLine,
   Param.HeaderVersion = HeaderVersion;
   Param.SystemdSlotEnv = SystemdSlotEnv;
 
-  Status = UpdateCmdLineParams (&Param, FinalCmdLine);
+  /* Size the command line, then write it to one buffer */
+  CmdLineBuilderInit (&Builder);
+  UpdateCmdLineParams (&Param, &Builder);
+  Status = CmdLineBuilderAllocate (&Builder);
+  if (Status == EFI_SUCCESS) {
+    UpdateCmdLineParams (&Param, &Builder);
+    Status = CmdLineBuilderFinish (&Builder, FinalCmdLine);
+  }
+  CmdLineBuilderFree (&Builder);
+
+  if (BootDevBuf) {
+    FreePool (BootDevBuf);
+  }
+  if (LEVerityCmdLine) {
+    FreePool (LEVerityCmdLine);
+  }
   if (Status != EFI_SUCCESS) {
+    DEBUG ((EFI_D_ERROR, "CMDLINE: Failed to build command line: %r\n",
+            Status));
     return Status;
   }
 
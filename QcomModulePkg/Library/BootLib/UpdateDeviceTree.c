@@ -442,8 +442,7 @@ UpdateGranuleInfo (VOID *fdt)
     return;
   }
 
-  FdtPropUpdateFunc (fdt, GranuleNodeOffset, "granule",
-                     GranuleSize, fdt_setprop_u32, Ret);
+  Ret = FdtSetPropU32 (fdt, GranuleNodeOffset, "granule", GranuleSize);
   if (Ret) {
     DEBUG ((EFI_D_ERROR, "INFO: Granule size update failed.\n"));
   }
@@ -590,10 +589,10 @@ dev_tree_add_mem_info (VOID *fdt, UINT32 offset, UINT32 addr, UINT32 size)
   if (!mem_info_cnt) {
     /* Replace any other reg prop in the memory node. */
     mem_info_cnt = 1;
-    FdtPropUpdateFunc (fdt, offset, "reg", addr, fdt_setprop_u32, ret);
+    ret = FdtSetPropU32 (fdt, offset, "reg", addr);
   } else {
     /* Append the mem info to the reg prop for subsequent nodes.  */
-    FdtPropUpdateFunc (fdt, offset, "reg", addr, fdt_appendprop_u32, ret);
+    ret = FdtAppendPropU32 (fdt, offset, "reg", addr);
   }
 
   if (ret) {
@@ -601,7 +600,7 @@ dev_tree_add_mem_info (VOID *fdt, UINT32 offset, UINT32 addr, UINT32 size)
         (EFI_D_ERROR, "Failed to add the memory information addr: %d\n", ret));
   }
 
-  FdtPropUpdateFunc (fdt, offset, "reg", size, fdt_appendprop_u32, ret);
+  ret = FdtAppendPropU32 (fdt, offset, "reg", size);
   if (ret) {
     DEBUG (
         (EFI_D_ERROR, "Failed to add the memory information size: %d\n", ret));
@@ -619,10 +618,10 @@ dev_tree_add_mem_infoV64 (VOID *fdt, UINT32 offset, UINT64 addr, UINT64 size)
   if (!mem_info_cnt) {
     /* Replace any other reg prop in the memory node. */
     mem_info_cnt = 1;
-    FdtPropUpdateFunc (fdt, offset, "reg", addr, fdt_setprop_u64, ret);
+    ret = FdtSetPropU64 (fdt, offset, "reg", addr);
   } else {
     /* Append the mem info to the reg prop for subsequent nodes.  */
-    FdtPropUpdateFunc (fdt, offset, "reg", addr, fdt_appendprop_u64, ret);
+    ret = FdtAppendPropU64 (fdt, offset, "reg", addr);
   }
 
   if (ret) {
@@ -630,7 +629,7 @@ dev_tree_add_mem_infoV64 (VOID *fdt, UINT32 offset, UINT64 addr, UINT64 size)
         (EFI_D_ERROR, "Failed to add the memory information addr: %d\n", ret));
   }
 
-  FdtPropUpdateFunc (fdt, offset, "reg", size, fdt_appendprop_u64, ret);
+  ret = FdtAppendPropU64 (fdt, offset, "reg", size);
   if (ret) {
     DEBUG (
         (EFI_D_ERROR, "Failed to add the memory information size: %d\n", ret));
@@ -639,17 +638,19 @@ dev_tree_add_mem_infoV64 (VOID *fdt, UINT32 offset, UINT64 addr, UINT64 size)
   return ret;
 }
 
-/* Top level function that updates the device tree. */
+/* Supporting function of UpdateDeviceTree()
+ * Updates the nodes while the property edits are being queued, the node
+ * offsets do not change until they are committed. */
+STATIC
 EFI_STATUS
-UpdateDeviceTree (VOID *fdt,
-                  CONST CHAR8 *cmdline,
-                  VOID *ramdisk,
-                  UINT32 RamDiskSize,
-                  BOOLEAN BootWith32Bit)
+UpdateDeviceTreeNodes (VOID *fdt,
+                       CONST CHAR8 *cmdline,
+                       VOID *ramdisk,
+                       UINT32 RamDiskSize,
+                       BOOLEAN BootWith32Bit)
 {
   INT32 ret = 0;
   UINT32 offset;
-  UINT32 PaddSize = 0;
   UINT64 RandomSeed = 0;
   UINT8 DdrDeviceType;
   /* Single space reserved for chan(0-9) */
@@ -659,30 +660,8 @@ UpdateDeviceTree (VOID *fdt,
   struct ddr_details_entry_info *DdrInfo;
   UINT64 Revision;
   EFI_STATUS Status;
-  UINT64 UpdateDTStartTime = GetTimerCountms ();
   UINT32 Index;
 
-  /* Check the device tree header */
-  ret = fdt_check_header (fdt) || fdt_check_header_ext (fdt);
-  if (ret) {
-    DEBUG ((EFI_D_ERROR, "ERROR: Invalid device tree header ...\n"));
-    return EFI_NOT_FOUND;
-  }
-
-  /* Add padding to make space for new nodes and properties. */
-  PaddSize = ADD_OF (fdt_totalsize (fdt),
-                    DTB_PAD_SIZE + AsciiStrLen (cmdline));
-  if (!PaddSize) {
-    DEBUG ((EFI_D_ERROR, "ERROR: Integer Overflow: fdt size = %u\n",
-            fdt_totalsize (fdt)));
-    return EFI_BAD_BUFFER_SIZE;
-  }
-  ret = fdt_open_into (fdt, fdt, PaddSize);
-  if (ret != 0) {
-    DEBUG ((EFI_D_ERROR, "ERROR: Failed to move/resize dtb buffer ...\n"));
-    return EFI_BAD_BUFFER_SIZE;
-  }
-
   /* Get offset of the memory node */
   ret = FdtPathOffset (fdt, "/memory");
   if (ret < 0) {
@@ -707,8 +686,8 @@ UpdateDeviceTree (VOID *fdt,
     DdrDeviceType = DdrInfo->device_type;
     DEBUG ((EFI_D_VERBOSE, "DDR deviceType:%d\n", DdrDeviceType));
 
-    FdtPropUpdateFunc (fdt, offset, (CONST char *)"ddr_device_type",
-                       (UINT32)DdrDeviceType, fdt_appendprop_u32, ret);
+    ret = FdtAppendPropU32 (fdt, offset, (CONST char *)"ddr_device_type",
+                            (UINT32)DdrDeviceType);
     if (ret) {
       DEBUG ((EFI_D_ERROR,
               "ERROR: Cannot update memory node [ddr_device_type]:0x%x\n",
@@ -734,9 +713,8 @@ UpdateDeviceTree (VOID *fdt,
                 Chan, DdrInfo->num_ranks[Chan]));
         AsciiSPrint (FdtRankProp, sizeof (FdtRankProp),
                      "ddr_device_rank_ch%d", Chan);
-        FdtPropUpdateFunc (fdt, offset, (CONST char *)FdtRankProp,
-                           (UINT32)DdrInfo->num_ranks[Chan],
-                           fdt_appendprop_u32, ret);
+        ret = FdtAppendPropU32 (fdt, offset, (CONST char *)FdtRankProp,
+                                (UINT32)DdrInfo->num_ranks[Chan]);
         if (ret) {
           DEBUG ((EFI_D_ERROR,
                   "ERROR: Cannot update memory node ddr_device_rank_ch%d:0x%x\n",
@@ -750,9 +728,8 @@ UpdateDeviceTree (VOID *fdt,
                   Chan, Rank, DdrInfo->hbb[Chan][Rank]));
           AsciiSPrint (FdtHbbProp, sizeof (FdtHbbProp),
                        "ddr_device_hbb_ch%d_rank%d", Chan, Rank);
-          FdtPropUpdateFunc (fdt, offset, (CONST char *)FdtHbbProp,
-                             (UINT32)DdrInfo->hbb[Chan][Rank],
-                             fdt_appendprop_u32, ret);
+          ret = FdtAppendPropU32 (fdt, offset, (CONST char *)FdtHbbProp,
+                                  (UINT32)DdrInfo->hbb[Chan][Rank]);
           if (ret) {
             DEBUG ((EFI_D_ERROR,
                     "ERROR: Cannot update memory node ddr_device_hbb_ch%d_rank%d:0x%x\n",
@@ -782,8 +759,8 @@ OutofUpdateRankChannel:
   offset = ret;
   if (cmdline) {
     /* Adding the cmdline to the chosen node */
-    FdtPropUpdateFunc (fdt, offset, (CONST char *)"bootargs",
-                      (CONST VOID *)cmdline, fdt_appendprop_string, ret);
+    ret = FdtAppendPropString (fdt, offset, (CONST char *)"bootargs",
+                               cmdline);
     if (ret) {
       DEBUG ((EFI_D_ERROR,
               "ERROR: Cannot update chosen node [bootargs] - 0x%x\n", ret));
@@ -796,8 +773,8 @@ OutofUpdateRankChannel:
     if (Status == EFI_SUCCESS) {
 
       /* Adding the RNG seed to the chosen node */
-      FdtPropUpdateFunc (fdt, offset, (CONST CHAR8 *)"rng-seed",
-                        (UINT64)RandomSeed, fdt_appendprop_u64, ret);
+      ret = FdtAppendPropU64 (fdt, offset, (CONST CHAR8 *)"rng-seed",
+                              (UINT64)RandomSeed);
       if (ret) {
         DEBUG ((EFI_D_ERROR,
               "ERROR: Cannot update chosen node [rng-seed] - 0x%x\n", ret));
@@ -812,8 +789,8 @@ OutofUpdateRankChannel:
   Status = GetRandomSeed (&RandomSeed);
   if (Status == EFI_SUCCESS) {
     /* Adding Kaslr Seed to the chosen node */
-    FdtPropUpdateFunc (fdt, offset, (CONST CHAR8 *)"kaslr-seed",
-                      (UINT64)RandomSeed, fdt_appendprop_u64, ret);
+    ret = FdtAppendPropU64 (fdt, offset, (CONST CHAR8 *)"kaslr-seed",
+                            (UINT64)RandomSeed);
     if (ret) {
       DEBUG ((EFI_D_INFO,
               "ERROR: Cannot update chosen node [kaslr-seed] - 0x%x\n", ret));
@@ -826,8 +803,8 @@ OutofUpdateRankChannel:
 
   if (RamDiskSize) {
     /* Adding the initrd-start to the chosen node */
-    FdtPropUpdateFunc (fdt, offset, (CONST CHAR8 *)"linux,initrd-start",
-                       (UINT64)ramdisk, fdt_setprop_u64, ret);
+    ret = FdtSetPropU64 (fdt, offset, (CONST CHAR8 *)"linux,initrd-start",
+                         (UINT64)ramdisk);
     if (ret) {
       DEBUG ((EFI_D_ERROR,
               "ERROR: Cannot update chosen node [linux,initrd-start] - 0x%x\n",
@@ -836,8 +813,8 @@ OutofUpdateRankChannel:
     }
 
     /* Adding the initrd-end to the chosen node */
-    FdtPropUpdateFunc (fdt, offset, (CONST CHAR8 *)"linux,initrd-end",
-                      (UINT64)ramdisk + RamDiskSize, fdt_setprop_u64, ret);
+    ret = FdtSetPropU64 (fdt, offset, (CONST CHAR8 *)"linux,initrd-end",
+                         (UINT64)ramdisk + RamDiskSize);
     if (ret) {
       DEBUG ((EFI_D_ERROR,
               "ERROR: Cannot update chosen node [linux,initrd-end] - 0x%x\n",
@@ -863,11 +840,80 @@ OutofUpdateRankChannel:
       return ret;
     }
   }
+
+  return ret;
+}
+
+/* Top level function that updates the device tree. */
+EFI_STATUS
+UpdateDeviceTree (VOID *fdt,
+                  CONST CHAR8 *cmdline,
+                  VOID *ramdisk,
+                  UINT32 RamDiskSize,
+                  BOOLEAN BootWith32Bit)
+{
+  INT32 ret = 0;
+  UINT32 PaddSize = 0;
+  EFI_STATUS Status;
+  UINT64 UpdateDTStartTime = GetTimerCountms ();
+  INT32 ChosenOffset;
+  BOOT_TRACE_BEGIN (UpdateDt);
+
+  /* Check the device tree header */
+  ret = fdt_check_header (fdt) || fdt_check_header_ext (fdt);
+  if (ret) {
+    DEBUG ((EFI_D_ERROR, "ERROR: Invalid device tree header ...\n"));
+    return EFI_NOT_FOUND;
+  }
+
+  /* Add padding to make space for new nodes and properties. */
+  PaddSize = ADD_OF (fdt_totalsize (fdt),
+                    DTB_PAD_SIZE + BOOT_TRACE_DT_SIZE + AsciiStrLen (cmdline));
+  if (!PaddSize) {
+    DEBUG ((EFI_D_ERROR, "ERROR: Integer Overflow: fdt size = %u\n",
+            fdt_totalsize (fdt)));
+    return EFI_BAD_BUFFER_SIZE;
+  }
+  ret = fdt_open_into (fdt, fdt, PaddSize);
+  if (ret != 0) {
+    DEBUG ((EFI_D_ERROR, "ERROR: Failed to move/resize dtb buffer ...\n"));
+    return EFI_BAD_BUFFER_SIZE;
+  }
+
+  /* Queue the property updates and write them to the blob in one pass
+   * instead of moving the rest of the blob for each of them.
+   */
+  ret = FdtEditBegin (fdt);
+  if (ret != 0) {
+    DEBUG ((EFI_D_ERROR, "ERROR: Cannot start device tree update: %d\n",
+            ret));
+    return EFI_BAD_BUFFER_SIZE;
+  }
+
+  /* The updates made before a failure are kept, as they were before */
+  Status = UpdateDeviceTreeNodes (fdt, cmdline, ramdisk, RamDiskSize,
+                                  BootWith32Bit);
+
+  /* Queue the boot trace last so that it covers the updates above, only
+   * the one pass of the commit is left out of it.
+   */
+  BOOT_TRACE_END (UpdateDt, BT_UPDATE_DEVICE_TREE, 0);
+  ChosenOffset = FdtPathOffset (fdt, "/chosen");
+  if (ChosenOffset >= 0) {
+    BootTraceExport (fdt, ChosenOffset);
+  }
+
+  ret = FdtEditCommit (fdt);
+  if (ret != 0) {
+    DEBUG ((EFI_D_ERROR, "ERROR: Cannot update device tree: %d\n", ret));
+    return EFI_BAD_BUFFER_SIZE;
+  }
+  BootTraceSave ();
   fdt_pack (fdt);
 
   DEBUG ((EFI_D_INFO, "Update Device Tree total time: %lu ms \n",
         GetTimerCountms () - UpdateDTStartTime));
-  return ret;
+  return Status;
 }
 
 /* Update device tree for fstab node */
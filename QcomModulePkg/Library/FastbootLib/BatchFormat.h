@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2021, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of The Linux Foundation nor
+ *       the names of its contributors may be used to endorse or promote
+ *       products derived from this software without specific prior written
+ *       permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef _BATCH_FORMAT_H_
+#define _BATCH_FORMAT_H_
+
+/* Download of the "flash-batch" command: a batch_header_t followed by
+ * entry_count entries of entry_sz bytes, each naming a partition and the
+ * raw or sparse image for it at offset from the start of the download.
+ */
+#define BATCH_HEADER_MAGIC 0x48435442 /* "BTCH" */
+#define BATCH_MAJOR_VERSION 1
+#define BATCH_PARTITION_NAME_SZ 72
+#define MAX_IMAGES_IN_BATCH 64
+
+typedef struct batch_header {
+  UINT32 magic;         /* 0x48435442 */
+  UINT16 major_version; /* (0x1) - reject images with higher major versions */
+  UINT16 minor_version; /* (0x0) - allow images with higer minor versions */
+  UINT16 header_sz;     /* size of this header */
+  UINT16 entry_sz;      /* size of one batch_entry_t, may grow */
+  UINT32 entry_count;   /* number of images in the batch */
+} batch_header_t;
+
+typedef struct batch_entry {
+  CHAR8 ptn_name[BATCH_PARTITION_NAME_SZ]; /* without slot suffix for the
+                                              current slot */
+  UINT64 offset; /* of the image from the start of the download */
+  UINT64 size;   /* of the image in the download */
+} batch_entry_t;
+
+#endif
@@ -51,12 +51,14 @@ found at
 #include <Library/DebugLib.h>
 #include <Library/DeviceInfo.h>
 #include <Library/DevicePathLib.h>
+#include <Library/Lz4Lib.h>
 #include <Library/MemoryAllocationLib.h>
 #include <Library/MenuKeysDetection.h>
 #include <Library/PartitionTableUpdate.h>
 #include <Library/PcdLib.h>
 #include <Library/PrintLib.h>
 #include <Library/ThreadStack.h>
+#include <Library/TimerLib.h>
 #include <Library/UefiApplicationEntryPoint.h>
 #include <Library/UefiBootServicesTableLib.h>
 #include <Library/UefiLib.h>
@@ -82,9 +84,11 @@ found at
 #include "FastbootCmds.h"
 #include "FastbootMain.h"
 #include "LinuxLoaderLib.h"
+#include "BatchFormat.h"
 #include "MetaFormat.h"
 #include "SparseFormat.h"
 #include "Recovery.h"
+#include "libavb/libavb.h"
 
 STATIC struct GetVarPartitionInfo part_info[] = {
     {"system", "partition-size:", "partition-type:", "", "ext4"},
@@ -125,6 +129,9 @@ STATIC CHAR8 StrSocVersion[MAX_RSP_SIZE];
 STATIC CHAR8 LogicalBlkSizeStr[MAX_RSP_SIZE];
 STATIC CHAR8 EraseBlkSizeStr[MAX_RSP_SIZE];
 STATIC CHAR8 MaxDownloadSizeStr[MAX_RSP_SIZE];
+#ifdef ENABLE_UPDATE_PARTITIONS_CMDS
+STATIC CHAR8 MaxFetchSizeStr[MAX_RSP_SIZE];
+#endif
 STATIC CHAR8 SnapshotMergeState[MAX_RSP_SIZE];
 
 struct GetVarSlotInfo {
@@ -177,7 +184,10 @@ STATIC EFI_KERNEL_PROTOCOL  *KernIntf = NULL;
 STATIC BOOLEAN IsMultiThreadSupported = FALSE;
 STATIC BOOLEAN IsFlashComplete = TRUE;
 STATIC LockHandle *LockDownload;
-STATIC LockHandle *LockFlash;
+/* Protects the flash queues and the download buffer states */
+STATIC LockHandle *LockQueue;
+/* Signaled while no flash job is queued or running */
+STATIC Event *FlashIdle;
 
 STATIC EFI_STATUS FlashResult = EFI_SUCCESS;
 #ifdef ENABLE_UPDATE_PARTITIONS_CMDS
@@ -198,6 +208,8 @@ STATIC VOID
 AcceptCmd (IN UINT64 Size, IN CHAR8 *Data);
 STATIC VOID
 AcceptCmdHandler (IN EFI_EVENT Event, IN VOID *Context);
+STATIC VOID
+WaitForTransferComplete (VOID);
 
 #define NAND_PAGES_PER_BLOCK 64
 
@@ -212,16 +224,87 @@ typedef struct {
   VOID *Data;
 } CmdInfo;
 
+/* Flash jobs whose completion is waited for together, see FlashGroupWait */
+typedef struct {
+  UINT32 Pending;
+  Event *Done;
+} FlashGroup;
+
 typedef struct {
   CHAR16 PartitionName[MAX_GPT_NAME_SIZE];
   UINT32 PartitionSize;
   UINT8 *FlashDataBuffer;
   UINT64 FlashNumDataBytes;
+  UINT32 Lun;
+  EFI_STATUS (*FlashImage) (CHAR16 *PartitionName, UINT32 PartitionMaxSize,
+                            VOID *Image, UINT64 Size);
+  /* FlashDataBuffer is a download buffer released once the job is done */
+  BOOLEAN OwnsBuffer;
+  /* Jobs of a group are owned by the caller, others are freed when done */
+  FlashGroup *Group;
+  EFI_STATUS Status;
+  UINT64 FlashTimeMs;
 } FlashInfo;
 
+/* With multi thread flash the fastboot buffer is split into a ring of
+ * download buffers. One of them receives USB data, the one handed to the
+ * last flash command is FLASH_BUF_FLASH and the others are either free or
+ * hold images queued for the flash workers.
+ */
+#define MAX_FLASH_BUFFERS 8
+/* Number of flash jobs each LUN can have queued */
+#define FLASH_QUEUE_DEPTH 32
+
+typedef enum {
+  FLASH_BUF_FREE,
+  FLASH_BUF_USB,
+  FLASH_BUF_FLASH,
+  FLASH_BUF_QUEUED,
+} FlashBufState;
+
+typedef struct {
+  UINT8 *Buffer;
+  FlashBufState State;
+} FlashBuf;
+
+/* Flash jobs of one LUN, written in order by the worker of the LUN while
+ * the workers of other LUNs run in parallel.
+ */
+typedef struct {
+  FlashInfo *Jobs[FLASH_QUEUE_DEPTH];
+  UINT32 Head;
+  UINT32 Count;
+  Semaphore *Pending;
+  Thread *Worker;
+} FlashQueue;
+
+STATIC FlashBuf FlashBufs[MAX_FLASH_BUFFERS];
+STATIC UINT32 FlashBufCount;
+STATIC Semaphore *FlashBufFree;
+STATIC FlashQueue FlashQueues[MAX_LUNS];
+STATIC UINT32 FlashJobsPending;
+
 STATIC BOOLEAN FlashSplitNeeded;
 STATIC BOOLEAN UsbTimerStarted;
 
+#ifdef ENABLE_UPDATE_PARTITIONS_CMDS
+/* Sparse image written while it is downloaded, see CmdOemSparseStream */
+STATIC SparseStreamParam SparseStream;
+#endif
+
+/* LZ4 compressed download, see CmdOemDownloadCompression. The compressed
+ * data is received at DloadLz4In, in the tail of the download buffer, and
+ * decoded to the start of the buffer while it is arriving.
+ */
+STATIC BOOLEAN DloadLz4Armed;
+STATIC BOOLEAN DloadLz4Active;
+STATIC UINT8 *DloadLz4In;
+STATIC UINTN DloadLz4InPos;
+STATIC UINTN DloadLz4OutPos;
+STATIC EFI_STATUS DloadLz4Result;
+STATIC UINT64 DloadLz4Ticks;
+STATIC LZ4_FRAME_DECODER DloadLz4Decoder;
+
 BOOLEAN IsUsbTimerStarted (VOID) {
   return UsbTimerStarted;
 }
@@ -240,6 +323,127 @@ BOOLEAN FlashComplete (VOID)
   return IsFlashComplete;
 }
 
+/* Number of download buffers the fastboot buffer is split into */
+STATIC UINT32
+FlashBufNum (IN UINT64 BufferSize)
+{
+  UINT32 Count;
+
+  if (CheckRootDeviceType () == NAND) {
+    return 1;
+  }
+
+  if (!IsUseMThreadParallel ()) {
+    return 2;
+  }
+
+  Count = FixedPcdGet32 (FlashBufferCount);
+  Count = MAX (Count, 2);
+  Count = MIN (Count, MAX_FLASH_BUFFERS);
+  while (Count > 2 &&
+         BufferSize / Count < MIN_BUFFER_SIZE) {
+    Count--;
+  }
+
+  return Count;
+}
+
+/* Set up the download buffer ring, Base is the USB buffer and
+ * Base + BufferSize the initial flash buffer as in FastbootCommandSetup.
+ */
+STATIC EFI_STATUS
+FlashBufInit (IN UINT8 *Base, IN UINT64 BufferSize, IN UINT32 Count)
+{
+  UINT32 Index;
+
+  FlashBufCount = 0;
+  if (!IsUseMThreadParallel () ||
+      Count < 2) {
+    return EFI_SUCCESS;
+  }
+
+  FlashBufFree = KernIntf->Sem->SemInit (0, Count - 2);
+  if (!FlashBufFree) {
+    DEBUG ((EFI_D_ERROR, "Failed to create flash buffer semaphore\n"));
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  for (Index = 0; Index < Count; Index++) {
+    FlashBufs[Index].Buffer = Base + Index * BufferSize;
+    FlashBufs[Index].State = FLASH_BUF_FREE;
+  }
+  FlashBufs[0].State = FLASH_BUF_USB;
+  FlashBufs[1].State = FLASH_BUF_FLASH;
+  FlashBufCount = Count;
+
+  DEBUG ((EFI_D_VERBOSE, "Fastboot uses %d download buffers\n", Count));
+  return EFI_SUCCESS;
+}
+
+STATIC FlashBufState
+FlashBufGetState (IN UINT8 *Buffer)
+{
+  FlashBufState State = FLASH_BUF_FREE;
+  UINT32 Index;
+
+  KernIntf->Lock->AcquireLock (LockQueue);
+  for (Index = 0; Index < FlashBufCount; Index++) {
+    if (FlashBufs[Index].Buffer == Buffer) {
+      State = FlashBufs[Index].State;
+      break;
+    }
+  }
+  KernIntf->Lock->ReleaseLock (LockQueue);
+
+  return State;
+}
+
+STATIC VOID
+FlashBufSetState (IN UINT8 *Buffer, IN FlashBufState State)
+{
+  BOOLEAN Freed = FALSE;
+  UINT32 Index;
+
+  KernIntf->Lock->AcquireLock (LockQueue);
+  for (Index = 0; Index < FlashBufCount; Index++) {
+    if (FlashBufs[Index].Buffer == Buffer) {
+      Freed = (State == FLASH_BUF_FREE &&
+               FlashBufs[Index].State != FLASH_BUF_FREE);
+      FlashBufs[Index].State = State;
+      break;
+    }
+  }
+  KernIntf->Lock->ReleaseLock (LockQueue);
+
+  if (Freed) {
+    KernIntf->Sem->SemPost (FlashBufFree, TRUE);
+  }
+}
+
+/* Take a free download buffer for the next USB transfer, waiting for a
+ * flash worker to release one if all of them are in use.
+ */
+STATIC UINT8 *
+FlashBufAcquire (VOID)
+{
+  UINT8 *Buffer = NULL;
+  UINT32 Index;
+
+  KernIntf->Sem->SemWait (FlashBufFree);
+
+  KernIntf->Lock->AcquireLock (LockQueue);
+  for (Index = 0; Index < FlashBufCount; Index++) {
+    if (FlashBufs[Index].State == FLASH_BUF_FREE) {
+      FlashBufs[Index].State = FLASH_BUF_USB;
+      Buffer = FlashBufs[Index].Buffer;
+      break;
+    }
+  }
+  KernIntf->Lock->ReleaseLock (LockQueue);
+
+  return Buffer;
+}
+
 #ifdef DISABLE_PARALLEL_DOWNLOAD_FLASH
 BOOLEAN IsDisableParallelDownloadFlash (VOID)
 {
@@ -553,15 +757,370 @@ STATIC VOID PopulateMultislotMetadata (VOID)
 }
 
 #ifdef ENABLE_UPDATE_PARTITIONS_CMDS
+/* Read-back verification of flashed data, "oem verify-after-flash". Every
+ * region written through WriteToDisk is read back and the SHA-256 of the
+ * data read compared with the one of the data written. With multi thread
+ * support a worker verifies a region while the next one is being written.
+ */
+typedef struct VerifyRegion {
+  CHAR16 *PartitionName;
+  EFI_BLOCK_IO_PROTOCOL *BlockIo;
+  VOID *Image;
+  UINT64 Size;
+  UINT64 Lba;
+} VerifyRegion;
+
+typedef struct VerifyReport {
+  CHAR16 PartitionName[MAX_GPT_NAME_SIZE];
+  UINT64 Offset;
+  UINT64 Size;
+  EFI_STATUS Status;
+} VerifyReport;
+
+STATIC BOOLEAN VerifyAfterFlash;
+STATIC UINT8 *VerifyReadBuf;
+STATIC VerifyRegion VerifyQueue[VERIFY_QUEUE_DEPTH];
+STATIC UINT32 VerifyHead;
+STATIC UINT32 VerifyCount;
+STATIC Semaphore *VerifyPending;
+STATIC Semaphore *VerifySlots;
+/* Signaled while no region is waiting for verification */
+STATIC Event *VerifyIdle;
+STATIC Thread *VerifyWorker;
+/* Results since the last VerifyFlashReport, under LockQueue while the
+ * verify worker runs
+ */
+STATIC UINT64 VerifyRegions;
+STATIC UINT64 VerifyBytes;
+STATIC UINT32 VerifyFailures;
+STATIC VerifyReport VerifyReports[MAX_VERIFY_REPORTS];
+
+STATIC EFI_STATUS
+VerifyDigest (IN CONST UINT8 *Data,
+              IN UINT64 Size,
+              OUT UINT8 *Digest)
+{
+  AvbSHA256Ctx Ctx;
+  UINT32 Len;
+
+  avb_sha256_init (&Ctx);
+  while (Size) {
+    Len = MIN (Size, MAX_UINT32);
+    avb_sha256_update (&Ctx, Data, Len);
+    Data += Len;
+    Size -= Len;
+  }
+
+  gBS->CopyMem (Digest, avb_sha256_final (&Ctx), AVB_SHA256_DIGEST_SIZE);
+  if (!avb_sha256_final_ok (&Ctx)) {
+    return EFI_DEVICE_ERROR;
+  }
+  return EFI_SUCCESS;
+}
+
+/* The results are shared with the verify worker once it runs */
+STATIC VOID
+VerifyResultsLock (IN BOOLEAN Acquire)
+{
+  if (!VerifyWorker) {
+    return;
+  }
+
+  if (Acquire) {
+    KernIntf->Lock->AcquireLock (LockQueue);
+  } else {
+    KernIntf->Lock->ReleaseLock (LockQueue);
+  }
+}
+
+/* Read a written region back and compare it with the data written */
+STATIC VOID
+VerifyFlashRegion (IN VerifyRegion *Region)
+{
+  EFI_STATUS Status;
+  EFI_BLOCK_IO_PROTOCOL *BlockIo = Region->BlockIo;
+  UINT32 BlockSize = BlockIo->Media->BlockSize;
+  UINT8 Written[AVB_SHA256_DIGEST_SIZE];
+  UINT8 Read[AVB_SHA256_DIGEST_SIZE];
+  VerifyReport *Report;
+
+  Status = BlockIo->ReadBlocks (BlockIo, BlockIo->Media->MediaId, Region->Lba,
+                                ROUND_TO_PAGE (Region->Size, BlockSize - 1),
+                                VerifyReadBuf);
+  if (!EFI_ERROR (Status)) {
+    Status = VerifyDigest (Region->Image, Region->Size, Written);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = VerifyDigest (VerifyReadBuf, Region->Size, Read);
+  }
+  if (!EFI_ERROR (Status) &&
+      CompareMem (Written, Read, AVB_SHA256_DIGEST_SIZE)) {
+    Status = EFI_CRC_ERROR;
+  }
+
+  if (EFI_ERROR (Status)) {
+    DEBUG ((EFI_D_ERROR, "Verify %s at offset %lld size %lld failed: %r\n",
+            Region->PartitionName, Region->Lba * BlockSize, Region->Size,
+            Status));
+  }
+
+  VerifyResultsLock (TRUE);
+  VerifyRegions++;
+  VerifyBytes += Region->Size;
+  if (EFI_ERROR (Status)) {
+    if (VerifyFailures < MAX_VERIFY_REPORTS) {
+      Report = &VerifyReports[VerifyFailures];
+      StrnCpyS (Report->PartitionName, ARRAY_SIZE (Report->PartitionName),
+                Region->PartitionName, StrLen (Region->PartitionName));
+      Report->Offset = Region->Lba * BlockSize;
+      Report->Size = Region->Size;
+      Report->Status = Status;
+    }
+    VerifyFailures++;
+  }
+  VerifyResultsLock (FALSE);
+}
+
+INT32 __attribute__ ( (no_sanitize ("safe-stack")))
+VerifyWorkerThread (VOID *Arg)
+{
+  VerifyRegion Region;
+
+  while (TRUE) {
+    KernIntf->Sem->SemWait (VerifyPending);
+
+    KernIntf->Lock->AcquireLock (LockQueue);
+    Region = VerifyQueue[VerifyHead];
+    KernIntf->Lock->ReleaseLock (LockQueue);
+
+    VerifyFlashRegion (&Region);
+
+    /* The slot is held until the region is verified, so that VerifyIdle
+     * tells the writers when their data is no longer needed.
+     */
+    KernIntf->Lock->AcquireLock (LockQueue);
+    VerifyHead = (VerifyHead + 1) % VERIFY_QUEUE_DEPTH;
+    VerifyCount--;
+    if (!VerifyCount) {
+      KernIntf->Event->EventSignal (VerifyIdle, FALSE);
+    }
+    KernIntf->Lock->ReleaseLock (LockQueue);
+    KernIntf->Sem->SemPost (VerifySlots, TRUE);
+  }
+
+  return 0;
+}
+
+STATIC EFI_STATUS
+VerifyWorkerStart (VOID)
+{
+  EFI_STATUS Status;
+  Thread *Worker = NULL;
+
+  VerifyPending = KernIntf->Sem->SemInit (0, 0);
+  VerifySlots = KernIntf->Sem->SemInit (0, VERIFY_QUEUE_DEPTH);
+  VerifyIdle = KernIntf->Event->EventInit (0, TRUE, 0);
+  if (!VerifyPending ||
+      !VerifySlots ||
+      !VerifyIdle) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Worker = KernIntf->Thread->ThreadCreate ("VerifyWorkerThread",
+      VerifyWorkerThread, NULL, UEFI_THREAD_PRIORITY, DEFAULT_STACK_SIZE);
+  if (Worker == NULL) {
+    return EFI_NOT_READY;
+  }
+
+  AllocateUnSafeStackPtr (Worker);
+  Status = KernIntf->Thread->ThreadResume (Worker);
+  if (!EFI_ERROR (Status)) {
+    VerifyWorker = Worker;
+  }
+  return Status;
+}
+
+/* Verify a written region, in the background when the worker runs */
+STATIC VOID
+VerifyFlashQueue (IN VerifyRegion *Region)
+{
+  if (!VerifyWorker) {
+    VerifyFlashRegion (Region);
+    return;
+  }
+
+  KernIntf->Sem->SemWait (VerifySlots);
+
+  KernIntf->Lock->AcquireLock (LockQueue);
+  VerifyQueue[(VerifyHead + VerifyCount) % VERIFY_QUEUE_DEPTH] = *Region;
+  if (!VerifyCount) {
+    KernIntf->Event->EventUnsignal (VerifyIdle);
+  }
+  VerifyCount++;
+  KernIntf->Lock->ReleaseLock (LockQueue);
+
+  KernIntf->Sem->SemPost (VerifyPending, TRUE);
+}
+
+/* Wait until all queued regions are verified. Callers must do so before
+ * the data they wrote is released or modified.
+ */
+STATIC VOID
+VerifyFlashWait (VOID)
+{
+  if (VerifyWorker) {
+    KernIntf->Event->EventWait (VerifyIdle);
+  }
+}
+
+/* Report the verification results of the data flashed since the last call.
+ * Returns Status, or the verification error if the flash itself succeeded.
+ */
+STATIC EFI_STATUS
+VerifyFlashReport (IN EFI_STATUS Status)
+{
+  CHAR8 Info[MAX_RSP_SIZE];
+  VerifyReport Reports[MAX_VERIFY_REPORTS];
+  UINT64 Regions;
+  UINT64 Bytes;
+  UINT32 Failures;
+  UINT32 i;
+
+  if (!VerifyAfterFlash) {
+    return Status;
+  }
+
+  VerifyFlashWait ();
+
+  /* Take the results and start over, the responses are sent unlocked */
+  VerifyResultsLock (TRUE);
+  Regions = VerifyRegions;
+  Bytes = VerifyBytes;
+  Failures = VerifyFailures;
+  gBS->CopyMem (Reports, VerifyReports,
+                MIN (Failures, MAX_VERIFY_REPORTS) * sizeof (Reports[0]));
+  VerifyRegions = 0;
+  VerifyBytes = 0;
+  VerifyFailures = 0;
+  VerifyResultsLock (FALSE);
+
+  for (i = 0; i < MIN (Failures, MAX_VERIFY_REPORTS); i++) {
+    AsciiSPrint (Info, MAX_RSP_SIZE, "%s: 0x%llx+0x%llx: %r",
+                 Reports[i].PartitionName, Reports[i].Offset,
+                 Reports[i].Size, Reports[i].Status);
+    FastbootInfo (Info);
+    WaitForTransferComplete ();
+  }
+
+  if (Regions) {
+    AsciiSPrint (Info, MAX_RSP_SIZE, "Verified %lld KB, %d of %lld bad",
+                 Bytes / 1024, Failures, Regions);
+    FastbootInfo (Info);
+    WaitForTransferComplete ();
+  }
+
+  if (Failures &&
+      !EFI_ERROR (Status)) {
+    Status = Reports[0].Status;
+  }
+
+  return Status;
+}
+
 /* Helper function to write data to disk */
 STATIC EFI_STATUS
-WriteToDisk (IN EFI_BLOCK_IO_PROTOCOL *BlockIo,
+WriteToDisk (IN CHAR16 *PartitionName,
+             IN EFI_BLOCK_IO_PROTOCOL *BlockIo,
              IN EFI_HANDLE *Handle,
              IN VOID *Image,
              IN UINT64 Size,
              IN UINT64 offset)
 {
-  return WriteBlockToPartition (BlockIo, Handle, offset, Size, Image);
+  EFI_STATUS Status;
+  VerifyRegion Region;
+
+  if (!VerifyAfterFlash) {
+    return WriteBlockToPartition (BlockIo, Handle, offset, Size, Image);
+  }
+
+  /* Written in regions, each one is verified while the next is written */
+  Region.PartitionName = PartitionName;
+  Region.BlockIo = BlockIo;
+  Region.Image = Image;
+  Region.Lba = offset;
+  while (Size) {
+    Region.Size = MIN (Size, VERIFY_REGION_SIZE);
+    Status = WriteBlockToPartition (BlockIo, Handle, Region.Lba, Region.Size,
+                                    Region.Image);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+
+    VerifyFlashQueue (&Region);
+    Region.Image = (UINT8 *)Region.Image + Region.Size;
+    Region.Lba += Region.Size / BlockIo->Media->BlockSize;
+    Size -= Region.Size;
+  }
+
+  return EFI_SUCCESS;
+}
+
+/* Write sparse image data to the disk, counting the writes issued */
+STATIC EFI_STATUS
+SparseWriteToDisk (IN SparseImgParam *SparseImgData,
+                   IN VOID *Image,
+                   IN UINT64 Size,
+                   IN UINT64 Lba)
+{
+  SparseImgData->WriteCalls++;
+  SparseImgData->WriteBytes += Size;
+  return WriteToDisk (SparseImgData->PartitionName, SparseImgData->BlockIo,
+                      SparseImgData->Handle, Image, Size, Lba);
+}
+
+/* Add Size bytes of image data to the running CRC32 of a sparse image,
+ * Data NULL stands for zeros.
+ */
+STATIC VOID
+SparseCrcUpdate (IN SparseImgParam *SparseImgData,
+                 IN CONST VOID *Data,
+                 IN UINT64 Size)
+{
+  UINT64 StartTicks = GetPerformanceCounter ();
+
+  if (Data) {
+    SparseImgData->Crc32 = avb_crc32_update (SparseImgData->Crc32,
+                                             (CONST UINT8 *)Data, Size);
+    SparseImgData->CrcBytes += Size;
+  } else {
+    SparseImgData->Crc32 = avb_crc32_zeros (SparseImgData->Crc32, Size);
+  }
+  SparseImgData->CrcTicks += GetPerformanceCounter () - StartTicks;
+}
+
+/* Print the write statistics and release the buffers of a sparse image */
+STATIC VOID
+SparseImgDone (IN SparseImgParam *SparseImgData)
+{
+  UINT64 CrcUs;
+
+  DEBUG ((EFI_D_INFO, "Sparse flash: %lld writes, %lld bytes written, "
+                      "%lld bytes erased\n",
+          SparseImgData->WriteCalls, SparseImgData->WriteBytes,
+          SparseImgData->EraseBytes));
+
+  CrcUs = DivU64x32 (GetTimeInNanoSecond (SparseImgData->CrcTicks), 1000);
+  DEBUG ((EFI_D_INFO, "Sparse CRC32: %lld bytes in %lld us (%lld MB/s)\n",
+          SparseImgData->CrcBytes, CrcUs,
+          CrcUs ? SparseImgData->CrcBytes / CrcUs : 0));
+
+  /* FillPattern and the image must stay until their writes are verified */
+  VerifyFlashWait ();
+
+  if (SparseImgData->FillPattern) {
+    FreePool (SparseImgData->FillPattern);
+    SparseImgData->FillPattern = NULL;
+  }
 }
 
 STATIC BOOLEAN
@@ -631,12 +1190,12 @@ HandleChunkTypeRaw (sparse_header_t *sparse_header,
   }
 
   /* Data is validated, now write to the disk */
+  SparseCrcUpdate (SparseImgData, *Image, SparseImgData->ChunkDataSz);
   SparseImgData->WrittenBlockCount =
     SparseImgData->TotalBlocks * SparseImgData->BlockCountFactor;
-  Status = WriteToDisk (SparseImgData->BlockIo, SparseImgData->Handle,
-                        *Image,
-                        SparseImgData->ChunkDataSz,
-                        SparseImgData->WrittenBlockCount);
+  Status = SparseWriteToDisk (SparseImgData, *Image,
+                              SparseImgData->ChunkDataSz,
+                              SparseImgData->WrittenBlockCount);
   if (EFI_ERROR (Status)) {
     DEBUG ((EFI_D_ERROR, "Flash Write Failure\n"));
     return Status;
@@ -654,95 +1213,304 @@ HandleChunkTypeRaw (sparse_header_t *sparse_header,
   return EFI_SUCCESS;
 }
 
+/* Write Bytes of the FILL pattern starting at Lba */
 STATIC EFI_STATUS
-HandleChunkTypeFill (sparse_header_t *sparse_header,
-        chunk_header_t *chunk_header,
-        VOID **Image,
-        SparseImgParam *SparseImgData)
+FillPatternWrite (IN SparseImgParam *SparseImgData,
+                  IN UINT64 Lba,
+                  IN UINT64 Bytes)
 {
-  UINT32 *FillBuf = NULL;
-  UINT32 FillVal;
-  EFI_STATUS Status = EFI_SUCCESS;
-  UINT32 Temp;
+  EFI_STATUS Status;
+  UINT32 BlockSize = SparseImgData->BlockIo->Media->BlockSize;
+  UINT64 WriteUnit = MAX_WRITE_SIZE - (MAX_WRITE_SIZE % BlockSize);
+  UINT64 WriteSize;
+
+  while (Bytes) {
+    WriteSize = MIN (Bytes, WriteUnit);
+    Status = SparseWriteToDisk (SparseImgData, SparseImgData->FillPattern,
+                                WriteSize, Lba);
+    if (EFI_ERROR (Status)) {
+      DEBUG ((EFI_D_ERROR, "Flash write failure for FILL Chunk\n"));
+      return Status;
+    }
 
-  if (sparse_header == NULL ||
-      chunk_header == NULL ||
-      *Image == NULL ||
-      SparseImgData == NULL) {
-    DEBUG ((EFI_D_ERROR, "Invalid input Parameters\n"));
-    return EFI_INVALID_PARAMETER;
+    Lba += WriteSize / BlockSize;
+    Bytes -= WriteSize;
   }
 
-  if (chunk_header->total_sz !=
-     (sparse_header->chunk_hdr_sz + sizeof (UINT32))) {
-    DEBUG ((EFI_D_ERROR, "Bogus chunk size for chunk type FILL\n"));
-    return EFI_INVALID_PARAMETER;
-  }
+  return EFI_SUCCESS;
+}
 
-  FillBuf = AllocateZeroPool (sparse_header->blk_sz);
-  if (!FillBuf) {
-    DEBUG ((EFI_D_ERROR, "Malloc failed for: CHUNK_TYPE_FILL\n"));
-    return EFI_OUT_OF_RESOURCES;
-  }
+/* Zero the EraseLengthGranularity aligned middle of a zero FILL run with
+ * EraseBlocks. The erase protocol does not tell whether erased blocks read
+ * back as zeros, so the first erase of an image is checked on a marked
+ * block. On success [*EraseLba, *EraseLba + *EraseBlocks) is known to
+ * read back as zeros, any other return value means the whole run still has
+ * to be written.
+ */
+STATIC EFI_STATUS
+FillRunErase (IN SparseImgParam *SparseImgData,
+              IN UINT64 Lba,
+              IN UINT64 Blocks,
+              OUT UINT64 *EraseLba,
+              OUT UINT64 *EraseBlocks)
+{
+  EFI_STATUS Status;
+  EFI_ERASE_BLOCK_PROTOCOL *EraseProt = NULL;
+  EFI_ERASE_BLOCK_TOKEN EraseToken;
+  EFI_BLOCK_IO_PROTOCOL *BlockIo = SparseImgData->BlockIo;
+  UINT32 BlockSize = BlockIo->Media->BlockSize;
+  UINT64 Granularity;
+  UINT64 Start;
+  UINT64 End;
+  UINTN TokenIndex;
+  UINT8 *Probe = NULL;
+  UINT32 Index;
 
-  if (CHECK_ADD64 ((UINT64)*Image, sizeof (UINT32))) {
-    DEBUG ((EFI_D_ERROR,
-              "Integer overflow while adding Image and uint32\n"));
-    Status = EFI_INVALID_PARAMETER;
-    goto out;
+  /* NAND erases to 0xFF, and its writes are laid out differently */
+  if (CheckRootDeviceType () == NAND) {
+    return EFI_UNSUPPORTED;
   }
 
-  if (SparseImgData->ImageEnd < (UINT64)*Image + sizeof (UINT32)) {
-    DEBUG ((EFI_D_ERROR,
-            "Buffer overread occured due to invalid sparse header\n"));
-   Status = EFI_INVALID_PARAMETER;
-   goto out;
+  if (SparseImgData->EraseZero == ERASE_ZERO_NO) {
+    return EFI_UNSUPPORTED;
   }
 
-  FillVal = *(UINT32 *)*Image;
-  *Image = (CHAR8 *)*Image + sizeof (UINT32);
+  Status = gBS->HandleProtocol (SparseImgData->Handle,
+                                &gEfiEraseBlockProtocolGuid,
+                                (VOID **)&EraseProt);
+  if (Status != EFI_SUCCESS) {
+    SparseImgData->EraseZero = ERASE_ZERO_NO;
+    return Status;
+  }
 
-  for (Temp = 0;
-       Temp < (sparse_header->blk_sz / sizeof (FillVal));
-       Temp++) {
-    FillBuf[Temp] = FillVal;
+  Granularity = EraseProt->EraseLengthGranularity ?
+                EraseProt->EraseLengthGranularity : 1;
+  Start = ((Lba + Granularity - 1) / Granularity) * Granularity;
+  End = ((Lba + Blocks) / Granularity) * Granularity;
+  if (End <= Start) {
+    return EFI_UNSUPPORTED;
   }
 
-  for (Temp = 0; Temp < chunk_header->chunk_sz; Temp++) {
-    /* Make sure the data does not exceed the partition size */
-    if ((UINT64)SparseImgData->TotalBlocks *
-         (UINT64)sparse_header->blk_sz +
-         sparse_header->blk_sz >
-         SparseImgData->PartitionSize) {
-      DEBUG ((EFI_D_ERROR, "Chunk data size for fill type "
-                            "exceeds partition size\n"));
-      Status = EFI_VOLUME_FULL;
-      goto out;
+  /* Mark the first block so that a device which keeps stale data on erase
+   * cannot be mistaken for one that erases to zero.
+   */
+  if (SparseImgData->EraseZero == ERASE_ZERO_UNKNOWN) {
+    Probe = AllocatePool (BlockSize);
+    if (!Probe) {
+      return EFI_OUT_OF_RESOURCES;
     }
 
-    SparseImgData->WrittenBlockCount =
-      SparseImgData->TotalBlocks *
-        SparseImgData->BlockCountFactor;
-    Status = WriteToDisk (SparseImgData->BlockIo,
-                          SparseImgData->Handle,
-                          (VOID *)FillBuf,
-                          sparse_header->blk_sz,
-                          SparseImgData->WrittenBlockCount);
+    gBS->SetMem (Probe, BlockSize, 0xA5);
+    Status = BlockIo->WriteBlocks (BlockIo, BlockIo->Media->MediaId, Start,
+                                   BlockSize, Probe);
     if (EFI_ERROR (Status)) {
-      DEBUG ((EFI_D_ERROR, "Flash write failure for FILL Chunk\n"));
+      goto out;
+    }
+  }
 
+  gBS->SetMem ((VOID *)&EraseToken, sizeof (EraseToken), 0);
+  Status = EraseProt->EraseBlocks (BlockIo, BlockIo->Media->MediaId, Start,
+                                   &EraseToken, (End - Start) * BlockSize);
+  if (Status != EFI_SUCCESS) {
+    DEBUG ((EFI_D_VERBOSE, "Erase for FILL chunk failed: %r\n", Status));
+    SparseImgData->EraseZero = ERASE_ZERO_NO;
     goto out;
+  }
+
+  if (EraseToken.Event != NULL) {
+    gBS->WaitForEvent (1, &EraseToken.Event, &TokenIndex);
+  }
+  SparseImgData->EraseBytes += (End - Start) * BlockSize;
+
+  if (SparseImgData->EraseZero == ERASE_ZERO_UNKNOWN) {
+    Status = BlockIo->ReadBlocks (BlockIo, BlockIo->Media->MediaId, Start,
+                                  BlockSize, Probe);
+    if (EFI_ERROR (Status)) {
+      goto out;
+    }
+
+    SparseImgData->EraseZero = ERASE_ZERO_YES;
+    for (Index = 0; Index < BlockSize; Index++) {
+      if (Probe[Index]) {
+        SparseImgData->EraseZero = ERASE_ZERO_NO;
+        Status = EFI_UNSUPPORTED;
+        goto out;
+      }
     }
+  }
 
-    SparseImgData->TotalBlocks++;
+  *EraseLba = Start;
+  *EraseBlocks = End - Start;
+
+out:
+  if (Probe) {
+    FreePool (Probe);
+    Probe = NULL;
   }
+  return Status;
+}
+
+/* Write the pending FILL run of SparseImgData to the disk */
+STATIC EFI_STATUS
+FlushFillRun (IN sparse_header_t *sparse_header,
+              IN SparseImgParam *SparseImgData)
+{
+  EFI_STATUS Status;
+  UINT32 BlockSize;
+  UINT64 Lba;
+  UINT64 Blocks;
+  UINT64 EraseLba = 0;
+  UINT64 EraseBlocks = 0;
 
-  out:
-    if (FillBuf) {
-    FreePool (FillBuf);
-    FillBuf = NULL;
+  if (!SparseImgData->FillPending) {
+    return EFI_SUCCESS;
+  }
+  SparseImgData->FillPending = FALSE;
+
+  if (!SparseImgData->FillPattern) {
+    SparseImgData->FillPattern = AllocatePool (MAX_WRITE_SIZE);
+    if (!SparseImgData->FillPattern) {
+      DEBUG ((EFI_D_ERROR, "Malloc failed for: CHUNK_TYPE_FILL\n"));
+      return EFI_OUT_OF_RESOURCES;
     }
-    return Status;
+    SparseImgData->FillPatternVal = ~SparseImgData->FillVal;
+  }
+
+  if (SparseImgData->FillPatternVal != SparseImgData->FillVal) {
+    VerifyFlashWait ();
+    SetMem32 (SparseImgData->FillPattern, MAX_WRITE_SIZE,
+              SparseImgData->FillVal);
+    SparseImgData->FillPatternVal = SparseImgData->FillVal;
+  }
+
+  BlockSize = SparseImgData->BlockIo->Media->BlockSize;
+  Lba = (UINT64)SparseImgData->FillStartBlock *
+        SparseImgData->BlockCountFactor;
+  Blocks = (UINT64)SparseImgData->FillBlocks *
+           SparseImgData->BlockCountFactor;
+  SparseImgData->WrittenBlockCount = Lba;
+
+  if (!SparseImgData->FillVal &&
+      FillRunErase (SparseImgData, Lba, Blocks,
+                    &EraseLba, &EraseBlocks) == EFI_SUCCESS) {
+    Status = FillPatternWrite (SparseImgData, Lba,
+                               (EraseLba - Lba) * BlockSize);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+
+    return FillPatternWrite (SparseImgData, EraseLba + EraseBlocks,
+                             (Lba + Blocks - EraseLba - EraseBlocks) *
+                             BlockSize);
+  }
+
+  return FillPatternWrite (SparseImgData, Lba,
+                           (UINT64)SparseImgData->FillBlocks *
+                           sparse_header->blk_sz);
+}
+
+/* Add Bytes of the FILL value FillVal to the running CRC32 */
+STATIC VOID
+FillCrcUpdate (IN SparseImgParam *SparseImgData,
+               IN UINT32 FillVal,
+               IN UINT64 Bytes)
+{
+  UINT32 Pattern[256];
+  UINT64 Size;
+
+  if (!FillVal) {
+    SparseCrcUpdate (SparseImgData, NULL, Bytes);
+    return;
+  }
+
+  SetMem32 (Pattern, sizeof (Pattern), FillVal);
+  while (Bytes) {
+    Size = MIN (Bytes, sizeof (Pattern));
+    SparseCrcUpdate (SparseImgData, Pattern, Size);
+    Bytes -= Size;
+  }
+}
+
+/* FILL chunks are not written right away, consecutive chunks with the same
+ * value are merged into one run which FlushFillRun writes once a different
+ * chunk follows or the image ends.
+ */
+STATIC EFI_STATUS
+HandleChunkTypeFill (sparse_header_t *sparse_header,
+        chunk_header_t *chunk_header,
+        VOID **Image,
+        SparseImgParam *SparseImgData)
+{
+  UINT32 FillVal;
+  EFI_STATUS Status;
+
+  if (sparse_header == NULL ||
+      chunk_header == NULL ||
+      *Image == NULL ||
+      SparseImgData == NULL) {
+    DEBUG ((EFI_D_ERROR, "Invalid input Parameters\n"));
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if (chunk_header->total_sz !=
+     (sparse_header->chunk_hdr_sz + sizeof (UINT32))) {
+    DEBUG ((EFI_D_ERROR, "Bogus chunk size for chunk type FILL\n"));
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if (CHECK_ADD64 ((UINT64)*Image, sizeof (UINT32))) {
+    DEBUG ((EFI_D_ERROR,
+              "Integer overflow while adding Image and uint32\n"));
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if (SparseImgData->ImageEnd < (UINT64)*Image + sizeof (UINT32)) {
+    DEBUG ((EFI_D_ERROR,
+            "Buffer overread occured due to invalid sparse header\n"));
+    return EFI_INVALID_PARAMETER;
+  }
+
+  FillVal = *(UINT32 *)*Image;
+  *Image = (CHAR8 *)*Image + sizeof (UINT32);
+
+  /* Make sure the data does not exceed the partition size */
+  if ((UINT64)SparseImgData->TotalBlocks *
+       (UINT64)sparse_header->blk_sz +
+       (UINT64)chunk_header->chunk_sz * sparse_header->blk_sz >
+       SparseImgData->PartitionSize) {
+    DEBUG ((EFI_D_ERROR, "Chunk data size for fill type "
+                          "exceeds partition size\n"));
+    return EFI_VOLUME_FULL;
+  }
+
+  if (SparseImgData->TotalBlocks >
+       (MAX_UINT32 - chunk_header->chunk_sz)) {
+    DEBUG ((EFI_D_ERROR, "Bogus size for FILL chunk Type\n"));
+    return EFI_INVALID_PARAMETER;
+  }
+
+  FillCrcUpdate (SparseImgData, FillVal,
+                 (UINT64)chunk_header->chunk_sz * sparse_header->blk_sz);
+
+  if (SparseImgData->FillPending &&
+      SparseImgData->FillVal == FillVal &&
+      SparseImgData->FillStartBlock + SparseImgData->FillBlocks ==
+      SparseImgData->TotalBlocks) {
+    SparseImgData->FillBlocks += chunk_header->chunk_sz;
+  } else {
+    Status = FlushFillRun (sparse_header, SparseImgData);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+
+    SparseImgData->FillPending = TRUE;
+    SparseImgData->FillVal = FillVal;
+    SparseImgData->FillStartBlock = SparseImgData->TotalBlocks;
+    SparseImgData->FillBlocks = chunk_header->chunk_sz;
+  }
+
+  SparseImgData->TotalBlocks += chunk_header->chunk_sz;
+  return EFI_SUCCESS;
 }
 
 STATIC EFI_STATUS
@@ -761,6 +1529,13 @@ ValidateChunkDataAndFlash (sparse_header_t *sparse_header,
     return EFI_INVALID_PARAMETER;
   }
 
+  if (chunk_header->chunk_type != CHUNK_TYPE_FILL) {
+    Status = FlushFillRun (sparse_header, SparseImgData);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+  }
+
   switch (chunk_header->chunk_type) {
     case CHUNK_TYPE_RAW:
     Status = HandleChunkTypeRaw (sparse_header,
@@ -791,11 +1566,14 @@ ValidateChunkDataAndFlash (sparse_header_t *sparse_header,
         DEBUG ((EFI_D_ERROR, "bogus size for chunk DONT CARE type\n"));
         return EFI_INVALID_PARAMETER;
       }
+      /* Skipped blocks read as zeros for the CRC */
+      SparseCrcUpdate (SparseImgData, NULL, SparseImgData->ChunkDataSz);
       SparseImgData->TotalBlocks += chunk_header->chunk_sz;
     break;
 
     case CHUNK_TYPE_CRC:
-      if (chunk_header->total_sz != sparse_header->chunk_hdr_sz) {
+      if (chunk_header->total_sz !=
+          (sparse_header->chunk_hdr_sz + sizeof (UINT32))) {
         DEBUG ((EFI_D_ERROR, "Bogus chunk size for chunk type CRC\n"));
         return EFI_INVALID_PARAMETER;
       }
@@ -808,19 +1586,25 @@ ValidateChunkDataAndFlash (sparse_header_t *sparse_header,
 
       SparseImgData->TotalBlocks += chunk_header->chunk_sz;
 
-
-      if (CHECK_ADD64 ((UINT64)*Image, SparseImgData->ChunkDataSz)) {
+      if (CHECK_ADD64 ((UINT64)*Image, sizeof (UINT32))) {
         DEBUG ((EFI_D_ERROR,
-                "Integer overflow while adding Image and chunk data sz\n"));
+                "Integer overflow while adding Image and uint32\n"));
         return EFI_INVALID_PARAMETER;
       }
 
-      *Image += (UINT32)SparseImgData->ChunkDataSz;
-      if (SparseImgData->ImageEnd < (UINT64)*Image) {
+      if (SparseImgData->ImageEnd < (UINT64)*Image + sizeof (UINT32)) {
         DEBUG ((EFI_D_ERROR, "buffer overreads occured due to "
                               "invalid sparse header\n"));
         return EFI_INVALID_PARAMETER;
       }
+
+      if (ReadUnaligned32 ((UINT32 *)*Image) != SparseImgData->Crc32) {
+        DEBUG ((EFI_D_ERROR, "Sparse image CRC mismatch: expected %x, "
+                             "computed %x\n",
+                ReadUnaligned32 ((UINT32 *)*Image), SparseImgData->Crc32));
+        return EFI_CRC_ERROR;
+      }
+      *Image = (CHAR8 *)*Image + sizeof (UINT32);
     break;
 
     default:
@@ -831,44 +1615,41 @@ ValidateChunkDataAndFlash (sparse_header_t *sparse_header,
   return EFI_SUCCESS;
 }
 
-/* Handle Sparse Image Flashing */
-STATIC
-EFI_STATUS
-HandleSparseImgFlash (IN CHAR16 *PartitionName,
-                      IN UINT32 PartitionMaxSize,
-                      IN VOID *Image,
-                      IN UINT64 sz)
+STATIC EFI_STATUS
+SparseImgFlash (IN CHAR16 *PartitionName,
+                IN VOID *Image,
+                IN UINT64 sz,
+                IN SparseImgParam *SparseImgData)
 {
   sparse_header_t *sparse_header;
   chunk_header_t *chunk_header;
   EFI_STATUS Status;
 
-  SparseImgParam SparseImgData = {0};
-
   if (CHECK_ADD64 ((UINT64)Image, sz)) {
     DEBUG ((EFI_D_ERROR, "Integer overflow while adding Image and sz\n"));
     return EFI_INVALID_PARAMETER;
   }
 
-  SparseImgData.ImageEnd = (UINT64)Image + sz;
+  SparseImgData->ImageEnd = (UINT64)Image + sz;
+  SparseImgData->PartitionName = PartitionName;
   /* Caller to ensure that the partition is present in the Partition Table*/
   Status = PartitionGetInfo (PartitionName,
-                             &(SparseImgData.BlockIo),
-                             &(SparseImgData.Handle));
+                             &(SparseImgData->BlockIo),
+                             &(SparseImgData->Handle));
 
   if (Status != EFI_SUCCESS)
     return Status;
-  if (!SparseImgData.BlockIo) {
+  if (!SparseImgData->BlockIo) {
     DEBUG ((EFI_D_ERROR, "BlockIo for %a is corrupted\n", PartitionName));
     return EFI_VOLUME_CORRUPTED;
   }
-  if (!SparseImgData.Handle) {
+  if (!SparseImgData->Handle) {
     DEBUG ((EFI_D_ERROR, "EFI handle for %a is corrupted\n", PartitionName));
     return EFI_VOLUME_CORRUPTED;
   }
   // Check image will fit on device
-  SparseImgData.PartitionSize = GetPartitionSize (SparseImgData.BlockIo);
-  if (!SparseImgData.PartitionSize) {
+  SparseImgData->PartitionSize = GetPartitionSize (SparseImgData->BlockIo);
+  if (!SparseImgData->PartitionSize) {
     return EFI_BAD_BUFFER_SIZE;
   }
 
@@ -879,7 +1660,7 @@ HandleSparseImgFlash (IN CHAR16 *PartitionName,
 
   sparse_header = (sparse_header_t *)Image;
   if (((UINT64)sparse_header->total_blks * (UINT64)sparse_header->blk_sz) >
-      SparseImgData.PartitionSize) {
+      SparseImgData->PartitionSize) {
     DEBUG ((EFI_D_ERROR, "Image is too large for the partition\n"));
     return EFI_VOLUME_FULL;
   }
@@ -896,14 +1677,14 @@ HandleSparseImgFlash (IN CHAR16 *PartitionName,
     return EFI_INVALID_PARAMETER;
   }
 
-  if ((sparse_header->blk_sz) % (SparseImgData.BlockIo->Media->BlockSize)) {
+  if ((sparse_header->blk_sz) % (SparseImgData->BlockIo->Media->BlockSize)) {
     DEBUG ((EFI_D_ERROR, "Unsupported sparse block size %x\n",
             sparse_header->blk_sz));
     return EFI_INVALID_PARAMETER;
   }
 
-  SparseImgData.BlockCountFactor = (sparse_header->blk_sz) /
-                                   (SparseImgData.BlockIo->Media->BlockSize);
+  SparseImgData->BlockCountFactor = (sparse_header->blk_sz) /
+                                   (SparseImgData->BlockIo->Media->BlockSize);
 
   DEBUG ((EFI_D_VERBOSE, "=== Sparse Image Header ===\n"));
   DEBUG ((EFI_D_VERBOSE, "magic: 0x%x\n", sparse_header->magic));
@@ -918,12 +1699,12 @@ HandleSparseImgFlash (IN CHAR16 *PartitionName,
   DEBUG ((EFI_D_VERBOSE, "total_chunks: %d\n", sparse_header->total_chunks));
 
   /* Start processing the chunks */
-  for (SparseImgData.Chunk = 0;
-       SparseImgData.Chunk < sparse_header->total_chunks;
-       SparseImgData.Chunk++) {
+  for (SparseImgData->Chunk = 0;
+       SparseImgData->Chunk < sparse_header->total_chunks;
+       SparseImgData->Chunk++) {
 
-    if (((UINT64)SparseImgData.TotalBlocks * (UINT64)sparse_header->blk_sz) >=
-        SparseImgData.PartitionSize) {
+    if (((UINT64)SparseImgData->TotalBlocks * (UINT64)sparse_header->blk_sz) >=
+        SparseImgData->PartitionSize) {
       DEBUG ((EFI_D_ERROR, "Size of image is too large for the partition\n"));
       return EFI_VOLUME_FULL;
     }
@@ -938,7 +1719,7 @@ HandleSparseImgFlash (IN CHAR16 *PartitionName,
     }
     Image += sizeof (chunk_header_t);
 
-    if (SparseImgData.ImageEnd < (UINT64)Image) {
+    if (SparseImgData->ImageEnd < (UINT64)Image) {
       DEBUG ((EFI_D_ERROR,
               "buffer overreads occured due to invalid sparse header\n"));
       return EFI_BAD_BUFFER_SIZE;
@@ -954,15 +1735,15 @@ HandleSparseImgFlash (IN CHAR16 *PartitionName,
       return EFI_INVALID_PARAMETER;
     }
 
-    SparseImgData.ChunkDataSz = (UINT64)sparse_header->blk_sz *
+    SparseImgData->ChunkDataSz = (UINT64)sparse_header->blk_sz *
                                  chunk_header->chunk_sz;
     /* Make sure that chunk size calculate from sparse image does not exceed the
      * partition size
      */
-    if ((UINT64)SparseImgData.TotalBlocks *
+    if ((UINT64)SparseImgData->TotalBlocks *
         (UINT64)sparse_header->blk_sz +
-        SparseImgData.ChunkDataSz >
-        SparseImgData.PartitionSize) {
+        SparseImgData->ChunkDataSz >
+        SparseImgData->PartitionSize) {
       DEBUG ((EFI_D_ERROR, "Chunk data size exceeds partition size\n"));
       return EFI_VOLUME_FULL;
     }
@@ -970,17 +1751,22 @@ HandleSparseImgFlash (IN CHAR16 *PartitionName,
     Status = ValidateChunkDataAndFlash (sparse_header,
                                         chunk_header,
                                         &Image,
-                                        &SparseImgData);
+                                        SparseImgData);
 
     if (EFI_ERROR (Status)) {
       return Status;
     }
   }
 
+  Status = FlushFillRun (sparse_header, SparseImgData);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
   DEBUG ((EFI_D_INFO, "Wrote %d blocks, expected to write %d blocks\n",
-            SparseImgData.TotalBlocks, sparse_header->total_blks));
+            SparseImgData->TotalBlocks, sparse_header->total_blks));
 
-  if (SparseImgData.TotalBlocks != sparse_header->total_blks) {
+  if (SparseImgData->TotalBlocks != sparse_header->total_blks) {
     DEBUG ((EFI_D_ERROR, "Sparse Image Write Failure\n"));
     Status = EFI_VOLUME_CORRUPTED;
   }
@@ -988,6 +1774,309 @@ HandleSparseImgFlash (IN CHAR16 *PartitionName,
   return Status;
 }
 
+/* Handle Sparse Image Flashing */
+STATIC
+EFI_STATUS
+HandleSparseImgFlash (IN CHAR16 *PartitionName,
+                      IN UINT32 PartitionMaxSize,
+                      IN VOID *Image,
+                      IN UINT64 sz)
+{
+  EFI_STATUS Status;
+  SparseImgParam SparseImgData = {0};
+
+  Status = SparseImgFlash (PartitionName, Image, sz, &SparseImgData);
+  SparseImgDone (&SparseImgData);
+  return Status;
+}
+
+STATIC VOID
+SparseStreamStop (IN EFI_STATUS Status)
+{
+  SparseImgDone (&SparseStream.SparseImgData);
+  SparseStream.Active = FALSE;
+  SparseStream.Done = TRUE;
+  SparseStream.Result = Status;
+}
+
+/* Prepare the armed sparse stream for a new download */
+STATIC VOID SparseStreamStart (VOID)
+{
+  if (!SparseStream.Armed) {
+    return;
+  }
+
+  /* Queued images may still be writing the same partition */
+  WaitForFlashFinished ();
+
+  SparseStream.Active = TRUE;
+  SparseStream.Done = FALSE;
+  SparseStream.HeaderParsed = FALSE;
+  SparseStream.InChunk = FALSE;
+  SparseStream.Result = EFI_SUCCESS;
+  SparseStream.Cursor = 0;
+  SparseStream.ChunkDataLeft = 0;
+}
+
+/* Validate the sparse header of a streamed image and look up the partition
+ * it is written to, the checks are the same as in HandleSparseImgFlash.
+ */
+STATIC EFI_STATUS
+SparseStreamParseHeader (IN VOID *Image)
+{
+  EFI_STATUS Status;
+  sparse_header_t *sparse_header = &SparseStream.SparseHeader;
+  SparseImgParam *SparseImgData = &SparseStream.SparseImgData;
+
+  gBS->CopyMem (sparse_header, Image, sizeof (sparse_header_t));
+  if (SparseImgData->FillPattern) {
+    FreePool (SparseImgData->FillPattern);
+  }
+  gBS->SetMem (SparseImgData, sizeof (SparseImgParam), 0);
+
+  SparseImgData->PartitionName = SparseStream.PartitionName;
+  Status = PartitionGetInfo (SparseStream.PartitionName,
+                             &(SparseImgData->BlockIo),
+                             &(SparseImgData->Handle));
+  if (Status != EFI_SUCCESS)
+    return Status;
+  if (!SparseImgData->BlockIo) {
+    DEBUG ((EFI_D_ERROR, "BlockIo for %s is corrupted\n",
+            SparseStream.PartitionName));
+    return EFI_VOLUME_CORRUPTED;
+  }
+  if (!SparseImgData->Handle) {
+    DEBUG ((EFI_D_ERROR, "EFI handle for %s is corrupted\n",
+            SparseStream.PartitionName));
+    return EFI_VOLUME_CORRUPTED;
+  }
+
+  SparseImgData->PartitionSize = GetPartitionSize (SparseImgData->BlockIo);
+  if (!SparseImgData->PartitionSize) {
+    return EFI_BAD_BUFFER_SIZE;
+  }
+
+  if (((UINT64)sparse_header->total_blks * (UINT64)sparse_header->blk_sz) >
+      SparseImgData->PartitionSize) {
+    DEBUG ((EFI_D_ERROR, "Image is too large for the partition\n"));
+    return EFI_VOLUME_FULL;
+  }
+
+  if (sparse_header->file_hdr_sz != sizeof (sparse_header_t)) {
+    DEBUG ((EFI_D_ERROR, "Sparse header size mismatch\n"));
+    return EFI_BAD_BUFFER_SIZE;
+  }
+
+  if (sparse_header->chunk_hdr_sz != sizeof (chunk_header_t)) {
+    DEBUG ((EFI_D_ERROR, "chunk header size mismatch\n"));
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if (!sparse_header->blk_sz ||
+      (sparse_header->blk_sz) % (SparseImgData->BlockIo->Media->BlockSize)) {
+    DEBUG ((EFI_D_ERROR, "Unsupported sparse block size %x\n",
+            sparse_header->blk_sz));
+    return EFI_INVALID_PARAMETER;
+  }
+
+  SparseImgData->BlockCountFactor = (sparse_header->blk_sz) /
+                                    (SparseImgData->BlockIo->Media->BlockSize);
+  return EFI_SUCCESS;
+}
+
+/* Start processing the next chunk header of a streamed sparse image */
+STATIC EFI_STATUS
+SparseStreamNextChunk (IN UINT8 *Buffer)
+{
+  EFI_STATUS Status;
+  sparse_header_t *sparse_header = &SparseStream.SparseHeader;
+  chunk_header_t *chunk_header = &SparseStream.ChunkHeader;
+  SparseImgParam *SparseImgData = &SparseStream.SparseImgData;
+
+  gBS->CopyMem (chunk_header, Buffer + SparseStream.Cursor,
+                sizeof (chunk_header_t));
+  SparseStream.Cursor += sizeof (chunk_header_t);
+
+  if (((UINT64)SparseImgData->TotalBlocks * (UINT64)sparse_header->blk_sz) >=
+      SparseImgData->PartitionSize) {
+    DEBUG ((EFI_D_ERROR, "Size of image is too large for the partition\n"));
+    return EFI_VOLUME_FULL;
+  }
+
+  SparseImgData->ChunkDataSz = (UINT64)sparse_header->blk_sz *
+                               chunk_header->chunk_sz;
+  if ((UINT64)SparseImgData->TotalBlocks *
+      (UINT64)sparse_header->blk_sz +
+      SparseImgData->ChunkDataSz >
+      SparseImgData->PartitionSize) {
+    DEBUG ((EFI_D_ERROR, "Chunk data size exceeds partition size\n"));
+    return EFI_VOLUME_FULL;
+  }
+
+  if (chunk_header->total_sz < sparse_header->chunk_hdr_sz) {
+    DEBUG ((EFI_D_ERROR, "Bogus chunk size %u\n", chunk_header->total_sz));
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if (chunk_header->chunk_type == CHUNK_TYPE_RAW) {
+    if ((UINT64)chunk_header->total_sz !=
+        ((UINT64)sparse_header->chunk_hdr_sz + SparseImgData->ChunkDataSz)) {
+      DEBUG ((EFI_D_ERROR, "Bogus chunk size for chunk type Raw\n"));
+      return EFI_INVALID_PARAMETER;
+    }
+
+    if (SparseImgData->TotalBlocks > (MAX_UINT32 - chunk_header->chunk_sz)) {
+      DEBUG ((EFI_D_ERROR, "Bogus size for RAW chunk Type\n"));
+      return EFI_INVALID_PARAMETER;
+    }
+
+    Status = FlushFillRun (sparse_header, SparseImgData);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+    SparseStream.ChunkDataLeft = SparseImgData->ChunkDataSz;
+  } else {
+    SparseStream.ChunkDataLeft = chunk_header->total_sz -
+                                 sparse_header->chunk_hdr_sz;
+  }
+
+  SparseStream.InChunk = TRUE;
+  return EFI_SUCCESS;
+}
+
+/* Consume the part of the download buffer that arrived since the last call.
+ * FILL, DONT_CARE and CRC chunks are handled once they are complete, RAW
+ * chunk data is written in MAX_WRITE_SIZE pieces while the rest of the chunk
+ * is still in flight. Buffer is the start of the download buffer and
+ * Available the number of bytes received into it so far.
+ */
+STATIC VOID
+SparseStreamFeed (IN UINT8 *Buffer, IN UINT64 Available, IN BOOLEAN Final)
+{
+  EFI_STATUS Status = EFI_SUCCESS;
+  sparse_header_t *sparse_header = &SparseStream.SparseHeader;
+  chunk_header_t *chunk_header = &SparseStream.ChunkHeader;
+  SparseImgParam *SparseImgData = &SparseStream.SparseImgData;
+  VOID *Image = NULL;
+  UINT64 WriteSize;
+  UINT64 Lba;
+
+  if (!SparseStream.Active) {
+    return;
+  }
+
+  if (!SparseStream.HeaderParsed) {
+    if (Available < sizeof (sparse_header_t)) {
+      if (Final) {
+        SparseStream.Active = FALSE;
+      }
+      return;
+    }
+
+    /* Not a sparse image, it is left to the flash command */
+    if (((sparse_header_t *)Buffer)->magic != SPARSE_HEADER_MAGIC) {
+      SparseStream.Active = FALSE;
+      return;
+    }
+
+    Status = SparseStreamParseHeader (Buffer);
+    if (EFI_ERROR (Status)) {
+      SparseStreamStop (Status);
+      return;
+    }
+    SparseStream.HeaderParsed = TRUE;
+    SparseStream.Cursor = sizeof (sparse_header_t);
+  }
+
+  while (SparseImgData->Chunk < sparse_header->total_chunks) {
+    if (!SparseStream.InChunk) {
+      if (Available - SparseStream.Cursor < sizeof (chunk_header_t)) {
+        break;
+      }
+
+      Status = SparseStreamNextChunk (Buffer);
+      if (EFI_ERROR (Status)) {
+        SparseStreamStop (Status);
+        return;
+      }
+    }
+
+    if (chunk_header->chunk_type != CHUNK_TYPE_RAW) {
+      if (Available - SparseStream.Cursor < SparseStream.ChunkDataLeft) {
+        break;
+      }
+
+      Image = Buffer + SparseStream.Cursor;
+      SparseImgData->ImageEnd = (UINT64)Buffer + Available;
+      Status = ValidateChunkDataAndFlash (sparse_header, chunk_header,
+                                          &Image, SparseImgData);
+      if (EFI_ERROR (Status)) {
+        SparseStreamStop (Status);
+        return;
+      }
+
+      SparseStream.Cursor += SparseStream.ChunkDataLeft;
+      SparseStream.ChunkDataLeft = 0;
+      SparseStream.InChunk = FALSE;
+      SparseImgData->Chunk++;
+      continue;
+    }
+
+    WriteSize = MIN (Available - SparseStream.Cursor,
+                     SparseStream.ChunkDataLeft);
+    if (WriteSize < SparseStream.ChunkDataLeft) {
+      /* Wait for more data rather than issuing small writes */
+      if (WriteSize < MAX_WRITE_SIZE) {
+        break;
+      }
+      WriteSize -= WriteSize % sparse_header->blk_sz;
+    }
+
+    Lba = SparseImgData->TotalBlocks * SparseImgData->BlockCountFactor +
+          (SparseImgData->ChunkDataSz - SparseStream.ChunkDataLeft) /
+          SparseImgData->BlockIo->Media->BlockSize;
+    SparseCrcUpdate (SparseImgData, Buffer + SparseStream.Cursor, WriteSize);
+    Status = SparseWriteToDisk (SparseImgData, Buffer + SparseStream.Cursor,
+                                WriteSize, Lba);
+    if (EFI_ERROR (Status)) {
+      DEBUG ((EFI_D_ERROR, "Flash Write Failure\n"));
+      SparseStreamStop (Status);
+      return;
+    }
+
+    SparseStream.Cursor += WriteSize;
+    SparseStream.ChunkDataLeft -= WriteSize;
+    if (!SparseStream.ChunkDataLeft) {
+      SparseImgData->TotalBlocks += chunk_header->chunk_sz;
+      SparseStream.InChunk = FALSE;
+      SparseImgData->Chunk++;
+    }
+  }
+
+  if (SparseImgData->Chunk == sparse_header->total_chunks) {
+    Status = FlushFillRun (sparse_header, SparseImgData);
+    if (EFI_ERROR (Status)) {
+      SparseStreamStop (Status);
+      return;
+    }
+
+    DEBUG ((EFI_D_INFO, "Wrote %d blocks, expected to write %d blocks\n",
+            SparseImgData->TotalBlocks, sparse_header->total_blks));
+    if (SparseImgData->TotalBlocks != sparse_header->total_blks) {
+      DEBUG ((EFI_D_ERROR, "Sparse Image Write Failure\n"));
+      SparseStreamStop (EFI_VOLUME_CORRUPTED);
+    } else {
+      SparseStreamStop (EFI_SUCCESS);
+    }
+    return;
+  }
+
+  if (Final) {
+    DEBUG ((EFI_D_ERROR, "Sparse image ended before its last chunk\n"));
+    SparseStreamStop (EFI_BAD_BUFFER_SIZE);
+  }
+}
+
 STATIC VOID
 FastbootUpdateAttr (CONST CHAR16 *SlotSuffix)
 {
@@ -1076,10 +2165,11 @@ HandleRawImgFlash (IN CHAR16 *PartitionName,
     return EFI_VOLUME_FULL;
   }
 
-  Status = WriteBlockToPartition (BlockIo, Handle, 0, Size, Image);
+  Status = WriteToDisk (PartitionName, BlockIo, Handle, Image, Size, 0);
   if (EFI_ERROR (Status)) {
     DEBUG ((EFI_D_ERROR, "Writing Block to partition Failure\n"));
   }
+  VerifyFlashWait ();
 
   if (MultiSlotBoot && HasSlot &&
       !(StrnCmp (PartitionName, (CONST CHAR16 *)L"boot",
@@ -1135,35 +2225,327 @@ HandleUbiImgFlash (
     return EFI_INVALID_PARAMETER;
   }
 
-  Status = gBS->LocateProtocol (&gEfiUbiFlasherProtocolGuid,
-                                NULL,
-                                (VOID **) &Ubi);
-  if (EFI_ERROR (Status)) {
-    DEBUG ((EFI_D_ERROR, "UBI Image flashing not supported.\n"));
-    return Status;
+  Status = gBS->LocateProtocol (&gEfiUbiFlasherProtocolGuid,
+                                NULL,
+                                (VOID **) &Ubi);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((EFI_D_ERROR, "UBI Image flashing not supported.\n"));
+    return Status;
+  }
+
+  UnicodeStrToAsciiStr (PartitionName, PartitionNameAscii);
+  Status = Ubi->UbiFlasherOpen (PartitionNameAscii,
+                                &UbiFlasherHandle,
+                                &UbiPageSize,
+                                &UbiBlockSize);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((EFI_D_ERROR, "Unable to open UBI Protocol.\n"));
+    return Status;
+  }
+
+  /* UBI_NUM_IMAGES can replace with number of sparse images being flashed. */
+  Status = Ubi->UbiFlasherWrite (UbiFlasherHandle, UBI_NUM_IMAGES, Image, Size);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((EFI_D_ERROR, "Unable to open UBI Protocol.\n"));
+    return Status;
+  }
+
+  Status = Ubi->UbiFlasherClose (UbiFlasherHandle);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((EFI_D_ERROR, "Unable to close UBI Protocol.\n"));
+    return Status;
+  }
+
+  return Status;
+}
+
+INT32 __attribute__ ( (no_sanitize ("safe-stack")))
+FlashWorkerThread (VOID* Arg)
+{
+  FlashQueue *Queue = (FlashQueue *)Arg;
+  FlashInfo *Job;
+  FlashGroup *Group;
+  EFI_STATUS Status;
+  UINT64 StartTime;
+
+  while (TRUE) {
+    KernIntf->Sem->SemWait (Queue->Pending);
+
+    KernIntf->Lock->AcquireLock (LockQueue);
+    Job = Queue->Jobs[Queue->Head];
+    Queue->Head = (Queue->Head + 1) % FLASH_QUEUE_DEPTH;
+    Queue->Count--;
+    KernIntf->Lock->ReleaseLock (LockQueue);
+
+    StartTime = GetTimerCountms ();
+    Status = Job->FlashImage (Job->PartitionName,
+                              Job->PartitionSize,
+                              Job->FlashDataBuffer,
+                              Job->FlashNumDataBytes);
+    Job->FlashTimeMs = GetTimerCountms () - StartTime;
+    Job->Status = Status;
+    if (EFI_ERROR (Status)) {
+      DEBUG ((EFI_D_ERROR, "Flashing %s on LUN %d failed: %r\n",
+              Job->PartitionName, Job->Lun, Status));
+    }
+
+    if (Job->OwnsBuffer) {
+      FlashBufSetState (Job->FlashDataBuffer, FLASH_BUF_FREE);
+    }
+
+    /* The owner of a group may free its jobs once the group is done */
+    Group = Job->Group;
+
+    KernIntf->Lock->AcquireLock (LockQueue);
+    /* Reported by AcceptCmd on the next flash or download command */
+    if (!Group &&
+        EFI_ERROR (Status) &&
+        FlashResult == EFI_SUCCESS) {
+      FlashResult = Status;
+    }
+
+    FlashJobsPending--;
+    if (!FlashJobsPending) {
+      FlashSplitNeeded = FALSE;
+      IsFlashComplete = TRUE;
+      KernIntf->Event->EventSignal (FlashIdle, FALSE);
+    }
+
+    if (Group) {
+      Group->Pending--;
+      if (!Group->Pending) {
+        KernIntf->Event->EventSignal (Group->Done, FALSE);
+      }
+    }
+    KernIntf->Lock->ReleaseLock (LockQueue);
+
+    if (!Group) {
+      FreePool (Job);
+    }
+    Job = NULL;
+  }
+
+  return 0;
+}
+
+STATIC EFI_STATUS
+FlashQueueStart (IN FlashQueue *Queue)
+{
+  Thread *Worker = NULL;
+
+  Queue->Pending = KernIntf->Sem->SemInit (0, 0);
+  if (!Queue->Pending) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Worker = KernIntf->Thread->ThreadCreate ("FlashWorkerThread",
+      FlashWorkerThread, (VOID*)Queue, UEFI_THREAD_PRIORITY,
+      DEFAULT_STACK_SIZE);
+  if (Worker == NULL) {
+    KernIntf->Sem->SemDestroy (Queue->Pending);
+    Queue->Pending = NULL;
+    return EFI_NOT_READY;
+  }
+
+  AllocateUnSafeStackPtr (Worker);
+  Queue->Worker = Worker;
+
+  return KernIntf->Thread->ThreadResume (Worker);
+}
+
+/* LUN of a partition, trying the current slot for partitions given without
+ * their slot suffix.
+ */
+STATIC UINT32
+PartitionLun (IN CHAR16 *PartitionName)
+{
+  CHAR16 Name[MAX_GPT_NAME_SIZE];
+  Slot CurrentSlot;
+  INT32 Index;
+
+  Index = GetPartitionIndex (PartitionName);
+  if (Index == INVALID_PTN &&
+      PartitionHasMultiSlot ((CONST CHAR16 *)L"boot")) {
+    StrnCpyS (Name, ARRAY_SIZE (Name), PartitionName, StrLen (PartitionName));
+    CurrentSlot = GetCurrentSlotSuffix ();
+    StrnCatS (Name, ARRAY_SIZE (Name), CurrentSlot.Suffix,
+              StrLen (CurrentSlot.Suffix));
+    Index = GetPartitionIndex (Name);
+  }
+
+  return (Index == INVALID_PTN) ? 0 : PtnEntries[Index].lun;
+}
+
+/* Queue a job to the worker of the LUN holding its partition. A download
+ * buffer owned by the job is released by the worker once written.
+ */
+STATIC EFI_STATUS
+FlashQueueJob (IN FlashInfo *Job)
+{
+  EFI_STATUS Status;
+  FlashQueue *Queue;
+
+  Job->Lun = PartitionLun (Job->PartitionName);
+  if (Job->Lun >= MAX_LUNS) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  Queue = &FlashQueues[Job->Lun];
+  if (!Queue->Worker) {
+    Status = FlashQueueStart (Queue);
+    if (EFI_ERROR (Status)) {
+      DEBUG ((EFI_D_ERROR, "Failed to start flash worker for LUN %d: %r\n",
+              Job->Lun, Status));
+      return Status;
+    }
+  }
+
+  KernIntf->Lock->AcquireLock (LockQueue);
+  if (Queue->Count == FLASH_QUEUE_DEPTH) {
+    KernIntf->Lock->ReleaseLock (LockQueue);
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Queue->Jobs[(Queue->Head + Queue->Count) % FLASH_QUEUE_DEPTH] = Job;
+  Queue->Count++;
+
+  if (!FlashJobsPending) {
+    IsFlashComplete = FALSE;
+    KernIntf->Event->EventUnsignal (FlashIdle);
+  }
+  FlashJobsPending++;
+
+  /* Let USB transfers run between the writes of a downloaded image */
+  if (Job->OwnsBuffer) {
+    FlashSplitNeeded = TRUE;
+  }
+  KernIntf->Lock->ReleaseLock (LockQueue);
+
+  if (Job->OwnsBuffer) {
+    FlashBufSetState (Job->FlashDataBuffer, FLASH_BUF_QUEUED);
+  }
+  KernIntf->Sem->SemPost (Queue->Pending, TRUE);
+
+  return EFI_SUCCESS;
+}
+
+STATIC BOOLEAN
+FlashJobIsBoot (IN FlashInfo *Job)
+{
+  return !StrnCmp (Job->PartitionName, (CONST CHAR16 *)L"boot",
+                   StrLen ((CONST CHAR16 *)L"boot"));
+}
+
+/* Write the images of a meta image or batch. Images are grouped by the LUN
+ * of their partition and written by the flash workers, so images on
+ * different LUNs are written in parallel. Boot images update the partition
+ * attributes and are written after the others, as is everything without
+ * multi thread support. Nothing more is written once an image failed, so
+ * the boot images are not updated over a partly written set. Jobs without
+ * FlashImage are raw images.
+ */
+STATIC EFI_STATUS
+FlashMetaImages (IN FlashInfo *Jobs, IN UINT32 Count)
+{
+  EFI_STATUS Status = EFI_SUCCESS;
+  FlashGroup Group = {0};
+  CHAR8 Info[MAX_RSP_SIZE];
+  UINT64 StartTime;
+  BOOLEAN Done = TRUE;
+  BOOLEAN Failed = FALSE;
+  UINT32 Pass;
+  UINT32 i;
+
+  for (i = 0; i < Count; i++) {
+    if (!Jobs[i].FlashImage) {
+      Jobs[i].FlashImage = HandleRawImgFlash;
+    }
+    Jobs[i].PartitionSize = ARRAY_SIZE (Jobs[i].PartitionName);
+    Jobs[i].Status = EFI_NOT_STARTED;
+  }
+
+  if (IsUseMThreadParallel ()) {
+    Group.Done = KernIntf->Event->EventInit (0, FALSE, 0);
   }
 
-  UnicodeStrToAsciiStr (PartitionName, PartitionNameAscii);
-  Status = Ubi->UbiFlasherOpen (PartitionNameAscii,
-                                &UbiFlasherHandle,
-                                &UbiPageSize,
-                                &UbiBlockSize);
-  if (EFI_ERROR (Status)) {
-    DEBUG ((EFI_D_ERROR, "Unable to open UBI Protocol.\n"));
-    return Status;
+  if (Group.Done) {
+    /* Held until all jobs are queued so that Done is not signaled early */
+    Group.Pending = 1;
+
+    for (i = 0; i < Count; i++) {
+      if (FlashJobIsBoot (&Jobs[i])) {
+        continue;
+      }
+
+      Jobs[i].Group = &Group;
+      KernIntf->Lock->AcquireLock (LockQueue);
+      Group.Pending++;
+      KernIntf->Lock->ReleaseLock (LockQueue);
+
+      if (EFI_ERROR (FlashQueueJob (&Jobs[i]))) {
+        KernIntf->Lock->AcquireLock (LockQueue);
+        Group.Pending--;
+        KernIntf->Lock->ReleaseLock (LockQueue);
+        Jobs[i].Group = NULL;
+      }
+    }
+
+    KernIntf->Lock->AcquireLock (LockQueue);
+    Group.Pending--;
+    Done = !Group.Pending;
+    KernIntf->Lock->ReleaseLock (LockQueue);
+
+    if (!Done) {
+      KernIntf->Event->EventWait (Group.Done);
+    }
+    KernIntf->Event->EventDestroy (Group.Done);
+
+    for (i = 0; i < Count; i++) {
+      if (Jobs[i].Group &&
+          EFI_ERROR (Jobs[i].Status)) {
+        Failed = TRUE;
+      }
+    }
   }
 
-  /* UBI_NUM_IMAGES can replace with number of sparse images being flashed. */
-  Status = Ubi->UbiFlasherWrite (UbiFlasherHandle, UBI_NUM_IMAGES, Image, Size);
-  if (EFI_ERROR (Status)) {
-    DEBUG ((EFI_D_ERROR, "Unable to open UBI Protocol.\n"));
-    return Status;
+  /* The remaining images, boot images in the second pass */
+  for (Pass = 0; Pass < 2 && !Failed; Pass++) {
+    for (i = 0; i < Count && !Failed; i++) {
+      if (Jobs[i].Group ||
+          FlashJobIsBoot (&Jobs[i]) != (Pass == 1)) {
+        continue;
+      }
+
+      StartTime = GetTimerCountms ();
+      Jobs[i].Status = Jobs[i].FlashImage (Jobs[i].PartitionName,
+                                           Jobs[i].PartitionSize,
+                                           Jobs[i].FlashDataBuffer,
+                                           Jobs[i].FlashNumDataBytes);
+      Jobs[i].FlashTimeMs = GetTimerCountms () - StartTime;
+      Failed = EFI_ERROR (Jobs[i].Status);
+    }
   }
 
-  Status = Ubi->UbiFlasherClose (UbiFlasherHandle);
-  if (EFI_ERROR (Status)) {
-    DEBUG ((EFI_D_ERROR, "Unable to close UBI Protocol.\n"));
-    return Status;
+  for (i = 0; i < Count; i++) {
+    if (Jobs[i].Status == EFI_NOT_STARTED) {
+      continue;
+    }
+
+    if (EFI_ERROR (Jobs[i].Status)) {
+      AsciiSPrint (Info, MAX_RSP_SIZE, "%s: %r", Jobs[i].PartitionName,
+                   Jobs[i].Status);
+      if (!EFI_ERROR (Status)) {
+        Status = Jobs[i].Status;
+      }
+    } else {
+      AsciiSPrint (Info, MAX_RSP_SIZE, "%s: %lld KB in %lld ms (%lld KB/s)",
+                   Jobs[i].PartitionName, Jobs[i].FlashNumDataBytes / 1024,
+                   Jobs[i].FlashTimeMs,
+                   Jobs[i].FlashNumDataBytes * 1000 / 1024 /
+                   MAX (Jobs[i].FlashTimeMs, 1));
+    }
+    FastbootInfo (Info);
+    WaitForTransferComplete ();
   }
 
   return Status;
@@ -1186,6 +2568,7 @@ HandleMetaImgFlash (IN CHAR16 *PartitionName,
   UINT64 ImageEnd = 0;
   BOOLEAN PnameTerminated = FALSE;
   UINT32 j;
+  FlashInfo Jobs[MAX_IMAGES_IN_METAIMG];
 
   if (Size < sizeof (meta_header_t)) {
     DEBUG ((EFI_D_ERROR,
@@ -1217,6 +2600,7 @@ HandleMetaImgFlash (IN CHAR16 *PartitionName,
     return EFI_BAD_BUFFER_SIZE;
   }
   ImageEnd = (UINT64)Image + Size;
+  gBS->SetMem (Jobs, sizeof (Jobs), 0);
 
   for (i = 0; i < images; i++) {
     PnameTerminated = FALSE;
@@ -1260,14 +2644,18 @@ HandleMetaImgFlash (IN CHAR16 *PartitionName,
       return EFI_INVALID_PARAMETER;
     }
 
-    Status = HandleRawImgFlash (
-        PartitionNameFromMeta, ARRAY_SIZE (PartitionNameFromMeta),
-        (void *)Image + img_header_entry[i].start_offset,
-        img_header_entry[i].size);
-    if (Status != EFI_SUCCESS) {
-      DEBUG ((EFI_D_ERROR, "Meta Image Write Failure\n"));
-      return Status;
-    }
+    StrnCpyS (Jobs[i].PartitionName, ARRAY_SIZE (Jobs[i].PartitionName),
+              PartitionNameFromMeta, StrLen (PartitionNameFromMeta));
+    Jobs[i].FlashDataBuffer = (UINT8 *)Image +
+                              img_header_entry[i].start_offset;
+    Jobs[i].FlashNumDataBytes = img_header_entry[i].size;
+  }
+
+  /* Every image is validated before any of them is written */
+  Status = FlashMetaImages (Jobs, i);
+  if (Status != EFI_SUCCESS) {
+    DEBUG ((EFI_D_ERROR, "Meta Image Write Failure\n"));
+    return Status;
   }
 
   Status = UpdateDevInfo (PartitionName, meta_header->img_version);
@@ -1309,59 +2697,76 @@ FastbootErasePartition (IN CHAR16 *PartitionName)
   return Status;
 }
 
-INT32 __attribute__ ( (no_sanitize ("safe-stack")))
-SparseImgFlashThread (VOID* Arg)
-{
-  Thread* CurrentThread = KernIntf->Thread->GetCurrentThread ();
-  FlashInfo* ThreadFlashInfo = (FlashInfo*) Arg;
+#endif
 
-  if (!ThreadFlashInfo || !ThreadFlashInfo->FlashDataBuffer) {
-    return 0;
+/* Prepare the decoding of an armed compressed download. The input is
+ * placed at the page aligned end of the download buffer, the decoded image
+ * grows from the start of the buffer towards it.
+ */
+STATIC VOID
+DloadLz4Start (VOID)
+{
+  DloadLz4Active = FALSE;
+  if (!DloadLz4Armed) {
+    return;
   }
 
-  KernIntf->Lock->AcquireLock (LockFlash);
-  IsFlashComplete = FALSE;
-  FlashSplitNeeded = TRUE;
-
-  HandleSparseImgFlash (ThreadFlashInfo->PartitionName,
-          ThreadFlashInfo->PartitionSize,
-          ThreadFlashInfo->FlashDataBuffer,
-          ThreadFlashInfo->FlashNumDataBytes);
-
-  FlashSplitNeeded = FALSE;
-  IsFlashComplete = TRUE;
-  KernIntf->Lock->ReleaseLock (LockFlash);
-
-  ThreadStackNodeRemove (CurrentThread);
-
-  FreePool (ThreadFlashInfo);
-  ThreadFlashInfo = NULL;
-
-  KernIntf->Thread->ThreadExit (0);
-
-  return 0;
+  DloadLz4Active = TRUE;
+  DloadLz4In = mUsbDataBuffer +
+               ((MaxDownLoadSize - mNumDataBytes) & ~(UINT64)EFI_PAGE_MASK);
+  DloadLz4InPos = 0;
+  DloadLz4OutPos = 0;
+  DloadLz4Result = EFI_SUCCESS;
+  DloadLz4Ticks = 0;
+  Lz4FrameInit (&DloadLz4Decoder);
 }
 
-EFI_STATUS CreateSparseImgFlashThread (IN FlashInfo* ThreadFlashInfo)
+/* Decode the Received bytes of the compressed download that are complete
+ * units. Each unit may only write up to the first input byte not consumed
+ * yet, so the in place decoding never overwrites its own input.
+ * Returns the number of decoded bytes at the start of the download buffer.
+ */
+STATIC UINT64
+DloadLz4Feed (IN UINT64 Received, IN BOOLEAN Final)
 {
-  EFI_STATUS Status = EFI_SUCCESS;
-  Thread* SparseImgFlashTD = NULL;
-
-  SparseImgFlashTD = KernIntf->Thread->ThreadCreate ("SparseImgFlashThread",
-      SparseImgFlashThread, (VOID*)ThreadFlashInfo, UEFI_THREAD_PRIORITY,
-      DEFAULT_STACK_SIZE);
+  EFI_STATUS Status;
+  UINT64 StartTicks;
 
-  if (SparseImgFlashTD == NULL) {
-    return EFI_NOT_READY;
+  if (EFI_ERROR (DloadLz4Result)) {
+    return DloadLz4OutPos;
   }
 
-  AllocateUnSafeStackPtr (SparseImgFlashTD);
+  StartTicks = GetPerformanceCounter ();
+  do {
+    Status = Lz4FrameDecode (&DloadLz4Decoder, DloadLz4In, Received,
+                             &DloadLz4InPos, Final, mUsbDataBuffer,
+                             (DloadLz4In + DloadLz4InPos) - mUsbDataBuffer,
+                             &DloadLz4OutPos);
+  } while (Status == EFI_SUCCESS);
+  DloadLz4Ticks += GetPerformanceCounter () - StartTicks;
+
+  if (Status == EFI_END_OF_FILE) {
+    if (Final &&
+        DloadLz4InPos != Received) {
+      DEBUG ((EFI_D_ERROR, "Compressed download: data after the frame\n"));
+      DloadLz4Result = EFI_VOLUME_CORRUPTED;
+    }
+  } else if (Status != EFI_NOT_READY) {
+    DEBUG ((EFI_D_ERROR, "Compressed download: decode failed at %lld: %r\n",
+            (UINT64)DloadLz4InPos, Status));
+    DloadLz4Result = Status;
+  }
 
-  Status = KernIntf->Thread->ThreadResume (SparseImgFlashTD);
-  return Status;
+  return DloadLz4OutPos;
 }
 
-#endif
+/* Drop the state of a compressed download that ended or was abandoned */
+STATIC VOID
+DloadLz4Stop (VOID)
+{
+  DloadLz4Active = FALSE;
+  DloadLz4In = NULL;
+}
 
 /* Handle Download Command */
 STATIC VOID
@@ -1373,6 +2778,9 @@ CmdDownload (IN CONST CHAR8 *arg, IN VOID *data, IN UINT32 sz)
   CHAR16 OutputString[FASTBOOT_STRING_MAX_LENGTH];
   CHAR8 *NumBytesString = (CHAR8 *)arg;
 
+  /* Nothing of an earlier download may steer this one */
+  DloadLz4Stop ();
+
   /* Argument is 8-character ASCII string hex representation of number of
    * bytes that will be sent in the data phase.Response is "DATA" + that same
    * 8-character string.
@@ -1411,6 +2819,11 @@ CmdDownload (IN CONST CHAR8 *arg, IN VOID *data, IN UINT32 sz)
     KernIntf->Lock->AcquireLock (LockDownload);
   }
 
+#ifdef ENABLE_UPDATE_PARTITIONS_CMDS
+  SparseStreamStart ();
+#endif
+  DloadLz4Start ();
+
   mState = ExpectDataState;
   mBytesReceivedSoFar = 0;
   GetFastbootDeviceData ()->UsbDeviceProtocol->Send (
@@ -1419,6 +2832,192 @@ CmdDownload (IN CONST CHAR8 *arg, IN VOID *data, IN UINT32 sz)
           GetFastbootDeviceData ()->gTxBuffer));
 }
 
+/* "oem download-compression lz4" makes the following downloads LZ4 frames,
+ * they are decoded while they arrive and the commands that follow see the
+ * decoded image. "oem download-compression none" goes back to plain data.
+ */
+STATIC VOID
+CmdOemDownloadCompression (IN CONST CHAR8 *Arg, IN VOID *Data, IN UINT32 Size)
+{
+  while (*Arg == ' ') {
+    Arg++;
+  }
+
+  if (!AsciiStrCmp (Arg, "lz4")) {
+    DloadLz4Armed = TRUE;
+  } else if (!AsciiStrCmp (Arg, "none") ||
+             *Arg == '\0') {
+    DloadLz4Armed = FALSE;
+  } else {
+    FastbootFail ("Unsupported download compression");
+    return;
+  }
+
+  FastbootOkay ("");
+}
+
+#ifdef ENABLE_UPDATE_PARTITIONS_CMDS
+/* Fetch offsets and sizes are hexadecimal with a 0x prefix, as the host
+ * sends them, or decimal.
+ */
+STATIC UINT64
+FetchParseNumber (IN CONST CHAR8 *Str)
+{
+  if (!AsciiStrnCmp (Str, "0x", AsciiStrLen ("0x")) ||
+      !AsciiStrnCmp (Str, "0X", AsciiStrLen ("0X"))) {
+    return AsciiStrHexToUint64 (Str);
+  }
+  return AsciiStrDecimalToUint64 (Str);
+}
+
+/* Handle Fetch Command: "fetch:<partition>[:<offset>[:<size>]]" sends <size>
+ * bytes of <partition> from byte <offset> to the host, the rest of the
+ * partition when <size> is left out. Neither needs to be block aligned, the
+ * blocks around the range are read and only the range is sent. Blocks are
+ * read straight into two USB transfer buffers, one is read while the other
+ * one is being sent.
+ */
+STATIC VOID
+CmdFetch (IN CONST CHAR8 *arg, IN VOID *data, IN UINT32 sz)
+{
+  EFI_STATUS Status = EFI_SUCCESS;
+  CHAR8 Name[MAX_GPT_NAME_SIZE];
+  CHAR16 PartitionName[MAX_GPT_NAME_SIZE];
+  CHAR16 SlotSuffix[MAX_SLOT_SUFFIX_SZ];
+  CHAR8 Response[MAX_RSP_SIZE];
+  CONST CHAR8 *Sep;
+  EFI_BLOCK_IO_PROTOCOL *BlockIo = NULL;
+  EFI_HANDLE *Handle = NULL;
+  UINT8 *Buffer[2] = {NULL, NULL};
+  UINT64 PartitionSize;
+  UINT64 Offset = 0;
+  UINT64 FetchSize = 0;
+  BOOLEAN HasSize = FALSE;
+  BOOLEAN Sending = FALSE;
+  UINT64 Pos;
+  UINT64 Skip;
+  UINT64 Bytes;
+  UINT32 BlockSize;
+  UINT32 Cur = 0;
+  UINTN Len;
+
+  if (!IsUnlocked ()) {
+    FastbootFail ("Fetch is not allowed on locked devices");
+    return;
+  }
+
+  Sep = AsciiStrStr (arg, ":");
+  Len = Sep ? (UINTN)(Sep - arg) : AsciiStrLen (arg);
+  if (!Len ||
+      Len >= MAX_GPT_NAME_SIZE) {
+    FastbootFail ("Invalid partition name");
+    return;
+  }
+  AsciiStrnCpyS (Name, sizeof (Name), arg, Len);
+  AsciiStrToUnicodeStr (Name, PartitionName);
+
+  if (Sep) {
+    Offset = FetchParseNumber (Sep + 1);
+    Sep = AsciiStrStr (Sep + 1, ":");
+  }
+  if (Sep) {
+    FetchSize = FetchParseNumber (Sep + 1);
+    HasSize = TRUE;
+  }
+
+  /* Read what queued flash jobs write */
+  WaitForFlashFinished ();
+
+  if (PartitionHasMultiSlot ((CONST CHAR16 *)L"boot")) {
+    GetPartitionHasSlot (PartitionName, ARRAY_SIZE (PartitionName),
+                         SlotSuffix, MAX_SLOT_SUFFIX_SZ);
+  }
+
+  Status = PartitionGetInfo (PartitionName, &BlockIo, &Handle);
+  if (EFI_ERROR (Status) ||
+      !BlockIo) {
+    FastbootFail ("Partition not found");
+    return;
+  }
+
+  PartitionSize = GetPartitionSize (BlockIo);
+  if (Offset > PartitionSize) {
+    FastbootFail ("Offset is outside the partition");
+    return;
+  }
+
+  if (!HasSize) {
+    FetchSize = PartitionSize - Offset;
+  }
+
+  if (!FetchSize ||
+      FetchSize > PartitionSize - Offset ||
+      FetchSize > MAX_FETCH_SIZE) {
+    FastbootFail ("Invalid fetch size");
+    return;
+  }
+
+  for (Cur = 0; Cur < ARRAY_SIZE (Buffer); Cur++) {
+    Status = GetFastbootDeviceData ()->UsbDeviceProtocol->AllocateTransferBuffer (
+        FETCH_BUFFER_SIZE, (VOID **)&Buffer[Cur]);
+    if (EFI_ERROR (Status)) {
+      DEBUG ((EFI_D_ERROR, "Failed to allocate fetch buffer: %r\n", Status));
+      FastbootFail ("Failed to allocate the fetch buffers");
+      goto out;
+    }
+  }
+
+  DEBUG ((EFI_D_INFO, "Fetching %lld bytes of %s at offset %lld\n",
+          FetchSize, PartitionName, Offset));
+
+  AsciiSPrint (Response, sizeof (Response), "%08x", (UINT32)FetchSize);
+  FastbootAck ("DATA", Response);
+  WaitForTransferComplete ();
+
+  BlockSize = BlockIo->Media->BlockSize;
+  Cur = 0;
+  for (Pos = Offset; Pos < Offset + FetchSize; Pos += Bytes) {
+    Skip = Pos % BlockSize;
+    Bytes = MIN (Offset + FetchSize - Pos, FETCH_BUFFER_SIZE - Skip);
+    Status = BlockIo->ReadBlocks (BlockIo, BlockIo->Media->MediaId,
+                                  Pos / BlockSize,
+                                  ROUND_TO_PAGE (Skip + Bytes, BlockSize - 1),
+                                  Buffer[Cur]);
+    if (EFI_ERROR (Status)) {
+      DEBUG ((EFI_D_ERROR, "Fetch read at %lld failed: %r\n", Pos, Status));
+      break;
+    }
+
+    /* The previous buffer was being sent while this one was read */
+    if (Sending) {
+      WaitForTransferComplete ();
+    }
+    GetFastbootDeviceData ()->UsbDeviceProtocol->Send (
+        ENDPOINT_OUT, Bytes, Buffer[Cur] + Skip);
+    Sending = TRUE;
+    Cur ^= 1;
+  }
+
+  if (Sending) {
+    WaitForTransferComplete ();
+  }
+
+  if (EFI_ERROR (Status)) {
+    FastbootFail ("Failed to read the partition");
+  } else {
+    FastbootOkay ("");
+  }
+
+out:
+  for (Cur = 0; Cur < ARRAY_SIZE (Buffer); Cur++) {
+    if (Buffer[Cur]) {
+      GetFastbootDeviceData ()->UsbDeviceProtocol->FreeTransferBuffer (
+          Buffer[Cur]);
+    }
+  }
+}
+#endif
+
 #ifdef ENABLE_UPDATE_PARTITIONS_CMDS
 /*  Function needed for event notification callback */
 STATIC VOID
@@ -1562,6 +3161,29 @@ IsCriticalPartition (CHAR16 *PartitionName)
   return FALSE;
 }
 
+/* Check whether PartitionName can be flashed in the current lock state,
+ * the failure response is sent to the host if it can not.
+ */
+STATIC BOOLEAN
+FlashAllowedInLockState (CHAR16 *PartitionName)
+{
+  if ((GetAVBVersion () == AVB_LE) ||
+      ((GetAVBVersion () != AVB_LE) &&
+      (TargetBuildVariantUser ()))) {
+    if (!IsUnlocked ()) {
+      FastbootFail ("Flashing is not allowed in Lock State");
+      return FALSE;
+    }
+
+    if (!IsUnlockCritical () && IsCriticalPartition (PartitionName)) {
+      FastbootFail ("Flashing is not allowed for Critical Partitions\n");
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
 STATIC BOOLEAN
 CheckVirtualAbCriticalPartition (CHAR16 *PartitionName)
 {
@@ -1581,22 +3203,64 @@ CheckVirtualAbCriticalPartition (CHAR16 *PartitionName)
   return FALSE;
 }
 
+/* Flashing or erasing super cancels a snapshot merge that has not
+ * completed. Returns FALSE after sending the failure response if the merge
+ * state can not be updated.
+ */
+STATIC BOOLEAN
+CancelSnapshotMergeForSuper (CHAR16 *PartitionName)
+{
+  VirtualAbMergeStatus SnapshotMergeStatus;
+  EFI_STATUS Status;
+
+  SnapshotMergeStatus = GetSnapshotMergeStatus ();
+  if (((SnapshotMergeStatus == MERGING) ||
+        (SnapshotMergeStatus == SNAPSHOTTED)) &&
+        !StrnCmp (PartitionName, L"super", StrLen (L"super"))) {
+
+    Status = SetSnapshotMergeStatus (CANCELLED);
+    if (Status != EFI_SUCCESS) {
+      FastbootFail ("Failed to update snapshot state to cancel");
+      return FALSE;
+    }
+
+    //updating fbvar snapshot-merge-state
+    AsciiSPrint (SnapshotMergeState,
+                  AsciiStrLen (VabSnapshotMergeStatus[NONE_MERGE_STATUS]) + 1,
+                  "%a", VabSnapshotMergeStatus[NONE_MERGE_STATUS]);
+  }
+
+  return TRUE;
+}
+
 STATIC VOID ExchangeFlashAndUsbDataBuf (VOID)
 {
   VOID *mTmpbuff;
 
   if (IsUseMThreadParallel ()) {
     KernIntf->Lock->AcquireLock (LockDownload);
-    KernIntf->Lock->AcquireLock (LockFlash);
   }
 
-  mTmpbuff = mUsbDataBuffer;
-  mUsbDataBuffer = mFlashDataBuffer;
-  mFlashDataBuffer = mTmpbuff;
-  mFlashNumDataBytes = mNumDataBytes;
+  if (FlashBufCount) {
+    /* The previous flash buffer is free again unless it was queued */
+    if (FlashBufGetState (mFlashDataBuffer) == FLASH_BUF_FLASH) {
+      FlashBufSetState (mFlashDataBuffer, FLASH_BUF_FREE);
+    }
+
+    FlashBufSetState (mUsbDataBuffer, FLASH_BUF_FLASH);
+    mFlashDataBuffer = mUsbDataBuffer;
+    mFlashNumDataBytes = mNumDataBytes;
+    mUsbDataBuffer = FlashBufAcquire ();
+  } else {
+    WaitForFlashFinished ();
+
+    mTmpbuff = mUsbDataBuffer;
+    mUsbDataBuffer = mFlashDataBuffer;
+    mFlashDataBuffer = mTmpbuff;
+    mFlashNumDataBytes = mNumDataBytes;
+  }
 
   if (IsUseMThreadParallel ()) {
-    KernIntf->Lock->ReleaseLock (LockFlash);
     KernIntf->Lock->ReleaseLock (LockDownload);
   }
 }
@@ -1610,6 +3274,9 @@ ReenumeratePartTable (VOID)
   BOOLEAN MultiSlotBoot = FALSE;
   BOOLEAN BootPtnUpdated = FALSE;
 
+  /* The handles of the old partition table go away with the refresh */
+  InvalidatePartitionIndex ();
+
   Status =
     gBS->CreateEventEx (EVT_NOTIFY_SIGNAL, TPL_CALLBACK, BlockIoCallback,
                         NULL, &gBlockIoRefreshGuid, &gBlockIoRefreshEvt);
@@ -1687,7 +3354,6 @@ CmdFlash (IN CONST CHAR8 *arg, IN VOID *data, IN UINT32 sz)
   CHAR8 FlashResultStr[MAX_RSP_SIZE] = "";
   UINT64 PartitionSize = 0;
   UINT32 Ret;
-  VirtualAbMergeStatus SnapshotMergeStatus;
 
   ExchangeFlashAndUsbDataBuf ();
   if (mFlashDataBuffer == NULL) {
@@ -1696,24 +3362,21 @@ CmdFlash (IN CONST CHAR8 *arg, IN VOID *data, IN UINT32 sz)
     return;
   }
 
+  /* Only sparse images are queued to the flash workers, anything else is
+   * written after them so that writes to a partition stay in order.
+   */
+  if (((sparse_header_t *)mFlashDataBuffer)->magic != SPARSE_HEADER_MAGIC) {
+    WaitForFlashFinished ();
+  }
+
   if (AsciiStrLen (arg) >= MAX_GPT_NAME_SIZE) {
     FastbootFail ("Invalid partition name");
     return;
   }
   AsciiStrToUnicodeStr (arg, PartitionName);
 
-  if ((GetAVBVersion () == AVB_LE) ||
-      ((GetAVBVersion () != AVB_LE) &&
-      (TargetBuildVariantUser ()))) {
-    if (!IsUnlocked ()) {
-      FastbootFail ("Flashing is not allowed in Lock State");
-      return;
-    }
-
-    if (!IsUnlockCritical () && IsCriticalPartition (PartitionName)) {
-      FastbootFail ("Flashing is not allowed for Critical Partitions\n");
-      return;
-    }
+  if (!FlashAllowedInLockState (PartitionName)) {
+    return;
   }
 
   if (IsVirtualAbOtaSupported ()) {
@@ -1725,22 +3388,36 @@ CmdFlash (IN CONST CHAR8 *arg, IN VOID *data, IN UINT32 sz)
       return;
     }
 
-    SnapshotMergeStatus = GetSnapshotMergeStatus ();
-    if (((SnapshotMergeStatus == MERGING) ||
-          (SnapshotMergeStatus == SNAPSHOTTED)) &&
-          !StrnCmp (PartitionName, L"super", StrLen (L"super"))) {
+    if (!CancelSnapshotMergeForSuper (PartitionName)) {
+      return;
+    }
+  }
 
-      Status = SetSnapshotMergeStatus (CANCELLED);
-      if (Status != EFI_SUCCESS) {
-        FastbootFail ("Failed to update snapshot state to cancel");
-        return;
-      }
+  if (SparseStream.Armed &&
+      !SparseStream.Done &&
+      AsciiStrCmp (arg, SparseStream.Target)) {
+    DEBUG ((EFI_D_INFO, "Sparse stream to %a disarmed\n", SparseStream.Target));
+    SparseStream.Armed = FALSE;
+  }
 
-      //updating fbvar snapshot-merge-state
-      AsciiSPrint (SnapshotMergeState,
-                    AsciiStrLen (VabSnapshotMergeStatus[NONE_MERGE_STATUS]) + 1,
-                    "%a", VabSnapshotMergeStatus[NONE_MERGE_STATUS]);
+  /* The image was already written while it was downloaded */
+  if (SparseStream.Done) {
+    SparseStream.Done = FALSE;
+    SparseStream.Result = VerifyFlashReport (SparseStream.Result);
+    if (AsciiStrCmp (arg, SparseStream.Target)) {
+      AsciiSPrint (FlashResultStr, MAX_RSP_SIZE,
+                   "Streamed image was flashed to %a", SparseStream.Target);
+      SparseStream.Armed = FALSE;
+      FastbootFail (FlashResultStr);
+    } else if (EFI_ERROR (SparseStream.Result)) {
+      AsciiSPrint (FlashResultStr, MAX_RSP_SIZE, "%a : %r",
+                   "Error flashing partition", SparseStream.Result);
+      DEBUG ((EFI_D_ERROR, "%a\n", FlashResultStr));
+      FastbootFail (FlashResultStr);
+    } else {
+      FastbootOkay ("");
     }
+    return;
   }
 
   /* Handle virtual partition avb_custom_key */
@@ -1801,6 +3478,7 @@ CmdFlash (IN CONST CHAR8 *arg, IN VOID *data, IN UINT32 sz)
       Status = HandleRawImgFlash (PartitionName,
                         ARRAY_SIZE (PartitionName),
                         mFlashDataBuffer, mFlashNumDataBytes);
+      Status = VerifyFlashReport (Status);
     }
     else {
       Status = UpdatePartitionTable (mFlashDataBuffer, mFlashNumDataBytes,
@@ -1847,8 +3525,12 @@ CmdFlash (IN CONST CHAR8 *arg, IN VOID *data, IN UINT32 sz)
       goto out;
     }
 
+    /* Verified images are flashed before the command completes, so that
+     * mismatches can be reported with its result.
+     */
     if ((PartitionSize > MaxDownLoadSize) &&
-         !IsDisableParallelDownloadFlash ()) {
+         !IsDisableParallelDownloadFlash () &&
+         !VerifyAfterFlash) {
       if (IsUseMThreadParallel ()) {
         FlashInfo* ThreadFlashInfo = AllocateZeroPool (sizeof (FlashInfo));
         if (!ThreadFlashInfo) {
@@ -1859,12 +3541,18 @@ CmdFlash (IN CONST CHAR8 *arg, IN VOID *data, IN UINT32 sz)
 
         ThreadFlashInfo->FlashDataBuffer = mFlashDataBuffer,
         ThreadFlashInfo->FlashNumDataBytes = mFlashNumDataBytes;
+        ThreadFlashInfo->FlashImage = HandleSparseImgFlash;
+        ThreadFlashInfo->OwnsBuffer = TRUE;
 
         StrnCpyS (ThreadFlashInfo->PartitionName, MAX_GPT_NAME_SIZE,
                 PartitionName, ARRAY_SIZE (PartitionName));
         ThreadFlashInfo->PartitionSize = ARRAY_SIZE (PartitionName);
 
-        Status = CreateSparseImgFlashThread (ThreadFlashInfo);
+        Status = FlashQueueJob (ThreadFlashInfo);
+        if (EFI_ERROR (Status)) {
+          FreePool (ThreadFlashInfo);
+          ThreadFlashInfo = NULL;
+        }
       } else {
         IsFlashComplete = FALSE;
 
@@ -1885,7 +3573,9 @@ CmdFlash (IN CONST CHAR8 *arg, IN VOID *data, IN UINT32 sz)
 
     if (EFI_ERROR (Status) ||
       !IsUseMThreadParallel () ||
+      VerifyAfterFlash ||
       (PartitionSize <= MaxDownLoadSize)) {
+      WaitForFlashFinished ();
       FlashResult = HandleSparseImgFlash (PartitionName,
                                         ARRAY_SIZE (PartitionName),
                                         mFlashDataBuffer, mFlashNumDataBytes);
@@ -1909,6 +3599,8 @@ CmdFlash (IN CONST CHAR8 *arg, IN VOID *data, IN UINT32 sz)
                                      mFlashDataBuffer, mFlashNumDataBytes);
   }
 
+  FlashResult = VerifyFlashReport (FlashResult);
+
   /*
    * For Non-sparse image: Check flash result and update the result
    * Also, Handle if there is Failure in handling USB events especially for
@@ -1916,6 +3608,7 @@ CmdFlash (IN CONST CHAR8 *arg, IN VOID *data, IN UINT32 sz)
    */
   if ((sparse_header->magic != SPARSE_HEADER_MAGIC) ||
         (PartitionSize < MaxDownLoadSize) ||
+        VerifyAfterFlash ||
         ((PartitionSize > MaxDownLoadSize) &&
         (IsDisableParallelDownloadFlash () ||
         (Status != EFI_SUCCESS)))) {
@@ -1954,6 +3647,375 @@ out:
   LunSet = FALSE;
 }
 
+/* Check one entry of a batch and fill its flash job. The partition is looked
+ * up in the current slot when it has slots, the expanded image has to fit
+ * in it. Returns FALSE after sending the failure response.
+ */
+STATIC BOOLEAN
+FlashBatchEntry (IN batch_entry_t *Entry,
+                 IN UINT8 *Batch,
+                 IN UINT64 BatchSize,
+                 IN UINT64 DataStart,
+                 OUT FlashInfo *Job)
+{
+  EFI_STATUS Status;
+  EFI_BLOCK_IO_PROTOCOL *BlockIo = NULL;
+  EFI_HANDLE *Handle = NULL;
+  CHAR16 SlotSuffix[MAX_SLOT_SUFFIX_SZ];
+  CHAR8 Resp[MAX_RSP_SIZE];
+  sparse_header_t *SparseHeader;
+  UINT64 ImageSize;
+  UINT64 PartitionSize;
+  INT32 Index;
+
+  if (AsciiStrnLenS (Entry->ptn_name, sizeof (Entry->ptn_name)) >=
+      MAX_GPT_NAME_SIZE) {
+    FastbootFail ("Invalid partition name in batch");
+    return FALSE;
+  }
+  AsciiStrToUnicodeStr (Entry->ptn_name, Job->PartitionName);
+
+  /* Partition tables, LUNs and virtual partitions need their own command */
+  if (!Job->PartitionName[0] ||
+      StrStr (Job->PartitionName, L":") ||
+      !StrnCmp (Job->PartitionName, L"partition", StrLen (L"partition")) ||
+      !StrnCmp (Job->PartitionName, L"mibib", StrLen (L"mibib")) ||
+      !StrnCmp (Job->PartitionName, L"avb_custom_key",
+                StrLen (L"avb_custom_key"))) {
+    AsciiSPrint (Resp, MAX_RSP_SIZE, "%a can not be flashed in a batch",
+                 Entry->ptn_name);
+    FastbootFail (Resp);
+    return FALSE;
+  }
+
+  if (!FlashAllowedInLockState (Job->PartitionName)) {
+    return FALSE;
+  }
+
+  if (IsVirtualAbOtaSupported () &&
+      CheckVirtualAbCriticalPartition (Job->PartitionName)) {
+    AsciiSPrint (Resp, MAX_RSP_SIZE, "Flashing of %s is not allowed in %a state",
+                 Job->PartitionName, SnapshotMergeState);
+    FastbootFail (Resp);
+    return FALSE;
+  }
+
+  if (Entry->offset < DataStart ||
+      Entry->offset > BatchSize ||
+      !Entry->size ||
+      Entry->size > BatchSize - Entry->offset) {
+    AsciiSPrint (Resp, MAX_RSP_SIZE, "Invalid image range for %a",
+                 Entry->ptn_name);
+    FastbootFail (Resp);
+    return FALSE;
+  }
+  Job->FlashDataBuffer = Batch + Entry->offset;
+  Job->FlashNumDataBytes = Entry->size;
+
+  if (PartitionHasMultiSlot ((CONST CHAR16 *)L"boot")) {
+    GetPartitionHasSlot (Job->PartitionName, ARRAY_SIZE (Job->PartitionName),
+                         SlotSuffix, MAX_SLOT_SUFFIX_SZ);
+  }
+
+  Index = GetPartitionIndex (Job->PartitionName);
+  Status = PartitionGetInfo (Job->PartitionName, &BlockIo, &Handle);
+  if (Index == INVALID_PTN ||
+      EFI_ERROR (Status)) {
+    AsciiSPrint (Resp, MAX_RSP_SIZE, "(%s) No such partition",
+                 Job->PartitionName);
+    FastbootFail (Resp);
+    return FALSE;
+  }
+  Job->Lun = PtnEntries[Index].lun;
+  PartitionSize = (PtnEntries[Index].PartEntry.EndingLBA -
+                   PtnEntries[Index].PartEntry.StartingLBA + 1) *
+                  BlockIo->Media->BlockSize;
+
+  ImageSize = Entry->size;
+  SparseHeader = (sparse_header_t *)Job->FlashDataBuffer;
+  if (Entry->size >= sizeof (sparse_header_t) &&
+      SparseHeader->magic == SPARSE_HEADER_MAGIC) {
+    ImageSize = (UINT64)SparseHeader->total_blks * SparseHeader->blk_sz;
+    Job->FlashImage = HandleSparseImgFlash;
+  } else if (Entry->size >= sizeof (meta_header_t) &&
+             ((meta_header_t *)Job->FlashDataBuffer)->magic ==
+             META_HEADER_MAGIC) {
+    AsciiSPrint (Resp, MAX_RSP_SIZE, "Meta image for %a in batch",
+                 Entry->ptn_name);
+    FastbootFail (Resp);
+    return FALSE;
+  } else {
+    Job->FlashImage = HandleRawImgFlash;
+  }
+
+  if (ImageSize > PartitionSize) {
+    AsciiSPrint (Resp, MAX_RSP_SIZE, "Image for %s is larger than partition",
+                 Job->PartitionName);
+    FastbootFail (Resp);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* "flash-batch" writes all images of one download, see BatchFormat.h.
+ * Every entry is checked as CmdFlash checks its partition before anything
+ * is written, then the images are written by the flash workers of their
+ * LUNs as the images of a meta image are.
+ */
+STATIC VOID
+CmdFlashBatch (IN CONST CHAR8 *Arg, IN VOID *Data, IN UINT32 Size)
+{
+  EFI_STATUS Status;
+  batch_header_t *Header;
+  FlashInfo *Jobs = NULL;
+  CHAR8 Resp[MAX_RSP_SIZE];
+  UINT64 DataStart;
+  UINT64 TotalBytes = 0;
+  UINT32 LunMask = 0;
+  UINT32 LunCount = 0;
+  BOOLEAN SystemFlashed = FALSE;
+  UINT32 Count;
+  UINT32 i;
+  UINT32 j;
+
+  LunSet = FALSE;
+  ExchangeFlashAndUsbDataBuf ();
+  if (mFlashDataBuffer == NULL ||
+      mFlashNumDataBytes < sizeof (batch_header_t)) {
+    FastbootFail ("No batch to flash");
+    return;
+  }
+
+  /* Images queued before the batch are written first */
+  WaitForFlashFinished ();
+
+  Header = (batch_header_t *)mFlashDataBuffer;
+  Count = Header->entry_count;
+  DataStart = Header->header_sz + (UINT64)Count * Header->entry_sz;
+  if (Header->magic != BATCH_HEADER_MAGIC ||
+      Header->major_version > BATCH_MAJOR_VERSION ||
+      Header->header_sz < sizeof (batch_header_t) ||
+      Header->entry_sz < sizeof (batch_entry_t) ||
+      !Count ||
+      Count > MAX_IMAGES_IN_BATCH ||
+      DataStart > mFlashNumDataBytes) {
+    FastbootFail ("Invalid batch header");
+    return;
+  }
+
+  Jobs = AllocateZeroPool (Count * sizeof (FlashInfo));
+  if (!Jobs) {
+    FastbootFail ("Failed to allocate memory for the batch");
+    return;
+  }
+
+  for (i = 0; i < Count; i++) {
+    if (!FlashBatchEntry ((batch_entry_t *)(mFlashDataBuffer +
+                                            Header->header_sz +
+                                            i * Header->entry_sz),
+                          mFlashDataBuffer, mFlashNumDataBytes, DataStart,
+                          &Jobs[i])) {
+      goto out;
+    }
+
+    for (j = 0; j < i; j++) {
+      if (!StrCmp (Jobs[i].PartitionName, Jobs[j].PartitionName)) {
+        AsciiSPrint (Resp, MAX_RSP_SIZE, "%s is flashed twice in the batch",
+                     Jobs[i].PartitionName);
+        FastbootFail (Resp);
+        goto out;
+      }
+    }
+
+    TotalBytes += Jobs[i].FlashNumDataBytes;
+    if (!(LunMask & (1 << Jobs[i].Lun))) {
+      LunMask |= 1 << Jobs[i].Lun;
+      LunCount++;
+    }
+    if (!StrnCmp (Jobs[i].PartitionName, L"system", StrLen (L"system"))) {
+      SystemFlashed = TRUE;
+    }
+  }
+
+  if (IsVirtualAbOtaSupported ()) {
+    for (i = 0; i < Count; i++) {
+      if (!CancelSnapshotMergeForSuper (Jobs[i].PartitionName)) {
+        goto out;
+      }
+    }
+  }
+
+  AsciiSPrint (Resp, MAX_RSP_SIZE, "Flashing %d images, %lld KB on %d LUNs",
+               Count, TotalBytes / 1024, LunCount);
+  FastbootInfo (Resp);
+  WaitForTransferComplete ();
+
+  Status = FlashMetaImages (Jobs, Count);
+  Status = VerifyFlashReport (Status);
+  if (EFI_ERROR (Status)) {
+    AsciiSPrint (Resp, MAX_RSP_SIZE, "%a : %r", "Error flashing batch", Status);
+    DEBUG ((EFI_D_ERROR, "%a\n", Resp));
+    FastbootFail (Resp);
+    goto out;
+  }
+
+  if (SystemFlashed &&
+      !IsEnforcing ()) {
+    // reset dm_verity mode to enforcing
+    Status = EnableEnforcingMode (TRUE);
+    if (Status != EFI_SUCCESS) {
+      DEBUG ((EFI_D_ERROR, "failed to update verity mode:  %r\n", Status));
+    }
+  }
+  FastbootOkay ("");
+
+out:
+  FreePool (Jobs);
+  Jobs = NULL;
+}
+
+/* "oem verify-after-flash [on|off]" turns read-back verification of the
+ * images flashed afterwards on or off. Regions that do not read back as
+ * written are listed before the result of the flash command.
+ */
+STATIC VOID
+CmdOemVerifyAfterFlash (IN CONST CHAR8 *Arg, IN VOID *Data, IN UINT32 Size)
+{
+  STATIC CONST UINT8 EmptySha256[AVB_SHA256_DIGEST_SIZE] = {
+    0xe3, 0xb0, 0xc4, 0x42, 0x98, 0xfc, 0x1c, 0x14,
+    0x9a, 0xfb, 0xf4, 0xc8, 0x99, 0x6f, 0xb9, 0x24,
+    0x27, 0xae, 0x41, 0xe4, 0x64, 0x9b, 0x93, 0x4c,
+    0xa4, 0x95, 0x99, 0x1b, 0x78, 0x52, 0xb8, 0x55,
+  };
+  EFI_STATUS Status;
+  UINT8 Digest[AVB_SHA256_DIGEST_SIZE];
+
+  while (*Arg == ' ') {
+    Arg++;
+  }
+
+  /* Images already queued are written with the previous setting */
+  WaitForFlashFinished ();
+
+  if (!AsciiStrCmp (Arg, "off")) {
+    VerifyFlashWait ();
+    VerifyAfterFlash = FALSE;
+    FastbootOkay ("");
+    return;
+  }
+
+  if (*Arg != '\0' &&
+      AsciiStrCmp (Arg, "on")) {
+    FastbootFail ("Enter fastboot oem verify-after-flash [on|off]");
+    return;
+  }
+
+  /* SHA-256 of no data */
+  if (VerifyDigest (NULL, 0, Digest) != EFI_SUCCESS ||
+      CompareMem (Digest, EmptySha256, sizeof (Digest))) {
+    FastbootFail ("SHA-256 is not available");
+    return;
+  }
+
+  if (!VerifyReadBuf) {
+    VerifyReadBuf = AllocatePages (EFI_SIZE_TO_PAGES (VERIFY_REGION_SIZE));
+    if (!VerifyReadBuf) {
+      FastbootFail ("Failed to allocate the verify buffer");
+      return;
+    }
+  }
+
+  if (IsUseMThreadParallel () &&
+      !VerifyWorker) {
+    /* The flash workers must not verify on their own, they would share
+     * the read buffer.
+     */
+    Status = VerifyWorkerStart ();
+    if (EFI_ERROR (Status)) {
+      DEBUG ((EFI_D_ERROR, "Failed to start verify worker: %r\n", Status));
+      FastbootFail ("Failed to start the verify worker");
+      return;
+    }
+  }
+
+  VerifyResultsLock (TRUE);
+  VerifyRegions = 0;
+  VerifyBytes = 0;
+  VerifyFailures = 0;
+  VerifyResultsLock (FALSE);
+  VerifyAfterFlash = TRUE;
+  FastbootOkay ("");
+}
+
+/* "oem sparse-stream <partition>" arms streaming of the following sparse
+ * downloads: chunks are written to <partition> while the data is still
+ * arriving and the "flash:<partition>" command that follows each download
+ * only reports the result. "oem sparse-stream" without a partition disarms.
+ */
+STATIC VOID
+CmdOemSparseStream (IN CONST CHAR8 *Arg, IN VOID *Data, IN UINT32 Size)
+{
+  CHAR16 PartitionName[MAX_GPT_NAME_SIZE];
+  CHAR16 SlotSuffix[MAX_SLOT_SUFFIX_SZ];
+  CHAR8 Resp[MAX_RSP_SIZE];
+  EFI_BLOCK_IO_PROTOCOL *BlockIo = NULL;
+  EFI_HANDLE *Handle = NULL;
+  EFI_STATUS Status;
+
+  while (*Arg == ' ') {
+    Arg++;
+  }
+
+  SparseStream.Armed = FALSE;
+  SparseStream.Active = FALSE;
+  SparseStream.Done = FALSE;
+
+  if (*Arg == '\0') {
+    FastbootOkay ("");
+    return;
+  }
+
+  if (AsciiStrLen (Arg) >= MAX_GPT_NAME_SIZE) {
+    FastbootFail ("Invalid partition name");
+    return;
+  }
+  AsciiStrToUnicodeStr (Arg, PartitionName);
+
+  if (!FlashAllowedInLockState (PartitionName)) {
+    return;
+  }
+
+  if (IsVirtualAbOtaSupported () &&
+      CheckVirtualAbCriticalPartition (PartitionName)) {
+    AsciiSPrint (Resp, MAX_RSP_SIZE, "Flashing of %s is not allowed in %a state",
+                 PartitionName, SnapshotMergeState);
+    FastbootFail (Resp);
+    return;
+  }
+
+  if (PartitionHasMultiSlot ((CONST CHAR16 *)L"boot")) {
+    GetPartitionHasSlot (PartitionName, ARRAY_SIZE (PartitionName),
+                         SlotSuffix, MAX_SLOT_SUFFIX_SZ);
+  }
+
+  Status = PartitionGetInfo (PartitionName, &BlockIo, &Handle);
+  if (EFI_ERROR (Status)) {
+    FastbootFail ("Partition not found");
+    return;
+  }
+
+  AsciiStrnCpyS (SparseStream.Target, sizeof (SparseStream.Target), Arg,
+                 AsciiStrLen (Arg));
+  StrnCpyS (SparseStream.PartitionName, ARRAY_SIZE (SparseStream.PartitionName),
+            PartitionName, StrLen (PartitionName));
+  SparseStream.Armed = TRUE;
+
+  DEBUG ((EFI_D_INFO, "Sparse images will be streamed to %s\n",
+          PartitionName));
+  FastbootOkay ("");
+}
+
 STATIC VOID
 CmdErase (IN CONST CHAR8 *arg, IN VOID *data, IN UINT32 sz)
 {
@@ -1964,7 +4026,6 @@ CmdErase (IN CONST CHAR8 *arg, IN VOID *data, IN UINT32 sz)
   BOOLEAN MultiSlotBoot = PartitionHasMultiSlot (L"boot");
   CHAR16 PartitionName[MAX_GPT_NAME_SIZE];
   CHAR8 EraseResultStr[MAX_RSP_SIZE] = "";
-  VirtualAbMergeStatus SnapshotMergeStatus;
 
   WaitForFlashFinished ();
 
@@ -1998,21 +4059,8 @@ CmdErase (IN CONST CHAR8 *arg, IN VOID *data, IN UINT32 sz)
       return;
     }
 
-    SnapshotMergeStatus = GetSnapshotMergeStatus ();
-    if (((SnapshotMergeStatus == MERGING) ||
-          (SnapshotMergeStatus == SNAPSHOTTED)) &&
-          !StrnCmp (PartitionName, L"super", StrLen (L"super"))) {
-
-      Status = SetSnapshotMergeStatus (CANCELLED);
-      if (Status != EFI_SUCCESS) {
-        FastbootFail ("Failed to update snapshot state to cancel");
-        return;
-      }
-
-      //updating fbvar snapshot-merge-state
-      AsciiSPrint (SnapshotMergeState,
-                    AsciiStrLen (VabSnapshotMergeStatus[NONE_MERGE_STATUS]) + 1,
-                    "%a", VabSnapshotMergeStatus[NONE_MERGE_STATUS]);
+    if (!CancelSnapshotMergeForSuper (PartitionName)) {
+      return;
     }
   }
 
@@ -2211,12 +4259,33 @@ STATIC EFI_STATUS FastbootOkayDelay (VOID)
   return Status;
 }
 
+/* Leave the data phase of a download that cannot complete */
+STATIC VOID
+DownloadAbort (VOID)
+{
+  DloadLz4Stop ();
+  mState = ExpectCmdState;
+#ifdef ENABLE_UPDATE_PARTITIONS_CMDS
+  if (SparseStream.Active) {
+    SparseStreamStop (EFI_ABORTED);
+  }
+#endif
+  if (IsUseMThreadParallel ()) {
+    KernIntf->Lock->ReleaseLock (LockDownload);
+  } else {
+    StopUsbTimer ();
+  }
+}
+
 STATIC VOID
 AcceptData (IN UINT64 Size, IN VOID *Data)
 {
   UINT64 RemainingBytes = mNumDataBytes - mBytesReceivedSoFar;
   UINT32 PageSize = 0;
   UINT32 RoundSize = 0;
+  UINT8 *Image = Data;
+  UINT64 Available;
+  UINT64 DecodeUs;
 
   /* Protocol doesn't say anything about sending extra data so just ignore it.*/
   if (Size > RemainingBytes) {
@@ -2231,6 +4300,28 @@ AcceptData (IN UINT64 Size, IN VOID *Data)
   if (mBytesReceivedSoFar == mNumDataBytes) {
     /* Download Finished */
     DEBUG ((EFI_D_INFO, "Download Finished\n"));
+
+    if (DloadLz4Active) {
+      Available = DloadLz4Feed (mBytesReceivedSoFar, TRUE);
+      DloadLz4Stop ();
+
+      DecodeUs = DivU64x32 (GetTimeInNanoSecond (DloadLz4Ticks), 1000);
+      DEBUG ((EFI_D_INFO, "Compressed download: %lld -> %lld bytes, "
+                          "decoded in %lld us (%lld MB/s)\n",
+              mBytesReceivedSoFar, Available, DecodeUs,
+              DecodeUs ? Available / DecodeUs : 0));
+
+      /* The image is at the start of the buffer as for a plain download */
+      mNumDataBytes = EFI_ERROR (DloadLz4Result) ? 0 : Available;
+      mBytesReceivedSoFar = mNumDataBytes;
+      Data = mUsbDataBuffer;
+      if (!mNumDataBytes) {
+        DownloadAbort ();
+        FastbootFail ("Failed to decode the compressed download");
+        return;
+      }
+    }
+
     /* Zero initialized the surplus data buffer. It's risky to access the data
      * buffer which it's not zero initialized, its content might leak
      */
@@ -2242,6 +4333,10 @@ AcceptData (IN UINT64 Size, IN VOID *Data)
     }
     mState = ExpectCmdState;
 
+#ifdef ENABLE_UPDATE_PARTITIONS_CMDS
+    SparseStreamFeed (Data, mBytesReceivedSoFar, TRUE);
+#endif
+
     if (IsUseMThreadParallel ())  {
       KernIntf->Lock->ReleaseLock (LockDownload);
       FastbootOkay ("");
@@ -2255,6 +4350,19 @@ AcceptData (IN UINT64 Size, IN VOID *Data)
     GetFastbootDeviceData ()->UsbDeviceProtocol->Send (
         ENDPOINT_IN, GetXfrSize (), (Data + mBytesReceivedSoFar));
     DEBUG ((EFI_D_VERBOSE, "AcceptData: Send %d\n", GetXfrSize ()));
+
+    /* Next transfer is queued, decode and write what has been received
+     * meanwhile.
+     */
+    Available = mBytesReceivedSoFar;
+    if (DloadLz4Active) {
+      Available = DloadLz4Feed (mBytesReceivedSoFar, FALSE);
+      Image = mUsbDataBuffer;
+    }
+
+#ifdef ENABLE_UPDATE_PARTITIONS_CMDS
+    SparseStreamFeed (Image, Available, FALSE);
+#endif
   }
 }
 
@@ -2394,8 +4502,7 @@ VOID WaitForFlashFinished (VOID)
 {
   if (!IsFlashComplete &&
     IsUseMThreadParallel ()) {
-    KernIntf->Lock->AcquireLock (LockFlash);
-    KernIntf->Lock->ReleaseLock (LockFlash);
+    KernIntf->Event->EventWait (FlashIdle);
   }
 }
 
@@ -2437,9 +4544,18 @@ VOID InitMultiThreadEnv ()
      return;
   }
 
-  KernIntf->Lock->InitLock ("FLASH", &LockFlash);
-  if (&LockFlash == NULL) {
-    DEBUG ((EFI_D_ERROR, "InitLock LockFlash error \n"));
+  Status = KernIntf->Lock->InitLock ("FLASHQUEUE", &LockQueue);
+  if (Status != EFI_SUCCESS ||
+      LockQueue == NULL) {
+    DEBUG ((EFI_D_ERROR, "InitLock LockQueue error \n"));
+    KernIntf->Lock->DestroyLock (LockDownload);
+    return;
+  }
+
+  FlashIdle = KernIntf->Event->EventInit (0, TRUE, 0);
+  if (FlashIdle == NULL) {
+    DEBUG ((EFI_D_ERROR, "EventInit FlashIdle error \n"));
+    KernIntf->Lock->DestroyLock (LockQueue);
     KernIntf->Lock->DestroyLock (LockDownload);
     return;
   }
@@ -2457,6 +4573,7 @@ FastbootCmdsInit (VOID)
   EFI_STATUS Status;
   EFI_EVENT mFatalSendErrorEvent;
   CHAR8 *FastBootBuffer;
+  UINT32 FlashBufNumber;
 
   mDataBuffer = NULL;
   mUsbDataBuffer = NULL;
@@ -2464,6 +4581,9 @@ FastbootCmdsInit (VOID)
 
   DEBUG ((EFI_D_INFO, "Fastboot: Initializing...\n"));
 
+  /* Sparse CRC chunks may be checked by several flash threads at once */
+  avb_crc32_init ();
+
   /* Disable watchdog */
   Status = gBS->SetWatchdogTimer (0, 0x10000, 0, NULL);
   if (EFI_ERROR (Status)) {
@@ -2519,12 +4639,18 @@ FastbootCmdsInit (VOID)
   DEBUG ((EFI_D_VERBOSE,
                   "Fastboot Buffer Size allocated: %ld\n", MaxDownLoadSize));
 
-  MaxDownLoadSize = (CheckRootDeviceType () == NAND) ?
-                              MaxDownLoadSize : MaxDownLoadSize / 2;
+  InitMultiThreadEnv ();
+
+  FlashBufNumber = FlashBufNum (MaxDownLoadSize);
+  MaxDownLoadSize = (MaxDownLoadSize / FlashBufNumber) & ~(UINT64)EFI_PAGE_MASK;
 
   FastbootCommandSetup ((VOID *)FastBootBuffer, MaxDownLoadSize);
 
-  InitMultiThreadEnv ();
+  Status = FlashBufInit ((UINT8 *)FastBootBuffer, MaxDownLoadSize,
+                         FlashBufNumber);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
 
   return EFI_SUCCESS;
 }
@@ -3256,6 +5382,61 @@ CmdOemDevinfo (CONST CHAR8 *arg, VOID *data, UINT32 sz)
   FastbootOkay ("");
 }
 
+/* "oem boot-trace" dumps the spans recorded by the boot trace of this run,
+ * one line per span with its start and duration in microseconds.
+ * "oem boot-trace previous" dumps the trace saved by the last boot that
+ * started a kernel, on platforms that keep one over warm resets by setting
+ * BootTracePersistBase and BootTracePersistSize in their DSC.
+ */
+STATIC VOID
+CmdOemBootTrace (CONST CHAR8 *Arg, VOID *Data, UINT32 Size)
+{
+  CHAR8 TraceInfo[MAX_RSP_SIZE];
+  BOOT_TRACE_EVENT *Events;
+  BOOLEAN Previous = FALSE;
+  UINT32 Count;
+  UINT32 Index;
+
+  while (*Arg == ' ') {
+    Arg++;
+  }
+  if (!AsciiStrCmp (Arg, "previous")) {
+    Previous = TRUE;
+  } else if (*Arg != '\0') {
+    FastbootFail ("Enter fastboot oem boot-trace [previous]");
+    return;
+  }
+  if (Previous &&
+      !BootTraceKeepsPrevious ()) {
+    FastbootFail ("Boot trace is not kept over resets on this platform");
+    return;
+  }
+
+  Events = AllocateZeroPool (BOOT_TRACE_MAX_EVENTS * sizeof (*Events));
+  if (Events == NULL) {
+    FastbootFail ("Failed to allocate boot trace buffer");
+    return;
+  }
+
+  if (Previous) {
+    Count = BootTracePrevious (Events, BOOT_TRACE_MAX_EVENTS);
+  } else {
+    Count = BootTraceSnapshot (Events, BOOT_TRACE_MAX_EVENTS);
+  }
+  for (Index = 0; Index < Count; Index++) {
+    AsciiSPrint (TraceInfo, sizeof (TraceInfo), "%a: start %lu us, %lu us, "
+                 "%lu bytes", BootTraceName (Events[Index].Id),
+                 Events[Index].StartUs, Events[Index].DurationUs,
+                 Events[Index].Bytes);
+    FastbootInfo (TraceInfo);
+    WaitForTransferComplete ();
+  }
+  FreePool (Events);
+
+  AsciiSPrint (TraceInfo, sizeof (TraceInfo), "%u spans", Count);
+  FastbootOkay (TraceInfo);
+}
+
 STATIC EFI_STATUS
 AcceptCmdTimerInit (IN UINT64 Size, IN CHAR8 *Data)
 {
@@ -3674,9 +5855,13 @@ FastbootCommandSetup (IN VOID *Base, IN UINT64 Size)
  */
 #ifdef ENABLE_UPDATE_PARTITIONS_CMDS
       {"flash:", CmdFlash},
+      {"flash-batch", CmdFlashBatch},
       {"erase:", CmdErase},
       {"set_active", CmdSetActive},
       {"flashing get_unlock_ability", CmdFlashingGetUnlockAbility},
+      {"oem sparse-stream", CmdOemSparseStream},
+      {"oem verify-after-flash", CmdOemVerifyAfterFlash},
+      {"fetch:", CmdFetch},
 #endif
 /*
  *CAUTION(CRITICAL): Enabling these commands will allow changes to bootimage.
@@ -3697,6 +5882,7 @@ FastbootCommandSetup (IN VOID *Base, IN UINT64 Size)
       {"oem off-mode-charge", CmdOemOffModeCharger},
       {"oem select-display-panel", CmdOemSelectDisplayPanel},
       {"oem device-info", CmdOemDevinfo},
+      {"oem boot-trace", CmdOemBootTrace},
       {"continue", CmdContinue},
       {"reboot", CmdReboot},
 #ifdef DYNAMIC_PARTITION_SUPPORT
@@ -3709,6 +5895,7 @@ FastbootCommandSetup (IN VOID *Base, IN UINT64 Size)
       {"reboot-bootloader", CmdRebootBootloader},
       {"getvar:", CmdGetVar},
       {"download:", CmdDownload},
+      {"oem download-compression", CmdOemDownloadCompression},
       {"oem display-cmdline", CmdOemDisplayCommandLine},
   };
 
@@ -3723,6 +5910,12 @@ FastbootCommandSetup (IN VOID *Base, IN UINT64 Size)
   AsciiSPrint (MaxDownloadSizeStr,
                   sizeof (MaxDownloadSizeStr), "%ld", MaxDownLoadSize);
   FastbootPublishVar ("max-download-size", MaxDownloadSizeStr);
+  FastbootPublishVar ("download-compression", "lz4");
+#ifdef ENABLE_UPDATE_PARTITIONS_CMDS
+  AsciiSPrint (MaxFetchSizeStr, sizeof (MaxFetchSizeStr), "%ld",
+               (UINT64)MAX_FETCH_SIZE);
+  FastbootPublishVar ("max-fetch-size", MaxFetchSizeStr);
+#endif
 
   if (IsDynamicPartitionSupport ()) {
     FastbootPublishVar ("is-userspace", "no");
@@ -3830,9 +6023,28 @@ FastbootCommandSetup (IN VOID *Base, IN UINT64 Size)
 
 VOID *FastbootDloadBuffer (VOID)
 {
+  /* A compressed download is received behind its decoded image */
+  if (DloadLz4Active) {
+    return (VOID *)DloadLz4In;
+  }
+
   return (VOID *)mUsbDataBuffer;
 }
 
+/* The USB transfer of the download was cancelled, the host starts over
+ * with a command.
+ */
+VOID FastbootDownloadCancelled (VOID)
+{
+  if (mState != ExpectDataState) {
+    return;
+  }
+
+  DEBUG ((EFI_D_ERROR, "Download aborted after %lld of %lld bytes\n",
+          mBytesReceivedSoFar, mNumDataBytes));
+  DownloadAbort ();
+}
+
 ANDROID_FASTBOOT_STATE FastbootCurrentState (VOID)
 {
   return mState;
@@ -44,6 +44,11 @@
 #define ENDPOINT_OUT 0x81
 
 #define MAX_WRITE_SIZE (1024 * 1024)
+#define VERIFY_REGION_SIZE (4 * 1024 * 1024)
+#define FETCH_BUFFER_SIZE (4 * 1024 * 1024)
+#define MAX_FETCH_SIZE (1024 * 1024 * 1024)
+#define VERIFY_QUEUE_DEPTH 8
+#define MAX_VERIFY_REPORTS 8
 #define MAX_RSP_SIZE 64
 #define ERASE_BUFF_SIZE 256 * 1024
 #define ERASE_BUFF_BLOCKS 256 * 2
@@ -167,6 +172,7 @@ BOOLEAN FastbootFatal (VOID);
 VOID PartitionDump (VOID);
 
 VOID *FastbootDloadBuffer (VOID);
+VOID FastbootDownloadCancelled (VOID);
 
 ANDROID_FASTBOOT_STATE FastbootCurrentState (VOID);
 
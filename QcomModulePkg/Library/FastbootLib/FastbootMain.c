@@ -263,6 +263,7 @@ ProcessBulkXfrCompleteRx (IN USB_DEVICE_TRANSFER_OUTCOME *Uto)
   case UsbDeviceTransferStatusCancelled:
     // if usb connected, retry, otherwise wait to get connected, then retry
     DEBUG ((EFI_D_ERROR, "Bulk in XFR aborted\n"));
+    FastbootDownloadCancelled ();
     Status = EFI_ABORTED;
     break;
 
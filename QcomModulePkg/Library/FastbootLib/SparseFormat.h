@@ -52,6 +52,13 @@ typedef struct chunk_header {
  *  For a Fill chunk, it's 4 bytes of the fill data.
  */
 
+/* Whether EraseBlocks leaves zeros behind on the device being written */
+typedef enum {
+  ERASE_ZERO_UNKNOWN,
+  ERASE_ZERO_YES,
+  ERASE_ZERO_NO,
+} EraseZeroState;
+
 typedef struct SparseImgParams {
   UINT32 Chunk;
   UINT32 TotalBlocks;
@@ -60,6 +67,47 @@ typedef struct SparseImgParams {
   UINT64 WrittenBlockCount;
   UINT64 BlockCountFactor;
   UINT64 PartitionSize;
+  CHAR16 *PartitionName;
   EFI_BLOCK_IO_PROTOCOL *BlockIo;
   EFI_HANDLE *Handle;
+  /* FILL chunks are merged into one run until a different chunk follows */
+  BOOLEAN FillPending;
+  UINT32 FillVal;
+  UINT32 FillStartBlock;
+  UINT32 FillBlocks;
+  /* MAX_WRITE_SIZE buffer holding FillPatternVal, FILL runs are written
+   * from it in large pieces instead of one sparse block at a time.
+   */
+  UINT32 *FillPattern;
+  UINT32 FillPatternVal;
+  /* Probed on the first zero FILL run of the image */
+  EraseZeroState EraseZero;
+  /* Write statistics of the image */
+  UINT64 WriteCalls;
+  UINT64 WriteBytes;
+  UINT64 EraseBytes;
+  /* Running CRC32 of the image data, checked against CHUNK_TYPE_CRC */
+  UINT32 Crc32;
+  UINT64 CrcBytes;
+  UINT64 CrcTicks;
 } SparseImgParam;
+
+/* State of a sparse image that is decoded and written while it is still
+ * being downloaded. Cursor is the offset in the download buffer up to which
+ * the image has been consumed.
+ */
+typedef struct SparseStreamParams {
+  BOOLEAN Armed;
+  BOOLEAN Active;
+  BOOLEAN Done;
+  BOOLEAN HeaderParsed;
+  BOOLEAN InChunk;
+  EFI_STATUS Result;
+  CHAR8 Target[MAX_GPT_NAME_SIZE];
+  CHAR16 PartitionName[MAX_GPT_NAME_SIZE];
+  UINT64 Cursor;
+  UINT64 ChunkDataLeft;
+  sparse_header_t SparseHeader;
+  chunk_header_t ChunkHeader;
+  SparseImgParam SparseImgData;
+} SparseStreamParam;
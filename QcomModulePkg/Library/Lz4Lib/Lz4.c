@@ -0,0 +1,580 @@
+/* Copyright (c) 2021, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/Lz4Lib.h>
+
+#define LZ4_MIN_MATCH 4
+#define LZ4_RUN_MASK 15
+
+#define LZ4_FLG_VERSION_MASK 0xC0
+#define LZ4_FLG_VERSION 0x40
+#define LZ4_FLG_BLOCK_CHECKSUM BIT4
+#define LZ4_FLG_CONTENT_SIZE BIT3
+#define LZ4_FLG_CONTENT_CHECKSUM BIT2
+#define LZ4_FLG_RESERVED BIT1
+#define LZ4_FLG_DICT_ID BIT0
+#define LZ4_BD_MAX_SIZE(Bd) (((Bd) >> 4) & 0x7)
+#define LZ4_BLOCK_UNCOMPRESSED BIT31
+
+#define XXH_PRIME32_1 0x9E3779B1U
+#define XXH_PRIME32_2 0x85EBCA77U
+#define XXH_PRIME32_3 0xC2B2AE3DU
+#define XXH_PRIME32_4 0x27D4EB2FU
+#define XXH_PRIME32_5 0x165667B1U
+
+STATIC UINT32
+Xxh32Round (IN UINT32 Acc, IN UINT32 Input)
+{
+  Acc += Input * XXH_PRIME32_2;
+  Acc = (Acc << 13) | (Acc >> 19);
+  return Acc * XXH_PRIME32_1;
+}
+
+STATIC UINT32
+Xxh32Rotl (IN UINT32 Value, IN UINT32 Count)
+{
+  return (Value << Count) | (Value >> (32 - Count));
+}
+
+VOID
+Lz4Xxh32Init (OUT LZ4_XXH32_STATE *State, IN UINT32 Seed)
+{
+  ZeroMem (State, sizeof (*State));
+  State->Seed = Seed;
+  State->V[0] = Seed + XXH_PRIME32_1 + XXH_PRIME32_2;
+  State->V[1] = Seed + XXH_PRIME32_2;
+  State->V[2] = Seed;
+  State->V[3] = Seed - XXH_PRIME32_1;
+}
+
+STATIC VOID
+Xxh32Stripe (IN OUT LZ4_XXH32_STATE *State, IN CONST UINT8 *Data)
+{
+  State->V[0] = Xxh32Round (State->V[0], ReadUnaligned32 ((UINT32 *)Data));
+  State->V[1] = Xxh32Round (State->V[1],
+                            ReadUnaligned32 ((UINT32 *)(Data + 4)));
+  State->V[2] = Xxh32Round (State->V[2],
+                            ReadUnaligned32 ((UINT32 *)(Data + 8)));
+  State->V[3] = Xxh32Round (State->V[3],
+                            ReadUnaligned32 ((UINT32 *)(Data + 12)));
+}
+
+VOID
+Lz4Xxh32Update (IN OUT LZ4_XXH32_STATE *State,
+                IN CONST UINT8 *Data,
+                IN UINTN Size)
+{
+  UINTN Fill;
+
+  State->TotalLen += Size;
+
+  if (State->MemSize) {
+    Fill = MIN (Size, sizeof (State->Mem) - State->MemSize);
+    CopyMem (State->Mem + State->MemSize, Data, Fill);
+    State->MemSize += Fill;
+    Data += Fill;
+    Size -= Fill;
+    if (State->MemSize < sizeof (State->Mem)) {
+      return;
+    }
+    Xxh32Stripe (State, State->Mem);
+    State->MemSize = 0;
+  }
+
+  while (Size >= sizeof (State->Mem)) {
+    Xxh32Stripe (State, Data);
+    Data += sizeof (State->Mem);
+    Size -= sizeof (State->Mem);
+  }
+
+  if (Size) {
+    CopyMem (State->Mem, Data, Size);
+    State->MemSize = Size;
+  }
+}
+
+UINT32
+Lz4Xxh32Final (IN LZ4_XXH32_STATE *State)
+{
+  CONST UINT8 *Data = State->Mem;
+  UINT32 Left = State->MemSize;
+  UINT32 Hash;
+
+  if (State->TotalLen >= sizeof (State->Mem)) {
+    Hash = Xxh32Rotl (State->V[0], 1) + Xxh32Rotl (State->V[1], 7) +
+           Xxh32Rotl (State->V[2], 12) + Xxh32Rotl (State->V[3], 18);
+  } else {
+    Hash = State->Seed + XXH_PRIME32_5;
+  }
+  Hash += (UINT32)State->TotalLen;
+
+  while (Left >= 4) {
+    Hash += ReadUnaligned32 ((UINT32 *)Data) * XXH_PRIME32_3;
+    Hash = Xxh32Rotl (Hash, 17) * XXH_PRIME32_4;
+    Data += 4;
+    Left -= 4;
+  }
+  while (Left) {
+    Hash += (*Data) * XXH_PRIME32_5;
+    Hash = Xxh32Rotl (Hash, 11) * XXH_PRIME32_1;
+    Data++;
+    Left--;
+  }
+
+  Hash ^= Hash >> 15;
+  Hash *= XXH_PRIME32_2;
+  Hash ^= Hash >> 13;
+  Hash *= XXH_PRIME32_3;
+  Hash ^= Hash >> 16;
+  return Hash;
+}
+
+STATIC UINT32
+Xxh32 (IN CONST UINT8 *Data, IN UINTN Size)
+{
+  LZ4_XXH32_STATE State;
+
+  Lz4Xxh32Init (&State, 0);
+  Lz4Xxh32Update (&State, Data, Size);
+  return Lz4Xxh32Final (&State);
+}
+
+/* Copy up to 16 bytes with two unaligned 8 byte moves when both buffers
+ * have room for them, the bytes past Length are rewritten later.
+ */
+STATIC VOID
+Lz4Copy (OUT UINT8 *Dst,
+         IN UINTN DstRoom,
+         IN CONST UINT8 *Src,
+         IN UINTN SrcRoom,
+         IN UINTN Length)
+{
+  if (Length <= 16 &&
+      DstRoom >= 16 &&
+      SrcRoom >= 16) {
+    WriteUnaligned64 ((UINT64 *)Dst, ReadUnaligned64 ((UINT64 *)Src));
+    WriteUnaligned64 ((UINT64 *)(Dst + 8),
+                      ReadUnaligned64 ((UINT64 *)(Src + 8)));
+    return;
+  }
+  CopyMem (Dst, Src, Length);
+}
+
+/* Read the extra length bytes that follow a run of 15 */
+STATIC BOOLEAN
+Lz4ReadLength (IN OUT CONST UINT8 **Ip,
+               IN CONST UINT8 *IEnd,
+               IN OUT UINTN *Length)
+{
+  UINT8 Byte;
+
+  do {
+    if (*Ip >= IEnd) {
+      return FALSE;
+    }
+    Byte = *(*Ip)++;
+    *Length += Byte;
+  } while (Byte == 255);
+
+  return TRUE;
+}
+
+EFI_STATUS
+Lz4DecompressBlock (IN CONST UINT8 *Src,
+                    IN UINTN SrcSize,
+                    IN OUT UINT8 *Dst,
+                    IN UINTN DstSize,
+                    IN OUT UINTN *DstPos)
+{
+  CONST UINT8 *Ip = Src;
+  CONST UINT8 *IEnd = Src + SrcSize;
+  UINT8 *Op = Dst + *DstPos;
+  UINT8 *OEnd = Dst + DstSize;
+  UINT8 *Match;
+  UINTN Token;
+  UINTN Length;
+  UINTN Offset;
+  UINTN Copy;
+
+  while (Ip < IEnd) {
+    Token = *Ip++;
+
+    /* Literals */
+    Length = Token >> 4;
+    if (Length == LZ4_RUN_MASK &&
+        !Lz4ReadLength (&Ip, IEnd, &Length)) {
+      return EFI_VOLUME_CORRUPTED;
+    }
+    if (Length > (UINTN)(IEnd - Ip)) {
+      return EFI_VOLUME_CORRUPTED;
+    }
+    if (Length > (UINTN)(OEnd - Op)) {
+      return EFI_BUFFER_TOO_SMALL;
+    }
+    Lz4Copy (Op, OEnd - Op, Ip, IEnd - Ip, Length);
+    Ip += Length;
+    Op += Length;
+
+    /* The last sequence has literals only */
+    if (Ip == IEnd) {
+      break;
+    }
+
+    /* Match */
+    if (IEnd - Ip < 2) {
+      return EFI_VOLUME_CORRUPTED;
+    }
+    Offset = Ip[0] | (Ip[1] << 8);
+    Ip += 2;
+    if (!Offset ||
+        Offset > (UINTN)(Op - Dst)) {
+      return EFI_VOLUME_CORRUPTED;
+    }
+
+    Length = Token & LZ4_RUN_MASK;
+    if (Length == LZ4_RUN_MASK &&
+        !Lz4ReadLength (&Ip, IEnd, &Length)) {
+      return EFI_VOLUME_CORRUPTED;
+    }
+    Length += LZ4_MIN_MATCH;
+    if (Length > (UINTN)(OEnd - Op)) {
+      return EFI_BUFFER_TOO_SMALL;
+    }
+
+    Match = Op - Offset;
+    if (Offset >= 16 &&
+        Length <= 16) {
+      Lz4Copy (Op, OEnd - Op, Match, OEnd - Match, Length);
+      Op += Length;
+    } else if (Offset >= Length) {
+      CopyMem (Op, Match, Length);
+      Op += Length;
+    } else if (Offset == 1) {
+      SetMem (Op, Length, *Match);
+      Op += Length;
+    } else {
+      /* Overlapping match: Match..Op repeats with a period of Offset, so
+       * it can be copied as a whole, doubling the distance each time.
+       */
+      while (Length) {
+        Copy = MIN (Length, (UINTN)(Op - Match));
+        CopyMem (Op, Match, Copy);
+        Op += Copy;
+        Length -= Copy;
+      }
+    }
+  }
+
+  *DstPos = Op - Dst;
+  return EFI_SUCCESS;
+}
+
+BOOLEAN
+IsLz4Frame (IN CONST VOID *Buffer, IN UINTN Size)
+{
+  UINT32 Magic;
+
+  if (Size < sizeof (Magic)) {
+    return FALSE;
+  }
+
+  Magic = ReadUnaligned32 ((UINT32 *)Buffer);
+  return Magic == LZ4_FRAME_MAGIC || Magic == LZ4_LEGACY_MAGIC;
+}
+
+VOID
+Lz4FrameInit (OUT LZ4_FRAME_DECODER *Decoder)
+{
+  ZeroMem (Decoder, sizeof (*Decoder));
+  Decoder->Stage = Lz4StageMagic;
+  Lz4Xxh32Init (&Decoder->Xxh, 0);
+}
+
+STATIC EFI_STATUS
+Lz4FrameHeader (IN OUT LZ4_FRAME_DECODER *Decoder,
+                IN CONST UINT8 *Header,
+                IN UINTN Avail,
+                OUT UINTN *Used)
+{
+  UINT8 Flg;
+  UINT8 Bd;
+  UINTN Size = 3;
+
+  if (Avail < 2) {
+    return EFI_NOT_READY;
+  }
+
+  Flg = Header[0];
+  Bd = Header[1];
+  if ((Flg & LZ4_FLG_VERSION_MASK) != LZ4_FLG_VERSION ||
+      (Flg & LZ4_FLG_RESERVED) ||
+      (Bd & 0x8F) ||
+      LZ4_BD_MAX_SIZE (Bd) < 4) {
+    DEBUG ((EFI_D_ERROR, "Unsupported LZ4 frame header %x %x\n", Flg, Bd));
+    return EFI_VOLUME_CORRUPTED;
+  }
+
+  /* Frames of a preset dictionary are not produced for images */
+  if (Flg & LZ4_FLG_DICT_ID) {
+    DEBUG ((EFI_D_ERROR, "LZ4 frames with a dictionary are not supported\n"));
+    return EFI_UNSUPPORTED;
+  }
+
+  if (Flg & LZ4_FLG_CONTENT_SIZE) {
+    Size += sizeof (UINT64);
+  }
+  if (Avail < Size) {
+    return EFI_NOT_READY;
+  }
+
+  if (((Xxh32 (Header, Size - 1) >> 8) & 0xFF) != Header[Size - 1]) {
+    DEBUG ((EFI_D_ERROR, "LZ4 frame header checksum mismatch\n"));
+    return EFI_CRC_ERROR;
+  }
+
+  Decoder->BlockChecksum = !!(Flg & LZ4_FLG_BLOCK_CHECKSUM);
+  Decoder->ContentChecksum = !!(Flg & LZ4_FLG_CONTENT_CHECKSUM);
+  Decoder->MaxBlockSize = 1 << (8 + 2 * LZ4_BD_MAX_SIZE (Bd));
+  if (Flg & LZ4_FLG_CONTENT_SIZE) {
+    Decoder->ContentSize = ReadUnaligned64 ((UINT64 *)(Header + 2));
+  }
+
+  *Used = Size;
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS
+Lz4FrameBlock (IN OUT LZ4_FRAME_DECODER *Decoder,
+               IN CONST UINT8 *Block,
+               IN UINTN Avail,
+               IN BOOLEAN InEnd,
+               OUT UINTN *Used,
+               OUT UINT8 *Out,
+               IN UINTN OutSize,
+               IN OUT UINTN *OutPos)
+{
+  EFI_STATUS Status;
+  UINT32 Word;
+  UINT32 BlockSize;
+  UINTN Need;
+  UINTN Limit;
+  UINTN Pos = *OutPos;
+
+  /* Legacy frames end with the input, "lz4 -l" output of the kernel build
+   * may carry the 4 byte decoded size after the last block.
+   */
+  if (Decoder->Legacy &&
+      InEnd &&
+      Avail <= sizeof (UINT32)) {
+    Decoder->Stage = Lz4StageDone;
+    *Used = Avail;
+    return EFI_SUCCESS;
+  }
+
+  if (Avail < sizeof (UINT32)) {
+    return EFI_NOT_READY;
+  }
+
+  Word = ReadUnaligned32 ((UINT32 *)Block);
+  if (Decoder->Legacy) {
+    /* Legacy frames may be concatenated */
+    if (Word == LZ4_LEGACY_MAGIC) {
+      *Used = sizeof (UINT32);
+      return EFI_SUCCESS;
+    }
+    BlockSize = Word;
+  } else if (!Word) {
+    Decoder->Stage = Decoder->ContentChecksum ? Lz4StageChecksum :
+                                                Lz4StageDone;
+    *Used = sizeof (UINT32);
+    return EFI_SUCCESS;
+  } else {
+    BlockSize = Word & ~LZ4_BLOCK_UNCOMPRESSED;
+  }
+
+  if (BlockSize > Decoder->MaxBlockSize) {
+    return EFI_VOLUME_CORRUPTED;
+  }
+
+  Need = sizeof (UINT32) + BlockSize;
+  if (Decoder->BlockChecksum) {
+    Need += sizeof (UINT32);
+  }
+  if (Avail < Need) {
+    return EFI_NOT_READY;
+  }
+  Block += sizeof (UINT32);
+
+  if (Decoder->BlockChecksum &&
+      Xxh32 (Block, BlockSize) !=
+      ReadUnaligned32 ((UINT32 *)(Block + BlockSize))) {
+    DEBUG ((EFI_D_ERROR, "LZ4 block checksum mismatch\n"));
+    return EFI_CRC_ERROR;
+  }
+
+  Limit = MIN (OutSize, Pos + Decoder->MaxBlockSize);
+  if (!Decoder->Legacy &&
+      (Word & LZ4_BLOCK_UNCOMPRESSED)) {
+    if (BlockSize > Limit - Pos) {
+      return (Limit == OutSize) ? EFI_BUFFER_TOO_SMALL : EFI_VOLUME_CORRUPTED;
+    }
+    CopyMem (Out + Pos, Block, BlockSize);
+    Pos += BlockSize;
+  } else {
+    Status = Lz4DecompressBlock (Block, BlockSize, Out, Limit, &Pos);
+    if (Status == EFI_BUFFER_TOO_SMALL &&
+        Limit != OutSize) {
+      Status = EFI_VOLUME_CORRUPTED;
+    }
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+  }
+
+  if (Decoder->ContentChecksum) {
+    Lz4Xxh32Update (&Decoder->Xxh, Out + *OutPos, Pos - *OutPos);
+  }
+
+  *OutPos = Pos;
+  *Used = Need;
+  return EFI_SUCCESS;
+}
+
+EFI_STATUS
+Lz4FrameDecode (IN OUT LZ4_FRAME_DECODER *Decoder,
+                IN CONST UINT8 *In,
+                IN UINTN InSize,
+                IN OUT UINTN *InPos,
+                IN BOOLEAN InEnd,
+                OUT UINT8 *Out,
+                IN UINTN OutSize,
+                IN OUT UINTN *OutPos)
+{
+  EFI_STATUS Status = EFI_SUCCESS;
+  CONST UINT8 *Unit = In + *InPos;
+  UINTN Avail = InSize - *InPos;
+  UINTN Used = 0;
+  UINT32 Magic;
+
+  switch (Decoder->Stage) {
+  case Lz4StageMagic:
+    if (Avail < sizeof (Magic)) {
+      Status = EFI_NOT_READY;
+      break;
+    }
+    Magic = ReadUnaligned32 ((UINT32 *)Unit);
+    if (Magic == LZ4_FRAME_MAGIC) {
+      Decoder->Stage = Lz4StageHeader;
+    } else if (Magic == LZ4_LEGACY_MAGIC) {
+      Decoder->Legacy = TRUE;
+      Decoder->MaxBlockSize = LZ4_LEGACY_BLOCK_SIZE;
+      Decoder->Stage = Lz4StageBlock;
+    } else {
+      Status = EFI_VOLUME_CORRUPTED;
+      break;
+    }
+    Used = sizeof (Magic);
+    break;
+
+  case Lz4StageHeader:
+    Status = Lz4FrameHeader (Decoder, Unit, Avail, &Used);
+    if (!EFI_ERROR (Status)) {
+      Decoder->Stage = Lz4StageBlock;
+    }
+    break;
+
+  case Lz4StageBlock:
+    Status = Lz4FrameBlock (Decoder, Unit, Avail, InEnd, &Used,
+                            Out, OutSize, OutPos);
+    break;
+
+  case Lz4StageChecksum:
+    if (Avail < sizeof (UINT32)) {
+      Status = EFI_NOT_READY;
+      break;
+    }
+    if (Lz4Xxh32Final (&Decoder->Xxh) != ReadUnaligned32 ((UINT32 *)Unit)) {
+      DEBUG ((EFI_D_ERROR, "LZ4 content checksum mismatch\n"));
+      Status = EFI_CRC_ERROR;
+      break;
+    }
+    Used = sizeof (UINT32);
+    Decoder->Stage = Lz4StageDone;
+    break;
+
+  case Lz4StageDone:
+  default:
+    return EFI_END_OF_FILE;
+  }
+
+  if (Status == EFI_NOT_READY &&
+      InEnd) {
+    DEBUG ((EFI_D_ERROR, "LZ4 frame is truncated\n"));
+    Status = EFI_VOLUME_CORRUPTED;
+  }
+
+  if (!EFI_ERROR (Status)) {
+    *InPos += Used;
+  }
+  return Status;
+}
+
+EFI_STATUS
+Lz4Decompress (IN CONST VOID *In,
+               IN UINTN InSize,
+               OUT VOID *Out,
+               IN UINTN OutSize,
+               OUT UINTN *OutUsed)
+{
+  EFI_STATUS Status;
+  LZ4_FRAME_DECODER Decoder;
+  UINTN InPos = 0;
+  UINTN OutPos = 0;
+
+  Lz4FrameInit (&Decoder);
+  do {
+    Status = Lz4FrameDecode (&Decoder, In, InSize, &InPos, TRUE,
+                             Out, OutSize, &OutPos);
+  } while (Status == EFI_SUCCESS);
+
+  if (Status != EFI_END_OF_FILE) {
+    return Status;
+  }
+
+  if (Decoder.ContentSize &&
+      Decoder.ContentSize != OutPos) {
+    DEBUG ((EFI_D_ERROR, "LZ4 content size mismatch\n"));
+    return EFI_VOLUME_CORRUPTED;
+  }
+
+  *OutUsed = OutPos;
+  return EFI_SUCCESS;
+}
@@ -0,0 +1,353 @@
+/* Copyright (c) 2021, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/Sha2Lib.h>
+
+#if defined (MDE_CPU_AARCH64)
+
+#include <arm_neon.h>
+
+/* SHA2 field of ID_AA64ISAR0_EL1 */
+#define ISAR0_SHA2_SHIFT 12
+#define ISAR0_SHA2_MASK 0xF
+#define ISAR0_SHA2_SHA256 1
+#define ISAR0_SHA2_SHA512 2
+
+STATIC CONST UINT32 Sha256K[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+  0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+  0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+  0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+  0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+  0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+  0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+  0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+  0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+STATIC CONST UINT64 Sha512K[80] = {
+  0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL,
+  0xe9b5dba58189dbbcULL, 0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL,
+  0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL, 0xd807aa98a3030242ULL,
+  0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+  0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL,
+  0xc19bf174cf692694ULL, 0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL,
+  0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL, 0x2de92c6f592b0275ULL,
+  0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+  0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL,
+  0xbf597fc7beef0ee4ULL, 0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL,
+  0x06ca6351e003826fULL, 0x142929670a0e6e70ULL, 0x27b70a8546d22ffcULL,
+  0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+  0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL,
+  0x92722c851482353bULL, 0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL,
+  0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL, 0xd192e819d6ef5218ULL,
+  0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+  0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL,
+  0x34b0bcb5e19b48a8ULL, 0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL,
+  0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL, 0x748f82ee5defb2fcULL,
+  0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+  0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL,
+  0xc67178f2e372532bULL, 0xca273eceea26619cULL, 0xd186b8c721c0c207ULL,
+  0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL, 0x06f067aa72176fbaULL,
+  0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+  0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL,
+  0x431d67c49c100d4cULL, 0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL,
+  0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL};
+
+STATIC CONST UINT32 Sha256Iv[8] = {
+  0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+  0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+STATIC CONST UINT64 Sha512Iv[8] = {
+  0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL,
+  0xa54ff53a5f1d36f1ULL, 0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL,
+  0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL};
+
+/* Digests of "abc", FIPS 180-2 appendix B.1 and C.1 */
+STATIC CONST UINT32 Sha256AbcDigest[8] = {
+  0xba7816bf, 0x8f01cfea, 0x414140de, 0x5dae2223,
+  0xb00361a3, 0x96177a9c, 0xb410ff61, 0xf20015ad};
+
+STATIC CONST UINT64 Sha512AbcDigest[8] = {
+  0xddaf35a193617abaULL, 0xcc417349ae204131ULL, 0x12e6fa4e89a97ea2ULL,
+  0x0a9eeee64b55d39aULL, 0x2192992a274fc1a8ULL, 0x36ba3c23a3feebbdULL,
+  0x454d4423643ce80eULL, 0x2a9ac94fa54ca49fULL};
+
+STATIC BOOLEAN Sha2CeProbed;
+STATIC BOOLEAN Sha256CeOk;
+STATIC BOOLEAN Sha512CeOk;
+
+/* Four rounds of SHA-256 with the schedule words in Msg */
+#define SHA256_CE_ROUNDS(Msg, Round)                                           \
+  do {                                                                         \
+    Wk = vaddq_u32 ((Msg), vld1q_u32 (&Sha256K[(Round)]));                     \
+    Abcd0 = Abcd;                                                              \
+    Abcd = vsha256hq_u32 (Abcd, Efgh, Wk);                                     \
+    Efgh = vsha256h2q_u32 (Efgh, Abcd0, Wk);                                   \
+  } while (0)
+
+/* Replaces Msg0 = W[t..t+3] with W[t+16..t+19] */
+#define SHA256_CE_SCHEDULE(Msg0, Msg1, Msg2, Msg3)                             \
+  (Msg0) = vsha256su1q_u32 (vsha256su0q_u32 ((Msg0), (Msg1)), (Msg2), (Msg3))
+
+VOID
+Sha256CeBlocks (UINT32 *State, CONST UINT8 *Data, UINTN Blocks)
+{
+  uint32x4_t Abcd;
+  uint32x4_t Efgh;
+  uint32x4_t Abcd0;
+  uint32x4_t AbcdSave;
+  uint32x4_t EfghSave;
+  uint32x4_t Msg0;
+  uint32x4_t Msg1;
+  uint32x4_t Msg2;
+  uint32x4_t Msg3;
+  uint32x4_t Wk;
+  UINT32 Round;
+
+  Abcd = vld1q_u32 ((CONST uint32_t *)State);
+  Efgh = vld1q_u32 ((CONST uint32_t *)State + 4);
+
+  while (Blocks-- > 0) {
+    AbcdSave = Abcd;
+    EfghSave = Efgh;
+
+    Msg0 = vreinterpretq_u32_u8 (vrev32q_u8 (vld1q_u8 (Data)));
+    Msg1 = vreinterpretq_u32_u8 (vrev32q_u8 (vld1q_u8 (Data + 16)));
+    Msg2 = vreinterpretq_u32_u8 (vrev32q_u8 (vld1q_u8 (Data + 32)));
+    Msg3 = vreinterpretq_u32_u8 (vrev32q_u8 (vld1q_u8 (Data + 48)));
+    Data += SHA256_CE_BLOCK_SIZE;
+
+    for (Round = 0; Round < 48; Round += 16) {
+      SHA256_CE_ROUNDS (Msg0, Round);
+      SHA256_CE_SCHEDULE (Msg0, Msg1, Msg2, Msg3);
+      SHA256_CE_ROUNDS (Msg1, Round + 4);
+      SHA256_CE_SCHEDULE (Msg1, Msg2, Msg3, Msg0);
+      SHA256_CE_ROUNDS (Msg2, Round + 8);
+      SHA256_CE_SCHEDULE (Msg2, Msg3, Msg0, Msg1);
+      SHA256_CE_ROUNDS (Msg3, Round + 12);
+      SHA256_CE_SCHEDULE (Msg3, Msg0, Msg1, Msg2);
+    }
+    SHA256_CE_ROUNDS (Msg0, 48);
+    SHA256_CE_ROUNDS (Msg1, 52);
+    SHA256_CE_ROUNDS (Msg2, 56);
+    SHA256_CE_ROUNDS (Msg3, 60);
+
+    Abcd = vaddq_u32 (Abcd, AbcdSave);
+    Efgh = vaddq_u32 (Efgh, EfghSave);
+  }
+
+  vst1q_u32 ((uint32_t *)State, Abcd);
+  vst1q_u32 ((uint32_t *)State + 4, Efgh);
+}
+
+/* The state is kept in pairs {a, b}, {c, d}, {e, f} and {g, h}, low lane
+ * first. SHA512H produces the T1 sums of two rounds and SHA512H2 the new
+ * a words from them, so each step below is two rounds.
+ */
+VOID
+Sha512CeBlocks (UINT64 *State, CONST UINT8 *Data, UINTN Blocks)
+{
+  uint64x2_t Ab;
+  uint64x2_t Cd;
+  uint64x2_t Ef;
+  uint64x2_t Gh;
+  uint64x2_t Save[4];
+  uint64x2_t Msg[8];
+  uint64x2_t Kw;
+  uint64x2_t T1;
+  uint64x2_t NewAb;
+  uint64x2_t NewEf;
+  UINT32 Round;
+  UINT32 Index;
+
+  Ab = vld1q_u64 ((CONST uint64_t *)State);
+  Cd = vld1q_u64 ((CONST uint64_t *)State + 2);
+  Ef = vld1q_u64 ((CONST uint64_t *)State + 4);
+  Gh = vld1q_u64 ((CONST uint64_t *)State + 6);
+
+  while (Blocks-- > 0) {
+    Save[0] = Ab;
+    Save[1] = Cd;
+    Save[2] = Ef;
+    Save[3] = Gh;
+
+    for (Index = 0; Index < 8; Index++) {
+      Msg[Index] = vreinterpretq_u64_u8 (vrev64q_u8 (vld1q_u8 (Data)));
+      Data += 16;
+    }
+
+    for (Round = 0; Round < 80; Round += 2) {
+      Index = (Round / 2) & 7;
+
+      /* {g + K[t + 1] + W[t + 1], h + K[t] + W[t]} */
+      Kw = vaddq_u64 (Msg[Index],
+                      vld1q_u64 ((CONST uint64_t *)&Sha512K[Round]));
+      Kw = vaddq_u64 (Gh, vextq_u64 (Kw, Kw, 1));
+
+      T1 = vsha512hq_u64 (Kw, vextq_u64 (Ef, Gh, 1), vextq_u64 (Cd, Ef, 1));
+      NewEf = vaddq_u64 (Cd, T1);
+      NewAb = vsha512h2q_u64 (T1, Cd, Ab);
+      Gh = Ef;
+      Ef = NewEf;
+      Cd = Ab;
+      Ab = NewAb;
+
+      if (Round < 64) {
+        Msg[Index] = vsha512su1q_u64 (
+            vsha512su0q_u64 (Msg[Index], Msg[(Index + 1) & 7]),
+            Msg[(Index + 7) & 7],
+            vextq_u64 (Msg[(Index + 4) & 7], Msg[(Index + 5) & 7], 1));
+      }
+    }
+
+    Ab = vaddq_u64 (Ab, Save[0]);
+    Cd = vaddq_u64 (Cd, Save[1]);
+    Ef = vaddq_u64 (Ef, Save[2]);
+    Gh = vaddq_u64 (Gh, Save[3]);
+  }
+
+  vst1q_u64 ((uint64_t *)State, Ab);
+  vst1q_u64 ((uint64_t *)State + 2, Cd);
+  vst1q_u64 ((uint64_t *)State + 4, Ef);
+  vst1q_u64 ((uint64_t *)State + 6, Gh);
+}
+
+/* Hashes the single padded block of "abc" with the instructions and checks
+ * the result, so that a core that reports the extension but computes wrong
+ * digests is never used.
+ */
+STATIC BOOLEAN
+Sha256CeSelfTest (VOID)
+{
+  UINT8 Block[SHA256_CE_BLOCK_SIZE];
+  UINT32 State[8];
+
+  SetMem (Block, sizeof (Block), 0);
+  CopyMem (Block, "abc", 3);
+  Block[3] = 0x80;
+  Block[sizeof (Block) - 1] = 3 * 8;
+
+  CopyMem (State, Sha256Iv, sizeof (State));
+  Sha256CeBlocks (State, Block, 1);
+
+  return CompareMem (State, Sha256AbcDigest, sizeof (State)) == 0;
+}
+
+STATIC BOOLEAN
+Sha512CeSelfTest (VOID)
+{
+  UINT8 Block[SHA512_CE_BLOCK_SIZE];
+  UINT64 State[8];
+
+  SetMem (Block, sizeof (Block), 0);
+  CopyMem (Block, "abc", 3);
+  Block[3] = 0x80;
+  Block[sizeof (Block) - 1] = 3 * 8;
+
+  CopyMem (State, Sha512Iv, sizeof (State));
+  Sha512CeBlocks (State, Block, 1);
+
+  return CompareMem (State, Sha512AbcDigest, sizeof (State)) == 0;
+}
+
+STATIC VOID
+Sha2CeProbe (VOID)
+{
+  UINT64 Isar0;
+  UINT32 Sha2;
+
+  if (Sha2CeProbed) {
+    return;
+  }
+
+  __asm__ volatile ("mrs %0, id_aa64isar0_el1" : "=r" (Isar0));
+  Sha2 = (Isar0 >> ISAR0_SHA2_SHIFT) & ISAR0_SHA2_MASK;
+
+  if (Sha2 >= ISAR0_SHA2_SHA256) {
+    Sha256CeOk = Sha256CeSelfTest ();
+    if (!Sha256CeOk) {
+      DEBUG ((EFI_D_ERROR, "SHA-256 instructions failed the self test\n"));
+    }
+  }
+  if (Sha2 >= ISAR0_SHA2_SHA512) {
+    Sha512CeOk = Sha512CeSelfTest ();
+    if (!Sha512CeOk) {
+      DEBUG ((EFI_D_ERROR, "SHA-512 instructions failed the self test\n"));
+    }
+  }
+
+  DEBUG ((EFI_D_VERBOSE, "SHA-256 instructions: %a, SHA-512 instructions: %a\n",
+          Sha256CeOk ? "yes" : "no", Sha512CeOk ? "yes" : "no"));
+  Sha2CeProbed = TRUE;
+}
+
+BOOLEAN
+Sha256CeSupported (VOID)
+{
+  Sha2CeProbe ();
+  return Sha256CeOk;
+}
+
+BOOLEAN
+Sha512CeSupported (VOID)
+{
+  Sha2CeProbe ();
+  return Sha512CeOk;
+}
+
+#else
+
+BOOLEAN
+Sha256CeSupported (VOID)
+{
+  return FALSE;
+}
+
+BOOLEAN
+Sha512CeSupported (VOID)
+{
+  return FALSE;
+}
+
+VOID
+Sha256CeBlocks (UINT32 *State, CONST UINT8 *Data, UINTN Blocks)
+{
+  ASSERT (FALSE);
+}
+
+VOID
+Sha512CeBlocks (UINT64 *State, CONST UINT8 *Data, UINTN Blocks)
+{
+  ASSERT (FALSE);
+}
+
+#endif
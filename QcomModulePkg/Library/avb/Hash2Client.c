@@ -31,33 +31,142 @@
 #include <Library/BaseLib.h>
 #include <Library/BaseMemoryLib.h>
 #include <Library/DebugLib.h>
+#include <Library/Sha2Lib.h>
 #include <Library/UefiBootServicesTableLib.h>
 #include <Protocol/Hash2.h>
 #include <Uefi.h>
 
+/* Implementation an AvbSHA256Ctx is bound to, see Sha256Bind () */
+#define SHA256_ENGINE_PENDING 0
+#define SHA256_ENGINE_CPU 1
+#define SHA256_ENGINE_HASH2 2
+#define SHA256_ENGINE_FAILED 3
+
+/* Smallest update that is sent to the Hash2 protocol. Below it, setting up
+ * the crypto engine costs more than hashing on the CPU, which is sooner
+ * the case when the CPU has the SHA-256 instructions.
+ */
+#define HASH2_MIN_LEN (16 * 1024)
+#define HASH2_MIN_LEN_CE (1024 * 1024)
+
+STATIC EFI_HASH2_PROTOCOL *Hash2Protocol;
+STATIC BOOLEAN Hash2Located;
+/* The protocol keeps a single hash, only one context may use it at a time.
+ * Contexts of the parallel AVB jobs claim it with a compare and exchange,
+ * the claim also covers locating the protocol.
+ */
+STATIC UINT32 Hash2InUse;
+
+bool
+avb_sha256_blocks_accel (uint32_t *h, const uint8_t *data, size_t block_nb)
+{
+  if (!Sha256CeSupported ()) {
+    return false;
+  }
+  Sha256CeBlocks (h, data, block_nb);
+  return true;
+}
+
+bool
+avb_sha512_blocks_accel (uint64_t *h, const uint8_t *data, size_t block_nb)
+{
+  if (!Sha512CeSupported ()) {
+    return false;
+  }
+  Sha512CeBlocks (h, data, block_nb);
+  return true;
+}
+
+STATIC VOID
+Hash2Release (VOID)
+{
+  __atomic_store_n (&Hash2InUse, 0, __ATOMIC_RELEASE);
+}
+
+STATIC EFI_HASH2_PROTOCOL *
+Hash2Claim (VOID)
+{
+  EFI_STATUS Status;
+  UINT32 Free = 0;
+
+  if (!__atomic_compare_exchange_n (&Hash2InUse, &Free, 1, FALSE,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+    return NULL;
+  }
+
+  if (!Hash2Located) {
+    Status = gBS->LocateProtocol (&gEfiHash2ProtocolGuid, NULL,
+                                  (VOID **)&Hash2Protocol);
+    if (Status != EFI_SUCCESS) {
+      DEBUG ((EFI_D_VERBOSE, "Hash2 protocol not found, hashing on the CPU\n"));
+      Hash2Protocol = NULL;
+    }
+    Hash2Located = TRUE;
+  }
+
+  if (Hash2Protocol == NULL) {
+    Hash2Release ();
+    return NULL;
+  }
+
+  if (Hash2Protocol->HashInit (Hash2Protocol, &gEfiHashAlgorithmSha256Guid) !=
+      EFI_SUCCESS) {
+    DEBUG ((EFI_D_ERROR, "Hash2 HashInit failed, hashing on the CPU\n"));
+    Hash2Release ();
+    return NULL;
+  }
+
+  return Hash2Protocol;
+}
+
+/* Binds Ctx to an engine chosen by the size of the update that is about to
+ * be made, and passes the bytes buffered so far to it.
+ */
+STATIC VOID
+Sha256Bind (AvbSHA256Ctx *Ctx, uint32_t Len)
+{
+  EFI_HASH2_PROTOCOL *pEfiHash2Protocol = NULL;
+  UINT8 Pending[sizeof (Ctx->block)];
+  uint32_t PendingLen = Ctx->len;
+  uint32_t MinLen;
+
+  MinLen = Sha256CeSupported () ? HASH2_MIN_LEN_CE : HASH2_MIN_LEN;
+  if (Len >= MinLen) {
+    pEfiHash2Protocol = Hash2Claim ();
+  }
+
+  CopyMem (Pending, Ctx->block, PendingLen);
+
+  if (pEfiHash2Protocol != NULL) {
+    Ctx->user_data = (VOID *)pEfiHash2Protocol;
+    Ctx->engine = SHA256_ENGINE_HASH2;
+    if (PendingLen != 0 &&
+        pEfiHash2Protocol->HashUpdate (pEfiHash2Protocol, Pending,
+                                       PendingLen) != EFI_SUCCESS) {
+      DEBUG ((EFI_D_ERROR, "avb_sha256_update: HashUpdate failed\n"));
+      Ctx->engine = SHA256_ENGINE_FAILED;
+    }
+    return;
+  }
+
+  avb_sha256_sw_init (Ctx);
+  Ctx->engine = SHA256_ENGINE_CPU;
+  avb_sha256_sw_update (Ctx, Pending, PendingLen);
+}
+
 /*
   Initializes the SHA-256 context.
   Ctx cannot be NULL here, it is caller's responsibility
   to ensure Ctx is not NULL.
+  The engine is picked on the first update that does not fit the context
+  buffer: the Hash2 protocol for large updates, otherwise the CPU.
 */
 void
 avb_sha256_init (AvbSHA256Ctx *Ctx)
 {
-  EFI_STATUS Status = EFI_SUCCESS;
-  EFI_HASH2_PROTOCOL *pEfiHash2Protocol = NULL;
-
-  GUARD_OUT (gBS->LocateProtocol (&gEfiHash2ProtocolGuid, NULL,
-                                  (VOID **)&pEfiHash2Protocol));
-
-  Ctx->user_data = (VOID *)pEfiHash2Protocol;
-
-  GUARD_OUT (pEfiHash2Protocol->HashInit (pEfiHash2Protocol,
-                                          &gEfiHashAlgorithmSha256Guid));
-
-out:
-  if (Status != EFI_SUCCESS) {
-    Ctx->user_data = NULL;
-  }
+  Ctx->user_data = NULL;
+  Ctx->engine = SHA256_ENGINE_PENDING;
+  Ctx->len = 0;
 }
 
 /*
@@ -76,15 +185,29 @@ avb_sha256_update (AvbSHA256Ctx *Ctx, const uint8_t *Data, uint32_t Len)
     return;
   }
 
-  pEfiHash2Protocol = Ctx->user_data;
-  if (pEfiHash2Protocol == NULL) {
-    DEBUG ((EFI_D_ERROR, "avb_sha256_update failed, Ctx->user_data is NULL\n"));
-    return;
+  if (Ctx->engine == SHA256_ENGINE_PENDING) {
+    if (Len <= sizeof (Ctx->block) - Ctx->len) {
+      CopyMem (&Ctx->block[Ctx->len], Data, Len);
+      Ctx->len += Len;
+      return;
+    }
+    Sha256Bind (Ctx, Len);
   }
 
-  Status = pEfiHash2Protocol->HashUpdate (pEfiHash2Protocol, Data, Len);
-  if (Status != EFI_SUCCESS) {
-    DEBUG ((EFI_D_ERROR, "avb_sha256_update: HashUpdate failed\n"));
+  switch (Ctx->engine) {
+  case SHA256_ENGINE_CPU:
+    avb_sha256_sw_update (Ctx, Data, Len);
+    break;
+  case SHA256_ENGINE_HASH2:
+    pEfiHash2Protocol = Ctx->user_data;
+    Status = pEfiHash2Protocol->HashUpdate (pEfiHash2Protocol, Data, Len);
+    if (Status != EFI_SUCCESS) {
+      DEBUG ((EFI_D_ERROR, "avb_sha256_update: HashUpdate failed\n"));
+      Ctx->engine = SHA256_ENGINE_FAILED;
+    }
+    break;
+  default:
+    break;
   }
 }
 
@@ -100,6 +223,15 @@ avb_sha256_final (AvbSHA256Ctx *Ctx)
   EFI_HASH2_OUTPUT Hash2Output;
   EFI_HASH2_PROTOCOL *pEfiHash2Protocol = NULL;
 
+  if (Ctx->engine == SHA256_ENGINE_PENDING) {
+    /* Nothing was large enough for the protocol */
+    Sha256Bind (Ctx, 0);
+  }
+
+  if (Ctx->engine == SHA256_ENGINE_CPU) {
+    return avb_sha256_sw_final (Ctx);
+  }
+
   pEfiHash2Protocol = Ctx->user_data;
   if (pEfiHash2Protocol == NULL) {
     DEBUG ((EFI_D_ERROR, "avb_sha256_final failed, Ctx->user_data is NULL\n"));
@@ -107,7 +239,17 @@ avb_sha256_final (AvbSHA256Ctx *Ctx)
     goto out;
   }
 
-  GUARD_OUT (pEfiHash2Protocol->HashFinal (pEfiHash2Protocol, &Hash2Output));
+  /* HashFinal also ends a hash that failed, so the protocol is reusable */
+  Status = pEfiHash2Protocol->HashFinal (pEfiHash2Protocol, &Hash2Output);
+  Hash2Release ();
+  Ctx->user_data = NULL;
+  if (Status != EFI_SUCCESS) {
+    goto out;
+  }
+  if (Ctx->engine == SHA256_ENGINE_FAILED) {
+    Status = EFI_DEVICE_ERROR;
+    goto out;
+  }
 
   if (sizeof (Hash2Output.Sha256Hash) > sizeof (Ctx->buf)) {
     DEBUG ((EFI_D_ERROR, "avb_sha256_final failed, output too large\n"));
@@ -118,7 +260,39 @@ avb_sha256_final (AvbSHA256Ctx *Ctx)
 
 out:
   if (Status != EFI_SUCCESS) {
-    SetMem (Ctx->buf, 0, sizeof (Ctx->buf));
+    SetMem (Ctx->buf, sizeof (Ctx->buf), 0);
+    Ctx->engine = SHA256_ENGINE_FAILED;
   }
   return Ctx->buf;
 }
+
+/*
+  Drops Ctx without a digest. A context bound to the Hash2 protocol holds
+  the claim on it until its hash is ended, which only HashFinal does.
+  Ctx cannot be NULL here, it is caller's responsibility
+  to ensure Ctx is not NULL.
+*/
+void
+avb_sha256_abort (AvbSHA256Ctx *Ctx)
+{
+  EFI_HASH2_OUTPUT Hash2Output;
+  EFI_HASH2_PROTOCOL *pEfiHash2Protocol = Ctx->user_data;
+
+  if (Ctx->engine != SHA256_ENGINE_CPU &&
+      pEfiHash2Protocol != NULL) {
+    pEfiHash2Protocol->HashFinal (pEfiHash2Protocol, &Hash2Output);
+    Hash2Release ();
+  }
+  Ctx->user_data = NULL;
+  Ctx->engine = SHA256_ENGINE_FAILED;
+}
+
+/*
+  Whether the last avb_sha256_final () on Ctx returned the digest. The
+  digest is zeroed when the Hash2 protocol failed.
+*/
+bool
+avb_sha256_final_ok (const AvbSHA256Ctx *Ctx)
+{
+  return Ctx->engine != SHA256_ENGINE_FAILED;
+}
@@ -240,6 +240,7 @@ KeyMasterSetRotAndBootState (KMRotAndBootState *BootState)
   case RED:
   default:
     DEBUG ((EFI_D_ERROR, "Invalid state to boot!\n"));
+    avb_sha256_abort (&RotCtx);
     return EFI_LOAD_ERROR;
   }
   /* RotDigest is a fixed size array, cannot be NULL */
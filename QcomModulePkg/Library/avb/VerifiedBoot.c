@@ -1143,6 +1143,10 @@ LoadImageAndAuthVB2 (BootInfo *Info)
   DEBUG ((EFI_D_VERBOSE, "Slot: %a, allow verification error: %a\n", SlotSuffix,
           BooleanString[AllowVerificationError].name));
 
+  if (Ops->run_parallel != NULL) {
+    VerifyFlags = VerifyFlags | AVB_SLOT_VERIFY_FLAGS_PARALLEL_HASH_VERIFICATION;
+  }
+
   if (FixedPcdGetBool (AllowEio)) {
     VerityFlags = IsEnforcing () ? AVB_HASHTREE_ERROR_MODE_RESTART
                                  : AVB_HASHTREE_ERROR_MODE_EIO;
@@ -1151,6 +1155,7 @@ LoadImageAndAuthVB2 (BootInfo *Info)
   }
   RequestedPartition = RequestedPartitionAll;
 
+  BOOT_TRACE_BEGIN (AvbVerify);
   if ( ( (!Info->MultiSlotBoot) ||
            IsDynamicPartitionSupport ()) &&
            (Info->BootIntoRecovery &&
@@ -1193,7 +1198,7 @@ LoadImageAndAuthVB2 (BootInfo *Info)
                   SlotSuffix, VerifyFlags, VerityFlags, &SlotData);
     }
   } else {
-    Slot CurrentSlot;
+    Slot CurrentSlot = {{0}};
     VOID *ImageHdrBuffer = NULL;
     UINT32 ImageHdrSize = 0;
 
@@ -1243,6 +1248,7 @@ LoadImageAndAuthVB2 (BootInfo *Info)
     Result = avb_slot_verify (Ops, (CONST CHAR8 *CONST *)RequestedPartition,
                   SlotSuffix, VerifyFlags, VerityFlags, &SlotData);
   }
+  BOOT_TRACE_END (AvbVerify, BT_AVB_VERIFY, 0);
 
   if (SlotData == NULL) {
     Status = EFI_LOAD_ERROR;
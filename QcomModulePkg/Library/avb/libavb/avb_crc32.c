@@ -91,23 +91,142 @@ static uint32_t crc32_tab[] = {
     0x54de5729, 0x23d967bf, 0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94,
     0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d};
 
-/*
- * A function that calculates the CRC-32 based on the table above is
- * given below for documentation purposes. An equivalent implementation
- * of this function that's actually used in the kernel can be found
- * in sys/libkern.h, where it can be inlined.
+#if defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+
+/* Updates the (pre-inverted) CRC register with the ARMv8 CRC32
+ * instructions, which use the same polynomial as crc32_tab.
  */
+static uint32_t crc32_raw(uint32_t crc, const uint8_t* p, size_t size) {
+  uint64_t v;
+
+  while (size && ((uintptr_t)p & 7)) {
+    __asm__("crc32b %w0, %w0, %w1" : "+r"(crc) : "r"((uint32_t)*p++));
+    size--;
+  }
+  while (size >= 8) {
+    v = *(const uint64_t*)p;
+    __asm__("crc32x %w0, %w0, %x1" : "+r"(crc) : "r"(v));
+    p += 8;
+    size -= 8;
+  }
+  while (size--) {
+    __asm__("crc32b %w0, %w0, %w1" : "+r"(crc) : "r"((uint32_t)*p++));
+  }
+  return crc;
+}
 
-static uint32_t crc32(uint32_t crc_in, const uint8_t* buf, int size) {
-  const uint8_t* p = buf;
-  uint32_t crc;
+void avb_crc32_init(void) {}
+
+#else
+
+/* Slice-by-8 tables, crc32_slice_tab[k][i] is the CRC register after
+ * feeding byte i followed by k zero bytes. Built from crc32_tab by
+ * avb_crc32_init().
+ */
+static uint32_t crc32_slice_tab[8][256];
+static bool crc32_slice_tab_ready;
 
-  crc = crc_in ^ ~0U;
-  while (size--)
+void avb_crc32_init(void) {
+  uint32_t i, k, c;
+
+  if (crc32_slice_tab_ready) {
+    return;
+  }
+
+  for (i = 0; i < 256; i++) {
+    c = crc32_tab[i];
+    crc32_slice_tab[0][i] = c;
+    for (k = 1; k < 8; k++) {
+      c = crc32_tab[c & 0xFF] ^ (c >> 8);
+      crc32_slice_tab[k][i] = c;
+    }
+  }
+  crc32_slice_tab_ready = true;
+}
+
+/* Updates the (pre-inverted) CRC register eight bytes at a time. */
+static uint32_t crc32_raw(uint32_t crc, const uint8_t* p, size_t size) {
+  uint32_t lo, hi;
+
+  /* Before avb_crc32_init() only the constant table is used, so that no
+   * caller ever reads a table another thread is building.
+   */
+  while (crc32_slice_tab_ready && size >= 8) {
+    lo = crc ^ ((uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+                ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+    hi = (uint32_t)p[4] | ((uint32_t)p[5] << 8) | ((uint32_t)p[6] << 16) |
+         ((uint32_t)p[7] << 24);
+    crc = crc32_slice_tab[7][lo & 0xFF] ^
+          crc32_slice_tab[6][(lo >> 8) & 0xFF] ^
+          crc32_slice_tab[5][(lo >> 16) & 0xFF] ^
+          crc32_slice_tab[4][lo >> 24] ^
+          crc32_slice_tab[3][hi & 0xFF] ^
+          crc32_slice_tab[2][(hi >> 8) & 0xFF] ^
+          crc32_slice_tab[1][(hi >> 16) & 0xFF] ^
+          crc32_slice_tab[0][hi >> 24];
+    p += 8;
+    size -= 8;
+  }
+  while (size--) {
     crc = crc32_tab[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
-  return crc ^ ~0U;
+  }
+  return crc;
+}
+
+#endif
+
+/* Multiplies the 32x32 GF(2) matrix |mat| (one column per bit) by |vec|. */
+static uint32_t gf2_matrix_times(const uint32_t* mat, uint32_t vec) {
+  uint32_t sum = 0;
+
+  while (vec) {
+    if (vec & 1) {
+      sum ^= *mat;
+    }
+    vec >>= 1;
+    mat++;
+  }
+  return sum;
+}
+
+static void gf2_matrix_square(uint32_t* square, const uint32_t* mat) {
+  int n;
+
+  for (n = 0; n < 32; n++) {
+    square[n] = gf2_matrix_times(mat, mat[n]);
+  }
+}
+
+uint32_t avb_crc32_update(uint32_t crc, const uint8_t* buf, size_t size) {
+  return crc32_raw(crc ^ ~0U, buf, size) ^ ~0U;
+}
+
+uint32_t avb_crc32_zeros(uint32_t crc, uint64_t len) {
+  uint32_t op[32];
+  uint32_t square[32];
+  uint32_t reg = crc ^ ~0U;
+  int n;
+
+  /* Feeding a zero byte is linear in the CRC register, so |len| zero bytes
+   * are applied by raising the one byte operator to the power |len|.
+   */
+  for (n = 0; n < 32; n++) {
+    op[n] = crc32_tab[(1U << n) & 0xFF] ^ ((1U << n) >> 8);
+  }
+
+  while (len) {
+    if (len & 1) {
+      reg = gf2_matrix_times(op, reg);
+    }
+    len >>= 1;
+    if (len) {
+      gf2_matrix_square(square, op);
+      avb_memcpy(op, square, sizeof(op));
+    }
+  }
+  return reg ^ ~0U;
 }
 
 uint32_t avb_crc32(const uint8_t* buf, size_t size) {
-  return crc32(0, buf, size);
+  return avb_crc32_update(0, buf, size);
 }
@@ -61,14 +61,13 @@
 #include <Library/BaseMemoryLib.h>
 #include <Library/DebugLib.h>
 #include <Library/MemoryAllocationLib.h>
+#include <Library/ThreadStack.h>
 #include <Uefi.h>
 
 STATIC AvbIOResult GetHandleInfo(const char *Partition, HandleInfo *HandleInfo)
 {
 	EFI_STATUS Status = EFI_SUCCESS;
 	CHAR16 UnicodePartition[MAX_GPT_NAME_SIZE] = {0};
-	UINT32 BlkIOAttrib = 0;
-	PartiSelectFilter HandleFilter = {0};
 	UINT32 MaxHandles = 1;
 
 	if ((AsciiStrLen(Partition) + 1) > ARRAY_SIZE(UnicodePartition)) {
@@ -79,21 +78,11 @@ STATIC AvbIOResult GetHandleInfo(const char *Partition, HandleInfo *HandleInfo)
 
 	AsciiStrToUnicodeStr(Partition, UnicodePartition);
 
-	HandleFilter.RootDeviceType = NULL;
-	HandleFilter.PartitionLabel = NULL;
-	HandleFilter.VolumeName = 0;
-
-	BlkIOAttrib |= BLK_IO_SEL_PARTITIONED_MBR;
-	BlkIOAttrib |= BLK_IO_SEL_PARTITIONED_GPT;
-	BlkIOAttrib |= BLK_IO_SEL_MEDIA_TYPE_NON_REMOVABLE;
-	BlkIOAttrib |= BLK_IO_SEL_MATCH_PARTITION_LABEL;
-	HandleFilter.PartitionLabel = UnicodePartition;
-
-	Status = GetBlkIOHandles(BlkIOAttrib, &HandleFilter, HandleInfo, &MaxHandles);
+	Status = GetPartitionHandles(UnicodePartition, HandleInfo, &MaxHandles);
 
 	if (Status != EFI_SUCCESS) {
 		DEBUG((EFI_D_ERROR,
-		       "GetHandleInfo: GetBlkIOHandles failed!\n"));
+		       "GetHandleInfo: GetPartitionHandles failed!\n"));
 		return AVB_IO_RESULT_ERROR_IO;
 	}
 
@@ -133,6 +122,7 @@ AvbIOResult AvbReadFromPartition(AvbOps *Ops, const char *Partition, int64_t Rea
         UINT64 FullBlock = 0;
         UINT64 StartPageReadSize = 0;
         UINT64 LoadImageStartTime = GetTimerCountms ();
+        BOOT_TRACE_BEGIN (Read);
 
 	if (Partition == NULL || Buffer == NULL || OutNumRead == NULL || NumBytes <= 0) {
 		DEBUG((EFI_D_ERROR, "bad input paramaters\n"));
@@ -305,11 +295,254 @@ out:
 		avb_free(Page);
 	}
 
+    BOOT_TRACE_END (Read, BT_AVB_READ,
+                    OutNumRead != NULL ? *OutNumRead : 0);
     DEBUG ((EFI_D_INFO, "Load Image %a total time: %lu ms \n",
           Partition, GetTimerCountms () - LoadImageStartTime));
 	return Result;
 }
 
+/* AvbReadFromPartitionChunked reads pieces of AVB_READ_CHUNK_SIZE, up to
+ * AVB_READ_AHEAD of them in flight through BlockIo2.
+ */
+#define AVB_READ_CHUNK_SIZE (1024 * 1024)
+#define AVB_READ_AHEAD 2
+
+typedef struct {
+	EFI_BLOCK_IO_PROTOCOL *BlockIo;
+	EFI_BLOCK_IO2_PROTOCOL *BlockIo2;
+	EFI_BLOCK_IO2_TOKEN Tokens[AVB_READ_AHEAD];
+	UINT8 *Buffer;
+	UINT64 Size;
+	UINT64 Issued;
+	UINT32 Oldest;
+	UINT32 InFlight;
+} AvbReadAhead;
+
+/* Queue the next piece of the image behind the ones already in flight */
+STATIC EFI_STATUS AvbReadAheadIssue(AvbReadAhead *Ra)
+{
+	EFI_STATUS Status;
+	UINT64 Piece = MIN (Ra->Size - Ra->Issued, AVB_READ_CHUNK_SIZE);
+
+	Status = Ra->BlockIo2->ReadBlocksEx (
+	        Ra->BlockIo2, Ra->BlockIo->Media->MediaId,
+	        Ra->Issued / Ra->BlockIo->Media->BlockSize,
+	        &Ra->Tokens[(Ra->Oldest + Ra->InFlight) % AVB_READ_AHEAD],
+	        Piece, Ra->Buffer + Ra->Issued);
+	if (Status == EFI_SUCCESS) {
+		Ra->Issued += Piece;
+		Ra->InFlight++;
+	}
+	return Status;
+}
+
+AvbIOResult AvbReadFromPartitionChunked(AvbOps *Ops, const char *Partition,
+                                        size_t NumBytes, void *Buffer,
+                                        size_t *OutNumRead,
+                                        void (*ChunkCb)(void *ChunkUser,
+                                                        const uint8_t *Data,
+                                                        size_t Len),
+                                        void *ChunkUser)
+{
+	AvbIOResult Result = AVB_IO_RESULT_OK;
+	EFI_STATUS Status = EFI_SUCCESS;
+	EFI_STATUS ReadStatus = EFI_SUCCESS;
+	HandleInfo InfoList[1];
+	EFI_BLOCK_IO_PROTOCOL *BlockIo = NULL;
+	AvbReadAhead Ra;
+	BOOLEAN IssueFailed = FALSE;
+	BOOLEAN Poll = FALSE;
+	EFI_TPL OldTpl;
+	VOID *Page = NULL;
+	UINT64 PartitionSize = 0;
+	UINT64 BlockSize = 0;
+	UINT64 Done = 0;
+	UINT64 Piece = 0;
+	UINT64 WaitTime = 0;
+	UINT64 StartTime = 0;
+	UINT64 LoadImageStartTime = GetTimerCountms ();
+	UINT32 Index = 0;
+	UINTN EventIndex = 0;
+	BOOT_TRACE_BEGIN (Read);
+
+	SetMem (&Ra, sizeof (Ra), 0);
+
+	if (Partition == NULL || Buffer == NULL || OutNumRead == NULL ||
+	    ChunkCb == NULL || NumBytes == 0) {
+		DEBUG((EFI_D_ERROR, "bad input paramaters\n"));
+		Result = AVB_IO_RESULT_ERROR_IO;
+		goto out;
+	}
+	*OutNumRead = 0;
+
+	Result = GetHandleInfo (Partition, InfoList);
+	if (Result != AVB_IO_RESULT_OK) {
+		DEBUG ((EFI_D_ERROR,
+		        "AvbReadFromPartitionChunked: GetHandleInfo failed"));
+		goto out;
+	}
+
+	BlockIo = InfoList[0].BlkIo;
+	PartitionSize = GetPartitionSize (BlockIo);
+	if (!PartitionSize) {
+		Result = AVB_IO_RESULT_ERROR_RANGE_OUTSIDE_PARTITION;
+		goto out;
+	}
+
+	if (NumBytes > PartitionSize) {
+		NumBytes = PartitionSize;
+	}
+	BlockSize = BlockIo->Media->BlockSize;
+
+	Ra.BlockIo = BlockIo;
+	Ra.Buffer = Buffer;
+	Ra.Size = NumBytes - (NumBytes % BlockSize);
+
+	Status = gBS->HandleProtocol (InfoList[0].Handle,
+	                              &gEfiBlockIo2ProtocolGuid,
+	                              (VOID **)&Ra.BlockIo2);
+	if (Status != EFI_SUCCESS) {
+		Ra.BlockIo2 = NULL;
+	}
+
+	/* WaitForEvent is only allowed at TPL_APPLICATION */
+	OldTpl = gBS->RaiseTPL (TPL_HIGH_LEVEL);
+	gBS->RestoreTPL (OldTpl);
+	if (OldTpl != TPL_APPLICATION) {
+		Ra.BlockIo2 = NULL;
+	}
+
+	for (Index = 0; Ra.BlockIo2 != NULL && Index < AVB_READ_AHEAD; Index++) {
+		Status = gBS->CreateEvent (0, TPL_NOTIFY, NULL, NULL,
+		                           &Ra.Tokens[Index].Event);
+		if (Status != EFI_SUCCESS) {
+			Ra.BlockIo2 = NULL;
+		}
+	}
+
+	/* Pieces are handed to ChunkCb in order, whatever order the device
+	 * completes them in: each wait is on the token of the oldest one. It
+	 * is handed over only after the next read has been queued, so the
+	 * device keeps reading while the caller hashes.
+	 */
+	while (Ra.BlockIo2 != NULL) {
+		while (!IssueFailed && ReadStatus == EFI_SUCCESS &&
+		       Ra.Issued < Ra.Size && Ra.InFlight < AVB_READ_AHEAD) {
+			if (AvbReadAheadIssue (&Ra) != EFI_SUCCESS) {
+				IssueFailed = TRUE;
+			}
+		}
+
+		if (!Ra.InFlight) {
+			break;
+		}
+
+		StartTime = GetTimerCountms ();
+		if (!Poll) {
+			Status = gBS->WaitForEvent (1, &Ra.Tokens[Ra.Oldest].Event,
+			                            &EventIndex);
+			if (Status != EFI_SUCCESS) {
+				/* The reads in flight still own the buffer and the
+				 * events: poll them to completion, and read the rest
+				 * synchronously.
+				 */
+				DEBUG ((EFI_D_ERROR, "WaitForEvent failed: %r, polling\n",
+				        Status));
+				Poll = TRUE;
+				IssueFailed = TRUE;
+			}
+		}
+		if (Poll) {
+			while (gBS->CheckEvent (Ra.Tokens[Ra.Oldest].Event) !=
+			       EFI_SUCCESS) {
+			}
+		}
+		WaitTime += GetTimerCountms () - StartTime;
+		if (ReadStatus == EFI_SUCCESS) {
+			ReadStatus = Ra.Tokens[Ra.Oldest].TransactionStatus;
+		}
+		Ra.Oldest = (Ra.Oldest + 1) % AVB_READ_AHEAD;
+		Ra.InFlight--;
+
+		/* Drain the reads still in flight before failing */
+		if (ReadStatus != EFI_SUCCESS) {
+			continue;
+		}
+
+		if (!IssueFailed && Ra.Issued < Ra.Size &&
+		    AvbReadAheadIssue (&Ra) != EFI_SUCCESS) {
+			IssueFailed = TRUE;
+		}
+
+		Piece = MIN (Ra.Size - Done, AVB_READ_CHUNK_SIZE);
+		ChunkCb (ChunkUser, (UINT8 *)Buffer + Done, Piece);
+		Done += Piece;
+	}
+
+	if (ReadStatus != EFI_SUCCESS) {
+		DEBUG ((EFI_D_ERROR, "ReadBlocksEx failed %r\n", ReadStatus));
+		Result = AVB_IO_RESULT_ERROR_IO;
+		goto out;
+	}
+
+	/* Whatever BlockIo2 could not queue is read synchronously */
+	while (Done < Ra.Size) {
+		Piece = MIN (Ra.Size - Done, AVB_READ_CHUNK_SIZE);
+		StartTime = GetTimerCountms ();
+		Status = BlockIo->ReadBlocks (BlockIo, BlockIo->Media->MediaId,
+		                              Done / BlockSize, Piece,
+		                              (UINT8 *)Buffer + Done);
+		WaitTime += GetTimerCountms () - StartTime;
+		if (Status != EFI_SUCCESS) {
+			DEBUG ((EFI_D_ERROR, "ReadBlocks failed %r\n", Status));
+			Result = AVB_IO_RESULT_ERROR_IO;
+			goto out;
+		}
+		ChunkCb (ChunkUser, (UINT8 *)Buffer + Done, Piece);
+		Done += Piece;
+	}
+
+	/* Last partial block */
+	if (Done < NumBytes) {
+		Page = avb_malloc (BlockSize);
+		if (Page == NULL) {
+			DEBUG ((EFI_D_ERROR, "Allocate for partial read failed!"));
+			Result = AVB_IO_RESULT_ERROR_OOM;
+			goto out;
+		}
+		Status = BlockIo->ReadBlocks (BlockIo, BlockIo->Media->MediaId,
+		                              Done / BlockSize, BlockSize, Page);
+		if (Status != EFI_SUCCESS) {
+			DEBUG ((EFI_D_ERROR, "ReadBlocks failed %r\n", Status));
+			Result = AVB_IO_RESULT_ERROR_IO;
+			goto out;
+		}
+		avb_memcpy ((UINT8 *)Buffer + Done, Page, NumBytes - Done);
+		ChunkCb (ChunkUser, (UINT8 *)Buffer + Done, NumBytes - Done);
+		Done = NumBytes;
+	}
+
+	*OutNumRead = Done;
+
+out:
+	for (Index = 0; Index < AVB_READ_AHEAD; Index++) {
+		if (Ra.Tokens[Index].Event != NULL) {
+			gBS->CloseEvent (Ra.Tokens[Index].Event);
+		}
+	}
+	if (Page != NULL) {
+		avb_free (Page);
+	}
+
+	BOOT_TRACE_END (Read, BT_AVB_READ, Done);
+	DEBUG ((EFI_D_INFO, "Load Image %a total time: %lu ms, %lu ms waiting "
+	        "for reads, %s\n", Partition,
+	        GetTimerCountms () - LoadImageStartTime, WaitTime,
+	        Ra.BlockIo2 != NULL ? L"BlockIo2" : L"BlockIo"));
+	return Result;
+}
+
 AvbIOResult AvbWriteToPartition(AvbOps *Ops, const char *Partition, int64_t Offset,
                                 size_t NumBytes, const void *Buffer)
 {
@@ -601,6 +834,156 @@ AvbIOResult AvbGetSizeOfPartition(AvbOps *Ops, const char *Partition, uint64_t *
 	return AVB_IO_RESULT_OK;
 }
 
+/* Threads that run the jobs of AvbRunParallel along with the caller */
+#define AVB_PARALLEL_WORKERS 3
+
+typedef struct {
+	AvbOps *Ops;
+	void (*Job)(AvbOps *Ops, void *JobUser, size_t Index);
+	void *JobUser;
+	size_t NumJobs;
+	size_t NextJob;
+} AvbParallelJobs;
+
+STATIC EFI_KERNEL_PROTOCOL *KernIntf = NULL;
+/* Hands out the jobs of AvbRunParallel */
+STATIC LockHandle *LockAvbJobs = NULL;
+/* Serializes the hashing of the jobs, see parallel_lock() */
+STATIC LockHandle *LockAvbHash = NULL;
+
+STATIC VOID AvbParallelRunJobs(AvbParallelJobs *Jobs)
+{
+	size_t Index;
+
+	while (TRUE) {
+		KernIntf->Lock->AcquireLock (LockAvbJobs);
+		Index = Jobs->NextJob;
+		if (Index < Jobs->NumJobs) {
+			Jobs->NextJob++;
+		}
+		KernIntf->Lock->ReleaseLock (LockAvbJobs);
+
+		if (Index >= Jobs->NumJobs) {
+			break;
+		}
+		Jobs->Job (Jobs->Ops, Jobs->JobUser, Index);
+	}
+}
+
+INT32 __attribute__ ( (no_sanitize ("safe-stack")))
+AvbParallelWorkerThread(VOID *Arg)
+{
+	AvbParallelRunJobs ((AvbParallelJobs *)Arg);
+	return 0;
+}
+
+STATIC BOOLEAN AvbParallelInit(VOID)
+{
+	EFI_STATUS Status;
+
+	if (LockAvbHash != NULL) {
+		return TRUE;
+	}
+
+	Status = gBS->LocateProtocol (&gEfiKernelProtocolGuid, NULL,
+	                              (VOID **)&KernIntf);
+	if ((Status != EFI_SUCCESS) ||
+	    (KernIntf == NULL) ||
+	    KernIntf->Version < EFI_KERNEL_PROTOCOL_VER_UNSAFE_STACK_APIS) {
+		DEBUG ((EFI_D_VERBOSE, "Parallel AVB verification is not "
+		        "supported.\n"));
+		KernIntf = NULL;
+		return FALSE;
+	}
+
+	Status = KernIntf->Lock->InitLock ("AVBJOBS", &LockAvbJobs);
+	if (Status != EFI_SUCCESS ||
+	    LockAvbJobs == NULL) {
+		DEBUG ((EFI_D_ERROR, "InitLock LockAvbJobs error \n"));
+		LockAvbJobs = NULL;
+		KernIntf = NULL;
+		return FALSE;
+	}
+
+	Status = KernIntf->Lock->InitLock ("AVBHASH", &LockAvbHash);
+	if (Status != EFI_SUCCESS ||
+	    LockAvbHash == NULL) {
+		DEBUG ((EFI_D_ERROR, "InitLock LockAvbHash error \n"));
+		KernIntf->Lock->DestroyLock (LockAvbJobs);
+		LockAvbJobs = NULL;
+		LockAvbHash = NULL;
+		KernIntf = NULL;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+void AvbRunParallel(AvbOps *Ops, size_t NumJobs,
+                    void (*Job)(AvbOps *Ops, void *JobUser, size_t Index),
+                    void *JobUser)
+{
+	AvbParallelJobs Jobs;
+	Thread *Workers[AVB_PARALLEL_WORKERS];
+	UINT32 NumWorkers = 0;
+	UINT32 Index;
+	INT32 RetCode;
+	UINT64 StartTime = GetTimerCountms ();
+
+	Jobs.Ops = Ops;
+	Jobs.Job = Job;
+	Jobs.JobUser = JobUser;
+	Jobs.NumJobs = NumJobs;
+	Jobs.NextJob = 0;
+
+	/* The calling thread runs jobs as well, so one worker fewer than
+	 * there are jobs is enough.
+	 */
+	while (NumWorkers < AVB_PARALLEL_WORKERS && NumWorkers + 1 < NumJobs) {
+		Workers[NumWorkers] = KernIntf->Thread->ThreadCreate (
+		        "AvbWorkerThread", AvbParallelWorkerThread, (VOID *)&Jobs,
+		        UEFI_THREAD_PRIORITY, DEFAULT_STACK_SIZE);
+		if (Workers[NumWorkers] == NULL) {
+			DEBUG ((EFI_D_ERROR, "Failed to create AVB worker thread\n"));
+			break;
+		}
+
+		AllocateUnSafeStackPtr (Workers[NumWorkers]);
+		if (KernIntf->Thread->ThreadResume (Workers[NumWorkers]) !=
+		    NO_ERROR) {
+			DEBUG ((EFI_D_ERROR, "Failed to start AVB worker thread\n"));
+			/* The thread never ran and cannot be joined: hand it to
+			 * the kernel and free the unsafe stack given to it.
+			 */
+			KernIntf->Thread->ThreadDetach (Workers[NumWorkers]);
+			ThreadStackNodeRemove (Workers[NumWorkers]);
+			ThreadStackReleaseCb (Workers[NumWorkers]);
+			break;
+		}
+		NumWorkers++;
+	}
+
+	AvbParallelRunJobs (&Jobs);
+
+	for (Index = 0; Index < NumWorkers; Index++) {
+		KernIntf->Thread->ThreadJoin (Workers[Index], &RetCode,
+		                              INFINITE_TIME);
+	}
+
+	DEBUG ((EFI_D_INFO, "AVB: %u images loaded and hashed by %u threads in "
+	        "%lu ms\n", (UINT32)NumJobs, NumWorkers + 1,
+	        GetTimerCountms () - StartTime));
+}
+
+void AvbParallelLock(AvbOps *Ops, bool Acquire)
+{
+	if (Acquire) {
+		KernIntf->Lock->AcquireLock (LockAvbHash);
+	} else {
+		KernIntf->Lock->ReleaseLock (LockAvbHash);
+	}
+}
+
 AvbOps *AvbOpsNew(VOID *UserData)
 {
 	AvbOps *Ops = avb_calloc(sizeof(AvbOps));
@@ -620,6 +1003,12 @@ AvbOps *AvbOpsNew(VOID *UserData)
 	Ops->read_is_device_unlocked = AvbReadIsDeviceUnlocked;
 	Ops->get_unique_guid_for_partition = AvbGetUniqueGuidForPartition;
 	Ops->get_size_of_partition = AvbGetSizeOfPartition;
+	Ops->read_from_partition_chunked = AvbReadFromPartitionChunked;
+	if (FixedPcdGetBool (EnableParallelAvbVerify) &&
+	    AvbParallelInit ()) {
+		Ops->run_parallel = AvbRunParallel;
+		Ops->parallel_lock = AvbParallelLock;
+	}
 
 out:
 	return Ops;
@@ -247,6 +247,45 @@ struct AvbOps {
       bool* out_is_trusted,
       uint32_t* out_rollback_index_location);
 
+  /* Reads the first |num_bytes| of partition |partition| into |buffer|
+   * like read_from_partition() with an |offset| of 0. Each piece of
+   * |buffer| is passed to |chunk_cb| with |chunk_user| in order as soon as
+   * it has been read, while the following pieces are still being read.
+   * This lets the caller hash the data as it is loaded.
+   *
+   * This operation is optional, read_from_partition() is used if it is
+   * NULL.
+   */
+  AvbIOResult (*read_from_partition_chunked)(
+      AvbOps* ops,
+      const char* partition,
+      size_t num_bytes,
+      void* buffer,
+      size_t* out_num_read,
+      void (*chunk_cb)(void* chunk_user, const uint8_t* data, size_t len),
+      void* chunk_user);
+
+  /* Calls |job| with |job_user| once for each |index| from 0 to
+   * |num_jobs| - 1, on several CPUs at once where possible, and returns
+   * when all calls have returned. Calls may be made from the calling
+   * thread, and all of them are, if no other CPU can be used.
+   *
+   * This operation is optional, it is only used with
+   * AVB_SLOT_VERIFY_FLAGS_PARALLEL_HASH_VERIFICATION.
+   */
+  void (*run_parallel)(AvbOps* ops,
+                       size_t num_jobs,
+                       void (*job)(AvbOps* ops, void* job_user, size_t index),
+                       void* job_user);
+
+  /* Acquires the lock shared by the jobs of run_parallel() if |acquire| is
+   * true, releases it otherwise. Jobs hold it while they hash, so that
+   * avb_sha256_*() and avb_sha512_*() need not support several contexts
+   * at once.
+   *
+   * This operation is required if run_parallel() is set.
+   */
+  void (*parallel_lock)(AvbOps* ops, bool acquire);
 };
 
 typedef struct {
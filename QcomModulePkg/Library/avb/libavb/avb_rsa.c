@@ -185,7 +185,7 @@ static void modpowF4(const Key* key, uint8_t* inout) {
 
   /* Convert from big endian byte array to little endian word array. */
   for (i = 0; i < (int)key->len; ++i) {
-    uint32_t tmp = (inout[((key->len - 1 - i) * 4) + 0] << 24) |
+    uint32_t tmp = ((uint32_t)inout[((key->len - 1 - i) * 4) + 0] << 24) |
                    (inout[((key->len - 1 - i) * 4) + 1] << 16) |
                    (inout[((key->len - 1 - i) * 4) + 2] << 8) |
                    (inout[((key->len - 1 - i) * 4) + 3] << 0);
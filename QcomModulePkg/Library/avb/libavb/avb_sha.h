@@ -51,6 +51,7 @@ typedef struct {
   uint8_t block[2 * AVB_SHA256_BLOCK_SIZE];
   uint8_t buf[AVB_SHA256_DIGEST_SIZE]; /* Used for storing the final digest. */
   void *user_data;
+  uint32_t engine; /* Which implementation the platform picked. */
 } AvbSHA256Ctx;
 
 /* Data structure used for SHA-512. */
@@ -71,6 +72,27 @@ void avb_sha256_update(AvbSHA256Ctx* ctx, const uint8_t* data, uint32_t len);
 /* Returns the SHA-256 digest. */
 uint8_t* avb_sha256_final(AvbSHA256Ctx* ctx) AVB_ATTR_WARN_UNUSED_RESULT;
 
+/* Returns false if the last avb_sha256_final() on |ctx| could not compute
+ * the digest. Only a platform implementation of SHA-256 can fail. */
+bool avb_sha256_final_ok(const AvbSHA256Ctx* ctx);
+
+/* Drops |ctx| without computing the digest, which gives back a hash engine
+ * the platform may hold for it. Needed on any path that does not reach
+ * avb_sha256_final() after an update, harmless after it. */
+void avb_sha256_abort(AvbSHA256Ctx* ctx);
+
+/* Software SHA-256, for platforms that provide avb_sha256_init() and
+ * friends themselves and fall back to it. */
+void avb_sha256_sw_init(AvbSHA256Ctx* ctx);
+void avb_sha256_sw_update(AvbSHA256Ctx* ctx, const uint8_t* data, uint32_t len);
+uint8_t* avb_sha256_sw_final(AvbSHA256Ctx* ctx) AVB_ATTR_WARN_UNUSED_RESULT;
+
+/* Runs the compression function on |block_nb| blocks of |data| with
+ * hardware support if the platform has it. Returns false if it does not,
+ * the software transform is used then. */
+bool avb_sha256_blocks_accel(uint32_t* h, const uint8_t* data, size_t block_nb);
+bool avb_sha512_blocks_accel(uint64_t* h, const uint8_t* data, size_t block_nb);
+
 /* Initializes the SHA-512 context. */
 void avb_sha512_init(AvbSHA512Ctx* ctx);
 
@@ -100,7 +100,7 @@ static const uint32_t sha256_k[64] = {
     0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
 
 /* SHA-256 implementation */
-void avb_sha256_init(AvbSHA256Ctx* ctx) {
+void avb_sha256_sw_init(AvbSHA256Ctx* ctx) {
 #ifndef UNROLL_LOOPS
   int i;
   for (i = 0; i < 8; i++) {
@@ -134,6 +134,10 @@ static void SHA256_transform(AvbSHA256Ctx* ctx,
   int j;
 #endif
 
+  if (block_nb == 0 || avb_sha256_blocks_accel(ctx->h, message, block_nb)) {
+    return;
+  }
+
   for (i = 0; i < (int)block_nb; i++) {
     sub_block = message + (i << 6);
 
@@ -320,7 +324,9 @@ static void SHA256_transform(AvbSHA256Ctx* ctx,
   }
 }
 
-void avb_sha256_update(AvbSHA256Ctx* ctx, const uint8_t* data, uint32_t len) {
+void avb_sha256_sw_update(AvbSHA256Ctx* ctx,
+                          const uint8_t* data,
+                          uint32_t len) {
   unsigned int block_nb;
   unsigned int new_len, rem_len, tmp_len;
   const uint8_t* shifted_data;
@@ -351,7 +357,7 @@ void avb_sha256_update(AvbSHA256Ctx* ctx, const uint8_t* data, uint32_t len) {
   ctx->tot_len += (block_nb + 1) << 6;
 }
 
-uint8_t* avb_sha256_final(AvbSHA256Ctx* ctx) {
+uint8_t* avb_sha256_sw_final(AvbSHA256Ctx* ctx) {
   unsigned int block_nb;
   unsigned int pm_len;
   unsigned int len_b;
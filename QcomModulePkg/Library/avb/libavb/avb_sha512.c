@@ -161,6 +161,10 @@ static void SHA512_transform(AvbSHA512Ctx* ctx,
   const uint8_t* sub_block;
   int i, j;
 
+  if (block_nb == 0 || avb_sha512_blocks_accel(ctx->h, message, block_nb)) {
+    return;
+  }
+
   for (i = 0; i < (int)block_nb; i++) {
     sub_block = message + (i << 7);
 
@@ -98,43 +98,83 @@ static inline bool result_should_continue(AvbSlotVerifyResult result) {
   return false;
 }
 
-static AvbSlotVerifyResult load_and_verify_hash_partition(
+/* Hash state of an image that is hashed while it is being loaded. Only the
+ * first |hash_left| bytes loaded belong to the hashed image.
+ */
+typedef struct {
+  AvbSHA256Ctx* sha256_ctx;
+  AvbSHA512Ctx* sha512_ctx;
+  uint64_t hash_left;
+} HashChunkData;
+
+static void hash_chunk(void* chunk_user, const uint8_t* data, size_t len) {
+  HashChunkData* hash_data = (HashChunkData*)chunk_user;
+
+  if (len > hash_data->hash_left) {
+    len = hash_data->hash_left;
+  }
+  if (len == 0) {
+    return;
+  }
+
+  if (hash_data->sha256_ctx != NULL) {
+    avb_sha256_update(hash_data->sha256_ctx, data, len);
+  } else {
+    avb_sha512_update(hash_data->sha512_ctx, data, len);
+  }
+  hash_data->hash_left -= len;
+}
+
+/* The image of a hash descriptor. Jobs are prepared and added to
+ * |slot_data| in descriptor order, hash_partition_load() may run for
+ * several of them at once, see run_parallel().
+ */
+typedef struct {
+  AvbSlotVerifyResult ret;
+  AvbHashDescriptor hash_desc;
+  const uint8_t* desc_salt;
+  const uint8_t* desc_digest;
+  char part_name[PART_NAME_MAX_SIZE];
+  const char* found;
+  uint64_t image_size;
+  uint8_t* image_buf;
+  bool sha512;
+  bool boot_stats;
+  bool parallel;
+} HashPartitionJob;
+
+static bool bootImgLoaded = FALSE;
+static bool vendorBootImgLoaded = FALSE;
+
+/* Validates |descriptor| and allocates the buffer its image is loaded
+ * into. |job->image_buf| is left NULL if the partition was not requested.
+ */
+static AvbSlotVerifyResult hash_partition_prepare(
     AvbOps* ops,
     const char* const* requested_partitions,
     const char* ab_suffix,
     bool allow_verification_error,
     const AvbDescriptor* descriptor,
-    AvbSlotVerifyData* slot_data) {
-  AvbHashDescriptor hash_desc;
-  AvbSHA256Ctx sha256_ctx;
-  AvbSHA512Ctx sha512_ctx;
+    HashPartitionJob* job) {
   const uint8_t* desc_partition_name = NULL;
-  const uint8_t* desc_salt;
-  const uint8_t* desc_digest;
-  char part_name[PART_NAME_MAX_SIZE];
   AvbSlotVerifyResult ret;
   AvbIOResult io_ret;
-  uint8_t* image_buf = NULL;
-  size_t part_num_read;
-  uint8_t* digest;
-  size_t digest_len;
-  const char* found;
-  uint64_t image_size;
-  static bool bootImgLoaded = FALSE;
-  static bool vendorBootImgLoaded = FALSE;
+
+  avb_memset(job, 0, sizeof(*job));
 
   if (!avb_hash_descriptor_validate_and_byteswap(
-          (const AvbHashDescriptor*)descriptor, &hash_desc)) {
+          (const AvbHashDescriptor*)descriptor, &job->hash_desc)) {
     ret = AVB_SLOT_VERIFY_RESULT_ERROR_INVALID_METADATA;
     goto out;
   }
 
   desc_partition_name =
       ((const uint8_t*)descriptor) + sizeof(AvbHashDescriptor);
-  desc_salt = desc_partition_name + hash_desc.partition_name_len;
-  desc_digest = desc_salt + hash_desc.salt_len;
+  job->desc_salt = desc_partition_name + job->hash_desc.partition_name_len;
+  job->desc_digest = job->desc_salt + job->hash_desc.salt_len;
 
-  if (!avb_validate_utf8(desc_partition_name, hash_desc.partition_name_len)) {
+  if (!avb_validate_utf8(desc_partition_name,
+                         job->hash_desc.partition_name_len)) {
     avb_error("Partition name is not valid UTF-8.\n");
     ret = AVB_SLOT_VERIFY_RESULT_ERROR_INVALID_METADATA;
     goto out;
@@ -143,18 +183,18 @@ static AvbSlotVerifyResult load_and_verify_hash_partition(
   /* Don't bother loading or validating unless the partition was
    * requested in the first place.
    */
-  found = avb_strv_find_str(requested_partitions,
-                            (const char*)desc_partition_name,
-                            hash_desc.partition_name_len);
-  if (found == NULL) {
+  job->found = avb_strv_find_str(requested_partitions,
+                                 (const char*)desc_partition_name,
+                                 job->hash_desc.partition_name_len);
+  if (job->found == NULL) {
     ret = AVB_SLOT_VERIFY_RESULT_OK;
     goto out;
   }
 
-  if (!avb_str_concat(part_name,
-                      sizeof part_name,
+  if (!avb_str_concat(job->part_name,
+                      sizeof job->part_name,
                       (const char*)desc_partition_name,
-                      hash_desc.partition_name_len,
+                      job->hash_desc.partition_name_len,
                       ab_suffix,
                       avb_strlen(ab_suffix))) {
     avb_error("Partition name and suffix does not fit.\n");
@@ -170,35 +210,135 @@ static AvbSlotVerifyResult load_and_verify_hash_partition(
    * boot /path/to/new/and/bigger/boot.img'. We want this to work
    * since it's such a common workflow.
    */
-  image_size = hash_desc.image_size;
+  job->image_size = job->hash_desc.image_size;
   if (allow_verification_error) {
-    io_ret = ops->get_size_of_partition (ops, part_name, &image_size);
+    io_ret = ops->get_size_of_partition (ops, job->part_name,
+                                         &job->image_size);
     if (io_ret == AVB_IO_RESULT_ERROR_OOM) {
       ret = AVB_SLOT_VERIFY_RESULT_ERROR_OOM;
       goto out;
     } else if (io_ret != AVB_IO_RESULT_OK) {
-      avb_errorv (part_name, ": Error determining partition size.\n", NULL);
+      avb_errorv (job->part_name, ": Error determining partition size.\n",
+                  NULL);
       ret = AVB_SLOT_VERIFY_RESULT_ERROR_IO;
       goto out;
     }
-    avb_debugv (part_name, ": Loading entire partition.\n", NULL);
+    avb_debugv (job->part_name, ": Loading entire partition.\n", NULL);
+  }
+
+  if (Avb_StrnCmp ( (CONST CHAR8*)job->hash_desc.hash_algorithm, "sha256",
+                 avb_strlen ("sha256")) == 0) {
+    job->sha512 = false;
+  } else if (Avb_StrnCmp ( (CONST CHAR8*)job->hash_desc.hash_algorithm,
+                  "sha512", avb_strlen ("sha512")) == 0) {
+    job->sha512 = true;
+  } else {
+    avb_errorv(job->part_name, ": Unsupported hash algorithm.\n", NULL);
+    ret = AVB_SLOT_VERIFY_RESULT_ERROR_INVALID_METADATA;
+    goto out;
   }
 
-  image_buf = avb_malloc(image_size);
-  if (image_buf == NULL) {
+  job->image_buf = avb_malloc(job->image_size);
+  if (job->image_buf == NULL) {
     ret = AVB_SLOT_VERIFY_RESULT_ERROR_OOM;
     goto out;
   }
 
-  if ((Avb_StrnCmp ("boot", part_name, 4) == 0 &&
-      !bootImgLoaded) ||
-      (Avb_StrnCmp ("vendor_boot", part_name, 11) == 0 &&
-      !vendorBootImgLoaded)) {
+  job->boot_stats = (Avb_StrnCmp ("boot", job->part_name, 4) == 0 &&
+                     !bootImgLoaded) ||
+                    (Avb_StrnCmp ("vendor_boot", job->part_name, 11) == 0 &&
+                     !vendorBootImgLoaded);
+
+  ret = AVB_SLOT_VERIFY_RESULT_OK;
+
+out:
+  job->ret = ret;
+  return ret;
+}
+
+static void hash_partition_start(HashPartitionJob* job,
+                                 HashChunkData* hash_data,
+                                 AvbSHA256Ctx* sha256_ctx,
+                                 AvbSHA512Ctx* sha512_ctx) {
+  avb_memset(hash_data, 0, sizeof(*hash_data));
+  if (!job->sha512) {
+    avb_sha256_init(sha256_ctx);
+    avb_sha256_update(sha256_ctx, job->desc_salt, job->hash_desc.salt_len);
+    hash_data->sha256_ctx = sha256_ctx;
+  } else {
+    avb_sha512_init(sha512_ctx);
+    avb_sha512_update(sha512_ctx, job->desc_salt, job->hash_desc.salt_len);
+    hash_data->sha512_ctx = sha512_ctx;
+  }
+  hash_data->hash_left = job->hash_desc.image_size;
+}
+
+static uint8_t* hash_partition_final(HashChunkData* hash_data) {
+  if (hash_data->sha256_ctx != NULL) {
+    return avb_sha256_final(hash_data->sha256_ctx);
+  }
+  return avb_sha512_final(hash_data->sha512_ctx);
+}
+
+/* Drops a hash that was started but may not have reached its final. */
+static void hash_partition_abort(HashChunkData* hash_data) {
+  if (hash_data->sha256_ctx != NULL) {
+    avb_sha256_abort(hash_data->sha256_ctx);
+  }
+}
+
+/* Loads the image of a prepared |job| and checks it against the digest of
+ * its descriptor. Only |job| is changed, and the hash is computed under
+ * parallel_lock() if |job->parallel| is set.
+ */
+static void hash_partition_load(AvbOps* ops, HashPartitionJob* job) {
+  AvbSHA256Ctx sha256_ctx;
+  AvbSHA512Ctx sha512_ctx;
+  HashChunkData hash_data;
+  AvbSlotVerifyResult ret;
+  AvbIOResult io_ret;
+  size_t part_num_read;
+  uint8_t* digest;
+  size_t digest_len;
+  const char* part_name = job->part_name;
+
+  if (job->boot_stats) {
     BootStatsSetTimeStamp (BS_KERNEL_LOAD_START);
   }
 
-  io_ret = ops->read_from_partition(
-      ops, part_name, 0 /* offset */, image_size, image_buf, &part_num_read);
+  /* The hash is started before loading so that the image can be hashed
+   * while it is read, if the platform supports that. Parallel jobs share
+   * the hash, so they load the whole image first.
+   */
+  if (job->parallel) {
+    io_ret = ops->read_from_partition(ops,
+                                      part_name,
+                                      0 /* offset */,
+                                      job->image_size,
+                                      job->image_buf,
+                                      &part_num_read);
+  } else {
+    hash_partition_start(job, &hash_data, &sha256_ctx, &sha512_ctx);
+    if (ops->read_from_partition_chunked != NULL) {
+      io_ret = ops->read_from_partition_chunked(ops,
+                                                part_name,
+                                                job->image_size,
+                                                job->image_buf,
+                                                &part_num_read,
+                                                hash_chunk,
+                                                &hash_data);
+    } else {
+      io_ret = ops->read_from_partition(ops,
+                                        part_name,
+                                        0 /* offset */,
+                                        job->image_size,
+                                        job->image_buf,
+                                        &part_num_read);
+      if (io_ret == AVB_IO_RESULT_OK) {
+        hash_chunk(&hash_data, job->image_buf, part_num_read);
+      }
+    }
+  }
   if (io_ret == AVB_IO_RESULT_ERROR_OOM) {
     ret = AVB_SLOT_VERIFY_RESULT_ERROR_OOM;
     goto out;
@@ -207,50 +347,40 @@ static AvbSlotVerifyResult load_and_verify_hash_partition(
     ret = AVB_SLOT_VERIFY_RESULT_ERROR_IO;
     goto out;
   }
-  if (part_num_read != image_size) {
+  if (part_num_read != job->image_size) {
     avb_errorv(part_name, ": Read fewer than requested bytes.\n", NULL);
     ret = AVB_SLOT_VERIFY_RESULT_ERROR_IO;
     goto out;
   }
 
-  if (Avb_StrnCmp ("boot", part_name, 4) == 0 &&
-      !bootImgLoaded) {
-    bootImgLoaded = TRUE;
-    BootStatsSetTimeStamp (BS_KERNEL_LOAD_DONE);
-  } else if (Avb_StrnCmp ("vendor_boot", part_name, 11) == 0 &&
-            !vendorBootImgLoaded) {
-    vendorBootImgLoaded = TRUE;
+  if (job->boot_stats) {
+    if (Avb_StrnCmp ("boot", part_name, 4) == 0) {
+      bootImgLoaded = TRUE;
+    } else {
+      vendorBootImgLoaded = TRUE;
+    }
     BootStatsSetTimeStamp (BS_KERNEL_LOAD_DONE);
   }
 
-  if (Avb_StrnCmp ( (CONST CHAR8*)hash_desc.hash_algorithm, "sha256",
-                 avb_strlen ("sha256")) == 0) {
-    avb_sha256_init(&sha256_ctx);
-    avb_sha256_update(&sha256_ctx, desc_salt, hash_desc.salt_len);
-    avb_sha256_update(&sha256_ctx, image_buf, hash_desc.image_size);
-    digest = avb_sha256_final(&sha256_ctx);
-    digest_len = AVB_SHA256_DIGEST_SIZE;
-  } else if (Avb_StrnCmp ( (CONST CHAR8*)hash_desc.hash_algorithm, "sha512",
-                  avb_strlen ("sha512")) == 0) {
-    avb_sha512_init(&sha512_ctx);
-    avb_sha512_update(&sha512_ctx, desc_salt, hash_desc.salt_len);
-    avb_sha512_update(&sha512_ctx, image_buf, hash_desc.image_size);
-    digest = avb_sha512_final(&sha512_ctx);
-    digest_len = AVB_SHA512_DIGEST_SIZE;
+  if (job->parallel) {
+    ops->parallel_lock(ops, true);
+    hash_partition_start(job, &hash_data, &sha256_ctx, &sha512_ctx);
+    hash_chunk(&hash_data, job->image_buf, part_num_read);
+    digest = hash_partition_final(&hash_data);
+    ops->parallel_lock(ops, false);
   } else {
-    avb_errorv(part_name, ": Unsupported hash algorithm.\n", NULL);
-    ret = AVB_SLOT_VERIFY_RESULT_ERROR_INVALID_METADATA;
-    goto out;
+    digest = hash_partition_final(&hash_data);
   }
+  digest_len = job->sha512 ? AVB_SHA512_DIGEST_SIZE : AVB_SHA256_DIGEST_SIZE;
 
-  if (digest_len != hash_desc.digest_len) {
+  if (digest_len != job->hash_desc.digest_len) {
     avb_errorv(
         part_name, ": Digest in descriptor not of expected size.\n", NULL);
     ret = AVB_SLOT_VERIFY_RESULT_ERROR_INVALID_METADATA;
     goto out;
   }
 
-  if (avb_safe_memcmp(digest, desc_digest, digest_len) != 0) {
+  if (avb_safe_memcmp(digest, job->desc_digest, digest_len) != 0) {
     avb_errorv(part_name,
                ": Hash of data does not match digest in descriptor.\n",
                NULL);
@@ -263,31 +393,125 @@ static AvbSlotVerifyResult load_and_verify_hash_partition(
   ret = AVB_SLOT_VERIFY_RESULT_OK;
 
 out:
+  /* A failed read leaves the hash started while the image was read */
+  if (ret != AVB_SLOT_VERIFY_RESULT_OK && !job->parallel) {
+    hash_partition_abort(&hash_data);
+  }
+  job->ret = ret;
+}
+
+/* Adds the image of |job| to |slot_data| if it was loaded, frees it
+ * otherwise. Returns the result of the job.
+ */
+static AvbSlotVerifyResult hash_partition_finish(
+    HashPartitionJob* job, AvbSlotVerifyData* slot_data) {
+  AvbSlotVerifyResult ret = job->ret;
 
   /* If it worked and something was loaded, copy to slot_data. */
   if ((ret == AVB_SLOT_VERIFY_RESULT_OK || result_should_continue(ret)) &&
-      image_buf != NULL) {
+      job->image_buf != NULL) {
     AvbPartitionData* loaded_partition;
     if (slot_data->num_loaded_partitions == MAX_NUMBER_OF_LOADED_PARTITIONS) {
-      avb_errorv(part_name, ": Too many loaded partitions.\n", NULL);
+      avb_errorv(job->part_name, ": Too many loaded partitions.\n", NULL);
       ret = AVB_SLOT_VERIFY_RESULT_ERROR_OOM;
       goto fail;
     }
     loaded_partition =
         &slot_data->loaded_partitions[slot_data->num_loaded_partitions++];
-    loaded_partition->partition_name = avb_strdup(found);
-    loaded_partition->data_size = image_size;
-    loaded_partition->data = image_buf;
-    image_buf = NULL;
+    loaded_partition->partition_name = avb_strdup(job->found);
+    loaded_partition->data_size = job->image_size;
+    loaded_partition->data = job->image_buf;
+    job->image_buf = NULL;
   }
 
 fail:
-  if (image_buf != NULL) {
-    avb_free(image_buf);
+  if (job->image_buf != NULL) {
+    avb_free(job->image_buf);
+    job->image_buf = NULL;
   }
   return ret;
 }
 
+static AvbSlotVerifyResult load_and_verify_hash_partition(
+    AvbOps* ops,
+    const char* const* requested_partitions,
+    const char* ab_suffix,
+    bool allow_verification_error,
+    const AvbDescriptor* descriptor,
+    AvbSlotVerifyData* slot_data) {
+  HashPartitionJob job;
+
+  if (hash_partition_prepare(ops,
+                             requested_partitions,
+                             ab_suffix,
+                             allow_verification_error,
+                             descriptor,
+                             &job) == AVB_SLOT_VERIFY_RESULT_OK &&
+      job.image_buf != NULL) {
+    hash_partition_load(ops, &job);
+  }
+  return hash_partition_finish(&job, slot_data);
+}
+
+static void hash_partition_run(AvbOps* ops, void* job_user, size_t index) {
+  HashPartitionJob* job = &((HashPartitionJob*)job_user)[index];
+
+  if (job->image_buf != NULL) {
+    hash_partition_load(ops, job);
+  }
+}
+
+/* Prepares the hash descriptors in |descriptors| up to the first one that
+ * cannot be prepared, and loads their images through run_parallel(). The
+ * jobs are returned in descriptor order, to be passed to
+ * hash_partition_finish() as the descriptors are walked. Returns NULL if
+ * the jobs could not be allocated.
+ */
+static HashPartitionJob* load_hash_partitions_parallel(
+    AvbOps* ops,
+    const char* const* requested_partitions,
+    const char* ab_suffix,
+    bool allow_verification_error,
+    const AvbDescriptor** descriptors,
+    size_t num_descriptors,
+    size_t* out_num_jobs) {
+  HashPartitionJob* jobs;
+  size_t num_jobs = 0;
+  size_t n;
+
+  jobs = avb_calloc(num_descriptors * sizeof(HashPartitionJob));
+  if (jobs == NULL) {
+    return NULL;
+  }
+
+  for (n = 0; n < num_descriptors; n++) {
+    AvbDescriptor desc;
+
+    if (!avb_descriptor_validate_and_byteswap(descriptors[n], &desc)) {
+      break;
+    }
+    if (desc.tag != AVB_DESCRIPTOR_TAG_HASH) {
+      continue;
+    }
+
+    if (hash_partition_prepare(ops,
+                               requested_partitions,
+                               ab_suffix,
+                               allow_verification_error,
+                               descriptors[n],
+                               &jobs[num_jobs++]) !=
+        AVB_SLOT_VERIFY_RESULT_OK) {
+      break;
+    }
+    jobs[num_jobs - 1].parallel = true;
+  }
+
+  ops->run_parallel(ops, num_jobs, hash_partition_run, jobs);
+
+  *out_num_jobs = num_jobs;
+  return jobs;
+}
+
 static AvbSlotVerifyResult load_requested_partitions(
     AvbOps* ops,
     const char* const* requested_partitions,
@@ -404,6 +628,9 @@ static AvbSlotVerifyResult load_and_verify_vbmeta(
   const AvbDescriptor** descriptors = NULL;
   size_t num_descriptors;
   size_t n;
+  HashPartitionJob* hash_jobs = NULL;
+  size_t num_hash_jobs = 0;
+  size_t next_hash_job = 0;
   bool is_main_vbmeta;
   bool look_for_vbmeta_footer;
   AvbVBMetaData* vbmeta_image_data = NULL;
@@ -787,6 +1014,21 @@ static AvbSlotVerifyResult load_and_verify_vbmeta(
   if (descriptors == NULL) {
       goto out;
   }
+
+  /* The images of the hash descriptors are loaded up front, and added to
+   * |slot_data| as their descriptors are reached below.
+   */
+  if ((flags & AVB_SLOT_VERIFY_FLAGS_PARALLEL_HASH_VERIFICATION) &&
+      ops->run_parallel != NULL && ops->parallel_lock != NULL) {
+    hash_jobs = load_hash_partitions_parallel(ops,
+                                              requested_partitions,
+                                              ab_suffix,
+                                              allow_verification_error,
+                                              descriptors,
+                                              num_descriptors,
+                                              &num_hash_jobs);
+  }
+
   for (n = 0; n < num_descriptors; n++) {
     AvbDescriptor desc;
 
@@ -799,12 +1041,17 @@ static AvbSlotVerifyResult load_and_verify_vbmeta(
     switch (desc.tag) {
       case AVB_DESCRIPTOR_TAG_HASH: {
         AvbSlotVerifyResult sub_ret;
-        sub_ret = load_and_verify_hash_partition(ops,
-                                                 requested_partitions,
-                                                 ab_suffix,
-                                                 allow_verification_error,
-                                                 descriptors[n],
-                                                 slot_data);
+        if (next_hash_job < num_hash_jobs) {
+          sub_ret =
+              hash_partition_finish(&hash_jobs[next_hash_job++], slot_data);
+        } else {
+          sub_ret = load_and_verify_hash_partition(ops,
+                                                   requested_partitions,
+                                                   ab_suffix,
+                                                   allow_verification_error,
+                                                   descriptors[n],
+                                                   slot_data);
+        }
         if (sub_ret != AVB_SLOT_VERIFY_RESULT_OK) {
           ret = sub_ret;
           if (!allow_verification_error || !result_should_continue(ret)) {
@@ -983,6 +1230,15 @@ out:
   if (descriptors != NULL) {
     avb_free(descriptors);
   }
+  if (hash_jobs != NULL) {
+    /* Images of descriptors after a failed one are not used */
+    for (n = next_hash_job; n < num_hash_jobs; n++) {
+      if (hash_jobs[n].image_buf != NULL) {
+        avb_free(hash_jobs[n].image_buf);
+      }
+    }
+    avb_free(hash_jobs);
+  }
   return ret;
 }
 
@@ -1262,6 +1518,7 @@ static AvbSlotVerifyResult append_options(
                               "androidboot.vbmeta.digest",
                               avb_sha256_final(&ctx),
                               AVB_SHA256_DIGEST_SIZE)) {
+        avb_sha256_abort(&ctx);
         ret = AVB_SLOT_VERIFY_RESULT_ERROR_OOM;
         goto out;
       }
@@ -108,12 +108,19 @@ typedef enum {
  * vbmeta structs. This flag is useful when booting into recovery on a device
  * not using A/B - see section "Booting into recovery" in README.md for
  * more information.
+ *
+ * If the AVB_SLOT_VERIFY_FLAGS_PARALLEL_HASH_VERIFICATION flag is set and
+ * the |run_parallel| and |parallel_lock| operations are available, the
+ * images of the hash descriptors of each vbmeta struct are loaded and
+ * hashed at the same time through |run_parallel|. |out_data| and the
+ * result are the same as without the flag.
  */
 typedef enum {
   AVB_SLOT_VERIFY_FLAGS_NONE = 0,
   AVB_SLOT_VERIFY_FLAGS_ALLOW_VERIFICATION_ERROR = (1 << 0),
   AVB_SLOT_VERIFY_FLAGS_RESTART_CAUSED_BY_HASHTREE_CORRUPTION = (1 << 1),
   AVB_SLOT_VERIFY_FLAGS_NO_VBMETA_PARTITION = (1 << 2),
+  AVB_SLOT_VERIFY_FLAGS_PARALLEL_HASH_VERIFICATION = (1 << 3),
 } AvbSlotVerifyFlags;
 
 /* Get a textual representation of |result|. */
@@ -22,14 +22,19 @@
  * SOFTWARE.
  */
 
+/* The POSIX implementation of avb_sysdeps.h, for running libavb on the
+ * build machine. avb_sysdeps.h is not included: its types come from the
+ * EDK2 Base.h and clash with those of the C library. The definitions below
+ * match its prototypes on LP64 hosts, where UINTN and size_t are both
+ * unsigned 64 bit integers.
+ */
+
 #include <endian.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#include "avb_sysdeps.h"
-
 int avb_memcmp(const void* src1, const void* src2, size_t n) {
   return memcmp(src1, src2, n);
 }
@@ -46,6 +51,10 @@ int avb_strcmp(const char* s1, const char* s2) {
   return strcmp(s1, s2);
 }
 
+int Avb_StrnCmp(const char* s1, const char* s2, size_t n) {
+  return strncmp(s1, s2, n);
+}
+
 size_t avb_strlen(const char* str) {
   return strlen(str);
 }
@@ -54,11 +63,11 @@ void avb_abort(void) {
   abort();
 }
 
-void avb_print(const char* message) {
+void avb_print(size_t error_level, const char* message) {
   fprintf(stderr, "%s", message);
 }
 
-void avb_printv(const char* message, ...) {
+void avb_printv(size_t error_level, const char* message, ...) {
   va_list ap;
   const char* m;
 
@@ -270,9 +270,25 @@ char* avb_replace(const char* str,
                   const char* search,
                   const char* replace) AVB_ATTR_WARN_UNUSED_RESULT;
 
+/* Builds the tables the CRC-32 functions below use to process 8 bytes at
+ * a time. Call it once before they may run on several threads, they work
+ * a byte at a time until then.
+ */
+void avb_crc32_init(void);
+
 /* Calculates the CRC-32 for data in |buf| of size |buf_size|. */
 uint32_t avb_crc32(const uint8_t* buf, size_t buf_size);
 
+/* Updates the CRC-32 |crc| of preceding data, 0 for none, with the data
+ * in |buf| of size |buf_size|.
+ */
+uint32_t avb_crc32_update(uint32_t crc, const uint8_t* buf, size_t buf_size);
+
+/* Updates the CRC-32 |crc| of preceding data with |len| zero bytes,
+ * without feeding them one by one.
+ */
+uint32_t avb_crc32_zeros(uint32_t crc, uint64_t len);
+
 /* Returns the basename of |str|. This is defined as the last path
  * component, assuming the normal POSIX separator '/'. If there are no
  * separators, returns |str|.
@@ -75,6 +75,14 @@ unsigned start;         /* inflate()'s starting value for strm->avail_out */
     unsigned dist;              /* match distance */
     unsigned char FAR *from;    /* where to copy match from */
 
+#ifdef INFLATE_FAST_WIDE
+    if (strm->avail_in >= INFLATE_FAST_WIDE_MIN_IN &&
+        strm->avail_out >= INFLATE_FAST_WIDE_MIN_OUT) {
+        inflate_fast_wide(strm, start);
+        return;
+    }
+#endif
+
     /* copy state to local variables */
     state = (struct inflate_state FAR *)strm->state;
     in = strm->next_in;
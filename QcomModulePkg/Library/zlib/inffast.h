@@ -9,3 +9,18 @@
  */
 
 void ZLIB_INTERNAL inflate_fast OF((z_streamp strm, unsigned start));
+
+/* The wide fast path needs a 64-bit little-endian bit buffer */
+#if defined(INFLATE_FAST_WIDE) && \
+    !(defined(__LP64__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#  undef INFLATE_FAST_WIDE
+#endif
+
+#ifdef INFLATE_FAST_WIDE
+/* one 8-byte refill per code, and a 258 byte match plus the overrun of a
+   16-byte copy */
+#  define INFLATE_FAST_WIDE_MIN_IN 8
+#  define INFLATE_FAST_WIDE_MIN_OUT (258 + 16)
+
+void ZLIB_INTERNAL inflate_fast_wide OF((z_streamp strm, unsigned start));
+#endif
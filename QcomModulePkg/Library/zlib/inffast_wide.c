@@ -0,0 +1,342 @@
+/* inffast_wide.c -- fast decoding with a 64-bit bit buffer and wide copies
+ * Copyright (C) 1995-2008, 2010, 2013 Mark Adler
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+#include "zutil.h"
+#include "inftrees.h"
+#include "inflate.h"
+#include "inffast.h"
+
+#ifdef INFLATE_FAST_WIDE
+
+/*
+   Variant of inflate_fast() for 64-bit little-endian targets, selected by
+   inflate_fast() when INFLATE_FAST_WIDE is defined and there is enough room
+   around the input and output pointers.
+
+   - The bit buffer is refilled with one unaligned 8-byte load per code, which
+     leaves at least 56 valid bits.  A length/distance pair needs at most 48
+     bits, so no further refills are needed while decoding it.  The bytes
+     above the valid bits are the following input bytes, so OR-ing in the
+     next load is exact.
+
+   - Where unaligned loads are not allowed (-mstrict-align, which leaves
+     __ARM_FEATURE_UNALIGNED undefined), the compiler would split that load
+     into eight byte loads.  INFLATE_FAST_ALIGNED instead loads the two
+     aligned words holding the first and the last of the 8 bytes and
+     shifts them together.  Both words hold an input byte, so they cannot
+     fault, but they may cover bytes around the input buffer.
+
+   - Matches with a distance of at least INFLATE_FAST_CHUNK are copied in
+     INFLATE_FAST_CHUNK byte pieces, which the compiler turns into 128-bit
+     NEON loads and stores on AArch64.  The last piece may write up to
+     INFLATE_FAST_CHUNK - 1 bytes past the match; they are overwritten by
+     the following output.  Distance 1 runs are filled 8 bytes at a time.
+
+   Entry assumptions, in addition to those of inflate_fast():
+
+        strm->avail_in >= INFLATE_FAST_WIDE_MIN_IN
+        strm->avail_out >= INFLATE_FAST_WIDE_MIN_OUT
+ */
+
+#define INFLATE_FAST_CHUNK 16
+
+#if defined(__aarch64__) && !defined(__ARM_FEATURE_UNALIGNED)
+#  define INFLATE_FAST_ALIGNED
+#endif
+
+typedef unsigned long long wide_t;
+
+#ifdef INFLATE_FAST_ALIGNED
+/* the words may reach outside the input buffer, see above */
+__attribute__((no_sanitize_address))
+local wide_t load_wide(const unsigned char FAR *p)
+{
+    const unsigned char FAR *lo = (const unsigned char FAR *)
+                                  ((unsigned long)p & ~7UL);
+    const unsigned char FAR *hi = (const unsigned char FAR *)
+                                  ((unsigned long)(p + 7) & ~7UL);
+    unsigned shift = ((unsigned)(unsigned long)p & 7) << 3;
+    wide_t l, h;
+
+    __builtin_memcpy(&l, __builtin_assume_aligned(lo, 8), sizeof(l));
+    __builtin_memcpy(&h, __builtin_assume_aligned(hi, 8), sizeof(h));
+    /* hi is lo when p is aligned, the two shifts then drop it */
+    return (l >> shift) | ((h << 1) << (63 - shift));
+}
+#else
+local wide_t load_wide(const unsigned char FAR *p)
+{
+    wide_t v;
+
+    __builtin_memcpy(&v, p, sizeof(v));
+    return v;
+}
+#endif
+
+/* copy len bytes from out - dist to out, dist >= INFLATE_FAST_CHUNK */
+local unsigned char FAR *chunk_copy(unsigned char FAR *out,
+                                    const unsigned char FAR *from,
+                                    unsigned len)
+{
+    unsigned char FAR *stop = out + len;
+
+    do {
+        __builtin_memcpy(out, from, INFLATE_FAST_CHUNK);
+        out += INFLATE_FAST_CHUNK;
+        from += INFLATE_FAST_CHUNK;
+    } while (out < stop);
+    return stop;
+}
+
+/* copy a match of len bytes at distance dist from the output itself */
+local unsigned char FAR *match_copy(unsigned char FAR *out,
+                                    unsigned len,
+                                    unsigned dist)
+{
+    const unsigned char FAR *from = out - dist;
+
+    if (dist >= INFLATE_FAST_CHUNK)
+        return chunk_copy(out, from, len);
+    if (dist == 1) {
+        unsigned char FAR *stop = out + len;
+        wide_t fill = *from * 0x0101010101010101ULL;
+
+        do {
+            __builtin_memcpy(out, &fill, sizeof(fill));
+            out += sizeof(fill);
+        } while (out < stop);
+        return stop;
+    }
+    do {
+        *out++ = *from++;
+    } while (--len);
+    return out;
+}
+
+void ZLIB_INTERNAL inflate_fast_wide(strm, start)
+z_streamp strm;
+unsigned start;         /* inflate()'s starting value for strm->avail_out */
+{
+    struct inflate_state FAR *state;
+    z_const unsigned char FAR *in;      /* local strm->next_in */
+    z_const unsigned char FAR *last;    /* have enough input while in < last */
+    unsigned char FAR *out;     /* local strm->next_out */
+    unsigned char FAR *beg;     /* inflate()'s initial strm->next_out */
+    unsigned char FAR *end;     /* while out < end, enough space available */
+#ifdef INFLATE_STRICT
+    unsigned dmax;              /* maximum distance from zlib header */
+#endif
+    unsigned wsize;             /* window size or zero if not using window */
+    unsigned whave;             /* valid bytes in the window */
+    unsigned wnext;             /* window write index */
+    unsigned char FAR *window;  /* allocated sliding window, if wsize != 0 */
+    wide_t hold;                /* local strm->hold */
+    unsigned bits;              /* local strm->bits */
+    code const FAR *lcode;      /* local strm->lencode */
+    code const FAR *dcode;      /* local strm->distcode */
+    unsigned lmask;             /* mask for first level of length codes */
+    unsigned dmask;             /* mask for first level of distance codes */
+    code here;                  /* retrieved table entry */
+    unsigned op;                /* code bits, operation, extra bits, or */
+                                /*  window position, window bytes to copy */
+    unsigned len;               /* match length, unused bytes */
+    unsigned dist;              /* match distance */
+    unsigned char FAR *from;    /* where to copy match from */
+
+    /* copy state to local variables */
+    state = (struct inflate_state FAR *)strm->state;
+    in = strm->next_in;
+    last = in + (strm->avail_in - (INFLATE_FAST_WIDE_MIN_IN - 1));
+    out = strm->next_out;
+    beg = out - (start - strm->avail_out);
+    end = out + (strm->avail_out - (INFLATE_FAST_WIDE_MIN_OUT - 1));
+#ifdef INFLATE_STRICT
+    dmax = state->dmax;
+#endif
+    wsize = state->wsize;
+    whave = state->whave;
+    wnext = state->wnext;
+    window = state->window;
+    hold = state->hold;
+    bits = state->bits;
+    lcode = state->lencode;
+    dcode = state->distcode;
+    lmask = (1U << state->lenbits) - 1;
+    dmask = (1U << state->distbits) - 1;
+
+    /* decode literals and length/distances until end-of-block or not enough
+       input data or output space */
+    do {
+        hold |= load_wide(in) << bits;
+        in += (63 - bits) >> 3;
+        bits |= 56;
+        here = lcode[hold & lmask];
+      dolen:
+        op = (unsigned)(here.bits);
+        hold >>= op;
+        bits -= op;
+        op = (unsigned)(here.op);
+        if (op == 0) {                          /* literal */
+            Tracevv((stderr, here.val >= 0x20 && here.val < 0x7f ?
+                    "inflate:         literal '%c'\n" :
+                    "inflate:         literal 0x%02x\n", here.val));
+            *out++ = (unsigned char)(here.val);
+        }
+        else if (op & 16) {                     /* length base */
+            len = (unsigned)(here.val);
+            op &= 15;                           /* number of extra bits */
+            if (op) {
+                len += (unsigned)hold & ((1U << op) - 1);
+                hold >>= op;
+                bits -= op;
+            }
+            Tracevv((stderr, "inflate:         length %u\n", len));
+            here = dcode[hold & dmask];
+          dodist:
+            op = (unsigned)(here.bits);
+            hold >>= op;
+            bits -= op;
+            op = (unsigned)(here.op);
+            if (op & 16) {                      /* distance base */
+                dist = (unsigned)(here.val);
+                op &= 15;                       /* number of extra bits */
+                dist += (unsigned)hold & ((1U << op) - 1);
+#ifdef INFLATE_STRICT
+                if (dist > dmax) {
+                    strm->msg = (char *)"invalid distance too far back";
+                    state->mode = BAD;
+                    break;
+                }
+#endif
+                hold >>= op;
+                bits -= op;
+                Tracevv((stderr, "inflate:         distance %u\n", dist));
+                op = (unsigned)(out - beg);     /* max distance in output */
+                if (dist > op) {                /* see if copy from window */
+                    op = dist - op;             /* distance back in window */
+                    if (op > whave) {
+                        if (state->sane) {
+                            strm->msg =
+                                (char *)"invalid distance too far back";
+                            state->mode = BAD;
+                            break;
+                        }
+#ifdef INFLATE_ALLOW_INVALID_DISTANCE_TOOFAR_ARRR
+                        if (len <= op - whave) {
+                            do {
+                                *out++ = 0;
+                            } while (--len);
+                            continue;
+                        }
+                        len -= op - whave;
+                        do {
+                            *out++ = 0;
+                        } while (--op > whave);
+                        if (op == 0) {
+                            out = match_copy(out, len, dist);
+                            continue;
+                        }
+#endif
+                    }
+                    /* window bytes are copied one at a time, a wide copy
+                       could read past the end of the window */
+                    from = window;
+                    if (wnext == 0) {           /* very common case */
+                        from += wsize - op;
+                        if (op < len) {         /* some from window */
+                            len -= op;
+                            do {
+                                *out++ = *from++;
+                            } while (--op);
+                            out = match_copy(out, len, dist);
+                            continue;
+                        }
+                    }
+                    else if (wnext < op) {      /* wrap around window */
+                        from += wsize + wnext - op;
+                        op -= wnext;
+                        if (op < len) {         /* some from end of window */
+                            len -= op;
+                            do {
+                                *out++ = *from++;
+                            } while (--op);
+                            from = window;
+                            if (wnext < len) {  /* some from start of window */
+                                op = wnext;
+                                len -= op;
+                                do {
+                                    *out++ = *from++;
+                                } while (--op);
+                                out = match_copy(out, len, dist);
+                                continue;
+                            }
+                        }
+                    }
+                    else {                      /* contiguous in window */
+                        from += wnext - op;
+                        if (op < len) {         /* some from window */
+                            len -= op;
+                            do {
+                                *out++ = *from++;
+                            } while (--op);
+                            out = match_copy(out, len, dist);
+                            continue;
+                        }
+                    }
+                    do {
+                        *out++ = *from++;
+                    } while (--len);
+                }
+                else {
+                    out = match_copy(out, len, dist);
+                }
+            }
+            else if ((op & 64) == 0) {          /* 2nd level distance code */
+                here = dcode[here.val + (hold & ((1U << op) - 1))];
+                goto dodist;
+            }
+            else {
+                strm->msg = (char *)"invalid distance code";
+                state->mode = BAD;
+                break;
+            }
+        }
+        else if ((op & 64) == 0) {              /* 2nd level length code */
+            here = lcode[here.val + (hold & ((1U << op) - 1))];
+            goto dolen;
+        }
+        else if (op & 32) {                     /* end-of-block */
+            Tracevv((stderr, "inflate:         end of block\n"));
+            state->mode = TYPE;
+            break;
+        }
+        else {
+            strm->msg = (char *)"invalid literal/length code";
+            state->mode = BAD;
+            break;
+        }
+    } while (in < last && out < end);
+
+    /* return unused bytes, drop the look-ahead bytes above bits */
+    len = bits >> 3;
+    in -= len;
+    bits -= len << 3;
+    hold &= (1U << bits) - 1;
+
+    /* update state and return */
+    strm->next_in = in;
+    strm->next_out = out;
+    strm->avail_in = (unsigned)(in < last ?
+                                (INFLATE_FAST_WIDE_MIN_IN - 1) + (last - in) :
+                                (INFLATE_FAST_WIDE_MIN_IN - 1) - (in - last));
+    strm->avail_out = (unsigned)(out < end ?
+                                 (INFLATE_FAST_WIDE_MIN_OUT - 1) + (end - out) :
+                                 (INFLATE_FAST_WIDE_MIN_OUT - 1) - (out - end));
+    state->hold = (unsigned long)hold;
+    state->bits = bits;
+    return;
+}
+
+#endif /* INFLATE_FAST_WIDE */
@@ -0,0 +1,173 @@
+/* Copyright (c) 2021, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Forced include for the host builds of the tests. It stands in for the
+ * AutoGen.h the EDK2 build generates for each module: the PCDs the sources
+ * under test read, with their QcomModulePkg.dec defaults, and the GUIDs they
+ * reference. A test overrides a PCD with -D_PCD_VALUE_<Name>=<Value>.
+ */
+
+#ifndef __HOST_AUTOGEN_H__
+#define __HOST_AUTOGEN_H__
+
+#include <Uefi.h>
+#include <Library/PcdLib.h>
+
+#ifndef _PCD_VALUE_EnableNewNodeSearchFuc
+#define _PCD_VALUE_EnableNewNodeSearchFuc TRUE
+#endif
+#ifndef _PCD_VALUE_EnablePartialGoods
+#define _PCD_VALUE_EnablePartialGoods TRUE
+#endif
+#ifndef _PCD_VALUE_EnableMultiThreadFlash
+#define _PCD_VALUE_EnableMultiThreadFlash TRUE
+#endif
+#ifndef _PCD_VALUE_EnableParallelAvbVerify
+#define _PCD_VALUE_EnableParallelAvbVerify FALSE
+#endif
+#ifndef _PCD_VALUE_EnableMdtpSupport
+#define _PCD_VALUE_EnableMdtpSupport FALSE
+#endif
+#ifndef _PCD_VALUE_EnableBatteryVoltageCheck
+#define _PCD_VALUE_EnableBatteryVoltageCheck TRUE
+#endif
+#ifndef _PCD_VALUE_AllowEio
+#define _PCD_VALUE_AllowEio FALSE
+#endif
+#ifndef _PCD_VALUE_FlashBufferCount
+#define _PCD_VALUE_FlashBufferCount 2U
+#endif
+#ifndef _PCD_VALUE_KernelLoadAddress
+#define _PCD_VALUE_KernelLoadAddress 0x00080000U
+#endif
+#ifndef _PCD_VALUE_KernelLoadAddress32
+#define _PCD_VALUE_KernelLoadAddress32 0x00008000U
+#endif
+#ifndef _PCD_VALUE_TagsAddress
+#define _PCD_VALUE_TagsAddress 0x03200000U
+#endif
+#ifndef _PCD_VALUE_RamdiskLoadAddress
+#define _PCD_VALUE_RamdiskLoadAddress 0x03400000U
+#endif
+#ifndef _PCD_VALUE_RamdiskEndAddress
+#define _PCD_VALUE_RamdiskEndAddress 0x05600000U
+#endif
+#ifndef _PCD_VALUE_RamdiskEndAddress32
+#define _PCD_VALUE_RamdiskEndAddress32 0x03C00000U
+#endif
+#ifndef _PCD_VALUE_BootTracePersistBase
+#define _PCD_VALUE_BootTracePersistBase 0ULL
+#endif
+#ifndef _PCD_VALUE_BootTracePersistSize
+#define _PCD_VALUE_BootTracePersistSize 0U
+#endif
+
+/* The GUIDs of the BootLib and FastbootLib .inf files */
+extern EFI_GUID gBlockIoRefreshGuid;
+extern EFI_GUID gChargerExProtocolGuid;
+extern EFI_GUID gEfiBlockIo2ProtocolGuid;
+extern EFI_GUID gEfiBlockIoProtocolGuid;
+extern EFI_GUID gEfiBootImgPartitionGuid;
+extern EFI_GUID gEfiChipInfoProtocolGuid;
+extern EFI_GUID gEfiDDRGetInfoProtocolGuid;
+extern EFI_GUID gEfiDevicePathFromTextProtocolGuid;
+extern EFI_GUID gEfiDevicePathProtocolGuid;
+extern EFI_GUID gEfiDevicePathToTextProtocolGuid;
+extern EFI_GUID gEfiDiskIoProtocolGuid;
+extern EFI_GUID gEfiEmmcGppPartition1Guid;
+extern EFI_GUID gEfiEmmcRpmbPartitionGuid;
+extern EFI_GUID gEfiEmmcUserPartitionGuid;
+extern EFI_GUID gEfiEraseBlockProtocolGuid;
+extern EFI_GUID gEfiFileInfoGuid;
+extern EFI_GUID gEfiFileSystemInfoGuid;
+extern EFI_GUID gEfiGlobalVariableGuid;
+extern EFI_GUID gEfiHash2ProtocolGuid;
+extern EFI_GUID gEfiHashAlgorithmSha256Guid;
+extern EFI_GUID gEfiKernelProtocolGuid;
+extern EFI_GUID gEfiLimitsProtocolGuid;
+extern EFI_GUID gEfiLoadFileProtocolGuid;
+extern EFI_GUID gEfiLoadedImageProtocolGuid;
+extern EFI_GUID gEfiLogFSPartitionGuid;
+extern EFI_GUID gEfiMemCardInfoProtocolGuid;
+extern EFI_GUID gEfiMiscPartitionGuid;
+extern EFI_GUID gEfiNandPartiGuidProtocolGuid;
+extern EFI_GUID gEfiNandUserPartitionGuid;
+extern EFI_GUID gEfiPartitionRecordGuid;
+extern EFI_GUID gEfiPartitionTypeGuid;
+extern EFI_GUID gEfiPlatPartitionTypeGuid;
+extern EFI_GUID gEfiPlatformInfoProtocolGuid;
+extern EFI_GUID gEfiPrint2ProtocolGuid;
+extern EFI_GUID gEfiQcomVerifiedBootProtocolGuid;
+extern EFI_GUID gEfiRNGAlgRawGuid;
+extern EFI_GUID gEfiRamPartitionProtocolGuid;
+extern EFI_GUID gEfiRecoveryImgPartitionGuid;
+extern EFI_GUID gEfiResetReasonProtocolGuid;
+extern EFI_GUID gEfiSdRemovableGuid;
+extern EFI_GUID gEfiSimpleFileSystemProtocolGuid;
+extern EFI_GUID gEfiSimpleTextInProtocolGuid;
+extern EFI_GUID gEfiSimpleTextInputExProtocolGuid;
+extern EFI_GUID gEfiSimpleTextOutProtocolGuid;
+extern EFI_GUID gEfiUbiFlasherProtocolGuid;
+extern EFI_GUID gEfiUfsLU0Guid;
+extern EFI_GUID gEfiUfsLU1Guid;
+extern EFI_GUID gEfiUfsLU2Guid;
+extern EFI_GUID gEfiUfsLU3Guid;
+extern EFI_GUID gEfiUfsLU4Guid;
+extern EFI_GUID gEfiUfsLU5Guid;
+extern EFI_GUID gEfiUfsLU6Guid;
+extern EFI_GUID gEfiUfsLU7Guid;
+extern EFI_GUID gEfiUsbDeviceProtocolGuid;
+extern EFI_GUID gEfiUsbIoProtocolGuid;
+extern EFI_GUID gEfiUsbfnIoProtocolGuid;
+extern EFI_GUID gQcomDisplayUtilsProtocolGuid;
+extern EFI_GUID gQcomMdtpProtocolGuid;
+extern EFI_GUID gQcomPmicPonProtocolGuid;
+extern EFI_GUID gQcomPmicVersionProtocolGuid;
+extern EFI_GUID gQcomQseecomProtocolGuid;
+extern EFI_GUID gQcomRngProtocolGuid;
+extern EFI_GUID gQcomScmModeSwithProtocolGuid;
+extern EFI_GUID gQcomScmProtocolGuid;
+extern EFI_GUID gQcomTokenSpaceGuid;
+
+#define _PCD_GET_MODE_32_PcdMaximumAsciiStringLength 1000000U
+#define _PCD_GET_MODE_32_PcdMaximumUnicodeStringLength 1000000U
+
+/* PcdGet* of the fixed PCDs above */
+#define _PCD_GET_MODE_BOOL_AllowEio _PCD_VALUE_AllowEio
+#define _PCD_GET_MODE_BOOL_EnableMdtpSupport _PCD_VALUE_EnableMdtpSupport
+#define _PCD_GET_MODE_BOOL_EnableNewNodeSearchFuc _PCD_VALUE_EnableNewNodeSearchFuc
+#define _PCD_GET_MODE_BOOL_EnablePartialGoods _PCD_VALUE_EnablePartialGoods
+#define _PCD_GET_MODE_32_KernelLoadAddress _PCD_VALUE_KernelLoadAddress
+#define _PCD_GET_MODE_32_KernelLoadAddress32 _PCD_VALUE_KernelLoadAddress32
+#define _PCD_GET_MODE_32_RamdiskEndAddress _PCD_VALUE_RamdiskEndAddress
+#define _PCD_GET_MODE_32_RamdiskEndAddress32 _PCD_VALUE_RamdiskEndAddress32
+#define _PCD_GET_MODE_32_BootTracePersistSize _PCD_VALUE_BootTracePersistSize
+#define _PCD_GET_MODE_64_BootTracePersistBase _PCD_VALUE_BootTracePersistBase
+
+#endif
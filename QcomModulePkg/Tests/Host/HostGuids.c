@@ -0,0 +1,231 @@
+/* Copyright (c) 2021, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * The GUIDs declared in AutoGen.h, as the EDK2 build defines them in the
+ * AutoGen.c of a module. Their values are the ones of the package .dec
+ * files.
+ */
+
+#include <Uefi.h>
+
+EFI_GUID gBlockIoRefreshGuid =
+  { 0xb1eb3d10, 0x9d67, 0x40ca,
+    { 0x95, 0x59, 0xf1, 0x48, 0x8b, 0x1b, 0x2d, 0xdb } };
+EFI_GUID gChargerExProtocolGuid =
+  { 0x6edc8a6d, 0x2663, 0x43cd,
+    { 0x90, 0xff, 0x46, 0x21, 0xff, 0xd1, 0x0d, 0xf5 } };
+EFI_GUID gEfiBlockIo2ProtocolGuid =
+  { 0xa77b2472, 0xe282, 0x4e9f,
+    { 0xa2, 0x45, 0xc2, 0xc0, 0xe2, 0x7b, 0xbc, 0xc1 } };
+EFI_GUID gEfiBlockIoProtocolGuid =
+  { 0x964e5b21, 0x6459, 0x11d2,
+    { 0x8e, 0x39, 0x00, 0xa0, 0xc9, 0x69, 0x72, 0x3b } };
+EFI_GUID gEfiBootImgPartitionGuid =
+  { 0x20117f86, 0xe985, 0x4357,
+    { 0xb9, 0xee, 0x37, 0x4b, 0xc1, 0xd8, 0x48, 0x7d } };
+EFI_GUID gEfiChipInfoProtocolGuid =
+  { 0xb0760469, 0x970c, 0x487a,
+    { 0xa4, 0xb5, 0x28, 0xdb, 0x7b, 0x45, 0xce, 0xf1 } };
+EFI_GUID gEfiDDRGetInfoProtocolGuid =
+  { 0x1a7c0eb8, 0x5646, 0x45f7,
+    { 0xab, 0x20, 0xea, 0xe5, 0xda, 0x46, 0x40, 0xa2 } };
+EFI_GUID gEfiDevicePathFromTextProtocolGuid =
+  { 0x05c99a21, 0xc70f, 0x4ad2,
+    { 0x8a, 0x5f, 0x35, 0xdf, 0x33, 0x43, 0xf5, 0x1e } };
+EFI_GUID gEfiDevicePathProtocolGuid =
+  { 0x09576e91, 0x6d3f, 0x11d2,
+    { 0x8e, 0x39, 0x00, 0xa0, 0xc9, 0x69, 0x72, 0x3b } };
+EFI_GUID gEfiDevicePathToTextProtocolGuid =
+  { 0x8b843e20, 0x8132, 0x4852,
+    { 0x90, 0xcc, 0x55, 0x1a, 0x4e, 0x4a, 0x7f, 0x1c } };
+EFI_GUID gEfiDiskIoProtocolGuid =
+  { 0xce345171, 0xba0b, 0x11d2,
+    { 0x8e, 0x4f, 0x00, 0xa0, 0xc9, 0x69, 0x72, 0x3b } };
+EFI_GUID gEfiEmmcGppPartition1Guid =
+  { 0xb9251ea5, 0x3462, 0x4807,
+    { 0x86, 0xc6, 0x89, 0x48, 0xb1, 0xb3, 0x61, 0x63 } };
+EFI_GUID gEfiEmmcRpmbPartitionGuid =
+  { 0xc49551ea, 0xd6bc, 0x4966,
+    { 0x94, 0x99, 0x87, 0x1e, 0x39, 0x31, 0x33, 0xcd } };
+EFI_GUID gEfiEmmcUserPartitionGuid =
+  { 0xb615f1f5, 0x5088, 0x43cd,
+    { 0x80, 0x9c, 0xa1, 0x6e, 0x52, 0x48, 0x7d, 0x00 } };
+EFI_GUID gEfiEraseBlockProtocolGuid =
+  { 0x95a9a93e, 0xa86e, 0x4926,
+    { 0xaa, 0xef, 0x99, 0x18, 0xe7, 0x72, 0xd9, 0x87 } };
+EFI_GUID gEfiFileInfoGuid =
+  { 0x09576e92, 0x6d3f, 0x11d2,
+    { 0x8e, 0x39, 0x00, 0xa0, 0xc9, 0x69, 0x72, 0x3b } };
+EFI_GUID gEfiFileSystemInfoGuid =
+  { 0x09576e93, 0x6d3f, 0x11d2,
+    { 0x8e, 0x39, 0x00, 0xa0, 0xc9, 0x69, 0x72, 0x3b } };
+EFI_GUID gEfiGlobalVariableGuid =
+  { 0x8be4df61, 0x93ca, 0x11d2,
+    { 0xaa, 0x0d, 0x00, 0xe0, 0x98, 0x03, 0x2b, 0x8c } };
+EFI_GUID gEfiHash2ProtocolGuid =
+  { 0x55b1d734, 0xc5e1, 0x49db,
+    { 0x96, 0x47, 0xb1, 0x6a, 0xfb, 0x0e, 0x30, 0x5b } };
+EFI_GUID gEfiHashAlgorithmSha256Guid =
+  { 0x51aa59de, 0xfdf2, 0x4ea3,
+    { 0xbc, 0x63, 0x87, 0x5f, 0xb7, 0x84, 0x2e, 0xe9 } };
+EFI_GUID gEfiKernelProtocolGuid =
+  { 0xb5062be7, 0x170b, 0x4a32,
+    { 0xbe, 0x21, 0x68, 0x92, 0x62, 0xff, 0x43, 0x99 } };
+EFI_GUID gEfiLimitsProtocolGuid =
+  { 0x79d6c879, 0x725e, 0x489e,
+    { 0xa0, 0xa9, 0x27, 0xef, 0xa5, 0xdf, 0xcb, 0x35 } };
+EFI_GUID gEfiLoadFileProtocolGuid =
+  { 0x56ec3091, 0x954c, 0x11d2,
+    { 0x8e, 0x3f, 0x00, 0xa0, 0xc9, 0x69, 0x72, 0x3b } };
+EFI_GUID gEfiLoadedImageProtocolGuid =
+  { 0x5b1b31a1, 0x9562, 0x11d2,
+    { 0x8e, 0x3f, 0x00, 0xa0, 0xc9, 0x69, 0x72, 0x3b } };
+EFI_GUID gEfiLogFSPartitionGuid =
+  { 0xbc0330eb, 0x3410, 0x4951,
+    { 0xa6, 0x17, 0x03, 0x89, 0x8d, 0xbe, 0x33, 0x72 } };
+EFI_GUID gEfiMemCardInfoProtocolGuid =
+  { 0x85c1f7d2, 0xbce6, 0x4f31,
+    { 0x8f, 0x4d, 0xd3, 0x7e, 0x03, 0xd0, 0x5e, 0xaa } };
+EFI_GUID gEfiMiscPartitionGuid =
+  { 0x82acc91f, 0x357c, 0x4a68,
+    { 0x9c, 0x8f, 0x68, 0x9e, 0x1b, 0x1a, 0x23, 0xa1 } };
+EFI_GUID gEfiNandPartiGuidProtocolGuid =
+  { 0xd68edce2, 0xa314, 0x457b,
+    { 0x96, 0x2a, 0x1d, 0x99, 0xbb, 0xfc, 0xbb, 0xfb } };
+EFI_GUID gEfiNandUserPartitionGuid =
+  { 0x03ef84a9, 0x60ce, 0x4371,
+    { 0x97, 0xcf, 0x04, 0x84, 0x5a, 0x86, 0x5b, 0x79 } };
+EFI_GUID gEfiPartitionRecordGuid =
+  { 0xfe2555be, 0xd716, 0x4686,
+    { 0xb9, 0xd0, 0x79, 0xdb, 0x59, 0x21, 0xb7, 0x0d } };
+EFI_GUID gEfiPartitionTypeGuid =
+  { 0x6848de61, 0xeb61, 0x4def,
+    { 0x9a, 0x8e, 0x38, 0x17, 0xcb, 0xeb, 0x8f, 0x1c } };
+EFI_GUID gEfiPlatPartitionTypeGuid =
+  { 0x543c031a, 0x4cb6, 0x4897,
+    { 0xbf, 0xfe, 0x4b, 0x48, 0x57, 0x68, 0xa8, 0xad } };
+EFI_GUID gEfiPlatformInfoProtocolGuid =
+  { 0x157a5c45, 0x21b2, 0x43c5,
+    { 0xba, 0x7c, 0x82, 0x2f, 0xee, 0x5f, 0xe5, 0x99 } };
+EFI_GUID gEfiPrint2ProtocolGuid =
+  { 0xf05976ef, 0x83f1, 0x4f3d,
+    { 0x86, 0x19, 0xf7, 0x59, 0x5d, 0x41, 0xe5, 0x38 } };
+EFI_GUID gEfiQcomVerifiedBootProtocolGuid =
+  { 0x8e5eff91, 0x21b6, 0x47d3,
+    { 0xaf, 0x2b, 0xc1, 0x5a, 0x01, 0xe0, 0x20, 0xec } };
+EFI_GUID gEfiRNGAlgRawGuid =
+  { 0xe43176d7, 0xb6e8, 0x4827,
+    { 0xb7, 0x84, 0x7f, 0xfd, 0xc4, 0xb6, 0x85, 0x61 } };
+EFI_GUID gEfiRamPartitionProtocolGuid =
+  { 0x5172ffb5, 0x4253, 0x7d51,
+    { 0xc6, 0x41, 0xa7, 0x01, 0xf9, 0x73, 0x10, 0x3c } };
+EFI_GUID gEfiRecoveryImgPartitionGuid =
+  { 0x9d72d4e4, 0x9958, 0x42da,
+    { 0xac, 0x26, 0xbe, 0xa7, 0xa9, 0x0b, 0x04, 0x34 } };
+EFI_GUID gEfiResetReasonProtocolGuid =
+  { 0xa022155a, 0x4828, 0x4535,
+    { 0xa4, 0x99, 0x11, 0xf1, 0x52, 0x40, 0xb9, 0x1b } };
+EFI_GUID gEfiSdRemovableGuid =
+  { 0xd1531d41, 0x3f80, 0x4091,
+    { 0x8d, 0x0a, 0x54, 0x1f, 0x59, 0x23, 0x6d, 0x66 } };
+EFI_GUID gEfiSimpleFileSystemProtocolGuid =
+  { 0x964e5b22, 0x6459, 0x11d2,
+    { 0x8e, 0x39, 0x00, 0xa0, 0xc9, 0x69, 0x72, 0x3b } };
+EFI_GUID gEfiSimpleTextInProtocolGuid =
+  { 0x387477c1, 0x69c7, 0x11d2,
+    { 0x8e, 0x39, 0x00, 0xa0, 0xc9, 0x69, 0x72, 0x3b } };
+EFI_GUID gEfiSimpleTextInputExProtocolGuid =
+  { 0xdd9e7534, 0x7762, 0x4698,
+    { 0x8c, 0x14, 0xf5, 0x85, 0x17, 0xa6, 0x25, 0xaa } };
+EFI_GUID gEfiSimpleTextOutProtocolGuid =
+  { 0x387477c2, 0x69c7, 0x11d2,
+    { 0x8e, 0x39, 0x00, 0xa0, 0xc9, 0x69, 0x72, 0x3b } };
+EFI_GUID gEfiUbiFlasherProtocolGuid =
+  { 0xe3eef434, 0x22c9, 0xe33b,
+    { 0x8f, 0x5d, 0x0e, 0x81, 0x68, 0x6a, 0x68, 0xcb } };
+EFI_GUID gEfiUfsLU0Guid =
+  { 0x860845c1, 0xbe09, 0x4355,
+    { 0x8b, 0xc1, 0x30, 0xd6, 0x4f, 0xf8, 0xe6, 0x3a } };
+EFI_GUID gEfiUfsLU1Guid =
+  { 0x8d90d477, 0x39a3, 0x4a38,
+    { 0xab, 0x9e, 0x58, 0x6f, 0xf6, 0x9e, 0xd0, 0x51 } };
+EFI_GUID gEfiUfsLU2Guid =
+  { 0xedf85868, 0x87ec, 0x4f77,
+    { 0x9c, 0xda, 0x5f, 0x10, 0xdf, 0x2f, 0xe6, 0x01 } };
+EFI_GUID gEfiUfsLU3Guid =
+  { 0x1ae69024, 0x8aeb, 0x4df8,
+    { 0xbc, 0x98, 0x00, 0x32, 0xdb, 0xdf, 0x50, 0x24 } };
+EFI_GUID gEfiUfsLU4Guid =
+  { 0xd33f1985, 0xf107, 0x4a85,
+    { 0xbe, 0x38, 0x68, 0xdc, 0x7a, 0xd3, 0x2c, 0xea } };
+EFI_GUID gEfiUfsLU5Guid =
+  { 0x4ba1d05f, 0x088e, 0x483f,
+    { 0xa9, 0x7e, 0xb1, 0x9b, 0x9c, 0xcf, 0x59, 0xb0 } };
+EFI_GUID gEfiUfsLU6Guid =
+  { 0x4acf98f6, 0x26fa, 0x44d2,
+    { 0x81, 0x32, 0x28, 0x2f, 0x2d, 0x19, 0xa4, 0xc5 } };
+EFI_GUID gEfiUfsLU7Guid =
+  { 0x8598155f, 0x34de, 0x415c,
+    { 0x8b, 0x55, 0x84, 0x3e, 0x33, 0x22, 0xd3, 0x6f } };
+EFI_GUID gEfiUsbDeviceProtocolGuid =
+  { 0xd9d9ce48, 0x44b8, 0x4f49,
+    { 0x8e, 0x3e, 0x2a, 0x3b, 0x92, 0x7d, 0xc6, 0xc1 } };
+EFI_GUID gEfiUsbIoProtocolGuid =
+  { 0x2b2f68d6, 0x0cd2, 0x44cf,
+    { 0x8e, 0x8b, 0xbb, 0xa2, 0x0b, 0x1b, 0x5b, 0x75 } };
+EFI_GUID gEfiUsbfnIoProtocolGuid =
+  { 0x32d2963a, 0xfe5d, 0x4f30,
+    { 0xb6, 0x33, 0x6e, 0x5d, 0xc5, 0x58, 0x03, 0xcc } };
+EFI_GUID gQcomDisplayUtilsProtocolGuid =
+  { 0xc0dd69ac, 0x76ba, 0x11e6,
+    { 0xab, 0x24, 0x1f, 0xc7, 0xf5, 0x57, 0x5f, 0x19 } };
+EFI_GUID gQcomMdtpProtocolGuid =
+  { 0x71746e63, 0x65f9, 0x41ec,
+    { 0xac, 0x08, 0xcd, 0xd1, 0xf2, 0xd0, 0x22, 0x98 } };
+EFI_GUID gQcomPmicPonProtocolGuid =
+  { 0x97044b58, 0xfea4, 0x4ad0,
+    { 0x9d, 0x0b, 0xe4, 0x17, 0xd6, 0x0f, 0x11, 0xa1 } };
+EFI_GUID gQcomPmicVersionProtocolGuid =
+  { 0x4684800a, 0x2755, 0x4edc,
+    { 0xb4, 0x43, 0x7f, 0x8c, 0xeb, 0x32, 0x39, 0xd3 } };
+EFI_GUID gQcomQseecomProtocolGuid =
+  { 0xa74862ce, 0x680f, 0x4fe1,
+    { 0xa3, 0x11, 0xdf, 0x41, 0xf4, 0x03, 0x03, 0x91 } };
+EFI_GUID gQcomRngProtocolGuid =
+  { 0x3152bca5, 0xeade, 0x433d,
+    { 0x86, 0x2e, 0xc0, 0x1c, 0xdc, 0x29, 0x1f, 0x44 } };
+EFI_GUID gQcomScmModeSwithProtocolGuid =
+  { 0xf57f73ed, 0x0afc, 0x4723,
+    { 0x93, 0x74, 0x2c, 0xeb, 0xc0, 0x19, 0x8e, 0xf9 } };
+EFI_GUID gQcomScmProtocolGuid =
+  { 0x77ed108d, 0x8524, 0x4b8b,
+    { 0x9d, 0x2e, 0x34, 0x98, 0x7a, 0xec, 0xb9, 0xc1 } };
+EFI_GUID gQcomTokenSpaceGuid =
+  { 0x882f8c2b, 0x9646, 0x435f,
+    { 0x8d, 0xe5, 0xf2, 0x08, 0xff, 0x80, 0xc1, 0xbd } };
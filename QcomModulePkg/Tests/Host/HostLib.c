@@ -0,0 +1,436 @@
+/* Copyright (c) 2021, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * MemoryAllocationLib, DebugLib, TimerLib and the DevicePathLib node walkers
+ * implemented over the C library, so the sources under test run on the build
+ * machine. BaseLib,
+ * BaseMemoryLib and PrintLib are the MdePkg libraries, built with the tests
+ * (see common.sh). The boot and runtime services are in HostUefi.c.
+ */
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/DevicePathLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/PrintLib.h>
+#include <Library/TimerLib.h>
+
+#include "HostLib.h"
+
+#define HOST_PRINT_MAX 4096
+#define HOST_THREADS_MAX 16
+
+/* Jobs of HostRunParallel () that are handed out to the threads */
+typedef struct {
+  VOID (*Job) (VOID *Context, UINTN Index);
+  VOID *Context;
+  UINTN Count;
+  UINTN Next;
+} HOST_PARALLEL;
+
+STATIC pthread_mutex_t HostJobsMutex = PTHREAD_MUTEX_INITIALIZER;
+STATIC pthread_mutex_t HostParallelMutex = PTHREAD_MUTEX_INITIALIZER;
+STATIC HOST_ALLOC_STATS HostAllocs;
+
+STATIC VOID *
+HostCountAlloc (VOID *Memory, UINTN Size)
+{
+  if (Memory) {
+    __atomic_fetch_add (&HostAllocs.Allocations, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add (&HostAllocs.Bytes, Size, __ATOMIC_RELAXED);
+  }
+  return Memory;
+}
+
+STATIC VOID
+HostCountFree (VOID *Buffer)
+{
+  if (Buffer) {
+    __atomic_fetch_add (&HostAllocs.Frees, 1, __ATOMIC_RELAXED);
+  }
+  free (Buffer);
+}
+
+VOID *
+EFIAPI
+AllocatePool (IN UINTN AllocationSize)
+{
+  return HostCountAlloc (malloc (AllocationSize ? AllocationSize : 1),
+                         AllocationSize);
+}
+
+VOID *
+EFIAPI
+AllocateZeroPool (IN UINTN AllocationSize)
+{
+  return HostCountAlloc (calloc (1, AllocationSize ? AllocationSize : 1),
+                         AllocationSize);
+}
+
+VOID *
+EFIAPI
+AllocateCopyPool (IN UINTN AllocationSize, IN CONST VOID *Buffer)
+{
+  VOID *Memory = AllocatePool (AllocationSize);
+
+  if (Memory) {
+    CopyMem (Memory, Buffer, AllocationSize);
+  }
+  return Memory;
+}
+
+VOID
+EFIAPI
+FreePool (IN VOID *Buffer)
+{
+  HostCountFree (Buffer);
+}
+
+VOID *
+EFIAPI
+AllocateAlignedPages (IN UINTN Pages, IN UINTN Alignment)
+{
+  VOID *Memory;
+
+  if (posix_memalign (&Memory, MAX (Alignment, EFI_PAGE_SIZE),
+                      EFI_PAGES_TO_SIZE (Pages ? Pages : 1))) {
+    return NULL;
+  }
+  return HostCountAlloc (Memory, EFI_PAGES_TO_SIZE (Pages));
+}
+
+VOID *
+EFIAPI
+AllocatePages (IN UINTN Pages)
+{
+  return AllocateAlignedPages (Pages, EFI_PAGE_SIZE);
+}
+
+VOID
+EFIAPI
+FreePages (IN VOID *Buffer, IN UINTN Pages)
+{
+  HostCountFree (Buffer);
+}
+
+VOID
+EFIAPI
+FreeAlignedPages (IN VOID *Buffer, IN UINTN Pages)
+{
+  HostCountFree (Buffer);
+}
+
+VOID
+HostAllocStats (OUT HOST_ALLOC_STATS *Stats)
+{
+  Stats->Allocations = __atomic_load_n (&HostAllocs.Allocations,
+                                        __ATOMIC_RELAXED);
+  Stats->Bytes = __atomic_load_n (&HostAllocs.Bytes, __ATOMIC_RELAXED);
+  Stats->Frees = __atomic_load_n (&HostAllocs.Frees, __ATOMIC_RELAXED);
+}
+
+BOOLEAN
+EFIAPI
+IsDevicePathEnd (IN CONST VOID *Node)
+{
+  CONST EFI_DEVICE_PATH_PROTOCOL *Path = Node;
+
+  return Path->Type == END_DEVICE_PATH_TYPE &&
+         Path->SubType == END_ENTIRE_DEVICE_PATH_SUBTYPE;
+}
+
+EFI_DEVICE_PATH_PROTOCOL *
+EFIAPI
+NextDevicePathNode (IN CONST VOID *Node)
+{
+  CONST EFI_DEVICE_PATH_PROTOCOL *Path = Node;
+
+  return (EFI_DEVICE_PATH_PROTOCOL *)((UINT8 *)Path +
+                                      (Path->Length[0] |
+                                       (Path->Length[1] << 8)));
+}
+
+VOID
+EFIAPI
+DebugPrint (IN UINTN ErrorLevel, IN CONST CHAR8 *Format, ...)
+{
+  CHAR8 Buffer[HOST_PRINT_MAX];
+  VA_LIST Marker;
+
+  if (!(ErrorLevel & (EFI_D_ERROR | EFI_D_WARN)) &&
+      !HostGetEnv ("HOST_DEBUG")) {
+    return;
+  }
+  VA_START (Marker, Format);
+  AsciiVSPrint (Buffer, sizeof (Buffer), Format, Marker);
+  VA_END (Marker);
+  fputs (Buffer, stderr);
+}
+
+VOID
+EFIAPI
+DebugAssert (IN CONST CHAR8 *FileName,
+             IN UINTN LineNumber,
+             IN CONST CHAR8 *Description)
+{
+  fprintf (stderr, "ASSERT %s(%llu): %s\n", FileName,
+           (unsigned long long)LineNumber, Description);
+  abort ();
+}
+
+VOID *
+EFIAPI
+DebugClearMemory (OUT VOID *Buffer, IN UINTN Length)
+{
+  return memset (Buffer, 0xAF, Length);
+}
+
+BOOLEAN
+EFIAPI
+DebugAssertEnabled (VOID)
+{
+  return TRUE;
+}
+
+BOOLEAN
+EFIAPI
+DebugPrintEnabled (VOID)
+{
+  return TRUE;
+}
+
+BOOLEAN
+EFIAPI
+DebugCodeEnabled (VOID)
+{
+  return TRUE;
+}
+
+BOOLEAN
+EFIAPI
+DebugClearMemoryEnabled (VOID)
+{
+  return FALSE;
+}
+
+BOOLEAN
+EFIAPI
+DebugPrintLevelEnabled (IN CONST UINTN ErrorLevel)
+{
+  return TRUE;
+}
+
+/* The performance counter counts nanoseconds */
+UINT64
+EFIAPI
+GetPerformanceCounter (VOID)
+{
+  return HostTimeNs ();
+}
+
+UINT64
+EFIAPI
+GetPerformanceCounterProperties (OUT UINT64 *StartValue OPTIONAL,
+                                 OUT UINT64 *EndValue OPTIONAL)
+{
+  if (StartValue) {
+    *StartValue = 0;
+  }
+  if (EndValue) {
+    *EndValue = MAX_UINT64;
+  }
+  return 1000000000ULL;
+}
+
+UINT64
+EFIAPI
+GetTimeInNanoSecond (IN UINT64 Ticks)
+{
+  return Ticks;
+}
+
+UINTN
+EFIAPI
+MicroSecondDelay (IN UINTN MicroSeconds)
+{
+  return MicroSeconds;
+}
+
+UINTN
+EFIAPI
+NanoSecondDelay (IN UINTN NanoSeconds)
+{
+  return NanoSeconds;
+}
+
+VOID *
+HostLoadFile (CONST CHAR8 *Path, UINTN *Size)
+{
+  FILE *Fp = fopen (Path, "rb");
+  VOID *Data = NULL;
+  long Len;
+
+  if (!Fp) {
+    return NULL;
+  }
+  if (!fseek (Fp, 0, SEEK_END) && (Len = ftell (Fp)) >= 0 &&
+      !fseek (Fp, 0, SEEK_SET)) {
+    Data = AllocatePool (Len);
+    if (Data && fread (Data, 1, Len, Fp) != (size_t)Len) {
+      FreePool (Data);
+      Data = NULL;
+    }
+    *Size = Len;
+  }
+  fclose (Fp);
+  return Data;
+}
+
+EFI_STATUS
+HostSaveFile (CONST CHAR8 *Path, CONST VOID *Data, UINTN Size)
+{
+  FILE *Fp = fopen (Path, "wb");
+  size_t Written;
+
+  if (!Fp) {
+    return EFI_NOT_FOUND;
+  }
+  Written = fwrite (Data, 1, Size, Fp);
+  if (fclose (Fp) || Written != Size) {
+    return EFI_DEVICE_ERROR;
+  }
+  return EFI_SUCCESS;
+}
+
+UINT64
+HostTimeNs (VOID)
+{
+  struct timespec Ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &Ts);
+  return (UINT64)Ts.tv_sec * 1000000000ULL + Ts.tv_nsec;
+}
+
+VOID
+EFIAPI
+HostPrint (IN CONST CHAR8 *Format, ...)
+{
+  CHAR8 Buffer[HOST_PRINT_MAX];
+  VA_LIST Marker;
+
+  VA_START (Marker, Format);
+  AsciiVSPrint (Buffer, sizeof (Buffer), Format, Marker);
+  VA_END (Marker);
+  fputs (Buffer, stdout);
+  fflush (stdout);
+}
+
+CONST CHAR8 *
+HostGetEnv (CONST CHAR8 *Name)
+{
+  return getenv (Name);
+}
+
+UINTN
+HostStrToUintn (CONST CHAR8 *Str)
+{
+  return strtoull (Str, NULL, 0);
+}
+
+VOID
+HostSleepUs (UINTN Us)
+{
+  usleep (Us);
+}
+
+STATIC VOID *
+HostParallelThread (VOID *Arg)
+{
+  HOST_PARALLEL *Parallel = Arg;
+  UINTN Index;
+
+  for (;;) {
+    pthread_mutex_lock (&HostJobsMutex);
+    Index = Parallel->Next;
+    if (Index < Parallel->Count) {
+      Parallel->Next++;
+    }
+    pthread_mutex_unlock (&HostJobsMutex);
+
+    if (Index >= Parallel->Count) {
+      return NULL;
+    }
+    Parallel->Job (Parallel->Context, Index);
+  }
+}
+
+VOID
+HostRunParallel (UINTN Threads,
+                 UINTN Count,
+                 VOID (*Job) (VOID *Context, UINTN Index),
+                 VOID *Context)
+{
+  HOST_PARALLEL Parallel = { Job, Context, Count, 0 };
+  pthread_t Thread[HOST_THREADS_MAX];
+  UINTN Started;
+  UINTN Index;
+
+  Threads = MIN (Threads, HOST_THREADS_MAX);
+  for (Started = 0; Started + 1 < Threads; Started++) {
+    if (pthread_create (&Thread[Started], NULL, HostParallelThread,
+                        &Parallel)) {
+      break;
+    }
+  }
+
+  HostParallelThread (&Parallel);
+  for (Index = 0; Index < Started; Index++) {
+    pthread_join (Thread[Index], NULL);
+  }
+}
+
+VOID
+HostParallelLock (BOOLEAN Acquire)
+{
+  if (Acquire) {
+    pthread_mutex_lock (&HostParallelMutex);
+  } else {
+    pthread_mutex_unlock (&HostParallelMutex);
+  }
+}
@@ -0,0 +1,94 @@
+/* Copyright (c) 2021, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Host helpers for the tests: file access and a clock for the test
+ * applications, which only include EDK2 headers.
+ */
+
+#ifndef __HOST_LIB_H__
+#define __HOST_LIB_H__
+
+/* MemoryAllocationLib calls counted since the start */
+typedef struct {
+  UINT64 Allocations;
+  UINT64 Bytes;
+  UINT64 Frees;
+} HOST_ALLOC_STATS;
+
+VOID
+HostAllocStats (OUT HOST_ALLOC_STATS *Stats);
+
+/* Loads Path into a pool buffer, NULL if it cannot be read */
+VOID *
+HostLoadFile (CONST CHAR8 *Path, UINTN *Size);
+
+EFI_STATUS
+HostSaveFile (CONST CHAR8 *Path, CONST VOID *Data, UINTN Size);
+
+/* Monotonic time in nanoseconds */
+UINT64
+HostTimeNs (VOID);
+
+/* Prints to stdout with the PrintLib format */
+VOID
+EFIAPI
+HostPrint (IN CONST CHAR8 *Format, ...);
+
+/* Value of the environment variable Name, NULL if unset */
+CONST CHAR8 *
+HostGetEnv (CONST CHAR8 *Name);
+
+UINTN
+HostStrToUintn (CONST CHAR8 *Str);
+
+VOID
+HostSleepUs (UINTN Us);
+
+/* Runs Job (Context, Index) for each Index below Count on up to Threads
+ * threads, the caller's included, and returns when all have returned.
+ */
+VOID
+HostRunParallel (UINTN Threads,
+                 UINTN Count,
+                 VOID (*Job) (VOID *Context, UINTN Index),
+                 VOID *Context);
+
+/* Acquires or releases a lock the jobs of HostRunParallel () may share */
+VOID
+HostParallelLock (BOOLEAN Acquire);
+
+/* Deterministic pseudo random numbers for the generated test cases */
+STATIC inline UINT32
+HostRandom (UINT32 *Seed)
+{
+  *Seed = *Seed * 1103515245 + 12345;
+  return *Seed >> 8;
+}
+
+#endif
@@ -0,0 +1,992 @@
+/* Copyright (c) 2021, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * UefiBootServicesTableLib and UefiRuntimeServicesTableLib for the host
+ * builds of the tests. Only the services the sources under test use are
+ * implemented, the others are NULL. Time does not pass on its own: timer
+ * events fire when the test calls HostDispatchTimers, or right away when
+ * they are waited for.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <Uefi.h>
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/MemoryAllocationLib.h>
+
+#include "HostUefi.h"
+
+#define HOST_MAX_PROTOCOLS 1024
+#define HOST_MAX_EVENTS 256
+#define HOST_MAX_VARIABLES 64
+#define HOST_MAX_IO2 64
+
+typedef struct {
+  EFI_HANDLE Handle;
+  EFI_GUID Guid;
+  VOID *Interface;
+} HOST_PROTOCOL;
+
+typedef struct {
+  UINT32 Type;
+  EFI_EVENT_NOTIFY Notify;
+  VOID *Context;
+  BOOLEAN Signaled;
+  BOOLEAN Armed;
+  BOOLEAN Periodic;
+} HOST_EVENT;
+
+/* A BlockIo2 request in flight */
+typedef struct {
+  HOST_DISK *Disk;
+  EFI_BLOCK_IO2_TOKEN *Token;
+  EFI_LBA Lba;
+  UINTN Size;
+  UINT8 *Buffer;
+  BOOLEAN Write;
+  BOOLEAN Fail;
+} HOST_IO2_REQUEST;
+
+typedef struct {
+  CHAR16 *Name;
+  EFI_GUID Guid;
+  UINT32 Attributes;
+  UINTN Size;
+  VOID *Data;
+} HOST_VARIABLE;
+
+STATIC HOST_PROTOCOL mProtocols[HOST_MAX_PROTOCOLS];
+STATIC UINTN mProtocolCount;
+STATIC UINTN mHandleCount;
+STATIC HOST_EVENT *mEvents[HOST_MAX_EVENTS];
+STATIC HOST_VARIABLE mVariables[HOST_MAX_VARIABLES];
+STATIC EFI_TPL mTpl = TPL_APPLICATION;
+STATIC UINT64 mCopiedBytes;
+STATIC HOST_IO2_REQUEST mIo2Requests[HOST_MAX_IO2];
+STATIC UINTN mIo2Count;
+
+STATIC BOOLEAN
+HostIo2Complete (VOID);
+
+STATIC EFI_TPL
+EFIAPI
+HostRaiseTpl (IN EFI_TPL NewTpl)
+{
+  EFI_TPL OldTpl = mTpl;
+
+  mTpl = NewTpl;
+  return OldTpl;
+}
+
+STATIC VOID
+EFIAPI
+HostRestoreTpl (IN EFI_TPL OldTpl)
+{
+  mTpl = OldTpl;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+HostAllocatePages (IN EFI_ALLOCATE_TYPE Type,
+                   IN EFI_MEMORY_TYPE MemoryType,
+                   IN UINTN Pages,
+                   IN OUT EFI_PHYSICAL_ADDRESS *Memory)
+{
+  VOID *Buffer;
+
+  if (Type != AllocateAnyPages) {
+    return EFI_UNSUPPORTED;
+  }
+  Buffer = AllocatePages (Pages);
+  if (!Buffer) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  *Memory = (EFI_PHYSICAL_ADDRESS)(UINTN)Buffer;
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+HostFreePages (IN EFI_PHYSICAL_ADDRESS Memory, IN UINTN Pages)
+{
+  FreePages ((VOID *)(UINTN)Memory, Pages);
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+HostAllocatePool (IN EFI_MEMORY_TYPE PoolType,
+                  IN UINTN Size,
+                  OUT VOID **Buffer)
+{
+  *Buffer = AllocatePool (Size);
+  return *Buffer ? EFI_SUCCESS : EFI_OUT_OF_RESOURCES;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+HostFreePool (IN VOID *Buffer)
+{
+  FreePool (Buffer);
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+HostCreateEvent (IN UINT32 Type,
+                 IN EFI_TPL NotifyTpl,
+                 IN EFI_EVENT_NOTIFY NotifyFunction OPTIONAL,
+                 IN VOID *NotifyContext OPTIONAL,
+                 OUT EFI_EVENT *Event)
+{
+  HOST_EVENT *NewEvent;
+  UINTN Index;
+
+  for (Index = 0; Index < HOST_MAX_EVENTS; Index++) {
+    if (!mEvents[Index]) {
+      break;
+    }
+  }
+  if (Index == HOST_MAX_EVENTS) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  NewEvent = AllocateZeroPool (sizeof (HOST_EVENT));
+  if (!NewEvent) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  NewEvent->Type = Type;
+  NewEvent->Notify = NotifyFunction;
+  NewEvent->Context = NotifyContext;
+  mEvents[Index] = NewEvent;
+  *Event = NewEvent;
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+HostCreateEventEx (IN UINT32 Type,
+                   IN EFI_TPL NotifyTpl,
+                   IN EFI_EVENT_NOTIFY NotifyFunction OPTIONAL,
+                   IN CONST VOID *NotifyContext OPTIONAL,
+                   IN CONST EFI_GUID *EventGroup OPTIONAL,
+                   OUT EFI_EVENT *Event)
+{
+  return HostCreateEvent (Type, NotifyTpl, NotifyFunction,
+                          (VOID *)NotifyContext, Event);
+}
+
+STATIC EFI_STATUS
+EFIAPI
+HostSetTimer (IN EFI_EVENT Event,
+              IN EFI_TIMER_DELAY Type,
+              IN UINT64 TriggerTime)
+{
+  HOST_EVENT *TimerEvent = Event;
+
+  if (!TimerEvent ||
+      !(TimerEvent->Type & EVT_TIMER)) {
+    return EFI_INVALID_PARAMETER;
+  }
+  TimerEvent->Armed = (Type != TimerCancel);
+  TimerEvent->Periodic = (Type == TimerPeriodic);
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+HostSignalEvent (IN EFI_EVENT Event)
+{
+  HOST_EVENT *SignalEvent = Event;
+
+  SignalEvent->Signaled = TRUE;
+  if ((SignalEvent->Type & EVT_NOTIFY_SIGNAL) &&
+      SignalEvent->Notify) {
+    SignalEvent->Notify (Event, SignalEvent->Context);
+  }
+  return EFI_SUCCESS;
+}
+
+/* An armed timer counts as signaled, the wait lasts until it expires */
+STATIC EFI_STATUS
+HostEventReady (IN EFI_EVENT Event)
+{
+  HOST_EVENT *CheckEvent = Event;
+
+  if (CheckEvent->Armed) {
+    CheckEvent->Armed = CheckEvent->Periodic;
+    CheckEvent->Signaled = TRUE;
+  }
+  if (!CheckEvent->Signaled) {
+    return EFI_NOT_READY;
+  }
+  CheckEvent->Signaled = FALSE;
+  return EFI_SUCCESS;
+}
+
+/* Polling gives the disks time to complete their BlockIo2 requests */
+STATIC EFI_STATUS
+EFIAPI
+HostCheckEvent (IN EFI_EVENT Event)
+{
+  EFI_STATUS Status = HostEventReady (Event);
+
+  while (Status == EFI_NOT_READY &&
+         HostIo2Complete ()) {
+    Status = HostEventReady (Event);
+  }
+  return Status;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+HostWaitForEvent (IN UINTN NumberOfEvents,
+                  IN EFI_EVENT *Event,
+                  OUT UINTN *Index)
+{
+  UINTN Wait;
+
+  if (mTpl != TPL_APPLICATION) {
+    return EFI_UNSUPPORTED;
+  }
+
+  do {
+    for (Wait = 0; Wait < NumberOfEvents; Wait++) {
+      if (HostEventReady (Event[Wait]) == EFI_SUCCESS) {
+        *Index = Wait;
+        return EFI_SUCCESS;
+      }
+    }
+  } while (HostIo2Complete ());
+
+  /* Nothing could signal the events while the caller waits */
+  DEBUG ((EFI_D_ERROR, "WaitForEvent: no event can be signaled\n"));
+  return EFI_UNSUPPORTED;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+HostCloseEvent (IN EFI_EVENT Event)
+{
+  UINTN Index;
+
+  /* The device would signal it when the request completes */
+  for (Index = 0; Index < mIo2Count; Index++) {
+    if (mIo2Requests[Index].Token->Event == Event) {
+      DEBUG ((EFI_D_ERROR, "CloseEvent: BlockIo2 request in flight\n"));
+      mIo2Requests[Index].Disk->Io2EarlyCloses++;
+      return EFI_INVALID_PARAMETER;
+    }
+  }
+
+  for (Index = 0; Index < HOST_MAX_EVENTS; Index++) {
+    if (mEvents[Index] == Event) {
+      mEvents[Index] = NULL;
+      FreePool (Event);
+      return EFI_SUCCESS;
+    }
+  }
+  return EFI_INVALID_PARAMETER;
+}
+
+UINTN
+HostDispatchTimers (VOID)
+{
+  HOST_EVENT *TimerEvent;
+  UINTN Notified = 0;
+  UINTN Index;
+
+  for (Index = 0; Index < HOST_MAX_EVENTS; Index++) {
+    TimerEvent = mEvents[Index];
+    if (!TimerEvent ||
+        !TimerEvent->Armed) {
+      continue;
+    }
+
+    if (!TimerEvent->Periodic) {
+      TimerEvent->Armed = FALSE;
+    }
+    TimerEvent->Signaled = TRUE;
+    if ((TimerEvent->Type & EVT_NOTIFY_SIGNAL) &&
+        TimerEvent->Notify) {
+      /* The notify function may close or rearm the event */
+      TimerEvent->Notify (TimerEvent, TimerEvent->Context);
+    }
+    Notified++;
+  }
+  return Notified;
+}
+
+STATIC HOST_PROTOCOL *
+HostFindProtocol (IN EFI_HANDLE Handle, IN CONST EFI_GUID *Guid)
+{
+  UINTN Index;
+
+  for (Index = 0; Index < mProtocolCount; Index++) {
+    if ((!Handle || mProtocols[Index].Handle == Handle) &&
+        CompareGuid (&mProtocols[Index].Guid, Guid)) {
+      return &mProtocols[Index];
+    }
+  }
+  return NULL;
+}
+
+EFI_STATUS
+HostInstallProtocol (IN OUT EFI_HANDLE *Handle,
+                     IN EFI_GUID *Guid,
+                     IN VOID *Interface)
+{
+  if (mProtocolCount == HOST_MAX_PROTOCOLS) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  /* Handles are only compared, a counter is enough to tell them apart */
+  if (!*Handle) {
+    *Handle = (EFI_HANDLE)(UINTN)++mHandleCount;
+  } else if (HostFindProtocol (*Handle, Guid)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  mProtocols[mProtocolCount].Handle = *Handle;
+  CopyGuid (&mProtocols[mProtocolCount].Guid, Guid);
+  mProtocols[mProtocolCount].Interface = Interface;
+  mProtocolCount++;
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+HostInstallProtocolInterface (IN OUT EFI_HANDLE *Handle,
+                              IN EFI_GUID *Protocol,
+                              IN EFI_INTERFACE_TYPE InterfaceType,
+                              IN VOID *Interface)
+{
+  return HostInstallProtocol (Handle, Protocol, Interface);
+}
+
+STATIC EFI_STATUS
+EFIAPI
+HostHandleProtocol (IN EFI_HANDLE Handle,
+                    IN EFI_GUID *Protocol,
+                    OUT VOID **Interface)
+{
+  HOST_PROTOCOL *Found;
+
+  if (!Handle) {
+    return EFI_INVALID_PARAMETER;
+  }
+  Found = HostFindProtocol (Handle, Protocol);
+  if (!Found) {
+    return EFI_UNSUPPORTED;
+  }
+  *Interface = Found->Interface;
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+HostOpenProtocol (IN EFI_HANDLE Handle,
+                  IN EFI_GUID *Protocol,
+                  OUT VOID **Interface OPTIONAL,
+                  IN EFI_HANDLE AgentHandle,
+                  IN EFI_HANDLE ControllerHandle,
+                  IN UINT32 Attributes)
+{
+  VOID *Found;
+  EFI_STATUS Status;
+
+  Status = HostHandleProtocol (Handle, Protocol, &Found);
+  if (Status == EFI_SUCCESS &&
+      Interface) {
+    *Interface = Found;
+  }
+  return Status;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+HostCloseProtocol (IN EFI_HANDLE Handle,
+                   IN EFI_GUID *Protocol,
+                   IN EFI_HANDLE AgentHandle,
+                   IN EFI_HANDLE ControllerHandle)
+{
+  return HostFindProtocol (Handle, Protocol) ? EFI_SUCCESS : EFI_NOT_FOUND;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+HostLocateHandleBuffer (IN EFI_LOCATE_SEARCH_TYPE SearchType,
+                        IN EFI_GUID *Protocol OPTIONAL,
+                        IN VOID *SearchKey OPTIONAL,
+                        IN OUT UINTN *NoHandles,
+                        OUT EFI_HANDLE **Buffer)
+{
+  UINTN Index;
+
+  if (SearchType != ByProtocol ||
+      !Protocol) {
+    return EFI_UNSUPPORTED;
+  }
+
+  *Buffer = AllocatePool (mProtocolCount * sizeof (EFI_HANDLE));
+  if (!*Buffer) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  *NoHandles = 0;
+  for (Index = 0; Index < mProtocolCount; Index++) {
+    if (CompareGuid (&mProtocols[Index].Guid, Protocol)) {
+      (*Buffer)[(*NoHandles)++] = mProtocols[Index].Handle;
+    }
+  }
+  if (!*NoHandles) {
+    FreePool (*Buffer);
+    *Buffer = NULL;
+    return EFI_NOT_FOUND;
+  }
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+HostLocateProtocol (IN EFI_GUID *Protocol,
+                    IN VOID *Registration OPTIONAL,
+                    OUT VOID **Interface)
+{
+  HOST_PROTOCOL *Found = HostFindProtocol (NULL, Protocol);
+
+  if (!Found) {
+    *Interface = NULL;
+    return EFI_NOT_FOUND;
+  }
+  *Interface = Found->Interface;
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+HostGetNextMonotonicCount (OUT UINT64 *Count)
+{
+  STATIC UINT64 Monotonic;
+
+  *Count = Monotonic++;
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+HostStall (IN UINTN Microseconds)
+{
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+HostSetWatchdogTimer (IN UINTN Timeout,
+                      IN UINT64 WatchdogCode,
+                      IN UINTN DataSize,
+                      IN CHAR16 *WatchdogData OPTIONAL)
+{
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+HostCalculateCrc32 (IN VOID *Data, IN UINTN DataSize, OUT UINT32 *Crc32)
+{
+  CONST UINT8 *Byte = Data;
+  UINT32 Crc = MAX_UINT32;
+  UINTN Bit;
+
+  /* Bitwise CRC-32 (IEEE 802.3), the tables are not worth it here */
+  while (DataSize--) {
+    Crc ^= *Byte++;
+    for (Bit = 0; Bit < 8; Bit++) {
+      Crc = (Crc >> 1) ^ (0xEDB88320 & (0 - (Crc & 1)));
+    }
+  }
+  *Crc32 = ~Crc;
+  return EFI_SUCCESS;
+}
+
+STATIC VOID
+EFIAPI
+HostCopyMem (IN VOID *Destination, IN VOID *Source, IN UINTN Length)
+{
+  memmove (Destination, Source, Length);
+  __atomic_fetch_add (&mCopiedBytes, Length, __ATOMIC_RELAXED);
+}
+
+UINT64
+HostCopiedBytes (VOID)
+{
+  return __atomic_load_n (&mCopiedBytes, __ATOMIC_RELAXED);
+}
+
+STATIC VOID
+EFIAPI
+HostSetMem (IN VOID *Buffer, IN UINTN Size, IN UINT8 Value)
+{
+  memset (Buffer, Value, Size);
+}
+
+STATIC HOST_VARIABLE *
+HostFindVariable (IN CHAR16 *VariableName, IN EFI_GUID *VendorGuid)
+{
+  UINTN Index;
+
+  for (Index = 0; Index < HOST_MAX_VARIABLES; Index++) {
+    if (mVariables[Index].Name &&
+        !StrCmp (mVariables[Index].Name, VariableName) &&
+        CompareGuid (&mVariables[Index].Guid, VendorGuid)) {
+      return &mVariables[Index];
+    }
+  }
+  return NULL;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+HostGetVariable (IN CHAR16 *VariableName,
+                 IN EFI_GUID *VendorGuid,
+                 OUT UINT32 *Attributes OPTIONAL,
+                 IN OUT UINTN *DataSize,
+                 OUT VOID *Data)
+{
+  HOST_VARIABLE *Variable = HostFindVariable (VariableName, VendorGuid);
+
+  if (!Variable) {
+    return EFI_NOT_FOUND;
+  }
+  if (Attributes) {
+    *Attributes = Variable->Attributes;
+  }
+  if (*DataSize < Variable->Size) {
+    *DataSize = Variable->Size;
+    return EFI_BUFFER_TOO_SMALL;
+  }
+  *DataSize = Variable->Size;
+  CopyMem (Data, Variable->Data, Variable->Size);
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+HostSetVariable (IN CHAR16 *VariableName,
+                 IN EFI_GUID *VendorGuid,
+                 IN UINT32 Attributes,
+                 IN UINTN DataSize,
+                 IN VOID *Data)
+{
+  HOST_VARIABLE *Variable = HostFindVariable (VariableName, VendorGuid);
+  UINTN Index;
+
+  if (Variable) {
+    FreePool (Variable->Data);
+    Variable->Data = NULL;
+    if (!DataSize) {
+      FreePool (Variable->Name);
+      Variable->Name = NULL;
+      return EFI_SUCCESS;
+    }
+  } else {
+    if (!DataSize) {
+      return EFI_NOT_FOUND;
+    }
+    for (Index = 0; Index < HOST_MAX_VARIABLES; Index++) {
+      if (!mVariables[Index].Name) {
+        break;
+      }
+    }
+    if (Index == HOST_MAX_VARIABLES) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+    Variable = &mVariables[Index];
+    Variable->Name = AllocateCopyPool (StrSize (VariableName), VariableName);
+    CopyGuid (&Variable->Guid, VendorGuid);
+  }
+
+  Variable->Attributes = Attributes;
+  Variable->Size = DataSize;
+  Variable->Data = AllocateCopyPool (DataSize, Data);
+  return EFI_SUCCESS;
+}
+
+STATIC VOID
+EFIAPI
+HostResetSystem (IN EFI_RESET_TYPE ResetType,
+                 IN EFI_STATUS ResetStatus,
+                 IN UINTN DataSize,
+                 IN VOID *ResetData OPTIONAL)
+{
+  DEBUG ((EFI_D_ERROR, "ResetSystem %d: %r\n", ResetType, ResetStatus));
+  exit (2);
+}
+
+STATIC EFI_BOOT_SERVICES mBootServices = {
+  .RaiseTPL = HostRaiseTpl,
+  .RestoreTPL = HostRestoreTpl,
+  .AllocatePages = HostAllocatePages,
+  .FreePages = HostFreePages,
+  .AllocatePool = HostAllocatePool,
+  .FreePool = HostFreePool,
+  .CreateEvent = HostCreateEvent,
+  .SetTimer = HostSetTimer,
+  .WaitForEvent = HostWaitForEvent,
+  .SignalEvent = HostSignalEvent,
+  .CloseEvent = HostCloseEvent,
+  .CheckEvent = HostCheckEvent,
+  .InstallProtocolInterface = HostInstallProtocolInterface,
+  .HandleProtocol = HostHandleProtocol,
+  .GetNextMonotonicCount = HostGetNextMonotonicCount,
+  .Stall = HostStall,
+  .SetWatchdogTimer = HostSetWatchdogTimer,
+  .OpenProtocol = HostOpenProtocol,
+  .CloseProtocol = HostCloseProtocol,
+  .LocateHandleBuffer = HostLocateHandleBuffer,
+  .LocateProtocol = HostLocateProtocol,
+  .CalculateCrc32 = HostCalculateCrc32,
+  .CopyMem = HostCopyMem,
+  .SetMem = HostSetMem,
+  .CreateEventEx = HostCreateEventEx,
+};
+
+STATIC EFI_RUNTIME_SERVICES mRuntimeServices = {
+  .GetVariable = HostGetVariable,
+  .SetVariable = HostSetVariable,
+  .ResetSystem = HostResetSystem,
+};
+
+STATIC EFI_SYSTEM_TABLE mSystemTable = {
+  .BootServices = &mBootServices,
+  .RuntimeServices = &mRuntimeServices,
+};
+
+EFI_HANDLE gImageHandle = (EFI_HANDLE)(UINTN)MAX_UINTN;
+EFI_SYSTEM_TABLE *gST = &mSystemTable;
+EFI_BOOT_SERVICES *gBS = &mBootServices;
+EFI_RUNTIME_SERVICES *gRT = &mRuntimeServices;
+
+STATIC EFI_STATUS
+HostDiskCheck (IN EFI_BLOCK_IO_PROTOCOL *This,
+               IN UINT32 MediaId,
+               IN EFI_LBA Lba,
+               IN UINTN BufferSize)
+{
+  HOST_DISK *Disk = (HOST_DISK *)This;
+
+  if (MediaId != Disk->Media.MediaId) {
+    return EFI_MEDIA_CHANGED;
+  }
+  if (BufferSize % Disk->Media.BlockSize) {
+    return EFI_BAD_BUFFER_SIZE;
+  }
+  if (Lba > Disk->Media.LastBlock ||
+      BufferSize / Disk->Media.BlockSize > Disk->Media.LastBlock + 1 - Lba) {
+    return EFI_INVALID_PARAMETER;
+  }
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+HostDiskReset (IN EFI_BLOCK_IO_PROTOCOL *This,
+               IN BOOLEAN ExtendedVerification)
+{
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+HostDiskReadBlocks (IN EFI_BLOCK_IO_PROTOCOL *This,
+                    IN UINT32 MediaId,
+                    IN EFI_LBA Lba,
+                    IN UINTN BufferSize,
+                    OUT VOID *Buffer)
+{
+  HOST_DISK *Disk = (HOST_DISK *)This;
+  EFI_STATUS Status = HostDiskCheck (This, MediaId, Lba, BufferSize);
+
+  if (Status != EFI_SUCCESS) {
+    return Status;
+  }
+  CopyMem (Buffer, Disk->Data + Lba * Disk->Media.BlockSize, BufferSize);
+  Disk->Reads++;
+  Disk->BytesRead += BufferSize;
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+HostDiskWriteBlocks (IN EFI_BLOCK_IO_PROTOCOL *This,
+                     IN UINT32 MediaId,
+                     IN EFI_LBA Lba,
+                     IN UINTN BufferSize,
+                     IN VOID *Buffer)
+{
+  HOST_DISK *Disk = (HOST_DISK *)This;
+  EFI_STATUS Status = HostDiskCheck (This, MediaId, Lba, BufferSize);
+
+  if (Status != EFI_SUCCESS) {
+    return Status;
+  }
+  CopyMem (Disk->Data + Lba * Disk->Media.BlockSize, Buffer, BufferSize);
+  Disk->Writes++;
+  Disk->BytesWritten += BufferSize;
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+HostDiskFlushBlocks (IN EFI_BLOCK_IO_PROTOCOL *This)
+{
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+HostDiskEraseBlocks (IN EFI_BLOCK_IO_PROTOCOL *This,
+                     IN UINT32 MediaId,
+                     IN EFI_LBA Lba,
+                     IN OUT EFI_ERASE_BLOCK_TOKEN *Token,
+                     IN UINTN Size)
+{
+  HOST_DISK *Disk = (HOST_DISK *)This;
+  EFI_STATUS Status = HostDiskCheck (This, MediaId, Lba, Size);
+
+  if (Status != EFI_SUCCESS) {
+    return Status;
+  }
+  if (Disk->Erase == HOST_ERASE_ZERO) {
+    SetMem (Disk->Data + Lba * Disk->Media.BlockSize, Size, 0);
+  }
+  Disk->BytesErased += Size;
+  return EFI_SUCCESS;
+}
+
+/* Completes one BlockIo2 request, the oldest one or, if its disk completes
+ * in reverse, the newest one of that disk. FALSE if none is in flight.
+ */
+STATIC BOOLEAN
+HostIo2Complete (VOID)
+{
+  HOST_IO2_REQUEST Request;
+  HOST_DISK *Disk;
+  UINTN Pick = 0;
+  UINTN Index;
+
+  if (!mIo2Count) {
+    return FALSE;
+  }
+  if (mIo2Requests[0].Disk->Io2Order == HOST_IO2_REVERSE) {
+    for (Index = 1; Index < mIo2Count; Index++) {
+      if (mIo2Requests[Index].Disk == mIo2Requests[0].Disk) {
+        Pick = Index;
+      }
+    }
+  }
+
+  Request = mIo2Requests[Pick];
+  mIo2Count--;
+  memmove (&mIo2Requests[Pick], &mIo2Requests[Pick + 1],
+           (mIo2Count - Pick) * sizeof (HOST_IO2_REQUEST));
+
+  Disk = Request.Disk;
+  Disk->Io2InFlight--;
+  if (Request.Fail) {
+    Request.Token->TransactionStatus = EFI_DEVICE_ERROR;
+  } else if (Request.Write) {
+    Request.Token->TransactionStatus =
+        HostDiskWriteBlocks (&Disk->BlockIo, Disk->Media.MediaId,
+                             Request.Lba, Request.Size, Request.Buffer);
+  } else {
+    Request.Token->TransactionStatus =
+        HostDiskReadBlocks (&Disk->BlockIo, Disk->Media.MediaId,
+                            Request.Lba, Request.Size, Request.Buffer);
+  }
+  HostSignalEvent (Request.Token->Event);
+  return TRUE;
+}
+
+STATIC EFI_STATUS
+HostDiskQueue (IN HOST_DISK *Disk,
+               IN UINT32 MediaId,
+               IN EFI_LBA Lba,
+               IN OUT EFI_BLOCK_IO2_TOKEN *Token,
+               IN UINTN Size,
+               IN VOID *Buffer,
+               IN BOOLEAN Write)
+{
+  HOST_IO2_REQUEST *Request;
+  EFI_STATUS Status = HostDiskCheck (&Disk->BlockIo, MediaId, Lba, Size);
+
+  if (Status != EFI_SUCCESS) {
+    return Status;
+  }
+
+  /* Without an event the request is blocking */
+  if (!Token ||
+      !Token->Event) {
+    return Write ? HostDiskWriteBlocks (&Disk->BlockIo, MediaId, Lba, Size,
+                                        Buffer)
+                 : HostDiskReadBlocks (&Disk->BlockIo, MediaId, Lba, Size,
+                                       Buffer);
+  }
+
+  Disk->Io2Requests++;
+  if (Disk->Io2Requests == Disk->Io2RefuseAt) {
+    return EFI_DEVICE_ERROR;
+  }
+  if (mIo2Count == HOST_MAX_IO2) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Request = &mIo2Requests[mIo2Count++];
+  Request->Disk = Disk;
+  Request->Token = Token;
+  Request->Lba = Lba;
+  Request->Size = Size;
+  Request->Buffer = Buffer;
+  Request->Write = Write;
+  Request->Fail = (Disk->Io2Requests == Disk->Io2FailAt);
+  /* Not a success until the device says so */
+  Token->TransactionStatus = EFI_NOT_READY;
+  Disk->Io2InFlight++;
+  Disk->Io2MaxInFlight = MAX (Disk->Io2MaxInFlight, Disk->Io2InFlight);
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+HostDiskResetEx (IN EFI_BLOCK_IO2_PROTOCOL *This,
+                 IN BOOLEAN ExtendedVerification)
+{
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+HostDiskReadBlocksEx (IN EFI_BLOCK_IO2_PROTOCOL *This,
+                      IN UINT32 MediaId,
+                      IN EFI_LBA Lba,
+                      IN OUT EFI_BLOCK_IO2_TOKEN *Token,
+                      IN UINTN BufferSize,
+                      OUT VOID *Buffer)
+{
+  return HostDiskQueue (BASE_CR (This, HOST_DISK, BlockIo2), MediaId, Lba,
+                        Token, BufferSize, Buffer, FALSE);
+}
+
+STATIC EFI_STATUS
+EFIAPI
+HostDiskWriteBlocksEx (IN EFI_BLOCK_IO2_PROTOCOL *This,
+                       IN UINT32 MediaId,
+                       IN EFI_LBA Lba,
+                       IN OUT EFI_BLOCK_IO2_TOKEN *Token,
+                       IN UINTN BufferSize,
+                       IN VOID *Buffer)
+{
+  return HostDiskQueue (BASE_CR (This, HOST_DISK, BlockIo2), MediaId, Lba,
+                        Token, BufferSize, Buffer, TRUE);
+}
+
+/* Completes everything in flight, on every disk */
+STATIC EFI_STATUS
+EFIAPI
+HostDiskFlushBlocksEx (IN EFI_BLOCK_IO2_PROTOCOL *This,
+                       IN OUT EFI_BLOCK_IO2_TOKEN *Token)
+{
+  while (HostIo2Complete ()) {
+  }
+  if (Token &&
+      Token->Event) {
+    Token->TransactionStatus = EFI_SUCCESS;
+    HostSignalEvent (Token->Event);
+  }
+  return EFI_SUCCESS;
+}
+
+VOID
+HostDiskAddBlockIo2 (IN HOST_DISK *Disk, IN HOST_IO2_ORDER Order)
+{
+  Disk->Io2Order = Order;
+  Disk->BlockIo2.Media = &Disk->Media;
+  Disk->BlockIo2.Reset = HostDiskResetEx;
+  Disk->BlockIo2.ReadBlocksEx = HostDiskReadBlocksEx;
+  Disk->BlockIo2.WriteBlocksEx = HostDiskWriteBlocksEx;
+  Disk->BlockIo2.FlushBlocksEx = HostDiskFlushBlocksEx;
+  HostInstallProtocol (&Disk->Handle, &gEfiBlockIo2ProtocolGuid,
+                       &Disk->BlockIo2);
+}
+
+HOST_DISK *
+HostDiskCreate (IN UINT32 BlockSize,
+                IN UINT64 Blocks,
+                IN UINT8 Fill,
+                IN HOST_ERASE Erase)
+{
+  HOST_DISK *Disk = AllocateZeroPool (sizeof (HOST_DISK));
+
+  if (!Disk) {
+    return NULL;
+  }
+  Disk->Size = BlockSize * Blocks;
+  Disk->Data = AllocatePool (Disk->Size);
+  if (!Disk->Data) {
+    FreePool (Disk);
+    return NULL;
+  }
+  SetMem (Disk->Data, Disk->Size, Fill);
+
+  Disk->Media.MediaId = 1;
+  Disk->Media.MediaPresent = TRUE;
+  Disk->Media.LogicalPartition = TRUE;
+  Disk->Media.BlockSize = BlockSize;
+  Disk->Media.LastBlock = Blocks - 1;
+  Disk->BlockIo.Revision = EFI_BLOCK_IO_PROTOCOL_REVISION;
+  Disk->BlockIo.Media = &Disk->Media;
+  Disk->BlockIo.Reset = HostDiskReset;
+  Disk->BlockIo.ReadBlocks = HostDiskReadBlocks;
+  Disk->BlockIo.WriteBlocks = HostDiskWriteBlocks;
+  Disk->BlockIo.FlushBlocks = HostDiskFlushBlocks;
+  Disk->Erase = Erase;
+  HostInstallProtocol (&Disk->Handle, &gEfiBlockIoProtocolGuid,
+                       &Disk->BlockIo);
+
+  if (Erase != HOST_ERASE_NONE) {
+    Disk->EraseBlock.Revision = EFI_ERASE_BLOCK_PROTOCOL_REVISION;
+    Disk->EraseBlock.EraseLengthGranularity = 8;
+    Disk->EraseBlock.EraseBlocks = HostDiskEraseBlocks;
+    HostInstallProtocol (&Disk->Handle, &gEfiEraseBlockProtocolGuid,
+                         &Disk->EraseBlock);
+  }
+  return Disk;
+}
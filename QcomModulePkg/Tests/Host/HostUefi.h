@@ -0,0 +1,118 @@
+/* Copyright (c) 2021, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Boot and runtime services for the host builds of the tests: a protocol
+ * database, timer events that fire when the test dispatches them, a
+ * variable store and memory backed block devices.
+ */
+
+#ifndef __HOST_UEFI_H__
+#define __HOST_UEFI_H__
+
+#include <Uefi.h>
+#include <Protocol/BlockIo.h>
+#include <Protocol/BlockIo2.h>
+#include <Protocol/EFIEraseBlock.h>
+
+typedef enum {
+  HOST_ERASE_NONE,  /* No erase protocol on the disk handle */
+  HOST_ERASE_ZERO,  /* Erased blocks read back as zeros */
+  HOST_ERASE_STALE, /* Erase succeeds but keeps the old data */
+} HOST_ERASE;
+
+typedef enum {
+  HOST_IO2_IN_ORDER, /* Requests complete in the order they were queued */
+  HOST_IO2_REVERSE,  /* The newest request of the disk completes first */
+} HOST_IO2_ORDER;
+
+typedef struct {
+  EFI_BLOCK_IO_PROTOCOL BlockIo;
+  EFI_BLOCK_IO_MEDIA Media;
+  EFI_ERASE_BLOCK_PROTOCOL EraseBlock;
+  HOST_ERASE Erase;
+  EFI_HANDLE Handle;
+  UINT8 *Data;
+  UINT64 Size;
+  /* Counted since the disk was created */
+  UINT64 Reads;
+  UINT64 Writes;
+  UINT64 BytesRead;
+  UINT64 BytesWritten;
+  UINT64 BytesErased;
+  /* BlockIo2, see HostDiskAddBlockIo2 () */
+  EFI_BLOCK_IO2_PROTOCOL BlockIo2;
+  HOST_IO2_ORDER Io2Order;
+  /* Number of the BlockIo2 request, counted from 1, that is refused when
+   * it is queued, or that completes with EFI_DEVICE_ERROR. 0 for none.
+   */
+  UINT64 Io2RefuseAt;
+  UINT64 Io2FailAt;
+  UINT64 Io2Requests;
+  UINT32 Io2InFlight;
+  UINT32 Io2MaxInFlight;
+  /* Token events the caller closed while their request was in flight */
+  UINT32 Io2EarlyCloses;
+} HOST_DISK;
+
+/* Installs Interface for Guid on *Handle, a new handle if it is NULL */
+EFI_STATUS
+HostInstallProtocol (IN OUT EFI_HANDLE *Handle,
+                     IN EFI_GUID *Guid,
+                     IN VOID *Interface);
+
+/* Calls the notify function of every armed timer event once, as if their
+ * time had come. Returns the number of events notified.
+ */
+UINTN
+HostDispatchTimers (VOID);
+
+/* Bytes copied through gBS->CopyMem since the start */
+UINT64
+HostCopiedBytes (VOID);
+
+/* A disk of Blocks blocks of BlockSize bytes, filled with Fill, with its
+ * block IO (and erase, unless Erase is HOST_ERASE_NONE) protocol installed
+ * on Disk->Handle.
+ */
+HOST_DISK *
+HostDiskCreate (IN UINT32 BlockSize,
+                IN UINT64 Blocks,
+                IN UINT8 Fill,
+                IN HOST_ERASE Erase);
+
+/* Installs BlockIo2 on Disk->Handle. Its requests complete, in Order, when
+ * the caller waits for or checks an event that is not signaled yet: the
+ * device works while the CPU waits. Data moves when a request completes,
+ * as with DMA. Like the firmware, gBS->WaitForEvent () fails above
+ * TPL_APPLICATION.
+ */
+VOID
+HostDiskAddBlockIo2 (IN HOST_DISK *Disk, IN HOST_IO2_ORDER Order);
+
+#endif
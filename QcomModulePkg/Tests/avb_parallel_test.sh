@@ -0,0 +1,69 @@
+#!/bin/bash
+
+# Verifies generated slots with libavb avb_slot_verify (), built for the
+# host with avb_sysdeps_posix.c, and checks that hashing the partitions in
+# parallel jobs on several threads gives the same result and slot data as
+# hashing them one after the other, for a valid slot and for slots with a
+# wrong digest, a missing or short partition, an unknown algorithm or a
+# chained vbmeta signed by another key.
+#
+# Usage: avb_parallel_test.sh [seeds]   (default 2)
+
+SCRIPT_DIR="$(dirname "$(readlink -f "$0")")"
+source ${SCRIPT_DIR}/common.sh
+
+on_exit() {
+  rm -rf "$TEMP_DIR"
+}
+
+QCOM_LIB="${WORKSPACE}/QcomModulePkg/Library"
+AVB_LIB="${QCOM_LIB}/avb/libavb"
+
+build_app() {
+  local out="$1"
+  local src srcs=()
+
+  for src in "${AVB_LIB}"/avb_*.c; do
+    case "$(basename "$src")" in
+      avb_ops.c|avb_sysdeps.c) ;;
+      *) srcs+=("$src") ;;
+    esac
+  done
+
+  host_build "${out}" -DAVB_COMPILATION "${HOST_SHA2_CFLAGS[@]}" \
+    -I"${WORKSPACE}/ArmPkg/Include" \
+    -I"${WORKSPACE}/QcomModulePkg/Include/Library" \
+    -I"${QCOM_LIB}" -I"${QCOM_LIB}/avb" -I"${AVB_LIB}" \
+    "${srcs[@]}" \
+    "${QCOM_LIB}/avb/Hash2Client.c" \
+    "${QCOM_LIB}/Sha2Lib/Sha2Ce.c" \
+    "${SCRIPT_DIR}/src/avb_parallel_test_app.c"
+}
+
+main() {
+  local seeds="${1:-2}"
+  local seed name result allowed out
+
+  alert "========== Running AVB Parallel Verification Tests =========="
+
+  command_exists python3 || die "python3 is needed to generate the images"
+
+  TEMP_DIR=`mktemp -d`
+  trap on_exit EXIT
+
+  build_app "$TEMP_DIR/avb_parallel_test_app"
+
+  for ((seed = 1; seed <= seeds; seed++)); do
+    mkdir "$TEMP_DIR/${seed}"
+    python3 "${SCRIPT_DIR}/gen_vbmeta.py" "$seed" "$TEMP_DIR/${seed}" \
+      > "$TEMP_DIR/cases" || die "Cannot generate the slots of seed ${seed}"
+    while read name result allowed; do
+      out=$("$TEMP_DIR/avb_parallel_test_app" "$TEMP_DIR/${seed}/${name}" \
+            "$result" "$allowed" 200 2>&1)
+      [ $? -eq 0 ] || die "seed ${seed} ${name}: ${out}"
+    done < "$TEMP_DIR/cases"
+    rm -rf "$TEMP_DIR/${seed}"
+  done
+}
+
+main "$@"
@@ -0,0 +1,51 @@
+#!/bin/bash
+
+# Writes images through WriteBlockToPartition () to disks with a mock
+# BlockIo2 that completes requests in order or newest first, refuses or
+# fails some of them, and to disks without BlockIo2, at a raised TPL and
+# with a failing WaitForEvent. The images must read back unless the write
+# fails, and no request may be left in flight.
+#
+# Usage: block_write_test.sh [seeds]   (default 4)
+
+SCRIPT_DIR="$(dirname "$(readlink -f "$0")")"
+source ${SCRIPT_DIR}/common.sh
+
+on_exit() {
+  rm -rf "$TEMP_DIR"
+}
+
+QCOM_LIB="${WORKSPACE}/QcomModulePkg/Library"
+
+build_app() {
+  local out="$1"
+
+  host_build "${out}" -DAVB_COMPILATION -Wno-attributes \
+    -I"${WORKSPACE}/ArmPkg/Include" \
+    -I"${WORKSPACE}/QcomModulePkg/Include/Library" \
+    -I"${QCOM_LIB}" -I"${QCOM_LIB}/BootLib" \
+    "${SCRIPT_DIR}/src/block_write_test_stubs.c" \
+    "${SCRIPT_DIR}/src/block_write_test_app.c"
+}
+
+main() {
+  local seeds="${1:-4}"
+  local seed out
+
+  alert "========== Running Block Write Tests =========="
+
+  TEMP_DIR=`mktemp -d`
+  trap on_exit EXIT
+
+  build_app "$TEMP_DIR/block_write_test_app"
+
+  for ((seed = 1; seed <= seeds; seed++)); do
+    out=$("$TEMP_DIR/block_write_test_app" "$seed" 2> "$TEMP_DIR/log")
+    if [ $? -ne 0 ]; then
+      cat "$TEMP_DIR/log" >&2
+      die "seed ${seed}: ${out}"
+    fi
+  done
+}
+
+main "$@"
@@ -0,0 +1,163 @@
+#!/bin/bash
+
+# Boots generated images through the boot path of LinuxLoader on the host:
+# BootLib, libavb, LibUfdt and zlib are built with mock TrustZone, verified
+# boot, chip, platform, RAM partition, card and Hash2 protocols, and
+# partitions on memory backed block devices. Each case must reach the
+# kernel jump with the kernel, ramdisk and device tree gen_boot_images.py
+# expects, or stop before it when the images were tampered with or cannot
+# be read. The partitions are read through BlockIo, and through a BlockIo2
+# completing requests in order or newest first, failing a request, or with
+# a failing WaitForEvent. No hash may be left started on the Hash2 engine.
+# The device tree must hold the boot trace, ending with its own update.
+# Each case runs with the stock zlib inflate and with the wide one the
+# AArch64 build selects. The time, bytes and allocations of each phase are
+# printed and the output must be readable by Tools/boot_trace.py.
+#
+# Usage: boot_sim_test.sh [seeds]   (default 1)
+
+SCRIPT_DIR="$(dirname "$(readlink -f "$0")")"
+source ${SCRIPT_DIR}/common.sh
+
+on_exit() {
+  rm -rf "$TEMP_DIR"
+}
+
+QCOM_LIB="${WORKSPACE}/QcomModulePkg/Library"
+BOOT_LIB="${QCOM_LIB}/BootLib"
+AVB_LIB="${QCOM_LIB}/avb/libavb"
+FDT_LIB="${WORKSPACE}/EmbeddedPkg/Library/FdtLib"
+UFDT_LIB="${WORKSPACE}/EmbeddedPkg/Library/LibUfdt"
+
+build_app() {
+  local out="$1"
+  local src srcs=()
+  shift
+
+  for src in BootLinux Board BootStats BootTrace CmdLineBuilder Decompress \
+             DeviceInfo FdtRw HypervisorMvCalls LECmdLine LinuxLoaderLib \
+             LocateDeviceTree PartialGoods PartitionTableUpdate Recovery \
+             Rtic UpdateCmdLine UpdateDeviceTree; do
+    srcs+=("${BOOT_LIB}/${src}.c")
+  done
+  for src in "${AVB_LIB}"/avb_*.c; do
+    case "$(basename "$src")" in
+      avb_sysdeps_posix.c) ;;
+      *) srcs+=("$src") ;;
+    esac
+  done
+  for src in zutil adler32 inftrees inflate inffast inffast_wide; do
+    srcs+=("${QCOM_LIB}/zlib/${src}.c")
+  done
+  for src in fdt fdt_ro fdt_rw fdt_sw fdt_wip fdt_strerror; do
+    srcs+=("${FDT_LIB}/${src}.c")
+  done
+  for src in convert node node_dict overlay; do
+    srcs+=("${UFDT_LIB}/ufdt_${src}.c")
+  done
+
+  host_build "${out}" "$@" -DAVB_COMPILATION -DVERIFIED_BOOT_2 -DZ_SOLO \
+    -DPRODUCT_NAME=\"QC_Reference_Phone\" -DINIT_BIN=\"/init\" \
+    -Wno-attributes "${HOST_SHA2_CFLAGS[@]}" -Wl,--wrap=UpdateDeviceTree \
+    -I"${WORKSPACE}/ArmPkg/Include" \
+    -I"${WORKSPACE}/QcomModulePkg/Include/Library" \
+    -I"${QCOM_LIB}" -I"${BOOT_LIB}" -I"${QCOM_LIB}/avb" -I"${AVB_LIB}" \
+    -I"${QCOM_LIB}/zlib" -I"${FDT_LIB}" -I"${UFDT_LIB}" \
+    -I"${UFDT_LIB}/include" -I"${UFDT_LIB}/sysdeps/include" \
+    "${srcs[@]}" \
+    "${UFDT_LIB}/sysdeps/libufdt_sysdeps_vendor.c" \
+    "${QCOM_LIB}/avb/VerifiedBoot.c" \
+    "${QCOM_LIB}/avb/Hash2Client.c" \
+    "${QCOM_LIB}/avb/KeymasterClient.c" \
+    "${QCOM_LIB}/Sha2Lib/Sha2Ce.c" \
+    "${QCOM_LIB}/Lz4Lib/Lz4.c" \
+    "${SCRIPT_DIR}/src/boot_sim_stubs.c" \
+    "${SCRIPT_DIR}/src/boot_sim_app.c"
+}
+
+# boot_case <images> <locked|unlocked> <boot state, or "fails">
+# Boots with the stock zlib inflate and with the wide one of AArch64.
+boot_case() {
+  local dir="$1" lock="$2" state="$3"
+  local out="$TEMP_DIR/out"
+  local app
+
+  for app in boot_sim_app boot_sim_app_wide; do
+    # What BootLinux () hands to the kernel, the command line and the image
+    # header among others, is never freed: not a leak for LeakSanitizer
+    ASAN_OPTIONS="${ASAN_OPTIONS:+${ASAN_OPTIONS}:}detect_leaks=0" \
+      "$TEMP_DIR/${app}" "$dir" "$lock" > "$out" 2> "$TEMP_DIR/log"
+    if [ $? -ne 0 ]; then
+      [ "$state" = "fails" ] && grep -q "^Boot stopped before the kernel" \
+        "$out" && ! grep -q "^ERROR: " "$out" && continue
+      die "${dir} ${lock} ${app}: $(cat "$TEMP_DIR/out" "$TEMP_DIR/log")"
+    fi
+    [ "$state" != "fails" ] ||
+      die "${dir} ${lock} ${app}: booted $(cat "$out")"
+    grep -q "^Boot state: ${state}\b" "$out" ||
+      die "${dir} ${lock} ${app}: expected ${state}, $(cat "$out")"
+    python3 "${WORKSPACE}/QcomModulePkg/Tools/boot_trace.py" "$out" \
+      > /dev/null ||
+      die "${dir} ${lock} ${app}: boot_trace.py cannot read $(cat "$out")"
+  done
+}
+
+main() {
+  local seeds="${1:-1}"
+  local seed dir
+
+  alert "========== Running Boot Simulator Tests =========="
+
+  command_exists python3 || die "python3 is needed to generate the images"
+
+  TEMP_DIR=`mktemp -d`
+  trap on_exit EXIT
+
+  build_app "$TEMP_DIR/boot_sim_app"
+  build_app "$TEMP_DIR/boot_sim_app_wide" -DINFLATE_FAST_WIDE
+
+  for ((seed = 1; seed <= seeds; seed++)); do
+    dir="$TEMP_DIR/${seed}"
+    python3 "${SCRIPT_DIR}/gen_boot_images.py" "$seed" "$dir" ||
+      die "Cannot generate the images of seed ${seed}"
+    boot_case "$dir" unlocked ORANGE
+    boot_case "$dir" locked YELLOW
+
+    # Read ahead through BlockIo2, which must not leave reads in flight
+    BOOT_SIM_BLOCKIO2=in-order boot_case "$dir" unlocked ORANGE
+    BOOT_SIM_BLOCKIO2=newest-first boot_case "$dir" locked YELLOW
+    BOOT_SIM_BLOCKIO2=newest-first BOOT_SIM_WAIT_FAILS_AT=2 \
+      boot_case "$dir" locked YELLOW
+    BOOT_SIM_BLOCKIO2=in-order BOOT_SIM_BLOCKIO2_FAIL_AT=1 \
+      boot_case "$dir" locked fails
+
+    # Partitions read in several pieces, failing after the first was
+    # hashed, which must not keep the Hash2 engine
+    python3 "${SCRIPT_DIR}/gen_boot_images.py" "$seed" "$dir" large ||
+      die "Cannot generate the large images of seed ${seed}"
+    BOOT_SIM_BLOCKIO2=newest-first boot_case "$dir" locked YELLOW
+    BOOT_SIM_BLOCKIO2=in-order BOOT_SIM_BLOCKIO2_FAIL_AT=2 \
+      boot_case "$dir" locked fails
+
+    python3 "${SCRIPT_DIR}/gen_boot_images.py" "$seed" "$dir" indexed ||
+      die "Cannot generate the indexed images of seed ${seed}"
+    boot_case "$dir" locked YELLOW
+
+    # Tampered with, the kernel boots only while unlocked
+    printf '\xff' | dd of="$dir/boot" bs=1 seek=8192 conv=notrunc \
+      status=none
+    rm "$dir/expect_kernel"
+    boot_case "$dir" unlocked ORANGE
+    boot_case "$dir" locked fails
+
+    # Without the user key vbmeta has no trusted signer
+    python3 "${SCRIPT_DIR}/gen_boot_images.py" "$seed" "$dir" ||
+      die "Cannot generate the images of seed ${seed}"
+    rm "$dir/avb_pubkey.bin"
+    boot_case "$dir" unlocked ORANGE
+    boot_case "$dir" locked fails
+    rm -rf "$dir"
+  done
+}
+
+main "$@"
@@ -0,0 +1,43 @@
+#!/bin/bash
+
+# Checks the two pass command line builder of BootLib: quoted values,
+# arguments after "--", repeated console=, the androidboot.* override and
+# second passes that do not match the sizing pass, then random sequences of
+# appends and merges against a naive reference.
+#
+# Usage: cmdline_test.sh [seeds] [sequences]   (default 2, 100000)
+
+SCRIPT_DIR="$(dirname "$(readlink -f "$0")")"
+source ${SCRIPT_DIR}/common.sh
+
+on_exit() {
+  rm -rf "$TEMP_DIR"
+}
+
+build_app() {
+  local out="$1"
+
+  host_build "${out}" \
+    "${WORKSPACE}/QcomModulePkg/Library/BootLib/CmdLineBuilder.c" \
+    "${SCRIPT_DIR}/src/cmdline_test_app.c"
+}
+
+main() {
+  local seeds="${1:-2}"
+  local sequences="${2:-100000}"
+  local seed out
+
+  alert "========== Running Command Line Builder Tests =========="
+
+  TEMP_DIR=`mktemp -d`
+  trap on_exit EXIT
+
+  build_app "$TEMP_DIR/cmdline_test_app"
+
+  for ((seed = 1; seed <= seeds; seed++)); do
+    out=$("$TEMP_DIR/cmdline_test_app" "$seed" "$sequences" 2>&1)
+    [ $? -eq 0 ] || die "seed ${seed}: ${out}"
+  done
+}
+
+main "$@"
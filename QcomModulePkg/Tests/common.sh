@@ -0,0 +1,86 @@
+#!/bin/bash
+
+# Builds the sources under test for the build machine. The EDK2 headers are
+# used as they are, with Host/AutoGen.h standing in for the generated one.
+# BaseLib, BaseMemoryLib and PrintLib come from MdePkg, and Host/HostLib.c
+# provides MemoryAllocationLib and DebugLib over the C library.
+
+TESTS_DIR="$(dirname "$(readlink -f "${BASH_SOURCE[0]}")")"
+WORKSPACE="$(readlink -f "${TESTS_DIR}/../..")"
+CC="${CC:-cc}"
+
+alert() {
+  echo "$*" >&2
+}
+
+die() {
+  echo "ERROR: $@"
+  exit 1
+}
+
+command_exists () {
+  type "$1" &> /dev/null;
+}
+
+case "$(uname -m)" in
+  aarch64|arm64) HOST_ARCH=AArch64 ;;
+  x86_64) HOST_ARCH=X64 ;;
+  *) die "No MdePkg ProcessorBind.h for $(uname -m)" ;;
+esac
+
+HOST_CFLAGS=(
+  -std=gnu99 -O2 -g -pthread -fshort-wchar -fno-strict-aliasing -fno-builtin
+  -fsigned-char -fno-short-enums
+  -D__FORTIFY_SOURCE -D_FORTIFY_SOURCE=2
+  -Werror=implicit-function-declaration
+  -include "${TESTS_DIR}/Host/AutoGen.h"
+  -I"${TESTS_DIR}/Host"
+  -I"${WORKSPACE}/MdePkg/Include"
+  -I"${WORKSPACE}/MdePkg/Include/${HOST_ARCH}"
+  -I"${WORKSPACE}/MdeModulePkg/Include"
+  -I"${WORKSPACE}/EmbeddedPkg/Include"
+  -I"${WORKSPACE}/QcomModulePkg/Include"
+)
+
+# Sha2Lib uses the SHA2 and SHA512 instructions on AArch64, as Sha2Lib.inf
+# builds it
+HOST_SHA2_CFLAGS=()
+if [ "${HOST_ARCH}" = AArch64 ]; then
+  HOST_SHA2_CFLAGS=(-march=armv8-a+crypto+sha3)
+fi
+
+MDE_LIB="${WORKSPACE}/MdePkg/Library"
+MDE_LIB_SOURCES=(
+  "${MDE_LIB}"/BaseMemoryLib/*.c
+  "${MDE_LIB}"/BasePrintLib/*.c
+)
+for f in String SafeString BitField SwapBytes16 SwapBytes32 SwapBytes64 \
+         Unaligned Math64 DivU64x32 DivU64x32Remainder MultU64x32 LShiftU64 \
+         RShiftU64 CheckSum; do
+  MDE_LIB_SOURCES+=("${MDE_LIB}/BaseLib/${f}.c")
+done
+
+# Usage: host_build <output> <compiler arguments and sources...>
+# ${CFLAGS} is added, e.g. CFLAGS=-fsanitize=address,undefined. The MdePkg
+# libraries are built once per output directory and without ${CFLAGS}, as
+# they are not what is tested.
+host_build() {
+  local out="$1"
+  local lib="$(dirname "${out}")/mde_lib"
+  local src
+  shift
+
+  if [ ! -f "${lib}.a" ]; then
+    mkdir -p "${lib}"
+    for src in "${MDE_LIB_SOURCES[@]}"; do
+      ${CC} "${HOST_CFLAGS[@]}" -c "${src}" \
+        -o "${lib}/$(basename "$(dirname "${src}")")_$(basename "${src}" .c).o" ||
+        die "Cannot build ${src}"
+    done
+    ar rcs "${lib}.a" "${lib}"/*.o || die "Cannot archive ${lib}.a"
+  fi
+
+  ${CC} "${HOST_CFLAGS[@]}" ${CFLAGS} "$@" "${TESTS_DIR}"/Host/Host*.c \
+    "${lib}.a" -o "${out}" ||
+    die "Cannot build ${out}"
+}
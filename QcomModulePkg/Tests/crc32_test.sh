@@ -0,0 +1,78 @@
+#!/bin/bash
+
+# Checks the libavb CRC-32, which sparse image CRC chunks are checked with,
+# against known answers with long runs of zeros and against python zlib on
+# generated data fed in updates of random sizes, before and after
+# avb_crc32_init (), and prints its speed on 32 MB.
+#
+# Usage: crc32_test.sh [seeds]   (default 2)
+
+SCRIPT_DIR="$(dirname "$(readlink -f "$0")")"
+source ${SCRIPT_DIR}/common.sh
+
+on_exit() {
+  rm -rf "$TEMP_DIR"
+}
+
+AVB_LIB="${WORKSPACE}/QcomModulePkg/Library/avb/libavb"
+
+build_app() {
+  local out="$1"
+
+  host_build "${out}" -DAVB_COMPILATION \
+    -I"${WORKSPACE}/QcomModulePkg/Include/Library" -I"${AVB_LIB}" \
+    "${AVB_LIB}/avb_crc32.c" \
+    "${AVB_LIB}/avb_sysdeps_posix.c" \
+    "${SCRIPT_DIR}/src/crc32_test_app.c"
+}
+
+crc32() {
+  python3 -c 'import sys, zlib
+print("%08x" % zlib.crc32(open(sys.argv[1], "rb").read()))' "$1"
+}
+
+run_app() {
+  local data="$1"
+  local seed="$2"
+  shift 2
+  local out
+
+  out=$("$TEMP_DIR/crc32_test_app" "$data" $(crc32 "$data") "$seed" "$@" \
+        2> "$TEMP_DIR/log")
+  if [ $? -ne 0 ]; then
+    cat "$TEMP_DIR/log" >&2
+    die "$(basename "$data") seed ${seed}: ${out}"
+  fi
+  [ -z "$out" ] || echo "$out"
+}
+
+main() {
+  local seeds="${1:-2}"
+  local size seed data
+
+  alert "========== Running CRC-32 Tests =========="
+
+  command_exists python3 || die "python3 is needed to generate the data"
+
+  TEMP_DIR=`mktemp -d`
+  trap on_exit EXIT
+
+  build_app "$TEMP_DIR/crc32_test_app"
+
+  for size in 0 1 7 8 9 4096 70001 1048577 3000000; do
+    for ((seed = 1; seed <= seeds; seed++)); do
+      data="$TEMP_DIR/data_${size}_${seed}"
+      python3 "${SCRIPT_DIR}/gen_plain.py" "$size" "$seed" "$data" ||
+        die "Cannot generate ${data}"
+      run_app "$data" "$seed"
+      rm -f "$data"
+    done
+  done
+
+  data="$TEMP_DIR/data_bench"
+  python3 "${SCRIPT_DIR}/gen_plain.py" 33554432 1 "$data" ||
+    die "Cannot generate ${data}"
+  run_app "$data" 1 3
+}
+
+main "$@"
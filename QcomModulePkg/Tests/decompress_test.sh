@@ -0,0 +1,156 @@
+#!/bin/bash
+
+# Compresses generated kernel images with the gzip and lz4 tools as the
+# kernel build does, Image.gz and Image.lz4 ("lz4 -l" with the decoded size
+# appended) and LZ4 frames, with and without an appended dtb, and checks the
+# BootLib decompressors decode them and find the end of the kernel. The
+# gzip data is also inflated in pieces of random sizes.
+#
+# Every case runs with the stock inflate_fast () of zlib, with the wide
+# decoder of inffast_wide.c the AArch64 build selects (INFLATE_FAST_WIDE),
+# and with the wide decoder loading aligned words as it does under
+# -mstrict-align (INFLATE_FAST_ALIGNED). Then the decode speed of each on
+# a large generated kernel, and on the kernels of KERNEL_CORPUS, a
+# directory of uncompressed Image files when set, is printed.
+#
+# Usage: decompress_test.sh [seeds]   (default 3)
+
+SCRIPT_DIR="$(dirname "$(readlink -f "$0")")"
+source ${SCRIPT_DIR}/common.sh
+
+on_exit() {
+  rm -rf "$TEMP_DIR"
+}
+
+QCOM_LIB="${WORKSPACE}/QcomModulePkg/Library"
+
+build_app() {
+  local out="$1"
+  shift
+
+  host_build "${out}" "$@" \
+    -I"${WORKSPACE}/QcomModulePkg/Include/Library" -I"${QCOM_LIB}" \
+    -I"${QCOM_LIB}/zlib" \
+    "${QCOM_LIB}"/zlib/{zutil,adler32,inftrees,inflate,inffast,inffast_wide}.c \
+    "${QCOM_LIB}/Lz4Lib/Lz4.c" \
+    "${QCOM_LIB}/BootLib/Decompress.c" \
+    "${SCRIPT_DIR}/src/decompress_test_app.c"
+}
+
+size_of() {
+  stat -c %s "$1"
+}
+
+# Appends the 4 byte little endian size of <file> to <image>, as the
+# size_append of the kernel build
+append_size() {
+  python3 -c "import struct, sys; sys.stdout.buffer.write(
+    struct.pack('<I', int(sys.argv[1])))" "$(size_of "$1")" >> "$2"
+}
+
+# Usage: check <plain> <compressed> <name> <size appended> <dtb appended>
+check() {
+  local plain="$1"
+  local compressed="$2"
+  local name="$3"
+  local image="$TEMP_DIR/image"
+  local end out variant
+
+  cp "$compressed" "$image"
+  [ "$4" = 1 ] && append_size "$plain" "$image"
+  end=$(size_of "$image")
+  [ "$5" = 1 ] && cat "$DTB" >> "$image"
+
+  for variant in "${VARIANTS[@]}"; do
+    out=$("$TEMP_DIR/decompress_test_app_${variant}" "$plain" "$image" \
+          "$name" "$end" 2>&1)
+    # UBSan reports without stopping the test
+    [ $? -eq 0 ] && ! grep -q "runtime error" <<< "$out" ||
+      die "$(basename "$compressed") size $4 dtb $5 ${variant}: ${out}"
+    [ "$name" = gzip ] || break
+  done
+}
+
+# Usage: bench <plain> <gzip image> [rounds]
+bench() {
+  local plain="$1"
+  local image="$2"
+  local variant out
+
+  for variant in "${VARIANTS[@]}"; do
+    out=$("$TEMP_DIR/decompress_test_app_${variant}" "$plain" "$image" gzip \
+          $(size_of "$image") "${3:-5}" 2>/dev/null) ||
+      die "$(basename "$image") ${variant}: ${out}"
+    echo "$(basename "$plain") ${variant}: ${out##*$'\n'}"
+  done
+}
+
+main() {
+  local seeds="${1:-3}"
+  local size seed plain dtb
+
+  alert "========== Running Kernel Decompression Tests =========="
+
+  command_exists python3 || die "python3 is needed to generate the images"
+  command_exists gzip || die "gzip is needed to compress the images"
+
+  TEMP_DIR=`mktemp -d`
+  trap on_exit EXIT
+
+  VARIANTS=(stock wide wide_aligned)
+  build_app "$TEMP_DIR/decompress_test_app_stock"
+  build_app "$TEMP_DIR/decompress_test_app_wide" -DINFLATE_FAST_WIDE
+  build_app "$TEMP_DIR/decompress_test_app_wide_aligned" -DINFLATE_FAST_WIDE \
+    -DINFLATE_FAST_ALIGNED
+
+  DTB="$TEMP_DIR/appended.dtb"
+  python3 "${SCRIPT_DIR}/gen_fdt.py" 3 1 "$DTB" || die "Cannot generate ${DTB}"
+
+  for size in 0 1 4096 300000 5000000; do
+    for ((seed = 1; seed <= seeds; seed++)); do
+      plain="$TEMP_DIR/Image_${size}_${seed}"
+      python3 "${SCRIPT_DIR}/gen_plain.py" "$size" "$seed" "$plain" ||
+        die "Cannot generate ${plain}"
+      gzip -9 -n -c "$plain" > "${plain}.gz" || die "gzip failed on ${plain}"
+      for dtb in 0 1; do
+        check "$plain" "${plain}.gz" gzip 0 "$dtb"
+      done
+      if command_exists lz4; then
+        lz4 -q -f -l -9 "$plain" "${plain}.lz4" ||
+          die "lz4 -l failed on ${plain}"
+        lz4 -q -f -9 "$plain" "${plain}.lz4f" || die "lz4 failed on ${plain}"
+        for dtb in 0 1; do
+          check "$plain" "${plain}.lz4" lz4 0 "$dtb"
+          check "$plain" "${plain}.lz4" lz4 1 "$dtb"
+          check "$plain" "${plain}.lz4f" lz4 0 "$dtb"
+        done
+      fi
+      rm -f "$plain" "${plain}".*
+    done
+  done
+
+  if ! command_exists lz4; then
+    alert "lz4 not found, LZ4 kernels skipped"
+  fi
+
+  plain="$TEMP_DIR/Image_large"
+  python3 "${SCRIPT_DIR}/gen_plain.py" $((32 * 1024 * 1024)) 1 "$plain" ||
+    die "Cannot generate ${plain}"
+  gzip -9 -n -c "$plain" > "${plain}.gz" || die "gzip failed on ${plain}"
+  bench "$plain" "${plain}.gz"
+  if command_exists lz4; then
+    lz4 -q -f -l -9 "$plain" "${plain}.lz4" || die "lz4 -l failed on ${plain}"
+    append_size "$plain" "${plain}.lz4"
+    "$TEMP_DIR/decompress_test_app_stock" "$plain" "${plain}.lz4" lz4 \
+      $(size_of "${plain}.lz4") 5 2>/dev/null || die "Image.lz4 failed"
+  fi
+
+  for plain in ${KERNEL_CORPUS:+"$KERNEL_CORPUS"/*}; do
+    [ -f "$plain" ] || continue
+    gzip -9 -n -c "$plain" > "$TEMP_DIR/corpus.gz" ||
+      die "gzip failed on ${plain}"
+    bench "$plain" "$TEMP_DIR/corpus.gz"
+  done
+}
+
+main "$@"
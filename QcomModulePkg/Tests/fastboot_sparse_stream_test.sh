@@ -0,0 +1,78 @@
+#!/bin/bash
+
+# Replays generated sparse images through the fastboot download path in
+# transfers of random sizes and checks that streaming them to a partition
+# while they arrive ("oem sparse-stream") gives the expanded image, and the
+# same partition as flashing them after the download, with and without erase
+# support on the disk. Images with a CRC chunk or the data it covers changed
+# must fail to flash, and images of many small FILL chunks must be written
+# in about one call per MB of each run of equal values. With the lz4 tool,
+# the images are also downloaded as LZ4 frames after "oem
+# download-compression lz4", and truncated or changed frames must fail.
+#
+# Usage: fastboot_sparse_stream_test.sh [seeds]   (default 10)
+
+SCRIPT_DIR="$(dirname "$(readlink -f "$0")")"
+source ${SCRIPT_DIR}/common.sh
+
+on_exit() {
+  rm -rf "$TEMP_DIR"
+}
+
+QCOM_LIB="${WORKSPACE}/QcomModulePkg/Library"
+
+build_app() {
+  local out="$1"
+  shift
+
+  host_build "${out}" "$@" -DAVB_COMPILATION -DENABLE_UPDATE_PARTITIONS_CMDS \
+    -DPRODUCT_NAME=\"QC_Reference_Phone\" -DUSERDATA_FS_TYPE=\"ext4\" \
+    -Wno-attributes \
+    -I"${WORKSPACE}/ArmPkg/Include" \
+    -I"${WORKSPACE}/QcomModulePkg/Include/Library" \
+    -I"${QCOM_LIB}" -I"${QCOM_LIB}/FastbootLib" -I"${QCOM_LIB}/BootLib" \
+    -I"${QCOM_LIB}/avb" \
+    "${QCOM_LIB}/avb/libavb/avb_crc32.c" \
+    "${QCOM_LIB}/avb/libavb/avb_sysdeps.c" \
+    "${QCOM_LIB}/Lz4Lib/Lz4.c" \
+    "${SCRIPT_DIR}/src/fastboot_test_stubs.c" \
+    "${SCRIPT_DIR}/src/fastboot_sparse_stream_test_app.c"
+}
+
+main() {
+  local seeds="${1:-10}"
+  local blocks seed image lz4 out
+
+  alert "========== Running Fastboot Sparse Stream Tests =========="
+
+  command_exists python3 || die "python3 is needed to generate the images"
+
+  if ! command_exists lz4; then
+    alert "lz4 not found, compressed downloads skipped"
+  fi
+
+  TEMP_DIR=`mktemp -d`
+  trap on_exit EXIT
+
+  build_app "$TEMP_DIR/fastboot_sparse_stream_test_app"
+
+  for blocks in 1 40 3000; do
+    for ((seed = 1; seed <= seeds; seed++)); do
+      image="$TEMP_DIR/sparse_${blocks}_${seed}"
+      python3 "${SCRIPT_DIR}/gen_sparse.py" "$blocks" "$seed" \
+        "${image}.simg" "${image}.raw" ||
+        die "Cannot generate ${image}.simg"
+      lz4=""
+      if command_exists lz4; then
+        lz4="${image}.simg.lz4"
+        lz4 -q -f "${image}.simg" "$lz4" || die "lz4 failed on ${image}.simg"
+      fi
+      out=$("$TEMP_DIR/fastboot_sparse_stream_test_app" "${image}.simg" \
+            "${image}.raw" "$seed" 2 $lz4 2>&1)
+      [ $? -eq 0 ] || die "blocks ${blocks} seed ${seed}: ${out}"
+      rm -f "${image}.simg" "${image}.raw" $lz4
+    done
+  done
+}
+
+main "$@"
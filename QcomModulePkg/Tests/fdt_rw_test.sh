@@ -0,0 +1,67 @@
+#!/bin/bash
+
+# Applies random property edits to generated device trees through FdtRw,
+# sequentially and in an edit batch, and checks both give the blob libfdt
+# gives. Both values of EnableNewNodeSearchFuc are tested. The time taken
+# by the sequential and batched paths on the largest tree is printed.
+#
+# Usage: fdt_rw_test.sh [seeds]   (default 20)
+
+SCRIPT_DIR="$(dirname "$(readlink -f "$0")")"
+source ${SCRIPT_DIR}/common.sh
+
+on_exit() {
+  rm -rf "$TEMP_DIR"
+}
+
+FDT_LIB="${WORKSPACE}/EmbeddedPkg/Library/FdtLib"
+
+build_app() {
+  local out="$1"
+  shift
+
+  host_build "${out}" "$@" -I"${FDT_LIB}" \
+    "${FDT_LIB}"/fdt.c "${FDT_LIB}"/fdt_ro.c "${FDT_LIB}"/fdt_rw.c \
+    "${FDT_LIB}"/fdt_wip.c "${FDT_LIB}"/fdt_strerror.c \
+    "${WORKSPACE}/QcomModulePkg/Library/BootLib/FdtRw.c" \
+    "${SCRIPT_DIR}/src/fdt_rw_test_app.c"
+}
+
+main() {
+  local seeds="${1:-20}"
+  local nodes pad seed search dtb out
+
+  alert "========== Running FdtRw Edit Batch Tests =========="
+
+  command_exists python3 || die "python3 is needed to generate the trees"
+
+  TEMP_DIR=`mktemp -d`
+  trap on_exit EXIT
+
+  build_app "$TEMP_DIR/fdt_rw_test_app_1" -D_PCD_VALUE_EnableNewNodeSearchFuc=TRUE
+  build_app "$TEMP_DIR/fdt_rw_test_app_0" -D_PCD_VALUE_EnableNewNodeSearchFuc=FALSE
+
+  for nodes in 0 3 20 200; do
+    dtb="$TEMP_DIR/tree_${nodes}.dtb"
+    python3 "${SCRIPT_DIR}/gen_fdt.py" "$nodes" 1 "$dtb" ||
+      die "Cannot generate ${dtb}"
+    for search in 0 1; do
+      for ((seed = 1; seed <= seeds; seed++)); do
+        for pad in 0 40 300 4096; do
+          out=$("$TEMP_DIR/fdt_rw_test_app_${search}" "$dtb" "$seed" \
+                $((seed % 7 * 15 + 1)) "$pad" 2>&1)
+          [ $? -eq 0 ] ||
+            die "nodes ${nodes} seed ${seed} pad ${pad} new node search ${search}: ${out}"
+        done
+      done
+    done
+  done
+
+  dtb="$TEMP_DIR/tree_2000.dtb"
+  python3 "${SCRIPT_DIR}/gen_fdt.py" 2000 1 "$dtb" ||
+    die "Cannot generate ${dtb}"
+  "$TEMP_DIR/fdt_rw_test_app_1" "$dtb" 1 100 65536 20 ||
+    die "nodes 2000: batch differs"
+}
+
+main "$@"
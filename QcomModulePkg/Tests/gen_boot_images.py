@@ -0,0 +1,182 @@
+#!/usr/bin/env python3
+"""Writes signed boot images for the boot simulator.
+
+Usage: gen_boot_images.py <seed> <output directory> [indexed] [large]
+
+The directory gets the boot, vendor_boot, dtbo and vbmeta images of a
+single slot device, avb_pubkey.bin, the key vbmeta is signed with, and
+what boot_sim_app must find loaded: expect_kernel, expect_ramdisk and the
+device tree properties of expect.
+
+boot and vendor_boot have version 3 headers. The kernel is an arm64 Image
+compressed with gzip, the vendor_boot dtb has the qcom,msm-id of the board
+boot_sim_app simulates by default, and dtbo has overlays for that board
+with a default and an exact subtype match and for other boards. The exact
+match must win. With "indexed", the match index of Tools/dtbo_index.py is
+written to dtbo before it is hashed. With "large", the ramdisks are a few
+MB, so that boot and vendor_boot are read in several pieces. Sizes and data
+come from <seed>.
+"""
+
+import os
+import random
+import struct
+import sys
+import zlib
+
+from gen_fdt import Node, flatten, strings, u32
+from gen_vbmeta import (cmdline_descriptor, gen_key, hash_descriptor,
+                        public_key_blob, vbmeta)
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                '..', 'Tools'))
+import dtbo_index  # noqa: E402
+
+PAGE_SIZE = 4096
+KERNEL64_MAGIC = 0x644d5241
+DT_TABLE_MAGIC = 0xd7b7ab1e
+
+# The board of boot_sim_app by default: chip, version, MTP and subtype
+CHIP_ID = 0x1a0
+CHIP_VERSION = 0x20000
+PLATFORM_MTP = 8
+SUBTYPE = 2
+
+# Overlays as (qcom,board-id, value of /soc sim-board they set)
+OVERLAYS = [
+    ((PLATFORM_MTP, 0), 'default'),
+    ((PLATFORM_MTP, SUBTYPE), 'exact'),
+    ((PLATFORM_MTP, SUBTYPE + 1), 'other-subtype'),
+    ((PLATFORM_MTP + 3, SUBTYPE), 'other-platform'),
+]
+
+BOOT_CMDLINE = 'console=ttyMSM0,115200n8'
+VENDOR_CMDLINE = 'androidboot.hardware=qcom'
+AVB_CMDLINE = 'androidboot.sim=1'
+
+
+def pad(data, align=PAGE_SIZE):
+    return data + b'\0' * (-len(data) % align)
+
+
+def random_data(rnd, size):
+    """Data that compresses, runs of random bytes"""
+    data = bytearray()
+    while len(data) < size:
+        data += bytes([rnd.getrandbits(8)]) * rnd.randrange(1, 64)
+    return bytes(data[:size])
+
+
+def kernel_image(rnd):
+    size = rnd.randrange(1 << 20, 3 << 20)
+    header = struct.pack('<IIQQQQQQII', 0x91005a4d, 0, 0x80000, size, 0xa,
+                         0, 0, 0, KERNEL64_MAGIC, 0)
+    return header + random_data(rnd, size - len(header))
+
+
+def gzip(data):
+    compressor = zlib.compressobj(9, zlib.DEFLATED, 31)
+    return compressor.compress(data) + compressor.flush()
+
+
+def boot_image(kernel, ramdisk):
+    header = struct.pack('<8sIIII4II1536s', b'ANDROID!', len(kernel),
+                         len(ramdisk), 0, 1580, 0, 0, 0, 0, 3,
+                         BOOT_CMDLINE.encode())
+    return pad(header) + pad(kernel) + pad(ramdisk)
+
+
+def vendor_boot_image(ramdisk, dtb):
+    header = struct.pack('<8sIIIII2048sI16sIIQ', b'VNDRBOOT', 3, PAGE_SIZE,
+                         0x8000, 0x1000000, len(ramdisk),
+                         VENDOR_CMDLINE.encode(), 0x100, b'sim', 2112,
+                         len(dtb), 0x1f00000)
+    return pad(header) + pad(ramdisk) + pad(dtb)
+
+
+def soc_dtb():
+    root = Node('')
+    root.prop('#address-cells', u32(2)).prop('#size-cells', u32(2))
+    root.prop('model', strings('Boot simulator'))
+    root.prop('compatible', strings('qcom,sim'))
+    root.prop('qcom,msm-id', u32(CHIP_ID, CHIP_VERSION))
+    root.child('chosen')
+    root.child('memory').prop('device_type', strings('memory')) \
+        .prop('reg', u32(0, 0, 0, 0))
+    root.child('soc').prop('sim-board', strings('none')) \
+        .prop('phandle', u32(1))
+    root.child('__symbols__').prop('soc', strings('/soc'))
+    return flatten(root)
+
+
+def overlay_dtb(board_id, value):
+    root = Node('')
+    root.prop('qcom,board-id', u32(*board_id))
+    fragment = root.child('fragment@0')
+    fragment.prop('target', u32(0xffffffff))
+    fragment.child('__overlay__').prop('sim-board', strings(value))
+    root.child('__fixups__').prop('soc', strings('/fragment@0:target:0'))
+    return flatten(root)
+
+
+def dtbo_image(indexed):
+    dtbs = [overlay_dtb(board_id, value) for board_id, value in OVERLAYS]
+    entry_offset = 32
+    offset = entry_offset + 32 * len(dtbs)
+    entries = b''
+    for dtb in dtbs:
+        custom = [0, 0, 0, 0]
+        if indexed:
+            soc_mask, board = dtbo_index.compute_index(dtb)
+            custom = [dtbo_index.INDEX_MAGIC, soc_mask, board, 0]
+        entries += struct.pack('>8I', len(dtb), offset, 0, 0, *custom)
+        offset += len(pad(dtb, 4))
+    header = struct.pack('>8I', DT_TABLE_MAGIC, offset, 32, 32, len(dtbs),
+                         entry_offset, PAGE_SIZE, 0)
+    return header + entries + b''.join(pad(dtb, 4) for dtb in dtbs)
+
+
+def main():
+    flags = sys.argv[3:]
+    if len(sys.argv) < 3 or any(flag not in ('indexed', 'large')
+                                for flag in flags):
+        sys.exit(__doc__)
+    rnd = random.Random(int(sys.argv[1]))
+    out = sys.argv[2]
+    ramdisk_min = (2 << 20) if 'large' in flags else 4096
+    ramdisk_max = (4 << 20) if 'large' in flags else (1 << 20)
+
+    kernel = kernel_image(rnd)
+    ramdisk = random_data(rnd, rnd.randrange(ramdisk_min, ramdisk_max))
+    vendor_ramdisk = random_data(rnd, rnd.randrange(ramdisk_min, ramdisk_max))
+    images = {
+        'boot': boot_image(gzip(kernel), ramdisk),
+        'vendor_boot': vendor_boot_image(vendor_ramdisk, soc_dtb()),
+        'dtbo': dtbo_image('indexed' in flags),
+    }
+
+    key = gen_key(rnd)
+    descriptors = b''
+    for name in ('boot', 'vendor_boot', 'dtbo'):
+        salt = rnd.getrandbits(256).to_bytes(32, 'little')
+        descriptors += hash_descriptor(name, images[name], salt)
+    descriptors += cmdline_descriptor(AVB_CMDLINE)
+    images['vbmeta'] = vbmeta(key, descriptors)
+    images['avb_pubkey.bin'] = public_key_blob(key[0])
+
+    images['expect_kernel'] = kernel
+    images['expect_ramdisk'] = vendor_ramdisk + ramdisk
+    images['expect'] = ('/soc sim-board exact\n'
+                        '/chosen bootargs %s\n'
+                        '/chosen bootargs %s\n'
+                        '/chosen bootargs %s\n' %
+                        (BOOT_CMDLINE, VENDOR_CMDLINE, AVB_CMDLINE)).encode()
+
+    os.makedirs(out, exist_ok=True)
+    for name, data in images.items():
+        with open(os.path.join(out, name), 'wb') as f:
+            f.write(data)
+
+
+if __name__ == '__main__':
+    main()
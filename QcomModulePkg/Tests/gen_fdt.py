@@ -0,0 +1,131 @@
+#!/usr/bin/env python3
+"""Writes a flattened device tree for the tests without needing dtc.
+
+Usage: gen_fdt.py <nodes> <seed> <output>
+
+The tree has the nodes the boot path edits (chosen, memory, reserved-memory,
+firmware/android/fstab), nodes with no properties and with no children, and
+<nodes> devices under /soc with random properties, generated from <seed>.
+"""
+
+import random
+import struct
+import sys
+
+FDT_MAGIC = 0xd00dfeed
+FDT_BEGIN_NODE, FDT_END_NODE, FDT_PROP, FDT_END = 1, 2, 3, 9
+
+
+class Node(object):
+    def __init__(self, name):
+        self.name = name
+        self.props = []
+        self.children = []
+
+    def prop(self, name, value):
+        self.props.append((name, value))
+        return self
+
+    def child(self, name):
+        node = Node(name)
+        self.children.append(node)
+        return node
+
+
+def u32(*values):
+    return b''.join(struct.pack('>I', v) for v in values)
+
+
+def strings(*values):
+    return b''.join(v.encode() + b'\0' for v in values)
+
+
+def flatten(root):
+    dt_struct = bytearray()
+    dt_strings = bytearray()
+    offsets = {}
+
+    def align():
+        dt_struct.extend(b'\0' * (-len(dt_struct) % 4))
+
+    def emit(node):
+        dt_struct.extend(u32(FDT_BEGIN_NODE))
+        dt_struct.extend(node.name.encode() + b'\0')
+        align()
+        for name, value in node.props:
+            if name not in offsets:
+                offsets[name] = len(dt_strings)
+                dt_strings.extend(name.encode() + b'\0')
+            dt_struct.extend(u32(FDT_PROP, len(value), offsets[name]))
+            dt_struct.extend(value)
+            align()
+        for child in node.children:
+            emit(child)
+        dt_struct.extend(u32(FDT_END_NODE))
+
+    emit(root)
+    dt_struct.extend(u32(FDT_END))
+
+    header_size = 40
+    rsvmap = b'\0' * 16
+    off_struct = header_size + len(rsvmap)
+    off_strings = off_struct + len(dt_struct)
+    total = off_strings + len(dt_strings)
+    header = struct.pack('>10I', FDT_MAGIC, total, off_struct, off_strings,
+                         header_size, 17, 16, 0, len(dt_strings),
+                         len(dt_struct))
+    return header + rsvmap + bytes(dt_struct) + bytes(dt_strings)
+
+
+def generate(nodes, rnd):
+    root = Node('')
+    root.prop('#address-cells', u32(2)).prop('#size-cells', u32(2))
+    root.prop('model', strings('host'))
+    chosen = root.child('chosen')
+    chosen.prop('bootargs', strings('console=ttyMSM0'))
+    chosen.prop('stdout-path', strings('serial0'))
+    memory = root.child('memory').prop('device_type', strings('memory'))
+    memory.prop('reg', u32(0, 0x80000000, 0, 0x1000))
+    root.child('empty')
+    root.child('bare').child('kid@1').prop('status', strings('okay'))
+    reserved = root.child('reserved-memory').prop('ranges', b'')
+    reserved.child('splash_region').prop('reg', u32(0, 1, 0, 2))
+
+    soc = root.child('soc').prop('compatible', strings('simple-bus'))
+    for i in range(nodes):
+        dev = soc.child('dev%04d@%x' % (i, i))
+        dev.prop('compatible', strings('vendor,dev%d' % (i % 7)))
+        dev.prop('reg', u32(0, i * 0x1000, 0, 0x1000))
+        if rnd.random() < 0.5:
+            dev.prop('status', strings(rnd.choice(['ok', 'okay', 'disabled'])))
+        if rnd.random() < 0.3:
+            dev.prop('blob', bytes(rnd.randrange(256)
+                                   for _ in range(rnd.randrange(600))))
+        if rnd.random() < 0.3:
+            dev.child('sub').prop('x', u32(i))
+    for i in range(nodes // 8):
+        top = root.child('top%05d' % i)
+        if rnd.random() < 0.7:
+            top.prop('val', u32(i))
+        if rnd.random() < 0.5:
+            top.child('c').prop('y', u32(1))
+
+    fstab = root.child('firmware').child('android').child('fstab')
+    for name in ('system', 'vendor'):
+        part = fstab.child(name)
+        part.prop('dev', strings('/dev/block/platform/soc/1d84000.ufshc/'
+                                 'by-name/' + name))
+        part.prop('status', strings('okay'))
+    return flatten(root)
+
+
+def main():
+    if len(sys.argv) != 4:
+        sys.exit(__doc__)
+    blob = generate(int(sys.argv[1]), random.Random(int(sys.argv[2])))
+    with open(sys.argv[3], 'wb') as f:
+        f.write(blob)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,240 @@
+#!/usr/bin/env python3
+"""Writes a device tree and overlays to apply to it, without needing dtc.
+
+Usage: gen_overlays.py <overlays> <seed> <output directory>
+
+The directory gets base.dtb, with devices under /soc that have phandles and
+/__symbols__ labels, overlay-NNN.dtb, to be applied in order, and expect,
+with a "node <path>" line for each node the applied overlays must leave
+and a "label <name> <path>" line for each label of /__symbols__. The
+fragments of an overlay target nodes by label through __fixups__ or by
+target-path, also nodes and labels added by the overlays before it and
+paths added by its own earlier fragments. They add nodes with phandles,
+referenced through __local_fixups__, properties referencing labels, and
+override properties, root properties, labels and the phandles of existing
+nodes. Everything comes from <seed>.
+"""
+
+import os
+import random
+import sys
+
+from gen_fdt import Node, flatten, strings, u32
+
+DEVICES = 96
+UNRESOLVED = 0xffffffff
+
+
+def join(parent, name):
+    return ('' if parent == '/' else parent) + '/' + name
+
+
+class Tree(object):
+    """What the overlays applied so far have left in the base tree"""
+
+    def __init__(self):
+        self.children = {'/': []}
+        self.labels = {}
+
+    def add(self, parent, name):
+        path = join(parent, name)
+        if path not in self.children:
+            self.children[parent].append(name)
+            self.children[path] = []
+        return path
+
+    def targets(self):
+        return sorted(p for p in self.children
+                      if not p.startswith('/__symbols__'))
+
+
+def base_dtb(rnd, tree):
+    root = Node('')
+    root.prop('#address-cells', u32(2)).prop('#size-cells', u32(2))
+    root.prop('model', strings('overlay base'))
+    root.prop('qcom,board-id', u32(8, 0))
+    root.child('chosen').prop('bootargs', strings('console=ttyMSM0'))
+    tree.add('/', 'chosen')
+    soc = root.child('soc').prop('compatible', strings('simple-bus'))
+    tree.add('/', 'soc')
+
+    phandles = rnd.sample(range(1, 4 * DEVICES), DEVICES)
+    for i in range(DEVICES):
+        name = 'dev%03d@%x' % (i, i * 0x1000)
+        dev = soc.child(name)
+        dev.prop('reg', u32(0, i * 0x1000, 0, 0x1000))
+        dev.prop('status', strings('okay'))
+        path = tree.add('/soc', name)
+        if rnd.random() < 0.7:
+            dev.prop('phandle', u32(phandles[i]))
+            tree.labels['dev%d' % i] = path
+        if rnd.random() < 0.3:
+            dev.child('sub').prop('x', u32(i))
+            tree.add(path, 'sub')
+
+    symbols = root.child('__symbols__')
+    for label in sorted(tree.labels):
+        symbols.prop(label, strings(tree.labels[label]))
+    tree.add('/', '__symbols__')
+    return flatten(root)
+
+
+class Overlay(object):
+    def __init__(self, index, rnd, tree):
+        self.index = index
+        self.rnd = rnd
+        self.tree = tree
+        self.nodes = 0
+        self.phandles = 0
+        self.fixups = {}
+        self.local_fixups = {}
+        self.labels = {}
+
+    def fixup(self, label, location):
+        self.fixups.setdefault(label, []).append(location)
+
+    def local_fixup(self, path, name, offset):
+        node = self.local_fixups
+        for part in path.strip('/').split('/'):
+            node = node.setdefault(part, {})
+        node.setdefault(name, []).append(offset)
+
+    def props(self, node, path, used):
+        rnd = self.rnd
+        for _ in range(rnd.randrange(4)):
+            kind = rnd.random()
+            if kind < 0.3:
+                name = rnd.choice(['status', 'data0', 'data1', 'reg'])
+                value = bytes(rnd.randrange(256)
+                              for _ in range(rnd.randrange(24)))
+            elif kind < 0.6:
+                name = 'clocks'
+                label = rnd.choice(sorted(self.tree.labels))
+                value = u32(UNRESOLVED, rnd.randrange(8))
+            elif self.phandles:
+                name = 'link'
+                value = u32(UNRESOLVED, 5, 1 + rnd.randrange(self.phandles))
+            else:
+                continue
+            if name in used:
+                continue
+            used.add(name)
+            node.prop(name, value)
+            if name == 'clocks':
+                self.fixup(label, '%s:%s:0' % (path, name))
+            elif name == 'link':
+                self.fixup(rnd.choice(sorted(self.tree.labels)),
+                           '%s:%s:0' % (path, name))
+                self.local_fixup(path, name, 8)
+
+    def fill(self, node, target, path, depth):
+        """Fills node, merged over target, at path of the overlay"""
+        rnd = self.rnd
+        used = set()
+        self.props(node, path, used)
+
+        # A new phandle for the target, the old one is no longer valid
+        if depth == 0 and target != '/' and rnd.random() < 0.15:
+            self.phandles += 1
+            node.prop('phandle', u32(self.phandles))
+            self.labels['o%dr%d' % (self.index, self.phandles)] = target
+
+        if depth >= 2:
+            return
+        names = set()
+        for _ in range(rnd.randrange(3)):
+            existing = [c for c in self.tree.children.get(target, [])
+                        if c != '__symbols__']
+            if existing and rnd.random() < 0.3:
+                name = rnd.choice(existing)
+            else:
+                self.nodes += 1
+                name = 'o%dn%d' % (self.index, self.nodes)
+            if name in names:
+                continue
+            names.add(name)
+            child = node.child(name)
+            child_target = join(target, name)
+            new = child_target not in self.tree.children
+            self.tree.add(target, name)
+            self.fill(child, child_target, '%s/%s' % (path, name), depth + 1)
+            if new and rnd.random() < 0.6:
+                self.phandles += 1
+                child.prop('phandle', u32(self.phandles))
+                self.labels[name] = child_target
+
+    def dtb(self):
+        rnd = self.rnd
+        tree = self.tree
+        root = Node('')
+        if rnd.random() < 0.3:
+            root.prop('model', strings('overlay %d' % self.index))
+        if rnd.random() < 0.3:
+            root.prop('qcom,board-id', u32(8, self.index))
+
+        fragments = 1 + rnd.randrange(5)
+        for i in range(fragments):
+            fragment = root.child('fragment@%d' % i)
+            if rnd.random() < 0.5:
+                label = rnd.choice(sorted(tree.labels))
+                target = tree.labels[label]
+                fragment.prop('target', u32(UNRESOLVED))
+                self.fixup(label, '/fragment@%d:target:0' % i)
+            else:
+                target = rnd.choice(tree.targets())
+                fragment.prop('target-path', strings(target))
+            self.fill(fragment.child('__overlay__'), target,
+                      '/fragment@%d/__overlay__' % i, 0)
+
+        # Labels of the new phandles, and old labels moved to them
+        if self.labels and rnd.random() < 0.5:
+            for _ in range(rnd.randrange(3)):
+                old = rnd.choice(sorted(tree.labels))
+                self.labels[old] = rnd.choice(sorted(self.labels.values()))
+        if self.labels:
+            fragment = root.child('fragment@%d' % fragments)
+            fragment.prop('target-path', strings('/__symbols__'))
+            symbols = fragment.child('__overlay__')
+            for label in sorted(self.labels):
+                symbols.prop(label, strings(self.labels[label]))
+            tree.labels.update(self.labels)
+
+        fixups = root.child('__fixups__')
+        for label in sorted(self.fixups):
+            fixups.prop(label, strings(*self.fixups[label]))
+        if self.local_fixups:
+            add_local_fixups(root.child('__local_fixups__'),
+                             self.local_fixups)
+        return flatten(root)
+
+
+def add_local_fixups(node, fixups):
+    for name in sorted(fixups):
+        if isinstance(fixups[name], dict):
+            add_local_fixups(node.child(name), fixups[name])
+        else:
+            node.prop(name, u32(*fixups[name]))
+
+
+def main():
+    if len(sys.argv) != 4:
+        sys.exit(__doc__)
+    count = int(sys.argv[1])
+    rnd = random.Random(int(sys.argv[2]))
+    out = sys.argv[3]
+
+    tree = Tree()
+    with open(os.path.join(out, 'base.dtb'), 'wb') as f:
+        f.write(base_dtb(rnd, tree))
+    for i in range(count):
+        with open(os.path.join(out, 'overlay-%03d.dtb' % i), 'wb') as f:
+            f.write(Overlay(i, rnd, tree).dtb())
+    with open(os.path.join(out, 'expect'), 'w') as f:
+        for path in sorted(tree.children):
+            f.write('node %s\n' % path)
+        for label in sorted(tree.labels):
+            f.write('label %s %s\n' % (label, tree.labels[label]))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,49 @@
+#!/usr/bin/env python3
+"""Writes data of a given size for the decompression tests.
+
+Usage: gen_plain.py <size> <seed> <output>
+
+The data is made of pieces of random sizes generated from <seed>: random
+bytes, words, runs of zeros and patterns repeating with short periods, so
+that compressors emit literal runs and matches of all lengths, near and far
+offsets and matches overlapping their own output.
+"""
+
+import random
+import sys
+
+WORDS = [b'boot', b'system', b'vendor', b'fastboot ', b'android',
+         b'qcom,msm-id', b'linux,initrd-start', b'\n']
+
+
+def piece(rnd):
+    size = rnd.choice([1, 5, 17, 300, 4096, 70000])
+    kind = rnd.random()
+    if kind < 0.25:
+        return rnd.getrandbits(8 * size).to_bytes(size, 'little')
+    if kind < 0.5:
+        data = bytearray()
+        while len(data) < size:
+            data.extend(rnd.choice(WORDS))
+        return bytes(data)
+    if kind < 0.6:
+        return b'\0' * size
+    period = rnd.randint(1, 40)
+    pattern = rnd.getrandbits(8 * period).to_bytes(period, 'little')
+    return (pattern * (size // period + 1))[:size + rnd.randint(0, period)]
+
+
+def main():
+    if len(sys.argv) != 4:
+        sys.exit(__doc__)
+    size, seed = int(sys.argv[1]), int(sys.argv[2])
+    rnd = random.Random(seed)
+    data = bytearray()
+    while len(data) < size:
+        data.extend(piece(rnd))
+    with open(sys.argv[3], 'wb') as f:
+        f.write(data[:size])
+
+
+if __name__ == '__main__':
+    main()
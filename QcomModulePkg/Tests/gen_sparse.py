@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+"""Writes an Android sparse image and its expanded raw image for the tests.
+
+Usage: gen_sparse.py <blocks> <seed> <sparse output> <raw output>
+
+The image covers <blocks> blocks of 4096 bytes with RAW chunks of random and
+of compressible data, FILL chunks of zeros and of other values (runs of
+equal FILL chunks included), DONT_CARE chunks and CRC32 chunks checking the
+image so far, generated from <seed>. DONT_CARE blocks are zeros in the raw
+image, as on a disk that was zeroed before the flash.
+"""
+
+import random
+import struct
+import sys
+import zlib
+
+SPARSE_HEADER_MAGIC = 0xed26ff3a
+CHUNK_TYPE_RAW, CHUNK_TYPE_FILL = 0xcac1, 0xcac2
+CHUNK_TYPE_DONT_CARE, CHUNK_TYPE_CRC = 0xcac3, 0xcac4
+BLOCK_SIZE = 4096
+
+
+def chunk(chunk_type, blocks, data=b''):
+    return struct.pack('<HHII', chunk_type, 0, blocks, 12 + len(data)) + data
+
+
+def raw_data(blocks, rnd):
+    size = blocks * BLOCK_SIZE
+    if rnd.random() < 0.5:
+        return rnd.getrandbits(8 * size).to_bytes(size, 'little')
+    words = [b'boot', b'system', b'vendor', b'\0' * 64, b'fastboot ']
+    data = bytearray()
+    while len(data) < size:
+        data.extend(rnd.choice(words))
+    return bytes(data[:size])
+
+
+def generate(total, rnd):
+    chunks = []
+    raw = bytearray()
+    fill = None
+    while len(raw) < total * BLOCK_SIZE:
+        left = total - len(raw) // BLOCK_SIZE
+        blocks = min(left, rnd.choice([1, 2, 3, 8, 17, 64, 300, 1024]))
+        kind = rnd.random()
+        if fill is not None and kind < 0.15:
+            # Same value as the FILL chunk before, they are merged
+            chunks.append(chunk(CHUNK_TYPE_FILL, blocks,
+                                struct.pack('<I', fill)))
+            raw.extend(struct.pack('<I', fill) * (blocks * BLOCK_SIZE // 4))
+            continue
+        fill = None
+        if kind < 0.45:
+            data = raw_data(blocks, rnd)
+            chunks.append(chunk(CHUNK_TYPE_RAW, blocks, data))
+            raw.extend(data)
+        elif kind < 0.75:
+            fill = 0 if rnd.random() < 0.6 else rnd.getrandbits(32)
+            chunks.append(chunk(CHUNK_TYPE_FILL, blocks,
+                                struct.pack('<I', fill)))
+            raw.extend(struct.pack('<I', fill) * (blocks * BLOCK_SIZE // 4))
+        elif kind < 0.9:
+            chunks.append(chunk(CHUNK_TYPE_DONT_CARE, blocks))
+            raw.extend(b'\0' * (blocks * BLOCK_SIZE))
+        else:
+            chunks.append(chunk(CHUNK_TYPE_CRC, 0,
+                                struct.pack('<I', zlib.crc32(raw))))
+    chunks.append(chunk(CHUNK_TYPE_CRC, 0, struct.pack('<I', zlib.crc32(raw))))
+
+    header = struct.pack('<IHHHHIIII', SPARSE_HEADER_MAGIC, 1, 0, 28, 12,
+                         BLOCK_SIZE, total, len(chunks), 0)
+    return header + b''.join(chunks), bytes(raw)
+
+
+def main():
+    if len(sys.argv) != 5:
+        sys.exit(__doc__)
+    sparse, raw = generate(int(sys.argv[1]), random.Random(int(sys.argv[2])))
+    with open(sys.argv[3], 'wb') as f:
+        f.write(sparse)
+    with open(sys.argv[4], 'wb') as f:
+        f.write(raw)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,197 @@
+#!/usr/bin/env python3
+"""Writes signed vbmeta and partition images for the libavb tests.
+
+Usage: gen_vbmeta.py <seed> <output directory>
+
+For each case a directory <case> is written with the partitions of slot a,
+<name>_a, and a line "<case> <result> <result with allow>" is printed with
+the avb_slot_verify () results expected without and with
+AVB_SLOT_VERIFY_FLAGS_ALLOW_VERIFICATION_ERROR.
+
+vbmeta_a has hash descriptors of boot, vendor_boot, dtbo, odm (which is
+not requested), a kernel command line and a chain descriptor of
+vbmeta_system, whose own hash descriptors are those of init_boot and
+vendor_kernel_boot. The images have random sizes and data, generated from
+<seed>, and the RSA-2048 keys are generated from <seed> too. The cases
+break one thing each: a digest, a partition, an algorithm name, the size
+of a partition or the key of the chained vbmeta.
+"""
+
+import hashlib
+import os
+import random
+import struct
+import sys
+
+SHA256_RSA2048 = 1
+TAG_HASH, TAG_KERNEL_CMDLINE, TAG_CHAIN = 2, 3, 4
+SHA256_DIGEST_INFO = bytes.fromhex('3031300d060960864801650304020105000420')
+
+MAIN = ['boot', 'vendor_boot', 'dtbo', 'odm']
+CHAINED = ['init_boot', 'vendor_kernel_boot']
+
+CASES = [
+    ('ok', 'OK', 'OK'),
+    ('digest', 'ERROR_VERIFICATION', 'ERROR_VERIFICATION'),
+    ('chain_digest', 'ERROR_VERIFICATION', 'ERROR_VERIFICATION'),
+    ('missing', 'ERROR_IO', 'ERROR_IO'),
+    ('algorithm', 'ERROR_INVALID_METADATA', 'ERROR_INVALID_METADATA'),
+    ('short', 'ERROR_IO', 'ERROR_VERIFICATION'),
+    ('chain_key', 'ERROR_PUBLIC_KEY_REJECTED', 'ERROR_PUBLIC_KEY_REJECTED'),
+]
+
+
+def is_prime(n, rnd):
+    for p in (2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37):
+        if n % p == 0:
+            return n == p
+    d, s = n - 1, 0
+    while d % 2 == 0:
+        d, s = d // 2, s + 1
+    for _ in range(20):
+        x = pow(rnd.randrange(2, n - 1), d, n)
+        if x in (1, n - 1):
+            continue
+        for _ in range(s - 1):
+            x = pow(x, 2, n)
+            if x == n - 1:
+                break
+        else:
+            return False
+    return True
+
+
+def gen_prime(bits, rnd):
+    while True:
+        n = rnd.getrandbits(bits) | (3 << (bits - 2)) | 1
+        if is_prime(n, rnd):
+            return n
+
+
+def gen_key(rnd):
+    e = 65537
+    while True:
+        p, q = gen_prime(1024, rnd), gen_prime(1024, rnd)
+        phi = (p - 1) * (q - 1)
+        if p != q and phi % e:
+            return p * q, pow(e, -1, phi)
+
+
+def public_key_blob(n):
+    """The key as AvbRSAPublicKeyHeader, modulus and R^2 mod n"""
+    n0inv = (1 << 32) - pow(n, -1, 1 << 32)
+    rr = pow(1 << 2048, 2, n)
+    return (struct.pack('>II', 2048, n0inv) + n.to_bytes(256, 'big') +
+            rr.to_bytes(256, 'big'))
+
+
+def sign(key, data):
+    n, d = key
+    digest = hashlib.sha256(data).digest()
+    suffix = b'\0' + SHA256_DIGEST_INFO + digest
+    padded = b'\0\1' + b'\xff' * (256 - 2 - len(suffix)) + suffix
+    return pow(int.from_bytes(padded, 'big'), d, n).to_bytes(256, 'big')
+
+
+def pad(data, align):
+    return data + b'\0' * (-len(data) % align)
+
+
+def descriptor(tag, body):
+    body = pad(body, 8)
+    return struct.pack('>QQ', tag, len(body)) + body
+
+
+def hash_descriptor(name, image, salt, alg='sha256', bad=False):
+    digest = hashlib.new('sha512' if alg == 'sha512' else 'sha256',
+                         salt + image).digest()
+    if bad:
+        digest = bytes([digest[0] ^ 1]) + digest[1:]
+    return descriptor(TAG_HASH, struct.pack(
+        '>Q32sIIII60s', len(image), alg.encode(), len(name), len(salt),
+        len(digest), 0, b'') + name.encode() + salt + digest)
+
+
+def cmdline_descriptor(cmdline):
+    return descriptor(TAG_KERNEL_CMDLINE,
+                      struct.pack('>II', 0, len(cmdline)) + cmdline.encode())
+
+
+def chain_descriptor(name, location, key_blob):
+    return descriptor(TAG_CHAIN, struct.pack(
+        '>III64s', location, len(name), len(key_blob), b'') +
+        name.encode() + key_blob)
+
+
+def vbmeta(key, descriptors):
+    key_blob = public_key_blob(key[0])
+    aux = pad(descriptors + key_blob, 64)
+    auth_size = 320
+    header = struct.pack('>4sIIQQI', b'AVB0', 1, 0, auth_size, len(aux),
+                         SHA256_RSA2048)
+    header += struct.pack('>10Q', 0, 32, 32, 256, len(descriptors),
+                          len(key_blob), len(descriptors) + len(key_blob), 0,
+                          0, len(descriptors))
+    header += struct.pack('>QI4s48s80s', 0, 0, b'', b'gen_vbmeta.py', b'')
+    assert len(header) == 256
+    signed = header + aux
+    auth = pad(hashlib.sha256(signed).digest() + sign(key, signed), 64)
+    return header + auth + aux
+
+
+def write_case(out, case, rnd, main_key, chain_key, other_key):
+    images = {}
+    for name in MAIN + CHAINED:
+        size = rnd.choice([1, 4096, 100000, 1 << 20, 3 << 20]) + \
+            rnd.randrange(4096)
+        images[name] = rnd.getrandbits(8 * size).to_bytes(size, 'little')
+
+    def descs(names, bad):
+        data = b''
+        for name in names:
+            alg = 'sha512' if name == 'dtbo' else 'sha256'
+            if case == 'algorithm' and name == 'vendor_boot':
+                alg = 'md5'
+            salt = rnd.getrandbits(256).to_bytes(32, 'little')
+            data += hash_descriptor(name, images[name], salt, alg,
+                                    bad == name)
+        return data
+
+    bad = {'digest': 'vendor_boot', 'chain_digest': 'init_boot'}.get(case)
+    main = descs(MAIN, bad)
+    main += cmdline_descriptor('androidboot.test=%d '
+                               'root=PARTUUID=$(ANDROID_SYSTEM_PARTUUID)' %
+                               rnd.randrange(1000))
+    main += chain_descriptor('vbmeta_system', 1, public_key_blob(chain_key[0]))
+    chained = descs(CHAINED, bad)
+
+    path = os.path.join(out, case)
+    os.makedirs(path)
+    for name, image in images.items():
+        if case == 'missing' and name == 'dtbo':
+            continue
+        if case == 'short' and name == 'boot':
+            image = image[:len(image) // 2 + 1]
+        else:
+            image += b'\0' * rnd.randrange(8192)
+        with open(os.path.join(path, name + '_a'), 'wb') as f:
+            f.write(image)
+    with open(os.path.join(path, 'vbmeta_a'), 'wb') as f:
+        f.write(vbmeta(main_key, main))
+    with open(os.path.join(path, 'vbmeta_system_a'), 'wb') as f:
+        f.write(vbmeta(other_key if case == 'chain_key' else chain_key,
+                       chained))
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(__doc__)
+    rnd = random.Random(int(sys.argv[1]))
+    keys = [gen_key(rnd) for _ in range(3)]
+    for case, result, allowed in CASES:
+        write_case(sys.argv[2], case, rnd, *keys)
+        print(case, result, allowed)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,77 @@
+#!/bin/bash
+
+# Compresses generated data with the lz4 tool, in the frame formats it can
+# write, and checks Lz4Lib decodes it whole and as it arrives in pieces,
+# and rejects truncated and changed frames. The decode speed on the largest
+# image is printed.
+#
+# Usage: lz4_test.sh [seeds]   (default 3)
+
+SCRIPT_DIR="$(dirname "$(readlink -f "$0")")"
+source ${SCRIPT_DIR}/common.sh
+
+on_exit() {
+  rm -rf "$TEMP_DIR"
+}
+
+FORMATS=(
+  "" "-1" "-9" "-B4" "-B5 -BD" "-B4 -BD -BX" "-BX --no-frame-crc"
+  "--content-size" "--no-frame-crc" "-l" "-l -9"
+)
+
+build_app() {
+  local out="$1"
+  shift
+
+  host_build "${out}" "$@" \
+    "${WORKSPACE}/QcomModulePkg/Library/Lz4Lib/Lz4.c" \
+    "${SCRIPT_DIR}/src/lz4_test_app.c"
+}
+
+main() {
+  local seeds="${1:-3}"
+  local size seed format plain frame out
+
+  alert "========== Running LZ4 Decoder Tests =========="
+
+  command_exists python3 || die "python3 is needed to generate the data"
+  if ! command_exists lz4; then
+    alert "lz4 not found, skipped"
+    return 0
+  fi
+
+  TEMP_DIR=`mktemp -d`
+  trap on_exit EXIT
+
+  build_app "$TEMP_DIR/lz4_test_app"
+
+  for size in 0 1 13 4096 70000 1100000; do
+    for ((seed = 1; seed <= seeds; seed++)); do
+      plain="$TEMP_DIR/plain_${size}_${seed}"
+      python3 "${SCRIPT_DIR}/gen_plain.py" "$size" "$seed" "$plain" ||
+        die "Cannot generate ${plain}"
+      for format in "${FORMATS[@]}"; do
+        frame="${plain}.lz4"
+        lz4 -q -f ${format} "$plain" "$frame" ||
+          die "lz4 ${format} failed on ${size} bytes"
+        out=$("$TEMP_DIR/lz4_test_app" "$plain" "$frame" "$seed" 2>&1)
+        [ $? -eq 0 ] ||
+          die "size ${size} seed ${seed} format \"${format}\": ${out}"
+      done
+      rm -f "$plain" "${plain}.lz4"
+    done
+  done
+
+  # Several legacy blocks of 8 MB, and the benchmark
+  plain="$TEMP_DIR/plain_large"
+  python3 "${SCRIPT_DIR}/gen_plain.py" $((32 * 1024 * 1024)) 1 "$plain" ||
+    die "Cannot generate ${plain}"
+  lz4 -q -f -l "$plain" "${plain}.lz4" || die "lz4 -l failed on ${plain}"
+  out=$("$TEMP_DIR/lz4_test_app" "$plain" "${plain}.lz4" 1 2>&1)
+  [ $? -eq 0 ] || die "32 MB legacy frame: ${out}"
+  lz4 -q -f "$plain" "${plain}.lz4" || die "lz4 failed on ${plain}"
+  "$TEMP_DIR/lz4_test_app" "$plain" "${plain}.lz4" 1 10 2>/dev/null ||
+    die "32 MB frame failed"
+}
+
+main "$@"
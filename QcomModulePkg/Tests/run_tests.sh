@@ -0,0 +1,30 @@
+#!/bin/bash
+
+# Runs every test of QcomModulePkg that can run on the build machine.
+
+SCRIPT_DIR="$(dirname "$(readlink -f "$0")")"
+source ${SCRIPT_DIR}/common.sh
+
+main() {
+  local test
+
+  command_exists "${CC}" || die "No C compiler, set CC"
+
+  for test in \
+      fdt_rw_test.sh \
+      fastboot_sparse_stream_test.sh \
+      block_write_test.sh \
+      lz4_test.sh \
+      decompress_test.sh \
+      avb_parallel_test.sh \
+      sha2_test.sh \
+      crc32_test.sh \
+      cmdline_test.sh \
+      ufdt_overlay_test.sh \
+      boot_sim_test.sh; do
+    "${SCRIPT_DIR}/${test}" || die "${test} failed!!"
+  done
+  alert "All tests passed"
+}
+
+main "$@"
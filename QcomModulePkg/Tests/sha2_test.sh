@@ -0,0 +1,85 @@
+#!/bin/bash
+
+# Checks the libavb SHA-256 and SHA-512, through the Hash2Client.c
+# dispatcher and a mock Hash2 protocol, against the FIPS 180-4 examples
+# and against python hashlib on generated data hashed in updates of random
+# sizes, and prints their speed on 32 MB. The SHA2 instructions of Sha2Lib
+# are used where the build machine has them.
+#
+# Usage: sha2_test.sh [seeds]   (default 2)
+
+SCRIPT_DIR="$(dirname "$(readlink -f "$0")")"
+source ${SCRIPT_DIR}/common.sh
+
+on_exit() {
+  rm -rf "$TEMP_DIR"
+}
+
+QCOM_LIB="${WORKSPACE}/QcomModulePkg/Library"
+AVB_LIB="${QCOM_LIB}/avb/libavb"
+
+build_app() {
+  local out="$1"
+
+  host_build "${out}" -DAVB_COMPILATION "${HOST_SHA2_CFLAGS[@]}" \
+    -I"${WORKSPACE}/QcomModulePkg/Include/Library" -I"${AVB_LIB}" \
+    "${AVB_LIB}/avb_sha256.c" \
+    "${AVB_LIB}/avb_sha512.c" \
+    "${AVB_LIB}/avb_sysdeps_posix.c" \
+    "${QCOM_LIB}/avb/Hash2Client.c" \
+    "${QCOM_LIB}/Sha2Lib/Sha2Ce.c" \
+    "${SCRIPT_DIR}/src/sha2_test_app.c"
+}
+
+digests() {
+  python3 -c 'import hashlib, sys
+data = open(sys.argv[1], "rb").read()
+print(hashlib.sha256(data).hexdigest(), hashlib.sha512(data).hexdigest())' "$1"
+}
+
+run_app() {
+  local data="$1"
+  local seed="$2"
+  shift 2
+  local out
+
+  out=$("$TEMP_DIR/sha2_test_app" "$data" $(digests "$data") "$seed" "$@" \
+        2> "$TEMP_DIR/log")
+  if [ $? -ne 0 ]; then
+    cat "$TEMP_DIR/log" >&2
+    die "$(basename "$data") seed ${seed}: ${out}"
+  fi
+  [ -z "$out" ] || echo "$out"
+}
+
+main() {
+  local seeds="${1:-2}"
+  local size seed data
+
+  alert "========== Running SHA-2 Tests =========="
+
+  command_exists python3 || die "python3 is needed to generate the data"
+
+  TEMP_DIR=`mktemp -d`
+  trap on_exit EXIT
+
+  build_app "$TEMP_DIR/sha2_test_app"
+
+  for size in 0 1 55 56 64 111 112 128 1000 16383 16384 70000 1048577 \
+              3000000; do
+    for ((seed = 1; seed <= seeds; seed++)); do
+      data="$TEMP_DIR/data_${size}_${seed}"
+      python3 "${SCRIPT_DIR}/gen_plain.py" "$size" "$seed" "$data" ||
+        die "Cannot generate ${data}"
+      run_app "$data" "$seed"
+      rm -f "$data"
+    done
+  done
+
+  data="$TEMP_DIR/data_bench"
+  python3 "${SCRIPT_DIR}/gen_plain.py" 33554432 1 "$data" ||
+    die "Cannot generate ${data}"
+  run_app "$data" 1 3
+}
+
+main "$@"
@@ -0,0 +1,446 @@
+/* Copyright (c) 2021, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Test of the parallel hash verification of libavb avb_slot_verify ().
+ *
+ * Usage: avb_parallel_test_app <dir> <result> <result with allow> [delay]
+ *
+ * <dir> holds the partitions of slot a as files <name>_a, as written by
+ * gen_vbmeta.py. The slot is verified with and without
+ * AVB_SLOT_VERIFY_FLAGS_ALLOW_VERIFICATION_ERROR, serially, serially with
+ * read_from_partition_chunked (), and with
+ * AVB_SLOT_VERIFY_FLAGS_PARALLEL_HASH_VERIFICATION on several threads. All
+ * must give the expected result and the same AvbSlotVerifyData. Each read
+ * takes [delay] microseconds more, so that the parallel jobs overlap.
+ */
+
+#include "libavb.h"
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/BootStats.h>
+#include <Library/DebugLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/PrintLib.h>
+
+#include "HostLib.h"
+
+#define TEST_THREADS 4
+#define TEST_CHUNK_SIZE (64 * 1024)
+#define TEST_MAX_PARTITIONS 8
+
+#define TEST_ERROR(Format, ...)                                                \
+  HostPrint ("%a: " Format "\n", TestMode, ##__VA_ARGS__)
+
+typedef struct {
+  CHAR8 Name[64];
+  UINT8 *Data;
+  UINTN Size;
+} TEST_PARTITION;
+
+/* The arguments of run_parallel (), the context of its HostRunParallel () */
+typedef struct {
+  AvbOps *Ops;
+  void (*Job) (AvbOps *Ops, void *JobUser, size_t Index);
+  void *JobUser;
+} TEST_PARALLEL_CALL;
+
+STATIC TEST_PARTITION TestPartitions[TEST_MAX_PARTITIONS];
+STATIC CONST CHAR8 *TestMode;
+STATIC UINTN TestDelayUs;
+
+STATIC CONST CHAR8 *CONST TestRequested[] = {
+    "boot", "vendor_boot", "dtbo", "init_boot", "vendor_kernel_boot", NULL};
+
+/* Partitions read from the test directory, those of gen_vbmeta.py */
+STATIC CONST CHAR8 *CONST TestPartitionNames[] = {
+    "vbmeta", "vbmeta_system", "boot",  "vendor_boot",
+    "dtbo",   "odm",           "init_boot", "vendor_kernel_boot", NULL};
+
+/* Device functions libavb references. avb_slot_verify () only records the
+ * boot stats, the root device type and slot state are not reached.
+ */
+VOID
+BootStatsSetTimeStamp (BS_ENTRY BootStatId)
+{
+}
+
+UINT32
+CheckRootDeviceType (VOID)
+{
+  ASSERT (FALSE);
+  return 0;
+}
+
+BOOLEAN
+IsCurrentSlotBootable (VOID)
+{
+  ASSERT (FALSE);
+  return FALSE;
+}
+
+STATIC TEST_PARTITION *
+TestFindPartition (CONST CHAR8 *Name)
+{
+  UINTN Index;
+
+  for (Index = 0; Index < TEST_MAX_PARTITIONS; Index++) {
+    if (TestPartitions[Index].Data != NULL &&
+        AsciiStrCmp (TestPartitions[Index].Name, Name) == 0) {
+      return &TestPartitions[Index];
+    }
+  }
+  return NULL;
+}
+
+/* Loads the partitions of TestPartitionNames that have a file in Dir. They
+ * are loaded before verifying, the parallel jobs only read them.
+ */
+STATIC VOID
+TestLoadPartitions (CONST CHAR8 *Dir)
+{
+  CHAR8 Path[512];
+  TEST_PARTITION *Part;
+  UINTN Index;
+
+  for (Index = 0; TestPartitionNames[Index] != NULL; Index++) {
+    Part = &TestPartitions[Index];
+    AsciiSPrint (Part->Name, sizeof (Part->Name), "%a_a",
+                 TestPartitionNames[Index]);
+    AsciiSPrint (Path, sizeof (Path), "%a/%a", Dir, Part->Name);
+    Part->Data = HostLoadFile (Path, &Part->Size);
+  }
+}
+
+STATIC AvbIOResult
+TestRead (AvbOps *Ops,
+          const char *Partition,
+          int64_t Offset,
+          size_t NumBytes,
+          void *Buffer,
+          size_t *OutNumRead)
+{
+  TEST_PARTITION *Part = TestFindPartition (Partition);
+
+  if (Part == NULL) {
+    return AVB_IO_RESULT_ERROR_NO_SUCH_PARTITION;
+  }
+  if (Offset < 0) {
+    if ((UINT64)-Offset > Part->Size) {
+      return AVB_IO_RESULT_ERROR_RANGE_OUTSIDE_PARTITION;
+    }
+    Offset += Part->Size;
+  }
+  if ((UINT64)Offset > Part->Size) {
+    return AVB_IO_RESULT_ERROR_RANGE_OUTSIDE_PARTITION;
+  }
+
+  if (TestDelayUs) {
+    HostSleepUs (TestDelayUs);
+  }
+  *OutNumRead = MIN (NumBytes, Part->Size - Offset);
+  CopyMem (Buffer, Part->Data + Offset, *OutNumRead);
+  return AVB_IO_RESULT_OK;
+}
+
+STATIC AvbIOResult
+TestReadChunked (AvbOps *Ops,
+                 const char *Partition,
+                 size_t NumBytes,
+                 void *Buffer,
+                 size_t *OutNumRead,
+                 void (*ChunkCb) (void *ChunkUser,
+                                  const uint8_t *Data,
+                                  size_t Len),
+                 void *ChunkUser)
+{
+  AvbIOResult Result;
+  UINT8 *Out = Buffer;
+  size_t Read;
+  UINTN Pos;
+
+  *OutNumRead = 0;
+  for (Pos = 0; Pos < NumBytes; Pos += Read) {
+    Result = TestRead (Ops, Partition, Pos, MIN (TEST_CHUNK_SIZE, NumBytes - Pos),
+                       Out + Pos, &Read);
+    if (Result != AVB_IO_RESULT_OK) {
+      return Result;
+    }
+    if (Read == 0) {
+      break;
+    }
+    ChunkCb (ChunkUser, Out + Pos, Read);
+    *OutNumRead += Read;
+  }
+  return AVB_IO_RESULT_OK;
+}
+
+STATIC AvbIOResult
+TestGetSize (AvbOps *Ops, const char *Partition, uint64_t *OutSize)
+{
+  TEST_PARTITION *Part = TestFindPartition (Partition);
+
+  if (Part == NULL) {
+    return AVB_IO_RESULT_ERROR_NO_SUCH_PARTITION;
+  }
+  *OutSize = Part->Size;
+  return AVB_IO_RESULT_OK;
+}
+
+STATIC AvbIOResult
+TestValidateKey (AvbOps *Ops,
+                 const uint8_t *PublicKey,
+                 size_t PublicKeyLength,
+                 const uint8_t *Metadata,
+                 size_t MetadataLength,
+                 bool *OutIsTrusted)
+{
+  *OutIsTrusted = true;
+  return AVB_IO_RESULT_OK;
+}
+
+STATIC AvbIOResult
+TestReadRollbackIndex (AvbOps *Ops, size_t Location, uint64_t *OutIndex)
+{
+  *OutIndex = 0;
+  return AVB_IO_RESULT_OK;
+}
+
+STATIC AvbIOResult
+TestReadUnlocked (AvbOps *Ops, bool *OutIsUnlocked)
+{
+  *OutIsUnlocked = false;
+  return AVB_IO_RESULT_OK;
+}
+
+STATIC AvbIOResult
+TestGetGuid (AvbOps *Ops, const char *Partition, char *Guid, size_t GuidSize)
+{
+  AsciiSPrint (Guid, GuidSize, "00000000-0000-0000-0000-%012x",
+               (UINT32)AsciiStrLen (Partition));
+  return AVB_IO_RESULT_OK;
+}
+
+STATIC VOID
+TestRunJob (VOID *Context, UINTN Index)
+{
+  TEST_PARALLEL_CALL *Call = Context;
+
+  Call->Job (Call->Ops, Call->JobUser, Index);
+}
+
+STATIC VOID
+TestRunParallel (AvbOps *Ops,
+                 size_t NumJobs,
+                 void (*Job) (AvbOps *Ops, void *JobUser, size_t Index),
+                 void *JobUser)
+{
+  TEST_PARALLEL_CALL Call = {Ops, Job, JobUser};
+
+  HostRunParallel (TEST_THREADS, NumJobs, TestRunJob, &Call);
+}
+
+STATIC VOID
+TestParallelLock (AvbOps *Ops, bool Acquire)
+{
+  HostParallelLock (Acquire);
+}
+
+STATIC BOOLEAN
+TestSameBytes (CONST VOID *A, UINTN ASize, CONST VOID *B, UINTN BSize)
+{
+  return ASize == BSize && (ASize == 0 || CompareMem (A, B, ASize) == 0);
+}
+
+STATIC BOOLEAN
+TestSameString (CONST CHAR8 *A, CONST CHAR8 *B)
+{
+  if (A == NULL || B == NULL) {
+    return A == B;
+  }
+  return AsciiStrCmp (A, B) == 0;
+}
+
+/* Checks that Data, from TestMode, matches Expected, from the serial run */
+STATIC BOOLEAN
+TestSameData (CONST AvbSlotVerifyData *Expected, CONST AvbSlotVerifyData *Data)
+{
+  UINTN Index;
+
+  if (Expected == NULL || Data == NULL) {
+    if (Expected != Data) {
+      TEST_ERROR ("slot data %a", Data ? "not expected" : "missing");
+      return FALSE;
+    }
+    return TRUE;
+  }
+
+  if (!TestSameString (Expected->ab_suffix, Data->ab_suffix) ||
+      !TestSameString (Expected->cmdline, Data->cmdline)) {
+    TEST_ERROR ("suffix or command line differ: '%a'", Data->cmdline);
+    return FALSE;
+  }
+  if (CompareMem (Expected->rollback_indexes, Data->rollback_indexes,
+                  sizeof (Data->rollback_indexes))) {
+    TEST_ERROR ("rollback indexes differ");
+    return FALSE;
+  }
+
+  if (Expected->num_vbmeta_images != Data->num_vbmeta_images) {
+    TEST_ERROR ("%u vbmeta images, expected %u",
+                (UINT32)Data->num_vbmeta_images,
+                (UINT32)Expected->num_vbmeta_images);
+    return FALSE;
+  }
+  for (Index = 0; Index < Data->num_vbmeta_images; Index++) {
+    if (!TestSameString (Expected->vbmeta_images[Index].partition_name,
+                         Data->vbmeta_images[Index].partition_name) ||
+        !TestSameBytes (Expected->vbmeta_images[Index].vbmeta_data,
+                        Expected->vbmeta_images[Index].vbmeta_size,
+                        Data->vbmeta_images[Index].vbmeta_data,
+                        Data->vbmeta_images[Index].vbmeta_size) ||
+        Expected->vbmeta_images[Index].verify_result !=
+            Data->vbmeta_images[Index].verify_result) {
+      TEST_ERROR ("vbmeta image %a differs",
+                  Data->vbmeta_images[Index].partition_name);
+      return FALSE;
+    }
+  }
+
+  if (Expected->num_loaded_partitions != Data->num_loaded_partitions) {
+    TEST_ERROR ("%u loaded partitions, expected %u",
+                (UINT32)Data->num_loaded_partitions,
+                (UINT32)Expected->num_loaded_partitions);
+    return FALSE;
+  }
+  for (Index = 0; Index < Data->num_loaded_partitions; Index++) {
+    if (!TestSameString (Expected->loaded_partitions[Index].partition_name,
+                         Data->loaded_partitions[Index].partition_name) ||
+        !TestSameBytes (Expected->loaded_partitions[Index].data,
+                        Expected->loaded_partitions[Index].data_size,
+                        Data->loaded_partitions[Index].data,
+                        Data->loaded_partitions[Index].data_size)) {
+      TEST_ERROR ("loaded partition %a differs",
+                  Data->loaded_partitions[Index].partition_name);
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+/* Verifies the slot with Flags in the three modes, returns FALSE if a
+ * result is not Expected or the data differs.
+ */
+STATIC BOOLEAN
+TestVerify (AvbSlotVerifyFlags Flags, CONST CHAR8 *Expected)
+{
+  AvbOps Ops;
+  AvbSlotVerifyData *Serial = NULL;
+  AvbSlotVerifyData *Data;
+  AvbSlotVerifyResult SerialResult;
+  AvbSlotVerifyResult Result;
+  CONST CHAR8 *ResultName;
+  UINTN Mode;
+  BOOLEAN Ok = TRUE;
+
+  ZeroMem (&Ops, sizeof (Ops));
+  Ops.read_from_partition = TestRead;
+  Ops.get_size_of_partition = TestGetSize;
+  Ops.validate_vbmeta_public_key = TestValidateKey;
+  Ops.read_rollback_index = TestReadRollbackIndex;
+  Ops.read_is_device_unlocked = TestReadUnlocked;
+  Ops.get_unique_guid_for_partition = TestGetGuid;
+
+  TestMode = "serial";
+  SerialResult = avb_slot_verify (&Ops, TestRequested, "_a", Flags,
+                                  AVB_HASHTREE_ERROR_MODE_RESTART_AND_INVALIDATE,
+                                  &Serial);
+  ResultName = avb_slot_verify_result_to_string (SerialResult);
+  if (AsciiStrCmp (ResultName, Expected)) {
+    TEST_ERROR ("result %a, expected %a", ResultName, Expected);
+    Ok = FALSE;
+  }
+
+  for (Mode = 0; Mode < 2 && Ok; Mode++) {
+    if (Mode == 0) {
+      TestMode = "chunked";
+      Ops.read_from_partition_chunked = TestReadChunked;
+    } else {
+      TestMode = "parallel";
+      Ops.read_from_partition_chunked = NULL;
+      Ops.run_parallel = TestRunParallel;
+      Ops.parallel_lock = TestParallelLock;
+      Flags |= AVB_SLOT_VERIFY_FLAGS_PARALLEL_HASH_VERIFICATION;
+    }
+
+    Data = NULL;
+    Result = avb_slot_verify (&Ops, TestRequested, "_a", Flags,
+                              AVB_HASHTREE_ERROR_MODE_RESTART_AND_INVALIDATE,
+                              &Data);
+    if (Result != SerialResult) {
+      TEST_ERROR ("result %a, serial %a",
+                  avb_slot_verify_result_to_string (Result), ResultName);
+      Ok = FALSE;
+    } else {
+      Ok = TestSameData (Serial, Data);
+    }
+    if (Data != NULL) {
+      avb_slot_verify_data_free (Data);
+    }
+  }
+
+  if (Serial != NULL) {
+    avb_slot_verify_data_free (Serial);
+  }
+  return Ok;
+}
+
+int
+main (int Argc, char **Argv)
+{
+  UINTN Index;
+  BOOLEAN Ok;
+
+  if (Argc < 4) {
+    HostPrint ("Usage: %a <dir> <result> <result with allow> [delay]\n",
+               Argv[0]);
+    return 2;
+  }
+  TestLoadPartitions (Argv[1]);
+  TestDelayUs = Argc > 4 ? HostStrToUintn (Argv[4]) : 0;
+
+  Ok = TestVerify (AVB_SLOT_VERIFY_FLAGS_NONE, Argv[2]) &&
+       TestVerify (AVB_SLOT_VERIFY_FLAGS_ALLOW_VERIFICATION_ERROR, Argv[3]);
+
+  for (Index = 0; Index < TEST_MAX_PARTITIONS; Index++) {
+    if (TestPartitions[Index].Data != NULL) {
+      FreePool (TestPartitions[Index].Data);
+    }
+  }
+  return Ok ? 0 : 1;
+}
@@ -0,0 +1,268 @@
+/* Copyright (c) 2021, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Writes images through WriteBlockToPartition () to disks with the mock
+ * BlockIo2 of HostUefi.c, which completes requests in order or newest
+ * first, refuses them or fails them.
+ *
+ * Usage: block_write_test_app <seed>
+ *
+ * LinuxLoaderLib.c is built into the test. Each case writes an image of a
+ * random size, which does not end on a block, at a random offset of a disk
+ * filled with a marker. Unless the case expects the write to fail, the
+ * image must read back with the marker around it. In every case each
+ * BlockIo2 request must have completed before the call returned, with its
+ * token event still open until then.
+ */
+
+#include "LinuxLoaderLib.c"
+
+#include "HostLib.h"
+#include "HostUefi.h"
+
+#define TEST_BLOCK_SIZE 512
+#define TEST_MARKER 0x5A
+
+typedef struct {
+  CONST CHAR8 *Name;
+  BOOLEAN BlockIo2;
+  HOST_IO2_ORDER Order;
+  BOOLEAN Split;
+  UINT64 RefuseAt;
+  UINT64 FailAt;
+  /* Raise the TPL to TPL_CALLBACK around the write */
+  BOOLEAN Callback;
+  /* Number of the gBS->WaitForEvent () call, from 1, from which it fails */
+  UINTN WaitFailsAt;
+} TEST_CASE;
+
+STATIC CONST TEST_CASE TestCases[] = {
+  {"no BlockIo2", FALSE, HOST_IO2_IN_ORDER, TRUE},
+  {"in order", TRUE, HOST_IO2_IN_ORDER, TRUE},
+  {"newest first", TRUE, HOST_IO2_REVERSE, TRUE},
+  {"no split", TRUE, HOST_IO2_REVERSE, FALSE},
+  {"first refused", TRUE, HOST_IO2_IN_ORDER, TRUE, 1},
+  {"third refused", TRUE, HOST_IO2_REVERSE, TRUE, 3},
+  {"second fails", TRUE, HOST_IO2_IN_ORDER, TRUE, 0, 2},
+  {"second fails newest first", TRUE, HOST_IO2_REVERSE, TRUE, 0, 2},
+  {"last fails newest first", TRUE, HOST_IO2_REVERSE, TRUE, 0, 4},
+  {"raised TPL", TRUE, HOST_IO2_IN_ORDER, TRUE, 0, 0, TRUE},
+  {"wait fails", TRUE, HOST_IO2_IN_ORDER, TRUE, 0, 0, FALSE, 1},
+  {"second wait fails", TRUE, HOST_IO2_REVERSE, TRUE, 0, 0, FALSE, 2},
+  {"wait fails after a failed write", TRUE, HOST_IO2_REVERSE, TRUE, 0, 3,
+   FALSE, 2},
+};
+
+STATIC BOOLEAN TestSplit;
+STATIC UINTN TestWaits;
+STATIC UINTN TestWaitFailsAt;
+STATIC EFI_WAIT_FOR_EVENT TestHostWaitForEvent;
+
+/* Only the BlockIo writes of LinuxLoaderLib.c are tested */
+UINT32
+CheckRootDeviceType (VOID)
+{
+  return EMMC;
+}
+
+BOOLEAN
+IsFlashSplitNeeded (VOID)
+{
+  return TestSplit;
+}
+
+BOOLEAN
+IsUseMThreadParallel (VOID)
+{
+  return FALSE;
+}
+
+UINT64
+BootTraceNowUs (VOID)
+{
+  return 0;
+}
+
+VOID
+BootTraceRecord (IN BOOT_TRACE_ID Id, IN UINT64 StartUs, IN UINT64 Bytes)
+{
+}
+
+/* WaitForEvent as it behaves when it is called at a raised TPL */
+STATIC EFI_STATUS
+EFIAPI
+TestWaitForEvent (IN UINTN NumberOfEvents,
+                  IN EFI_EVENT *Event,
+                  OUT UINTN *Index)
+{
+  if (TestWaitFailsAt &&
+      ++TestWaits >= TestWaitFailsAt) {
+    return EFI_UNSUPPORTED;
+  }
+  return TestHostWaitForEvent (NumberOfEvents, Event, Index);
+}
+
+STATIC BOOLEAN
+TestCheckDisk (IN CONST TEST_CASE *Case,
+               IN HOST_DISK *Disk,
+               IN UINT64 Lba,
+               IN CONST UINT8 *Image,
+               IN UINTN Size)
+{
+  UINT64 Start = Lba * TEST_BLOCK_SIZE;
+  UINT64 Index;
+
+  if (CompareMem (Disk->Data + Start, Image, Size)) {
+    HostPrint ("%a: the image does not read back\n", Case->Name);
+    return FALSE;
+  }
+  for (Index = 0; Index < Disk->Size; Index++) {
+    if ((Index < Start || Index >= Start + Size) &&
+        Disk->Data[Index] != TEST_MARKER) {
+      HostPrint ("%a: byte %lu outside the image changed\n", Case->Name,
+                 Index);
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+STATIC BOOLEAN
+TestRun (IN CONST TEST_CASE *Case, IN UINT32 *Seed)
+{
+  UINTN Size = SIZE_4MB + HostRandom (Seed) % (5 * SIZE_1MB);
+  UINT64 Lba = HostRandom (Seed) % 64;
+  UINT64 Units = ALIGN_VALUE (Size - Size % TEST_BLOCK_SIZE, MAX_WRITE_SIZE) /
+                 MAX_WRITE_SIZE;
+  UINT8 *Image;
+  HOST_DISK *Disk;
+  EFI_TPL OldTpl = TPL_APPLICATION;
+  EFI_STATUS Status;
+  EFI_STATUS Expect = Case->FailAt ? EFI_DEVICE_ERROR : EFI_SUCCESS;
+  UINTN Index;
+  BOOLEAN Ok = TRUE;
+
+  if (Size % TEST_BLOCK_SIZE == 0) {
+    Size++;
+  }
+  Image = AllocatePool (Size);
+  Disk = HostDiskCreate (TEST_BLOCK_SIZE,
+                         Lba + Size / TEST_BLOCK_SIZE + 1 + 64, TEST_MARKER,
+                         HOST_ERASE_NONE);
+  if (!Image ||
+      !Disk) {
+    HostPrint ("%a: out of memory\n", Case->Name);
+    return FALSE;
+  }
+  for (Index = 0; Index < Size; Index++) {
+    Image[Index] = HostRandom (Seed);
+  }
+
+  if (Case->BlockIo2) {
+    HostDiskAddBlockIo2 (Disk, Case->Order);
+  }
+  Disk->Io2RefuseAt = Case->RefuseAt;
+  Disk->Io2FailAt = Case->FailAt;
+  TestSplit = Case->Split;
+  TestWaits = 0;
+  TestWaitFailsAt = Case->WaitFailsAt;
+
+  if (Case->Callback) {
+    OldTpl = gBS->RaiseTPL (TPL_CALLBACK);
+  }
+  Status = WriteBlockToPartition (&Disk->BlockIo, Disk->Handle, Lba, Size,
+                                  Image);
+  if (Case->Callback) {
+    gBS->RestoreTPL (OldTpl);
+  }
+
+  if (Status != Expect) {
+    HostPrint ("%a: %r instead of %r\n", Case->Name, Status, Expect);
+    Ok = FALSE;
+  }
+  if (Disk->Io2InFlight ||
+      Disk->Io2EarlyCloses) {
+    HostPrint ("%a: returned with %u requests in flight, %u events closed "
+               "before their request completed\n", Case->Name,
+               Disk->Io2InFlight, Disk->Io2EarlyCloses);
+    Ok = FALSE;
+  }
+  if (Disk->Io2MaxInFlight > MAX_ASYNC_WRITES) {
+    HostPrint ("%a: %u writes in flight\n", Case->Name,
+               Disk->Io2MaxInFlight);
+    Ok = FALSE;
+  }
+
+  /* What BlockIo2 must have been asked to write */
+  if (!Case->BlockIo2 ||
+      Case->Callback) {
+    Ok = Ok && Disk->Io2Requests == 0;
+  } else if (!Case->Split) {
+    Ok = Ok && Disk->Io2Requests == 1;
+  } else if (Case->WaitFailsAt == 1) {
+    Ok = Ok && Disk->Io2Requests == MIN (Units, MAX_ASYNC_WRITES);
+  } else if (!Case->RefuseAt &&
+             !Case->FailAt &&
+             !Case->WaitFailsAt) {
+    Ok = Ok && Disk->Io2Requests == Units && Disk->Io2MaxInFlight > 1;
+  }
+  if (!Ok) {
+    HostPrint ("%a: %lu BlockIo2 requests for %lu units, at most %u in "
+               "flight\n", Case->Name, Disk->Io2Requests, Units,
+               Disk->Io2MaxInFlight);
+  }
+
+  if (Ok &&
+      Status == EFI_SUCCESS) {
+    Ok = TestCheckDisk (Case, Disk, Lba, Image, Size);
+  }
+  FreePool (Image);
+  return Ok;
+}
+
+int
+main (int Argc, char **Argv)
+{
+  UINT32 Seed;
+  UINTN Index;
+  BOOLEAN Ok = TRUE;
+
+  if (Argc != 2) {
+    HostPrint ("Usage: %a <seed>\n", Argv[0]);
+    return 2;
+  }
+  Seed = HostStrToUintn (Argv[1]);
+
+  TestHostWaitForEvent = gBS->WaitForEvent;
+  gBS->WaitForEvent = TestWaitForEvent;
+  for (Index = 0; Index < ARRAY_SIZE (TestCases); Index++) {
+    Ok = TestRun (&TestCases[Index], &Seed) && Ok;
+  }
+  return Ok ? 0 : 1;
+}
@@ -0,0 +1,54 @@
+/* Copyright (c) 2021, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Link stubs for the block write test: the functions LinuxLoaderLib.c
+ * references outside of WriteBlockToPartition (). They abort if they are
+ * called after all. This file includes none of their headers so that it
+ * does not need their types.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define HOST_UNUSED(Name)                                                      \
+  void Name (void);                                                            \
+  void Name (void)                                                             \
+  {                                                                            \
+    fprintf (stderr, "%s is not expected to be called\n", #Name);              \
+    abort ();                                                                  \
+  }
+
+HOST_UNUSED (EfiClose)
+HOST_UNUSED (EfiOpen)
+HOST_UNUSED (EfiReadAllocatePool)
+HOST_UNUSED (GetAVBVersion)
+HOST_UNUSED (GetPartitionHandles)
+HOST_UNUSED (GetPartitionSize)
+HOST_UNUSED (GetRootDeviceType)
+HOST_UNUSED (VerifiedBootEnbled)
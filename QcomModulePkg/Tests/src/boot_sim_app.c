@@ -0,0 +1,1063 @@
+/* Copyright (c) 2021, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Boot simulator: the boot path of LinuxLoader, from DeviceInfoInit () to
+ * the jump to the kernel, with BootLib, libavb, LibUfdt and zlib running
+ * over mock protocols.
+ *
+ * Usage: boot_sim_app <dir> <locked|unlocked>
+ *
+ * <dir> holds the boot, vendor_boot, dtbo and vbmeta images, as written by
+ * gen_boot_images.py, which become the partitions of an eMMC disk, and
+ * optionally avb_pubkey.bin, the user key of the device info. The board
+ * is an MTP of the chip of BOOT_SIM_CHIP_ID and BOOT_SIM_CHIP_VERSION with
+ * subtype BOOT_SIM_SUBTYPE, see TEST_DEFAULT_*.
+ *
+ * With BOOT_SIM_BLOCKIO2 set to in-order or newest-first, the partitions
+ * also have a BlockIo2 completing requests in that order, which fails the
+ * request number BOOT_SIM_BLOCKIO2_FAIL_AT of each partition. From the
+ * call number BOOT_SIM_WAIT_FAILS_AT on, gBS->WaitForEvent () fails as it
+ * does at a raised TPL. No BlockIo2 request may be left in flight when the
+ * boot ends, whether it reached the kernel or not.
+ *
+ * The mocks stand in for TrustZone (SCM and the keymaster application),
+ * the verified boot, chip, platform, RAM partition and card protocols and
+ * the Hash2 engine. The kernel jump is caught in PreparePlatformHardware ()
+ * and the loaded kernel, ramdisk and device tree are then checked against
+ * expect_kernel, expect_ramdisk and expect of <dir>, when present. Each
+ * line of expect is "<node> <property> <text>": the property must hold
+ * <text>.
+ *
+ * The time, partition bytes read, bytes copied through gBS->CopyMem and
+ * allocations of each phase are printed, followed by the boot trace
+ * events, in the format boot_trace.py reads. Exits with 0 when the kernel
+ * was reached and the checks pass.
+ */
+
+#include <setjmp.h>
+
+#include "libavb.h"
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/Board.h>
+#include <Library/BootLinux.h>
+#include <Library/BootTrace.h>
+#include <Library/DeviceInfo.h>
+#include <Library/HypervisorMvCalls.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/PartitionTableUpdate.h>
+#include <Library/PrintLib.h>
+#include <Library/Recovery.h>
+#include <Library/ShutdownServices.h>
+#include <Library/Sha2Lib.h>
+#include <Library/UefiBootServicesTableLib.h>
+#include <Library/VerifiedBoot.h>
+#include <Protocol/DevicePath.h>
+#include <Protocol/EFICardInfo.h>
+#include <Protocol/EFIChipInfo.h>
+#include <Protocol/EFIPlatformInfo.h>
+#include <Protocol/EFIQseecom.h>
+#include <Protocol/EFIRamPartition.h>
+#include <Protocol/EFIScm.h>
+#include <Protocol/EFIVerifiedBoot.h>
+#include <Protocol/Hash2.h>
+#include <Protocol/scm_sip_interface.h>
+#include <libfdt_env.h>
+#include <fdt.h>
+#include <libfdt.h>
+
+#include "HostLib.h"
+#include "HostUefi.h"
+
+#define TEST_BLOCK_SIZE 4096
+#define TEST_MAX_PATH 512
+/* The RAM the images are loaded to. BootLib takes the kernel, ramdisk and
+ * device tree addresses as offsets into it, so it is aligned well beyond
+ * the offsets of the load address PCDs.
+ */
+#define TEST_RAM_SIZE SIZE_128MB
+#define TEST_DEFAULT_CHIP_ID 0x1A0
+#define TEST_DEFAULT_CHIP_VERSION 0x20000
+#define TEST_DEFAULT_SUBTYPE 2
+/* QSEE 5.2, which has the rollback update call */
+#define TEST_QSEE_VERSION ((5 << 22) | (2 << 12))
+#define TEST_SERIAL_NUMBER 0x5eed
+
+/* Keymaster commands, see KeyMasterCmd in KeymasterClient.c */
+#define TEST_KM_GET_VERSION 0x200
+#define TEST_KM_SET_BOOT_STATE 0x208
+
+#define TEST_ERROR(Format, ...) HostPrint ("ERROR: " Format "\n", ##__VA_ARGS__)
+
+typedef struct {
+  VENDOR_DEVICE_PATH Root;
+  HARDDRIVE_DEVICE_PATH Partition;
+  EFI_DEVICE_PATH_PROTOCOL End;
+} __attribute__ ((packed)) TEST_DEVICE_PATH;
+
+typedef struct {
+  CONST CHAR8 *Name;
+  HOST_DISK *Disk;
+  TEST_DEVICE_PATH DevicePath;
+  EFI_PARTITION_ENTRY Entry;
+} TEST_PARTITION;
+
+/* KMSetBootStateReq of KeymasterClient.c */
+typedef struct {
+  UINT32 CmdId;
+  UINT32 Version;
+  UINT32 Offset;
+  UINT32 Size;
+  UINT32 IsUnlocked;
+  CHAR8 PublicKey[AVB_SHA256_DIGEST_SIZE];
+  UINT32 Color;
+  UINT32 SystemVersion;
+  UINT32 SystemSecurityLevel;
+} __attribute__ ((packed)) TEST_KM_SET_BOOT_STATE_REQ;
+
+/* KMGetVersionRsp of KeymasterClient.c */
+typedef struct {
+  INT32 Status;
+  UINT32 Major;
+  UINT32 Minor;
+  UINT32 AppMajor;
+  UINT32 AppMinor;
+} __attribute__ ((packed)) TEST_KM_GET_VERSION_RSP;
+
+typedef struct {
+  CONST CHAR8 *Name;
+  UINT64 StartNs;
+  UINT64 BytesRead;
+  UINT64 BytesCopied;
+  HOST_ALLOC_STATS Allocs;
+} TEST_PHASE;
+
+STATIC TEST_PARTITION TestPartitions[] = {
+  {"boot"}, {"vendor_boot"}, {"dtbo"}, {"vbmeta"},
+};
+
+STATIC CONST CHAR8 *CONST TestBootStates[] = {"GREEN", "ORANGE", "YELLOW",
+                                              "RED"};
+
+STATIC CONST CHAR8 *TestDir;
+STATIC UINT8 *TestRam;
+STATIC DeviceInfo TestDevInfo;
+STATIC UINT32 TestChipId;
+STATIC UINT32 TestChipVersion;
+STATIC UINT32 TestSubtype;
+STATIC UINT32 TestBootState = BOOT_STATE_MAX;
+STATIC UINT64 TestBootStart;
+STATIC BOOLEAN TestServicesDown;
+STATIC jmp_buf TestKernelJump;
+STATIC TEST_PHASE TestPhase;
+
+/* What BootLinux () passed to UpdateDeviceTree () */
+STATIC VOID *TestFdt;
+STATIC UINT8 *TestRamdisk;
+STATIC UINT32 TestRamdiskSize;
+
+STATIC UINT32 TestHashActive;
+STATIC AvbSHA256Ctx TestHashCtx;
+
+STATIC UINTN TestWaits;
+STATIC UINTN TestWaitFailsAt;
+STATIC EFI_WAIT_FOR_EVENT TestHostWaitForEvent;
+
+EFI_STATUS
+__real_UpdateDeviceTree (VOID *Fdt,
+                         CONST CHAR8 *CmdLine,
+                         VOID *Ramdisk,
+                         UINT32 RamdiskSize,
+                         BOOLEAN BootWith32Bit);
+
+EFI_STATUS
+__wrap_UpdateDeviceTree (VOID *Fdt,
+                         CONST CHAR8 *CmdLine,
+                         VOID *Ramdisk,
+                         UINT32 RamdiskSize,
+                         BOOLEAN BootWith32Bit)
+{
+  TestFdt = Fdt;
+  TestRamdisk = Ramdisk;
+  TestRamdiskSize = RamdiskSize;
+  return __real_UpdateDeviceTree (Fdt, CmdLine, Ramdisk, RamdiskSize,
+                                  BootWith32Bit);
+}
+
+/* Boot services end here, the kernel would not see any use of them */
+EFI_STATUS
+ShutdownUefiBootServices (VOID)
+{
+  TestServicesDown = TRUE;
+  return EFI_SUCCESS;
+}
+
+/* The last call before the jump to the kernel, which the test takes */
+EFI_STATUS
+PreparePlatformHardware (VOID)
+{
+  longjmp (TestKernelJump, 1);
+}
+
+UINTN
+EFIAPI
+AsciiPrint (IN CONST CHAR8 *Format, ...)
+{
+  CHAR8 Buffer[512];
+  VA_LIST Marker;
+
+  VA_START (Marker, Format);
+  AsciiVSPrint (Buffer, sizeof (Buffer), Format, Marker);
+  VA_END (Marker);
+  DEBUG ((EFI_D_ERROR, "%a", Buffer));
+  return AsciiStrLen (Buffer);
+}
+
+/* RAM partition protocol: a single partition, TestRam */
+STATIC EFI_STATUS
+EFIAPI
+MockGetRamPartitions (IN EFI_RAMPARTITION_PROTOCOL *This,
+                      OUT RamPartitionEntry *RamPartitions,
+                      IN OUT UINT32 *NumPartition)
+{
+  if (RamPartitions == NULL || *NumPartition < 1) {
+    *NumPartition = 1;
+    return EFI_BUFFER_TOO_SMALL;
+  }
+  RamPartitions[0].Base = (UINTN)TestRam;
+  RamPartitions[0].AvailableLength = TEST_RAM_SIZE;
+  *NumPartition = 1;
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+MockGetMinPasrSize (IN EFI_RAMPARTITION_PROTOCOL *This,
+                    OUT UINT32 *MinPasrSize)
+{
+  *MinPasrSize = SIZE_2MB;
+  return EFI_SUCCESS;
+}
+
+/* Chip info protocol, the chip of the environment */
+STATIC EFI_STATUS
+EFIAPI
+MockGetChipId (IN EFI_CHIPINFO_PROTOCOL *This, OUT EFIChipInfoIdType *Id)
+{
+  *Id = TestChipId;
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+MockGetChipVersion (IN EFI_CHIPINFO_PROTOCOL *This,
+                    OUT EFIChipInfoVersionType *Version)
+{
+  *Version = TestChipVersion;
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+MockGetFoundryId (IN EFI_CHIPINFO_PROTOCOL *This,
+                  OUT EFIChipInfoFoundryIdType *Id)
+{
+  *Id = 0;
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+MockGetModemSupport (IN EFI_CHIPINFO_PROTOCOL *This,
+                     OUT EFIChipInfoModemType *Modem)
+{
+  *Modem = 0;
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+MockGetChipIdString (IN EFI_CHIPINFO_PROTOCOL *This,
+                     OUT CHAR8 *IdString,
+                     IN UINT32 Size)
+{
+  AsciiSPrint (IdString, Size, "SIM%x", TestChipId);
+  return EFI_SUCCESS;
+}
+
+/* No defective parts or CPUs */
+STATIC EFI_STATUS
+EFIAPI
+MockGetDefectivePart (IN EFI_CHIPINFO_PROTOCOL *This,
+                      IN EFIChipInfoPartType Part,
+                      OUT UINT32 *Mask)
+{
+  *Mask = 0;
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+MockGetDefectiveCpus (IN EFI_CHIPINFO_PROTOCOL *This,
+                      IN UINT32 Cluster,
+                      OUT UINT32 *Mask)
+{
+  *Mask = 0;
+  return EFI_SUCCESS;
+}
+
+/* Platform info protocol: an MTP of subtype TestSubtype */
+STATIC EFI_STATUS
+EFIAPI
+MockGetPlatformInfo (IN EFI_PLATFORMINFO_PROTOCOL *This,
+                     OUT EFI_PLATFORMINFO_PLATFORM_INFO_TYPE *Info)
+{
+  ZeroMem (Info, sizeof (*Info));
+  Info->platform = EFI_PLATFORMINFO_TYPE_MTP;
+  Info->version = 0x10000;
+  Info->subtype = TestSubtype;
+  return EFI_SUCCESS;
+}
+
+/* Card info protocol: an eMMC card */
+STATIC EFI_STATUS
+EFIAPI
+MockGetCardInfo (IN EFI_MEM_CARDINFO_PROTOCOL *This,
+                 OUT MEM_CARD_INFO *CardInfo)
+{
+  UINT32 Serial = TEST_SERIAL_NUMBER;
+
+  ZeroMem (CardInfo, sizeof (*CardInfo));
+  CopyMem (CardInfo->product_serial_num, &Serial, sizeof (Serial));
+  CardInfo->serial_num_len = sizeof (Serial);
+  CopyMem (CardInfo->card_type, "EMMC", sizeof (CardInfo->card_type));
+  return EFI_SUCCESS;
+}
+
+/* Verified boot protocol, over TestDevInfo */
+STATIC EFI_STATUS
+EFIAPI
+MockVBRwDeviceState (IN QCOM_VERIFIEDBOOT_PROTOCOL *This,
+                     IN vb_device_state_op_t Op,
+                     IN OUT UINT8 *Buf,
+                     IN UINT32 Len)
+{
+  if (Len > sizeof (TestDevInfo)) {
+    return EFI_INVALID_PARAMETER;
+  }
+  if (Op == READ_CONFIG) {
+    CopyMem (Buf, &TestDevInfo, Len);
+  } else if (Op == WRITE_CONFIG) {
+    CopyMem (&TestDevInfo, Buf, Len);
+  } else {
+    return EFI_INVALID_PARAMETER;
+  }
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+MockVBDeviceInit (IN QCOM_VERIFIEDBOOT_PROTOCOL *This,
+                  IN device_info_vb_t *DevInfo)
+{
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+MockVBSendCall (IN QCOM_VERIFIEDBOOT_PROTOCOL *This)
+{
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+MockVBIsDeviceSecure (IN QCOM_VERIFIEDBOOT_PROTOCOL *This,
+                      OUT BOOLEAN *State)
+{
+  *State = FALSE;
+  return EFI_SUCCESS;
+}
+
+/* QSEECom protocol with the keymaster application, which keeps the boot
+ * state it is given
+ */
+STATIC EFI_STATUS
+EFIAPI
+MockQseecomStartApp (IN QCOM_QSEECOM_PROTOCOL *This,
+                     IN CHAR8 *AppName,
+                     OUT UINT32 *Handle)
+{
+  if (AsciiStrCmp (AppName, "keymaster")) {
+    return EFI_NOT_FOUND;
+  }
+  *Handle = 1;
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+MockQseecomSendCmd (IN QCOM_QSEECOM_PROTOCOL *This,
+                    IN UINT32 Handle,
+                    IN UINT8 *SendBuf,
+                    IN UINT32 SendLen,
+                    OUT UINT8 *RspBuf,
+                    IN UINT32 RspLen)
+{
+  TEST_KM_GET_VERSION_RSP Version = {0, 2, 0, 2, 0};
+  UINT32 CmdId;
+
+  if (Handle != 1 || SendLen < sizeof (CmdId) || RspLen < sizeof (INT32)) {
+    return EFI_INVALID_PARAMETER;
+  }
+  CopyMem (&CmdId, SendBuf, sizeof (CmdId));
+  ZeroMem (RspBuf, RspLen);
+  switch (CmdId) {
+  case TEST_KM_GET_VERSION:
+    CopyMem (RspBuf, &Version, MIN (RspLen, sizeof (Version)));
+    break;
+  case TEST_KM_SET_BOOT_STATE:
+    if (SendLen < sizeof (TEST_KM_SET_BOOT_STATE_REQ)) {
+      return EFI_INVALID_PARAMETER;
+    }
+    TestBootState = ((TEST_KM_SET_BOOT_STATE_REQ *)SendBuf)->Color;
+    break;
+  }
+  return EFI_SUCCESS;
+}
+
+/* SCM protocol: a QSEE that is not secure and takes rollback updates. The
+ * hypervisor and other calls are not supported.
+ */
+STATIC EFI_STATUS
+EFIAPI
+MockScmSipSysCall (IN QCOM_SCM_PROTOCOL *This,
+                   IN UINT32 SmcId,
+                   IN UINT32 ParamId,
+                   IN UINT64 Parameters[SCM_MAX_NUM_PARAMETERS],
+                   OUT UINT64 Results[SCM_MAX_NUM_RESULTS])
+{
+  tz_feature_version_rsp_t *VersionRsp = (tz_feature_version_rsp_t *)Results;
+  tz_get_secure_state_rsp_t *StateRsp = (tz_get_secure_state_rsp_t *)Results;
+  tz_syscall_rsp_t *Rsp = (tz_syscall_rsp_t *)Results;
+
+  switch (SmcId) {
+  case TZ_INFO_GET_FEATURE_VERSION_ID:
+    VersionRsp->common_rsp.status = 1;
+    VersionRsp->version = TEST_QSEE_VERSION;
+    return EFI_SUCCESS;
+  case TZ_INFO_GET_SECURE_STATE:
+    StateRsp->common_rsp.status = 1;
+    StateRsp->status_0 = 0;
+    StateRsp->status_1 = 0;
+    return EFI_SUCCESS;
+  case TZ_UPDATE_ROLLBACK_VERSION_ID:
+    Rsp->status = 1;
+    return EFI_SUCCESS;
+  }
+  return EFI_UNSUPPORTED;
+}
+
+/* Hash2 protocol hashing with the scalar code. It keeps a single hash, as
+ * the hardware engines do.
+ */
+STATIC EFI_STATUS
+EFIAPI
+MockHash2Init (IN CONST EFI_HASH2_PROTOCOL *This,
+               IN CONST EFI_GUID *HashAlgorithm)
+{
+  UINT32 Idle = 0;
+
+  if (!CompareGuid (HashAlgorithm, &gEfiHashAlgorithmSha256Guid)) {
+    return EFI_UNSUPPORTED;
+  }
+  if (!__atomic_compare_exchange_n (&TestHashActive, &Idle, 1, FALSE,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+    return EFI_ALREADY_STARTED;
+  }
+  avb_sha256_sw_init (&TestHashCtx);
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+MockHash2Update (IN CONST EFI_HASH2_PROTOCOL *This,
+                 IN CONST UINT8 *Message,
+                 IN UINTN MessageSize)
+{
+  if (!TestHashActive) {
+    return EFI_NOT_READY;
+  }
+  avb_sha256_sw_update (&TestHashCtx, Message, MessageSize);
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+MockHash2Final (IN CONST EFI_HASH2_PROTOCOL *This,
+                IN OUT EFI_HASH2_OUTPUT *Hash)
+{
+  if (!TestHashActive) {
+    return EFI_NOT_READY;
+  }
+  CopyMem (Hash->Sha256Hash, avb_sha256_sw_final (&TestHashCtx),
+           sizeof (Hash->Sha256Hash));
+  __atomic_store_n (&TestHashActive, 0, __ATOMIC_RELEASE);
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_RAMPARTITION_PROTOCOL MockRamPartition = {
+  .Revision = EFI_RAMPARTITION_PROTOCOL_REVISION,
+  .GetRamPartitions = MockGetRamPartitions,
+  .GetMinPasrSize = MockGetMinPasrSize,
+};
+
+STATIC EFI_CHIPINFO_PROTOCOL MockChipInfo = {
+  .Revision = EFI_CHIPINFO_PROTOCOL_REVISION,
+  .GetChipVersion = MockGetChipVersion,
+  .GetChipId = MockGetChipId,
+  .GetChipIdString = MockGetChipIdString,
+  .GetModemSupport = MockGetModemSupport,
+  .GetFoundryId = MockGetFoundryId,
+  .GetDefectivePart = MockGetDefectivePart,
+  .GetDefectiveCPUs = MockGetDefectiveCpus,
+};
+
+STATIC EFI_PLATFORMINFO_PROTOCOL MockPlatformInfo = {
+  .Version = EFI_PLATFORMINFO_PROTOCOL_VERSION,
+  .GetPlatformInfo = MockGetPlatformInfo,
+};
+
+STATIC EFI_MEM_CARDINFO_PROTOCOL MockCardInfo = {
+  .Revision = EFI_MEM_CARD_INFO_PROTOCOL_REVISION,
+  .GetCardInfo = MockGetCardInfo,
+};
+
+STATIC QCOM_VERIFIEDBOOT_PROTOCOL MockVerifiedBoot = {
+  .Revision = QCOM_VERIFIEDBOOT_PROTOCOL_REVISION,
+  .VBRwDeviceState = MockVBRwDeviceState,
+  .VBDeviceInit = MockVBDeviceInit,
+  .VBSendRot = MockVBSendCall,
+  .VBSendMilestone = MockVBSendCall,
+  .VBIsDeviceSecure = MockVBIsDeviceSecure,
+};
+
+STATIC QCOM_QSEECOM_PROTOCOL MockQseecom = {
+  .Revision = QCOM_QSEECOM_PROTOCOL_REVISION,
+  .QseecomStartApp = MockQseecomStartApp,
+  .QseecomSendCmd = MockQseecomSendCmd,
+};
+
+STATIC QCOM_SCM_PROTOCOL MockScm = {
+  .Revision = QCOM_SCM_PROTOCOL_REVISION,
+  .ScmSipSysCall = MockScmSipSysCall,
+};
+
+STATIC EFI_HASH2_PROTOCOL MockHash2 = {
+  .HashInit = MockHash2Init,
+  .HashUpdate = MockHash2Update,
+  .HashFinal = MockHash2Final,
+};
+
+STATIC VOID *
+TestLoad (CONST CHAR8 *Name, UINTN *Size)
+{
+  CHAR8 Path[TEST_MAX_PATH];
+
+  AsciiSPrint (Path, sizeof (Path), "%a/%a", TestDir, Name);
+  return HostLoadFile (Path, Size);
+}
+
+STATIC UINT32
+TestEnv (CONST CHAR8 *Name, UINT32 Default)
+{
+  CONST CHAR8 *Value = HostGetEnv (Name);
+
+  return Value ? (UINT32)HostStrToUintn (Value) : Default;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+TestWaitForEvent (IN UINTN NumberOfEvents,
+                  IN EFI_EVENT *Event,
+                  OUT UINTN *Index)
+{
+  if (++TestWaits >= TestWaitFailsAt) {
+    return EFI_UNSUPPORTED;
+  }
+  return TestHostWaitForEvent (NumberOfEvents, Event, Index);
+}
+
+/* Adds partition Index to the eMMC user area: a disk holding the image,
+ * with its device path and partition record
+ */
+STATIC BOOLEAN
+TestAddPartition (UINTN Index)
+{
+  TEST_PARTITION *Partition = &TestPartitions[Index];
+  TEST_DEVICE_PATH *Path = &Partition->DevicePath;
+  CONST CHAR8 *Io2Order = HostGetEnv ("BOOT_SIM_BLOCKIO2");
+  UINT8 *Image;
+  UINTN Size;
+  UINT64 Blocks;
+
+  Image = TestLoad (Partition->Name, &Size);
+  if (Image == NULL) {
+    TEST_ERROR ("Cannot read %a/%a", TestDir, Partition->Name);
+    return FALSE;
+  }
+  Blocks = MAX (1, (Size + TEST_BLOCK_SIZE - 1) / TEST_BLOCK_SIZE);
+  Partition->Disk = HostDiskCreate (TEST_BLOCK_SIZE, Blocks, 0,
+                                    HOST_ERASE_NONE);
+  CopyMem (Partition->Disk->Data, Image, Size);
+  FreePool (Image);
+  Partition->Disk->Media.RemovableMedia = FALSE;
+  if (Io2Order != NULL) {
+    HostDiskAddBlockIo2 (Partition->Disk,
+                         AsciiStrCmp (Io2Order, "newest-first")
+                             ? HOST_IO2_IN_ORDER
+                             : HOST_IO2_REVERSE);
+    Partition->Disk->Io2FailAt = TestEnv ("BOOT_SIM_BLOCKIO2_FAIL_AT", 0);
+  }
+
+  Path->Root.Header.Type = HARDWARE_DEVICE_PATH;
+  Path->Root.Header.SubType = HW_VENDOR_DP;
+  Path->Root.Header.Length[0] = sizeof (Path->Root);
+  CopyGuid (&Path->Root.Guid, &gEfiEmmcUserPartitionGuid);
+  Path->Partition.Header.Type = MEDIA_DEVICE_PATH;
+  Path->Partition.Header.SubType = MEDIA_HARDDRIVE_DP;
+  Path->Partition.Header.Length[0] = sizeof (Path->Partition);
+  Path->Partition.PartitionNumber = Index + 1;
+  Path->Partition.PartitionSize = Blocks;
+  Path->Partition.MBRType = PARTITIONED_TYPE_GPT;
+  Path->Partition.SignatureType = SIGNATURE_TYPE_GUID;
+  Path->End.Type = END_DEVICE_PATH_TYPE;
+  Path->End.SubType = END_ENTIRE_DEVICE_PATH_SUBTYPE;
+  Path->End.Length[0] = sizeof (Path->End);
+
+  AsciiStrToUnicodeStr (Partition->Name, Partition->Entry.PartitionName);
+  Partition->Entry.UniquePartitionGUID.Data1 = Index + 1;
+  Partition->Entry.StartingLBA = 0;
+  Partition->Entry.EndingLBA = Blocks - 1;
+
+  HostInstallProtocol (&Partition->Disk->Handle, &gEfiDevicePathProtocolGuid,
+                       Path);
+  HostInstallProtocol (&Partition->Disk->Handle, &gEfiPartitionRecordGuid,
+                       &Partition->Entry);
+  /* BoardSerialNum () asks the first handle of the card */
+  HostInstallProtocol (&Partition->Disk->Handle, &gEfiMemCardInfoProtocolGuid,
+                       &MockCardInfo);
+  return TRUE;
+}
+
+STATIC BOOLEAN
+TestSetUp (BOOLEAN Unlocked)
+{
+  EFI_HANDLE Handle = NULL;
+  UINT8 *UserKey;
+  UINTN UserKeySize = 0;
+  UINTN Index;
+
+  TestRam = AllocateAlignedPages (EFI_SIZE_TO_PAGES (TEST_RAM_SIZE),
+                                  TEST_RAM_SIZE);
+  if (TestRam == NULL) {
+    TEST_ERROR ("Cannot allocate %u MB of RAM", TEST_RAM_SIZE / SIZE_1MB);
+    return FALSE;
+  }
+
+  CopyMem (TestDevInfo.magic, DEVICE_MAGIC, DEVICE_MAGIC_SIZE);
+  TestDevInfo.is_unlocked = Unlocked;
+  TestDevInfo.is_unlock_critical = Unlocked;
+  TestDevInfo.verity_mode = TRUE;
+  UserKey = TestLoad ("avb_pubkey.bin", &UserKeySize);
+  if (UserKey != NULL) {
+    if (UserKeySize > sizeof (TestDevInfo.user_public_key)) {
+      TEST_ERROR ("avb_pubkey.bin is too large");
+      return FALSE;
+    }
+    CopyMem (TestDevInfo.user_public_key, UserKey, UserKeySize);
+    TestDevInfo.user_public_key_length = UserKeySize;
+    FreePool (UserKey);
+  }
+
+  TestChipId = TestEnv ("BOOT_SIM_CHIP_ID", TEST_DEFAULT_CHIP_ID);
+  TestChipVersion = TestEnv ("BOOT_SIM_CHIP_VERSION",
+                             TEST_DEFAULT_CHIP_VERSION);
+  TestSubtype = TestEnv ("BOOT_SIM_SUBTYPE", TEST_DEFAULT_SUBTYPE);
+  TestWaitFailsAt = TestEnv ("BOOT_SIM_WAIT_FAILS_AT", 0);
+  if (TestWaitFailsAt) {
+    TestHostWaitForEvent = gBS->WaitForEvent;
+    gBS->WaitForEvent = TestWaitForEvent;
+  }
+
+  HostInstallProtocol (&Handle, &gEfiRamPartitionProtocolGuid,
+                       &MockRamPartition);
+  HostInstallProtocol (&Handle, &gEfiChipInfoProtocolGuid, &MockChipInfo);
+  HostInstallProtocol (&Handle, &gEfiPlatformInfoProtocolGuid,
+                       &MockPlatformInfo);
+  HostInstallProtocol (&Handle, &gEfiQcomVerifiedBootProtocolGuid,
+                       &MockVerifiedBoot);
+  HostInstallProtocol (&Handle, &gQcomQseecomProtocolGuid, &MockQseecom);
+  HostInstallProtocol (&Handle, &gQcomScmProtocolGuid, &MockScm);
+  HostInstallProtocol (&Handle, &gEfiHash2ProtocolGuid, &MockHash2);
+
+  for (Index = 0; Index < ARRAY_SIZE (TestPartitions); Index++) {
+    if (!TestAddPartition (Index)) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+STATIC UINT64
+TestBytesRead (VOID)
+{
+  UINT64 Bytes = 0;
+  UINTN Index;
+
+  for (Index = 0; Index < ARRAY_SIZE (TestPartitions); Index++) {
+    Bytes += TestPartitions[Index].Disk->BytesRead;
+  }
+  return Bytes;
+}
+
+/* Every BlockIo2 request completed, with its event open until then */
+STATIC BOOLEAN
+TestCheckDisks (VOID)
+{
+  HOST_DISK *Disk;
+  UINT64 Requests = 0;
+  UINTN Index;
+  BOOLEAN Ok = TRUE;
+
+  for (Index = 0; Index < ARRAY_SIZE (TestPartitions); Index++) {
+    Disk = TestPartitions[Index].Disk;
+    Requests += Disk->Io2Requests;
+    if (Disk->Io2InFlight ||
+        Disk->Io2EarlyCloses) {
+      TEST_ERROR ("%a: %u BlockIo2 requests in flight, %u events closed "
+                  "before their request completed",
+                  TestPartitions[Index].Name, Disk->Io2InFlight,
+                  Disk->Io2EarlyCloses);
+      Ok = FALSE;
+    }
+  }
+  if (HostGetEnv ("BOOT_SIM_BLOCKIO2") != NULL &&
+      !Requests) {
+    TEST_ERROR ("No partition was read through BlockIo2");
+    Ok = FALSE;
+  }
+  return Ok;
+}
+
+/* Every hash started on the Hash2 engine ended, whether the boot went on
+ * or stopped in the middle of a partition
+ */
+STATIC BOOLEAN
+TestCheckHash2 (VOID)
+{
+  if (TestHashActive) {
+    TEST_ERROR ("The Hash2 engine was left with a hash started");
+    return FALSE;
+  }
+  return TRUE;
+}
+
+STATIC VOID
+TestPhaseBegin (CONST CHAR8 *Name)
+{
+  TestPhase.Name = Name;
+  TestPhase.BytesRead = TestBytesRead ();
+  TestPhase.BytesCopied = HostCopiedBytes ();
+  HostAllocStats (&TestPhase.Allocs);
+  TestPhase.StartNs = HostTimeNs ();
+}
+
+STATIC VOID
+TestPhaseEnd (VOID)
+{
+  UINT64 EndNs = HostTimeNs ();
+  HOST_ALLOC_STATS Allocs;
+
+  HostAllocStats (&Allocs);
+  HostPrint ("%a: start %lu us, %lu us, %lu bytes\n", TestPhase.Name,
+             (TestPhase.StartNs - TestBootStart) / 1000,
+             (EndNs - TestPhase.StartNs) / 1000,
+             TestBytesRead () - TestPhase.BytesRead);
+  HostPrint ("  %lu bytes copied, %lu allocations of %lu bytes, %lu frees\n",
+             HostCopiedBytes () - TestPhase.BytesCopied,
+             Allocs.Allocations - TestPhase.Allocs.Allocations,
+             Allocs.Bytes - TestPhase.Allocs.Bytes,
+             Allocs.Frees - TestPhase.Allocs.Frees);
+}
+
+/* Data must be at Address, when the file Name is there to compare with */
+STATIC BOOLEAN
+TestCheckLoaded (CONST CHAR8 *What,
+                 CONST UINT8 *Address,
+                 UINTN Size,
+                 CONST CHAR8 *Name)
+{
+  UINT8 *Expected;
+  UINTN ExpectedSize;
+  BOOLEAN Ok;
+
+  Expected = TestLoad (Name, &ExpectedSize);
+  if (Expected == NULL) {
+    return TRUE;
+  }
+  Ok = Size >= ExpectedSize && Address != NULL &&
+       CompareMem (Address, Expected, ExpectedSize) == 0;
+  if (!Ok) {
+    TEST_ERROR ("The %a loaded at 0x%lx is not %a", What, (UINT64)Address,
+                Name);
+  }
+  FreePool (Expected);
+  return Ok;
+}
+
+/* Each line of the expect file: "<node> <property> <text>" */
+STATIC BOOLEAN
+TestCheckFdt (VOID)
+{
+  CHAR8 *Data;
+  CHAR8 *Expect;
+  CHAR8 *Line;
+  CHAR8 *Next;
+  CHAR8 *Property;
+  CHAR8 *Text;
+  CONST CHAR8 *Value;
+  UINTN Size;
+  INT32 Offset;
+  INT32 Len;
+  BOOLEAN Ok = TRUE;
+
+  if (TestFdt == NULL || fdt_check_header (TestFdt)) {
+    TEST_ERROR ("No valid device tree was passed to the kernel");
+    return FALSE;
+  }
+
+  Data = TestLoad ("expect", &Size);
+  if (Data == NULL) {
+    return TRUE;
+  }
+  Expect = AllocateZeroPool (Size + 1);
+  if (Expect == NULL) {
+    FreePool (Data);
+    return FALSE;
+  }
+  CopyMem (Expect, Data, Size);
+  FreePool (Data);
+  for (Line = Expect; *Line; Line = Next) {
+    Next = Line;
+    while (*Next && *Next != '\n') {
+      Next++;
+    }
+    if (*Next) {
+      *Next++ = '\0';
+    }
+    Property = AsciiStrStr (Line, " ");
+    Text = Property ? AsciiStrStr (Property + 1, " ") : NULL;
+    if (Text == NULL) {
+      continue;
+    }
+    *Property++ = '\0';
+    *Text++ = '\0';
+
+    Offset = fdt_path_offset (TestFdt, Line);
+    Value = Offset >= 0 ? fdt_getprop (TestFdt, Offset, Property, &Len) : NULL;
+    if (Value == NULL || Len <= 0 || Value[Len - 1] != '\0' ||
+        AsciiStrStr (Value, Text) == NULL) {
+      TEST_ERROR ("%a %a is \"%a\", expected to hold \"%a\"", Line, Property,
+                  Value && Len > 0 && Value[Len - 1] == '\0' ? Value : "",
+                  Text);
+      Ok = FALSE;
+    }
+  }
+  FreePool (Expect);
+  return Ok;
+}
+
+/* The boot trace in /chosen ends with the device tree update, which is
+ * queued with the other updates, and names every event id.
+ */
+STATIC BOOLEAN
+TestCheckBootTrace (VOID)
+{
+  CONST fdt32_t *Cells;
+  CONST CHAR8 *Names;
+  INT32 Offset;
+  INT32 Len;
+  INT32 NamesLen;
+  INT32 Pos;
+  UINT32 Id;
+
+  Offset = fdt_path_offset (TestFdt, "/chosen");
+  Cells = Offset >= 0 ? fdt_getprop (TestFdt, Offset, "qcom,boot-trace", &Len)
+                      : NULL;
+  if (Cells == NULL || Len <= 0 ||
+      Len % (BOOT_TRACE_DT_CELLS * sizeof (*Cells)) ||
+      fdt32_to_cpu (Cells[Len / sizeof (*Cells) - BOOT_TRACE_DT_CELLS]) !=
+          BT_UPDATE_DEVICE_TREE) {
+    TEST_ERROR ("/chosen qcom,boot-trace does not end with %a",
+                BootTraceName (BT_UPDATE_DEVICE_TREE));
+    return FALSE;
+  }
+
+  Names = fdt_getprop (TestFdt, Offset, "qcom,boot-trace-names", &NamesLen);
+  for (Id = 0, Pos = 0; Names && Id < BT_ID_MAX && Pos < NamesLen; Id++) {
+    if (AsciiStrCmp (Names + Pos, BootTraceName (Id))) {
+      break;
+    }
+    Pos += AsciiStrLen (Names + Pos) + 1;
+  }
+  if (Id != BT_ID_MAX || Pos != NamesLen) {
+    TEST_ERROR ("/chosen qcom,boot-trace-names does not name event %u", Id);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+STATIC VOID
+TestPrintTrace (VOID)
+{
+  BOOT_TRACE_EVENT *Events;
+  UINT32 Count;
+  UINT32 Index;
+
+  Events = AllocatePool (BOOT_TRACE_MAX_EVENTS * sizeof (*Events));
+  if (Events == NULL) {
+    return;
+  }
+  /* The trace clock is the performance counter, HostTimeNs () here */
+  Count = BootTraceSnapshot (Events, BOOT_TRACE_MAX_EVENTS);
+  for (Index = 0; Index < Count; Index++) {
+    HostPrint ("%a: start %lu us, %lu us, %lu bytes\n",
+               BootTraceName (Events[Index].Id),
+               Events[Index].StartUs - TestBootStart / 1000,
+               Events[Index].DurationUs, Events[Index].Bytes);
+  }
+  FreePool (Events);
+}
+
+STATIC EFI_STATUS
+TestBoot (VOID)
+{
+  STATIC BootInfo Info;
+  BOOLEAN BootIntoRecovery = FALSE;
+  EFI_STATUS Status;
+
+  TestBootStart = HostTimeNs ();
+
+  TestPhaseBegin ("device-info");
+  Status = DeviceInfoInit ();
+  TestPhaseEnd ();
+  if (Status != EFI_SUCCESS) {
+    return Status;
+  }
+
+  TestPhaseBegin ("partitions");
+  Status = EnumeratePartitions ();
+  if (Status == EFI_SUCCESS) {
+    UpdatePartitionEntries ();
+    Info.MultiSlotBoot = PartitionHasMultiSlot ((CONST CHAR16 *)L"boot");
+  }
+  TestPhaseEnd ();
+  if (Status != EFI_SUCCESS) {
+    return Status;
+  }
+
+  /* There is no misc partition, LinuxLoader ignores the error too */
+  TestPhaseBegin ("board-init");
+  RecoveryInit (&BootIntoRecovery);
+  Info.BootIntoRecovery = BootIntoRecovery;
+  Status = BoardInit ();
+  GetVmData ();
+  TestPhaseEnd ();
+  if (Status != EFI_SUCCESS) {
+    return Status;
+  }
+
+  TestPhaseBegin ("load-image-auth");
+  Status = LoadImageAndAuth (&Info);
+  TestPhaseEnd ();
+  if (Status != EFI_SUCCESS) {
+    return Status;
+  }
+
+  TestPhaseBegin ("boot-linux");
+  if (setjmp (TestKernelJump) == 0) {
+    Status = BootLinux (&Info);
+    TestPhaseEnd ();
+    return EFI_ERROR (Status) ? Status : EFI_ABORTED;
+  }
+  TestPhaseEnd ();
+  return EFI_SUCCESS;
+}
+
+int
+main (int Argc, char **Argv)
+{
+  EFI_STATUS Status;
+  BOOLEAN Ok;
+
+  if (Argc != 3 || (AsciiStrCmp (Argv[2], "locked") &&
+                    AsciiStrCmp (Argv[2], "unlocked"))) {
+    HostPrint ("Usage: %a <dir> <locked|unlocked>\n", Argv[0]);
+    return 2;
+  }
+  TestDir = Argv[1];
+  if (!TestSetUp (AsciiStrCmp (Argv[2], "unlocked") == 0)) {
+    return 1;
+  }
+
+  Status = TestBoot ();
+  TestPrintTrace ();
+  Ok = TestCheckDisks ();
+  Ok = TestCheckHash2 () && Ok;
+  if (Status != EFI_SUCCESS) {
+    HostPrint ("Boot stopped before the kernel: %r\n", Status);
+    return 1;
+  }
+
+  HostPrint ("Boot state: %a\n", TestBootState < ARRAY_SIZE (TestBootStates)
+                                     ? TestBootStates[TestBootState]
+                                     : "not set");
+  if (!TestServicesDown) {
+    TEST_ERROR ("The kernel was started with the boot services up");
+    Ok = FALSE;
+  }
+  Ok &= TestCheckLoaded (
+      "kernel", TestRam + PcdGet32 (KernelLoadAddress),
+      TEST_RAM_SIZE - PcdGet32 (KernelLoadAddress), "expect_kernel");
+  Ok &= TestCheckLoaded ("ramdisk", TestRamdisk, TestRamdiskSize,
+                         "expect_ramdisk");
+  Ok &= TestCheckFdt () && TestCheckBootTrace ();
+  return Ok ? 0 : 1;
+}
@@ -0,0 +1,420 @@
+/* Copyright (c) 2021, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Test of the two pass command line builder of BootLib.
+ *
+ * Usage: cmdline_test_app <seed> <sequences>
+ *
+ * Hand written cases check quoted values, "--", repeated console=, keys
+ * completed by the next append, the androidboot.* override, and that a
+ * second pass appending more than the sizing pass fails with
+ * EFI_BUFFER_TOO_SMALL. Then <sequences> random sequences of appends and
+ * merges generated from <seed> must give the command line of a naive
+ * reference, which tokenizes the joined line and drops all but the last
+ * token of each merged key by rescanning it.
+ */
+
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/CmdLineBuilder.h>
+#include <Library/MemoryAllocationLib.h>
+
+#include "HostLib.h"
+
+#define TEST_MAX_OPS 12
+#define TEST_LINE_SIZE 2048
+#define TEST_PREFIX "androidboot."
+#define TEST_COUNT(Array) (sizeof (Array) / sizeof (*(Array)))
+
+typedef struct {
+  BOOLEAN Merge;
+  CONST CHAR8 *Str;
+} TEST_OP;
+
+typedef struct {
+  CONST CHAR8 *Name;
+  TEST_OP Ops[6];
+  CONST CHAR8 *Expected;
+} TEST_CASE;
+
+STATIC CONST TEST_CASE TestCases[] = {
+  {"quoted value",
+   {{FALSE, "dm=\"1 vroot androidboot.x=1 ro\" androidboot.x=2"},
+    {TRUE, " androidboot.x=3"}},
+   "dm=\"1 vroot androidboot.x=1 ro\" androidboot.x=3"},
+  {"quoted key",
+   {{FALSE, "androidboot.v=\"a b\" \"androidboot.v=c\""},
+    {TRUE, " androidboot.v=\"d e\""}},
+   "\"androidboot.v=c\" androidboot.v=\"d e\""},
+  {"quote in the key",
+   {{TRUE, "androidboot.\"k=1\" androidboot.\"k=2\""}},
+   "androidboot.\"k=1\" androidboot.\"k=2\""},
+  {"init arguments",
+   {{TRUE, "androidboot.a=1 androidboot.a=2 -- androidboot.a=3"},
+    {TRUE, " androidboot.a=4 --"}},
+   "androidboot.a=2 -- androidboot.a=3 androidboot.a=4 --"},
+  {"repeated console",
+   {{FALSE, "console=ttyMSM0 console=tty0"},
+    {TRUE, " console=ttyS0 androidboot.console=a androidboot.console=b"},
+    {TRUE, " earlycon=uart console=ttyS0"}},
+   "console=ttyMSM0 console=tty0 console=ttyS0 androidboot.console=b "
+   "earlycon=uart console=ttyS0"},
+  {"bootloader over image",
+   {{FALSE, "androidboot.hardware=img quiet"},
+    {TRUE, " androidboot.hardware=qcom"}},
+   "quiet androidboot.hardware=qcom"},
+  {"key completed by an append",
+   {{FALSE, "androidboot.serialno=img"},
+    {TRUE, " androidboot.serialno="},
+    {FALSE, "1234abcd"}},
+   "androidboot.serialno=1234abcd"},
+  {"no keys",
+   {{FALSE, " init=/init  quiet "},
+    {TRUE, "androidboot. androidboot.=1 androidboot.flag"}},
+   " init=/init  quiet androidboot. androidboot.=1 androidboot.flag"},
+};
+
+/* Pieces of the random sequences, each appended or merged */
+STATIC CONST CHAR8 *TestPieces[] = {
+  " console=ttyMSM0,115200n8", " console=tty0", "console=ttyS0",
+  " earlycon=msm_geni_serial,0xa90000", " androidboot.hardware=qcom",
+  " androidboot.hardware=sim", "androidboot.hardware=x",
+  " androidboot.serialno=", "1234abcd", " androidboot.mode=charger",
+  " androidboot.mode=normal", " dm=\"1 vroot none ro 1,0 androidboot.mode=a\"",
+  " androidboot.verifiedbootstate=\"orange state\"", " androidboot.e=\"a=b\"",
+  " androidboot.e=c", " \"androidboot.q=1\"", " androidboot.q=2",
+  " androidboot.=x", " androidboot.", " androidboot.flag",
+  " androidboot.\"k=1\"", " --",
+  " -- androidboot.hardware=after", " init=/init", " quiet", "  ", " ", "",
+  "androidboot.slot_suffix=_a", " androidboot.slot_suffix=_b", "\"",
+  " androidboot.z=1 androidboot.z=2 androidboot.z=3",
+};
+
+STATIC UINT32 TestSeed;
+
+STATIC VOID
+TestRun (CMDLINE_BUILDER *Builder, CONST TEST_OP *Ops, UINTN Count)
+{
+  UINTN Index;
+
+  for (Index = 0; Index < Count; Index++) {
+    if (Ops[Index].Merge) {
+      CmdLineBuilderMerge (Builder, Ops[Index].Str);
+    } else {
+      CmdLineBuilderAppend (Builder, Ops[Index].Str);
+    }
+  }
+}
+
+/* Both passes over Ops, CmdLine is to be freed by the caller */
+STATIC EFI_STATUS
+TestBuild (CONST TEST_OP *Ops, UINTN Count, CHAR8 **CmdLine)
+{
+  CMDLINE_BUILDER Builder;
+  EFI_STATUS Status;
+
+  CmdLineBuilderInit (&Builder);
+  TestRun (&Builder, Ops, Count);
+  Status = CmdLineBuilderAllocate (&Builder);
+  if (Status == EFI_SUCCESS) {
+    TestRun (&Builder, Ops, Count);
+    Status = CmdLineBuilderFinish (&Builder, CmdLine);
+  }
+  CmdLineBuilderFree (&Builder);
+  return Status;
+}
+
+/* Length of the token at Str: up to a space outside of double quotes */
+STATIC UINTN
+TestTokenLen (CONST CHAR8 *Str)
+{
+  BOOLEAN Quoted = FALSE;
+  UINTN Len;
+
+  for (Len = 0; Str[Len] && (Quoted || Str[Len] != ' '); Len++) {
+    if (Str[Len] == '"') {
+      Quoted = !Quoted;
+    }
+  }
+  return Len;
+}
+
+/* Length of the key of an androidboot.<name>=value token, 0 otherwise */
+STATIC UINTN
+TestKeyLen (CONST CHAR8 *Token, UINTN Len)
+{
+  UINTN Prefix = AsciiStrLen (TEST_PREFIX);
+  UINTN Index;
+
+  if (Len <= Prefix || AsciiStrnCmp (Token, TEST_PREFIX, Prefix)) {
+    return 0;
+  }
+  for (Index = Prefix; Index < Len && Token[Index] != '"'; Index++) {
+    if (Token[Index] == '=') {
+      return Index > Prefix ? Index : 0;
+    }
+  }
+  return 0;
+}
+
+STATIC BOOLEAN
+TestSameKey (CONST CHAR8 *A, UINTN ALen, CONST CHAR8 *B, UINTN BLen)
+{
+  return ALen && ALen == BLen && !AsciiStrnCmp (A, B, ALen);
+}
+
+/* Whether a token of a merged string has the key Key */
+STATIC BOOLEAN
+TestMerged (CONST TEST_OP *Ops, UINTN Count, CONST CHAR8 *Key, UINTN KeyLen)
+{
+  CONST CHAR8 *Str;
+  UINTN Index;
+  UINTN Len;
+
+  for (Index = 0; Index < Count; Index++) {
+    if (!Ops[Index].Merge) {
+      continue;
+    }
+    for (Str = Ops[Index].Str; *Str; Str += Len) {
+      Len = *Str == ' ' ? 1 : TestTokenLen (Str);
+      if (TestSameKey (Str, TestKeyLen (Str, Len), Key, KeyLen)) {
+        return TRUE;
+      }
+    }
+  }
+  return FALSE;
+}
+
+/* The command line of Ops, the slow way. A dropped token takes the space
+ * before it along, or the one after it when nothing was written before.
+ */
+STATIC VOID
+TestReference (CONST TEST_OP *Ops, UINTN Count, CHAR8 *Out)
+{
+  CHAR8 Line[TEST_LINE_SIZE] = "";
+  UINTN Index;
+  UINTN Pos;
+  UINTN Next;
+  UINTN Len;
+  UINTN NextLen;
+  UINTN KeyLen;
+  UINTN Write = 0;
+  BOOLEAN Drop;
+  BOOLEAN SkipSpace = FALSE;
+  BOOLEAN Args = FALSE;
+
+  for (Index = 0; Index < Count; Index++) {
+    AsciiStrCatS (Line, sizeof (Line), Ops[Index].Str);
+  }
+
+  for (Pos = 0; Line[Pos]; Pos += Len) {
+    if (Args) {
+      Len = 1;
+      Out[Write++] = Line[Pos];
+      continue;
+    }
+    if (Line[Pos] == ' ') {
+      Len = 1;
+      if (!SkipSpace) {
+        Out[Write++] = ' ';
+      }
+      SkipSpace = FALSE;
+      continue;
+    }
+    Len = TestTokenLen (Line + Pos);
+    if (Len == 2 && !AsciiStrnCmp (Line + Pos, "--", 2)) {
+      Args = TRUE;
+      Len = 0;
+      continue;
+    }
+
+    /* Dropped when the key was merged and a later token before "--" has
+     * it too
+     */
+    KeyLen = TestKeyLen (Line + Pos, Len);
+    Drop = FALSE;
+    if (KeyLen && TestMerged (Ops, Count, Line + Pos, KeyLen)) {
+      for (Next = Pos + Len; Line[Next] && !Drop; Next += NextLen) {
+        NextLen = Line[Next] == ' ' ? 1 : TestTokenLen (Line + Next);
+        if (NextLen == 2 && !AsciiStrnCmp (Line + Next, "--", 2)) {
+          break;
+        }
+        Drop = TestSameKey (Line + Next, TestKeyLen (Line + Next, NextLen),
+                            Line + Pos, KeyLen);
+      }
+    }
+    if (Drop) {
+      if (Write && Out[Write - 1] == ' ') {
+        Write--;
+      } else {
+        SkipSpace = TRUE;
+      }
+      continue;
+    }
+    SkipSpace = FALSE;
+    CopyMem (Out + Write, Line + Pos, Len);
+    Write += Len;
+  }
+  Out[Write] = '\0';
+}
+
+STATIC BOOLEAN
+TestCheck (CONST CHAR8 *Name,
+           CONST TEST_OP *Ops,
+           UINTN Count,
+           CONST CHAR8 *Expected)
+{
+  CHAR8 *CmdLine = NULL;
+  EFI_STATUS Status;
+  UINTN Index;
+  BOOLEAN Ok;
+
+  Status = TestBuild (Ops, Count, &CmdLine);
+  if (Status != EFI_SUCCESS) {
+    HostPrint ("%a: %r\n", Name, Status);
+    return FALSE;
+  }
+  Ok = !AsciiStrCmp (CmdLine, Expected);
+  if (!Ok) {
+    HostPrint ("%a:\n", Name);
+    for (Index = 0; Index < Count; Index++) {
+      HostPrint ("  %a \"%a\"\n", Ops[Index].Merge ? "merge " : "append",
+                 Ops[Index].Str);
+    }
+    HostPrint ("  got      \"%a\"\n  expected \"%a\"\n", CmdLine, Expected);
+  }
+  FreePool (CmdLine);
+  return Ok;
+}
+
+STATIC BOOLEAN
+TestHandCases (VOID)
+{
+  CONST TEST_CASE *Case;
+  CHAR8 Reference[TEST_LINE_SIZE];
+  UINTN Count;
+  UINTN Index;
+
+  for (Index = 0; Index < TEST_COUNT (TestCases); Index++) {
+    Case = &TestCases[Index];
+    for (Count = 0; Count < TEST_COUNT (Case->Ops) && Case->Ops[Count].Str;
+         Count++) {
+    }
+    TestReference (Case->Ops, Count, Reference);
+    if (!TestCheck (Case->Name, Case->Ops, Count, Case->Expected) ||
+        !TestCheck ("reference", Case->Ops, Count, Reference)) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+/* A second pass that differs from the sizing pass must not write past
+ * what was sized, in text or in keys
+ */
+STATIC BOOLEAN
+TestSizeMismatch (VOID)
+{
+  STATIC CONST CHAR8 *Sized[] = {"console=ttyMSM0", "console=ttyMSM0"};
+  STATIC CONST CHAR8 *Written[] = {"console=ttyMSM0 quiet",
+                                   "androidboot.x=1"};
+  STATIC CONST BOOLEAN Merged[] = {FALSE, TRUE};
+  CMDLINE_BUILDER Builder;
+  CHAR8 *CmdLine = NULL;
+  EFI_STATUS Status;
+  UINTN Index;
+
+  for (Index = 0; Index < TEST_COUNT (Sized); Index++) {
+    CmdLineBuilderInit (&Builder);
+    if (CmdLineBuilderFinish (&Builder, &CmdLine) != EFI_NOT_READY) {
+      HostPrint ("finish before the allocation did not fail\n");
+      return FALSE;
+    }
+    CmdLineBuilderAppend (&Builder, Sized[Index]);
+    if (CmdLineBuilderAllocate (&Builder) != EFI_SUCCESS ||
+        CmdLineBuilderAllocate (&Builder) != EFI_ALREADY_STARTED) {
+      HostPrint ("allocation of a sized builder\n");
+      CmdLineBuilderFree (&Builder);
+      return FALSE;
+    }
+    if (Merged[Index]) {
+      CmdLineBuilderMerge (&Builder, Written[Index]);
+    } else {
+      CmdLineBuilderAppend (&Builder, Written[Index]);
+    }
+    Status = CmdLineBuilderFinish (&Builder, &CmdLine);
+    CmdLineBuilderFree (&Builder);
+    if (Status != EFI_BUFFER_TOO_SMALL) {
+      HostPrint ("\"%a\" sized as \"%a\": %r, not %r\n", Written[Index],
+                 Sized[Index], Status, EFI_BUFFER_TOO_SMALL);
+      if (Status == EFI_SUCCESS) {
+        FreePool (CmdLine);
+      }
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+STATIC BOOLEAN
+TestRandom (UINTN Sequences)
+{
+  TEST_OP Ops[TEST_MAX_OPS];
+  CHAR8 Reference[TEST_LINE_SIZE];
+  UINTN Sequence;
+  UINTN Count;
+  UINTN Index;
+
+  for (Sequence = 0; Sequence < Sequences; Sequence++) {
+    Count = 1 + HostRandom (&TestSeed) % TEST_MAX_OPS;
+    for (Index = 0; Index < Count; Index++) {
+      Ops[Index].Merge = HostRandom (&TestSeed) % 2;
+      Ops[Index].Str =
+          TestPieces[HostRandom (&TestSeed) % TEST_COUNT (TestPieces)];
+    }
+    TestReference (Ops, Count, Reference);
+    if (!TestCheck ("random sequence", Ops, Count, Reference)) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+int
+main (int Argc, char **Argv)
+{
+  if (Argc != 3) {
+    HostPrint ("Usage: %a <seed> <sequences>\n", Argv[0]);
+    return 2;
+  }
+  TestSeed = HostStrToUintn (Argv[1]);
+
+  return TestHandCases () && TestSizeMismatch () &&
+         TestRandom (HostStrToUintn (Argv[2])) ? 0 : 1;
+}
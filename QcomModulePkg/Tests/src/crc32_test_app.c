@@ -0,0 +1,243 @@
+/* Copyright (c) 2021, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Test of the CRC-32 of libavb, which sparse images use for their CRC
+ * chunks: avb_crc32_update () and avb_crc32_zeros ().
+ *
+ * Usage: crc32_test_app <data> <crc32> <seed> [rounds]
+ *
+ * Known answers, with long runs of zeros, are checked before and after
+ * avb_crc32_init (). <data> is then fed in updates of random sizes, with
+ * zeros added through avb_crc32_zeros (), and must give the hex CRC
+ * <crc32>. With [rounds], the speeds are printed.
+ */
+
+#include "libavb.h"
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+
+#include "HostLib.h"
+
+#define TEST_SPLITS 20
+#define TEST_ZERO_RUNS 200
+#define TEST_ZERO_BUF SIZE_64KB
+
+typedef struct {
+  CONST CHAR8 *Message;
+  UINT64 Zeros;
+  UINT32 Crc32;
+} TEST_KAT;
+
+/* From python zlib.crc32 () */
+STATIC CONST TEST_KAT TestKats[] = {
+  {"", 0, 0x00000000},
+  {"123456789", 0, 0xcbf43926},
+  {"The quick brown fox jumps over the lazy dog", 0, 0x414fa339},
+  {"", 1, 0xd202ef8d},
+  {"", 4096, 0xc71c0011},
+  {"", SIZE_64KB, 0xd7978eeb},
+  {"123456789", SIZE_1MB, 0xb88afb81},
+  {"", SIZE_1GB, 0x5b64c2b0},
+  {"123456789", 0x100000005ULL, 0x58f8652e},
+};
+
+STATIC UINT32 TestSeed;
+STATIC UINT8 TestZeros[TEST_ZERO_BUF];
+
+/* Runs of zeros that fit the buffer are also fed through
+ * avb_crc32_update (), which must agree.
+ */
+STATIC BOOLEAN
+TestKnownAnswers (CONST CHAR8 *When)
+{
+  CONST TEST_KAT *Kat;
+  UINT32 Crc;
+  UINT32 Prefix;
+  UINTN Index;
+
+  for (Index = 0; Index < sizeof (TestKats) / sizeof (*TestKats); Index++) {
+    Kat = &TestKats[Index];
+    Prefix = avb_crc32_update (0, (CONST UINT8 *)Kat->Message,
+                               AsciiStrLen (Kat->Message));
+    Crc = avb_crc32_zeros (Prefix, Kat->Zeros);
+    if (Crc != Kat->Crc32) {
+      HostPrint ("\"%a\" and %lu zeros %a: CRC %08x, expected %08x\n",
+                 Kat->Message, Kat->Zeros, When, Crc, Kat->Crc32);
+      return FALSE;
+    }
+    if (Kat->Zeros <= sizeof (TestZeros) &&
+        avb_crc32_update (Prefix, TestZeros, Kat->Zeros) != Crc) {
+      HostPrint ("\"%a\" and %lu zeros %a: avb_crc32_update () differs\n",
+                 Kat->Message, Kat->Zeros, When);
+      return FALSE;
+    }
+  }
+  if (avb_crc32 ((CONST UINT8 *)"123456789", 9) != 0xcbf43926) {
+    HostPrint ("avb_crc32 () %a: wrong CRC\n", When);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/* Zeros through the matrix and through the tables, from random CRCs */
+STATIC BOOLEAN
+TestZeroRuns (VOID)
+{
+  UINT32 Crc;
+  UINTN Size;
+  UINTN Index;
+
+  for (Index = 0; Index < TEST_ZERO_RUNS; Index++) {
+    Crc = HostRandom (&TestSeed) ^ (HostRandom (&TestSeed) << 16);
+    Size = HostRandom (&TestSeed) % (sizeof (TestZeros) + 1);
+    if (Index % 4 == 0) {
+      Size %= 16;
+    }
+    if (avb_crc32_zeros (Crc, Size) !=
+        avb_crc32_update (Crc, TestZeros, Size)) {
+      HostPrint ("%lu zeros after %08x: avb_crc32_zeros () differs\n",
+                 (UINT64)Size, Crc);
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+STATIC BOOLEAN
+TestIsZero (CONST UINT8 *Data, UINTN Size)
+{
+  while (Size--) {
+    if (*Data++) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+/* Feeds Data in pieces of random sizes and alignments. Zero bytes are
+ * passed to avb_crc32_zeros () when a piece holds nothing else.
+ */
+STATIC BOOLEAN
+TestSplit (CONST UINT8 *Data, UINTN Size, UINT32 Expected)
+{
+  UINT32 Crc = 0;
+  UINTN Pos;
+  UINTN Piece;
+  UINTN Limit;
+
+  for (Pos = 0; Pos < Size; Pos += Piece) {
+    Limit = HostRandom (&TestSeed) % 2 ? 16 : SIZE_1MB;
+    Piece = 1 + HostRandom (&TestSeed) % Limit;
+    Piece = MIN (Piece, Size - Pos);
+    if (TestIsZero (Data + Pos, Piece)) {
+      Crc = avb_crc32_zeros (Crc, Piece);
+    } else {
+      Crc = avb_crc32_update (Crc, Data + Pos, Piece);
+    }
+  }
+  if (Crc != Expected) {
+    HostPrint ("split updates: CRC %08x, expected %08x\n", Crc, Expected);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+STATIC UINT64
+TestSpeed (UINT64 Bytes, UINT64 Start)
+{
+  UINT64 Time = HostTimeNs () - Start;
+
+  return Time ? Bytes * 1000 / Time : 0;
+}
+
+STATIC UINT64
+TestBenchUpdate (CONST UINT8 *Data, UINTN Size, UINT32 Rounds)
+{
+  UINT64 Start = HostTimeNs ();
+  UINT32 Crc = 0;
+  UINT32 Round;
+
+  for (Round = 0; Round < Rounds; Round++) {
+    Crc = avb_crc32_update (Crc, Data, Size);
+  }
+  (VOID)Crc;
+  return TestSpeed ((UINT64)Size * Rounds, Start);
+}
+
+int
+main (int Argc, char **Argv)
+{
+  UINT8 *Data;
+  UINTN Size;
+  UINTN Index;
+  UINT32 Expected;
+  UINT32 Rounds;
+  UINT64 Bytewise = 0;
+  UINT64 Start;
+  UINT64 ZerosTime;
+  BOOLEAN Ok;
+
+  if (Argc < 4) {
+    HostPrint ("Usage: %a <data> <crc32> <seed> [rounds]\n", Argv[0]);
+    return 2;
+  }
+  Expected = AsciiStrHexToUintn (Argv[2]);
+  TestSeed = HostStrToUintn (Argv[3]);
+  Rounds = Argc > 4 ? HostStrToUintn (Argv[4]) : 0;
+
+  Data = HostLoadFile (Argv[1], &Size);
+  if (Data == NULL) {
+    HostPrint ("Cannot read %a\n", Argv[1]);
+    return 2;
+  }
+
+  Ok = TestKnownAnswers ("before init") && TestZeroRuns () &&
+       TestSplit (Data, Size, Expected);
+  if (Ok && Rounds) {
+    Bytewise = TestBenchUpdate (Data, Size, Rounds);
+  }
+
+  avb_crc32_init ();
+  Ok = Ok && TestKnownAnswers ("after init") && TestZeroRuns ();
+  for (Index = 0; Index < TEST_SPLITS && Ok; Index++) {
+    Ok = TestSplit (Data, Size, Expected);
+  }
+
+  if (Ok && Rounds) {
+    Start = HostTimeNs ();
+    (VOID)avb_crc32_zeros (0, 0x100000005ULL);
+    ZerosTime = HostTimeNs () - Start;
+    HostPrint ("crc32 %lu MB/s (%lu MB/s before init), "
+               "4 GB of zeros in %lu ns\n",
+               TestBenchUpdate (Data, Size, Rounds), Bytewise, ZerosTime);
+  }
+  FreePool (Data);
+  return Ok ? 0 : 1;
+}
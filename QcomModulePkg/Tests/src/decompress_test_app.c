@@ -0,0 +1,265 @@
+/* Copyright (c) 2021, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Test of the kernel decompressors of BootLib Decompress.c.
+ *
+ * Usage: decompress_test_app <plain> <image> <name> <end> [rounds]
+ *
+ * <image> is a kernel image <plain> compressed by the gzip or lz4 tool,
+ * possibly followed by its decoded size and an appended dtb as the kernel
+ * build writes them. get_kernel_decompressor () must choose the <name>
+ * decompressor for it, which must decode it to <plain> and report <end>,
+ * the offset of the appended dtb or the end of the image, as the end of
+ * the compressed kernel. The image cut within the compressed data must
+ * fail to decode, unless it is an LZ4 legacy frame, which has no end mark.
+ * The gzip trailer is not checked, as before.
+ *
+ * The deflate data of a gzip image is also inflated with zlib directly, in
+ * input and output pieces of random sizes, so that inflate_fast () copies
+ * matches out of the window of the earlier pieces, and compared with
+ * <plain>. With [rounds], the decode speed is printed.
+ */
+
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/Decompress.h>
+#include <Library/Lz4Lib.h>
+#include <Library/MemoryAllocationLib.h>
+
+#include "HostLib.h"
+#include "zlib.h"
+
+#define TEST_TRUNCATIONS 20
+#define GZIP_TRAILER_SIZE 8
+#define GZIP_HEADER_SIZE 10
+#define GZIP_FNAME 0x08
+#define TEST_PIECE_RUNS 4
+
+STATIC UINT32 TestSeed;
+
+STATIC voidpf
+TestZalloc (voidpf Opaque, uInt Items, uInt Size)
+{
+  return AllocateZeroPool ((UINTN)Items * Size);
+}
+
+STATIC VOID
+TestZfree (voidpf Opaque, voidpf Address)
+{
+  FreePool (Address);
+}
+
+/* A random piece size: mostly small, sometimes up to 64 KB */
+STATIC UINTN
+TestPieceSize (VOID)
+{
+  UINT32 Random = HostRandom (&TestSeed);
+
+  return 1 + (Random & 0x100 ? Random % 65536 : Random % 600);
+}
+
+/* Inflates the deflate data of a gzip image in pieces of random sizes */
+STATIC BOOLEAN
+TestInflatePieces (UINT8 *Image,
+                   UINTN ImageSize,
+                   CONST UINT8 *Plain,
+                   UINTN PlainSize,
+                   UINT8 *Out,
+                   UINTN OutSize)
+{
+  z_stream Stream;
+  UINTN Header = GZIP_HEADER_SIZE;
+  UINTN Piece;
+  int Rc = Z_OK;
+
+  if (Image[3] & GZIP_FNAME) {
+    while (Header < ImageSize && Image[Header]) {
+      Header++;
+    }
+    Header++;
+  }
+
+  SetMem (&Stream, sizeof (Stream), 0);
+  Stream.zalloc = TestZalloc;
+  Stream.zfree = TestZfree;
+  if (inflateInit2 (&Stream, -MAX_WBITS) != Z_OK) {
+    HostPrint ("inflateInit2 failed\n");
+    return FALSE;
+  }
+  Stream.next_in = Image + Header;
+  Stream.next_out = Out;
+  while (Rc == Z_OK) {
+    Piece = TestPieceSize ();
+    Stream.avail_in = MIN (Piece, Image + ImageSize - Stream.next_in);
+    Piece = TestPieceSize ();
+    Stream.avail_out = MIN (Piece, Out + OutSize - Stream.next_out);
+    Rc = inflate (&Stream, Z_NO_FLUSH);
+    if (Rc == Z_BUF_ERROR &&
+        Stream.next_in < Image + ImageSize &&
+        Stream.next_out < Out + OutSize) {
+      Rc = Z_OK;
+    }
+  }
+  inflateEnd (&Stream);
+
+  if (Rc != Z_STREAM_END ||
+      Stream.total_out != PlainSize ||
+      CompareMem (Out, Plain, PlainSize)) {
+    HostPrint ("inflate in pieces: %d, %lu bytes, which differ from the %lu "
+               "plain ones\n", Rc, (UINT64)Stream.total_out,
+               (UINT64)PlainSize);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+STATIC VOID
+TestBenchmark (CONST KERNEL_DECOMPRESSOR *Decompressor,
+               UINT8 *Image,
+               UINTN ImageSize,
+               UINT8 *Out,
+               UINTN OutSize,
+               UINT32 Rounds)
+{
+  UINT64 Start;
+  UINT64 Time;
+  unsigned int Pos;
+  unsigned int OutLen = 0;
+  UINT32 Round;
+
+  Start = HostTimeNs ();
+  for (Round = 0; Round < Rounds; Round++) {
+    Decompressor->Decompress (Image, ImageSize, Out, OutSize, &Pos, &OutLen);
+  }
+  Time = HostTimeNs () - Start;
+
+  HostPrint ("%a: %lu -> %u bytes in %lu us, %lu MB/s\n", Decompressor->Name,
+             (UINT64)ImageSize, OutLen, Time / Rounds / 1000,
+             Time ? (UINT64)OutLen * Rounds * 1000 / Time : 0);
+}
+
+int
+main (int Argc, char **Argv)
+{
+  CONST KERNEL_DECOMPRESSOR *Decompressor;
+  UINT8 *Plain;
+  UINT8 *Image;
+  UINT8 *Out;
+  UINTN PlainSize;
+  UINTN ImageSize;
+  UINTN OutSize;
+  UINTN End;
+  UINTN DataEnd;
+  UINTN Cut;
+  UINTN Index;
+  unsigned int Pos = 0;
+  unsigned int OutLen = 0;
+  BOOLEAN Legacy;
+
+  if (Argc < 5) {
+    HostPrint ("usage: %a <plain> <image> <name> <end> [rounds]\n", Argv[0]);
+    return 1;
+  }
+  Plain = HostLoadFile (Argv[1], &PlainSize);
+  Image = HostLoadFile (Argv[2], &ImageSize);
+  if (!Plain ||
+      !Image) {
+    HostPrint ("cannot load %a or %a\n", Argv[1], Argv[2]);
+    return 1;
+  }
+  End = HostStrToUintn (Argv[4]);
+  TestSeed = PlainSize;
+
+  Decompressor = get_kernel_decompressor (Image, ImageSize);
+  if (!Decompressor ||
+      AsciiStrCmp (Decompressor->Name, Argv[3])) {
+    HostPrint ("decompressor %a chosen for %a\n",
+               Decompressor ? Decompressor->Name : "none", Argv[3]);
+    return 1;
+  }
+  Legacy = ReadUnaligned32 ((UINT32 *)Image) == LZ4_LEGACY_MAGIC;
+
+  /* The decompressors want more room than the compressed size, as the
+   * kernel load region has. The buffer is exact so the sanitizers see any
+   * write past it.
+   */
+  OutSize = MAX (PlainSize, ImageSize + 1);
+  Out = AllocatePool (OutSize);
+  if (!Out) {
+    HostPrint ("out of memory\n");
+    return 1;
+  }
+
+  if (Decompressor->Decompress (Image, ImageSize, Out, OutSize, &Pos,
+                                &OutLen)) {
+    HostPrint ("%a failed\n", Decompressor->Name);
+    return 1;
+  }
+  if (OutLen != PlainSize ||
+      CompareMem (Out, Plain, PlainSize)) {
+    HostPrint ("%a gave %u bytes, which differ from the %lu plain ones\n",
+               Decompressor->Name, OutLen, (UINT64)PlainSize);
+    return 1;
+  }
+  if (Pos != End) {
+    HostPrint ("%a ends at %u, expected %lu\n", Decompressor->Name, Pos,
+               (UINT64)End);
+    return 1;
+  }
+
+  DataEnd = End;
+  if (is_gzip_package (Image, ImageSize)) {
+    DataEnd -= GZIP_TRAILER_SIZE;
+    for (Index = 0; Index < TEST_PIECE_RUNS; Index++) {
+      if (!TestInflatePieces (Image, ImageSize, Plain, PlainSize, Out,
+                              OutSize)) {
+        return 1;
+      }
+    }
+  }
+  for (Index = 0; !Legacy && Index < TEST_TRUNCATIONS; Index++) {
+    Cut = HostRandom (&TestSeed) % (DataEnd - 1) + 1;
+    if (!Decompressor->Decompress (Image, Cut, Out, OutSize, &Pos,
+                                   &OutLen)) {
+      HostPrint ("%a decoded the image cut to %lu bytes\n",
+                 Decompressor->Name, (UINT64)Cut);
+      return 1;
+    }
+  }
+
+  if (Argc > 5) {
+    TestBenchmark (Decompressor, Image, ImageSize, Out, OutSize,
+                   HostStrToUintn (Argv[5]));
+  }
+
+  FreePool (Out);
+  FreePool (Image);
+  FreePool (Plain);
+  return 0;
+}
@@ -0,0 +1,776 @@
+/* Copyright (c) 2021, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Replays sparse image downloads through the fastboot data path.
+ *
+ * Usage: fastboot_sparse_stream_test_app <sparse> <raw> <seed> [runs [lz4]]
+ *
+ * FastbootCmds.c is built into the test, with the USB device, the partition
+ * table and the disks replaced by the mocks below. Each run downloads
+ * <sparse> with "download" in transfers of random sizes generated from
+ * <seed>, each completed through DataReady () as the USB driver does, and
+ * flashes it with "flash". The image is streamed to the partition while it
+ * is downloaded ("oem sparse-stream"), and on disks filled with a marker it
+ * is also flashed after the download as without streaming. The streamed
+ * partition must read back as <raw> on a zeroed disk and byte for byte as
+ * the one flashed after the download on the others, for each kind of erase
+ * support of the disk. The CRC chunks of <sparse> must match, and it must
+ * fail to flash with a CRC value or data a CRC chunk covers changed. An
+ * image of FILL chunks of a few blocks each, covering the disk, must be
+ * written in about one call per MAX_WRITE_SIZE of each run of equal values.
+ *
+ * <lz4> is <sparse> compressed by the lz4 tool. It is downloaded the same
+ * ways after "oem download-compression lz4", decoded as it arrives, and
+ * must give the same partitions. Downloads of it truncated or with a byte
+ * changed must fail, and cancelling it must leave nothing behind that
+ * breaks the next download.
+ */
+
+#include "FastbootCmds.c"
+
+#include "HostLib.h"
+#include "HostUefi.h"
+
+#define TEST_BLOCK_SIZE 4096
+#define TEST_DOWNLOAD_SIZE (64 * 1024 * 1024)
+#define TEST_MARKER 0x5A
+#define TEST_FILL_RUNS 3
+#define TEST_FILL_CHUNK_BLOCKS 8
+
+typedef struct {
+  CONST CHAR8 *Name;
+  HOST_ERASE Erase;
+  HOST_DISK *Disk;
+  EFI_PARTITION_ENTRY Entry;
+} TEST_PARTITION;
+
+STATIC TEST_PARTITION TestPartitions[] = {
+  { "sparse_noerase", HOST_ERASE_NONE },
+  { "sparse_erase", HOST_ERASE_ZERO },
+  { "sparse_stale", HOST_ERASE_STALE },
+};
+
+STATIC EFI_USB_DEVICE_PROTOCOL TestUsb;
+STATIC FastbootDeviceData TestFbd;
+STATIC CHAR8 TestTxBuffer[MAX_RSP_SIZE];
+STATIC CHAR8 TestResponse[MAX_RSP_SIZE + 1];
+STATIC UINT8 *TestRxBuffer;
+STATIC UINTN TestRxSize;
+STATIC UINT32 TestSeed;
+STATIC UINT64 TestTransfers;
+STATIC UINT64 TestFillChunks;
+STATIC UINT64 TestFillWrites;
+
+struct StoragePartInfo Ptable[MAX_LUNS];
+struct PartitionEntry PtnEntries[MAX_NUM_PARTITIONS];
+
+/* Queues a receive on ENDPOINT_IN, anything else is a response */
+STATIC EFI_STATUS
+TestUsbSend (IN UINT8 EndpointIndex, IN UINTN Size, IN VOID *Buffer)
+{
+  if (EndpointIndex == ENDPOINT_IN) {
+    TestRxBuffer = Buffer;
+    TestRxSize = Size;
+    return EFI_SUCCESS;
+  }
+
+  Size = MIN (Size, MAX_RSP_SIZE);
+  CopyMem (TestResponse, Buffer, Size);
+  TestResponse[Size] = '\0';
+  return EFI_SUCCESS;
+}
+
+FastbootDeviceData *
+GetFastbootDeviceData (VOID)
+{
+  return &TestFbd;
+}
+
+UINT32
+GetMaxLuns ()
+{
+  return 1;
+}
+
+UINT64
+GetPartitionSize (EFI_BLOCK_IO_PROTOCOL *BlockIo)
+{
+  return (BlockIo->Media->LastBlock + 1) * BlockIo->Media->BlockSize;
+}
+
+/* LinuxLoaderLib's version without its NAND and BlockIo2 paths, which the
+ * disks of the test do not have
+ */
+EFI_STATUS
+WriteBlockToPartition (EFI_BLOCK_IO_PROTOCOL *BlockIo,
+                       IN EFI_HANDLE *Handle,
+                       IN UINT64 Offset,
+                       IN UINT64 Size,
+                       IN VOID *Image)
+{
+  UINT32 BlockSize = BlockIo->Media->BlockSize;
+  UINT64 Whole = Size - Size % BlockSize;
+  UINT8 *Last;
+  EFI_STATUS Status = EFI_SUCCESS;
+
+  if (Whole) {
+    Status = BlockIo->WriteBlocks (BlockIo, BlockIo->Media->MediaId, Offset,
+                                   Whole, Image);
+  }
+  if (Status != EFI_SUCCESS ||
+      Whole == Size) {
+    return Status;
+  }
+
+  Last = AllocatePool (BlockSize);
+  if (!Last) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  Offset += Whole / BlockSize;
+  Status = BlockIo->ReadBlocks (BlockIo, BlockIo->Media->MediaId, Offset,
+                                BlockSize, Last);
+  if (Status == EFI_SUCCESS) {
+    CopyMem (Last, (UINT8 *)Image + Whole, Size - Whole);
+    Status = BlockIo->WriteBlocks (BlockIo, BlockIo->Media->MediaId, Offset,
+                                   BlockSize, Last);
+  }
+  FreePool (Last);
+  return Status;
+}
+
+VOID
+GetPageSize (UINT32 *PageSize)
+{
+  *PageSize = EFI_PAGE_SIZE;
+}
+
+UINT32
+CheckRootDeviceType (VOID)
+{
+  return UFS;
+}
+
+VOID
+GetRootDeviceType (CHAR8 *StrDeviceType, UINT32 Len)
+{
+  AsciiStrnCpyS (StrDeviceType, Len, "UFS", AsciiStrLen ("UFS"));
+}
+
+UINT32
+GetAVBVersion ()
+{
+  return AVB_2;
+}
+
+BOOLEAN
+IsUnlocked (VOID)
+{
+  return TRUE;
+}
+
+BOOLEAN
+IsUnlockCritical (VOID)
+{
+  return TRUE;
+}
+
+BOOLEAN
+IsEnforcing (VOID)
+{
+  return TRUE;
+}
+
+BOOLEAN
+TargetBuildVariantUser (VOID)
+{
+  return FALSE;
+}
+
+BOOLEAN
+IsVirtualAbOtaSupported (VOID)
+{
+  return FALSE;
+}
+
+BOOLEAN
+IsDynamicPartitionSupport (VOID)
+{
+  return FALSE;
+}
+
+BOOLEAN
+PartitionHasMultiSlot (CONST CHAR16 *Pname)
+{
+  return FALSE;
+}
+
+EFI_STATUS
+HandleUsbEvents (VOID)
+{
+  return EFI_SUCCESS;
+}
+
+STATIC BOOLEAN
+TestSetup (UINT64 ImageSize)
+{
+  TEST_PARTITION *Part;
+  UINT64 Blocks = ImageSize / TEST_BLOCK_SIZE + 256;
+  UINTN Index;
+
+  TestUsb.Send = TestUsbSend;
+  TestFbd.UsbDeviceProtocol = &TestUsb;
+  TestFbd.gTxBuffer = TestTxBuffer;
+
+  for (Index = 0; Index < ARRAY_SIZE (TestPartitions); Index++) {
+    Part = &TestPartitions[Index];
+    Part->Disk = HostDiskCreate (TEST_BLOCK_SIZE, Blocks, 0, Part->Erase);
+    if (!Part->Disk) {
+      return FALSE;
+    }
+    AsciiStrToUnicodeStr (Part->Name, Part->Entry.PartitionName);
+    Part->Entry.EndingLBA = Blocks - 1;
+    HostInstallProtocol (&Part->Disk->Handle, &gEfiPartitionRecordGuid,
+                         &Part->Entry);
+    Ptable[0].HandleInfoList[Index].Handle = Part->Disk->Handle;
+    Ptable[0].HandleInfoList[Index].BlkIo = &Part->Disk->BlockIo;
+    Ptable[0].MaxHandles++;
+  }
+
+  /* What FastbootCmdsInit and FastbootCommandSetup set up */
+  avb_crc32_init ();
+  MaxDownLoadSize = TEST_DOWNLOAD_SIZE;
+  mUsbDataBuffer = AllocatePages (EFI_SIZE_TO_PAGES (MaxDownLoadSize));
+  mFlashDataBuffer = AllocatePages (EFI_SIZE_TO_PAGES (MaxDownLoadSize));
+  FlashBufCount = 0;
+  return mUsbDataBuffer && mFlashDataBuffer;
+}
+
+STATIC BOOLEAN
+TestIsFilled (CONST UINT8 *Data, UINT64 Size, UINT8 Fill)
+{
+  while (Size--) {
+    if (*Data++ != Fill) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+/* Runs a command handler, its response has to start with Expected */
+STATIC BOOLEAN
+TestCommand (VOID (*Handler) (CONST CHAR8 *, VOID *, UINT32),
+             CONST CHAR8 *Arg,
+             CONST CHAR8 *Expected)
+{
+  TestResponse[0] = '\0';
+  Handler (Arg, NULL, 0);
+  if (AsciiStrnCmp (TestResponse, Expected, AsciiStrLen (Expected))) {
+    HostPrint ("command %a: got \"%a\", expected \"%a\"\n", Arg, TestResponse,
+               Expected);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/* The transfers complete with random sizes up to the queued one: a few
+ * bytes, up to a page, up to one or a few MB, or all of it.
+ */
+STATIC UINTN
+TestTransferSize (UINTN Queued)
+{
+  STATIC CONST UINTN Limits[] = { 64, EFI_PAGE_SIZE, SIZE_1MB, SIZE_4MB };
+  UINT32 Pick = HostRandom (&TestSeed) % (ARRAY_SIZE (Limits) + 1);
+  UINTN Size;
+
+  if (Pick == ARRAY_SIZE (Limits)) {
+    return Queued;
+  }
+  Size = 1 + HostRandom (&TestSeed) % Limits[Pick];
+  return MIN (Queued, Size);
+}
+
+/* "download" of Size bytes of Image, whose final response has to start
+ * with Expected. The first receive is queued when the DATA response has
+ * been sent, then by AcceptData as each one completes.
+ */
+STATIC BOOLEAN
+TestDownload (CONST UINT8 *Image, UINT64 Size, CONST CHAR8 *Expected)
+{
+  CHAR8 Arg[16];
+  UINT64 Sent = 0;
+  UINTN Transfer;
+  UINTN Timers = 0;
+
+  AsciiSPrint (Arg, sizeof (Arg), "%08lx", Size);
+  if (!TestCommand (CmdDownload, Arg, "DATA")) {
+    return FALSE;
+  }
+
+  TestRxBuffer = NULL;
+  GetFastbootDeviceData ()->UsbDeviceProtocol->Send (
+      ENDPOINT_IN, GetXfrSize (), FastbootDloadBuffer ());
+  TestResponse[0] = '\0';
+  while (Sent < Size) {
+    if (!TestRxBuffer) {
+      HostPrint ("no receive queued after %lu of %lu bytes\n", Sent, Size);
+      return FALSE;
+    }
+    Transfer = TestTransferSize (MIN (TestRxSize, Size - Sent));
+    CopyMem (TestRxBuffer, Image + Sent, Transfer);
+    TestRxBuffer = NULL;
+    Sent += Transfer;
+    TestTransfers++;
+    DataReady (Transfer, FastbootDloadBuffer ());
+  }
+
+  /* The OKAY waits for the flash started by the download */
+  while (!TestResponse[0] &&
+         HostDispatchTimers ()) {
+    Timers++;
+  }
+  if (AsciiStrnCmp (TestResponse, Expected, AsciiStrLen (Expected))) {
+    HostPrint ("download: got \"%a\" after %lu timers\n", TestResponse, Timers);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/* Downloads Image, as LZ4 frame with Compressed, and flashes it to Part */
+STATIC BOOLEAN
+TestFlash (TEST_PARTITION *Part,
+           CONST UINT8 *Image,
+           UINT64 Size,
+           BOOLEAN Compressed,
+           BOOLEAN Stream,
+           UINT8 Fill)
+{
+  HOST_DISK *Disk = Part->Disk;
+
+  SetMem (Disk->Data, Disk->Size, Fill);
+  return TestCommand (CmdOemDownloadCompression, Compressed ? "lz4" : "none",
+                      "OKAY") &&
+         TestCommand (CmdOemSparseStream, Stream ? Part->Name : "", "OKAY") &&
+         TestDownload (Image, Size, "OKAY") &&
+         TestCommand (CmdFlash, Part->Name, "OKAY");
+}
+
+/* Downloads a damaged frame, streamed or not. It has to fail, or decode to
+ * Image when the change did not matter, e.g. a match offset moved within a
+ * run of zeros.
+ */
+STATIC BOOLEAN
+TestBadFrame (TEST_PARTITION *Part,
+              CONST UINT8 *Frame,
+              UINT64 Size,
+              CONST UINT8 *Image,
+              UINT64 ImageSize)
+{
+  if (!TestCommand (CmdOemDownloadCompression, "lz4", "OKAY") ||
+      !TestCommand (CmdOemSparseStream,
+                    (HostRandom (&TestSeed) & 1) ? Part->Name : "", "OKAY") ||
+      !TestDownload (Frame, Size, "")) {
+    return FALSE;
+  }
+  if (!AsciiStrnCmp (TestResponse, "FAIL", 4)) {
+    return TRUE;
+  }
+  return mNumDataBytes == ImageSize &&
+         !CompareMem (mUsbDataBuffer, Image, ImageSize) &&
+         TestCommand (CmdFlash, Part->Name, "OKAY");
+}
+
+/* Offset and size of the data of a random chunk of Type in the sparse
+ * Image, FALSE if it has none.
+ */
+STATIC BOOLEAN
+TestPickChunk (CONST UINT8 *Image,
+               UINT64 Size,
+               UINT16 Type,
+               UINT64 *DataPos,
+               UINT64 *DataSize)
+{
+  CONST sparse_header_t *Header = (CONST sparse_header_t *)Image;
+  chunk_header_t Chunk;
+  UINT64 Pos = Header->file_hdr_sz;
+  UINT32 Found = 0;
+  UINT32 Index;
+
+  for (Index = 0; Index < Header->total_chunks && Pos < Size; Index++) {
+    CopyMem (&Chunk, Image + Pos, sizeof (Chunk));
+    if (Chunk.chunk_type == Type &&
+        Chunk.total_sz > Header->chunk_hdr_sz &&
+        HostRandom (&TestSeed) % ++Found == 0) {
+      *DataPos = Pos + Header->chunk_hdr_sz;
+      *DataSize = Chunk.total_sz - Header->chunk_hdr_sz;
+    }
+    Pos += Chunk.total_sz;
+  }
+  return Found != 0;
+}
+
+/* Downloads Image with a CRC chunk that does not match, streamed or not.
+ * The download or the flash has to fail.
+ */
+STATIC BOOLEAN
+TestBadCrc (TEST_PARTITION *Part,
+            CONST UINT8 *Image,
+            UINT64 Size,
+            BOOLEAN Stream)
+{
+  if (!TestCommand (CmdOemDownloadCompression, "none", "OKAY") ||
+      !TestCommand (CmdOemSparseStream, Stream ? Part->Name : "", "OKAY") ||
+      !TestDownload (Image, Size, "")) {
+    return FALSE;
+  }
+  if (!AsciiStrnCmp (TestResponse, "FAIL", 4)) {
+    return TRUE;
+  }
+  return TestCommand (CmdFlash, Part->Name, "FAIL");
+}
+
+/* Cancels a compressed download after its first transfer, as the USB
+ * driver does on a reset. Nothing of it may stay active.
+ */
+STATIC BOOLEAN
+TestCancel (TEST_PARTITION *Part, CONST UINT8 *Frame, UINT64 Size)
+{
+  CHAR8 Arg[16];
+
+  AsciiSPrint (Arg, sizeof (Arg), "%08lx", Size);
+  if (!TestCommand (CmdOemDownloadCompression, "lz4", "OKAY") ||
+      !TestCommand (CmdOemSparseStream,
+                    (HostRandom (&TestSeed) & 1) ? Part->Name : "", "OKAY") ||
+      !TestCommand (CmdDownload, Arg, "DATA")) {
+    return FALSE;
+  }
+
+  TestRxBuffer = NULL;
+  GetFastbootDeviceData ()->UsbDeviceProtocol->Send (
+      ENDPOINT_IN, GetXfrSize (), FastbootDloadBuffer ());
+  if (Size > 1) {
+    TestRxSize = TestTransferSize (MIN (TestRxSize, Size - 1));
+    CopyMem (TestRxBuffer, Frame, TestRxSize);
+    DataReady (TestRxSize, FastbootDloadBuffer ());
+  }
+  FastbootDownloadCancelled ();
+
+  return FastbootCurrentState () == ExpectCmdState &&
+         !DloadLz4Active &&
+         FastbootDloadBuffer () == (VOID *)mUsbDataBuffer;
+}
+
+/* Flashes Image, plain or compressed, to Part as the streamed and the
+ * non-streamed paths do and checks the results against Raw.
+ */
+STATIC BOOLEAN
+TestImage (TEST_PARTITION *Part,
+           CONST UINT8 *Image,
+           UINT64 Size,
+           BOOLEAN Compressed,
+           CONST UINT8 *Raw,
+           UINT64 RawSize,
+           UINT8 *Expected)
+{
+  HOST_DISK *Disk = Part->Disk;
+  CONST CHAR8 *Kind = Compressed ? "lz4 " : "";
+
+  if (!TestFlash (Part, Image, Size, Compressed, TRUE, 0)) {
+    HostPrint ("%a: %astreaming to a zeroed disk failed\n", Part->Name, Kind);
+    return FALSE;
+  }
+  if (CompareMem (Disk->Data, Raw, RawSize) ||
+      !TestIsFilled (Disk->Data + RawSize, Disk->Size - RawSize, 0)) {
+    HostPrint ("%a: %astreamed image differs from the raw image\n",
+               Part->Name, Kind);
+    return FALSE;
+  }
+
+  if (!TestFlash (Part, Image, Size, Compressed, FALSE, TEST_MARKER)) {
+    HostPrint ("%a: %aflashing after the download failed\n", Part->Name,
+               Kind);
+    return FALSE;
+  }
+  CopyMem (Expected, Disk->Data, Disk->Size);
+  if (!TestFlash (Part, Image, Size, Compressed, TRUE, TEST_MARKER)) {
+    HostPrint ("%a: %astreaming failed\n", Part->Name, Kind);
+    return FALSE;
+  }
+  if (CompareMem (Disk->Data, Expected, Disk->Size)) {
+    HostPrint ("%a: %astreamed partition differs from the one flashed "
+               "after the download\n", Part->Name, Kind);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/* Changes a bit of a CRC value, or of RAW or FILL data, which the CRC
+ * chunks after it cover. The changed image must not flash, streamed or
+ * not, and the image must flash again afterwards.
+ */
+STATIC BOOLEAN
+TestCrcChunks (TEST_PARTITION *Part,
+               UINT8 *Sparse,
+               UINT64 SparseSize,
+               CONST UINT8 *Raw,
+               UINT64 RawSize,
+               UINT8 *Expected)
+{
+  STATIC CONST UINT16 Types[] = { CHUNK_TYPE_CRC, CHUNK_TYPE_RAW,
+                                  CHUNK_TYPE_FILL };
+  UINT64 DataPos;
+  UINT64 DataSize;
+  UINT64 Pos;
+  UINTN Index;
+  UINT8 Flip;
+
+  for (Index = 0; Index < ARRAY_SIZE (Types); Index++) {
+    if (!TestPickChunk (Sparse, SparseSize, Types[Index], &DataPos,
+                        &DataSize)) {
+      continue;
+    }
+    Pos = DataPos + HostRandom (&TestSeed) % DataSize;
+    Flip = 1 << (HostRandom (&TestSeed) % 8);
+    Sparse[Pos] ^= Flip;
+    if (!TestBadCrc (Part, Sparse, SparseSize, FALSE) ||
+        !TestBadCrc (Part, Sparse, SparseSize, TRUE)) {
+      HostPrint ("%a: image with chunk %x changed at %lu did not fail\n",
+                 Part->Name, Types[Index], Pos);
+      return FALSE;
+    }
+    Sparse[Pos] ^= Flip;
+  }
+  return TestImage (Part, Sparse, SparseSize, FALSE, Raw, RawSize, Expected);
+}
+
+/* Sparse image of Blocks blocks of FILL chunks of up to
+ * TEST_FILL_CHUNK_BLOCKS blocks, in runs with one value each: nonzero, zero,
+ * nonzero. Raw gets the expanded image and RunBlocks the blocks of each run.
+ */
+STATIC UINT8 *
+TestFillImage (UINT32 Blocks,
+               UINT8 *Raw,
+               UINT32 *RunBlocks,
+               UINT64 *Size,
+               UINT32 *Chunks)
+{
+  STATIC CONST UINT32 Values[TEST_FILL_RUNS] = { 0x5AA5C33C, 0, 0xFFFFFFFF };
+  sparse_header_t Header = { SPARSE_HEADER_MAGIC, 1, 0,
+                             sizeof (sparse_header_t), sizeof (chunk_header_t),
+                             TEST_BLOCK_SIZE, Blocks, 0, 0 };
+  chunk_header_t Chunk = { CHUNK_TYPE_FILL, 0, 0,
+                           sizeof (chunk_header_t) + sizeof (UINT32) };
+  UINT8 *Image;
+  UINT8 *Pos;
+  UINT32 Run;
+  UINT32 Left;
+
+  Image = AllocatePool (sizeof (Header) +
+                        (UINT64)Blocks * (sizeof (Chunk) + sizeof (UINT32)));
+  if (!Image) {
+    return NULL;
+  }
+  Pos = Image + sizeof (Header);
+  for (Run = 0; Run < TEST_FILL_RUNS; Run++) {
+    RunBlocks[Run] = Run == TEST_FILL_RUNS - 1 ?
+                     Blocks : 1 + HostRandom (&TestSeed) % (Blocks / 2);
+    Blocks -= RunBlocks[Run];
+    for (Left = RunBlocks[Run]; Left; Left -= Chunk.chunk_sz) {
+      Chunk.chunk_sz = 1 + HostRandom (&TestSeed) % TEST_FILL_CHUNK_BLOCKS;
+      Chunk.chunk_sz = MIN (Chunk.chunk_sz, Left);
+      CopyMem (Pos, &Chunk, sizeof (Chunk));
+      CopyMem (Pos + sizeof (Chunk), &Values[Run], sizeof (UINT32));
+      Pos += sizeof (Chunk) + sizeof (UINT32);
+      SetMem32 (Raw, Chunk.chunk_sz * TEST_BLOCK_SIZE, Values[Run]);
+      Raw += Chunk.chunk_sz * TEST_BLOCK_SIZE;
+      Header.total_chunks++;
+    }
+  }
+  CopyMem (Image, &Header, sizeof (Header));
+  *Size = Pos - Image;
+  *Chunks = Header.total_chunks;
+  return Image;
+}
+
+/* Flashes a FILL image covering Part, streamed and not. Each run may take
+ * one write per MAX_WRITE_SIZE, and three more for the erase probe and the
+ * blocks at the ends of an erased zero run, where one write per sparse
+ * block would take one per chunk or more.
+ */
+STATIC BOOLEAN
+TestFillImageWrites (TEST_PARTITION *Part, UINT8 *Raw)
+{
+  HOST_DISK *Disk = Part->Disk;
+  UINT32 Blocks = Disk->Size / TEST_BLOCK_SIZE;
+  UINT32 RunBlocks[TEST_FILL_RUNS];
+  UINT64 Unit = MAX_WRITE_SIZE - MAX_WRITE_SIZE % TEST_BLOCK_SIZE;
+  UINT64 Limit = 0;
+  UINT64 Writes;
+  UINT64 Size;
+  UINT32 Chunks;
+  UINT32 Run;
+  UINT8 *Image;
+  UINTN Stream;
+  BOOLEAN Ok = TRUE;
+
+  Image = TestFillImage (Blocks, Raw, RunBlocks, &Size, &Chunks);
+  if (!Image) {
+    HostPrint ("out of memory\n");
+    return FALSE;
+  }
+  for (Run = 0; Run < TEST_FILL_RUNS; Run++) {
+    Limit += ((UINT64)RunBlocks[Run] * TEST_BLOCK_SIZE + Unit - 1) / Unit + 3;
+  }
+
+  for (Stream = 0; Stream < 2 && Ok; Stream++) {
+    Writes = Disk->Writes;
+    if (!TestFlash (Part, Image, Size, FALSE, Stream, TEST_MARKER)) {
+      HostPrint ("%a: FILL image failed\n", Part->Name);
+      Ok = FALSE;
+    } else if (CompareMem (Disk->Data, Raw, Disk->Size)) {
+      HostPrint ("%a: FILL image differs from the raw image\n", Part->Name);
+      Ok = FALSE;
+    } else if (Disk->Writes - Writes > Limit) {
+      HostPrint ("%a: FILL image of %u chunks in %u runs took %lu writes, "
+                 "more than %lu\n", Part->Name, Chunks, TEST_FILL_RUNS,
+                 Disk->Writes - Writes, Limit);
+      Ok = FALSE;
+    }
+    TestFillChunks += Chunks;
+    TestFillWrites += Disk->Writes - Writes;
+  }
+  FreePool (Image);
+  return Ok;
+}
+
+int
+main (int Argc, char **Argv)
+{
+  UINT8 *Sparse;
+  UINT8 *Raw;
+  UINT8 *Lz4 = NULL;
+  UINT8 *Expected;
+  UINTN SparseSize;
+  UINTN RawSize;
+  UINTN Lz4Size = 0;
+  UINTN Pos;
+  UINT8 Flip;
+  UINT32 Runs = 1;
+  UINT32 Run;
+  UINTN Index;
+  TEST_PARTITION *Part;
+
+  if (Argc < 4) {
+    HostPrint ("usage: %a <sparse> <raw> <seed> [runs [lz4]]\n", Argv[0]);
+    return 1;
+  }
+  Sparse = HostLoadFile (Argv[1], &SparseSize);
+  Raw = HostLoadFile (Argv[2], &RawSize);
+  if (!Sparse ||
+      !Raw) {
+    HostPrint ("cannot load %a or %a\n", Argv[1], Argv[2]);
+    return 1;
+  }
+  TestSeed = HostStrToUintn (Argv[3]);
+  if (Argc > 4) {
+    Runs = HostStrToUintn (Argv[4]);
+  }
+  if (Argc > 5) {
+    Lz4 = HostLoadFile (Argv[5], &Lz4Size);
+    if (!Lz4) {
+      HostPrint ("cannot load %a\n", Argv[5]);
+      return 1;
+    }
+  }
+
+  if (!TestSetup (RawSize)) {
+    HostPrint ("out of memory\n");
+    return 1;
+  }
+  Expected = AllocatePool (TestPartitions[0].Disk->Size);
+  if (!Expected) {
+    HostPrint ("out of memory\n");
+    return 1;
+  }
+
+  for (Run = 0; Run < Runs; Run++) {
+    for (Index = 0; Index < ARRAY_SIZE (TestPartitions); Index++) {
+      Part = &TestPartitions[Index];
+      if (!TestImage (Part, Sparse, SparseSize, FALSE, Raw, RawSize,
+                      Expected) ||
+          !TestCrcChunks (Part, Sparse, SparseSize, Raw, RawSize,
+                          Expected) ||
+          !TestFillImageWrites (Part, Expected)) {
+        return 1;
+      }
+      if (!Lz4) {
+        continue;
+      }
+      if (!TestImage (Part, Lz4, Lz4Size, TRUE, Raw, RawSize, Expected)) {
+        return 1;
+      }
+
+      /* The frame ends with its content checksum, a truncated one cannot
+       * decode. The plain download that follows must work.
+       */
+      Pos = 1 + HostRandom (&TestSeed) % (Lz4Size - 1);
+      if (!TestBadFrame (Part, Lz4, Pos, NULL, 0)) {
+        HostPrint ("%a: lz4 download truncated to %lu did not fail\n",
+                   Part->Name, Pos);
+        return 1;
+      }
+      Pos = HostRandom (&TestSeed) % Lz4Size;
+      Flip = 1 << (HostRandom (&TestSeed) % 8);
+      Lz4[Pos] ^= Flip;
+      if (!TestBadFrame (Part, Lz4, Lz4Size, Sparse, SparseSize)) {
+        HostPrint ("%a: lz4 download changed at %lu did not fail\n",
+                   Part->Name, Pos);
+        return 1;
+      }
+      Lz4[Pos] ^= Flip;
+      if (!TestCancel (Part, Lz4, Lz4Size)) {
+        HostPrint ("%a: cancelled lz4 download stays active\n", Part->Name);
+        return 1;
+      }
+      if (!TestImage (Part, Sparse, SparseSize, FALSE, Raw, RawSize,
+                      Expected)) {
+        return 1;
+      }
+    }
+  }
+
+  HostPrint ("%u runs, %lu transfers, %lu writes for %lu FILL chunks\n",
+             Runs, TestTransfers, TestFillWrites, TestFillChunks);
+  if (Lz4) {
+    FreePool (Lz4);
+  }
+  FreePool (Expected);
+  FreePool (Raw);
+  FreePool (Sparse);
+  return 0;
+}
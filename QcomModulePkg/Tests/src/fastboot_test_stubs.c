@@ -0,0 +1,85 @@
+/* Copyright (c) 2021, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Link stubs for the functions FastbootCmds.c references but the fastboot
+ * tests do not reach: booting, device state, partition table updates,
+ * charging, display and the verify-after-flash digests. They abort if they
+ * are called after all. This file includes none of their headers so that it
+ * does not need their types.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define HOST_UNUSED(Name)                                                      \
+  void Name (void);                                                            \
+  void Name (void)                                                             \
+  {                                                                            \
+    fprintf (stderr, "%s is not expected to be called\n", #Name);              \
+    abort ();                                                                  \
+  }
+
+HOST_UNUSED (AllocateUnSafeStackPtr)
+HOST_UNUSED (BoardHwPlatformName)
+HOST_UNUSED (BoardPlatformChipVersion)
+HOST_UNUSED (BoardSerialNum)
+HOST_UNUSED (BootLinux)
+HOST_UNUSED (BootTraceKeepsPrevious)
+HOST_UNUSED (BootTraceName)
+HOST_UNUSED (BootTracePrevious)
+HOST_UNUSED (BootTraceSnapshot)
+HOST_UNUSED (EnableChargingScreen)
+HOST_UNUSED (EnumeratePartitions)
+HOST_UNUSED (ErasePartition)
+HOST_UNUSED (EraseUserKey)
+HOST_UNUSED (ExitMenuKeysDetection)
+HOST_UNUSED (FastbootUsbDeviceStop)
+HOST_UNUSED (GetDevInfo)
+HOST_UNUSED (GetPartitionCount)
+HOST_UNUSED (GetPartitionIndex)
+HOST_UNUSED (GetTimerCountms)
+HOST_UNUSED (InvalidatePartitionIndex)
+HOST_UNUSED (IsChargingScreenEnable)
+HOST_UNUSED (IsSecureBootEnabled)
+HOST_UNUSED (LoadImageAndAuth)
+HOST_UNUSED (PartitionVerifyMibibImage)
+HOST_UNUSED (RebootDevice)
+HOST_UNUSED (ResetDeviceState)
+HOST_UNUSED (ShutdownDevice)
+HOST_UNUSED (StoreDisplayCmdLine)
+HOST_UNUSED (StoreUserKey)
+HOST_UNUSED (TargetBatterySocOk)
+HOST_UNUSED (UfsGetSetBootLun)
+HOST_UNUSED (UpdateDevInfo)
+HOST_UNUSED (UpdatePartitionEntries)
+HOST_UNUSED (UpdatePartitionTable)
+HOST_UNUSED (avb_sha256_final)
+HOST_UNUSED (avb_sha256_final_ok)
+HOST_UNUSED (avb_sha256_init)
+HOST_UNUSED (avb_sha256_update)
@@ -0,0 +1,367 @@
+/* Copyright (c) 2021, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Differential test of the FdtRw edit batch.
+ *
+ * Usage: fdt_rw_test_app <dtb> <seed> <count> <pad> [rounds]
+ *
+ * Generates <count> property edits from <seed> and applies them to <dtb>,
+ * opened with <pad> bytes of free space, three ways: directly through
+ * libfdt, through FdtRw one edit at a time, and through FdtRw between
+ * FdtEditBegin () and FdtEditCommit (). The return code of every edit and
+ * the resulting blobs must be the same, and FdtPathOffset () must agree with
+ * fdt_path_offset () for every node afterwards. With [rounds], the time
+ * the sequential and the batched FdtRw paths take is printed.
+ */
+
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/FdtRw.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/PrintLib.h>
+#include <libfdt_env.h>
+#include <fdt.h>
+#include <libfdt.h>
+
+#include "HostLib.h"
+
+#define MAX_PATHS 100000
+#define MAX_PATH_LEN 512
+#define MAX_DEPTH 64
+#define MAX_VALUE 64
+
+typedef enum {
+  EditSetProp,
+  EditAppendProp,
+  EditAppendPropString,
+} EDIT_KIND;
+
+typedef struct {
+  EDIT_KIND Kind;
+  UINT32 Node;
+  CONST CHAR8 *Name;
+  UINT8 Val[MAX_VALUE];
+  INT32 Len;
+} EDIT;
+
+STATIC CONST CHAR8 *PropNames[] = {
+  "reg", "status", "compatible", "bootargs", "val", "x",
+  "ddr_device_type", "ddr_device_rank_ch0", "ddr_device_hbb_ch0_rank0",
+  "rng-seed", "kaslr-seed", "linux,initrd-start", "linux,initrd-end",
+  "granule", "ch0", "new-a", "new-b", "blob", "model", "e",
+};
+
+STATIC CHAR8 *Paths[MAX_PATHS];
+STATIC UINT32 NumPaths;
+
+STATIC INT32
+ApplyEdit (VOID *Fdt, EDIT *Edit, INT32 Offset, BOOLEAN Direct)
+{
+  if (Direct) {
+    switch (Edit->Kind) {
+    case EditSetProp:
+      return fdt_setprop (Fdt, Offset, Edit->Name, Edit->Val, Edit->Len);
+    case EditAppendProp:
+      return fdt_appendprop (Fdt, Offset, Edit->Name, Edit->Val, Edit->Len);
+    default:
+      return fdt_appendprop_string (Fdt, Offset, Edit->Name,
+                                    (CONST CHAR8 *)Edit->Val);
+    }
+  }
+
+  switch (Edit->Kind) {
+  case EditSetProp:
+    return FdtSetProp (Fdt, Offset, Edit->Name, Edit->Val, Edit->Len);
+  case EditAppendProp:
+    return FdtAppendProp (Fdt, Offset, Edit->Name, Edit->Val, Edit->Len);
+  default:
+    return FdtAppendPropString (Fdt, Offset, Edit->Name,
+                                (CONST CHAR8 *)Edit->Val);
+  }
+}
+
+/* Zeroes the padding after each property value, which libfdt leaves as is
+ * when a property shrinks
+ */
+STATIC VOID
+ZeroPropertyPadding (VOID *Fdt)
+{
+  INT32 Offset = 0;
+  INT32 Next;
+  UINT32 Tag;
+  struct fdt_property *Prop;
+  INT32 Len;
+
+  do {
+    Tag = fdt_next_tag (Fdt, Offset, &Next);
+    if (Tag == FDT_PROP) {
+      Prop = (struct fdt_property *)((CHAR8 *)Fdt + fdt_off_dt_struct (Fdt) +
+                                     Offset);
+      Len = fdt32_to_cpu (Prop->len);
+      SetMem (Prop->data + Len, FDT_TAGALIGN (Len) - Len, 0);
+    }
+    Offset = Next;
+  } while (Tag != FDT_END);
+}
+
+STATIC UINT32
+BlobEnd (VOID *Fdt)
+{
+  return fdt_off_dt_strings (Fdt) + fdt_size_dt_strings (Fdt);
+}
+
+STATIC VOID
+CollectPaths (VOID *Fdt)
+{
+  CHAR8 Path[MAX_PATH_LEN];
+  UINTN Lens[MAX_DEPTH];
+  INT32 Offset;
+  INT32 Depth = 0;
+  UINTN Len;
+
+  for (Offset = 0; Offset >= 0 && Depth >= 0 && NumPaths < MAX_PATHS;
+       Offset = fdt_next_node (Fdt, Offset, &Depth)) {
+    Len = Depth ? Lens[Depth - 1] : 0;
+    if (Depth) {
+      Len += AsciiSPrint (Path + Len, sizeof (Path) - Len, "/%a",
+                          fdt_get_name (Fdt, Offset, NULL));
+    }
+    Lens[Depth] = Len;
+    Paths[NumPaths++] = AllocateCopyPool (Depth ? Len + 1 : 2,
+                                          Depth ? Path : "/");
+  }
+}
+
+STATIC VOID
+GenerateEdits (EDIT *Edits, UINT32 Count, UINT32 Seed)
+{
+  UINT32 Index;
+  INT32 Byte;
+  EDIT *Edit;
+
+  for (Index = 0; Index < Count; Index++) {
+    Edit = &Edits[Index];
+    Edit->Kind = HostRandom (&Seed) % 3;
+    /* Most edits go to the first nodes, as on the boot path */
+    Edit->Node = (HostRandom (&Seed) % 4 == 0) ?
+                     HostRandom (&Seed) % NumPaths :
+                     HostRandom (&Seed) % 12 % NumPaths;
+    Edit->Name = PropNames[HostRandom (&Seed) %
+                             (sizeof (PropNames) / sizeof (*PropNames))];
+    Edit->Len = HostRandom (&Seed) % 24;
+    for (Byte = 0; Byte < Edit->Len; Byte++) {
+      Edit->Val[Byte] = 'a' + HostRandom (&Seed) % 26;
+    }
+    if (Edit->Kind == EditAppendPropString) {
+      Edit->Val[Edit->Len++] = '\0';
+    }
+  }
+}
+
+STATIC INT32
+CheckOffsets (VOID *Fdt)
+{
+  UINT32 Index;
+
+  for (Index = 0; Index < NumPaths; Index++) {
+    if (FdtPathOffset (Fdt, Paths[Index]) !=
+        fdt_path_offset (Fdt, Paths[Index])) {
+      HostPrint ("offset of %a wrong after commit\n", Paths[Index]);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+STATIC VOID
+Bench (VOID *In, VOID *Fdt, INT32 Size, EDIT *Edits, UINT32 Count,
+       UINT32 Rounds, UINTN InSize)
+{
+  UINT64 Start;
+  UINT64 Sequential;
+  UINT64 Batch;
+  UINT32 Round;
+  UINT32 Index;
+
+  Start = HostTimeNs ();
+  for (Round = 0; Round < Rounds; Round++) {
+    fdt_open_into (In, Fdt, Size);
+    /* Start from an empty first level node list, as the batch does */
+    FdtEditBegin (Fdt);
+    FdtEditCancel ();
+    for (Index = 0; Index < Count; Index++) {
+      ApplyEdit (Fdt, &Edits[Index],
+                 FdtPathOffset (Fdt, Paths[Edits[Index].Node]), FALSE);
+    }
+  }
+  Sequential = HostTimeNs () - Start;
+
+  Start = HostTimeNs ();
+  for (Round = 0; Round < Rounds; Round++) {
+    fdt_open_into (In, Fdt, Size);
+    FdtEditBegin (Fdt);
+    for (Index = 0; Index < Count; Index++) {
+      ApplyEdit (Fdt, &Edits[Index],
+                 FdtPathOffset (Fdt, Paths[Edits[Index].Node]), FALSE);
+    }
+    FdtEditCommit (Fdt);
+  }
+  Batch = HostTimeNs () - Start;
+
+  HostPrint ("blob %lu bytes, %u edits: sequential %lu us, batch %lu us\n",
+             (UINT64)InSize, Count, Sequential / Rounds / 1000,
+             Batch / Rounds / 1000);
+}
+
+int
+main (int Argc, char **Argv)
+{
+  VOID *In;
+  UINTN InSize;
+  UINT32 Seed;
+  UINT32 Count;
+  INT32 Size;
+  UINT32 Index;
+  INT32 Offset;
+  INT32 Len;
+  EDIT *Edits;
+  INT32 *RcRef;
+  INT32 *RcCur;
+  INT32 *RcBat;
+  VOID *Ref;
+  VOID *Cur;
+  VOID *Bat;
+
+  if (Argc < 5) {
+    HostPrint ("usage: %a <dtb> <seed> <count> <pad> [rounds]\n", Argv[0]);
+    return 2;
+  }
+
+  In = HostLoadFile (Argv[1], &InSize);
+  if (!In || fdt_check_header (In)) {
+    HostPrint ("cannot load %a\n", Argv[1]);
+    return 2;
+  }
+  Seed = HostStrToUintn (Argv[2]);
+  Count = HostStrToUintn (Argv[3]);
+  Size = InSize + HostStrToUintn (Argv[4]);
+
+  Edits = AllocateZeroPool (Count * sizeof (EDIT));
+  RcRef = AllocatePool (Count * sizeof (INT32));
+  RcCur = AllocatePool (Count * sizeof (INT32));
+  RcBat = AllocatePool (Count * sizeof (INT32));
+  Ref = AllocatePool (Size);
+  Cur = AllocatePool (Size);
+  Bat = AllocatePool (Size);
+  if (!Edits || !RcRef || !RcCur || !RcBat || !Ref || !Cur || !Bat) {
+    HostPrint ("out of memory\n");
+    return 2;
+  }
+
+  CollectPaths (In);
+  GenerateEdits (Edits, Count, Seed);
+
+  /* Reference: libfdt, the offset looked up again for every edit */
+  fdt_open_into (In, Ref, Size);
+  for (Index = 0; Index < Count; Index++) {
+    Offset = fdt_path_offset (Ref, Paths[Edits[Index].Node]);
+    /* fdt_appendprop_string () of an empty property is an append of the
+     * string, which is what FdtAppendPropString () does
+     */
+    if (Edits[Index].Kind == EditAppendPropString &&
+        fdt_getprop (Ref, Offset, Edits[Index].Name, &Len) && !Len) {
+      Edits[Index].Kind = EditAppendProp;
+    }
+    RcRef[Index] = ApplyEdit (Ref, &Edits[Index], Offset, TRUE);
+  }
+
+  /* FdtRw one edit at a time */
+  fdt_open_into (In, Cur, Size);
+  for (Index = 0; Index < Count; Index++) {
+    RcCur[Index] = ApplyEdit (
+        Cur, &Edits[Index], FdtPathOffset (Cur, Paths[Edits[Index].Node]),
+        FALSE);
+  }
+
+  /* FdtRw batch */
+  fdt_open_into (In, Bat, Size);
+  if (FdtEditBegin (Bat)) {
+    HostPrint ("FdtEditBegin failed\n");
+    return 1;
+  }
+  for (Index = 0; Index < Count; Index++) {
+    RcBat[Index] = ApplyEdit (
+        Bat, &Edits[Index], FdtPathOffset (Bat, Paths[Edits[Index].Node]),
+        FALSE);
+  }
+  if (FdtEditCommit (Bat)) {
+    HostPrint ("FdtEditCommit failed\n");
+    return 1;
+  }
+
+  for (Index = 0; Index < Count; Index++) {
+    if (RcRef[Index] != RcCur[Index] || RcRef[Index] != RcBat[Index]) {
+      HostPrint ("edit %u returned %d through libfdt, %d sequential, "
+                 "%d batched\n",
+                 Index, RcRef[Index], RcCur[Index], RcBat[Index]);
+      return 1;
+    }
+  }
+
+  ZeroPropertyPadding (Ref);
+  ZeroPropertyPadding (Cur);
+  if (BlobEnd (Ref) != BlobEnd (Cur) || CompareMem (Ref, Cur, BlobEnd (Ref))) {
+    HostPrint ("sequential blob differs from libfdt\n");
+    return 1;
+  }
+  if (BlobEnd (Ref) != BlobEnd (Bat) || CompareMem (Ref, Bat, BlobEnd (Ref))) {
+    HostPrint ("batched blob differs from libfdt\n");
+    return 1;
+  }
+  if (CheckOffsets (Bat)) {
+    return 1;
+  }
+
+  if (Argc > 5) {
+    Bench (In, Cur, Size, Edits, Count, HostStrToUintn (Argv[5]), InSize);
+  }
+
+  for (Index = 0; Index < NumPaths; Index++) {
+    FreePool (Paths[Index]);
+  }
+  FreePool (Bat);
+  FreePool (Cur);
+  FreePool (Ref);
+  FreePool (RcBat);
+  FreePool (RcCur);
+  FreePool (RcRef);
+  FreePool (Edits);
+  FreePool (In);
+  return 0;
+}
@@ -0,0 +1,307 @@
+/* Copyright (c) 2021, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Test of the LZ4 frame decoder of Lz4Lib.
+ *
+ * Usage: lz4_test_app <plain> <frame> <seed> [rounds]
+ *
+ * <frame> is <plain> compressed by the lz4 tool. It has to decode to
+ * <plain> through Lz4Decompress (), and through Lz4FrameDecode () with the
+ * input arriving in pieces of random sizes generated from <seed>, as the
+ * fastboot download feeds it. The XXH32 of <plain> must not depend on how
+ * it is split. Decoding to a buffer one byte short and truncated frames
+ * must fail, except that a legacy frame, which has no end mark, may give a
+ * prefix of <plain>. Frames with a random bit changed must not touch memory
+ * out of the buffers, and with a content checksum they must fail or still
+ * give <plain>: the match length of the last token is not used.
+ * With [rounds], the decode speed is printed.
+ */
+
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/Lz4Lib.h>
+#include <Library/MemoryAllocationLib.h>
+
+#include "HostLib.h"
+
+#define TEST_CORRUPTIONS 200
+#define TEST_TRUNCATIONS 50
+/* Bytes decoded at most for the corruptions of a large frame */
+#define TEST_CORRUPTION_BYTES (256 * 1024 * 1024)
+
+#define LZ4_FLG_CONTENT_CHECKSUM 0x04
+
+STATIC UINT32 TestSeed;
+
+/* Number of input bytes made available next: a few bytes, up to a page,
+ * up to a MB, or all that is left.
+ */
+STATIC UINTN
+TestPiece (UINTN Left)
+{
+  STATIC CONST UINTN Limits[] = { 8, EFI_PAGE_SIZE, SIZE_1MB };
+  UINTN Count = sizeof (Limits) / sizeof (*Limits);
+  UINT32 Pick = HostRandom (&TestSeed) % (Count + 1);
+  UINTN Size;
+
+  if (Pick == Count) {
+    return Left;
+  }
+  Size = 1 + HostRandom (&TestSeed) % Limits[Pick];
+  return MIN (Left, Size);
+}
+
+/* Decodes Frame with Lz4FrameDecode () as its bytes arrive */
+STATIC EFI_STATUS
+TestStream (CONST UINT8 *Frame,
+            UINTN FrameSize,
+            UINT8 *Out,
+            UINTN OutSize,
+            UINTN *OutUsed)
+{
+  EFI_STATUS Status;
+  LZ4_FRAME_DECODER Decoder;
+  UINTN Received = 0;
+  UINTN InPos = 0;
+  UINTN OutPos = 0;
+
+  Lz4FrameInit (&Decoder);
+  do {
+    Received += TestPiece (FrameSize - Received);
+    do {
+      Status = Lz4FrameDecode (&Decoder, Frame, Received, &InPos,
+                               Received == FrameSize, Out, OutSize, &OutPos);
+    } while (Status == EFI_SUCCESS);
+  } while (Status == EFI_NOT_READY &&
+           Received < FrameSize);
+
+  if (Status != EFI_END_OF_FILE) {
+    return Status;
+  }
+  if (InPos != FrameSize) {
+    HostPrint ("stream: frame ends at %lu of %lu\n", InPos, FrameSize);
+    return EFI_VOLUME_CORRUPTED;
+  }
+  *OutUsed = OutPos;
+  return EFI_SUCCESS;
+}
+
+STATIC BOOLEAN
+TestXxh32 (CONST UINT8 *Data, UINTN Size)
+{
+  LZ4_XXH32_STATE Whole;
+  LZ4_XXH32_STATE Split;
+  UINTN Pos = 0;
+  UINTN Piece;
+
+  Lz4Xxh32Init (&Whole, 0);
+  Lz4Xxh32Update (&Whole, Data, Size);
+  Lz4Xxh32Init (&Split, 0);
+  while (Pos < Size) {
+    Piece = TestPiece (Size - Pos);
+    Lz4Xxh32Update (&Split, Data + Pos, Piece);
+    Pos += Piece;
+  }
+  return Lz4Xxh32Final (&Whole) == Lz4Xxh32Final (&Split);
+}
+
+/* Decodes to an exactly sized pool buffer, so the sanitizers see any
+ * write past the end. Returns TRUE if it decoded to Plain.
+ */
+STATIC BOOLEAN
+TestDecodes (CONST UINT8 *Frame,
+             UINTN FrameSize,
+             CONST UINT8 *Plain,
+             UINTN PlainSize,
+             BOOLEAN Stream)
+{
+  EFI_STATUS Status;
+  UINT8 *Out;
+  UINTN OutUsed = 0;
+  BOOLEAN Match;
+
+  Out = AllocatePool (PlainSize ? PlainSize : 1);
+  if (!Out) {
+    return FALSE;
+  }
+  if (Stream) {
+    Status = TestStream (Frame, FrameSize, Out, PlainSize, &OutUsed);
+  } else {
+    Status = Lz4Decompress (Frame, FrameSize, Out, PlainSize, &OutUsed);
+  }
+  Match = !EFI_ERROR (Status) &&
+          OutUsed == PlainSize &&
+          !CompareMem (Out, Plain, PlainSize);
+  FreePool (Out);
+  return Match;
+}
+
+STATIC VOID
+TestBenchmark (CONST UINT8 *Frame,
+               UINTN FrameSize,
+               UINT8 *Out,
+               UINTN OutSize,
+               UINT32 Rounds)
+{
+  LZ4_XXH32_STATE Xxh;
+  UINT64 Start;
+  UINT64 Decode;
+  UINT64 Hash;
+  UINTN OutUsed;
+  UINT32 Round;
+
+  Start = HostTimeNs ();
+  for (Round = 0; Round < Rounds; Round++) {
+    Lz4Decompress (Frame, FrameSize, Out, OutSize, &OutUsed);
+  }
+  Decode = HostTimeNs () - Start;
+
+  Start = HostTimeNs ();
+  for (Round = 0; Round < Rounds; Round++) {
+    Lz4Xxh32Init (&Xxh, 0);
+    Lz4Xxh32Update (&Xxh, Out, OutSize);
+    Lz4Xxh32Final (&Xxh);
+  }
+  Hash = HostTimeNs () - Start;
+
+  HostPrint ("%lu -> %lu bytes: decode %lu MB/s, xxh32 %lu MB/s\n",
+             (UINT64)FrameSize, (UINT64)OutSize,
+             Decode ? (UINT64)OutSize * Rounds * 1000 / Decode : 0,
+             Hash ? (UINT64)OutSize * Rounds * 1000 / Hash : 0);
+}
+
+int
+main (int Argc, char **Argv)
+{
+  EFI_STATUS Status;
+  UINT8 *Plain;
+  UINT8 *Frame;
+  UINT8 *Out;
+  UINTN PlainSize;
+  UINTN FrameSize;
+  UINTN OutUsed;
+  UINTN Pos;
+  UINTN Index;
+  UINTN Count;
+  UINT8 Flip;
+  BOOLEAN Legacy;
+  BOOLEAN Checked;
+
+  if (Argc < 4) {
+    HostPrint ("usage: %a <plain> <frame> <seed> [rounds]\n", Argv[0]);
+    return 1;
+  }
+  Plain = HostLoadFile (Argv[1], &PlainSize);
+  Frame = HostLoadFile (Argv[2], &FrameSize);
+  if (!Plain ||
+      !Frame) {
+    HostPrint ("cannot load %a or %a\n", Argv[1], Argv[2]);
+    return 1;
+  }
+  TestSeed = HostStrToUintn (Argv[3]);
+
+  if (!IsLz4Frame (Frame, FrameSize)) {
+    HostPrint ("not an LZ4 frame\n");
+    return 1;
+  }
+  Legacy = ReadUnaligned32 ((UINT32 *)Frame) == LZ4_LEGACY_MAGIC;
+  Checked = !Legacy &&
+            FrameSize > 4 &&
+            (Frame[4] & LZ4_FLG_CONTENT_CHECKSUM);
+
+  if (!TestXxh32 (Plain, PlainSize)) {
+    HostPrint ("xxh32 depends on the split of the data\n");
+    return 1;
+  }
+
+  if (!TestDecodes (Frame, FrameSize, Plain, PlainSize, FALSE)) {
+    HostPrint ("Lz4Decompress output differs\n");
+    return 1;
+  }
+  for (Index = 0; Index < 10; Index++) {
+    if (!TestDecodes (Frame, FrameSize, Plain, PlainSize, TRUE)) {
+      HostPrint ("streamed output differs\n");
+      return 1;
+    }
+  }
+
+  Out = AllocatePool (PlainSize ? PlainSize : 1);
+  if (!Out) {
+    HostPrint ("out of memory\n");
+    return 1;
+  }
+
+  if (PlainSize &&
+      !EFI_ERROR (Lz4Decompress (Frame, FrameSize, Out, PlainSize - 1,
+                                 &OutUsed))) {
+    HostPrint ("decoded to a buffer too small\n");
+    return 1;
+  }
+
+  /* A legacy frame has no end mark, cut at a block boundary it decodes to
+   * a prefix of the data.
+   */
+  for (Index = 0; Index < TEST_TRUNCATIONS; Index++) {
+    Pos = HostRandom (&TestSeed) % FrameSize;
+    Status = Lz4Decompress (Frame, Pos, Out, PlainSize, &OutUsed);
+    if (!EFI_ERROR (Status) &&
+        (!Legacy ||
+         OutUsed >= PlainSize ||
+         CompareMem (Out, Plain, OutUsed))) {
+      HostPrint ("frame truncated to %lu bytes decoded\n", Pos);
+      return 1;
+    }
+  }
+
+  Count = MIN (TEST_CORRUPTIONS, 1 + TEST_CORRUPTION_BYTES / (PlainSize + 1));
+  for (Index = 0; Index < Count; Index++) {
+    Pos = HostRandom (&TestSeed) % FrameSize;
+    Flip = 1 << (HostRandom (&TestSeed) % 8);
+    Frame[Pos] ^= Flip;
+    Status = Lz4Decompress (Frame, FrameSize, Out, PlainSize, &OutUsed);
+    if (Checked &&
+        !EFI_ERROR (Status) &&
+        (OutUsed != PlainSize ||
+         CompareMem (Out, Plain, PlainSize))) {
+      HostPrint ("frame changed at %lu decoded to other data\n", Pos);
+      return 1;
+    }
+    TestDecodes (Frame, FrameSize, Plain, PlainSize, TRUE);
+    Frame[Pos] ^= Flip;
+  }
+
+  if (Argc > 4) {
+    TestBenchmark (Frame, FrameSize, Out, PlainSize, HostStrToUintn (Argv[4]));
+  }
+
+  FreePool (Out);
+  FreePool (Frame);
+  FreePool (Plain);
+  return 0;
+}
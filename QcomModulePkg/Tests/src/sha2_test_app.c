@@ -0,0 +1,577 @@
+/* Copyright (c) 2021, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Test of the SHA-256 and SHA-512 of libavb: the Hash2Client.c dispatcher,
+ * the scalar code of avb_sha256.c and avb_sha512.c, and the Sha2Lib CPU
+ * instructions where the build machine has them.
+ *
+ * Usage: sha2_test_app <data> <sha256> <sha512> <seed> [rounds]
+ *
+ * The FIPS 180-4 examples are checked first. <data> is then hashed in
+ * updates of random sizes and must give the hex digests <sha256> and
+ * <sha512>, with a mock Hash2 protocol that works, rejects HashInit or
+ * fails HashUpdate, and from several threads at once, which must never
+ * share the protocol. A context dropped with avb_sha256_abort () must give
+ * the protocol back. With [rounds], the hash speeds are printed.
+ */
+
+#include "libavb.h"
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/Sha2Lib.h>
+#include <Protocol/Hash2.h>
+
+#include "HostLib.h"
+#include "HostUefi.h"
+
+#define TEST_SPLITS 20
+/* Bound on the bytes hashed by the split updates of large data */
+#define TEST_SPLIT_BYTES SIZE_16MB
+#define TEST_THREADS 4
+#define TEST_MILLION 1000000
+
+typedef enum {
+  MOCK_HASH2_OK,
+  MOCK_HASH2_INIT_FAILS,
+  MOCK_HASH2_UPDATE_FAILS,
+} MOCK_HASH2_MODE;
+
+/* Hash2 protocol hashing with the scalar code, which the known answers
+ * check. It keeps a single hash, as the hardware engines do.
+ */
+typedef struct {
+  EFI_HASH2_PROTOCOL Protocol;
+  MOCK_HASH2_MODE Mode;
+  UINT32 Active;
+  BOOLEAN Shared;
+  UINT64 Inits;
+  AvbSHA256Ctx Ctx;
+} MOCK_HASH2;
+
+typedef struct {
+  CONST CHAR8 *Name;
+  CONST CHAR8 *Message;
+  UINTN Repeat;
+  CONST CHAR8 *Sha256;
+  CONST CHAR8 *Sha512;
+} TEST_KAT;
+
+typedef struct {
+  CONST UINT8 *Data;
+  UINTN Size;
+  CONST UINT8 *Sha256;
+  BOOLEAN Failed;
+} TEST_THREAD_DATA;
+
+/* FIPS 180-4 examples, from the NIST Cryptographic Standards and Guidelines
+ * SHA-256 and SHA-512 example values.
+ */
+STATIC CONST TEST_KAT TestKats[] = {
+  {"empty", "", 1,
+   "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855",
+   "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce"
+   "47d0d13c5d85f2b0ff8318d2877eec2f63b931bd47417a81a538327af927da3e"},
+  {"abc", "abc", 1,
+   "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+   "ddaf35a193617abacc417349ae20413112e6fa4e89a97ea20a9eeee64b55d39a"
+   "2192992a274fc1a836ba3c23a3feebbd454d4423643ce80e2a9ac94fa54ca49f"},
+  {"448 bits", "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 1,
+   "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1",
+   "204a8fc6dda82f0a0ced7beb8e08a41657c16ef468b228a8279be331a703c335"
+   "96fd15c13b1b07f9aa1d3bea57789ca031ad85c7a71dd70354ec631238ca3445"},
+  {"896 bits",
+   "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmno"
+   "ijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu", 1,
+   "cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1",
+   "8e959b75dae313da8cf4f72814fc143f8f7779c6eb9f7fa17299aeadb6889018"
+   "501d289e4900f7e4331b99dec4b5433ac7d329eeb6dd26545e96e55b874be909"},
+  {"million a", "a", TEST_MILLION,
+   "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0",
+   "e718483d0ce769644e2e42c7bc15b4638e1f98b13b2044285632a803afa973eb"
+   "de0ff244877ea60a4cb0432ce577c31beb009c5c2c49aa2e4eadb217ad8cc09b"},
+};
+
+STATIC MOCK_HASH2 MockHash2;
+STATIC UINT32 TestSeed;
+
+STATIC EFI_STATUS
+EFIAPI
+MockHash2Init (IN CONST EFI_HASH2_PROTOCOL *This,
+               IN CONST EFI_GUID *HashAlgorithm)
+{
+  UINT32 Idle = 0;
+
+  if (!CompareGuid (HashAlgorithm, &gEfiHashAlgorithmSha256Guid) ||
+      MockHash2.Mode == MOCK_HASH2_INIT_FAILS) {
+    return EFI_UNSUPPORTED;
+  }
+  if (!__atomic_compare_exchange_n (&MockHash2.Active, &Idle, 1, FALSE,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+    MockHash2.Shared = TRUE;
+    return EFI_ALREADY_STARTED;
+  }
+  MockHash2.Inits++;
+  avb_sha256_sw_init (&MockHash2.Ctx);
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+MockHash2Update (IN CONST EFI_HASH2_PROTOCOL *This,
+                 IN CONST UINT8 *Message,
+                 IN UINTN MessageSize)
+{
+  if (!MockHash2.Active) {
+    MockHash2.Shared = TRUE;
+    return EFI_NOT_READY;
+  }
+  if (MockHash2.Mode == MOCK_HASH2_UPDATE_FAILS) {
+    return EFI_DEVICE_ERROR;
+  }
+  avb_sha256_sw_update (&MockHash2.Ctx, Message, MessageSize);
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS
+EFIAPI
+MockHash2Final (IN CONST EFI_HASH2_PROTOCOL *This,
+                IN OUT EFI_HASH2_OUTPUT *Hash)
+{
+  if (!MockHash2.Active) {
+    MockHash2.Shared = TRUE;
+    return EFI_NOT_READY;
+  }
+  CopyMem (Hash->Sha256Hash, avb_sha256_sw_final (&MockHash2.Ctx),
+           sizeof (Hash->Sha256Hash));
+  __atomic_store_n (&MockHash2.Active, 0, __ATOMIC_RELEASE);
+  return EFI_SUCCESS;
+}
+
+STATIC BOOLEAN
+TestParseHex (CONST CHAR8 *Hex, UINT8 *Out, UINTN Size)
+{
+  UINTN Index;
+  CHAR8 Byte[3] = {0};
+
+  if (AsciiStrLen (Hex) != Size * 2) {
+    return FALSE;
+  }
+  for (Index = 0; Index < Size; Index++) {
+    Byte[0] = Hex[Index * 2];
+    Byte[1] = Hex[Index * 2 + 1];
+    Out[Index] = AsciiStrHexToUintn (Byte);
+  }
+  return TRUE;
+}
+
+STATIC BOOLEAN
+TestCheck (CONST CHAR8 *What,
+           CONST UINT8 *Digest,
+           CONST UINT8 *Expected,
+           UINTN Size)
+{
+  if (CompareMem (Digest, Expected, Size)) {
+    HostPrint ("%a: wrong SHA-%u digest\n", What, (UINT32)Size * 8);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/* Size of the next update, from single bytes to megabytes, so that
+ * updates start and end anywhere in a block and the dispatcher sees first
+ * updates on both sides of its thresholds.
+ */
+STATIC UINTN
+TestPiece (UINTN Left)
+{
+  STATIC CONST UINTN Limits[] = {1, AVB_SHA256_BLOCK_SIZE,
+                                 AVB_SHA512_BLOCK_SIZE * 3, SIZE_16KB,
+                                 SIZE_64KB, SIZE_2MB};
+  UINTN Limit;
+
+  Limit = Limits[HostRandom (&TestSeed) % (sizeof (Limits) / sizeof (*Limits))];
+  if (HostRandom (&TestSeed) % 4 == 0 || Left <= Limit) {
+    return Left;
+  }
+  return 1 + HostRandom (&TestSeed) % Limit;
+}
+
+STATIC UINT8 *
+TestSha256 (AvbSHA256Ctx *Ctx,
+            CONST UINT8 *Data,
+            UINTN Size,
+            BOOLEAN Split,
+            BOOLEAN Scalar)
+{
+  UINTN Pos;
+  UINTN Piece;
+
+  if (Scalar) {
+    avb_sha256_sw_init (Ctx);
+  } else {
+    avb_sha256_init (Ctx);
+  }
+  for (Pos = 0; Pos < Size; Pos += Piece) {
+    Piece = Split ? TestPiece (Size - Pos) : Size - Pos;
+    if (Scalar) {
+      avb_sha256_sw_update (Ctx, Data + Pos, Piece);
+    } else {
+      avb_sha256_update (Ctx, Data + Pos, Piece);
+    }
+  }
+  return Scalar ? avb_sha256_sw_final (Ctx) : avb_sha256_final (Ctx);
+}
+
+STATIC UINT8 *
+TestSha512 (AvbSHA512Ctx *Ctx, CONST UINT8 *Data, UINTN Size, BOOLEAN Split)
+{
+  UINTN Pos;
+  UINTN Piece;
+
+  avb_sha512_init (Ctx);
+  for (Pos = 0; Pos < Size; Pos += Piece) {
+    Piece = Split ? TestPiece (Size - Pos) : Size - Pos;
+    avb_sha512_update (Ctx, Data + Pos, Piece);
+  }
+  return avb_sha512_final (Ctx);
+}
+
+/* Hashes Data every way and compares with the expected digests */
+STATIC BOOLEAN
+TestDigests (CONST CHAR8 *Name,
+             CONST UINT8 *Data,
+             UINTN Size,
+             CONST UINT8 *Sha256,
+             CONST UINT8 *Sha512)
+{
+  AvbSHA256Ctx Ctx256;
+  AvbSHA512Ctx Ctx512;
+  UINTN Split;
+
+  for (Split = 0; Split < 2; Split++) {
+    MockHash2.Mode = MOCK_HASH2_OK;
+    if (!TestCheck (Name, TestSha256 (&Ctx256, Data, Size, Split, TRUE),
+                    Sha256, AVB_SHA256_DIGEST_SIZE) ||
+        !TestCheck (Name, TestSha256 (&Ctx256, Data, Size, Split, FALSE),
+                    Sha256, AVB_SHA256_DIGEST_SIZE) ||
+        !avb_sha256_final_ok (&Ctx256) ||
+        !TestCheck (Name, TestSha512 (&Ctx512, Data, Size, Split), Sha512,
+                    AVB_SHA512_DIGEST_SIZE)) {
+      return FALSE;
+    }
+
+    /* The CPU takes over when the protocol cannot start a hash */
+    MockHash2.Mode = MOCK_HASH2_INIT_FAILS;
+    if (!TestCheck (Name, TestSha256 (&Ctx256, Data, Size, Split, FALSE),
+                    Sha256, AVB_SHA256_DIGEST_SIZE) ||
+        !avb_sha256_final_ok (&Ctx256)) {
+      return FALSE;
+    }
+  }
+  MockHash2.Mode = MOCK_HASH2_OK;
+  return TRUE;
+}
+
+STATIC BOOLEAN
+TestKnownAnswers (VOID)
+{
+  UINT8 Sha256[AVB_SHA256_DIGEST_SIZE];
+  UINT8 Sha512[AVB_SHA512_DIGEST_SIZE];
+  CONST TEST_KAT *Kat;
+  UINT8 *Data;
+  UINTN Len;
+  UINTN Pos;
+  UINTN Size;
+  UINTN Index;
+  BOOLEAN Ok = TRUE;
+
+  for (Index = 0; Index < sizeof (TestKats) / sizeof (*TestKats) && Ok;
+       Index++) {
+    Kat = &TestKats[Index];
+    Len = AsciiStrLen (Kat->Message);
+    Size = Len * Kat->Repeat;
+    Data = AllocatePool (Size + 1);
+    if (Data == NULL) {
+      return FALSE;
+    }
+    for (Pos = 0; Pos < Size; Pos += Len) {
+      CopyMem (Data + Pos, Kat->Message, Len);
+    }
+
+    TestParseHex (Kat->Sha256, Sha256, sizeof (Sha256));
+    TestParseHex (Kat->Sha512, Sha512, sizeof (Sha512));
+    Ok = TestDigests (Kat->Name, Data, Size, Sha256, Sha512);
+    FreePool (Data);
+  }
+  return Ok;
+}
+
+/* A failed protocol hash must be reported, not give a digest. Size is at
+ * least SIZE_2MB, above the thresholds of the dispatcher.
+ */
+STATIC BOOLEAN
+TestHash2Failure (CONST UINT8 *Data, UINTN Size)
+{
+  AvbSHA256Ctx Ctx;
+  STATIC CONST UINT8 Zero[AVB_SHA256_DIGEST_SIZE];
+  UINT64 Inits = MockHash2.Inits;
+  UINT8 *Digest;
+
+  MockHash2.Mode = MOCK_HASH2_UPDATE_FAILS;
+  avb_sha256_init (&Ctx);
+  avb_sha256_update (&Ctx, Data, SIZE_2MB);
+  Digest = avb_sha256_final (&Ctx);
+  MockHash2.Mode = MOCK_HASH2_OK;
+
+  if (MockHash2.Inits == Inits) {
+    HostPrint ("Hash2 not used for a %u byte update\n", SIZE_2MB);
+    return FALSE;
+  }
+  if (avb_sha256_final_ok (&Ctx) || CompareMem (Digest, Zero, sizeof (Zero))) {
+    HostPrint ("Hash2 failure not reported\n");
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/* The second context hashes on the CPU while the first holds the
+ * protocol, which is free again once the first is final.
+ */
+STATIC BOOLEAN
+TestHash2Claim (CONST UINT8 *Data, UINTN Size, CONST UINT8 *Sha256)
+{
+  AvbSHA256Ctx First;
+  AvbSHA256Ctx Second;
+  UINT64 Inits = MockHash2.Inits;
+  UINTN Half = Size / 2;
+
+  avb_sha256_init (&First);
+  avb_sha256_init (&Second);
+  avb_sha256_update (&First, Data, Half);
+  avb_sha256_update (&Second, Data, Half);
+  avb_sha256_update (&First, Data + Half, Size - Half);
+  avb_sha256_update (&Second, Data + Half, Size - Half);
+  if (MockHash2.Inits != Inits + 1 || MockHash2.Shared) {
+    HostPrint ("Hash2 started %u times for two contexts%a\n",
+               (UINT32)(MockHash2.Inits - Inits),
+               MockHash2.Shared ? ", and shared" : "");
+    return FALSE;
+  }
+  if (!TestCheck ("claimed", avb_sha256_final (&First), Sha256,
+                  AVB_SHA256_DIGEST_SIZE) ||
+      !TestCheck ("not claimed", avb_sha256_final (&Second), Sha256,
+                  AVB_SHA256_DIGEST_SIZE)) {
+    return FALSE;
+  }
+
+  avb_sha256_init (&First);
+  avb_sha256_update (&First, Data, Size);
+  if (MockHash2.Inits != Inits + 2) {
+    HostPrint ("Hash2 not released\n");
+    return FALSE;
+  }
+  return TestCheck ("released", avb_sha256_final (&First), Sha256,
+                    AVB_SHA256_DIGEST_SIZE);
+}
+
+/* Contexts dropped before their final, with the protocol working or
+ * failed, or already final, must leave it free for the next one.
+ */
+STATIC BOOLEAN
+TestHash2Abort (CONST UINT8 *Data, UINTN Size, CONST UINT8 *Sha256)
+{
+  STATIC CONST MOCK_HASH2_MODE Modes[] = { MOCK_HASH2_OK,
+                                           MOCK_HASH2_UPDATE_FAILS };
+  AvbSHA256Ctx Ctx;
+  UINT64 Inits;
+  UINTN Index;
+
+  for (Index = 0; Index < sizeof (Modes) / sizeof (*Modes); Index++) {
+    MockHash2.Mode = Modes[Index];
+    avb_sha256_init (&Ctx);
+    avb_sha256_update (&Ctx, Data, Size / 2);
+    avb_sha256_abort (&Ctx);
+    avb_sha256_abort (&Ctx);
+    MockHash2.Mode = MOCK_HASH2_OK;
+
+    Inits = MockHash2.Inits;
+    avb_sha256_init (&Ctx);
+    avb_sha256_update (&Ctx, Data, Size);
+    if (MockHash2.Inits != Inits + 1) {
+      HostPrint ("Hash2 not released by avb_sha256_abort ()%a\n",
+                 Index ? " after a failed update" : "");
+      return FALSE;
+    }
+    if (!TestCheck ("after abort", avb_sha256_final (&Ctx), Sha256,
+                    AVB_SHA256_DIGEST_SIZE)) {
+      return FALSE;
+    }
+    avb_sha256_abort (&Ctx);
+  }
+  if (MockHash2.Active || MockHash2.Shared) {
+    HostPrint ("Hash2 left active or shared by avb_sha256_abort ()\n");
+    return FALSE;
+  }
+  return TRUE;
+}
+
+STATIC VOID
+TestThread (VOID *Context, UINTN Index)
+{
+  TEST_THREAD_DATA *Thread = Context;
+  AvbSHA256Ctx Ctx;
+  UINTN Pos;
+  UINTN Piece;
+
+  avb_sha256_init (&Ctx);
+  for (Pos = 0; Pos < Thread->Size; Pos += Piece) {
+    Piece = MIN (SIZE_1MB * (Index % 3 + 1), Thread->Size - Pos);
+    avb_sha256_update (&Ctx, Thread->Data + Pos, Piece);
+  }
+  if (CompareMem (avb_sha256_final (&Ctx), Thread->Sha256,
+                  AVB_SHA256_DIGEST_SIZE) ||
+      !avb_sha256_final_ok (&Ctx)) {
+    __atomic_store_n (&Thread->Failed, TRUE, __ATOMIC_RELAXED);
+  }
+}
+
+STATIC BOOLEAN
+TestThreads (CONST UINT8 *Data, UINTN Size, CONST UINT8 *Sha256)
+{
+  TEST_THREAD_DATA Thread = {Data, Size, Sha256, FALSE};
+
+  HostRunParallel (TEST_THREADS, TEST_THREADS * 8, TestThread, &Thread);
+  if (MockHash2.Shared) {
+    HostPrint ("Hash2 used by several contexts at once\n");
+    return FALSE;
+  }
+  if (Thread.Failed) {
+    HostPrint ("wrong digest from the threads\n");
+    return FALSE;
+  }
+  return TRUE;
+}
+
+STATIC UINT64
+TestSpeed (UINT64 Bytes, UINT64 Start)
+{
+  UINT64 Time = HostTimeNs () - Start;
+
+  return Time ? Bytes * 1000 / Time : 0;
+}
+
+STATIC VOID
+TestBenchmark (CONST UINT8 *Data, UINTN Size, UINT32 Rounds)
+{
+  AvbSHA256Ctx Ctx256;
+  AvbSHA512Ctx Ctx512;
+  UINT64 Start;
+  UINT64 Scalar256;
+  UINT64 Dispatched;
+  UINT64 Sha512;
+  UINT32 Round;
+  UINT8 *Digest;
+
+  Start = HostTimeNs ();
+  for (Round = 0; Round < Rounds; Round++) {
+    Digest = TestSha256 (&Ctx256, Data, Size, FALSE, TRUE);
+  }
+  Scalar256 = TestSpeed ((UINT64)Size * Rounds, Start);
+
+  Start = HostTimeNs ();
+  for (Round = 0; Round < Rounds; Round++) {
+    Digest = TestSha512 (&Ctx512, Data, Size, FALSE);
+  }
+  Sha512 = TestSpeed ((UINT64)Size * Rounds, Start);
+
+  /* Through the dispatcher, on the CPU */
+  MockHash2.Mode = MOCK_HASH2_INIT_FAILS;
+  Start = HostTimeNs ();
+  for (Round = 0; Round < Rounds; Round++) {
+    Digest = TestSha256 (&Ctx256, Data, Size, FALSE, FALSE);
+  }
+  Dispatched = TestSpeed ((UINT64)Size * Rounds, Start);
+  MockHash2.Mode = MOCK_HASH2_OK;
+  (VOID)Digest;
+
+  HostPrint ("sha256 %lu MB/s (%a), %lu MB/s through the dispatcher, "
+             "sha512 %lu MB/s (%a)\n",
+             Scalar256, Sha256CeSupported () ? "instructions" : "scalar",
+             Dispatched, Sha512,
+             Sha512CeSupported () ? "instructions" : "scalar");
+}
+
+int
+main (int Argc, char **Argv)
+{
+  EFI_HANDLE Handle = NULL;
+  UINT8 Sha256[AVB_SHA256_DIGEST_SIZE];
+  UINT8 Sha512[AVB_SHA512_DIGEST_SIZE];
+  UINT8 *Data;
+  UINTN Size;
+  UINTN Index;
+  BOOLEAN Ok;
+
+  if (Argc < 5 || !TestParseHex (Argv[2], Sha256, sizeof (Sha256)) ||
+      !TestParseHex (Argv[3], Sha512, sizeof (Sha512))) {
+    HostPrint ("Usage: %a <data> <sha256> <sha512> <seed> [rounds]\n",
+               Argv[0]);
+    return 2;
+  }
+  TestSeed = HostStrToUintn (Argv[4]);
+
+  Data = HostLoadFile (Argv[1], &Size);
+  if (Data == NULL) {
+    HostPrint ("Cannot read %a\n", Argv[1]);
+    return 2;
+  }
+
+  MockHash2.Protocol.HashInit = MockHash2Init;
+  MockHash2.Protocol.HashUpdate = MockHash2Update;
+  MockHash2.Protocol.HashFinal = MockHash2Final;
+  HostInstallProtocol (&Handle, &gEfiHash2ProtocolGuid, &MockHash2.Protocol);
+
+  Ok = TestKnownAnswers ();
+  for (Index = 0; Index < MIN (TEST_SPLITS, 1 + TEST_SPLIT_BYTES / (Size + 1)) &&
+                  Ok;
+       Index++) {
+    Ok = TestDigests (Argv[1], Data, Size, Sha256, Sha512);
+  }
+  if (Ok && Size >= SIZE_2MB) {
+    Ok = TestHash2Failure (Data, Size) && TestHash2Claim (Data, Size, Sha256) &&
+         TestHash2Abort (Data, Size, Sha256) && TestThreads (Data, Size, Sha256);
+  }
+
+  if (Ok && Argc > 5) {
+    TestBenchmark (Data, Size, HostStrToUintn (Argv[5]));
+  }
+  FreePool (Data);
+  return Ok ? 0 : 1;
+}
@@ -0,0 +1,310 @@
+/* Copyright (c) 2021, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation, Inc. nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Test of ufdt_apply_multi_overlay of LibUfdt against the overlays applied
+ * one at a time with ufdt_apply_overlay, which rebuilds the lookups of the
+ * base tree for each of them.
+ *
+ * Usage: ufdt_overlay_test_app <expect> <base> <overlay>... [bench]
+ *
+ * The overlays are applied to <base> in order both ways and the blobs
+ * must be the same byte for byte. The blob must have the nodes and labels
+ * of <expect>, see gen_overlays.py, and no phandle twice.
+ * ufdt_apply_multi_overlay runs once with a dto_malloc pool sized by
+ * ufdt_multi_overlay_mem_size and once with the smallest pool, which has
+ * to be chained on. The inputs are copied for
+ * each run, as they are changed in place. With "bench" the time of both
+ * ways is printed.
+ */
+
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <libfdt.h>
+#include <libufdt_sysdeps.h>
+#include <ufdt_overlay.h>
+
+#include "HostLib.h"
+
+typedef struct {
+  UINT8 *Data;
+  UINTN Size;
+} TEST_BLOB;
+
+STATIC TEST_BLOB TestBase;
+STATIC TEST_BLOB *TestOverlays;
+STATIC UINTN TestCount;
+
+/* The overlays applied one at a time, each to the blob of the one before */
+STATIC UINT8 *
+TestChained (UINT64 *Time)
+{
+  struct fdt_entry_node Entry = {0};
+  struct fdt_header *Out;
+  UINT8 *Cur;
+  UINT8 *Next;
+  UINT8 *Overlay;
+  UINTN CurSize = TestBase.Size;
+  UINTN Index;
+  UINT64 Start;
+
+  *Time = 0;
+  Cur = AllocateCopyPool (TestBase.Size, TestBase.Data);
+  for (Index = 0; Cur != NULL && Index < TestCount; Index++) {
+    Overlay = AllocateCopyPool (TestOverlays[Index].Size,
+                                TestOverlays[Index].Data);
+    Entry.address = (UINTN)Overlay;
+    Entry.size = TestOverlays[Index].Size;
+    Next = NULL;
+    if (Overlay != NULL &&
+        pre_overlay_malloc (ufdt_multi_overlay_mem_size (
+            (struct fdt_header *)Cur, &Entry))) {
+      Start = HostTimeNs ();
+      Out = ufdt_apply_overlay (ufdt_install_blob (Cur, CurSize), CurSize,
+                                Overlay, Entry.size);
+      *Time += HostTimeNs () - Start;
+      if (Out == NULL) {
+        HostPrint ("ufdt_apply_overlay failed on overlay %u\n", Index);
+      } else {
+        CurSize = fdt_totalsize (Out);
+        Next = AllocateCopyPool (CurSize, Out);
+      }
+    }
+    post_overlay_free ();
+    FreePool (Cur);
+    if (Overlay != NULL) {
+      FreePool (Overlay);
+    }
+    Cur = Next;
+  }
+  return Cur;
+}
+
+/* Each "node <path>" of Expect is in Fdt, each "label <name> <path>" is
+ * in /__symbols__ and its node has a phandle, and no phandle is repeated.
+ */
+STATIC BOOLEAN
+TestCheckExpect (VOID *Fdt, CHAR8 *Expect)
+{
+  CHAR8 *Line;
+  CHAR8 *Next;
+  CHAR8 *Path;
+  CONST CHAR8 *Symbol;
+  UINT32 *Phandles;
+  UINT32 Count = 0;
+  UINT32 Index;
+  INT32 Offset;
+  INT32 Len;
+
+  for (Line = Expect; *Line; Line = Next) {
+    for (Next = Line; *Next && *Next != '\n'; Next++) {
+    }
+    if (*Next) {
+      *Next++ = '\0';
+    }
+    if (!AsciiStrnCmp (Line, "node ", 5)) {
+      if (fdt_path_offset (Fdt, Line + 5) < 0) {
+        HostPrint ("No node %a\n", Line + 5);
+        return FALSE;
+      }
+    } else if (!AsciiStrnCmp (Line, "label ", 6)) {
+      Path = AsciiStrStr (Line + 6, " ");
+      if (Path == NULL) {
+        continue;
+      }
+      *Path++ = '\0';
+      Offset = fdt_path_offset (Fdt, "/__symbols__");
+      Symbol = Offset >= 0 ? fdt_getprop (Fdt, Offset, Line + 6, &Len) : NULL;
+      if (Symbol == NULL || Len <= 0 || Symbol[Len - 1] != '\0' ||
+          AsciiStrCmp (Symbol, Path)) {
+        HostPrint ("Label %a is not %a\n", Line + 6, Path);
+        return FALSE;
+      }
+      Offset = fdt_path_offset (Fdt, Path);
+      if (Offset < 0 || !fdt_get_phandle (Fdt, Offset)) {
+        HostPrint ("No phandle on %a of label %a\n", Path, Line + 6);
+        return FALSE;
+      }
+    }
+  }
+
+  Phandles = AllocatePool (fdt_size_dt_struct (Fdt));
+  if (Phandles == NULL) {
+    return FALSE;
+  }
+  for (Offset = fdt_next_node (Fdt, -1, NULL); Offset >= 0;
+       Offset = fdt_next_node (Fdt, Offset, NULL)) {
+    Phandles[Count] = fdt_get_phandle (Fdt, Offset);
+    for (Index = 0; Phandles[Count] && Index < Count; Index++) {
+      if (Phandles[Index] == Phandles[Count]) {
+        HostPrint ("Phandle %u is on two nodes\n", Phandles[Count]);
+        FreePool (Phandles);
+        return FALSE;
+      }
+    }
+    Count += Phandles[Count] != 0;
+  }
+  FreePool (Phandles);
+  return TRUE;
+}
+
+/* All the overlays in one call, from a pool of PoolSize bytes or of the
+ * size ufdt_multi_overlay_mem_size estimates when PoolSize is 0.
+ */
+STATIC BOOLEAN
+TestMulti (CONST UINT8 *Expected, UINTN PoolSize, UINT64 *Time)
+{
+  struct fdt_entry_node *List;
+  struct fdt_header *Out = NULL;
+  UINT8 *Base;
+  UINTN Index;
+  UINT64 Start;
+  BOOLEAN Ok = FALSE;
+
+  Base = AllocateCopyPool (TestBase.Size, TestBase.Data);
+  List = AllocateZeroPool (TestCount * sizeof (*List));
+  for (Index = 0; List != NULL && Index < TestCount; Index++) {
+    List[Index].address = (UINTN)AllocateCopyPool (TestOverlays[Index].Size,
+                                                   TestOverlays[Index].Data);
+    List[Index].size = TestOverlays[Index].Size;
+    List[Index].next = Index + 1 < TestCount ? &List[Index + 1] : NULL;
+    if (!List[Index].address) {
+      break;
+    }
+  }
+  if (Base == NULL || List == NULL || Index < TestCount) {
+    HostPrint ("Cannot copy the device trees\n");
+    goto Out;
+  }
+
+  if (!PoolSize) {
+    PoolSize = ufdt_multi_overlay_mem_size ((struct fdt_header *)Base, List);
+  }
+  if (!pre_overlay_malloc (PoolSize)) {
+    HostPrint ("Cannot allocate a pool of %lu bytes\n", (UINT64)PoolSize);
+    goto Out;
+  }
+  Start = HostTimeNs ();
+  Out = ufdt_apply_multi_overlay (ufdt_install_blob (Base, TestBase.Size),
+                                  TestBase.Size, List);
+  *Time = HostTimeNs () - Start;
+
+  if (Out == NULL) {
+    HostPrint ("ufdt_apply_multi_overlay failed with a %lu byte pool\n",
+               (UINT64)PoolSize);
+  } else if (fdt_totalsize (Out) != fdt_totalsize (Expected) ||
+             CompareMem (Out, Expected, fdt_totalsize (Expected))) {
+    HostPrint ("ufdt_apply_multi_overlay with a %lu byte pool differs from "
+               "the chained overlays\n", (UINT64)PoolSize);
+  } else {
+    Ok = TRUE;
+  }
+
+Out:
+  post_overlay_free ();
+  for (Index = 0; List != NULL && Index < TestCount; Index++) {
+    if (List[Index].address) {
+      FreePool ((VOID *)(UINTN)List[Index].address);
+    }
+  }
+  if (List != NULL) {
+    FreePool (List);
+  }
+  if (Base != NULL) {
+    FreePool (Base);
+  }
+  return Ok;
+}
+
+int
+main (int Argc, char **Argv)
+{
+  BOOLEAN Bench = FALSE;
+  CHAR8 *Expect;
+  VOID *ExpectData;
+  UINTN ExpectSize;
+  UINT8 *Expected;
+  UINT64 ChainedTime;
+  UINT64 MultiTime;
+  UINT64 ChainedMultiTime;
+  UINTN Index;
+  BOOLEAN Ok;
+
+  if (Argc > 1 && !AsciiStrCmp (Argv[Argc - 1], "bench")) {
+    Bench = TRUE;
+    Argc--;
+  }
+  if (Argc < 4) {
+    HostPrint ("Usage: %a <expect> <base> <overlay>... [bench]\n", Argv[0]);
+    return 2;
+  }
+
+  TestCount = Argc - 3;
+  TestOverlays = AllocateZeroPool (TestCount * sizeof (*TestOverlays));
+  ExpectData = HostLoadFile (Argv[1], &ExpectSize);
+  Expect = ExpectData ? AllocateZeroPool (ExpectSize + 1) : NULL;
+  TestBase.Data = HostLoadFile (Argv[2], &TestBase.Size);
+  if (TestOverlays == NULL || Expect == NULL || TestBase.Data == NULL) {
+    HostPrint ("Cannot load %a or %a\n", Argv[1], Argv[2]);
+    return 1;
+  }
+  CopyMem (Expect, ExpectData, ExpectSize);
+  FreePool (ExpectData);
+  for (Index = 0; Index < TestCount; Index++) {
+    TestOverlays[Index].Data =
+        HostLoadFile (Argv[Index + 3], &TestOverlays[Index].Size);
+    if (TestOverlays[Index].Data == NULL) {
+      HostPrint ("Cannot load %a\n", Argv[Index + 3]);
+      return 1;
+    }
+  }
+
+  Expected = TestChained (&ChainedTime);
+  Ok = Expected != NULL &&
+       TestCheckExpect (Expected, Expect) &&
+       TestMulti (Expected, 0, &MultiTime) &&
+       TestMulti (Expected, 1, &ChainedMultiTime);
+  if (Ok && Bench) {
+    HostPrint ("ufdt: %u overlays on %u KB, one at a time %lu us, "
+               "ufdt_apply_multi_overlay %lu us, %lu us with a chained pool\n",
+               TestCount, TestBase.Size / 1024, ChainedTime / 1000,
+               MultiTime / 1000, ChainedMultiTime / 1000);
+  }
+
+  for (Index = 0; Index < TestCount; Index++) {
+    FreePool (TestOverlays[Index].Data);
+  }
+  FreePool (TestOverlays);
+  FreePool (TestBase.Data);
+  FreePool (Expect);
+  if (Expected != NULL) {
+    FreePool (Expected);
+  }
+  return Ok ? 0 : 1;
+}
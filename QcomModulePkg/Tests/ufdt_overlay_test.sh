@@ -0,0 +1,84 @@
+#!/bin/bash
+
+# Checks ufdt_apply_multi_overlay of LibUfdt against the same overlays
+# applied one at a time with ufdt_apply_overlay, byte for byte. The base
+# tree and overlays are generated by gen_overlays.py, and the result must
+# have the nodes and labels it expects and no phandle twice. Fragments
+# target nodes by label and by path, also nodes and labels of earlier
+# overlays, add and renumber phandles and move labels, so the phandle,
+# symbol and path caches of the multi overlay must follow the tree. It
+# runs with the dto_malloc pool ufdt_multi_overlay_mem_size sizes, and
+# with the smallest one, which is chained on. The time of both ways is
+# printed for the largest case.
+#
+# Usage: ufdt_overlay_test.sh [seeds]   (default 4)
+
+SCRIPT_DIR="$(dirname "$(readlink -f "$0")")"
+source ${SCRIPT_DIR}/common.sh
+
+on_exit() {
+  rm -rf "$TEMP_DIR"
+}
+
+FDT_LIB="${WORKSPACE}/EmbeddedPkg/Library/FdtLib"
+UFDT_LIB="${WORKSPACE}/EmbeddedPkg/Library/LibUfdt"
+
+build_app() {
+  local out="$1"
+  local src srcs=()
+
+  for src in fdt fdt_ro fdt_rw fdt_sw fdt_wip fdt_strerror; do
+    srcs+=("${FDT_LIB}/${src}.c")
+  done
+  for src in convert node node_dict overlay; do
+    srcs+=("${UFDT_LIB}/ufdt_${src}.c")
+  done
+
+  host_build "${out}" \
+    -I"${FDT_LIB}" -I"${UFDT_LIB}" -I"${UFDT_LIB}/include" \
+    -I"${UFDT_LIB}/sysdeps/include" \
+    "${srcs[@]}" \
+    "${UFDT_LIB}/sysdeps/libufdt_sysdeps_vendor.c" \
+    "${SCRIPT_DIR}/src/ufdt_overlay_test_app.c"
+}
+
+# Usage: run_case <overlays> <seed> [bench]
+run_case() {
+  local count="$1"
+  local seed="$2"
+  local dir="$TEMP_DIR/${count}_${seed}"
+  local out
+  shift 2
+
+  mkdir -p "$dir"
+  python3 "${SCRIPT_DIR}/gen_overlays.py" "$count" "$seed" "$dir" ||
+    die "Cannot generate ${dir}"
+  out=$("$TEMP_DIR/ufdt_overlay_test_app" "$dir/expect" "$dir/base.dtb" \
+        "$dir"/overlay-*.dtb "$@")
+  [ $? -eq 0 ] || die "${count} overlays, seed ${seed}: ${out}"
+  [ -z "$out" ] || echo "$out"
+  rm -rf "$dir"
+}
+
+main() {
+  local seeds="${1:-4}"
+  local count seed
+
+  alert "========== Running LibUfdt Overlay Tests =========="
+
+  command_exists python3 || die "python3 is needed to generate the blobs"
+
+  TEMP_DIR=`mktemp -d`
+  trap on_exit EXIT
+
+  build_app "$TEMP_DIR/ufdt_overlay_test_app"
+
+  for count in 1 2 8 32; do
+    for ((seed = 1; seed <= seeds; seed++)); do
+      run_case "$count" "$seed"
+    done
+  done
+  run_case 256 1 bench
+}
+
+main "$@"
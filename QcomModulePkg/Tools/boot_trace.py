@@ -0,0 +1,168 @@
+ # Copyright (c) 2024, The Linux Foundation. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions are
+ # met:
+ # * Redistributions of source code must retain the above copyright
+ #  notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above
+ # copyright notice, this list of conditions and the following
+ # disclaimer in the documentation and/or other materials provided
+ #  with the distribution.
+ #   * Neither the name of The Linux Foundation nor the names of its
+ # contributors may be used to endorse or promote products derived
+ # from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ # WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ # MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ # ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ # BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ # CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ # SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ # BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ # WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ # OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ # IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+# Summarize the boot trace of a device and compare it with a baseline.
+#
+# The trace is read from either of:
+#  - a copy of /chosen of the booted kernel, e.g.
+#    "adb pull /proc/device-tree/chosen chosen", which holds the
+#    "qcom,boot-trace" and "qcom,boot-trace-names" properties;
+#  - a file with the output of "fastboot oem boot-trace", or of
+#    "fastboot oem boot-trace previous" for the last boot that started a
+#    kernel, on platforms that save the trace over warm resets.
+#
+# The spans are summed per phase. With --save the totals are written to a
+# baseline file, with --check the run fails when a phase takes longer than
+# the baseline by more than the tolerance (10% and 2 ms by default), so a
+# lab device can catch boot time regressions.
+#
+# Usage: boot_trace.py <chosen dir | fastboot output> [--save <baseline>]
+#                      [--check <baseline>] [--tolerance <percent>]
+
+from __future__ import print_function
+
+import json
+import os
+import re
+import struct
+import sys
+
+TRACE_PROP = "qcom,boot-trace"
+NAMES_PROP = "qcom,boot-trace-names"
+TRACE_CELLS = 4
+MIN_SLACK_US = 2000
+
+FASTBOOT_LINE = re.compile(
+   r"(?:\(bootloader\)\s*)?([\w-]+): start (\d+) us, (\d+) us, (\d+) bytes")
+
+def read_chosen(path):
+   with open(os.path.join(path, TRACE_PROP), "rb") as f:
+      cells = f.read()
+   with open(os.path.join(path, NAMES_PROP), "rb") as f:
+      names = f.read().rstrip(b"\0").decode("ascii").split("\0")
+
+   spans = []
+   count = len(cells) // (TRACE_CELLS * 4)
+   for index in range(count):
+      ident, start, duration, size = struct.unpack_from(
+            ">%dI" % TRACE_CELLS, cells, index * TRACE_CELLS * 4)
+      name = names[ident] if ident < len(names) else "id-%d" % ident
+      spans.append((name, start, duration, size))
+   return spans
+
+def read_fastboot(path):
+   spans = []
+   with open(path, "r") as f:
+      for line in f:
+         match = FASTBOOT_LINE.search(line)
+         if match:
+            spans.append((match.group(1),) +
+                         tuple(int(x) for x in match.groups()[1:]))
+   return spans
+
+def summarize(spans):
+   phases = {}
+   for name, start, duration, size in spans:
+      phase = phases.setdefault(name, {"count": 0, "us": 0, "bytes": 0})
+      phase["count"] += 1
+      phase["us"] += duration
+      phase["bytes"] += size
+   return phases
+
+def print_summary(spans, phases):
+   if spans:
+      first = min(span[1] for span in spans)
+      last = max(span[1] + span[2] for span in spans)
+      print("%d spans, %.1f ms from first to last" %
+            (len(spans), (last - first) / 1000.0))
+   print("%-20s %6s %10s %12s %9s" % ("phase", "count", "ms", "bytes", "MB/s"))
+   for name in sorted(phases, key=lambda n: -phases[n]["us"]):
+      phase = phases[name]
+      rate = "-"
+      if phase["us"] and phase["bytes"]:
+         rate = "%.1f" % (phase["bytes"] / 1048576.0 / (phase["us"] / 1e6))
+      print("%-20s %6d %10.1f %12d %9s" % (name, phase["count"],
+            phase["us"] / 1000.0, phase["bytes"], rate))
+
+def check(phases, baseline, tolerance):
+   failed = False
+   for name in sorted(baseline):
+      if name not in phases:
+         print("%s: missing from this run" % name)
+         failed = True
+         continue
+      limit = baseline[name]["us"] * (1.0 + tolerance / 100.0)
+      limit = max(limit, baseline[name]["us"] + MIN_SLACK_US)
+      if phases[name]["us"] > limit:
+         print("%s: %.1f ms, baseline %.1f ms" % (name,
+               phases[name]["us"] / 1000.0, baseline[name]["us"] / 1000.0))
+         failed = True
+   return failed
+
+def main():
+   args = sys.argv[1:]
+   options = {"--save": None, "--check": None, "--tolerance": "10"}
+   paths = []
+   while args:
+      arg = args.pop(0)
+      if arg in options and args:
+         options[arg] = args.pop(0)
+      else:
+         paths.append(arg)
+
+   if len(paths) != 1:
+      print("Usage: boot_trace.py <chosen dir | fastboot output> "
+            "[--save <baseline>] [--check <baseline>] [--tolerance <percent>]")
+      return 2
+
+   if os.path.isdir(paths[0]):
+      spans = read_chosen(paths[0])
+   else:
+      spans = read_fastboot(paths[0])
+   if not spans:
+      print("%s: no boot trace found" % paths[0])
+      return 2
+
+   phases = summarize(spans)
+   print_summary(spans, phases)
+
+   if options["--save"]:
+      with open(options["--save"], "w") as f:
+         json.dump(phases, f, indent=1, sort_keys=True)
+
+   if options["--check"]:
+      with open(options["--check"]) as f:
+         baseline = json.load(f)
+      if check(phases, baseline, float(options["--tolerance"])):
+         print("boot trace regressed against %s" % options["--check"])
+         return 1
+      print("boot trace within %s%% of %s" % (options["--tolerance"],
+            options["--check"]))
+   return 0
+
+if __name__ == "__main__":
+   sys.exit(main())
@@ -0,0 +1,108 @@
+ # Copyright (c) 2021, The Linux Foundation. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions are
+ # met:
+ # * Redistributions of source code must retain the above copyright
+ #  notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above
+ # copyright notice, this list of conditions and the following
+ # disclaimer in the documentation and/or other materials provided
+ #  with the distribution.
+ #   * Neither the name of The Linux Foundation nor the names of its
+ # contributors may be used to endorse or promote products derived
+ # from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ # WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ # MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ # ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ # BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ # CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ # SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ # BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ # WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ # OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ # IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+# Compare the codecs for compressed fastboot downloads on an image.
+#
+# The device decodes LZ4 frames while they are being downloaded once
+# "fastboot oem download-compression lz4" is sent, a frame made with
+# "lz4 -B4 -BD --content-size <image>" can then be flashed as it is.
+# gzip and zstd are listed for reference only.
+#
+# Usage: download_compression.py <image> [link MB/s] [device/host decode ratio]
+
+from __future__ import print_function
+
+import os
+import subprocess
+import sys
+import tempfile
+import time
+import zlib
+
+def run_codec(name, compress_cmd, decompress_cmd, image, work):
+   packed = os.path.join(work, "image." + name)
+   with open(image, "rb") as src, open(packed, "wb") as dst:
+      subprocess.check_call(compress_cmd, stdin=src, stdout=dst)
+   with open(os.devnull, "wb") as null:
+      start = time.time()
+      with open(packed, "rb") as src:
+         subprocess.check_call(decompress_cmd, stdin=src, stdout=null)
+      elapsed = time.time() - start
+   return os.stat(packed).st_size, elapsed
+
+def run_gzip(image, work):
+   with open(image, "rb") as src:
+      data = src.read()
+   packed = zlib.compress(data, 6)
+   start = time.time()
+   zlib.decompress(packed)
+   return len(packed), time.time() - start
+
+def main():
+   if len(sys.argv) < 2:
+      print("Usage: download_compression.py <image> [link MB/s] [device/host decode ratio]")
+      return 1
+
+   image = sys.argv[1]
+   link = float(sys.argv[2]) if len(sys.argv) > 2 else 40.0
+   ratio = float(sys.argv[3]) if len(sys.argv) > 3 else 1.0
+   size = os.stat(image).st_size
+   mb = 1024.0 * 1024.0
+   work = tempfile.mkdtemp()
+
+   results = [("none", size, 0.0, True)]
+   results.append(("gzip",) + run_gzip(image, work) + (False,))
+   for name, comp, decomp, inline in (
+         ("lz4", ["lz4", "-q", "-B4", "-BD", "--content-size"],
+          ["lz4", "-q", "-d"], True),
+         ("zstd", ["zstd", "-q", "-3"], ["zstd", "-q", "-d"], False)):
+      try:
+         results.append((name,) + run_codec(name, comp, decomp, image, work) +
+                        (inline,))
+      except OSError:
+         print("%s: not found, skipped" % comp[0])
+
+   print("%-6s %12s %7s %12s %12s" % ("codec", "bytes", "ratio", "decode MB/s",
+                                       "flash MB/s"))
+   for name, packed, decode, inline in results:
+      transfer = packed / mb / link
+      decode = decode / ratio
+      # LZ4 is decoded while the next transfer is running, the other codecs
+      # would have to be decoded after the download.
+      total = max(transfer, decode) if inline else transfer + decode
+      print("%-6s %12d %7.3f %12s %12.1f" % (
+            name, packed, float(packed) / size,
+            "%.1f" % (size / mb / decode) if decode else "-",
+            size / mb / total))
+
+   for name in os.listdir(work):
+      os.remove(os.path.join(work, name))
+   os.rmdir(work)
+   return 0
+
+if __name__ == "__main__":
+   sys.exit(main())
@@ -0,0 +1,183 @@
+ # Copyright (c) 2024, The Linux Foundation. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions are
+ # met:
+ # * Redistributions of source code must retain the above copyright
+ #  notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above
+ # copyright notice, this list of conditions and the following
+ # disclaimer in the documentation and/or other materials provided
+ #  with the distribution.
+ #   * Neither the name of The Linux Foundation nor the names of its
+ # contributors may be used to endorse or promote products derived
+ # from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ # WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ # MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ # ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ # BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ # CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ # SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ # BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ # WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ # OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ # IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+# Write or verify the match index of a dtbo image.
+#
+# The index is kept in the Custom fields of each dt_table_entry, see
+# DTBO_INDEX_MAGIC in LocateDeviceTree.h. It lets the bootloader skip the
+# overlays that cannot match the board without parsing them. Entries the
+# bootloader does need to parse are checked against their index, and a
+# stale index makes it parse every entry.
+#
+# Run "write" on the image from mkdtboimg before avbtool adds the hash
+# footer, the index is part of the verified image.
+#
+# Usage: dtbo_index.py write <dtbo.img>
+#        dtbo_index.py verify <dtbo.img>
+#        dtbo_index.py clear <dtbo.img>
+
+from __future__ import print_function
+
+import struct
+import sys
+
+DT_TABLE_MAGIC = 0xd7b7ab1e
+DT_TABLE_HEADER = ">8I"
+DT_TABLE_ENTRY = ">8I"
+FDT_MAGIC = 0xd00dfeed
+FDT_BEGIN_NODE = 1
+FDT_END_NODE = 2
+FDT_PROP = 3
+FDT_NOP = 4
+
+INDEX_MAGIC = 0x51444931
+SOC_ALL = 0xffffffff
+BOARD_VALID = 1 << 31
+SOC_MASK = 0xffff
+VARIANT_MASK = 0xff
+SUBTYPE_MASK = 0xff
+SUBTYPE_SHIFT_ID = 24
+PLAT_ID_SIZE = 8
+BOARD_ID_SIZE = 8
+
+def root_props(dtb):
+   """Properties of the root node of a flattened device tree"""
+   magic, total, off_struct, off_strings = struct.unpack_from(">4I", dtb, 0)
+   if magic != FDT_MAGIC or total > len(dtb):
+      raise ValueError("not a device tree")
+
+   props = {}
+   pos = off_struct
+   depth = 0
+   while True:
+      token, = struct.unpack_from(">I", dtb, pos)
+      pos += 4
+      if token == FDT_BEGIN_NODE:
+         if depth > 0:
+            # Root properties come before any subnode
+            break
+         depth += 1
+         pos = dtb.index(b"\0", pos) + 1
+         pos = (pos + 3) & ~3
+      elif token == FDT_PROP:
+         length, name_off = struct.unpack_from(">II", dtb, pos)
+         pos += 8
+         name_end = dtb.index(b"\0", off_strings + name_off)
+         name = dtb[off_strings + name_off:name_end].decode("ascii")
+         props[name] = dtb[pos:pos + length]
+         pos = (pos + length + 3) & ~3
+      elif token == FDT_NOP:
+         continue
+      else:
+         break
+   return props
+
+def compute_index(dtb):
+   """The Custom[1] and Custom[2] words of a dtb, as DtboIndexCompute"""
+   props = root_props(dtb)
+
+   soc_mask = SOC_ALL
+   msm_id = props.get("qcom,msm-id", b"")
+   if len(msm_id) > 0 and len(msm_id) % PLAT_ID_SIZE == 0:
+      soc_mask = 0
+      for pos in range(0, len(msm_id), PLAT_ID_SIZE):
+         platform_id, = struct.unpack_from(">I", msm_id, pos)
+         soc_mask |= 1 << ((platform_id & SOC_MASK) % 32)
+
+   board = 0
+   board_id = props.get("qcom,board-id", b"")
+   if len(board_id) > 0 and len(board_id) % BOARD_ID_SIZE == 0:
+      variant, subtype = struct.unpack_from(">II", board_id, 0)
+      if subtype == 0:
+         subtype = variant >> SUBTYPE_SHIFT_ID
+      board = (BOARD_VALID | (variant & VARIANT_MASK) |
+               ((subtype & SUBTYPE_MASK) << 8))
+   return soc_mask, board
+
+def entries(image):
+   (magic, total, header_size, entry_size, count, entry_offset, page_size,
+    version) = struct.unpack_from(DT_TABLE_HEADER, image, 0)
+   if magic != DT_TABLE_MAGIC:
+      raise ValueError("not a dtbo image")
+   if version != 0:
+      # Version 1 keeps compression flags in Custom[0]
+      raise ValueError("dt_table version %d is not supported" % version)
+   for index in range(count):
+      pos = entry_offset + index * entry_size
+      yield index, pos, list(struct.unpack_from(DT_TABLE_ENTRY, image, pos))
+
+def main():
+   if len(sys.argv) != 3 or sys.argv[1] not in ("write", "verify", "clear"):
+      print("Usage: dtbo_index.py write|verify|clear <dtbo.img>")
+      return 2
+
+   command, path = sys.argv[1], sys.argv[2]
+   with open(path, "rb") as f:
+      image = bytearray(f.read())
+
+   stale = 0
+   count = 0
+   for index, pos, entry in entries(image):
+      dt_size, dt_offset = entry[0], entry[1]
+      custom = entry[4:8]
+      count += 1
+      if command == "clear":
+         if custom[0] == INDEX_MAGIC:
+            entry[4:8] = [0, 0, 0, 0]
+         struct.pack_into(DT_TABLE_ENTRY, image, pos, *entry)
+         continue
+
+      dtb = bytes(image[dt_offset:dt_offset + dt_size])
+      soc_mask, board = compute_index(dtb)
+      wanted = [INDEX_MAGIC, soc_mask, board, 0]
+      if command == "write":
+         if any(custom) and custom[0] != INDEX_MAGIC:
+            raise ValueError("entry %d already uses its custom fields" % index)
+         entry[4:8] = wanted
+         struct.pack_into(DT_TABLE_ENTRY, image, pos, *entry)
+      elif custom != wanted:
+         print("entry %d: index %s, expected %s" % (index,
+               " ".join("%08x" % x for x in custom),
+               " ".join("%08x" % x for x in wanted)))
+         stale += 1
+
+   if command == "verify":
+      if stale:
+         print("%d of %d entries have a missing or stale index" %
+               (stale, count))
+         return 1
+      print("%d entries, index is up to date" % count)
+      return 0
+
+   with open(path, "wb") as f:
+      f.write(image)
+   print("%s: %s index of %d entries" % (path,
+         "wrote" if command == "write" else "cleared", count))
+   return 0
+
+if __name__ == "__main__":
+   sys.exit(main())
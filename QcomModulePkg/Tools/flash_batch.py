@@ -0,0 +1,95 @@
+ # Copyright (c) 2021, The Linux Foundation. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions are
+ # met:
+ # * Redistributions of source code must retain the above copyright
+ #  notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above
+ # copyright notice, this list of conditions and the following
+ # disclaimer in the documentation and/or other materials provided
+ #  with the distribution.
+ #   * Neither the name of The Linux Foundation nor the names of its
+ # contributors may be used to endorse or promote products derived
+ # from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ # WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ # MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ # ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ # BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ # CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ # SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ # BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ # WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ # OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ # IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+# Pack images into a download for the "flash-batch" fastboot command, see
+# Library/FastbootLib/BatchFormat.h. Raw and sparse images can be mixed.
+#
+# Usage: flash_batch.py <output> <partition>=<image> [...]
+# The output is downloaded as one image and flashed with "flash-batch".
+
+from __future__ import print_function
+
+import os
+import struct
+import sys
+
+BATCH_HEADER_MAGIC = 0x48435442
+BATCH_MAJOR_VERSION = 1
+BATCH_MINOR_VERSION = 0
+BATCH_PARTITION_NAME_SZ = 72
+MAX_IMAGES_IN_BATCH = 64
+HEADER_FORMAT = "<IHHHHI"
+ENTRY_FORMAT = "<%dsQQ" % BATCH_PARTITION_NAME_SZ
+# Images start on a page so that the device reads them aligned
+IMAGE_ALIGN = 4096
+
+def main():
+   if len(sys.argv) < 3:
+      print("Usage: flash_batch.py <output> <partition>=<image> [...]")
+      return 1
+
+   entries = []
+   for arg in sys.argv[2:]:
+      name, sep, path = arg.partition("=")
+      if not sep or not name or len(name) >= BATCH_PARTITION_NAME_SZ:
+         print("Invalid entry: %s" % arg)
+         return 1
+      entries.append((name, path, os.stat(path).st_size))
+
+   if len(entries) > MAX_IMAGES_IN_BATCH:
+      print("At most %d images can be batched" % MAX_IMAGES_IN_BATCH)
+      return 1
+
+   header_sz = struct.calcsize(HEADER_FORMAT)
+   entry_sz = struct.calcsize(ENTRY_FORMAT)
+   offset = header_sz + entry_sz * len(entries)
+   table = []
+   for name, path, size in entries:
+      offset = (offset + IMAGE_ALIGN - 1) & ~(IMAGE_ALIGN - 1)
+      table.append((name, path, offset, size))
+      offset += size
+
+   with open(sys.argv[1], "wb") as out:
+      out.write(struct.pack(HEADER_FORMAT, BATCH_HEADER_MAGIC,
+                            BATCH_MAJOR_VERSION, BATCH_MINOR_VERSION,
+                            header_sz, entry_sz, len(table)))
+      for name, path, offset, size in table:
+         out.write(struct.pack(ENTRY_FORMAT, name.encode("ascii"), offset,
+                               size))
+      for name, path, offset, size in table:
+         out.write(b"\0" * (offset - out.tell()))
+         with open(path, "rb") as image:
+            while True:
+               data = image.read(1024 * 1024)
+               if not data:
+                  break
+               out.write(data)
+         print("%-24s %12d bytes at 0x%x" % (name, size, offset))
+   return 0
+
+if __name__ == "__main__":
+   sys.exit(main())